@@ -7,6 +7,7 @@
 
 #import "AppDelegate.h"
 #import "CoreDataManager.h"
+#import <AsyncDisplayKit/ASTrace.h>
 
 @interface AppDelegate ()
 
@@ -21,9 +22,24 @@
     // 初始化CoreDataManager
     [CoreDataManager sharedManager];
     
+    // 以 -TokenTrace 启动时记录从 SSE 数据到上屏的时间线，进入后台时导出为 Chrome trace JSON
+    if ([[NSProcessInfo processInfo].arguments containsObject:@"-TokenTrace"]) {
+        [self startTokenTrace];
+    }
+    
     return YES;
 }
 
+- (void)startTokenTrace {
+    ASTraceStart();
+    [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidEnterBackgroundNotification object:nil queue:[NSOperationQueue mainQueue] usingBlock:^(NSNotification * _Nonnull note) {
+        NSURL *documents = [[NSFileManager defaultManager] URLsForDirectory:NSDocumentDirectory inDomains:NSUserDomainMask].firstObject;
+        NSURL *traceURL = [documents URLByAppendingPathComponent:@"token-trace.json"];
+        [ASTraceCopyChromeTrace() writeToURL:traceURL atomically:YES];
+        NSLog(@"Token trace written to %@ (%llu events dropped)", traceURL.path, ASTraceDroppedEventCount());
+    }];
+}
+
 
 #pragma mark - UISceneSession lifecycle
 
@@ -0,0 +1,878 @@
+// Checks the pipeline behind AttachmentThumbnailService and compares it with
+// making thumbnails per request, on simulated chat sessions.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -o attachment_thumbnail_bench
+//      attachment_thumbnail_bench.c ../Tool/AttachmentThumbnailPipeline.c
+//   ./attachment_thumbnail_bench [--quick] > result.json
+//
+// First checks the hash against XXH64 and across chunkings, sampling of
+// large contents, and stored records, every byte of which is covered by the
+// checksum. Then runs random operations on the queue against a model of it,
+// checking that jobs start in priority and queue order within the limits
+// and that finishing one reaches every waiter that joined it. Exits with 1
+// on failure.
+//
+// Then replays sessions of a chat, with the app relaunched between them.
+// The user picks photos, screenshots and PDFs into the input tray one at a
+// time, sometimes deletes one, and sends; every change rebuilds the tray's
+// thumbnails. Sent attachments show in the message list once uploaded,
+// whose cells are built again as the reply streams in, and the user scrolls
+// back to older messages now and then. Three pipelines are compared:
+//
+// - per_request: what the app did. Each tray rebuild asks QuickLook for
+//   every file again; the list downloads through PINRemoteImage, which
+//   joins concurrent downloads, keeps bytes on disk and decoded images in
+//   memory, but decodes at full size. Nothing limits how many run at once.
+// - pool: one job per attachment however many ask for it, the list's
+//   requests joining the tray's, decoding at thumbnail size, with two
+//   decoders and three downloads at a time. Thumbnails live in memory only,
+//   so after a relaunch the list downloads again. A picked image waits for
+//   its thumbnail here, though the tray shows the image itself meanwhile.
+// - pool_persistent: the same with thumbnails stored by content, so no
+//   attachment is made a thumbnail of more than once.
+//
+// Reports how many thumbnails were made, the CPU time and downloads spent,
+// the peak memory of images being decoded, and how long each surface waited
+// for its thumbnails. Costs are a rough model of a phone with four cores.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Tool/AttachmentThumbnailPipeline.h"
+
+#define TRIALS 3
+#define TICK 0.001
+#define CORES 4.0
+#define BANDWIDTH (2.0 * 1024 * 1024)
+#define FIRST_BYTE_SECONDS 0.15
+#define DECODE_LIMIT 2
+#define FETCH_LIMIT 3
+#define THUMBNAIL_PIXELS 256
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+static double S_uniform(double low, double high) {
+  return low + (high - low) * (double)S_random(1u << 30) / (double)(1u << 30);
+}
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int S_failures = 0;
+
+#define S_CHECK(condition, ...)                                \
+  do {                                                         \
+    if (!(condition)) {                                        \
+      if (S_failures++ < 10) {                                 \
+        fprintf(stderr, "%s:%d: ", __func__, __LINE__);        \
+        fprintf(stderr, __VA_ARGS__);                          \
+        fprintf(stderr, "\n");                                 \
+      }                                                        \
+    }                                                          \
+  } while (0)
+
+// MARK: - Hash and record checks
+
+static void S_fill(uint8_t *bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    bytes[i] = (uint8_t)S_random(256);
+  }
+}
+
+static void S_check_hash(void) {
+  const char *spam = "Nobody inspects the spammish repetition";
+  S_CHECK(AttachmentThumbnailHash("", 0, 0) == 0xEF46DB3751D8E999ull, "empty");
+  S_CHECK(AttachmentThumbnailHash("abc", 3, 0) == 0x44BC2CF5AD770999ull, "abc");
+  S_CHECK(AttachmentThumbnailHash(spam, strlen(spam), 0) == 0xFBCEA83C8A378BF1ull, "spam");
+
+  // Any chunking hashes the same as one call.
+  uint8_t bytes[700];
+  for (int round = 0; round < 400; round++) {
+    size_t length = S_random(sizeof(bytes));
+    uint64_t seed = S_random(3) == 0 ? 0 : ((uint64_t)S_random(1u << 31) << 32 | S_random(1u << 31));
+    S_fill(bytes, length);
+    uint64_t whole = AttachmentThumbnailHash(bytes, length, seed);
+    AttachmentThumbnailHasher hasher;
+    AttachmentThumbnailHasherInit(&hasher, seed);
+    size_t offset = 0;
+    while (offset < length) {
+      size_t chunk = 1 + S_random(S_random(2) ? 40 : 200);
+      chunk = chunk > length - offset ? length - offset : chunk;
+      AttachmentThumbnailHasherUpdate(&hasher, bytes + offset, chunk);
+      offset += chunk;
+    }
+    S_CHECK(AttachmentThumbnailHasherFinal(&hasher) == whole, "chunked length %zu", length);
+    if (length > 0) {
+      bytes[S_random((uint32_t)length)] ^= 1 << S_random(8);
+      S_CHECK(AttachmentThumbnailHash(bytes, length, seed) != whole, "bit flip at length %zu", length);
+    }
+  }
+
+  // Small contents are hashed whole; large ones by length and three samples.
+  size_t large = AttachmentThumbnailSampledHashThreshold + (5u << 20) + 3;
+  uint8_t *content = (uint8_t *)malloc(large);
+  S_fill(content, large);
+  S_CHECK(AttachmentThumbnailContentHash(content, 1000) == AttachmentThumbnailHash(content, 1000, 0), "small is whole");
+  uint64_t sampled = AttachmentThumbnailContentHash(content, large);
+  content[AttachmentThumbnailSampleLength + 10] ^= 1;
+  S_CHECK(AttachmentThumbnailContentHash(content, large) == sampled, "outside the samples");
+  content[large / 2] ^= 1;
+  S_CHECK(AttachmentThumbnailContentHash(content, large) != sampled, "middle sample");
+  content[large / 2] ^= 1;
+  content[large - 1] ^= 1;
+  S_CHECK(AttachmentThumbnailContentHash(content, large) != sampled, "end sample");
+  content[large - 1] ^= 1;
+  S_CHECK(AttachmentThumbnailContentHash(content, large - 1) != sampled, "length");
+  free(content);
+
+  char key[34];
+  S_CHECK(AttachmentThumbnailFormatContentKey(~0ull, ~0ull, key, sizeof(key)) == 33 && strcmp(key, "ffffffffffffffff-ffffffffffffffff") == 0, "%s", key);
+  S_CHECK(AttachmentThumbnailFormatContentKey(0xab, 0x10, key, sizeof(key)) == 19 && strcmp(key, "00000000000000ab-10") == 0, "%s", key);
+  S_CHECK(AttachmentThumbnailFormatContentKey(0xab, 0x10, key, 19) == 0, "too small");
+
+  S_CHECK(AttachmentThumbnailBucketPixelSize(0) == 256 && AttachmentThumbnailBucketPixelSize(180) == 256, "small");
+  S_CHECK(AttachmentThumbnailBucketPixelSize(240) == 256 && AttachmentThumbnailBucketPixelSize(257) == 512, "power of two");
+  S_CHECK(AttachmentThumbnailBucketPixelSize(100000) == 2048, "largest");
+}
+
+static void S_check_records(void) {
+  uint8_t record[AttachmentThumbnailRecordHeaderLength + 300];
+  for (int round = 0; round < 40; round++) {
+    AttachmentThumbnailRecordInfo info = {S_random(4096), S_random(4096), (uint64_t)S_random(1u << 30) << 20, S_random(300)};
+    uint8_t *payload = record + AttachmentThumbnailRecordHeaderLength;
+    S_fill(payload, info.payloadLength);
+    AttachmentThumbnailRecordWriteHeader(record, &info, payload);
+    size_t length = AttachmentThumbnailRecordHeaderLength + info.payloadLength;
+
+    AttachmentThumbnailRecordInfo read;
+    const void *readPayload = NULL;
+    S_CHECK(AttachmentThumbnailRecordRead(record, length, &read, &readPayload), "valid");
+    S_CHECK(read.width == info.width && read.height == info.height && read.contentHash == info.contentHash
+                && read.payloadLength == info.payloadLength && readPayload == payload, "fields");
+    S_CHECK(!AttachmentThumbnailRecordRead(record, length - 1, &read, &readPayload), "truncated");
+    S_CHECK(!AttachmentThumbnailRecordRead(record, AttachmentThumbnailRecordHeaderLength - 1, &read, &readPayload), "short header");
+    if (length < sizeof(record)) {
+      S_CHECK(!AttachmentThumbnailRecordRead(record, length + 1, &read, &readPayload), "trailing byte");
+    }
+    for (size_t i = 0; i < length; i++) {
+      uint8_t bit = (uint8_t)(1 << S_random(8));
+      record[i] ^= bit;
+      S_CHECK(!AttachmentThumbnailRecordRead(record, length, &read, &readPayload), "flip at %zu of %zu", i, length);
+      record[i] ^= bit;
+    }
+  }
+}
+
+// MARK: - Queue checks
+
+#define KEY_COUNT 24
+#define WAITER_CAPACITY 4096
+
+typedef struct {
+  bool present;
+  bool running;
+  uint32_t lane;
+  uint32_t priority;
+  uint64_t sequence;
+  uintptr_t waiters[WAITER_CAPACITY];
+  size_t waiterCount;
+} model_job;
+
+typedef struct {
+  uintptr_t waiters[WAITER_CAPACITY];
+  size_t count;
+} finished;
+
+static void S_record_waiter(void *context, void *waiter) {
+  finished *f = (finished *)context;
+  f->waiters[f->count++] = (uintptr_t)waiter;
+}
+
+static void S_queue_key(char *buffer, size_t size, uint32_t key) {
+  snprintf(buffer, size, "file:///private/var/mobile/tmp/attachment-%u.pdf@256", key);
+}
+
+static uint32_t S_queue_key_index(const char *key, size_t keyLength) {
+  const char *dash = NULL;
+  for (size_t i = 0; i < keyLength; i++) {
+    if (key[i] == '-') {
+      dash = key + i;
+    }
+  }
+  return dash ? (uint32_t)strtoul(dash + 1, NULL, 10) : KEY_COUNT;
+}
+
+static void S_check_queue(int rounds) {
+  model_job *jobs = (model_job *)calloc(KEY_COUNT, sizeof(model_job));
+  for (int round = 0; round < rounds; round++) {
+    uint32_t limits[AttachmentThumbnailLaneCount] = {S_random(4), S_random(4)};
+    AttachmentThumbnailQueue *queue = AttachmentThumbnailQueueCreate(limits[0], limits[1]);
+    memset(jobs, 0, KEY_COUNT * sizeof(model_job));
+    uint64_t sequence = 0;
+    uintptr_t nextWaiter = 1;
+    char key[96];
+
+    for (int step = 0; step < 2000; step++) {
+      uint32_t k = S_random(KEY_COUNT);
+      model_job *job = &jobs[k];
+      S_queue_key(key, sizeof(key), k);
+      switch (S_random(5)) {
+        case 0:
+        case 1: {
+          uint32_t lane = S_random(AttachmentThumbnailLaneCount);
+          uint32_t priority = S_random(AttachmentThumbnailPriorityCount);
+          if (job->waiterCount == WAITER_CAPACITY) {
+            break;
+          }
+          uintptr_t waiter = nextWaiter++;
+          AttachmentThumbnailQueueAddResult result = AttachmentThumbnailQueueAdd(queue, key, strlen(key), lane, priority, (void *)waiter);
+          if (job->present) {
+            S_CHECK(result == AttachmentThumbnailQueueAddJoined, "joins");
+            if (!job->running && priority > job->priority) {
+              job->priority = priority;
+              job->sequence = sequence++;
+            }
+          } else {
+            S_CHECK(result == AttachmentThumbnailQueueAddQueued, "queues");
+            job->present = true;
+            job->running = false;
+            job->lane = lane;
+            job->priority = priority;
+            job->sequence = sequence++;
+          }
+          job->waiters[job->waiterCount++] = waiter;
+          break;
+        }
+        case 2:
+        case 3: {
+          AttachmentThumbnailQueueJob started[4];
+          size_t capacity = 1 + S_random(4);
+          size_t count = AttachmentThumbnailQueueNext(queue, started, capacity);
+          for (size_t i = 0; i <= count && i < capacity; i++) {
+            // What the model would start next.
+            model_job *best = NULL;
+            for (int p = AttachmentThumbnailPriorityCount - 1; p >= 0 && best == NULL; p--) {
+              for (uint32_t j = 0; j < KEY_COUNT; j++) {
+                model_job *candidate = &jobs[j];
+                if (!candidate->present || candidate->running || candidate->priority != (uint32_t)p) {
+                  continue;
+                }
+                if (limits[candidate->lane] > 0 && AttachmentThumbnailQueueRunningCount(queue, candidate->lane) - (i < count && started[i].lane == candidate->lane ? 1 : 0) >= limits[candidate->lane]) {
+                  continue;
+                }
+                if (best == NULL || candidate->sequence < best->sequence) {
+                  best = candidate;
+                }
+              }
+            }
+            if (i == count) {
+              S_CHECK(best == NULL, "stopped with %u startable", (unsigned)(best - jobs));
+              break;
+            }
+            uint32_t index = S_queue_key_index(started[i].key, started[i].keyLength);
+            S_CHECK(best == &jobs[index % KEY_COUNT], "started %u, model %d", index, best ? (int)(best - jobs) : -1);
+            S_CHECK(started[i].keyLength == strlen(started[i].key), "key length");
+            if (index < KEY_COUNT) {
+              jobs[index].running = true;
+              S_CHECK(started[i].lane == jobs[index].lane, "lane");
+            }
+          }
+          break;
+        }
+        case 4: {
+          finished f = {{0}, 0};
+          size_t count = AttachmentThumbnailQueueFinish(queue, key, strlen(key), S_record_waiter, &f);
+          if (job->present && job->running) {
+            S_CHECK(count == job->waiterCount && f.count == count, "waiters %zu of %zu", count, job->waiterCount);
+            S_CHECK(memcmp(f.waiters, job->waiters, count * sizeof(uintptr_t)) == 0, "waiters in order");
+            memset(job, 0, sizeof(*job));
+          } else {
+            S_CHECK(count == 0 && f.count == 0, "finished a job not running");
+          }
+          break;
+        }
+      }
+
+      size_t queued = 0;
+      size_t running[AttachmentThumbnailLaneCount] = {0, 0};
+      for (uint32_t j = 0; j < KEY_COUNT; j++) {
+        if (jobs[j].present) {
+          if (jobs[j].running) {
+            running[jobs[j].lane]++;
+          } else {
+            queued++;
+          }
+        }
+      }
+      S_CHECK(AttachmentThumbnailQueueQueuedCount(queue) == queued, "queued %zu, model %zu", AttachmentThumbnailQueueQueuedCount(queue), queued);
+      for (uint32_t lane = 0; lane < AttachmentThumbnailLaneCount; lane++) {
+        S_CHECK(AttachmentThumbnailQueueRunningCount(queue, lane) == running[lane], "running");
+        S_CHECK(limits[lane] == 0 || running[lane] <= limits[lane], "over the limit");
+      }
+      if (S_failures) {
+        break;
+      }
+    }
+
+    finished f = {{0}, 0};
+    size_t expected = 0;
+    for (uint32_t j = 0; j < KEY_COUNT; j++) {
+      expected += jobs[j].waiterCount;
+    }
+    if (expected <= WAITER_CAPACITY) {
+      AttachmentThumbnailQueueDestroy(queue, S_record_waiter, &f);
+      S_CHECK(f.count == expected, "destroy reaches %zu of %zu waiters", f.count, expected);
+    } else {
+      AttachmentThumbnailQueueDestroy(queue, NULL, NULL);
+    }
+    if (S_failures) {
+      break;
+    }
+  }
+  free(jobs);
+}
+
+// MARK: - Simulation
+
+typedef enum { KIND_PHOTO, KIND_SCREENSHOT, KIND_PDF, KIND_COUNT } kind;
+
+typedef struct {
+  double share;
+  /** Picked as a UIImage, which has no file and is uploaded re-encoded. */
+  bool image;
+  double bytes;
+  double pixels;
+  double fullDecodeSeconds;
+  /** Decoding straight to the thumbnail size; for a picked image, downsampling its bitmap. */
+  double thumbnailSeconds;
+  double quickLookSeconds;
+  /** Whether a downloaded copy can be decoded at all; PDFs can't. */
+  bool decodable;
+} kind_info;
+
+static const kind_info S_kinds[KIND_COUNT] = {
+  {0.6, true, 3.5e6, 12e6, 0.120, 0.022, 0.140, true},
+  {0.25, false, 2.5e6, 3.5e6, 0.045, 0.040, 0.060, true},
+  {0.15, false, 1.0e6, 2.0e6, 0.0, 0.060, 0.060, false},
+};
+
+#define RECORD_SECONDS 0.0015
+#define SESSION_GAP 100000.0
+
+typedef enum { SURFACE_TRAY, SURFACE_LIST, SURFACE_COUNT } surface;
+static const char *S_surface_names[SURFACE_COUNT] = {"tray", "list"};
+
+typedef struct {
+  kind kind;
+  uint32_t session;
+} attachment;
+
+typedef struct {
+  double time;
+  uint32_t attachment;
+  surface surface;
+  uint32_t session;
+} request;
+
+typedef struct {
+  attachment *attachments;
+  size_t attachmentCount;
+  request *requests;
+  size_t requestCount;
+  size_t requestCapacity;
+} workload;
+
+static void S_add_request(workload *w, double time, uint32_t a, surface s, uint32_t session) {
+  if (w->requestCount == w->requestCapacity) {
+    w->requestCapacity = w->requestCapacity ? w->requestCapacity * 2 : 256;
+    w->requests = (request *)realloc(w->requests, w->requestCapacity * sizeof(request));
+  }
+  w->requests[w->requestCount++] = (request){time, a, s, session};
+}
+
+static int S_compare_requests(const void *a, const void *b) {
+  const request *x = (const request *)a, *y = (const request *)b;
+  return x->time < y->time ? -1 : x->time > y->time ? 1 : 0;
+}
+
+static kind S_pick_kind(void) {
+  double r = S_uniform(0, 1);
+  for (int k = 0; k < KIND_COUNT - 1; k++) {
+    if ((r -= S_kinds[k].share) < 0) {
+      return (kind)k;
+    }
+  }
+  return (kind)(KIND_COUNT - 1);
+}
+
+static void S_list_message(workload *w, const uint32_t *message, size_t count, double time, uint32_t session) {
+  for (size_t i = 0; i < count; i++) {
+    S_add_request(w, time, message[i], SURFACE_LIST, session);
+  }
+}
+
+static workload S_make_workload(uint32_t sessions, uint32_t sendsPerSession) {
+  workload w = {0};
+  size_t maxAttachments = (size_t)sessions * sendsPerSession * 4;
+  w.attachments = (attachment *)calloc(maxAttachments, sizeof(attachment));
+  // Each sent message's attachments, four at most.
+  uint32_t (*messages)[4] = calloc((size_t)sessions * sendsPerSession, sizeof(*messages));
+  size_t *messageSizes = (size_t *)calloc((size_t)sessions * sendsPerSession, sizeof(size_t));
+  size_t messageCount = 0;
+
+  for (uint32_t session = 0; session < sessions; session++) {
+    double t = session * SESSION_GAP;
+    // Opening the chat shows its last messages.
+    for (size_t m = messageCount > 6 ? messageCount - 6 : 0; m < messageCount; m++) {
+      S_list_message(&w, messages[m], messageSizes[m], t + S_uniform(0, 0.3), session);
+    }
+    for (uint32_t send = 0; send < sendsPerSession; send++) {
+      uint32_t tray[4];
+      size_t trayCount = 0;
+      uint32_t picks = 1 + S_random(3);
+      for (uint32_t p = 0; p < picks; p++) {
+        t += S_uniform(1.5, 4.0);
+        uint32_t a = (uint32_t)w.attachmentCount++;
+        w.attachments[a] = (attachment){S_pick_kind(), session};
+        tray[trayCount++] = a;
+        for (size_t i = 0; i < trayCount; i++) {
+          S_add_request(&w, t, tray[i], SURFACE_TRAY, session);
+        }
+        if (trayCount > 1 && S_random(10) == 0) {
+          t += S_uniform(0.5, 1.5);
+          size_t removed = S_random((uint32_t)trayCount);
+          memmove(tray + removed, tray + removed + 1, (trayCount - removed - 1) * sizeof(uint32_t));
+          trayCount--;
+          for (size_t i = 0; i < trayCount; i++) {
+            S_add_request(&w, t, tray[i], SURFACE_TRAY, session);
+          }
+        }
+      }
+      t += S_uniform(1.0, 3.0);
+      double uploadBytes = 0;
+      for (size_t i = 0; i < trayCount; i++) {
+        uploadBytes += S_kinds[w.attachments[tray[i]].kind].bytes;
+      }
+      // Uploads don't compete with thumbnails for the model's bandwidth.
+      double shown = t + FIRST_BYTE_SECONDS + uploadBytes / BANDWIDTH;
+      memcpy(messages[messageCount], tray, trayCount * sizeof(uint32_t));
+      messageSizes[messageCount] = trayCount;
+      // Inserted, then built again as the reply streams in and once it ends.
+      S_list_message(&w, tray, trayCount, shown, session);
+      S_list_message(&w, tray, trayCount, shown + S_uniform(0.3, 0.8), session);
+      S_list_message(&w, tray, trayCount, shown + S_uniform(3.0, 8.0), session);
+      messageCount++;
+      t = shown + S_uniform(5.0, 15.0);
+
+      // Scrolling back a way, and returning to the bottom.
+      if (messageCount > 4 && S_random(4) == 0) {
+        size_t back = 2 + S_random(8);
+        size_t first = messageCount > back ? messageCount - back : 0;
+        for (size_t m = first; m < messageCount; m++) {
+          S_list_message(&w, messages[m], messageSizes[m], t, session);
+          t += S_uniform(0.1, 0.4);
+        }
+        for (size_t m = messageCount; m-- > first;) {
+          S_list_message(&w, messages[m], messageSizes[m], t, session);
+          t += S_uniform(0.05, 0.2);
+        }
+      }
+    }
+  }
+  free(messages);
+  free(messageSizes);
+  qsort(w.requests, w.requestCount, sizeof(request), S_compare_requests);
+  return w;
+}
+
+typedef enum { POLICY_PER_REQUEST, POLICY_POOL, POLICY_POOL_PERSISTENT, POLICY_COUNT } policy;
+static const char *S_policy_names[POLICY_COUNT] = {"per_request", "pool", "pool_persistent"};
+
+typedef struct {
+  bool active;
+  char key[48];
+  double firstByteLeft;
+  double bytesLeft;
+  double cpuLeft;
+  double memory;
+  /** Attachment whose caches it fills when done, if it succeeds. */
+  uint32_t attachment;
+  uint32_t session;
+  bool fills;
+  bool running;
+} sim_job;
+
+typedef struct {
+  const char *name;
+  size_t made;
+  double cpuSeconds;
+  double downloadMegabytes;
+  double peakDecodingMegabytes;
+  double p50[SURFACE_COUNT];
+  double p95[SURFACE_COUNT];
+  double max[SURFACE_COUNT];
+  size_t requests[SURFACE_COUNT];
+  size_t waited[SURFACE_COUNT];
+} sim_result;
+
+typedef struct {
+  const workload *w;
+  policy policy;
+  AttachmentThumbnailQueue *queue;
+  sim_job *jobs;
+  size_t jobCapacity;
+  /** Per attachment: a thumbnail in memory this session, a stored record, the bytes on disk. */
+  uint32_t *memorySession;
+  bool *stored;
+  bool *downloaded;
+  double *latency;
+  sim_result result;
+} sim;
+
+static void S_sim_key(char *buffer, size_t size, const char *prefix, uint64_t id) {
+  snprintf(buffer, size, "%s-%llu", prefix, (unsigned long long)id);
+}
+
+static sim_job *S_job_for_key(sim *s, const char *key, size_t keyLength) {
+  for (size_t i = 0; i < s->jobCapacity; i++) {
+    if (s->jobs[i].active && strlen(s->jobs[i].key) == keyLength && memcmp(s->jobs[i].key, key, keyLength) == 0) {
+      return &s->jobs[i];
+    }
+  }
+  return NULL;
+}
+
+static sim_job *S_new_job(sim *s, const char *key) {
+  for (size_t i = 0; i < s->jobCapacity; i++) {
+    if (!s->jobs[i].active) {
+      memset(&s->jobs[i], 0, sizeof(sim_job));
+      s->jobs[i].active = true;
+      snprintf(s->jobs[i].key, sizeof(s->jobs[i].key), "%s", key);
+      return &s->jobs[i];
+    }
+  }
+  size_t capacity = s->jobCapacity;
+  s->jobCapacity = capacity ? capacity * 2 : 64;
+  s->jobs = (sim_job *)realloc(s->jobs, s->jobCapacity * sizeof(sim_job));
+  memset(s->jobs + capacity, 0, (s->jobCapacity - capacity) * sizeof(sim_job));
+  return S_new_job(s, key);
+}
+
+typedef struct {
+  sim *s;
+  double now;
+} finish_context;
+
+static void S_finish_waiter(void *context, void *waiter) {
+  finish_context *c = (finish_context *)context;
+  size_t index = (size_t)(uintptr_t)waiter - 1;
+  c->s->latency[index] = c->now - c->s->w->requests[index].time;
+}
+
+// Sets up the work for a request that needs a job, and queues it.
+static void S_submit(sim *s, size_t index) {
+  const request *r = &s->w->requests[index];
+  const attachment *a = &s->w->attachments[r->attachment];
+  const kind_info *k = &S_kinds[a->kind];
+  void *waiter = (void *)(uintptr_t)(index + 1);
+  char key[48];
+  uint32_t lane = AttachmentThumbnailLaneDecode;
+
+  if (s->policy == POLICY_PER_REQUEST) {
+    // The tray asks QuickLook for every file on every rebuild; PINRemoteImage joins downloads of a URL.
+    if (r->surface == SURFACE_TRAY) {
+      S_sim_key(key, sizeof(key), "tray", index);
+    } else {
+      S_sim_key(key, sizeof(key), "url", r->attachment);
+    }
+  } else {
+    // The list's URLs resolve to the tray's attachment once uploaded.
+    S_sim_key(key, sizeof(key), "content", r->attachment);
+    bool local = a->session == r->session;
+    lane = local || s->stored[r->attachment] ? AttachmentThumbnailLaneDecode : AttachmentThumbnailLaneFetch;
+  }
+  uint32_t priority = r->surface == SURFACE_TRAY ? AttachmentThumbnailPriorityInteractive : AttachmentThumbnailPriorityNormal;
+  AttachmentThumbnailQueueAddResult result = AttachmentThumbnailQueueAdd(s->queue, key, strlen(key), lane, priority, waiter);
+  if (result != AttachmentThumbnailQueueAddQueued) {
+    return;
+  }
+
+  sim_job *job = S_new_job(s, key);
+  job->attachment = r->attachment;
+  job->session = r->session;
+  job->fills = true;
+  double fullMemory = k->pixels * 4;
+  double thumbnailMemory = THUMBNAIL_PIXELS * THUMBNAIL_PIXELS * 4.0;
+  if (s->policy == POLICY_PER_REQUEST) {
+    if (r->surface == SURFACE_TRAY) {
+      job->cpuLeft = k->quickLookSeconds;
+      job->memory = fullMemory;
+      job->fills = false;
+    } else {
+      if (!s->downloaded[r->attachment]) {
+        job->firstByteLeft = FIRST_BYTE_SECONDS;
+        job->bytesLeft = k->bytes;
+      }
+      job->cpuLeft = k->fullDecodeSeconds;
+      job->memory = k->decodable ? fullMemory : 0;
+    }
+    return;
+  }
+  if (s->policy == POLICY_POOL_PERSISTENT && s->stored[r->attachment]) {
+    job->cpuLeft = RECORD_SECONDS;
+    job->memory = thumbnailMemory;
+    return;
+  }
+  if (a->session == r->session) {
+    job->cpuLeft = k->thumbnailSeconds;
+    // ImageIO can't decode a PNG at a smaller size, only scale it after.
+    job->memory = a->kind == KIND_SCREENSHOT ? fullMemory : thumbnailMemory;
+  } else {
+    job->firstByteLeft = FIRST_BYTE_SECONDS;
+    job->bytesLeft = k->bytes;
+    job->cpuLeft = k->decodable ? k->thumbnailSeconds : 0;
+    job->memory = a->kind == KIND_SCREENSHOT ? fullMemory : thumbnailMemory;
+    job->fills = k->decodable;
+  }
+}
+
+static bool S_serve_from_memory(sim *s, size_t index) {
+  const request *r = &s->w->requests[index];
+  if (s->policy == POLICY_PER_REQUEST && r->surface == SURFACE_TRAY) {
+    // A picked image is shown as it is.
+    return S_kinds[s->w->attachments[r->attachment].kind].image;
+  }
+  return s->memorySession[r->attachment] == r->session + 1;
+}
+
+static int S_compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void S_finish(sim *s, sim_job *job, double now) {
+  if (job->fills) {
+    s->memorySession[job->attachment] = job->session + 1;
+    if (s->policy == POLICY_POOL_PERSISTENT) {
+      s->stored[job->attachment] = true;
+    }
+  }
+  if (s->policy == POLICY_PER_REQUEST && job->fills) {
+    s->downloaded[job->attachment] = true;
+  }
+  finish_context c = {s, now};
+  AttachmentThumbnailQueueFinish(s->queue, job->key, strlen(job->key), S_finish_waiter, &c);
+  job->active = false;
+}
+
+static sim_result S_simulate(const workload *w, policy p) {
+  sim s = {0};
+  s.w = w;
+  s.policy = p;
+  bool bounded = p != POLICY_PER_REQUEST;
+  s.queue = AttachmentThumbnailQueueCreate(bounded ? DECODE_LIMIT : 0, bounded ? FETCH_LIMIT : 0);
+  s.memorySession = (uint32_t *)calloc(w->attachmentCount, sizeof(uint32_t));
+  s.stored = (bool *)calloc(w->attachmentCount, sizeof(bool));
+  s.downloaded = (bool *)calloc(w->attachmentCount, sizeof(bool));
+  s.latency = (double *)calloc(w->requestCount, sizeof(double));
+  s.result.name = S_policy_names[p];
+
+  size_t next = 0;
+  size_t active = 0;
+  double now = 0;
+  while (next < w->requestCount || active > 0) {
+    if (active == 0 && w->requests[next].time > now) {
+      now = w->requests[next].time;
+    }
+    while (next < w->requestCount && w->requests[next].time <= now) {
+      if (S_serve_from_memory(&s, next)) {
+        s.latency[next] = 0;
+      } else {
+        S_submit(&s, next);
+      }
+      next++;
+    }
+
+    AttachmentThumbnailQueueJob started[16];
+    size_t count;
+    while ((count = AttachmentThumbnailQueueNext(s.queue, started, 16)) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        sim_job *job = S_job_for_key(&s, started[i].key, started[i].keyLength);
+        job->running = true;
+        if (job->cpuLeft > RECORD_SECONDS) {
+          s.result.made++;
+        }
+        s.result.downloadMegabytes += job->bytesLeft / (1024.0 * 1024.0);
+        s.result.cpuSeconds += job->cpuLeft;
+      }
+    }
+
+    // Cores are shared among the jobs decoding, bandwidth among the downloads.
+    size_t decoding = 0, downloading = 0;
+    double decodingMemory = 0;
+    active = 0;
+    for (size_t i = 0; i < s.jobCapacity; i++) {
+      sim_job *job = &s.jobs[i];
+      if (!job->active) {
+        continue;
+      }
+      active++;
+      if (!job->running || job->firstByteLeft > 0) {
+        continue;
+      }
+      if (job->bytesLeft > 0) {
+        downloading++;
+      } else {
+        decoding++;
+        decodingMemory += job->memory;
+      }
+    }
+    if (decodingMemory / (1024.0 * 1024.0) > s.result.peakDecodingMegabytes) {
+      s.result.peakDecodingMegabytes = decodingMemory / (1024.0 * 1024.0);
+    }
+    double cpuRate = decoding > CORES ? CORES / (double)decoding : 1.0;
+    double byteRate = downloading ? BANDWIDTH / (double)downloading : 0;
+    now += TICK;
+    for (size_t i = 0; i < s.jobCapacity; i++) {
+      sim_job *job = &s.jobs[i];
+      if (!job->active || !job->running) {
+        continue;
+      }
+      if (job->firstByteLeft > 0) {
+        job->firstByteLeft -= TICK;
+      } else if (job->bytesLeft > 0) {
+        job->bytesLeft -= byteRate * TICK;
+      } else if ((job->cpuLeft -= cpuRate * TICK) <= 0) {
+        S_finish(&s, job, now);
+        active--;
+      }
+    }
+  }
+
+  double *latencies = (double *)malloc(w->requestCount * sizeof(double));
+  for (int which = 0; which < SURFACE_COUNT; which++) {
+    size_t n = 0;
+    for (size_t i = 0; i < w->requestCount; i++) {
+      if (w->requests[i].surface == (surface)which) {
+        latencies[n++] = s.latency[i];
+        s.result.waited[which] += s.latency[i] > 0;
+      }
+    }
+    s.result.requests[which] = n;
+    if (n > 0) {
+      qsort(latencies, n, sizeof(double), S_compare_doubles);
+      s.result.p50[which] = latencies[n / 2];
+      s.result.p95[which] = latencies[(size_t)(n * 0.95)];
+      s.result.max[which] = latencies[n - 1];
+    }
+  }
+  free(latencies);
+
+  sim_result result = s.result;
+  AttachmentThumbnailQueueDestroy(s.queue, NULL, NULL);
+  free(s.jobs);
+  free(s.memorySession);
+  free(s.stored);
+  free(s.downloaded);
+  free(s.latency);
+  return result;
+}
+
+// MARK: - Cost
+
+static double S_time_hash(size_t length) {
+  uint8_t *bytes = (uint8_t *)malloc(length);
+  S_fill(bytes, length);
+  uint64_t sink = 0;
+  int repeats = 8;
+  double start = S_now();
+  for (int i = 0; i < repeats; i++) {
+    bytes[0] = (uint8_t)i;
+    sink ^= AttachmentThumbnailContentHash(bytes, length);
+  }
+  double elapsed = S_now() - start;
+  free(bytes);
+  if (sink == 42) {
+    fprintf(stderr, "\n");
+  }
+  return (double)length * repeats / elapsed / 1e9;
+}
+
+static double S_time_queue(void) {
+  AttachmentThumbnailQueue *queue = AttachmentThumbnailQueueCreate(DECODE_LIMIT, FETCH_LIMIT);
+  const int operations = 300000;
+  char key[96];
+  double start = S_now();
+  for (int i = 0; i < operations / 3; i++) {
+    uint32_t k = S_random(64);
+    S_queue_key(key, sizeof(key), k);
+    AttachmentThumbnailQueueAdd(queue, key, strlen(key), S_random(2), S_random(2), (void *)(uintptr_t)(i + 1));
+    AttachmentThumbnailQueueJob started[1];
+    if (AttachmentThumbnailQueueNext(queue, started, 1) == 1) {
+      char finished[96];
+      memcpy(finished, started[0].key, started[0].keyLength);
+      AttachmentThumbnailQueueFinish(queue, finished, started[0].keyLength, NULL, NULL);
+    }
+  }
+  double elapsed = S_now() - start;
+  AttachmentThumbnailQueueDestroy(queue, NULL, NULL);
+  return elapsed / operations * 1e9;
+}
+
+int main(int argc, char **argv) {
+  uint32_t sessions = 4;
+  uint32_t sends = 30;
+  int rounds = 200;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      sessions = 3;
+      sends = 10;
+      rounds = 30;
+    }
+  }
+
+  S_check_hash();
+  S_check_records();
+  S_check_queue(rounds);
+  if (S_failures) {
+    return 1;
+  }
+
+  printf("{\n  \"sessions\": %u,\n  \"sends_per_session\": %u,\n  \"decoders\": %d,\n  \"downloads\": %d,\n  \"trials\": [",
+         sessions, sends, DECODE_LIMIT, FETCH_LIMIT);
+  for (int trial = 0; trial < TRIALS; trial++) {
+    S_state = 0x5EED0000ull + (uint64_t)trial;
+    workload w = S_make_workload(sessions, sends);
+    printf("%s\n    {\"seed\": %d, \"attachments\": %zu, \"requests\": %zu, \"policies\": [", trial ? "," : "", trial, w.attachmentCount, w.requestCount);
+    for (int p = 0; p < POLICY_COUNT; p++) {
+      sim_result r = S_simulate(&w, (policy)p);
+      printf("%s\n      {\"policy\": \"%s\", \"made\": %zu, \"cpu_s\": %.2f, \"download_mb\": %.1f, \"peak_decoding_mb\": %.1f",
+             p ? "," : "", r.name, r.made, r.cpuSeconds, r.downloadMegabytes, r.peakDecodingMegabytes);
+      for (int surface = 0; surface < SURFACE_COUNT; surface++) {
+        printf(", \"%s\": {\"requests\": %zu, \"waited\": %zu, \"p50_s\": %.3f, \"p95_s\": %.3f, \"max_s\": %.3f}",
+               S_surface_names[surface], r.requests[surface], r.waited[surface], r.p50[surface], r.p95[surface], r.max[surface]);
+      }
+      printf("}");
+    }
+    printf("\n    ]}");
+    free(w.attachments);
+    free(w.requests);
+  }
+  printf("\n  ],\n  \"hash_gb_per_s\": %.2f,\n  \"sampled_hash_gb_per_s\": %.1f,\n  \"queue_ns_per_operation\": %.1f\n}\n",
+         S_time_hash(4u << 20), S_time_hash(256u << 20), S_time_queue());
+  return 0;
+}
@@ -0,0 +1,572 @@
+// Checks the hashing and index behind AttachmentUploadCache, measures how
+// fast contents hash, and compares uploading every send with skipping
+// contents uploaded before, on simulated chat sessions.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -pthread -o attachment_upload_index_bench
+//      attachment_upload_index_bench.c ../Tool/AttachmentUploadIndex.c
+//   ./attachment_upload_index_bench [--quick] > result.json
+//
+// First checks the CRC-64 against the xz check value and a bytewise
+// reference, continuing over following bytes and combining pieces and
+// chunks of every size. Then runs random operations on the index against a
+// model of it, checking lookups, expiry and which entry a full index drops,
+// that an encoding decodes to the same index, and that every byte of it is
+// covered by the checksum. Exits with 1 on failure.
+//
+// Then measures hashing: bytewise, sliced by eight, and in chunks of
+// AttachmentUploadHashChunkLength on 1, 2, 4 and 8 threads, the way the
+// app spreads large files over cores.
+//
+// Then replays sessions of a chat, with the app relaunched between them and
+// the index stored. The user sends photos, screenshots and PDFs; now and
+// then the same one again, in this chat or another. Two policies are
+// compared:
+//
+// - upload_always: what the app did, uploading every attachment of every
+//   send.
+// - indexed: contents whose URL is still working are not uploaded again,
+//   at the cost of hashing every attachment before the send.
+//
+// Reports the attachments and megabytes uploaded, and the seconds a send
+// waits on hashing and uploading at a phone's upload rate.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Tool/AttachmentUploadIndex.h"
+
+#define TRIALS 3
+#define UPLOAD_BANDWIDTH (1.0 * 1024 * 1024)
+#define UPLOAD_SETUP_SECONDS 0.3
+#define URL_LIFETIME (7 * 86400)
+#define EXPIRY_MARGIN 600
+#define INDEX_CAPACITY 2048
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+static double S_uniform(double low, double high) {
+  return low + (high - low) * (double)S_random(1u << 30) / (double)(1u << 30);
+}
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int S_failures = 0;
+
+#define S_CHECK(condition, ...)                                \
+  do {                                                         \
+    if (!(condition)) {                                        \
+      if (S_failures++ < 10) {                                 \
+        fprintf(stderr, "%s:%d: ", __func__, __LINE__);        \
+        fprintf(stderr, __VA_ARGS__);                          \
+        fprintf(stderr, "\n");                                 \
+      }                                                        \
+    }                                                          \
+  } while (0)
+
+static void S_fill(uint8_t *bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    bytes[i] = (uint8_t)S_random(256);
+  }
+}
+
+// MARK: - CRC checks
+
+static uint64_t S_reference_crc(uint64_t crc, const uint8_t *bytes, size_t length) {
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (int k = 0; k < 8; k++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xC96C5795D7870F42ull : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+static void S_check_crc(void) {
+  S_CHECK(AttachmentUploadCRC64(0, "", 0) == 0, "empty");
+  S_CHECK(AttachmentUploadCRC64(0, "123456789", 9) == 0x995DC9BBDF1939FAull, "check value");
+
+  size_t size = 1 << 16;
+  uint8_t *bytes = (uint8_t *)malloc(size);
+  S_fill(bytes, size);
+  for (int round = 0; round < 600; round++) {
+    size_t offset = S_random(16);
+    size_t length = S_random(S_random(2) ? 100 : (uint32_t)(size - offset));
+    size_t split = S_random((uint32_t)length + 1);
+    uint64_t whole = S_reference_crc(0, bytes + offset, length);
+    S_CHECK(AttachmentUploadCRC64(0, bytes + offset, length) == whole, "offset %zu length %zu", offset, length);
+
+    uint64_t first = AttachmentUploadCRC64(0, bytes + offset, split);
+    uint64_t second = AttachmentUploadCRC64(0, bytes + offset + split, length - split);
+    S_CHECK(AttachmentUploadCRC64(first, bytes + offset + split, length - split) == whole, "continued at %zu of %zu", split, length);
+    S_CHECK(AttachmentUploadCRC64Combine(first, second, length - split) == whole, "combined at %zu of %zu", split, length);
+
+    // Any chunk length combines to the whole.
+    size_t chunkLength = 1 + S_random(S_random(2) ? 64 : 9000);
+    size_t count = AttachmentUploadHashChunkCount(length, chunkLength);
+    uint64_t *crcs = (uint64_t *)malloc(count * sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+      size_t start = i * chunkLength;
+      size_t chunk = start + chunkLength < length ? chunkLength : length - start;
+      crcs[i] = AttachmentUploadCRC64(0, bytes + offset + start, chunk);
+    }
+    S_CHECK(AttachmentUploadCRC64CombineChunks(crcs, count, length, chunkLength) == whole,
+            "%zu chunks of %zu for %zu", count, chunkLength, length);
+    free(crcs);
+  }
+  S_CHECK(AttachmentUploadHashChunkCount(0, 4) == 1 && AttachmentUploadHashChunkCount(8, 4) == 2
+          && AttachmentUploadHashChunkCount(9, 4) == 3, "chunk counts");
+
+  // Skipping past 32 bits of length is the same as skipping in two steps.
+  uint64_t head = AttachmentUploadCRC64(0, "x", 1);
+  uint64_t big = (1ull << 32) + 4096 * 3;
+  S_CHECK(AttachmentUploadCRC64Combine(AttachmentUploadCRC64Combine(head, 0, 1ull << 32), 0, 4096 * 3)
+          == AttachmentUploadCRC64Combine(head, 0, big), "long skip");
+  free(bytes);
+}
+
+// MARK: - Index checks
+
+typedef struct {
+  uint64_t crc64;
+  uint64_t length;
+  int64_t expiry;
+  char url[64];
+} model_entry;
+
+/** Entries most recently used first. */
+typedef struct {
+  model_entry entries[64];
+  size_t count;
+  size_t capacity;
+} model;
+
+static int S_model_find(const model *m, uint64_t crc64, uint64_t length) {
+  for (size_t i = 0; i < m->count; i++) {
+    if (m->entries[i].crc64 == crc64 && m->entries[i].length == length) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static void S_model_remove_at(model *m, size_t i) {
+  memmove(&m->entries[i], &m->entries[i + 1], (m->count - i - 1) * sizeof(model_entry));
+  m->count--;
+}
+
+static void S_model_push_front(model *m, const model_entry *entry) {
+  memmove(&m->entries[1], &m->entries[0], m->count * sizeof(model_entry));
+  m->entries[0] = *entry;
+  m->count++;
+}
+
+static void S_check_same(AttachmentUploadIndex *a, AttachmentUploadIndex *b, const char *what) {
+  size_t la = AttachmentUploadIndexEncodedLength(a);
+  size_t lb = AttachmentUploadIndexEncodedLength(b);
+  uint8_t *ea = (uint8_t *)malloc(la);
+  uint8_t *eb = (uint8_t *)malloc(lb);
+  AttachmentUploadIndexEncode(a, ea, la);
+  AttachmentUploadIndexEncode(b, eb, lb);
+  S_CHECK(la == lb && memcmp(ea, eb, la) == 0, "%s: encodings differ", what);
+  free(ea);
+  free(eb);
+}
+
+static void S_check_index(int rounds) {
+  for (int round = 0; round < rounds; round++) {
+    model m = {.count = 0, .capacity = 1 + S_random(20)};
+    AttachmentUploadIndex *index = AttachmentUploadIndexCreate(m.capacity);
+    int64_t now = 1700000000;
+    // Few distinct keys, some sharing a CRC with a different length.
+    for (int step = 0; step < 400; step++) {
+      uint64_t crc64 = 0xABCD0000ull + S_random(12);
+      uint64_t length = 100 + S_random(2);
+      uint32_t op = S_random(10);
+      if (op < 4) {
+        model_entry entry = {crc64, length, now + 1 + S_random(100), ""};
+        snprintf(entry.url, sizeof(entry.url), "https://bucket.example.com/%u.jpg", S_random(100000));
+        S_CHECK(AttachmentUploadIndexInsert(index, crc64, length, entry.url, strlen(entry.url), entry.expiry), "insert");
+        int at = S_model_find(&m, crc64, length);
+        if (at >= 0) {
+          S_model_remove_at(&m, (size_t)at);
+        } else if (m.count == m.capacity) {
+          m.count--;
+        }
+        S_model_push_front(&m, &entry);
+      } else if (op < 8) {
+        const char *url = AttachmentUploadIndexLookup(index, crc64, length, now);
+        int at = S_model_find(&m, crc64, length);
+        if (at >= 0 && m.entries[at].expiry <= now) {
+          S_model_remove_at(&m, (size_t)at);
+          at = -1;
+        }
+        if (at < 0) {
+          S_CHECK(url == NULL, "round %d step %d: found a missing key", round, step);
+        } else {
+          model_entry entry = m.entries[at];
+          S_CHECK(url && strcmp(url, entry.url) == 0, "round %d step %d: wrong url", round, step);
+          S_model_remove_at(&m, (size_t)at);
+          S_model_push_front(&m, &entry);
+        }
+      } else if (op == 8) {
+        int at = S_model_find(&m, crc64, length);
+        S_CHECK(AttachmentUploadIndexRemove(index, crc64, length) == (at >= 0), "remove");
+        if (at >= 0) {
+          S_model_remove_at(&m, (size_t)at);
+        }
+      } else if (S_random(4) == 0) {
+        size_t expired = 0;
+        for (size_t i = m.count; i-- > 0;) {
+          if (m.entries[i].expiry <= now) {
+            S_model_remove_at(&m, i);
+            expired++;
+          }
+        }
+        S_CHECK(AttachmentUploadIndexPrune(index, now) == expired, "prune");
+      } else {
+        now += S_random(30);
+      }
+      S_CHECK(AttachmentUploadIndexCount(index) == m.count, "round %d step %d: count %zu, model %zu", round, step,
+              AttachmentUploadIndexCount(index), m.count);
+
+      // Decoding keeps the entries and their order, less the expired.
+      if (step % 50 == 49) {
+        size_t length = AttachmentUploadIndexEncodedLength(index);
+        uint8_t *bytes = (uint8_t *)malloc(length);
+        S_CHECK(AttachmentUploadIndexEncode(index, bytes, length - 1) == 0, "short buffer");
+        S_CHECK(AttachmentUploadIndexEncode(index, bytes, length) == length, "encode");
+        AttachmentUploadIndex *copy = AttachmentUploadIndexCreate(m.capacity);
+        S_CHECK(AttachmentUploadIndexDecode(copy, bytes, length, now), "decode");
+        AttachmentUploadIndexPrune(index, now);
+        for (size_t i = m.count; i-- > 0;) {
+          if (m.entries[i].expiry <= now) {
+            S_model_remove_at(&m, i);
+          }
+        }
+        S_check_same(index, copy, "round trip");
+        free(bytes);
+        AttachmentUploadIndexDestroy(copy);
+      }
+    }
+    AttachmentUploadIndexDestroy(index);
+  }
+
+  // A smaller index keeps the most recently used.
+  AttachmentUploadIndex *large = AttachmentUploadIndexCreate(8);
+  AttachmentUploadIndex *small = AttachmentUploadIndexCreate(3);
+  for (uint64_t i = 0; i < 8; i++) {
+    char url[32];
+    snprintf(url, sizeof(url), "https://x/%llu", (unsigned long long)i);
+    AttachmentUploadIndexInsert(large, i, i, url, strlen(url), 100);
+  }
+  size_t length = AttachmentUploadIndexEncodedLength(large);
+  uint8_t *bytes = (uint8_t *)malloc(length + 1);
+  AttachmentUploadIndexEncode(large, bytes, length);
+  S_CHECK(AttachmentUploadIndexDecode(small, bytes, length, 0) && AttachmentUploadIndexCount(small) == 3, "smaller");
+  S_CHECK(AttachmentUploadIndexLookup(small, 7, 7, 0) && AttachmentUploadIndexLookup(small, 5, 5, 0)
+          && !AttachmentUploadIndexLookup(small, 4, 4, 0), "smaller keeps recent");
+  S_CHECK(AttachmentUploadIndexDecode(small, bytes, length, 100) && AttachmentUploadIndexCount(small) == 0, "expired");
+  S_CHECK(!AttachmentUploadIndexInsert(small, 1, 1, "", 0, 100), "empty url");
+
+  // Any damage is rejected and leaves the index as it was.
+  AttachmentUploadIndex *damaged = AttachmentUploadIndexCreate(8);
+  AttachmentUploadIndexDecode(damaged, bytes, length, 0);
+  for (size_t bit = 0; bit < length * 8; bit++) {
+    bytes[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    S_CHECK(!AttachmentUploadIndexDecode(damaged, bytes, length, 0), "bit %zu", bit);
+    bytes[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+  }
+  for (size_t cut = 0; cut < length; cut++) {
+    S_CHECK(!AttachmentUploadIndexDecode(damaged, bytes, cut, 0), "cut at %zu", cut);
+  }
+  bytes[length] = 0;
+  S_CHECK(!AttachmentUploadIndexDecode(damaged, bytes, length + 1, 0), "trailing byte");
+  S_check_same(large, damaged, "after damage");
+  free(bytes);
+  AttachmentUploadIndexDestroy(large);
+  AttachmentUploadIndexDestroy(small);
+  AttachmentUploadIndexDestroy(damaged);
+}
+
+// MARK: - Hash throughput
+
+typedef struct {
+  const uint8_t *bytes;
+  size_t length;
+  uint64_t *crcs;
+  size_t count;
+  size_t first;
+  size_t stride;
+} hash_work;
+
+static void *S_hash_chunks(void *argument) {
+  hash_work *work = (hash_work *)argument;
+  for (size_t i = work->first; i < work->count; i += work->stride) {
+    size_t start = i * AttachmentUploadHashChunkLength;
+    size_t chunk = start + AttachmentUploadHashChunkLength < work->length ? AttachmentUploadHashChunkLength : work->length - start;
+    work->crcs[i] = AttachmentUploadCRC64(0, work->bytes + start, chunk);
+  }
+  return NULL;
+}
+
+static uint64_t S_parallel_crc(const uint8_t *bytes, size_t length, int threads) {
+  size_t count = AttachmentUploadHashChunkCount(length, AttachmentUploadHashChunkLength);
+  uint64_t *crcs = (uint64_t *)malloc(count * sizeof(uint64_t));
+  pthread_t ids[8];
+  hash_work work[8];
+  for (int t = 0; t < threads; t++) {
+    work[t] = (hash_work){bytes, length, crcs, count, (size_t)t, (size_t)threads};
+    pthread_create(&ids[t], NULL, S_hash_chunks, &work[t]);
+  }
+  for (int t = 0; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+  uint64_t crc = AttachmentUploadCRC64CombineChunks(crcs, count, length, AttachmentUploadHashChunkLength);
+  free(crcs);
+  return crc;
+}
+
+typedef struct {
+  double bytewise;
+  double sliced;
+  double threads[4];
+  double combineNanoseconds;
+} hash_speed;
+
+static double S_best_of(double (*run)(const uint8_t *, size_t, int), const uint8_t *bytes, size_t length, int threads) {
+  double best = 1e9;
+  for (int i = 0; i < 3; i++) {
+    double start = S_now();
+    double sink = run(bytes, length, threads);
+    double elapsed = S_now() - start;
+    best = elapsed < best ? elapsed : best;
+    if (sink == 42) {
+      fprintf(stderr, "\n");
+    }
+  }
+  return (double)length / best / 1e9;
+}
+
+static double S_run_bytewise(const uint8_t *bytes, size_t length, int threads) {
+  (void)threads;
+  return (double)S_reference_crc(0, bytes, length);
+}
+
+static double S_run_sliced(const uint8_t *bytes, size_t length, int threads) {
+  (void)threads;
+  return (double)AttachmentUploadCRC64(0, bytes, length);
+}
+
+static double S_run_parallel(const uint8_t *bytes, size_t length, int threads) {
+  return (double)S_parallel_crc(bytes, length, threads);
+}
+
+static hash_speed S_time_hash(size_t length) {
+  hash_speed speed;
+  uint8_t *bytes = (uint8_t *)malloc(length);
+  S_fill(bytes, length);
+  uint64_t whole = AttachmentUploadCRC64(0, bytes, length);
+  for (int t = 1; t <= 8; t *= 2) {
+    S_CHECK(S_parallel_crc(bytes, length, t) == whole, "%d threads", t);
+  }
+  speed.bytewise = S_best_of(S_run_bytewise, bytes, length / 8, 1);
+  speed.sliced = S_best_of(S_run_sliced, bytes, length, 1);
+  for (int i = 0; i < 4; i++) {
+    speed.threads[i] = S_best_of(S_run_parallel, bytes, length, 1 << i);
+  }
+  const int combines = 100000;
+  uint64_t sink = 0;
+  double start = S_now();
+  for (int i = 0; i < combines; i++) {
+    sink ^= AttachmentUploadCRC64Combine(sink + (uint64_t)i, whole, AttachmentUploadHashChunkLength);
+  }
+  speed.combineNanoseconds = (S_now() - start) / combines * 1e9;
+  if (sink == 42) {
+    fprintf(stderr, "\n");
+  }
+  free(bytes);
+  return speed;
+}
+
+// MARK: - Sessions
+
+typedef enum { KIND_SCREENSHOT, KIND_PHOTO, KIND_PDF, KIND_COUNT } kind;
+
+typedef struct {
+  double share;
+  double minMegabytes;
+  double maxMegabytes;
+} kind_info;
+
+static const kind_info S_kinds[KIND_COUNT] = {
+    [KIND_SCREENSHOT] = {0.45, 0.3, 1.5},
+    [KIND_PHOTO] = {0.35, 2.0, 5.0},
+    [KIND_PDF] = {0.20, 0.2, 20.0},
+};
+
+typedef struct {
+  uint64_t crc64;
+  uint64_t length;
+} attachment;
+
+typedef struct {
+  const char *name;
+  size_t uploaded;
+  double uploadedMegabytes;
+  double hashSeconds;
+  double waitSeconds;
+  size_t reused;
+} policy_result;
+
+static attachment S_new_attachment(void) {
+  double share = S_uniform(0, 1);
+  int k = 0;
+  while (k < KIND_COUNT - 1 && share > S_kinds[k].share) {
+    share -= S_kinds[k].share;
+    k++;
+  }
+  attachment a;
+  a.crc64 = ((uint64_t)S_random(1u << 31) << 32) | S_random(1u << 31);
+  a.length = (uint64_t)(S_uniform(S_kinds[k].minMegabytes, S_kinds[k].maxMegabytes) * 1024 * 1024);
+  return a;
+}
+
+/**
+ Days of use, one session a day. A send carries one to three attachments;
+ each is sent before with probability `repeat`, mostly a recent one.
+ */
+static void S_replay(uint32_t days, uint32_t sendsPerDay, double repeat, double hashBytesPerSecond, policy_result results[2]) {
+  size_t capacity = (size_t)days * sendsPerDay * 3;
+  attachment *sent = (attachment *)malloc(capacity * sizeof(attachment));
+  size_t sentCount = 0;
+  AttachmentUploadIndex *index = AttachmentUploadIndexCreate(INDEX_CAPACITY);
+  uint8_t *stored = NULL;
+  size_t storedLength = 0;
+  results[0] = (policy_result){.name = "upload_always"};
+  results[1] = (policy_result){.name = "indexed"};
+
+  for (uint32_t day = 0; day < days; day++) {
+    int64_t now = 1700000000 + (int64_t)day * 86400;
+    // Relaunched: the index comes back from what was stored.
+    if (stored) {
+      AttachmentUploadIndex *loaded = AttachmentUploadIndexCreate(INDEX_CAPACITY);
+      S_CHECK(AttachmentUploadIndexDecode(loaded, stored, storedLength, now), "reload");
+      AttachmentUploadIndexDestroy(index);
+      index = loaded;
+      free(stored);
+    }
+    for (uint32_t send = 0; send < sendsPerDay; send++) {
+      now += 60 + S_random(1800);
+      uint32_t count = 1 + S_random(3);
+      double always = UPLOAD_SETUP_SECONDS;
+      double indexed = 0;
+      double hashing = 0;
+      bool uploads = false;
+      for (uint32_t i = 0; i < count; i++) {
+        attachment a;
+        if (sentCount > 0 && S_uniform(0, 1) < repeat) {
+          size_t back = S_random(S_random(4) == 0 ? (uint32_t)sentCount : (sentCount < 20 ? (uint32_t)sentCount : 20));
+          a = sent[sentCount - 1 - back];
+        } else {
+          a = S_new_attachment();
+        }
+        sent[sentCount++] = a;
+        double megabytes = (double)a.length / (1024 * 1024);
+        results[0].uploaded++;
+        results[0].uploadedMegabytes += megabytes;
+        always += (double)a.length / UPLOAD_BANDWIDTH;
+
+        hashing += (double)a.length / hashBytesPerSecond;
+        if (AttachmentUploadIndexLookup(index, a.crc64, a.length, now + EXPIRY_MARGIN)) {
+          results[1].reused++;
+          continue;
+        }
+        char url[64];
+        snprintf(url, sizeof(url), "https://bucket.example.com/%016llx", (unsigned long long)a.crc64);
+        AttachmentUploadIndexInsert(index, a.crc64, a.length, url, strlen(url), now + URL_LIFETIME);
+        results[1].uploaded++;
+        results[1].uploadedMegabytes += megabytes;
+        indexed += (double)a.length / UPLOAD_BANDWIDTH;
+        uploads = true;
+      }
+      results[0].waitSeconds += always;
+      results[1].hashSeconds += hashing;
+      results[1].waitSeconds += hashing + indexed + (uploads ? UPLOAD_SETUP_SECONDS : 0);
+    }
+    storedLength = AttachmentUploadIndexEncodedLength(index);
+    stored = (uint8_t *)malloc(storedLength);
+    AttachmentUploadIndexEncode(index, stored, storedLength);
+  }
+  free(stored);
+  free(sent);
+  AttachmentUploadIndexDestroy(index);
+}
+
+int main(int argc, char **argv) {
+  uint32_t days = 30;
+  uint32_t sends = 12;
+  int rounds = 200;
+  size_t hashLength = (size_t)256 << 20;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      days = 7;
+      sends = 6;
+      rounds = 30;
+      hashLength = (size_t)32 << 20;
+    }
+  }
+
+  S_check_crc();
+  S_check_index(rounds);
+  if (S_failures) {
+    return 1;
+  }
+  hash_speed speed = S_time_hash(hashLength);
+  if (S_failures) {
+    return 1;
+  }
+
+  // Sends wait on hashing at the four-thread speed, the app's cores.
+  double hashBytesPerSecond = speed.threads[2] * 1e9;
+  const double repeats[] = {0.1, 0.3};
+  printf("{\n  \"days\": %u,\n  \"sends_per_day\": %u,\n  \"upload_mb_per_s\": %.1f,\n  \"trials\": [",
+         days, sends, UPLOAD_BANDWIDTH / (1024 * 1024));
+  for (int trial = 0; trial < TRIALS; trial++) {
+    printf("%s\n    {\"seed\": %d, \"runs\": [", trial ? "," : "", trial);
+    for (int r = 0; r < 2; r++) {
+      S_state = 0x5EED0000ull + (uint64_t)trial;
+      policy_result results[2];
+      S_replay(days, sends, repeats[r], hashBytesPerSecond, results);
+      printf("%s\n      {\"repeat\": %.1f, \"policies\": [", r ? "," : "", repeats[r]);
+      for (int p = 0; p < 2; p++) {
+        printf("%s{\"policy\": \"%s\", \"uploaded\": %zu, \"reused\": %zu, \"uploaded_mb\": %.1f, \"hash_s\": %.2f, \"wait_s\": %.1f}",
+               p ? ", " : "", results[p].name, results[p].uploaded, results[p].reused, results[p].uploadedMegabytes,
+               results[p].hashSeconds, results[p].waitSeconds);
+      }
+      printf("]}");
+    }
+    printf("\n    ]}");
+  }
+  printf("\n  ],\n  \"hash_mb\": %zu,\n  \"bytewise_gb_per_s\": %.2f,\n  \"sliced_gb_per_s\": %.2f,\n"
+         "  \"chunked_gb_per_s\": {\"1\": %.2f, \"2\": %.2f, \"4\": %.2f, \"8\": %.2f},\n  \"combine_ns\": %.0f\n}\n",
+         hashLength >> 20, speed.bytewise, speed.sliced, speed.threads[0], speed.threads[1], speed.threads[2], speed.threads[3],
+         speed.combineNanoseconds);
+  return S_failures ? 1 : 0;
+}
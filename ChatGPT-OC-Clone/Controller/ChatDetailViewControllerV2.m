@@ -1,13 +1,15 @@
 #import "ChatDetailViewControllerV2.h"
 #import <AsyncDisplayKit/ASDisplayNode+Beta.h>
+#import <AsyncDisplayKit/ASTrace.h>
 #import "ThinkingNode.h"
 #import "RichMessageCellNode.h"
 #import "AttachmentThumbnailView.h"
 #import "CoreDataManager.h"
 #import "APIManager.h"
 @import CoreData;
-#import <QuickLookThumbnailing/QuickLookThumbnailing.h>
 #import "OSSUploadManager.h"
+#import "AttachmentThumbnailService.h"
+#import "AttachmentUploadCache.h"
 #import "ImagePreviewOverlay.h"
 #import "SemanticBlockParser.h"
 #import <QuartzCore/QuartzCore.h>
@@ -618,9 +620,11 @@ static const CGFloat kAttachmentsTextTopPadding = 8.0; // 缩略图行与输入
     NSArray *attachments = [self.selectedAttachments copy];
 
     if (attachments.count > 0) {
-        // 先上传附件到 OSS，拿到 URL 后把 URL 附加到文本中（回调在主线程）
-        [[OSSUploadManager sharedManager] uploadAttachments:attachments completion:^(NSArray<NSURL *> * _Nonnull uploadedURLs) {
+        // 先上传附件到 OSS（内容上传过且 URL 仍有效的直接复用），拿到 URL 后把 URL 附加到文本中（回调在主线程）
+        [[AttachmentUploadCache sharedCache] uploadAttachments:attachments completion:^(NSArray<NSURL *> * _Nonnull uploadedURLs) {
             NSMutableString *finalMessage = [NSMutableString stringWithString:userMessage ?: @""];
+            // 消息列表里的远程 URL 复用输入栏已生成的缩略图
+            [[AttachmentThumbnailService sharedService] associateUploadedURLs:uploadedURLs withAttachments:attachments];
             if (uploadedURLs.count > 0) {
                 if (finalMessage.length > 0) {
                     [finalMessage appendString:@"\n\n"]; 
@@ -814,6 +818,17 @@ static const CGFloat kAttachmentsTextTopPadding = 8.0; // 缩略图行与输入
     };
 }
 
+// 布局代价提示：正文越长解析与排版越重，Texture 会先开始最重的行，避免长消息最后才开工拖住整批
+- (CGFloat)tableNode:(ASTableNode *)tableNode layoutCostHintForRowAtIndexPath:(NSIndexPath *)indexPath {
+    if (self.isAIThinking && indexPath.row == self.messages.count) {
+        return 1.0;
+    }
+    NSString *message = [self messageAtIndexPath:indexPath] ?: @"";
+    NSArray *attachments = [self attachmentsAtIndexPath:indexPath];
+    // 每张缩略图大致相当于几百个字符的排版量
+    return (CGFloat)message.length + attachments.count * 200.0;
+}
+
 // MARK: - 滚动控制（粘底检测与执行）
 - (void)scrollToBottom {
     if (self.messages.count > 0) {
@@ -884,12 +899,22 @@ static const CGFloat kAttachmentsTextTopPadding = 8.0; // 缩略图行与输入
             [weakSelf deleteAttachmentAtIndex:thumbnailView.tag];
         };
         
-        // 配置显示的图片
-        if ([attachment isKindOfClass:[UIImage class]]) {
-            thumbnailView.imageView.image = attachment;
-        } else if ([attachment isKindOfClass:[NSURL class]]) {
-            [self generateThumbnailForURL:attachment completion:^(UIImage * _Nullable image) {
-                thumbnailView.imageView.image = image ?: [UIImage systemImageNamed:@"doc.fill"];
+        // 配置显示的图片：缩略图服务按内容缓存，重建时直接命中，不再重复生成
+        AttachmentThumbnailService *thumbnailService = [AttachmentThumbnailService sharedService];
+        UIImage *cachedThumbnail = [thumbnailService cachedThumbnailForAttachment:attachment pointSize:kAttachmentThumbnailWidth];
+        if (cachedThumbnail) {
+            thumbnailView.imageView.image = cachedThumbnail;
+        } else {
+            UIImage *fallbackImage = [attachment isKindOfClass:[UIImage class]] ? attachment : [UIImage systemImageNamed:@"doc.fill"];
+            if ([attachment isKindOfClass:[UIImage class]]) {
+                thumbnailView.imageView.image = attachment; // 缩略图生成前先显示原图
+            }
+            __weak AttachmentThumbnailView *weakThumbnailView = thumbnailView;
+            [thumbnailService requestThumbnailForAttachment:attachment
+                                                  pointSize:kAttachmentThumbnailWidth
+                                                   priority:AttachmentThumbnailRequestPriorityInteractive
+                                                 completion:^(UIImage * _Nullable image) {
+                weakThumbnailView.imageView.image = image ?: fallbackImage;
             }];
         }
         
@@ -967,22 +992,6 @@ static const CGFloat kAttachmentsTextTopPadding = 8.0; // 缩略图行与输入
     }
 }
 
-// 异步从文件URL生成缩略图的辅助方法
-- (void)generateThumbnailForURL:(NSURL *)url completion:(void (^)(UIImage * _Nullable image))completion {
-    CGFloat scale = [UIScreen mainScreen].scale;
-    CGSize size = CGSizeMake(120, 120); // 请求一个稍大尺寸的缩略图以保证清晰度
-    
-    QLThumbnailGenerationRequest *request = [[QLThumbnailGenerationRequest alloc] initWithFileAtURL:url size:size scale:scale representationTypes:QLThumbnailGenerationRequestRepresentationTypeAll];
-    
-    [[QLThumbnailGenerator sharedGenerator] generateBestRepresentationForRequest:request completionHandler:^(QLThumbnailRepresentation * _Nullable thumbnail, NSError * _Nullable error) {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (completion) {
-                completion(thumbnail.UIImage);
-            }
-        });
-    }];
-}
-
 // MARK: - CustomMenuViewDelegate
 - (void)customMenuViewDidSelectItemAtIndex:(NSInteger)index {
     switch (index) {
@@ -1245,7 +1254,9 @@ static const CGFloat kAttachmentsTextTopPadding = 8.0; // 缩略图行与输入
                     }
                     [sself.fullResponseBuffer setString:(partialResponse ?: @"")];
                     if (sself.isUIUpdatePaused && !isDone) { return; }
+                    ASTraceBegin("Semantic parse", partialResponse.length);
                     NSArray<NSString *> *preparedBlocks = [sself.semanticParser consumeFullText:(partialResponse ?: @"") isDone:isDone];
+                    ASTraceEnd("Semantic parse", preparedBlocks.count);
                     if (preparedBlocks.count == 0) { return; }
                     dispatch_async(dispatch_get_main_queue(), ^{
                         [sself ui_applyPreparedBlocks:preparedBlocks isDone:isDone thinkingIndexPath:thinkingIndexPath];
@@ -1287,7 +1298,9 @@ static const CGFloat kAttachmentsTextTopPadding = 8.0; // 缩略图行与输入
             if (strongSelf.isUIUpdatePaused && !isDone) { return; }
 
             // 语义分块（仅在完成块时推进）
+            ASTraceBegin("Semantic parse", partialResponse.length);
             NSArray<NSString *> *preparedBlocks = [strongSelf.semanticParser consumeFullText:(partialResponse ?: @"") isDone:isDone];
+            ASTraceEnd("Semantic parse", preparedBlocks.count);
             if (preparedBlocks.count == 0) { return; }
 
             // 主线程：应用渲染
@@ -1903,11 +1916,13 @@ static const CGFloat kAttachmentsTextTopPadding = 8.0; // 缩略图行与输入
 
 - (void)appendBlocks:(NSArray<NSString *> *)blocks isFinal:(BOOL)isDone toNode:(id)node {
     if ([node respondsToSelector:@selector(appendSemanticBlocks:isFinal:)]) {
+        ASTraceBegin("Apply semantic blocks", blocks.count);
         [node appendSemanticBlocks:blocks isFinal:isDone];
         if ([node respondsToSelector:@selector(setNeedsLayout)]) {
             [node setNeedsLayout];
         }
         [self anchorScrollToBottomIfNeeded];
+        ASTraceEnd("Apply semantic blocks", blocks.count);
     } else if ([node respondsToSelector:@selector(updateMessageText:)]) {
         NSString *accumulated = [self.semanticRenderedBuffer copy];
         [node updateMessageText:accumulated];
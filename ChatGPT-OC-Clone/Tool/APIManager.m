@@ -1,4 +1,6 @@
 #import "APIManager.h"
+#import <AsyncDisplayKit/ASTrace.h>
+#import <PINRemoteImage/PINImage+ScaledImage.h>
 
 static NSString * kDefaultAPIEndpoint = @"https://xiaoai.plus/v1/chat/completions";
 static const NSTimeInterval kUIThrottleIntervalSeconds = 0.016; // ~60fps
@@ -123,7 +125,9 @@ static const NSTimeInterval kUIThrottleIntervalSeconds = 0.016; // ~60fps
                 snapshot = [acc copy];
             });
             if (shouldEmit && cb && !isCompleted) {
+                ASTraceBegin("Throttle tick", snapshot.length);
                 cb(snapshot, NO, nil);
+                ASTraceEnd("Throttle tick", snapshot.length);
             }
         });
         self.taskThrottleTimers[taskIdentifier] = timer;
@@ -718,6 +722,7 @@ didReceiveResponse:(NSURLResponse *)response
 - (void)URLSession:(NSURLSession *)session
           dataTask:(NSURLSessionDataTask *)dataTask
     didReceiveData:(NSData *)data {
+    ASTraceInstant("SSE chunk received", data.length);
         
     // 1. 获取与此任务相关的状态信息
     NSNumber *taskIdentifier = @(dataTask.taskIdentifier);
@@ -904,21 +909,10 @@ didCompleteWithError:(nullable NSError *)error {
     if (!image) { return nil; }
     CGFloat maxDimension = 1536.0; // 最长边限制（可按需调整）
     CGSize size = image.size;
-    CGFloat scale = 1.0;
     CGFloat maxSide = MAX(size.width, size.height);
-    if (maxSide > maxDimension && maxSide > 0) {
-        scale = maxDimension / maxSide;
-    }
-    CGSize targetSize = CGSizeMake(floor(size.width * scale), floor(size.height * scale));
-    UIImage *resultImage = image;
-    if (scale < 1.0) {
-        UIGraphicsImageRendererFormat *fmt = [UIGraphicsImageRendererFormat defaultFormat];
-        fmt.scale = 1.0;
-        UIGraphicsImageRenderer *renderer = [[UIGraphicsImageRenderer alloc] initWithSize:targetSize format:fmt];
-        resultImage = [renderer imageWithActions:^(UIGraphicsImageRendererContext * _Nonnull context) {
-            [image drawInRect:CGRectMake(0, 0, targetSize.width, targetSize.height)];
-        }];
-    }
+    // 分带绘制并用 SIMD 面积平均缩小，省掉整张重绘出的第二份全尺寸位图。
+    // 这里只有 UIImage、没有原始字节，无法用 ImageIO 按目标尺寸解码：尚未解码的 JPEG 仍会在首次绘制时整张解码
+    UIImage *resultImage = [image pin_imageDownsampledToMaxPixelSize:maxDimension] ?: image;
     CGFloat jpegQuality = (maxSide > 3000.0 ? 0.6 : 0.7);
     @autoreleasepool {
         NSData *imageData = UIImageJPEGRepresentation(resultImage, jpegQuality);
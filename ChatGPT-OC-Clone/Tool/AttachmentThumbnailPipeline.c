@@ -0,0 +1,547 @@
+//
+//  AttachmentThumbnailPipeline.c
+//  ChatGPT-OC-Clone
+//
+
+#include "AttachmentThumbnailPipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MARK: - Content hash
+
+static const uint64_t AttachmentThumbnailPrime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t AttachmentThumbnailPrime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t AttachmentThumbnailPrime3 = 0x165667B19E3779F9ull;
+static const uint64_t AttachmentThumbnailPrime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t AttachmentThumbnailPrime5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t AttachmentThumbnailRotate(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t AttachmentThumbnailRead64(const uint8_t *bytes)
+{
+    return (uint64_t)bytes[0] | ((uint64_t)bytes[1] << 8) | ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24)
+        | ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) | ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
+}
+
+static inline uint32_t AttachmentThumbnailRead32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static inline uint64_t AttachmentThumbnailRound(uint64_t lane, uint64_t input)
+{
+    lane += input * AttachmentThumbnailPrime2;
+    lane = AttachmentThumbnailRotate(lane, 31);
+    return lane * AttachmentThumbnailPrime1;
+}
+
+static inline uint64_t AttachmentThumbnailMergeRound(uint64_t hash, uint64_t lane)
+{
+    hash ^= AttachmentThumbnailRound(0, lane);
+    return hash * AttachmentThumbnailPrime1 + AttachmentThumbnailPrime4;
+}
+
+static const uint8_t *AttachmentThumbnailConsumeStripes(uint64_t lanes[4], const uint8_t *bytes, const uint8_t *end)
+{
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    while (end - bytes >= 32) {
+        v1 = AttachmentThumbnailRound(v1, AttachmentThumbnailRead64(bytes));
+        v2 = AttachmentThumbnailRound(v2, AttachmentThumbnailRead64(bytes + 8));
+        v3 = AttachmentThumbnailRound(v3, AttachmentThumbnailRead64(bytes + 16));
+        v4 = AttachmentThumbnailRound(v4, AttachmentThumbnailRead64(bytes + 24));
+        bytes += 32;
+    }
+    lanes[0] = v1, lanes[1] = v2, lanes[2] = v3, lanes[3] = v4;
+    return bytes;
+}
+
+void AttachmentThumbnailHasherInit(AttachmentThumbnailHasher *hasher, uint64_t seed)
+{
+    memset(hasher, 0, sizeof(*hasher));
+    hasher->seed = seed;
+    hasher->lanes[0] = seed + AttachmentThumbnailPrime1 + AttachmentThumbnailPrime2;
+    hasher->lanes[1] = seed + AttachmentThumbnailPrime2;
+    hasher->lanes[2] = seed;
+    hasher->lanes[3] = seed - AttachmentThumbnailPrime1;
+}
+
+void AttachmentThumbnailHasherUpdate(AttachmentThumbnailHasher *hasher, const void *bytes, size_t length)
+{
+    const uint8_t *input = (const uint8_t *)bytes;
+    const uint8_t *end = input + length;
+    hasher->totalLength += length;
+
+    if (hasher->bufferLength + length < 32) {
+        if (length > 0) {
+            memcpy(hasher->buffer + hasher->bufferLength, input, length);
+        }
+        hasher->bufferLength += (uint32_t)length;
+        return;
+    }
+    if (hasher->bufferLength > 0) {
+        size_t fill = 32 - hasher->bufferLength;
+        memcpy(hasher->buffer + hasher->bufferLength, input, fill);
+        AttachmentThumbnailConsumeStripes(hasher->lanes, hasher->buffer, hasher->buffer + 32);
+        input += fill;
+        hasher->bufferLength = 0;
+    }
+    input = AttachmentThumbnailConsumeStripes(hasher->lanes, input, end);
+    hasher->bufferLength = (uint32_t)(end - input);
+    if (hasher->bufferLength > 0) {
+        memcpy(hasher->buffer, input, hasher->bufferLength);
+    }
+}
+
+uint64_t AttachmentThumbnailHasherFinal(const AttachmentThumbnailHasher *hasher)
+{
+    uint64_t hash;
+    if (hasher->totalLength >= 32) {
+        const uint64_t *lanes = hasher->lanes;
+        hash = AttachmentThumbnailRotate(lanes[0], 1) + AttachmentThumbnailRotate(lanes[1], 7)
+            + AttachmentThumbnailRotate(lanes[2], 12) + AttachmentThumbnailRotate(lanes[3], 18);
+        for (int i = 0; i < 4; i++) {
+            hash = AttachmentThumbnailMergeRound(hash, lanes[i]);
+        }
+    } else {
+        hash = hasher->seed + AttachmentThumbnailPrime5;
+    }
+    hash += hasher->totalLength;
+
+    const uint8_t *bytes = hasher->buffer;
+    const uint8_t *end = bytes + hasher->bufferLength;
+    while (end - bytes >= 8) {
+        hash ^= AttachmentThumbnailRound(0, AttachmentThumbnailRead64(bytes));
+        hash = AttachmentThumbnailRotate(hash, 27) * AttachmentThumbnailPrime1 + AttachmentThumbnailPrime4;
+        bytes += 8;
+    }
+    if (end - bytes >= 4) {
+        hash ^= (uint64_t)AttachmentThumbnailRead32(bytes) * AttachmentThumbnailPrime1;
+        hash = AttachmentThumbnailRotate(hash, 23) * AttachmentThumbnailPrime2 + AttachmentThumbnailPrime3;
+        bytes += 4;
+    }
+    while (bytes < end) {
+        hash ^= (uint64_t)*bytes * AttachmentThumbnailPrime5;
+        hash = AttachmentThumbnailRotate(hash, 11) * AttachmentThumbnailPrime1;
+        bytes++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= AttachmentThumbnailPrime2;
+    hash ^= hash >> 29;
+    hash *= AttachmentThumbnailPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t AttachmentThumbnailHash(const void *bytes, size_t length, uint64_t seed)
+{
+    AttachmentThumbnailHasher hasher;
+    AttachmentThumbnailHasherInit(&hasher, seed);
+    AttachmentThumbnailHasherUpdate(&hasher, bytes, length);
+    return AttachmentThumbnailHasherFinal(&hasher);
+}
+
+uint64_t AttachmentThumbnailContentHash(const void *bytes, size_t length)
+{
+    if (length <= AttachmentThumbnailSampledHashThreshold) {
+        return AttachmentThumbnailHash(bytes, length, 0);
+    }
+    // Seeding with the length keeps a sampled hash from matching a whole one.
+    const uint8_t *input = (const uint8_t *)bytes;
+    AttachmentThumbnailHasher hasher;
+    AttachmentThumbnailHasherInit(&hasher, (uint64_t)length);
+    AttachmentThumbnailHasherUpdate(&hasher, input, AttachmentThumbnailSampleLength);
+    AttachmentThumbnailHasherUpdate(&hasher, input + (length - AttachmentThumbnailSampleLength) / 2, AttachmentThumbnailSampleLength);
+    AttachmentThumbnailHasherUpdate(&hasher, input + length - AttachmentThumbnailSampleLength, AttachmentThumbnailSampleLength);
+    return AttachmentThumbnailHasherFinal(&hasher);
+}
+
+size_t AttachmentThumbnailFormatContentKey(uint64_t contentHash, uint64_t length, char *buffer, size_t capacity)
+{
+    int written = snprintf(buffer, capacity, "%016llx-%llx", (unsigned long long)contentHash, (unsigned long long)length);
+    if (written < 0 || (size_t)written >= capacity) {
+        return 0;
+    }
+    return (size_t)written;
+}
+
+uint32_t AttachmentThumbnailBucketPixelSize(uint32_t pixelSize)
+{
+    uint32_t bucket = 256;
+    while (bucket < pixelSize && bucket < 2048) {
+        bucket *= 2;
+    }
+    return bucket;
+}
+
+// MARK: - Queue types
+
+typedef struct AttachmentThumbnailQueueEntry AttachmentThumbnailQueueEntry;
+
+struct AttachmentThumbnailQueueEntry {
+    char *key;
+    size_t keyLength;
+    uint32_t keyHash;
+    /** The next entry whose key hashes to the same bucket. */
+    AttachmentThumbnailQueueEntry *chain;
+    uint32_t lane;
+    uint32_t priority;
+    bool running;
+    /** Orders queued entries within a priority. */
+    uint64_t sequence;
+    /** Neighbours in the queued list for the entry's lane and priority. */
+    AttachmentThumbnailQueueEntry *previous;
+    AttachmentThumbnailQueueEntry *next;
+    void **waiters;
+    size_t waiterCount;
+    size_t waiterCapacity;
+};
+
+typedef struct {
+    AttachmentThumbnailQueueEntry *head;
+    AttachmentThumbnailQueueEntry *tail;
+} AttachmentThumbnailQueueList;
+
+struct AttachmentThumbnailQueue {
+    uint32_t limits[AttachmentThumbnailLaneCount];
+    uint32_t running[AttachmentThumbnailLaneCount];
+    AttachmentThumbnailQueueList queued[AttachmentThumbnailLaneCount][AttachmentThumbnailPriorityCount];
+    size_t queuedCount;
+    AttachmentThumbnailQueueEntry **buckets;
+    size_t bucketCount;
+    size_t entryCount;
+    uint64_t sequence;
+};
+
+static uint32_t AttachmentThumbnailQueueHash(const char *bytes, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// MARK: - Queued lists
+
+static void AttachmentThumbnailQueueListAppend(AttachmentThumbnailQueueList *list, AttachmentThumbnailQueueEntry *entry)
+{
+    entry->previous = list->tail;
+    entry->next = NULL;
+    if (list->tail) {
+        list->tail->next = entry;
+    } else {
+        list->head = entry;
+    }
+    list->tail = entry;
+}
+
+static void AttachmentThumbnailQueueListRemove(AttachmentThumbnailQueueList *list, AttachmentThumbnailQueueEntry *entry)
+{
+    if (entry->previous) {
+        entry->previous->next = entry->next;
+    } else {
+        list->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->previous = entry->previous;
+    } else {
+        list->tail = entry->previous;
+    }
+    entry->previous = entry->next = NULL;
+}
+
+// MARK: - Entries
+
+static AttachmentThumbnailQueueEntry **AttachmentThumbnailQueueFind(AttachmentThumbnailQueue *queue, const char *key, size_t keyLength, uint32_t keyHash)
+{
+    AttachmentThumbnailQueueEntry **link = &queue->buckets[keyHash & (queue->bucketCount - 1)];
+    while (*link) {
+        AttachmentThumbnailQueueEntry *entry = *link;
+        if (entry->keyHash == keyHash && entry->keyLength == keyLength && memcmp(entry->key, key, keyLength) == 0) {
+            break;
+        }
+        link = &entry->chain;
+    }
+    return link;
+}
+
+static bool AttachmentThumbnailQueueGrow(AttachmentThumbnailQueue *queue)
+{
+    size_t bucketCount = queue->bucketCount * 2;
+    AttachmentThumbnailQueueEntry **buckets = (AttachmentThumbnailQueueEntry **)calloc(bucketCount, sizeof(AttachmentThumbnailQueueEntry *));
+    if (buckets == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < queue->bucketCount; i++) {
+        AttachmentThumbnailQueueEntry *entry = queue->buckets[i];
+        while (entry) {
+            AttachmentThumbnailQueueEntry *chain = entry->chain;
+            size_t bucket = entry->keyHash & (bucketCount - 1);
+            entry->chain = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = chain;
+        }
+    }
+    free(queue->buckets);
+    queue->buckets = buckets;
+    queue->bucketCount = bucketCount;
+    return true;
+}
+
+static bool AttachmentThumbnailQueueEntryAddWaiter(AttachmentThumbnailQueueEntry *entry, void *waiter)
+{
+    if (entry->waiterCount == entry->waiterCapacity) {
+        size_t capacity = entry->waiterCapacity ? entry->waiterCapacity * 2 : 4;
+        void **waiters = (void **)realloc(entry->waiters, capacity * sizeof(void *));
+        if (waiters == NULL) {
+            return false;
+        }
+        entry->waiters = waiters;
+        entry->waiterCapacity = capacity;
+    }
+    entry->waiters[entry->waiterCount++] = waiter;
+    return true;
+}
+
+static void AttachmentThumbnailQueueFreeEntry(AttachmentThumbnailQueueEntry *entry)
+{
+    free(entry->waiters);
+    free(entry->key);
+    free(entry);
+}
+
+// MARK: - Lifetime
+
+AttachmentThumbnailQueue *AttachmentThumbnailQueueCreate(uint32_t decodeLimit, uint32_t fetchLimit)
+{
+    AttachmentThumbnailQueue *queue = (AttachmentThumbnailQueue *)calloc(1, sizeof(AttachmentThumbnailQueue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->bucketCount = 32;
+    queue->buckets = (AttachmentThumbnailQueueEntry **)calloc(queue->bucketCount, sizeof(AttachmentThumbnailQueueEntry *));
+    if (queue->buckets == NULL) {
+        free(queue);
+        return NULL;
+    }
+    AttachmentThumbnailQueueSetLimits(queue, decodeLimit, fetchLimit);
+    return queue;
+}
+
+void AttachmentThumbnailQueueDestroy(AttachmentThumbnailQueue *queue, AttachmentThumbnailQueueWaiterFunction function, void *context)
+{
+    if (queue == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < queue->bucketCount; i++) {
+        AttachmentThumbnailQueueEntry *entry = queue->buckets[i];
+        while (entry) {
+            AttachmentThumbnailQueueEntry *chain = entry->chain;
+            if (function) {
+                for (size_t w = 0; w < entry->waiterCount; w++) {
+                    function(context, entry->waiters[w]);
+                }
+            }
+            AttachmentThumbnailQueueFreeEntry(entry);
+            entry = chain;
+        }
+    }
+    free(queue->buckets);
+    free(queue);
+}
+
+void AttachmentThumbnailQueueSetLimits(AttachmentThumbnailQueue *queue, uint32_t decodeLimit, uint32_t fetchLimit)
+{
+    queue->limits[AttachmentThumbnailLaneDecode] = decodeLimit;
+    queue->limits[AttachmentThumbnailLaneFetch] = fetchLimit;
+}
+
+// MARK: - Scheduling
+
+AttachmentThumbnailQueueAddResult AttachmentThumbnailQueueAdd(AttachmentThumbnailQueue *queue, const char *key, size_t keyLength,
+                                                              uint32_t lane, uint32_t priority, void *waiter)
+{
+    if (lane >= AttachmentThumbnailLaneCount) {
+        lane = AttachmentThumbnailLaneDecode;
+    }
+    if (priority >= AttachmentThumbnailPriorityCount) {
+        priority = AttachmentThumbnailPriorityCount - 1;
+    }
+    uint32_t keyHash = AttachmentThumbnailQueueHash(key, keyLength);
+    AttachmentThumbnailQueueEntry *entry = *AttachmentThumbnailQueueFind(queue, key, keyLength, keyHash);
+
+    if (entry) {
+        if (!AttachmentThumbnailQueueEntryAddWaiter(entry, waiter)) {
+            return AttachmentThumbnailQueueAddFailed;
+        }
+        if (!entry->running && priority > entry->priority) {
+            AttachmentThumbnailQueueListRemove(&queue->queued[entry->lane][entry->priority], entry);
+            entry->priority = priority;
+            entry->sequence = queue->sequence++;
+            AttachmentThumbnailQueueListAppend(&queue->queued[entry->lane][priority], entry);
+        }
+        return AttachmentThumbnailQueueAddJoined;
+    }
+
+    if (queue->entryCount >= queue->bucketCount && !AttachmentThumbnailQueueGrow(queue)) {
+        return AttachmentThumbnailQueueAddFailed;
+    }
+    entry = (AttachmentThumbnailQueueEntry *)calloc(1, sizeof(AttachmentThumbnailQueueEntry));
+    if (entry == NULL) {
+        return AttachmentThumbnailQueueAddFailed;
+    }
+    entry->key = (char *)malloc(keyLength + 1);
+    if (entry->key == NULL || !AttachmentThumbnailQueueEntryAddWaiter(entry, waiter)) {
+        AttachmentThumbnailQueueFreeEntry(entry);
+        return AttachmentThumbnailQueueAddFailed;
+    }
+    memcpy(entry->key, key, keyLength);
+    entry->key[keyLength] = '\0';
+    entry->keyLength = keyLength;
+    entry->keyHash = keyHash;
+    entry->lane = lane;
+    entry->priority = priority;
+    entry->sequence = queue->sequence++;
+
+    AttachmentThumbnailQueueEntry **bucket = &queue->buckets[keyHash & (queue->bucketCount - 1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    queue->entryCount++;
+    AttachmentThumbnailQueueListAppend(&queue->queued[lane][priority], entry);
+    queue->queuedCount++;
+    return AttachmentThumbnailQueueAddQueued;
+}
+
+size_t AttachmentThumbnailQueueNext(AttachmentThumbnailQueue *queue, AttachmentThumbnailQueueJob *jobs, size_t capacity)
+{
+    size_t count = 0;
+    while (count < capacity) {
+        // The oldest head of the highest priority among lanes with room.
+        AttachmentThumbnailQueueEntry *best = NULL;
+        for (int priority = AttachmentThumbnailPriorityCount - 1; priority >= 0 && best == NULL; priority--) {
+            for (uint32_t lane = 0; lane < AttachmentThumbnailLaneCount; lane++) {
+                if (queue->limits[lane] > 0 && queue->running[lane] >= queue->limits[lane]) {
+                    continue;
+                }
+                AttachmentThumbnailQueueEntry *head = queue->queued[lane][priority].head;
+                if (head && (best == NULL || head->sequence < best->sequence)) {
+                    best = head;
+                }
+            }
+        }
+        if (best == NULL) {
+            break;
+        }
+        AttachmentThumbnailQueueListRemove(&queue->queued[best->lane][best->priority], best);
+        queue->queuedCount--;
+        best->running = true;
+        queue->running[best->lane]++;
+        jobs[count].key = best->key;
+        jobs[count].keyLength = best->keyLength;
+        jobs[count].lane = best->lane;
+        count++;
+    }
+    return count;
+}
+
+size_t AttachmentThumbnailQueueFinish(AttachmentThumbnailQueue *queue, const char *key, size_t keyLength,
+                                      AttachmentThumbnailQueueWaiterFunction function, void *context)
+{
+    AttachmentThumbnailQueueEntry **link = AttachmentThumbnailQueueFind(queue, key, keyLength, AttachmentThumbnailQueueHash(key, keyLength));
+    AttachmentThumbnailQueueEntry *entry = *link;
+    if (entry == NULL || !entry->running) {
+        return 0;
+    }
+    *link = entry->chain;
+    queue->entryCount--;
+    queue->running[entry->lane]--;
+
+    size_t waiterCount = entry->waiterCount;
+    if (function) {
+        for (size_t i = 0; i < waiterCount; i++) {
+            function(context, entry->waiters[i]);
+        }
+    }
+    AttachmentThumbnailQueueFreeEntry(entry);
+    return waiterCount;
+}
+
+size_t AttachmentThumbnailQueueQueuedCount(const AttachmentThumbnailQueue *queue)
+{
+    return queue->queuedCount;
+}
+
+size_t AttachmentThumbnailQueueRunningCount(const AttachmentThumbnailQueue *queue, uint32_t lane)
+{
+    return lane < AttachmentThumbnailLaneCount ? queue->running[lane] : 0;
+}
+
+// MARK: - Records
+
+static const uint32_t AttachmentThumbnailRecordMagic = 0x31485441; // "ATH1"
+
+static inline void AttachmentThumbnailWrite32(uint8_t *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static inline void AttachmentThumbnailWrite64(uint8_t *bytes, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t AttachmentThumbnailRecordChecksum(const uint8_t *header, const void *payload, size_t payloadLength)
+{
+    AttachmentThumbnailHasher hasher;
+    AttachmentThumbnailHasherInit(&hasher, 0);
+    AttachmentThumbnailHasherUpdate(&hasher, header, AttachmentThumbnailRecordHeaderLength - 4);
+    AttachmentThumbnailHasherUpdate(&hasher, payload, payloadLength);
+    return (uint32_t)AttachmentThumbnailHasherFinal(&hasher);
+}
+
+void AttachmentThumbnailRecordWriteHeader(uint8_t header[AttachmentThumbnailRecordHeaderLength],
+                                          const AttachmentThumbnailRecordInfo *info, const void *payload)
+{
+    AttachmentThumbnailWrite32(header, AttachmentThumbnailRecordMagic);
+    AttachmentThumbnailWrite32(header + 4, AttachmentThumbnailRecordVersion);
+    AttachmentThumbnailWrite32(header + 8, info->width);
+    AttachmentThumbnailWrite32(header + 12, info->height);
+    AttachmentThumbnailWrite64(header + 16, info->contentHash);
+    AttachmentThumbnailWrite32(header + 24, info->payloadLength);
+    AttachmentThumbnailWrite32(header + 28, AttachmentThumbnailRecordChecksum(header, payload, info->payloadLength));
+}
+
+bool AttachmentThumbnailRecordRead(const void *bytes, size_t length, AttachmentThumbnailRecordInfo *info, const void **payload)
+{
+    const uint8_t *header = (const uint8_t *)bytes;
+    if (length < AttachmentThumbnailRecordHeaderLength
+        || AttachmentThumbnailRead32(header) != AttachmentThumbnailRecordMagic
+        // Version in the low 16 bits, flags in the high 16, none defined yet.
+        || AttachmentThumbnailRead32(header + 4) != AttachmentThumbnailRecordVersion) {
+        return false;
+    }
+    uint32_t payloadLength = AttachmentThumbnailRead32(header + 24);
+    if (length - AttachmentThumbnailRecordHeaderLength != payloadLength) {
+        return false;
+    }
+    const uint8_t *body = header + AttachmentThumbnailRecordHeaderLength;
+    if (AttachmentThumbnailRead32(header + 28) != AttachmentThumbnailRecordChecksum(header, body, payloadLength)) {
+        return false;
+    }
+    info->width = AttachmentThumbnailRead32(header + 8);
+    info->height = AttachmentThumbnailRead32(header + 12);
+    info->contentHash = AttachmentThumbnailRead64(header + 16);
+    info->payloadLength = payloadLength;
+    *payload = body;
+    return true;
+}
@@ -0,0 +1,167 @@
+//
+//  AttachmentThumbnailPipeline.h
+//  ChatGPT-OC-Clone
+//
+//  Queueing, content hashing and the stored record format behind AttachmentThumbnailService.
+//
+
+#ifndef AttachmentThumbnailPipeline_h
+#define AttachmentThumbnailPipeline_h
+
+// Plain C with no Foundation dependency, so the thumbnail pipeline can be
+// built and benchmarked on its own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// MARK: - Content hash
+
+/** Streaming XXH64. Feed bytes in any chunking; the result matches hashing them in one call. */
+typedef struct {
+    uint64_t lanes[4];
+    uint64_t totalLength;
+    uint64_t seed;
+    uint8_t buffer[32];
+    uint32_t bufferLength;
+} AttachmentThumbnailHasher;
+
+void AttachmentThumbnailHasherInit(AttachmentThumbnailHasher *hasher, uint64_t seed);
+void AttachmentThumbnailHasherUpdate(AttachmentThumbnailHasher *hasher, const void *bytes, size_t length);
+uint64_t AttachmentThumbnailHasherFinal(const AttachmentThumbnailHasher *hasher);
+
+uint64_t AttachmentThumbnailHash(const void *bytes, size_t length, uint64_t seed);
+
+/** Contents up to this many bytes are hashed whole; larger ones are sampled. */
+#define AttachmentThumbnailSampledHashThreshold ((size_t)16 << 20)
+#define AttachmentThumbnailSampleLength ((size_t)1 << 20)
+
+/**
+ Hash identifying an attachment by its contents. Contents past
+ AttachmentThumbnailSampledHashThreshold hash their length and a sample
+ from the start, middle and end instead of every byte, so a long video
+ costs three megabytes of reads. Two such files differing only outside the
+ samples share a thumbnail.
+ */
+uint64_t AttachmentThumbnailContentHash(const void *bytes, size_t length);
+
+/**
+ Writes the content key "<hash>-<length>" in hex, NUL terminated, and
+ returns its length, or 0 if `capacity` is too small. 34 bytes always fit.
+ */
+size_t AttachmentThumbnailFormatContentKey(uint64_t contentHash, uint64_t length, char *buffer, size_t capacity);
+
+/**
+ Pixel size thumbnails are made at for a request of `pixelSize`: the next
+ power of two, at least 256 and at most 2048. The input tray and the
+ message list ask for slightly different sizes, and land on the same one.
+ */
+uint32_t AttachmentThumbnailBucketPixelSize(uint32_t pixelSize);
+
+// MARK: - Queue
+
+/** Jobs that decode local contents, and jobs that download first. Each lane runs up to its own limit. */
+enum {
+    AttachmentThumbnailLaneDecode = 0,
+    AttachmentThumbnailLaneFetch = 1,
+    AttachmentThumbnailLaneCount = 2,
+};
+
+enum {
+    AttachmentThumbnailPriorityNormal = 0,
+    /** The input tray: the user just picked these. */
+    AttachmentThumbnailPriorityInteractive = 1,
+    AttachmentThumbnailPriorityCount = 2,
+};
+
+typedef enum {
+    AttachmentThumbnailQueueAddFailed = 0,
+    /** A new job was queued for the key. */
+    AttachmentThumbnailQueueAddQueued,
+    /** The key already had a job, queued or running, and the waiter joined it. */
+    AttachmentThumbnailQueueAddJoined,
+} AttachmentThumbnailQueueAddResult;
+
+typedef struct {
+    /** Valid until the job is finished. */
+    const char *key;
+    size_t keyLength;
+    uint32_t lane;
+} AttachmentThumbnailQueueJob;
+
+/** Called once for each waiter of a finished job. */
+typedef void (*AttachmentThumbnailQueueWaiterFunction)(void *context, void *waiter);
+
+/**
+ Runs one job per key however many requests wait on it, up to a limit per
+ lane at a time.
+
+ Requests wait on a key with an opaque waiter. A request for a key that
+ already has a job joins it, queued or running, and raises a queued job to
+ its priority. Jobs start highest priority first, and within a priority in
+ the order they were queued or raised to it. Not thread safe.
+ */
+typedef struct AttachmentThumbnailQueue AttachmentThumbnailQueue;
+
+/** A limit of 0 runs every job of the lane as soon as it's queued. */
+AttachmentThumbnailQueue *AttachmentThumbnailQueueCreate(uint32_t decodeLimit, uint32_t fetchLimit);
+
+/** Calls `function` for the waiters of every job left, if given. */
+void AttachmentThumbnailQueueDestroy(AttachmentThumbnailQueue *queue, AttachmentThumbnailQueueWaiterFunction function, void *context);
+
+void AttachmentThumbnailQueueSetLimits(AttachmentThumbnailQueue *queue, uint32_t decodeLimit, uint32_t fetchLimit);
+
+/** `lane` only applies when this queues a new job. */
+AttachmentThumbnailQueueAddResult AttachmentThumbnailQueueAdd(AttachmentThumbnailQueue *queue, const char *key, size_t keyLength,
+                                                              uint32_t lane, uint32_t priority, void *waiter);
+
+/** Starts up to `capacity` queued jobs the limits allow, and returns how many. */
+size_t AttachmentThumbnailQueueNext(AttachmentThumbnailQueue *queue, AttachmentThumbnailQueueJob *jobs, size_t capacity);
+
+/**
+ Ends a running job, calling `function` for each of its waiters, and
+ returns how many there were. Returns 0 if the key has no running job.
+ */
+size_t AttachmentThumbnailQueueFinish(AttachmentThumbnailQueue *queue, const char *key, size_t keyLength,
+                                      AttachmentThumbnailQueueWaiterFunction function, void *context);
+
+size_t AttachmentThumbnailQueueQueuedCount(const AttachmentThumbnailQueue *queue);
+size_t AttachmentThumbnailQueueRunningCount(const AttachmentThumbnailQueue *queue, uint32_t lane);
+
+// MARK: - Records
+
+/**
+ A stored thumbnail: a 32 byte header followed by the encoded image.
+
+ The header holds, little endian, the magic "ATH1", a version and flags of
+ 16 bits each, the width and height in pixels, the 64 bit content hash the
+ thumbnail was made from, the payload length, and a 32 bit checksum over
+ the rest of the header and the payload. A record that doesn't check out,
+ from a crash mid-write or an older version, is treated as missing.
+ */
+#define AttachmentThumbnailRecordHeaderLength ((size_t)32)
+#define AttachmentThumbnailRecordVersion 1
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint64_t contentHash;
+    uint32_t payloadLength;
+} AttachmentThumbnailRecordInfo;
+
+/** Fills `header` for `payload`, whose length is info->payloadLength. */
+void AttachmentThumbnailRecordWriteHeader(uint8_t header[AttachmentThumbnailRecordHeaderLength],
+                                          const AttachmentThumbnailRecordInfo *info, const void *payload);
+
+/** Returns false unless `bytes` hold exactly one valid record, otherwise fills `info` and `payload`. */
+bool AttachmentThumbnailRecordRead(const void *bytes, size_t length, AttachmentThumbnailRecordInfo *info, const void **payload);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AttachmentThumbnailPipeline_h
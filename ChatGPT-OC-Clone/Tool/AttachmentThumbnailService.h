@@ -0,0 +1,44 @@
+//
+//  AttachmentThumbnailService.h
+//  ChatGPT-OC-Clone
+//
+//  Thumbnails for attachments in the input tray and the message list, made once per attachment.
+//
+
+#import <UIKit/UIKit.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(NSInteger, AttachmentThumbnailRequestPriority) {
+    AttachmentThumbnailRequestPriorityNormal = 0,
+    /// The input tray, where the user just picked the attachment.
+    AttachmentThumbnailRequestPriorityInteractive,
+};
+
+/// Attachments are UIImages, local file URLs or uploaded http(s) URLs.
+///
+/// Thumbnails are decoded straight at their display size by a small pool of workers, and
+/// stored on disk keyed by a hash of the attachment's contents, so an attachment is made a
+/// thumbnail of once however often and wherever it shows, across launches. Requests for an
+/// attachment with a thumbnail on the way join it; once uploaded URLs are associated with the
+/// tray's attachments, the message list's requests join the tray's too.
+@interface AttachmentThumbnailService : NSObject
+
++ (instancetype)sharedService;
+
+/// The thumbnail if it is in memory, for building views without a placeholder flash.
+- (nullable UIImage *)cachedThumbnailForAttachment:(id)attachment pointSize:(CGFloat)pointSize;
+
+/// Calls completion on the main thread, with nil if no thumbnail could be made.
+- (void)requestThumbnailForAttachment:(id)attachment
+                            pointSize:(CGFloat)pointSize
+                             priority:(AttachmentThumbnailRequestPriority)priority
+                           completion:(void (^)(UIImage * _Nullable image))completion;
+
+/// Call with the URLs an upload returned, in the order of the attachments uploaded. Does nothing
+/// unless there is one URL per attachment, since they couldn't be paired otherwise.
+- (void)associateUploadedURLs:(NSArray<NSURL *> *)urls withAttachments:(NSArray *)attachments;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,490 @@
+//
+//  AttachmentThumbnailService.m
+//  ChatGPT-OC-Clone
+//
+
+#import "AttachmentThumbnailService.h"
+#import "AttachmentThumbnailPipeline.h"
+#import <objc/runtime.h>
+#import <os/lock.h>
+#import <QuickLookThumbnailing/QuickLookThumbnailing.h>
+#import <PINCache/PINDiskCache.h>
+#import <PINRemoteImage/PINImage+DecodedImage.h>
+#import <PINRemoteImage/PINImage+ScaledImage.h>
+
+static const uint32_t kDecodeWorkerCount = 2;   // 本地解码：CPU 密集，少量即可
+static const uint32_t kFetchWorkerCount = 3;    // 先下载再解码：主要在等网络
+static const NSUInteger kDiskByteLimit = 64 * 1024 * 1024;
+static const NSUInteger kMemoryCostLimit = 16 * 1024 * 1024;
+static const CGFloat kThumbnailJPEGQuality = 0.8;
+static const size_t kJobBatchCount = 8;
+
+static const void *kImageIdentityKey = &kImageIdentityKey;
+
+// 队列里的一个任务：同一附件、同一尺寸只有一个
+@interface AttachmentThumbnailJob : NSObject
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, copy) NSString *identity;
+@property (nonatomic, strong, nullable) id source;
+/// 已知的内容键（否则要读取内容才知道）
+@property (nonatomic, copy, nullable) NSString *contentKey;
+/// 本地附件已释放时，退回从上传后的 URL 下载
+@property (nonatomic, strong, nullable) NSURL *fallbackURL;
+@property (nonatomic, assign) uint32_t pixelSize;
+@end
+
+@implementation AttachmentThumbnailJob
+@end
+
+static void AttachmentThumbnailCollectWaiter(void *context, void *waiter) {
+    NSMutableArray *completions = (__bridge NSMutableArray *)context;
+    [completions addObject:(__bridge_transfer id)waiter];
+}
+
+static NSString *AttachmentThumbnailContentKey(const void *bytes, size_t length, uint64_t *contentHash) {
+    uint64_t hash = AttachmentThumbnailContentHash(bytes, length);
+    char buffer[40];
+    size_t keyLength = AttachmentThumbnailFormatContentKey(hash, length, buffer, sizeof(buffer));
+    if (contentHash) {
+        *contentHash = hash;
+    }
+    return [[NSString alloc] initWithBytes:buffer length:keyLength encoding:NSASCIIStringEncoding];
+}
+
+@implementation AttachmentThumbnailService {
+    os_unfair_lock _lock;
+    AttachmentThumbnailQueue *_queue;
+    NSMutableDictionary<NSString *, AttachmentThumbnailJob *> *_jobs;
+    // 附件标识 -> 内容键；上传后的 URL 标识 -> 本地附件标识
+    NSMutableDictionary<NSString *, NSString *> *_contentKeys;
+    NSMutableDictionary<NSString *, NSString *> *_aliases;
+    NSMapTable<NSString *, id> *_sources;
+    NSCache<NSString *, UIImage *> *_memoryCache;
+    PINDiskCache *_diskCache;
+    NSURLSession *_session;
+    CGFloat _screenScale;
+}
+
++ (instancetype)sharedService {
+    static AttachmentThumbnailService *sharedService = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedService = [[self alloc] init];
+    });
+    return sharedService;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _queue = AttachmentThumbnailQueueCreate(kDecodeWorkerCount, kFetchWorkerCount);
+        if (_queue == NULL) {
+            return nil;
+        }
+        _jobs = [NSMutableDictionary dictionary];
+        _contentKeys = [NSMutableDictionary dictionary];
+        _aliases = [NSMutableDictionary dictionary];
+        _sources = [NSMapTable strongToWeakObjectsMapTable];
+        _memoryCache = [[NSCache alloc] init];
+        _memoryCache.totalCostLimit = kMemoryCostLimit;
+        _diskCache = [[PINDiskCache alloc] initWithName:@"AttachmentThumbnails"];
+        _diskCache.byteLimit = kDiskByteLimit;
+        _session = [NSURLSession sessionWithConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration]];
+        // 与 Texture 的 ASScreenScale 一样，只读一次，可能不在主线程
+        _screenScale = [UIScreen mainScreen].scale;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    AttachmentThumbnailQueueDestroy(_queue, AttachmentThumbnailCollectWaiter, (__bridge void *)[NSMutableArray array]);
+}
+
+// MARK: - Keys
+
+- (nullable NSString *)identityForAttachment:(id)attachment {
+    if ([attachment isKindOfClass:[UIImage class]]) {
+        // UIImage 没有可读的原始字节：给它一个固定标识，并直接当作内容键
+        @synchronized (attachment) {
+            NSString *identity = objc_getAssociatedObject(attachment, kImageIdentityKey);
+            if (!identity) {
+                identity = [@"image-" stringByAppendingString:[NSUUID UUID].UUIDString];
+                objc_setAssociatedObject(attachment, kImageIdentityKey, identity, OBJC_ASSOCIATION_COPY_NONATOMIC);
+            }
+            return identity;
+        }
+    }
+    if ([attachment isKindOfClass:[NSURL class]]) {
+        NSURL *url = attachment;
+        if (url.isFileURL) {
+            if (url.path.length == 0) {
+                return nil;
+            }
+            // 文件选择器会复用同名临时文件：带上大小和修改时间，内容变了就是新附件
+            NSDictionary<NSURLResourceKey, id> *values = [url resourceValuesForKeys:@[NSURLFileSizeKey, NSURLContentModificationDateKey] error:nil];
+            return [NSString stringWithFormat:@"file:%@#%llu-%.6f", url.path,
+                    [values[NSURLFileSizeKey] unsignedLongLongValue],
+                    [values[NSURLContentModificationDateKey] timeIntervalSinceReferenceDate]];
+        }
+        return url.absoluteString.length > 0 ? [@"url:" stringByAppendingString:url.absoluteString] : nil;
+    }
+    return nil;
+}
+
+- (uint32_t)pixelSizeForPointSize:(CGFloat)pointSize {
+    CGFloat pixels = ceil(MAX(pointSize, 1.0) * _screenScale);
+    return AttachmentThumbnailBucketPixelSize((uint32_t)MIN(pixels, (CGFloat)UINT32_MAX));
+}
+
+- (NSString *)memoryKeyForContentKey:(NSString *)contentKey pixelSize:(uint32_t)pixelSize {
+    return [NSString stringWithFormat:@"%@-%u", contentKey, pixelSize];
+}
+
+- (NSString *)recordKeyForContentKey:(NSString *)contentKey pixelSize:(uint32_t)pixelSize {
+    return [NSString stringWithFormat:@"thumb-%@-%u", contentKey, pixelSize];
+}
+
+- (NSString *)aliasKeyForURL:(NSURL *)url {
+    NSData *bytes = [url.absoluteString dataUsingEncoding:NSUTF8StringEncoding] ?: [NSData data];
+    return [@"alias-" stringByAppendingString:AttachmentThumbnailContentKey(bytes.bytes, bytes.length, NULL)];
+}
+
+// 沿着别名找到最终的附件标识，以及它的内容键（若已知）
+- (NSString *)l_resolveIdentity:(NSString *)identity contentKey:(NSString * _Nullable * _Nonnull)contentKey {
+    for (int hop = 0; hop < 4; hop++) {
+        NSString *known = _contentKeys[identity];
+        if (known) {
+            *contentKey = known;
+            return identity;
+        }
+        NSString *alias = _aliases[identity];
+        // 本地附件已释放且内容键未知时，别名没有意义（任务进行中会持有附件）
+        if (!alias || (!_contentKeys[alias] && ![_sources objectForKey:alias])) {
+            break;
+        }
+        identity = alias;
+    }
+    *contentKey = nil;
+    return identity;
+}
+
+// MARK: - Requests
+
+- (nullable UIImage *)cachedThumbnailForAttachment:(id)attachment pointSize:(CGFloat)pointSize {
+    NSString *identity = [self identityForAttachment:attachment];
+    if (!identity) {
+        return nil;
+    }
+    uint32_t pixelSize = [self pixelSizeForPointSize:pointSize];
+    os_unfair_lock_lock(&_lock);
+    NSString *contentKey = nil;
+    [self l_resolveIdentity:identity contentKey:&contentKey];
+    os_unfair_lock_unlock(&_lock);
+    return contentKey ? [_memoryCache objectForKey:[self memoryKeyForContentKey:contentKey pixelSize:pixelSize]] : nil;
+}
+
+- (void)requestThumbnailForAttachment:(id)attachment
+                            pointSize:(CGFloat)pointSize
+                             priority:(AttachmentThumbnailRequestPriority)priority
+                           completion:(void (^)(UIImage * _Nullable image))completion {
+    NSString *identity = [self identityForAttachment:attachment];
+    if (!identity || !completion) {
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{ completion(nil); });
+        }
+        return;
+    }
+    uint32_t pixelSize = [self pixelSizeForPointSize:pointSize];
+
+    os_unfair_lock_lock(&_lock);
+    if ([attachment isKindOfClass:[UIImage class]]) {
+        _contentKeys[identity] = identity;
+    }
+    NSString *contentKey = nil;
+    NSString *resolved = [self l_resolveIdentity:identity contentKey:&contentKey];
+    UIImage *cached = contentKey ? [_memoryCache objectForKey:[self memoryKeyForContentKey:contentKey pixelSize:pixelSize]] : nil;
+    if (cached) {
+        os_unfair_lock_unlock(&_lock);
+        dispatch_async(dispatch_get_main_queue(), ^{ completion(cached); });
+        return;
+    }
+
+    NSString *key = [NSString stringWithFormat:@"%@@%u", resolved, pixelSize];
+    const char *keyBytes = key.UTF8String;
+    BOOL remote = [resolved hasPrefix:@"url:"];
+    uint32_t lane = (remote && !contentKey) ? AttachmentThumbnailLaneFetch : AttachmentThumbnailLaneDecode;
+    uint32_t queuePriority = (priority == AttachmentThumbnailRequestPriorityInteractive) ? AttachmentThumbnailPriorityInteractive : AttachmentThumbnailPriorityNormal;
+    void *waiter = (__bridge_retained void *)[completion copy];
+    AttachmentThumbnailQueueAddResult result = AttachmentThumbnailQueueAdd(_queue, keyBytes, strlen(keyBytes), lane, queuePriority, waiter);
+    if (result == AttachmentThumbnailQueueAddQueued) {
+        AttachmentThumbnailJob *job = [[AttachmentThumbnailJob alloc] init];
+        job.key = key;
+        job.identity = resolved;
+        job.contentKey = contentKey;
+        job.pixelSize = pixelSize;
+        job.source = [resolved isEqualToString:identity] ? attachment : [_sources objectForKey:resolved];
+        if (!job.source && remote == NO && [identity hasPrefix:@"url:"]) {
+            job.fallbackURL = attachment;
+        }
+        _jobs[key] = job;
+    }
+    os_unfair_lock_unlock(&_lock);
+
+    if (result == AttachmentThumbnailQueueAddFailed) {
+        CFBridgingRelease(waiter);
+        dispatch_async(dispatch_get_main_queue(), ^{ completion(nil); });
+        return;
+    }
+    [self scheduleJobs];
+}
+
+- (void)associateUploadedURLs:(NSArray<NSURL *> *)urls withAttachments:(NSArray *)attachments {
+    // 数量不一致时无法确定对应关系（可能有上传失败）
+    if (urls.count != attachments.count) {
+        return;
+    }
+    NSMutableArray<NSString *> *remotes = [NSMutableArray array];
+    NSMutableArray<NSString *> *locals = [NSMutableArray array];
+    NSMutableArray *sources = [NSMutableArray array];
+    NSMutableArray<NSURL *> *uploadedURLs = [NSMutableArray array];
+    for (NSUInteger i = 0; i < urls.count; i++) {
+        NSString *remote = [self identityForAttachment:urls[i]];
+        NSString *local = [self identityForAttachment:attachments[i]];
+        if (remote && local && ![remote isEqualToString:local]) {
+            [remotes addObject:remote];
+            [locals addObject:local];
+            [sources addObject:attachments[i]];
+            [uploadedURLs addObject:urls[i]];
+        }
+    }
+
+    NSMutableArray<NSURL *> *persistable = [NSMutableArray array];
+    NSMutableArray<NSString *> *persistableKeys = [NSMutableArray array];
+    os_unfair_lock_lock(&_lock);
+    for (NSUInteger i = 0; i < remotes.count; i++) {
+        if ([sources[i] isKindOfClass:[UIImage class]]) {
+            _contentKeys[locals[i]] = locals[i];
+        }
+        _aliases[remotes[i]] = locals[i];
+        [_sources setObject:sources[i] forKey:locals[i]];
+        // 内容键未知的，等本地任务完成时再持久化
+        NSString *contentKey = _contentKeys[locals[i]];
+        if (contentKey) {
+            [persistable addObject:uploadedURLs[i]];
+            [persistableKeys addObject:contentKey];
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+    for (NSUInteger i = 0; i < persistable.count; i++) {
+        [_diskCache setObjectAsync:persistableKeys[i] forKey:[self aliasKeyForURL:persistable[i]] completion:nil];
+    }
+}
+
+// MARK: - Workers
+
+- (void)scheduleJobs {
+    AttachmentThumbnailQueueJob started[kJobBatchCount];
+    NSMutableArray<AttachmentThumbnailJob *> *jobs = [NSMutableArray array];
+    os_unfair_lock_lock(&_lock);
+    size_t count;
+    while ((count = AttachmentThumbnailQueueNext(_queue, started, kJobBatchCount)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            NSString *key = [[NSString alloc] initWithBytes:started[i].key length:started[i].keyLength encoding:NSUTF8StringEncoding];
+            AttachmentThumbnailJob *job = key ? _jobs[key] : nil;
+            if (job) {
+                [jobs addObject:job];
+            }
+        }
+    }
+    os_unfair_lock_unlock(&_lock);
+    for (AttachmentThumbnailJob *job in jobs) {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [self runJob:job];
+        });
+    }
+}
+
+- (void)runJob:(AttachmentThumbnailJob *)job {
+    if (job.contentKey) {
+        UIImage *stored = [self storedThumbnailForContentKey:job.contentKey pixelSize:job.pixelSize];
+        if (stored) {
+            [self finishJob:job image:stored contentKey:job.contentKey];
+            return;
+        }
+    }
+
+    id source = job.source ?: job.fallbackURL;
+    if ([source isKindOfClass:[UIImage class]]) {
+        // 没有原始字节可解码：按目标尺寸分块缩小位图
+        UIImage *image = [(UIImage *)source pin_imageDownsampledToMaxPixelSize:job.pixelSize];
+        NSString *contentKey = job.identity;
+        if (image) {
+            NSData *identityBytes = [contentKey dataUsingEncoding:NSUTF8StringEncoding];
+            [self storeThumbnail:image contentKey:contentKey contentHash:AttachmentThumbnailHash(identityBytes.bytes, identityBytes.length, 0) pixelSize:job.pixelSize];
+        }
+        [self finishJob:job image:image contentKey:contentKey];
+    } else if ([source isKindOfClass:[NSURL class]] && ((NSURL *)source).isFileURL) {
+        NSData *data = [NSData dataWithContentsOfURL:source options:NSDataReadingMappedIfSafe error:nil];
+        if (!data) {
+            [self finishJob:job image:nil contentKey:nil];
+            return;
+        }
+        [self makeThumbnailWithData:data fileURL:source job:job];
+    } else if ([source isKindOfClass:[NSURL class]]) {
+        [self fetchThumbnailForURL:source job:job];
+    } else {
+        [self finishJob:job image:nil contentKey:nil];
+    }
+}
+
+- (void)fetchThumbnailForURL:(NSURL *)url job:(AttachmentThumbnailJob *)job {
+    // 之前的启动中见过这个 URL：直接按内容键读取，无需下载
+    NSString *aliasKey = [self aliasKeyForURL:url];
+    id contentKey = [_diskCache objectForKey:aliasKey];
+    if ([contentKey isKindOfClass:[NSString class]]) {
+        UIImage *stored = [self storedThumbnailForContentKey:contentKey pixelSize:job.pixelSize];
+        if (stored) {
+            [self finishJob:job image:stored contentKey:contentKey];
+            return;
+        }
+    }
+    NSURLSessionDataTask *task = [_session dataTaskWithURL:url completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+        NSInteger status = [response isKindOfClass:[NSHTTPURLResponse class]] ? ((NSHTTPURLResponse *)response).statusCode : 200;
+        if (!data || error || status >= 400) {
+            [self finishJob:job image:nil contentKey:nil];
+            return;
+        }
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [self makeThumbnailWithData:data fileURL:nil job:job];
+        });
+    }];
+    [task resume];
+}
+
+- (void)makeThumbnailWithData:(NSData *)data fileURL:(nullable NSURL *)fileURL job:(AttachmentThumbnailJob *)job {
+    uint64_t contentHash = 0;
+    NSString *contentKey = AttachmentThumbnailContentKey(data.bytes, data.length, &contentHash);
+    UIImage *stored = [self storedThumbnailForContentKey:contentKey pixelSize:job.pixelSize];
+    if (stored) {
+        [self finishJob:job image:stored contentKey:contentKey];
+        return;
+    }
+    // 直接解码到目标尺寸，JPEG 不必先解出整张图
+    UIImage *image = [UIImage pin_decodedImageWithData:data maxPixelSize:job.pixelSize];
+    if (image || !fileURL) {
+        if (image) {
+            [self storeThumbnail:image contentKey:contentKey contentHash:contentHash pixelSize:job.pixelSize];
+        }
+        [self finishJob:job image:image contentKey:contentKey];
+        return;
+    }
+
+    // PDF 等非图片文件交给 QuickLook
+    CGFloat side = job.pixelSize / _screenScale;
+    QLThumbnailGenerationRequest *request = [[QLThumbnailGenerationRequest alloc] initWithFileAtURL:fileURL
+                                                                                                size:CGSizeMake(side, side)
+                                                                                               scale:_screenScale
+                                                                                 representationTypes:QLThumbnailGenerationRequestRepresentationTypeAll];
+    [[QLThumbnailGenerator sharedGenerator] generateBestRepresentationForRequest:request completionHandler:^(QLThumbnailRepresentation * _Nullable thumbnail, NSError * _Nullable error) {
+        UIImage *generated = thumbnail.UIImage;
+        if (generated) {
+            [self storeThumbnail:generated contentKey:contentKey contentHash:contentHash pixelSize:job.pixelSize];
+        }
+        [self finishJob:job image:generated contentKey:contentKey];
+    }];
+}
+
+// MARK: - Storage
+
+- (nullable UIImage *)storedThumbnailForContentKey:(NSString *)contentKey pixelSize:(uint32_t)pixelSize {
+    UIImage *image = [_memoryCache objectForKey:[self memoryKeyForContentKey:contentKey pixelSize:pixelSize]];
+    if (image) {
+        return image;
+    }
+    id record = [_diskCache objectForKey:[self recordKeyForContentKey:contentKey pixelSize:pixelSize]];
+    if (![record isKindOfClass:[NSData class]]) {
+        return nil;
+    }
+    AttachmentThumbnailRecordInfo info;
+    const void *payload = NULL;
+    if (!AttachmentThumbnailRecordRead([record bytes], [record length], &info, &payload)) {
+        // 写到一半或旧版本的记录：当作没有，重新生成时会覆盖
+        return nil;
+    }
+    NSData *encoded = [NSData dataWithBytesNoCopy:(void *)payload length:info.payloadLength freeWhenDone:NO];
+    image = [UIImage pin_decodedImageWithData:encoded];
+    if (image) {
+        [_memoryCache setObject:image forKey:[self memoryKeyForContentKey:contentKey pixelSize:pixelSize] cost:[self costOfImage:image]];
+    }
+    return image;
+}
+
+- (void)storeThumbnail:(UIImage *)image contentKey:(NSString *)contentKey contentHash:(uint64_t)contentHash pixelSize:(uint32_t)pixelSize {
+    [_memoryCache setObject:image forKey:[self memoryKeyForContentKey:contentKey pixelSize:pixelSize] cost:[self costOfImage:image]];
+
+    CGImageRef cgImage = image.CGImage;
+    if (!cgImage) {
+        return;
+    }
+    CGImageAlphaInfo alpha = CGImageGetAlphaInfo(cgImage);
+    BOOL opaque = alpha == kCGImageAlphaNone || alpha == kCGImageAlphaNoneSkipFirst || alpha == kCGImageAlphaNoneSkipLast;
+    NSData *encoded = opaque ? PINImageJPEGRepresentation(image, kThumbnailJPEGQuality) : PINImagePNGRepresentation(image);
+    if (encoded.length == 0 || encoded.length > UINT32_MAX) {
+        return;
+    }
+    AttachmentThumbnailRecordInfo info = {
+        (uint32_t)CGImageGetWidth(cgImage),
+        (uint32_t)CGImageGetHeight(cgImage),
+        contentHash,
+        (uint32_t)encoded.length,
+    };
+    NSMutableData *record = [NSMutableData dataWithLength:AttachmentThumbnailRecordHeaderLength];
+    AttachmentThumbnailRecordWriteHeader(record.mutableBytes, &info, encoded.bytes);
+    [record appendData:encoded];
+    [_diskCache setObjectAsync:record forKey:[self recordKeyForContentKey:contentKey pixelSize:pixelSize] completion:nil];
+}
+
+- (NSUInteger)costOfImage:(UIImage *)image {
+    CGImageRef cgImage = image.CGImage;
+    return cgImage ? CGImageGetBytesPerRow(cgImage) * CGImageGetHeight(cgImage) : 0;
+}
+
+- (void)finishJob:(AttachmentThumbnailJob *)job image:(nullable UIImage *)image contentKey:(nullable NSString *)contentKey {
+    NSMutableArray *completions = [NSMutableArray array];
+    NSMutableArray<NSURL *> *aliasedURLs = [NSMutableArray array];
+    os_unfair_lock_lock(&_lock);
+    if (contentKey) {
+        _contentKeys[job.identity] = contentKey;
+        // 已上传的 URL 现在可以持久地指向这份内容
+        [_aliases enumerateKeysAndObjectsUsingBlock:^(NSString *remote, NSString *local, BOOL *stop) {
+            if ([local isEqualToString:job.identity]) {
+                NSURL *url = [NSURL URLWithString:[remote substringFromIndex:@"url:".length]];
+                if (url) {
+                    [aliasedURLs addObject:url];
+                }
+            }
+        }];
+        if ([job.identity hasPrefix:@"url:"]) {
+            NSURL *url = [NSURL URLWithString:[job.identity substringFromIndex:@"url:".length]];
+            if (url) {
+                [aliasedURLs addObject:url];
+            }
+        }
+    }
+    [_jobs removeObjectForKey:job.key];
+    const char *keyBytes = job.key.UTF8String;
+    AttachmentThumbnailQueueFinish(_queue, keyBytes, strlen(keyBytes), AttachmentThumbnailCollectWaiter, (__bridge void *)completions);
+    os_unfair_lock_unlock(&_lock);
+
+    for (NSURL *url in aliasedURLs) {
+        [_diskCache setObjectAsync:contentKey forKey:[self aliasKeyForURL:url] completion:nil];
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (void (^completion)(UIImage *) in completions) {
+            completion(image);
+        }
+    });
+    [self scheduleJobs];
+}
+
+@end
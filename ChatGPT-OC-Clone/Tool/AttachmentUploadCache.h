@@ -0,0 +1,29 @@
+//
+//  AttachmentUploadCache.h
+//  ChatGPT-OC-Clone
+//
+//  Skips uploading attachments whose contents were uploaded before.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Uploads through OSSUploadManager, remembering which URL each attachment's contents went to.
+///
+/// Attachments are keyed by the CRC-64 and length of their contents: a file's bytes, or an
+/// image's pixels. Contents whose URL still works are not uploaded again, whichever chat they
+/// are sent in. The index is stored in Caches and survives relaunches.
+@interface AttachmentUploadCache : NSObject
+
++ (instancetype)sharedCache;
+
+/// Same contract as OSSUploadManager's: one URL per attachment in their order, with the
+/// completion on the main thread. If an upload partly fails, the URLs that exist come back,
+/// the reused ones first.
+- (void)uploadAttachments:(NSArray *)attachments
+               completion:(void (^)(NSArray<NSURL *> *uploadedURLs))completion;
+
+@end
+
+NS_ASSUME_NONNULL_END
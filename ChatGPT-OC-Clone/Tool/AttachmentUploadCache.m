@@ -0,0 +1,300 @@
+//
+//  AttachmentUploadCache.m
+//  ChatGPT-OC-Clone
+//
+
+#import "AttachmentUploadCache.h"
+#import "AttachmentUploadIndex.h"
+#import "OSSUploadManager.h"
+#import <UIKit/UIKit.h>
+
+static const size_t kIndexCapacity = 2048;
+// 复用的 URL 至少还要有效这么久，模型才来得及读取
+static const int64_t kExpiryMargin = 10 * 60;
+// 没有签名过期时间的 URL：保守地认为一周后失效（存储桶可能有生命周期规则）
+static const int64_t kUnsignedURLLifetime = 7 * 24 * 60 * 60;
+
+typedef struct {
+    uint64_t crc64;
+    uint64_t length;
+} AttachmentUploadKey;
+
+/// 大内容分块并行计算 CRC-64，再合并成整体的值
+static uint64_t AttachmentUploadHashBytes(uint64_t crc, const uint8_t *bytes, size_t length) {
+    if (length <= AttachmentUploadParallelHashThreshold) {
+        return AttachmentUploadCRC64(crc, bytes, length);
+    }
+    size_t count = AttachmentUploadHashChunkCount(length, AttachmentUploadHashChunkLength);
+    uint64_t *chunkCRCs = (uint64_t *)malloc(count * sizeof(uint64_t));
+    if (chunkCRCs == NULL) {
+        return AttachmentUploadCRC64(crc, bytes, length);
+    }
+    dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t i) {
+        size_t start = i * AttachmentUploadHashChunkLength;
+        size_t chunk = MIN(AttachmentUploadHashChunkLength, length - start);
+        chunkCRCs[i] = AttachmentUploadCRC64(0, bytes + start, chunk);
+    });
+    uint64_t whole = AttachmentUploadCRC64CombineChunks(chunkCRCs, count, length, AttachmentUploadHashChunkLength);
+    free(chunkCRCs);
+    return AttachmentUploadCRC64Combine(crc, whole, length);
+}
+
+@implementation AttachmentUploadCache {
+    // 索引只在 _queue 上访问
+    dispatch_queue_t _queue;
+    AttachmentUploadIndex *_index;
+    NSURL *_fileURL;
+}
+
++ (instancetype)sharedCache {
+    static AttachmentUploadCache *sharedCache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[self alloc] init];
+    });
+    return sharedCache;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _index = AttachmentUploadIndexCreate(kIndexCapacity);
+        if (_index == NULL) {
+            return nil;
+        }
+        _queue = dispatch_queue_create("com.chatgpt.attachmentUploadCache", DISPATCH_QUEUE_SERIAL);
+        NSURL *cachesURL = [[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask].firstObject;
+        _fileURL = [cachesURL URLByAppendingPathComponent:@"AttachmentUploadIndex.bin"];
+        dispatch_async(_queue, ^{
+            [self loadIndex];
+        });
+    }
+    return self;
+}
+
+- (void)dealloc {
+    AttachmentUploadIndexDestroy(_index);
+}
+
+// MARK: - Persistence
+
+- (int64_t)now {
+    return (int64_t)[[NSDate date] timeIntervalSince1970];
+}
+
+- (void)loadIndex {
+    NSData *data = [NSData dataWithContentsOfURL:_fileURL options:NSDataReadingMappedIfSafe error:nil];
+    if (data.length == 0) {
+        return;
+    }
+    if (!AttachmentUploadIndexDecode(_index, data.bytes, data.length, [self now])) {
+        // 写到一半崩溃或旧版本：丢弃，之后重新积累
+        [[NSFileManager defaultManager] removeItemAtURL:_fileURL error:nil];
+    }
+}
+
+- (void)saveIndex {
+    AttachmentUploadIndexPrune(_index, [self now]);
+    size_t length = AttachmentUploadIndexEncodedLength(_index);
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    if (AttachmentUploadIndexEncode(_index, data.mutableBytes, length) != length) {
+        return;
+    }
+    NSError *error = nil;
+    if (![data writeToURL:_fileURL options:NSDataWritingAtomic error:&error]) {
+        NSLog(@"[AttachmentUploadCache] 保存索引失败: %@", error);
+    }
+}
+
+// MARK: - Keys
+
+/// 文件按字节、图片按像素（连同尺寸与方向）计算键；无法读取内容时返回 NO，照常上传
+- (BOOL)getKey:(AttachmentUploadKey *)key forAttachment:(id)attachment {
+    if ([attachment isKindOfClass:[NSURL class]]) {
+        NSURL *url = attachment;
+        if (!url.isFileURL) {
+            return NO;
+        }
+        NSData *data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:nil];
+        if (data == nil) {
+            return NO;
+        }
+        key->crc64 = AttachmentUploadHashBytes(0, data.bytes, data.length);
+        key->length = data.length;
+        return YES;
+    }
+    if ([attachment isKindOfClass:[UIImage class]]) {
+        UIImage *image = attachment;
+        CGImageRef cgImage = image.CGImage;
+        if (cgImage == NULL) {
+            return NO;
+        }
+        CFDataRef pixels = CGDataProviderCopyData(CGImageGetDataProvider(cgImage));
+        if (pixels == NULL) {
+            return NO;
+        }
+        uint64_t layout[7] = {
+            CGImageGetWidth(cgImage), CGImageGetHeight(cgImage), CGImageGetBitsPerComponent(cgImage),
+            CGImageGetBitsPerPixel(cgImage), CGImageGetBytesPerRow(cgImage), CGImageGetBitmapInfo(cgImage),
+            (uint64_t)image.imageOrientation,
+        };
+        size_t pixelLength = (size_t)CFDataGetLength(pixels);
+        uint64_t crc = AttachmentUploadCRC64(0, layout, sizeof(layout));
+        key->crc64 = AttachmentUploadHashBytes(crc, CFDataGetBytePtr(pixels), pixelLength);
+        key->length = sizeof(layout) + pixelLength;
+        CFRelease(pixels);
+        return YES;
+    }
+    return NO;
+}
+
+/// 带签名的 URL 取签名里的过期时间（OSS V1/V4、COS），否则按默认有效期
+- (int64_t)expiryForURL:(NSURL *)url now:(int64_t)now {
+    NSURLComponents *components = [NSURLComponents componentsWithURL:url resolvingAgainstBaseURL:NO];
+    NSMutableDictionary<NSString *, NSString *> *query = [NSMutableDictionary dictionary];
+    for (NSURLQueryItem *item in components.queryItems) {
+        if (item.value) {
+            query[item.name.lowercaseString] = item.value;
+        }
+    }
+    if (query[@"expires"]) {
+        return query[@"expires"].longLongValue;
+    }
+    NSString *signTime = query[@"q-sign-time"] ?: query[@"q-key-time"];
+    NSArray<NSString *> *range = [signTime componentsSeparatedByString:@";"];
+    if (range.count == 2) {
+        return range[1].longLongValue;
+    }
+    for (NSString *prefix in @[@"x-oss-", @"x-amz-"]) {
+        NSString *expires = query[[prefix stringByAppendingString:@"expires"]];
+        NSString *date = query[[prefix stringByAppendingString:@"date"]];
+        if (expires && date) {
+            static NSDateFormatter *formatter = nil;
+            static dispatch_once_t onceToken;
+            dispatch_once(&onceToken, ^{
+                formatter = [[NSDateFormatter alloc] init];
+                formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+                formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+                formatter.dateFormat = @"yyyyMMdd'T'HHmmss'Z'";
+            });
+            NSDate *signedAt = [formatter dateFromString:date];
+            if (signedAt) {
+                return (int64_t)signedAt.timeIntervalSince1970 + expires.longLongValue;
+            }
+        }
+    }
+    return now + kUnsignedURLLifetime;
+}
+
+// MARK: - Upload
+
+- (void)uploadAttachments:(NSArray *)attachments
+               completion:(void (^)(NSArray<NSURL *> *uploadedURLs))completion {
+    NSArray *pending = [attachments copy];
+    // 计算键要读取全部内容，放到后台
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSMutableArray *keys = [NSMutableArray arrayWithCapacity:pending.count];
+        for (id attachment in pending) {
+            AttachmentUploadKey key;
+            if ([self getKey:&key forAttachment:attachment]) {
+                [keys addObject:[NSValue valueWithBytes:&key objCType:@encode(AttachmentUploadKey)]];
+            } else {
+                [keys addObject:[NSNull null]];
+            }
+        }
+        dispatch_async(self->_queue, ^{
+            [self uploadAttachments:pending keys:keys completion:completion];
+        });
+    });
+}
+
+- (void)uploadAttachments:(NSArray *)attachments keys:(NSArray *)keys
+               completion:(void (^)(NSArray<NSURL *> *uploadedURLs))completion {
+    int64_t now = [self now];
+    NSMutableArray *urls = [NSMutableArray arrayWithCapacity:attachments.count];
+    // 每个附件在待上传列表中的位置；同一次发送里内容相同的只上传一次
+    NSMutableArray<NSNumber *> *slots = [NSMutableArray arrayWithCapacity:attachments.count];
+    NSMutableArray *misses = [NSMutableArray array];
+    NSMutableArray *missKeys = [NSMutableArray array];
+    NSMutableDictionary<NSValue *, NSNumber *> *slotForKey = [NSMutableDictionary dictionary];
+
+    for (NSUInteger i = 0; i < attachments.count; i++) {
+        id keyValue = keys[i];
+        if ([keyValue isKindOfClass:[NSValue class]]) {
+            AttachmentUploadKey key;
+            [keyValue getValue:&key];
+            const char *url = AttachmentUploadIndexLookup(_index, key.crc64, key.length, now + kExpiryMargin);
+            NSURL *reused = url ? [NSURL URLWithString:@(url)] : nil;
+            if (reused) {
+                [urls addObject:reused];
+                [slots addObject:@(-1)];
+                continue;
+            }
+            NSNumber *slot = slotForKey[keyValue];
+            if (slot) {
+                [urls addObject:[NSNull null]];
+                [slots addObject:slot];
+                continue;
+            }
+            slotForKey[keyValue] = @(misses.count);
+        }
+        [urls addObject:[NSNull null]];
+        [slots addObject:@(misses.count)];
+        [misses addObject:attachments[i]];
+        [missKeys addObject:keyValue];
+    }
+
+    if (misses.count == 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(urls);
+        });
+        return;
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [[OSSUploadManager sharedManager] uploadAttachments:misses completion:^(NSArray<NSURL *> * _Nonnull uploadedURLs) {
+            if (uploadedURLs.count != misses.count) {
+                // 部分失败时无法按顺序对应：返回已有的 URL，不记录
+                NSMutableArray<NSURL *> *partial = [NSMutableArray array];
+                for (id url in urls) {
+                    if ([url isKindOfClass:[NSURL class]]) {
+                        [partial addObject:url];
+                    }
+                }
+                [partial addObjectsFromArray:uploadedURLs];
+                completion(partial);
+                return;
+            }
+            for (NSUInteger i = 0; i < urls.count; i++) {
+                NSInteger slot = slots[i].integerValue;
+                if (slot >= 0) {
+                    urls[i] = uploadedURLs[slot];
+                }
+            }
+            completion(urls);
+            dispatch_async(self->_queue, ^{
+                [self recordURLs:uploadedURLs forKeys:missKeys];
+            });
+        }];
+    });
+}
+
+- (void)recordURLs:(NSArray<NSURL *> *)urls forKeys:(NSArray *)keys {
+    int64_t now = [self now];
+    BOOL changed = NO;
+    for (NSUInteger i = 0; i < urls.count; i++) {
+        if (![keys[i] isKindOfClass:[NSValue class]]) {
+            continue;
+        }
+        AttachmentUploadKey key;
+        [keys[i] getValue:&key];
+        const char *url = urls[i].absoluteString.UTF8String;
+        int64_t expiry = [self expiryForURL:urls[i] now:now];
+        if (url && expiry > now + kExpiryMargin) {
+            changed |= AttachmentUploadIndexInsert(_index, key.crc64, key.length, url, strlen(url), expiry);
+        }
+    }
+    if (changed) {
+        [self saveIndex];
+    }
+}
+
+@end
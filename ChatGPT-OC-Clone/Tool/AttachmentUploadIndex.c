@@ -0,0 +1,461 @@
+//
+//  AttachmentUploadIndex.c
+//  ChatGPT-OC-Clone
+//
+
+#include "AttachmentUploadIndex.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MARK: - CRC-64
+
+static const uint64_t AttachmentUploadCRC64Polynomial = 0xC96C5795D7870F42ull;
+
+/** Slicing by eight: table k holds each byte's CRC followed by k zero bytes. */
+static uint64_t AttachmentUploadCRC64Table[8][256];
+/** x^(2^k) modulo the polynomial, for skipping ahead over 2^k zero bits. */
+static uint64_t AttachmentUploadCRC64Powers[64];
+static pthread_once_t AttachmentUploadCRC64Once = PTHREAD_ONCE_INIT;
+
+/** a * b modulo the polynomial, with x^0 in the top bit as the CRC is reflected. */
+static uint64_t AttachmentUploadCRC64Multiply(uint64_t a, uint64_t b)
+{
+    uint64_t product = 0;
+    for (uint64_t bit = 1ull << 63; bit != 0; bit >>= 1) {
+        if (a & bit) {
+            product ^= b;
+            if ((a & (bit - 1)) == 0) {
+                break;
+            }
+        }
+        b = (b & 1) ? (b >> 1) ^ AttachmentUploadCRC64Polynomial : b >> 1;
+    }
+    return product;
+}
+
+static void AttachmentUploadCRC64Setup(void)
+{
+    for (uint32_t n = 0; n < 256; n++) {
+        uint64_t crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ AttachmentUploadCRC64Polynomial : crc >> 1;
+        }
+        AttachmentUploadCRC64Table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        uint64_t crc = AttachmentUploadCRC64Table[0][n];
+        for (int k = 1; k < 8; k++) {
+            crc = AttachmentUploadCRC64Table[0][crc & 0xFF] ^ (crc >> 8);
+            AttachmentUploadCRC64Table[k][n] = crc;
+        }
+    }
+    uint64_t power = 1ull << 62; // x^1
+    for (int k = 0; k < 64; k++) {
+        AttachmentUploadCRC64Powers[k] = power;
+        power = AttachmentUploadCRC64Multiply(power, power);
+    }
+}
+
+static inline uint64_t AttachmentUploadRead64(const uint8_t *bytes)
+{
+    return (uint64_t)bytes[0] | ((uint64_t)bytes[1] << 8) | ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24)
+        | ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) | ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
+}
+
+static inline uint32_t AttachmentUploadRead32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+uint64_t AttachmentUploadCRC64(uint64_t crc, const void *bytes, size_t length)
+{
+    pthread_once(&AttachmentUploadCRC64Once, AttachmentUploadCRC64Setup);
+    uint64_t (*table)[256] = AttachmentUploadCRC64Table;
+    const uint8_t *input = (const uint8_t *)bytes;
+    crc = ~crc;
+    while (length >= 8) {
+        crc ^= AttachmentUploadRead64(input);
+        crc = table[7][crc & 0xFF] ^ table[6][(crc >> 8) & 0xFF] ^ table[5][(crc >> 16) & 0xFF] ^ table[4][(crc >> 24) & 0xFF]
+            ^ table[3][(crc >> 32) & 0xFF] ^ table[2][(crc >> 40) & 0xFF] ^ table[1][(crc >> 48) & 0xFF] ^ table[0][crc >> 56];
+        input += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = table[0][(crc ^ *input) & 0xFF] ^ (crc >> 8);
+        input++;
+        length--;
+    }
+    return ~crc;
+}
+
+uint64_t AttachmentUploadCRC64Combine(uint64_t crc1, uint64_t crc2, uint64_t length2)
+{
+    pthread_once(&AttachmentUploadCRC64Once, AttachmentUploadCRC64Setup);
+    // Appending length2 zero bytes multiplies by x^(8 * length2); the
+    // inversions cancel out, as for zlib's crc32_combine.
+    uint64_t shift = 1ull << 63; // x^0
+    for (int k = 3; length2 != 0; k++, length2 >>= 1) {
+        if (length2 & 1) {
+            shift = AttachmentUploadCRC64Multiply(AttachmentUploadCRC64Powers[k & 63], shift);
+        }
+    }
+    return AttachmentUploadCRC64Multiply(shift, crc1) ^ crc2;
+}
+
+size_t AttachmentUploadHashChunkCount(uint64_t length, size_t chunkLength)
+{
+    if (length == 0 || chunkLength == 0) {
+        return 1;
+    }
+    return (size_t)((length - 1) / chunkLength + 1);
+}
+
+uint64_t AttachmentUploadCRC64CombineChunks(const uint64_t *chunkCRCs, size_t count, uint64_t length, size_t chunkLength)
+{
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t crc = chunkCRCs[0];
+    for (size_t i = 1; i < count; i++) {
+        uint64_t chunk = i + 1 < count ? chunkLength : length - (uint64_t)chunkLength * i;
+        crc = AttachmentUploadCRC64Combine(crc, chunkCRCs[i], chunk);
+    }
+    return crc;
+}
+
+// MARK: - Index types
+
+typedef struct AttachmentUploadIndexEntry AttachmentUploadIndexEntry;
+
+struct AttachmentUploadIndexEntry {
+    uint64_t crc64;
+    uint64_t length;
+    int64_t expiry;
+    char *url;
+    size_t urlLength;
+    /** The next entry whose key hashes to the same bucket. */
+    AttachmentUploadIndexEntry *chain;
+    /** Neighbours in order of use, most recent first. */
+    AttachmentUploadIndexEntry *previous;
+    AttachmentUploadIndexEntry *next;
+};
+
+struct AttachmentUploadIndex {
+    size_t capacity;
+    AttachmentUploadIndexEntry **buckets;
+    size_t bucketCount;
+    size_t entryCount;
+    AttachmentUploadIndexEntry *mostRecent;
+    AttachmentUploadIndexEntry *leastRecent;
+};
+
+static size_t AttachmentUploadIndexBucket(const AttachmentUploadIndex *index, uint64_t crc64, uint64_t length)
+{
+    // The CRC is already well mixed; the length separates the rare collision.
+    uint64_t hash = crc64 ^ (length * 0x9E3779B97F4A7C15ull);
+    return (size_t)(hash ^ (hash >> 32)) & (index->bucketCount - 1);
+}
+
+// MARK: - Order of use
+
+static void AttachmentUploadIndexUnlink(AttachmentUploadIndex *index, AttachmentUploadIndexEntry *entry)
+{
+    if (entry->previous) {
+        entry->previous->next = entry->next;
+    } else {
+        index->mostRecent = entry->next;
+    }
+    if (entry->next) {
+        entry->next->previous = entry->previous;
+    } else {
+        index->leastRecent = entry->previous;
+    }
+    entry->previous = entry->next = NULL;
+}
+
+static void AttachmentUploadIndexPushFront(AttachmentUploadIndex *index, AttachmentUploadIndexEntry *entry)
+{
+    entry->previous = NULL;
+    entry->next = index->mostRecent;
+    if (index->mostRecent) {
+        index->mostRecent->previous = entry;
+    } else {
+        index->leastRecent = entry;
+    }
+    index->mostRecent = entry;
+}
+
+// MARK: - Entries
+
+static AttachmentUploadIndexEntry **AttachmentUploadIndexFind(AttachmentUploadIndex *index, uint64_t crc64, uint64_t length)
+{
+    AttachmentUploadIndexEntry **link = &index->buckets[AttachmentUploadIndexBucket(index, crc64, length)];
+    while (*link) {
+        AttachmentUploadIndexEntry *entry = *link;
+        if (entry->crc64 == crc64 && entry->length == length) {
+            break;
+        }
+        link = &entry->chain;
+    }
+    return link;
+}
+
+static void AttachmentUploadIndexFreeEntry(AttachmentUploadIndexEntry *entry)
+{
+    free(entry->url);
+    free(entry);
+}
+
+static void AttachmentUploadIndexDrop(AttachmentUploadIndex *index, AttachmentUploadIndexEntry **link)
+{
+    AttachmentUploadIndexEntry *entry = *link;
+    *link = entry->chain;
+    AttachmentUploadIndexUnlink(index, entry);
+    index->entryCount--;
+    AttachmentUploadIndexFreeEntry(entry);
+}
+
+static void AttachmentUploadIndexClear(AttachmentUploadIndex *index)
+{
+    AttachmentUploadIndexEntry *entry = index->mostRecent;
+    while (entry) {
+        AttachmentUploadIndexEntry *next = entry->next;
+        AttachmentUploadIndexFreeEntry(entry);
+        entry = next;
+    }
+    memset(index->buckets, 0, index->bucketCount * sizeof(AttachmentUploadIndexEntry *));
+    index->entryCount = 0;
+    index->mostRecent = index->leastRecent = NULL;
+}
+
+// MARK: - Lifetime
+
+AttachmentUploadIndex *AttachmentUploadIndexCreate(size_t capacity)
+{
+    AttachmentUploadIndex *index = (AttachmentUploadIndex *)calloc(1, sizeof(AttachmentUploadIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->capacity = capacity > 0 ? capacity : 1;
+    // A bucket per entry at capacity, so the table never grows.
+    index->bucketCount = 16;
+    while (index->bucketCount < index->capacity) {
+        index->bucketCount *= 2;
+    }
+    index->buckets = (AttachmentUploadIndexEntry **)calloc(index->bucketCount, sizeof(AttachmentUploadIndexEntry *));
+    if (index->buckets == NULL) {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+void AttachmentUploadIndexDestroy(AttachmentUploadIndex *index)
+{
+    if (index == NULL) {
+        return;
+    }
+    AttachmentUploadIndexClear(index);
+    free(index->buckets);
+    free(index);
+}
+
+// MARK: - Lookup
+
+const char *AttachmentUploadIndexLookup(AttachmentUploadIndex *index, uint64_t crc64, uint64_t length, int64_t time)
+{
+    AttachmentUploadIndexEntry **link = AttachmentUploadIndexFind(index, crc64, length);
+    AttachmentUploadIndexEntry *entry = *link;
+    if (entry == NULL) {
+        return NULL;
+    }
+    if (entry->expiry <= time) {
+        AttachmentUploadIndexDrop(index, link);
+        return NULL;
+    }
+    AttachmentUploadIndexUnlink(index, entry);
+    AttachmentUploadIndexPushFront(index, entry);
+    return entry->url;
+}
+
+bool AttachmentUploadIndexInsert(AttachmentUploadIndex *index, uint64_t crc64, uint64_t length,
+                                 const char *url, size_t urlLength, int64_t expiry)
+{
+    if (urlLength == 0 || urlLength > AttachmentUploadIndexMaxURLLength || memchr(url, '\0', urlLength) != NULL) {
+        return false;
+    }
+    char *copy = (char *)malloc(urlLength + 1);
+    if (copy == NULL) {
+        return false;
+    }
+    memcpy(copy, url, urlLength);
+    copy[urlLength] = '\0';
+
+    AttachmentUploadIndexEntry **link = AttachmentUploadIndexFind(index, crc64, length);
+    AttachmentUploadIndexEntry *entry = *link;
+    if (entry) {
+        free(entry->url);
+        AttachmentUploadIndexUnlink(index, entry);
+    } else {
+        entry = (AttachmentUploadIndexEntry *)calloc(1, sizeof(AttachmentUploadIndexEntry));
+        if (entry == NULL) {
+            free(copy);
+            return false;
+        }
+        if (index->entryCount >= index->capacity) {
+            AttachmentUploadIndexEntry *evicted = index->leastRecent;
+            AttachmentUploadIndexDrop(index, AttachmentUploadIndexFind(index, evicted->crc64, evicted->length));
+        }
+        entry->crc64 = crc64;
+        entry->length = length;
+        AttachmentUploadIndexEntry **bucket = &index->buckets[AttachmentUploadIndexBucket(index, crc64, length)];
+        entry->chain = *bucket;
+        *bucket = entry;
+        index->entryCount++;
+    }
+    entry->url = copy;
+    entry->urlLength = urlLength;
+    entry->expiry = expiry;
+    AttachmentUploadIndexPushFront(index, entry);
+    return true;
+}
+
+bool AttachmentUploadIndexRemove(AttachmentUploadIndex *index, uint64_t crc64, uint64_t length)
+{
+    AttachmentUploadIndexEntry **link = AttachmentUploadIndexFind(index, crc64, length);
+    if (*link == NULL) {
+        return false;
+    }
+    AttachmentUploadIndexDrop(index, link);
+    return true;
+}
+
+size_t AttachmentUploadIndexPrune(AttachmentUploadIndex *index, int64_t time)
+{
+    size_t pruned = 0;
+    AttachmentUploadIndexEntry *entry = index->mostRecent;
+    while (entry) {
+        AttachmentUploadIndexEntry *next = entry->next;
+        if (entry->expiry <= time) {
+            AttachmentUploadIndexDrop(index, AttachmentUploadIndexFind(index, entry->crc64, entry->length));
+            pruned++;
+        }
+        entry = next;
+    }
+    return pruned;
+}
+
+size_t AttachmentUploadIndexCount(const AttachmentUploadIndex *index)
+{
+    return index->entryCount;
+}
+
+// MARK: - Encoding
+
+static const uint32_t AttachmentUploadIndexMagic = 0x31495541; // "AUI1"
+static const size_t AttachmentUploadIndexHeaderLength = 16;
+static const size_t AttachmentUploadIndexEntryLength = 28;
+
+static inline void AttachmentUploadWrite32(uint8_t *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static inline void AttachmentUploadWrite64(uint8_t *bytes, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+size_t AttachmentUploadIndexEncodedLength(const AttachmentUploadIndex *index)
+{
+    size_t length = AttachmentUploadIndexHeaderLength + 8;
+    for (const AttachmentUploadIndexEntry *entry = index->mostRecent; entry; entry = entry->next) {
+        length += AttachmentUploadIndexEntryLength + entry->urlLength;
+    }
+    return length;
+}
+
+size_t AttachmentUploadIndexEncode(const AttachmentUploadIndex *index, void *buffer, size_t capacity)
+{
+    size_t length = AttachmentUploadIndexEncodedLength(index);
+    if (capacity < length) {
+        return 0;
+    }
+    uint8_t *output = (uint8_t *)buffer;
+    AttachmentUploadWrite32(output, AttachmentUploadIndexMagic);
+    AttachmentUploadWrite32(output + 4, AttachmentUploadIndexVersion);
+    AttachmentUploadWrite32(output + 8, (uint32_t)index->entryCount);
+    AttachmentUploadWrite32(output + 12, 0);
+    uint8_t *cursor = output + AttachmentUploadIndexHeaderLength;
+    for (const AttachmentUploadIndexEntry *entry = index->mostRecent; entry; entry = entry->next) {
+        AttachmentUploadWrite64(cursor, entry->crc64);
+        AttachmentUploadWrite64(cursor + 8, entry->length);
+        AttachmentUploadWrite64(cursor + 16, (uint64_t)entry->expiry);
+        AttachmentUploadWrite32(cursor + 24, (uint32_t)entry->urlLength);
+        memcpy(cursor + AttachmentUploadIndexEntryLength, entry->url, entry->urlLength);
+        cursor += AttachmentUploadIndexEntryLength + entry->urlLength;
+    }
+    AttachmentUploadWrite64(cursor, AttachmentUploadCRC64(0, output, (size_t)(cursor - output)));
+    return length;
+}
+
+bool AttachmentUploadIndexDecode(AttachmentUploadIndex *index, const void *bytes, size_t length, int64_t time)
+{
+    const uint8_t *input = (const uint8_t *)bytes;
+    if (length < AttachmentUploadIndexHeaderLength + 8
+        || AttachmentUploadRead32(input) != AttachmentUploadIndexMagic
+        || AttachmentUploadRead32(input + 4) != AttachmentUploadIndexVersion
+        || AttachmentUploadRead32(input + 12) != 0
+        || AttachmentUploadRead64(input + length - 8) != AttachmentUploadCRC64(0, input, length - 8)) {
+        return false;
+    }
+    // Walk the entries once to check they fill the contents exactly.
+    uint32_t count = AttachmentUploadRead32(input + 8);
+    const uint8_t *end = input + length - 8;
+    const uint8_t *cursor = input + AttachmentUploadIndexHeaderLength;
+    for (uint32_t i = 0; i < count; i++) {
+        if ((size_t)(end - cursor) < AttachmentUploadIndexEntryLength) {
+            return false;
+        }
+        size_t urlLength = AttachmentUploadRead32(cursor + 24);
+        if (urlLength == 0 || urlLength > AttachmentUploadIndexMaxURLLength
+            || (size_t)(end - cursor) - AttachmentUploadIndexEntryLength < urlLength
+            || memchr(cursor + AttachmentUploadIndexEntryLength, '\0', urlLength) != NULL) {
+            return false;
+        }
+        cursor += AttachmentUploadIndexEntryLength + urlLength;
+    }
+    if (cursor != end) {
+        return false;
+    }
+
+    // Entries are stored most recent first; inserting least recent first
+    // rebuilds the order, and a full index keeps the most recent.
+    const uint8_t **entries = (const uint8_t **)malloc((count ? count : 1) * sizeof(const uint8_t *));
+    if (entries == NULL) {
+        return false;
+    }
+    cursor = input + AttachmentUploadIndexHeaderLength;
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i] = cursor;
+        cursor += AttachmentUploadIndexEntryLength + AttachmentUploadRead32(cursor + 24);
+    }
+    AttachmentUploadIndexClear(index);
+    for (uint32_t i = count; i-- > 0;) {
+        const uint8_t *entry = entries[i];
+        int64_t expiry = (int64_t)AttachmentUploadRead64(entry + 16);
+        if (expiry <= time) {
+            continue;
+        }
+        AttachmentUploadIndexInsert(index, AttachmentUploadRead64(entry), AttachmentUploadRead64(entry + 8),
+                                    (const char *)entry + AttachmentUploadIndexEntryLength, AttachmentUploadRead32(entry + 24), expiry);
+    }
+    free(entries);
+    return true;
+}
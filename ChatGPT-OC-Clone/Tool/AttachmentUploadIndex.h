@@ -0,0 +1,116 @@
+//
+//  AttachmentUploadIndex.h
+//  ChatGPT-OC-Clone
+//
+//  Content hashing and the index of uploaded attachments behind AttachmentUploadCache.
+//
+
+#ifndef AttachmentUploadIndex_h
+#define AttachmentUploadIndex_h
+
+// Plain C with no Foundation dependency, so the upload index can be built
+// and benchmarked on its own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// MARK: - CRC-64
+
+/**
+ CRC-64 as xz computes it: the ECMA-182 polynomial, bit reversed, with
+ pre and post inversion. The same value as the OSS SDK's aos_crc64 and the
+ x-oss-hash-crc64ecma header. Pass 0 to start, or a previous result to
+ continue it over following bytes. Thread safe.
+ */
+uint64_t AttachmentUploadCRC64(uint64_t crc, const void *bytes, size_t length);
+
+/**
+ CRC-64 of two pieces of contents back to back, from the CRC-64 of each and
+ the length of the second, like aos_crc64_combine. Costs about as much as
+ hashing 64 bytes per bit of `length2`.
+ */
+uint64_t AttachmentUploadCRC64Combine(uint64_t crc1, uint64_t crc2, uint64_t length2);
+
+/** Contents past this many bytes are hashed in chunks of AttachmentUploadHashChunkLength, in parallel. */
+#define AttachmentUploadParallelHashThreshold ((size_t)8 << 20)
+#define AttachmentUploadHashChunkLength ((size_t)4 << 20)
+
+/** How many chunks of `chunkLength` bytes `length` bytes hash in; at least 1. */
+size_t AttachmentUploadHashChunkCount(uint64_t length, size_t chunkLength);
+
+/**
+ CRC-64 of the whole contents from the CRC-64 of each chunk, in order. Every
+ chunk but the last is `chunkLength` bytes, and `length` is the total.
+ */
+uint64_t AttachmentUploadCRC64CombineChunks(const uint64_t *chunkCRCs, size_t count, uint64_t length, size_t chunkLength);
+
+// MARK: - Index
+
+/** URLs longer than this aren't indexed. */
+#define AttachmentUploadIndexMaxURLLength ((size_t)4096)
+
+/**
+ Maps contents, by CRC-64 and length, to the URL they were uploaded to and
+ the time, in seconds since 1970, that URL stops working.
+
+ Holds up to a capacity of entries, dropping the least recently looked up
+ or inserted when full. Entries expired at lookup are dropped too. Not
+ thread safe.
+ */
+typedef struct AttachmentUploadIndex AttachmentUploadIndex;
+
+AttachmentUploadIndex *AttachmentUploadIndexCreate(size_t capacity);
+void AttachmentUploadIndexDestroy(AttachmentUploadIndex *index);
+
+/**
+ The URL, NUL terminated, if the contents have one still working at `time`.
+ Valid until the index next changes.
+ */
+const char *AttachmentUploadIndexLookup(AttachmentUploadIndex *index, uint64_t crc64, uint64_t length, int64_t time);
+
+/** Adds or replaces the contents' entry. Returns false if the URL is empty or too long. */
+bool AttachmentUploadIndexInsert(AttachmentUploadIndex *index, uint64_t crc64, uint64_t length,
+                                 const char *url, size_t urlLength, int64_t expiry);
+
+bool AttachmentUploadIndexRemove(AttachmentUploadIndex *index, uint64_t crc64, uint64_t length);
+
+/** Drops the entries expired at `time`, and returns how many. */
+size_t AttachmentUploadIndexPrune(AttachmentUploadIndex *index, int64_t time);
+
+size_t AttachmentUploadIndexCount(const AttachmentUploadIndex *index);
+
+// MARK: - Encoding
+
+/**
+ The index as stored: a 16 byte header, the entries, most recently used
+ first, and a CRC-64 of everything before it.
+
+ The header holds, little endian, the magic "AUI1", a version of 32 bits
+ and the entry count. Each entry holds the CRC-64, length and expiry of 64
+ bits, the URL length of 32 bits and the URL. Contents that don't check
+ out, from a crash mid-write or an older version, are rejected whole.
+ */
+#define AttachmentUploadIndexVersion 1
+
+size_t AttachmentUploadIndexEncodedLength(const AttachmentUploadIndex *index);
+
+/** Returns the bytes written, or 0 if `capacity` is less than the encoded length. */
+size_t AttachmentUploadIndexEncode(const AttachmentUploadIndex *index, void *buffer, size_t capacity);
+
+/**
+ Replaces the index's entries with the encoded ones still working at
+ `time`, keeping their order of use, up to its capacity. Returns false and
+ leaves the index unchanged unless `bytes` hold exactly one valid encoding.
+ */
+bool AttachmentUploadIndexDecode(AttachmentUploadIndex *index, const void *bytes, size_t length, int64_t time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AttachmentUploadIndex_h
@@ -5,11 +5,15 @@ import Down
 public final class MarkdownParserBridge: NSObject, @unchecked Sendable {
     public nonisolated(unsafe) static let shared = MarkdownParserBridge()
 
+    // 流式输出时同一条消息会被反复解析，保留上一次的文本和文档，只重新解析变化的尾部
+    private let cacheLock = NSLock()
+    private var cachedRaw: String?
+    private var cachedDocument: Document?
+
     public func parseToBlocks(_ raw: String) -> [[String: Any]] {
         guard !raw.isEmpty else { return [] }
         // 使用 Down 的 AST 解析
-        let down = Down(markdownString: raw)
-        guard let doc = try? down.toDocument() else { return [] }
+        guard let doc = parseDocument(raw) else { return [] }
 
         var blocks: [[String: Any]] = []
         // 使用 Down 提供的 childSequence 兼容地遍历子节点
@@ -33,17 +37,67 @@ public final class MarkdownParserBridge: NSObject, @unchecked Sendable {
             case let list as List:
                 list.children.forEach { item in
                     if let it = item as? Item {
-                        let text = condenseWhitespace(it.children.map { Self.extractPlainText(from: $0) }.joined(separator: "\n"))
+                        var text = condenseWhitespace(it.children.map { Self.extractPlainText(from: $0) }.joined(separator: "\n"))
+                        // 任务列表的 [ ] / [x] 已被解析掉，用复选框字符保留勾选状态
+                        switch it.taskState {
+                        case .unchecked: text = "☐ " + text
+                        case .checked: text = "☑ " + text
+                        case .none: break
+                        }
                         if !text.isEmpty { blocks.append(["type": "listItem", "text": text]) }
                     }
                 }
+            case let table as Table:
+                // 表格逐行输出，单元格以 | 分隔；未识别的类型在 OC 侧按段落处理
+                let rows = table.children.map { row in
+                    row.children.map { condenseWhitespace(Self.extractPlainText(from: $0)) }.joined(separator: " | ")
+                }
+                if !rows.isEmpty { blocks.append(["type": "table", "text": rows.joined(separator: "\n")]) }
             default:
                 break
             }
         }
+        storeDocument(doc, raw: raw)
         return blocks
     }
 
+    // 取出缓存的文档（重新解析会移走它的块，不能与其他线程共用），与上次文本有公共前缀时增量解析
+    private func parseDocument(_ raw: String) -> Document? {
+        cacheLock.lock()
+        let previousRaw = cachedRaw
+        let previousDocument = cachedDocument
+        cachedRaw = nil
+        cachedDocument = nil
+        cacheLock.unlock()
+
+        let doc: Document?
+        if let previousRaw = previousRaw, let previousDocument = previousDocument,
+           case let unchanged = Self.commonUTF8PrefixLength(previousRaw, raw), unchanged > 0 {
+            doc = try? previousDocument.reparsed(raw, unchangedUTF8Count: unchanged, options: .gfm)
+        } else {
+            doc = try? Down(markdownString: raw).toDocument(.gfm)
+        }
+
+        return doc
+    }
+
+    // 遍历结束后再放回缓存，避免遍历期间被其他线程的增量解析移走节点
+    private func storeDocument(_ doc: Document, raw: String) {
+        cacheLock.lock()
+        cachedRaw = raw
+        cachedDocument = doc
+        cacheLock.unlock()
+    }
+
+    private static func commonUTF8PrefixLength(_ a: String, _ b: String) -> Int {
+        var count = 0
+        for (x, y) in zip(a.utf8, b.utf8) {
+            guard x == y else { break }
+            count += 1
+        }
+        return count
+    }
+
     // 递归提取行内文本，包含 Text / Code 等节点；其他节点下钻其子节点
     private static func extractPlainText(from node: Node) -> String {
         switch node {
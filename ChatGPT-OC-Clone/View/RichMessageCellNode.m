@@ -2,8 +2,10 @@
 #import "ParserResult.h"
 #import "AIMarkdownParser.h"
 #import "AICodeBlockNode.h"
+#import "AttachmentThumbnailService.h"
 #import <QuartzCore/QuartzCore.h>
 #import <AsyncDisplayKit/ASTextNode2.h>
+#import <AsyncDisplayKit/ASTrace.h>
 
 // MARK: - 富文本消息节点
 @interface RichMessageCellNode ()
@@ -16,6 +18,7 @@
 @property (nonatomic, strong) NSArray<ASDisplayNode *> *renderNodes;
 // 已移除未使用的附件容器属性
 @property (nonatomic, strong) NSArray *attachmentsData; // 原始附件数据
+@property (nonatomic, strong) NSMapTable<ASDisplayNode *, UIImage *> *thumbAttachmentImages; // 本地图片缩略图节点 -> 原图
 @property (nonatomic, strong) NSMutableDictionary<NSString *, ASDisplayNode *> *nodeCache;
 @property (nonatomic, assign) BOOL isUpdating;
 // 新增：附件缩略图尺寸与间距（便于统一调节）
@@ -95,6 +98,7 @@
         // 附件缩略图默认尺寸与间距（可按需调整）
         _attachmentImageSize = 80.0;
         _attachmentSpacing = 6.0;
+        _thumbAttachmentImages = [NSMapTable weakToStrongObjectsMapTable];
         
         // 新增：首行渲染前隐藏
         _startHiddenUntilFirstLine = (!isFromUser && (message.length == 0));
@@ -311,55 +315,72 @@
     return finalSpec;
 }
 - (ASDisplayNode *)createAttachmentThumbNode:(id)attachment {
-    if ([attachment isKindOfClass:[UIImage class]]) {
-        ASImageNode *n = [[ASImageNode alloc] init];
-        n.image = attachment;
-        n.contentMode = UIViewContentModeScaleAspectFill;
-        n.clipsToBounds = YES;
-        n.cornerRadius = 8.0;
-        CGFloat side = (self.currentAttachmentThumbSize > 0.0 ? self.currentAttachmentThumbSize : self.attachmentImageSize);
-        n.style.width = ASDimensionMake(side);
-        n.style.height = ASDimensionMake(side);
-        // 允许点击
-        [(ASControlNode *)n addTarget:self action:@selector(thumbTapped:) forControlEvents:ASControlNodeEventTouchUpInside];
-        // 标记为本地图片
+    BOOL isLocalImage = [attachment isKindOfClass:[UIImage class]];
+    if (!isLocalImage && ![attachment isKindOfClass:[NSURL class]]) {
+        return nil;
+    }
+    CGFloat side = (self.currentAttachmentThumbSize > 0.0 ? self.currentAttachmentThumbSize : self.attachmentImageSize);
+    ASImageNode *n = [[ASImageNode alloc] init];
+    n.contentMode = UIViewContentModeScaleAspectFill;
+    n.clipsToBounds = YES;
+    n.cornerRadius = 8.0;
+    n.backgroundColor = [UIColor systemGray5Color];
+    n.style.width = ASDimensionMake(side);
+    n.style.height = ASDimensionMake(side);
+    // 允许点击
+    [(ASControlNode *)n addTarget:self action:@selector(thumbTapped:) forControlEvents:ASControlNodeEventTouchUpInside];
+    if (isLocalImage) {
+        // 标记为本地图片，点击时预览原图而非缩略图
         n.accessibilityLabel = @"local-image";
-        return n;
-    } else if ([attachment isKindOfClass:[NSURL class]]) {
-        ASNetworkImageNode *n = [[ASNetworkImageNode alloc] init];
-        n.URL = attachment;
-        n.contentMode = UIViewContentModeScaleAspectFill;
-        n.clipsToBounds = YES;
-        n.cornerRadius = 8.0;
-        n.placeholderFadeDuration = 0.1;
-        n.placeholderColor = [UIColor systemGray5Color];
-        CGFloat side = (self.currentAttachmentThumbSize > 0.0 ? self.currentAttachmentThumbSize : self.attachmentImageSize);
-        n.style.width = ASDimensionMake(side);
-        n.style.height = ASDimensionMake(side);
-        // 允许点击
-        [(ASControlNode *)n addTarget:self action:@selector(thumbTapped:) forControlEvents:ASControlNodeEventTouchUpInside];
+        // 布局可能在后台线程进行，点击在主线程
+        @synchronized (self.thumbAttachmentImages) {
+            [self.thumbAttachmentImages setObject:attachment forKey:n];
+        }
+    } else {
         // 存储URL字符串
         n.accessibilityLabel = @"remote-url";
         n.accessibilityValue = ((NSURL *)attachment).absoluteString;
-        return n;
     }
-    return nil;
+
+    // 缩略图服务按内容缓存：cell 每次重建都同步命中内存，与输入栏共用同一份
+    AttachmentThumbnailService *thumbnailService = [AttachmentThumbnailService sharedService];
+    UIImage *cachedThumbnail = [thumbnailService cachedThumbnailForAttachment:attachment pointSize:side];
+    if (cachedThumbnail) {
+        n.image = cachedThumbnail;
+    } else {
+        if (isLocalImage) {
+            n.image = attachment;
+        }
+        __weak ASImageNode *weakNode = n;
+        [thumbnailService requestThumbnailForAttachment:attachment
+                                              pointSize:side
+                                               priority:AttachmentThumbnailRequestPriorityNormal
+                                             completion:^(UIImage * _Nullable image) {
+            if (image) {
+                weakNode.image = image;
+            }
+        }];
+    }
+    return n;
 }
 
 // 缩略图点击：通过通知告知控制器展示预览
 - (void)thumbTapped:(ASControlNode *)sender {
     NSMutableDictionary *info = [NSMutableDictionary dictionary];
-    // 远程：传 URL 字符串；本地：传 UIImage
-    if ([sender isKindOfClass:[ASNetworkImageNode class]]) {
-        ASNetworkImageNode *net = (ASNetworkImageNode *)sender;
-        NSString *urlStr = net.accessibilityValue;
+    // 远程：传 URL 字符串；本地：传原图 UIImage
+    if ([sender.accessibilityLabel isEqualToString:@"remote-url"]) {
+        NSString *urlStr = sender.accessibilityValue;
         if (urlStr.length > 0) {
             info[@"url"] = urlStr;
         }
     } else if ([sender isKindOfClass:[ASImageNode class]]) {
-        ASImageNode *imgNode = (ASImageNode *)sender;
-        if (imgNode.image) {
-            info[@"image"] = imgNode.image;
+        UIImage *image = nil;
+        @synchronized (self.thumbAttachmentImages) {
+            image = [self.thumbAttachmentImages objectForKey:sender];
+        }
+        image = image ?: ((ASImageNode *)sender).image;
+        if (image) {
+            info[@"image"] = image;
         }
     }
     [[NSNotificationCenter defaultCenter] postNotificationName:@"AttachmentPreviewRequested"
@@ -1149,6 +1170,7 @@
 
 // 新增：按语义块增量追加（逐行渲染）
 - (void)appendSemanticBlocks:(NSArray<NSString *> *)blocks isFinal:(BOOL)isFinal {
+    ASTraceInstant("Append semantic blocks", blocks.count);
     if (blocks.count == 0) {
         if (isFinal) { self.pendingFinalizeWhenQueueEmpty = YES; [self processNextSemanticBlockIfIdle]; }
         return;
@@ -1464,6 +1486,7 @@
     NSDictionary *task = [self.currentBlockLineTasks firstObject];
     [self.currentBlockLineTasks removeObjectAtIndex:0];
     NSString *type = task[@"type"];
+    ASTraceCounter("Pending line tasks", self.currentBlockLineTasks.count);
     
     self.currentBlockRenderedLineIndex += 1;
     
@@ -1503,7 +1526,9 @@
                 // 日志：文本行开始渐显
             NSTimeInterval t0 = CACurrentMediaTime();
             (void)localIdx; (void)t0; // remove logs
+            ASTraceInstant("Text line reveal started", (uintptr_t)textNode);
             [strongSelf _applyLeftToRightRevealMaskOnNode:textNode duration:strongSelf.textLineRevealDuration completion:^{
+                ASTraceInstant("Text line revealed", (uintptr_t)textNode);
                 strongSelf.activeTextRevealAnimations = MAX(0, strongSelf.activeTextRevealAnimations - 1);
                 // 动画结束后立即推进下一行（本次跳过间隔）
                 NSTimeInterval t1 = CACurrentMediaTime();
@@ -1559,7 +1584,9 @@
             BOOL first = isStart && (self.activeAccumulatedCode.length > 0);
             self.activeCodeRevealAnimations += 1; // 加锁，避免并发
             __weak typeof(self) weakSelf = self;
+            ASTraceInstant("Code line reveal started", lineText.length);
             [self.activeCodeNode appendCodeLine:lineText isFirst:first completion:^{
+                ASTraceInstant("Code line revealed", lineText.length);
                 __strong typeof(weakSelf) strongSelf = weakSelf; if (!strongSelf) return;
                 // 代码行：在渐显动画完成后推进下一行，避免多行同时渐显
                 strongSelf.activeCodeRevealAnimations = MAX(0, strongSelf.activeCodeRevealAnimations - 1);
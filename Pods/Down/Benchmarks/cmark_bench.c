@@ -0,0 +1,1481 @@
+// Throughput and pathological-input benchmark for the vendored cmark.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   cc -O2 -DNDEBUG -I../Sources/cmark -o cmark_bench cmark_bench.c
+//      ../Sources/cmark/*.c -lm
+//   ./cmark_bench [--quick] [--min-time SECONDS] [FILE.md ...] > result.json
+//
+// Every measurement parses or renders with a counting cmark_mem, so the JSON
+// report carries allocation counts, requested bytes and peak live bytes next to
+// the timings.  Besides the chat corpus, ASCII, CJK and emoji corpora compare
+// multi-byte input; building with -DCMARK_NO_SIMD measures the scalar byte
+// loops for comparison.  Each pathological family is run at doubling input
+// sizes and the fitted exponent of time over size flags superlinear scaling.
+// Corpora are parsed with and without CMARK_OPT_GFM; the table and
+// strikethrough families parse with it.  The reparse cases edit the tail of a
+// 50 KB answer and time cmark_reparse_document against a full parse.
+//
+// Before reporting, the GFM spec examples for tables, task list items and
+// strikethrough are rendered to HTML and compared with the spec's, chains of
+// random edits are reparsed and compared, as XML with source positions, with
+// a full parse of the edited text, the SIMD
+// HTML escaping and UTF-8 validation are compared with byte at a time loops on
+// inputs with characters and invalid sequences across 16 byte block edges (on
+// x86 build with -mssse3 to reach the full UTF-8 fast path), and
+// cmark_render_style_runs is checked against a reference that renders each
+// node's text and runs recursively and joins them into its parent's, as
+// AttributedStringVisitor does, over fixed and random documents.  Any
+// difference is printed to stderr and the bench exits with status 1.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "cmark.h"
+#include "buffer.h"
+#include "houdini.h"
+#include "utf8.h"
+
+#define MAX_FILES 32
+#define TRIALS 3
+
+static double min_time = 0.2;
+static bool quick = false;
+
+// MARK: - Counting allocator
+
+struct alloc_stats {
+  size_t allocs;
+  size_t bytes;
+  size_t live;
+  size_t peak;
+};
+
+static struct alloc_stats stats;
+
+// Every block is prefixed with its size so realloc and free can keep the
+// live byte count exact.
+typedef union {
+  size_t size;
+  long double align;
+} alloc_header;
+
+// Blocks allocated before a measurement started, like the document a reparse
+// replaces, may be freed during it; they never count below zero.
+static void S_note_free(size_t size) {
+  stats.live -= size < stats.live ? size : stats.live;
+}
+
+static void S_note_alloc(size_t size) {
+  stats.allocs++;
+  stats.bytes += size;
+  stats.live += size;
+  if (stats.live > stats.peak) {
+    stats.peak = stats.live;
+  }
+}
+
+static void *counting_calloc(size_t nmem, size_t size) {
+  alloc_header *h = (alloc_header *)calloc(1, sizeof(alloc_header) + nmem * size);
+  if (!h) {
+    abort();
+  }
+  h->size = nmem * size;
+  S_note_alloc(h->size);
+  return h + 1;
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+  alloc_header *h = ptr ? (alloc_header *)ptr - 1 : NULL;
+  size_t old_size = h ? h->size : 0;
+  h = (alloc_header *)realloc(h, sizeof(alloc_header) + size);
+  if (!h) {
+    abort();
+  }
+  h->size = size;
+  S_note_free(old_size);
+  S_note_alloc(size);
+  return h + 1;
+}
+
+static void counting_free(void *ptr) {
+  if (ptr) {
+    alloc_header *h = (alloc_header *)ptr - 1;
+    S_note_free(h->size);
+    free(h);
+  }
+}
+
+static cmark_mem COUNTING_MEM = {counting_calloc, counting_realloc,
+                                 counting_free};
+
+// MARK: - Timing
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct measurement {
+  double seconds; // best time of one iteration
+  struct alloc_stats alloc;
+};
+
+struct input {
+  const char *data;
+  size_t len;
+  int options;
+  cmark_node *doc; // parsed once, for renderer measurements
+};
+
+typedef void (*bench_fn)(struct input *input);
+
+// Runs 'fn' until 'min_time' has passed, TRIALS times, and keeps the best
+// per-iteration time.  Allocation stats are those of a single iteration.
+static struct measurement S_measure(bench_fn fn, struct input *input) {
+  struct measurement m;
+  size_t iterations = 1, i;
+  int trial;
+  double start, elapsed;
+
+  memset(&stats, 0, sizeof(stats));
+  fn(input);
+  m.alloc = stats;
+  m.seconds = INFINITY;
+
+  for (trial = 0; trial < TRIALS; trial++) {
+    for (;;) {
+      start = S_now();
+      for (i = 0; i < iterations; i++) {
+        fn(input);
+      }
+      elapsed = S_now() - start;
+      if (elapsed >= min_time / TRIALS || iterations >= (1u << 30)) {
+        break;
+      }
+      iterations *= 2;
+    }
+    if (elapsed / iterations < m.seconds) {
+      m.seconds = elapsed / iterations;
+    }
+  }
+  return m;
+}
+
+// MARK: - Operations
+
+static cmark_node *S_parse(struct input *input) {
+  cmark_parser *parser = cmark_parser_new_with_mem(input->options, &COUNTING_MEM);
+  cmark_node *doc;
+  cmark_parser_feed(parser, input->data, input->len);
+  doc = cmark_parser_finish(parser);
+  cmark_parser_free(parser);
+  return doc;
+}
+
+static void bench_parse(struct input *input) {
+  cmark_node_free(S_parse(input));
+}
+
+static void bench_html(struct input *input) {
+  COUNTING_MEM.free(cmark_render_html(input->doc, input->options));
+}
+
+static void bench_xml(struct input *input) {
+  COUNTING_MEM.free(cmark_render_xml(input->doc, input->options));
+}
+
+static void bench_commonmark(struct input *input) {
+  COUNTING_MEM.free(cmark_render_commonmark(input->doc, input->options, 0));
+}
+
+static void bench_latex(struct input *input) {
+  COUNTING_MEM.free(cmark_render_latex(input->doc, input->options, 0));
+}
+
+static void bench_man(struct input *input) {
+  COUNTING_MEM.free(cmark_render_man(input->doc, input->options, 0));
+}
+
+static void bench_style_runs(struct input *input) {
+  cmark_style_runs_free(cmark_render_style_runs(input->doc, input->options));
+}
+
+// The byte loops under parsing and HTML rendering, on the raw input.
+static void bench_escape_html(struct input *input) {
+  cmark_strbuf buf = CMARK_BUF_INIT(&COUNTING_MEM);
+  houdini_escape_html0(&buf, (const uint8_t *)input->data,
+                       (bufsize_t)input->len, 0);
+  cmark_strbuf_free(&buf);
+}
+
+static void bench_validate_utf8(struct input *input) {
+  cmark_strbuf buf = CMARK_BUF_INIT(&COUNTING_MEM);
+  cmark_utf8proc_check(&buf, (const uint8_t *)input->data,
+                       (bufsize_t)input->len);
+  cmark_strbuf_free(&buf);
+}
+
+// Incremental parsing flips one document between two texts that share a
+// prefix, so every iteration reparses only the edited tail.
+struct edit {
+  const char *texts[2];
+  size_t lens[2];
+  size_t unchanged;
+  cmark_node *doc;
+  int current; // index of the text 'doc' was parsed from
+};
+
+static struct edit edit_state;
+
+static void bench_reparse(struct input *input) {
+  struct edit *e = &edit_state;
+  int next = !e->current;
+  cmark_node *doc = cmark_reparse_document(e->doc, e->unchanged, e->texts[next],
+                                           e->lens[next], input->options);
+  cmark_node_free(e->doc);
+  e->doc = doc;
+  e->current = next;
+}
+
+static const struct {
+  const char *name;
+  bench_fn fn;
+} RENDERERS[] = {
+    {"html", bench_html},
+    {"xml", bench_xml},
+    {"commonmark", bench_commonmark},
+    {"latex", bench_latex},
+    {"man", bench_man},
+    {"style_runs", bench_style_runs},
+};
+
+// MARK: - Inputs
+
+typedef struct {
+  char *ptr;
+  size_t len, cap;
+} text_buf;
+
+static void S_append(text_buf *buf, const char *fmt, ...) {
+  va_list ap;
+  int n;
+
+  for (;;) {
+    va_start(ap, fmt);
+    n = vsnprintf(buf->ptr ? buf->ptr + buf->len : NULL,
+                  buf->ptr ? buf->cap - buf->len : 0, fmt, ap);
+    va_end(ap);
+    if (buf->ptr && (size_t)n < buf->cap - buf->len) {
+      buf->len += n;
+      return;
+    }
+    buf->cap = (buf->cap + n + 1) * 2;
+    buf->ptr = (char *)realloc(buf->ptr, buf->cap);
+    if (!buf->ptr) {
+      abort();
+    }
+  }
+}
+
+// A chat-style answer: headings, nested lists, quotes, fenced code, inline
+// markup, CJK text and emoji, repeated with varying numbers until 'bytes'.
+static text_buf S_chat_corpus(size_t bytes) {
+  text_buf buf = {NULL, 0, 0};
+  int i = 0;
+
+  while (buf.len < bytes) {
+    S_append(&buf, "## Section %d\n\n", i);
+    S_append(&buf,
+             "This answer explains **step %d** with *emphasis*, `inline code` "
+             "and a [link](https://example.com/%d \"title\").\nA soft break "
+             "follows, then a hard one.  \nDone.\n\n",
+             i, i);
+    S_append(&buf, "这是一个包含中文内容的段落，用于测试多字节字符的解析性能。"
+                   "混合 English 与 **中文加粗** 以及 `代码` 片段。😀🚀\n\n");
+    S_append(&buf, "1. First item\n2. Second item with *style*\n"
+                   "   - nested bullet\n   - another one\n"
+                   "     > quoted inside a list\n3. Third item\n\n");
+    S_append(&buf, "> A block quote\n> > nested quote with `code`\n\n");
+    S_append(&buf, "```swift\nfunc f%d(x: Int) -> Int {\n"
+                   "    return x * %d // comment\n}\n```\n\n",
+             i, i);
+    S_append(&buf, "| a | b |\n|---|---|\n| %d | ~~%d~~ |\n\n- [ ] task\n"
+                   "- [x] done\n\n---\n\n",
+             i, i + 1);
+    i++;
+  }
+  return buf;
+}
+
+static const char *const ASCII_WORDS[] = {
+    "the ", "answer ", "depends ", "on ", "whether ", "a < b ", "and ",
+    "R&D ", "teams ", "agree, ", "so ", "**measure** ", "first. ",
+};
+
+static const char *const CJK_WORDS[] = {
+    "这个问题", "取决于", "具体的", "使用场景，", "我们可以", "先测量",
+    "性能", "再决定", "是否", "优化。", "日本語の", "文章と", "한국어 ",
+    "**重点**", "「引用」",
+};
+
+static const char *const EMOJI_WORDS[] = {
+    "😀", "🚀", "👍🏽", "👨‍👩‍👧", "🇨🇳", "❤️", "🎉 ", "ok ", "🙂🙃",
+    "🧑‍💻", "✅ ", "**🔥**",
+};
+
+// Paragraphs of 'words' in one script, for comparing multi-byte heavy input
+// with ASCII.
+static text_buf S_script_corpus(const char *const *words, size_t count,
+                                size_t bytes) {
+  text_buf buf = {NULL, 0, 0};
+  size_t i = 0;
+
+  while (buf.len < bytes) {
+    S_append(&buf, "%s", words[i++ % count]);
+    if (i % 12 == 0) {
+      S_append(&buf, i % 48 == 0 ? "\n\n" : "\n");
+    }
+  }
+  return buf;
+}
+
+static char *S_read_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  char *data;
+  long size;
+
+  if (!f) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = (char *)malloc(size + 1);
+  *len = fread(data, 1, size, f);
+  fclose(f);
+  return data;
+}
+
+// MARK: - Pathological inputs
+//
+// The known quadratic shapes from cmark's pathological test suite, each
+// generated with 'n' repetitions.
+
+static void gen_nested_strong_emph(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "*a **a ");
+  S_append(b, "b");
+  for (i = 0; i < n; i++) S_append(b, " a** a*");
+}
+
+static void gen_emph_closers_no_openers(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "a_ ");
+}
+
+static void gen_emph_openers_no_closers(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "_a ");
+}
+
+static void gen_emph_delimiter_runs(text_buf *b, int n) {
+  int i;
+  S_append(b, "a**b");
+  for (i = 0; i < n; i++) S_append(b, "c* ");
+}
+
+static void gen_mismatched_openers_closers(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "*a_ ");
+}
+
+static void gen_link_openers_emph_closers(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "[ a_");
+}
+
+static void gen_nested_brackets(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "[");
+  S_append(b, "a");
+  for (i = 0; i < n; i++) S_append(b, "]");
+}
+
+static void gen_unclosed_links(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "[a](<b");
+}
+
+static void gen_backtick_strings(text_buf *b, int n) {
+  int i, j;
+  // Total length grows with n^2 for n distinct run lengths, so use sqrt(n)
+  // runs to keep the input size proportional to n.
+  int runs = (int)sqrt((double)n * 2);
+  for (i = 1; i <= runs; i++) {
+    S_append(b, "e");
+    for (j = 0; j < i; j++) S_append(b, "`");
+  }
+}
+
+static void gen_link_references(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "[ref%d]: /url%d \"t\"\n", i, i);
+  S_append(b, "\n");
+  for (i = 0; i < n; i++) S_append(b, "[ref%d] ", n - 1 - i);
+}
+
+static void gen_nested_block_quotes(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) S_append(b, "> ");
+  S_append(b, "a\n");
+}
+
+static void gen_nested_lists(text_buf *b, int n) {
+  int i, j;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < i; j++) S_append(b, "  ");
+    S_append(b, "* a\n");
+  }
+}
+
+static void gen_table_rows(text_buf *b, int n) {
+  S_append(b, "| a | b | c | d |\n| --- | :-: | --: | :-- |\n");
+  while (n--) {
+    S_append(b, "| x |\n| x | y | z | w | extra | cells |\n");
+  }
+}
+
+static void gen_wide_table(text_buf *b, int n) {
+  int i;
+  for (i = 0; i < n; i++) {
+    S_append(b, "|a");
+  }
+  S_append(b, "|\n");
+  for (i = 0; i < n; i++) {
+    S_append(b, "|-");
+  }
+  S_append(b, "|\n");
+}
+
+static void gen_strikethrough_runs(text_buf *b, int n) {
+  while (n--) {
+    S_append(b, "~~a ~b ~~~c ");
+  }
+}
+
+static const struct {
+  const char *name;
+  const char *const *words;
+  size_t count;
+} SCRIPTS[] = {
+    {"ascii", ASCII_WORDS, sizeof(ASCII_WORDS) / sizeof(ASCII_WORDS[0])},
+    {"cjk", CJK_WORDS, sizeof(CJK_WORDS) / sizeof(CJK_WORDS[0])},
+    {"emoji", EMOJI_WORDS, sizeof(EMOJI_WORDS) / sizeof(EMOJI_WORDS[0])},
+};
+
+static const struct {
+  const char *name;
+  void (*gen)(text_buf *b, int n);
+  int base; // repetitions at the smallest size
+  int options;
+} PATHOLOGICAL[] = {
+    {"nested_strong_emph", gen_nested_strong_emph, 1000, CMARK_OPT_DEFAULT},
+    {"emph_closers_no_openers", gen_emph_closers_no_openers, 4000,
+     CMARK_OPT_DEFAULT},
+    {"emph_openers_no_closers", gen_emph_openers_no_closers, 4000,
+     CMARK_OPT_DEFAULT},
+    {"emph_delimiter_runs", gen_emph_delimiter_runs, 4000, CMARK_OPT_DEFAULT},
+    {"mismatched_openers_closers", gen_mismatched_openers_closers, 4000,
+     CMARK_OPT_DEFAULT},
+    {"link_openers_emph_closers", gen_link_openers_emph_closers, 4000,
+     CMARK_OPT_DEFAULT},
+    {"nested_brackets", gen_nested_brackets, 4000, CMARK_OPT_DEFAULT},
+    {"unclosed_links", gen_unclosed_links, 4000, CMARK_OPT_DEFAULT},
+    {"backtick_strings", gen_backtick_strings, 4000, CMARK_OPT_DEFAULT},
+    {"link_references", gen_link_references, 1000, CMARK_OPT_DEFAULT},
+    {"nested_block_quotes", gen_nested_block_quotes, 1000, CMARK_OPT_DEFAULT},
+    {"nested_lists", gen_nested_lists, 250, CMARK_OPT_DEFAULT},
+    {"table_rows", gen_table_rows, 1000, CMARK_OPT_GFM},
+    {"wide_table", gen_wide_table, 1000, CMARK_OPT_GFM},
+    {"strikethrough_runs", gen_strikethrough_runs, 4000, CMARK_OPT_GFM},
+};
+
+// MARK: - Checks
+//
+// Run before the measurements; any failure is printed to stderr and the
+// benchmark exits with 1 before producing a report.
+
+static int failures = 0;
+static uint64_t check_state = 0x9E3779B97F4A7C15ull;
+
+static void S_fail(const char *fmt, ...) {
+  va_list ap;
+  if (failures++ < 10) {
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+  }
+}
+
+static uint32_t S_random(uint32_t bound) {
+  check_state = check_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((check_state >> 33) % bound);
+}
+
+static const char *const INLINE_PIECES[] = {
+    "plain ", "*em* ", "**strong** ", "`code` ", "[link](/u \"t\") ",
+    "![img](/i) ", "~~gone~~ ", "***both*** ", "*a **b** c* ", "中文 ",
+    "😀👍🏽 ", "<span>x</span> ", "a\\*b ", "~one~ ", "[**x**](/y) ",
+};
+
+static void S_random_inline(text_buf *b) {
+  int n = 1 + S_random(5);
+  while (n--) {
+    S_append(b, "%s", INLINE_PIECES[S_random(sizeof(INLINE_PIECES) /
+                                             sizeof(INLINE_PIECES[0]))]);
+  }
+}
+
+// Random nested blocks, every line starting with 'prefix' (quote markers and
+// list indentation).  Any input parses, so the shapes only need to reach
+// every node type, not to be well formed.
+static void S_random_blocks(text_buf *b, const char *prefix, int depth) {
+  int n = 1 + S_random(3), i, j, k;
+  char inner[256];
+
+  for (i = 0; i < n; i++) {
+    if (i > 0) {
+      S_append(b, "%s\n", prefix);
+    }
+    switch (S_random(depth > 0 ? 9 : 6)) {
+    case 0:
+    case 1:
+      for (j = 1 + S_random(3); j > 0; j--) {
+        S_append(b, "%s", prefix);
+        S_random_inline(b);
+        S_append(b, j > 1 && S_random(2) ? "  \n" : "\n");
+      }
+      break;
+    case 2:
+      S_append(b, "%s%.*s ", prefix, 1 + S_random(6), "######");
+      S_random_inline(b);
+      S_append(b, "\n");
+      break;
+    case 3:
+      S_append(b, "%s```%s\n", prefix, S_random(2) ? "swift" : "");
+      for (j = S_random(4); j > 0; j--) {
+        S_append(b, "%s%s\n", prefix,
+                 S_random(3) ? "let x = 1 // 注释" : "");
+      }
+      S_append(b, "%s```\n", prefix);
+      break;
+    case 4:
+      S_append(b, S_random(2) ? "%s---\n" : "%s<div>\n%s\n", prefix, prefix);
+      break;
+    case 5:
+      S_append(b, "%s| a | b |\n%s| --- | :-: |\n", prefix, prefix);
+      for (j = S_random(3); j > 0; j--) {
+        S_append(b, "%s| ", prefix);
+        S_random_inline(b);
+        S_append(b, "| x |\n");
+      }
+      break;
+    case 6:
+    case 7:
+      k = S_random(3);
+      for (j = 1 + S_random(3); j > 0; j--) {
+        const char *marker = k == 0 ? "- " : k == 1 ? "3. " : "- [x] ";
+        S_append(b, "%s%s", prefix, marker);
+        S_random_inline(b);
+        S_append(b, "\n");
+        if (S_random(2)) {
+          snprintf(inner, sizeof(inner), "%s%*s", prefix,
+                   (int)(k == 1 ? 3 : 2), "");
+          S_random_blocks(b, inner, depth - 1);
+        }
+      }
+      break;
+    default:
+      snprintf(inner, sizeof(inner), "%s> ", prefix);
+      S_random_blocks(b, inner, depth - 1);
+      break;
+    }
+  }
+}
+
+// MARK: Style runs
+//
+// A recursive reference for cmark_render_style_runs, written the way Down's
+// AttributedStringVisitor builds its string: every node renders into a new
+// buffer, joins its children's buffers, and its runs are shifted into the
+// parent's at each join.
+
+struct ref_out {
+  cmark_strbuf text;
+  int32_t utf16_len;
+  cmark_style_run *runs;
+  size_t nruns, cap;
+};
+
+struct ref_list {
+  cmark_list_type type;
+  int next;
+};
+
+static int32_t S_utf16_len(const unsigned char *data, bufsize_t len) {
+  int32_t units = 0;
+  bufsize_t i;
+  for (i = 0; i < len; i++) {
+    if ((data[i] & 0xC0) != 0x80) {
+      units += data[i] >= 0xF0 ? 2 : 1;
+    }
+  }
+  return units;
+}
+
+static void S_ref_init(struct ref_out *out) {
+  cmark_strbuf_init(&COUNTING_MEM, &out->text, 0);
+  out->utf16_len = 0;
+  out->runs = NULL;
+  out->nruns = out->cap = 0;
+}
+
+static void S_ref_free(struct ref_out *out) {
+  cmark_strbuf_free(&out->text);
+  free(out->runs);
+}
+
+static void S_ref_put(struct ref_out *out, const char *data, bufsize_t len) {
+  cmark_strbuf_put(&out->text, (const unsigned char *)data, len);
+  out->utf16_len += S_utf16_len((const unsigned char *)data, len);
+}
+
+static cmark_style_run *S_ref_push(struct ref_out *out) {
+  if (out->nruns == out->cap) {
+    out->cap = out->cap ? out->cap * 2 : 8;
+    out->runs = (cmark_style_run *)realloc(out->runs,
+                                           out->cap * sizeof(cmark_style_run));
+  }
+  return &out->runs[out->nruns++];
+}
+
+// Appends 'child' to 'out', shifting its runs to their place in 'out'.
+static void S_ref_join(struct ref_out *out, struct ref_out *child) {
+  size_t i;
+  for (i = 0; i < child->nruns; i++) {
+    cmark_style_run *run = S_ref_push(out);
+    *run = child->runs[i];
+    run->location += out->utf16_len;
+    run->byte_offset += out->text.size;
+  }
+  S_ref_put(out, (const char *)child->text.ptr, child->text.size);
+}
+
+// Styles all of 'out' with a run inserted before its children's runs.
+static void S_ref_wrap(struct ref_out *out, cmark_node *node, uint16_t style,
+                       uint16_t nest_depth, int32_t payload) {
+  S_ref_push(out);
+  memmove(out->runs + 1, out->runs, (out->nruns - 1) * sizeof(cmark_style_run));
+  out->runs[0].location = 0;
+  out->runs[0].length = out->utf16_len;
+  out->runs[0].byte_offset = 0;
+  out->runs[0].byte_length = out->text.size;
+  out->runs[0].style = style;
+  out->runs[0].nest_depth = nest_depth;
+  out->runs[0].payload = payload;
+  out->runs[0].node = node;
+}
+
+static uint16_t S_ref_nest_depth(cmark_node *node) {
+  uint16_t depth = 0;
+  cmark_node *parent;
+  for (parent = cmark_node_parent(node); parent;
+       parent = cmark_node_parent(parent)) {
+    depth += cmark_node_get_type(parent) == cmark_node_get_type(node);
+  }
+  return depth;
+}
+
+static bool S_ref_is_newline(const char *s, size_t *len) {
+  const unsigned char *u = (const unsigned char *)s;
+  if (u[0] >= 0x0A && u[0] <= 0x0D) {
+    *len = 1;
+  } else if (u[0] == 0xC2 && u[1] == 0x85) {
+    *len = 2;
+  } else if (u[0] == 0xE2 && u[1] == 0x80 && (u[2] == 0xA8 || u[2] == 0xA9)) {
+    *len = 3;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The visitor's replacingNewlinesWithLineSeparators: trim newlines, then
+// split on every newline code point and join with U+2028.
+static void S_ref_block_literal(struct ref_out *out, const char *literal) {
+  const char *end = literal + strlen(literal), *p;
+  size_t nl;
+  while (literal < end && S_ref_is_newline(literal, &nl)) {
+    literal += nl;
+  }
+  for (;;) {
+    const char *last = end;
+    while (last > literal && ((unsigned char)last[-1] & 0xC0) == 0x80) {
+      last--;
+    }
+    if (last > literal) {
+      last--;
+    }
+    if (last < end && last >= literal && S_ref_is_newline(last, &nl) &&
+        last + nl == end) {
+      end = last;
+    } else {
+      break;
+    }
+  }
+  for (p = literal; p < end;) {
+    if (S_ref_is_newline(p, &nl)) {
+      S_ref_put(out, "\xE2\x80\xA8", 3);
+      p += nl;
+    } else {
+      S_ref_put(out, p, 1);
+      p++;
+    }
+  }
+}
+
+static void S_ref_render(cmark_node *node, struct ref_out *out, int options,
+                         struct ref_list *lists, int nlists) {
+  cmark_node_type type = cmark_node_get_type(node);
+  const char *literal = cmark_node_get_literal(node);
+  bool separate = cmark_node_next(node) != NULL;
+  cmark_node *child;
+  struct ref_out prefix;
+  char marker[32];
+  size_t i;
+
+  S_ref_init(out);
+  switch (type) {
+  case CMARK_NODE_TEXT:
+  case CMARK_NODE_CODE:
+  case CMARK_NODE_HTML_INLINE:
+    if (literal && *literal) {
+      S_ref_put(out, literal, (bufsize_t)strlen(literal));
+      S_ref_wrap(out, node, type, 0, 0);
+    }
+    return;
+  case CMARK_NODE_SOFTBREAK:
+    S_ref_put(out, options & CMARK_OPT_HARDBREAKS ? "\xE2\x80\xA8" : " ",
+              options & CMARK_OPT_HARDBREAKS ? 3 : 1);
+    S_ref_wrap(out, node, type, 0, 0);
+    return;
+  case CMARK_NODE_LINEBREAK:
+    S_ref_put(out, "\xE2\x80\xA8", 3);
+    S_ref_wrap(out, node, type, 0, 0);
+    return;
+  case CMARK_NODE_THEMATIC_BREAK:
+    S_ref_put(out, "\xE2\x80\x8B\n", 4);
+    S_ref_wrap(out, node, type, 0, 0);
+    return;
+  case CMARK_NODE_CODE_BLOCK:
+  case CMARK_NODE_HTML_BLOCK:
+    if (literal && *literal) {
+      S_ref_block_literal(out, literal);
+      if (separate) {
+        S_ref_put(out, "\xE2\x80\xA9", 3);
+      }
+      S_ref_wrap(out, node, type, 0, 0);
+    }
+    return;
+  case CMARK_NODE_CUSTOM_BLOCK:
+  case CMARK_NODE_CUSTOM_INLINE:
+    return;
+  case CMARK_NODE_LIST:
+    lists[nlists].type = cmark_node_get_list_type(node);
+    lists[nlists].next = cmark_node_get_list_start(node);
+    nlists++;
+    break;
+  default:
+    break;
+  }
+
+  for (child = cmark_node_first_child(node); child;
+       child = cmark_node_next(child)) {
+    struct ref_out rendered;
+    S_ref_render(child, &rendered, options, lists, nlists);
+    S_ref_join(out, &rendered);
+    S_ref_free(&rendered);
+  }
+
+  switch (type) {
+  case CMARK_NODE_ITEM: {
+    struct ref_list *list = &lists[nlists - 1];
+    cmark_task_state task = cmark_node_get_task_state(node);
+    int32_t prefix_len;
+    struct ref_out joined;
+    if (task != CMARK_NO_TASK) {
+      strcpy(marker, task == CMARK_TASK_CHECKED ? "\xE2\x98\x91"
+                                                : "\xE2\x98\x90");
+      list->next += list->type == CMARK_ORDERED_LIST;
+    } else if (list->type == CMARK_ORDERED_LIST) {
+      snprintf(marker, sizeof(marker), "%d.", list->next++);
+    } else {
+      strcpy(marker, "\xE2\x80\xA2");
+    }
+    prefix_len = S_utf16_len((const unsigned char *)marker,
+                             (bufsize_t)strlen(marker));
+    S_ref_init(&prefix);
+    S_ref_put(&prefix, marker, (bufsize_t)strlen(marker));
+    S_ref_put(&prefix, "\t", 1);
+    S_ref_wrap(&prefix, node, CMARK_STYLE_LIST_ITEM_PREFIX, 0, prefix_len);
+    // Insert the prefix in front of the children.
+    S_ref_init(&joined);
+    S_ref_join(&joined, &prefix);
+    S_ref_join(&joined, out);
+    S_ref_free(&prefix);
+    S_ref_free(out);
+    *out = joined;
+    if (separate) {
+      S_ref_put(out, "\xE2\x80\xA9", 3);
+    }
+    S_ref_wrap(out, node, type, S_ref_nest_depth(node), prefix_len);
+    return;
+  }
+  case CMARK_NODE_TABLE_ROW:
+    if (separate) {
+      S_ref_put(out, "\xE2\x80\xA8", 3);
+    }
+    S_ref_wrap(out, node, type, S_ref_nest_depth(node),
+               cmark_node_get_table_row_header(node));
+    return;
+  case CMARK_NODE_TABLE_CELL:
+    if (separate) {
+      S_ref_put(out, "\t", 1);
+    }
+    S_ref_wrap(out, node, type, S_ref_nest_depth(node),
+               cmark_node_get_table_cell_column(node));
+    return;
+  case CMARK_NODE_BLOCK_QUOTE:
+  case CMARK_NODE_LIST:
+  case CMARK_NODE_PARAGRAPH:
+  case CMARK_NODE_HEADING:
+  case CMARK_NODE_TABLE:
+    if (separate) {
+      S_ref_put(out, "\xE2\x80\xA9", 3);
+    }
+    break;
+  default:
+    break;
+  }
+  S_ref_wrap(out, node, type, S_ref_nest_depth(node),
+             type == CMARK_NODE_HEADING ? cmark_node_get_heading_level(node)
+             : type == CMARK_NODE_TABLE ? cmark_node_get_table_columns(node)
+                                        : 0);
+  (void)i;
+}
+
+static void S_check_style_runs_of(const char *markdown, size_t len,
+                                  int options) {
+  cmark_node *doc = cmark_parse_document(markdown, len, options);
+  cmark_style_runs *runs = cmark_render_style_runs(doc, options);
+  struct ref_list lists[64];
+  struct ref_out ref;
+  size_t i;
+
+  S_ref_render(doc, &ref, options, lists, 0);
+  if (runs->text_len != ref.text.size ||
+      memcmp(runs->text, ref.text.ptr, ref.text.size) != 0 ||
+      runs->utf16_len != ref.utf16_len) {
+    S_fail("style runs: text differs for options %d:\n%.*s", options,
+           (int)len, markdown);
+  } else if (runs->nruns != ref.nruns) {
+    S_fail("style runs: %zu runs, reference %zu, options %d:\n%.*s",
+           runs->nruns, ref.nruns, options, (int)len, markdown);
+  } else {
+    for (i = 0; i < ref.nruns; i++) {
+      cmark_style_run *a = &runs->runs[i], *b = &ref.runs[i];
+      if (a->location != b->location || a->length != b->length ||
+          a->byte_offset != b->byte_offset ||
+          a->byte_length != b->byte_length || a->style != b->style ||
+          a->nest_depth != b->nest_depth || a->payload != b->payload ||
+          a->node != b->node) {
+        S_fail("style runs: run %zu differs, options %d:\n%.*s", i, options,
+               (int)len, markdown);
+        break;
+      }
+    }
+  }
+  S_ref_free(&ref);
+  cmark_style_runs_free(runs);
+  cmark_node_free(doc);
+}
+
+static void S_check_style_runs(int rounds) {
+  static const char *const FIXED[] = {
+      "", "a", "# h\n\n- a\n- b\n\n  c\n\n> q\n\n```\n\n\n```\n",
+      "1. a\n   1. b\n2. c\n\n---\n\n<p>\n\nx  \ny\n",
+      "```\r\nline\r\n\r\nmore\r\n```\n", "- [ ] a\n- [x] b\n",
+      "| a | b |\n| - | - |\n| *x* | y |\n| z |\n\ntail",
+  };
+  static const int OPTIONS[] = {CMARK_OPT_DEFAULT, CMARK_OPT_HARDBREAKS,
+                                CMARK_OPT_GFM,
+                                CMARK_OPT_GFM | CMARK_OPT_HARDBREAKS};
+  size_t f, o;
+  int round;
+
+  for (o = 0; o < sizeof(OPTIONS) / sizeof(OPTIONS[0]); o++) {
+    for (f = 0; f < sizeof(FIXED) / sizeof(FIXED[0]); f++) {
+      S_check_style_runs_of(FIXED[f], strlen(FIXED[f]), OPTIONS[o]);
+    }
+  }
+  for (round = 0; round < rounds; round++) {
+    text_buf b = {NULL, 0, 0};
+    S_random_blocks(&b, "", 4);
+    S_check_style_runs_of(b.ptr, b.len, OPTIONS[round % 4]);
+    free(b.ptr);
+  }
+}
+
+// MARK: GFM spec
+
+// The GFM spec examples for tables, task list items and strikethrough,
+// rendered to HTML with CMARK_OPT_GFM.
+static const char *const GFM_SPEC[][2] = {
+    {"| foo | bar |\n| --- | --- |\n| baz | bim |\n",
+     "<table>\n<thead>\n<tr>\n<th>foo</th>\n<th>bar</th>\n</tr>\n</thead>\n"
+     "<tbody>\n<tr>\n<td>baz</td>\n<td>bim</td>\n</tr>\n</tbody>\n</table>\n"},
+    {"| abc | defghi |\n:-: | -----------:\nbar | baz\n",
+     "<table>\n<thead>\n<tr>\n<th align=\"center\">abc</th>\n"
+     "<th align=\"right\">defghi</th>\n</tr>\n</thead>\n<tbody>\n<tr>\n"
+     "<td align=\"center\">bar</td>\n<td align=\"right\">baz</td>\n</tr>\n"
+     "</tbody>\n</table>\n"},
+    {"| f\\|oo  |\n| ------ |\n| b `\\|` az |\n| b **\\|** im |\n",
+     "<table>\n<thead>\n<tr>\n<th>f|oo</th>\n</tr>\n</thead>\n<tbody>\n<tr>\n"
+     "<td>b <code>|</code> az</td>\n</tr>\n<tr>\n"
+     "<td>b <strong>|</strong> im</td>\n</tr>\n</tbody>\n</table>\n"},
+    {"| abc | def |\n| --- | --- |\n| bar | baz |\n> bar\n",
+     "<table>\n<thead>\n<tr>\n<th>abc</th>\n<th>def</th>\n</tr>\n</thead>\n"
+     "<tbody>\n<tr>\n<td>bar</td>\n<td>baz</td>\n</tr>\n</tbody>\n</table>\n"
+     "<blockquote>\n<p>bar</p>\n</blockquote>\n"},
+    {"| abc | def |\n| --- | --- |\n| bar | baz |\nbar\n\nbar\n",
+     "<table>\n<thead>\n<tr>\n<th>abc</th>\n<th>def</th>\n</tr>\n</thead>\n"
+     "<tbody>\n<tr>\n<td>bar</td>\n<td>baz</td>\n</tr>\n<tr>\n<td>bar</td>\n"
+     "<td></td>\n</tr>\n</tbody>\n</table>\n<p>bar</p>\n"},
+    {"| abc | def |\n| --- |\n| bar |\n",
+     "<p>| abc | def |\n| --- |\n| bar |</p>\n"},
+    {"| abc | def |\n| --- | --- |\n| bar |\n| bar | baz | boo |\n",
+     "<table>\n<thead>\n<tr>\n<th>abc</th>\n<th>def</th>\n</tr>\n</thead>\n"
+     "<tbody>\n<tr>\n<td>bar</td>\n<td></td>\n</tr>\n<tr>\n<td>bar</td>\n"
+     "<td>baz</td>\n</tr>\n</tbody>\n</table>\n"},
+    {"| abc | def |\n| --- | --- |\n",
+     "<table>\n<thead>\n<tr>\n<th>abc</th>\n<th>def</th>\n</tr>\n</thead>\n"
+     "</table>\n"},
+    {"- [ ] foo\n- [x] bar\n",
+     "<ul>\n<li><input disabled=\"\" type=\"checkbox\"> foo</li>\n"
+     "<li><input checked=\"\" disabled=\"\" type=\"checkbox\"> bar</li>\n"
+     "</ul>\n"},
+    {"- [x] foo\n  - [ ] bar\n  - [x] baz\n- [ ] bim\n",
+     "<ul>\n<li><input checked=\"\" disabled=\"\" type=\"checkbox\"> foo\n"
+     "<ul>\n<li><input disabled=\"\" type=\"checkbox\"> bar</li>\n"
+     "<li><input checked=\"\" disabled=\"\" type=\"checkbox\"> baz</li>\n"
+     "</ul>\n</li>\n<li><input disabled=\"\" type=\"checkbox\"> bim</li>\n"
+     "</ul>\n"},
+    {"~~Hi~~ Hello, world!\n", "<p><del>Hi</del> Hello, world!</p>\n"},
+    {"This ~~has a\n\nnew paragraph~~.\n",
+     "<p>This ~~has a</p>\n<p>new paragraph~~.</p>\n"},
+};
+
+// Without the options the same inputs must parse as CommonMark does.
+static const char *const GFM_OFF[][2] = {
+    {"| a |\n| - |\n", "<p>| a |\n| - |</p>\n"},
+    {"- [x] a\n", "<ul>\n<li>[x] a</li>\n</ul>\n"},
+    {"~~a~~\n", "<p>~~a~~</p>\n"},
+};
+
+static void S_check_html(const char *markdown, const char *expected,
+                         int options) {
+  char *html = cmark_markdown_to_html(markdown, strlen(markdown), options);
+  if (strcmp(html, expected) != 0) {
+    S_fail("gfm spec: options %d\n%s--- expected\n%s--- got\n%s", options,
+           markdown, expected, html);
+  }
+  free(html);
+}
+
+static void S_check_gfm_spec(void) {
+  size_t i;
+
+  for (i = 0; i < sizeof(GFM_SPEC) / sizeof(GFM_SPEC[0]); i++) {
+    S_check_html(GFM_SPEC[i][0], GFM_SPEC[i][1], CMARK_OPT_GFM);
+  }
+  for (i = 0; i < sizeof(GFM_OFF) / sizeof(GFM_OFF[0]); i++) {
+    S_check_html(GFM_OFF[i][0], GFM_OFF[i][1], CMARK_OPT_DEFAULT);
+  }
+}
+
+// MARK: Byte loops
+
+// Byte at a time references for houdini_escape_html0 and
+// cmark_utf8proc_check, whose 16 byte fast paths must produce exactly what
+// their scalar loops do.  They mirror the scalar loops as of the fast paths,
+// so building with -DCMARK_NO_SIMD checks the references themselves.
+
+static void S_ref_escape_html(cmark_strbuf *ob, const uint8_t *src,
+                              bufsize_t size, int secure) {
+  bufsize_t i;
+
+  for (i = 0; i < size; i++) {
+    switch (src[i]) {
+    case '"': cmark_strbuf_puts(ob, "&quot;"); break;
+    case '&': cmark_strbuf_puts(ob, "&amp;"); break;
+    case '<': cmark_strbuf_puts(ob, "&lt;"); break;
+    case '>': cmark_strbuf_puts(ob, "&gt;"); break;
+    case '\'':
+      cmark_strbuf_puts(ob, secure ? "&#39;" : "'");
+      break;
+    case '/':
+      cmark_strbuf_puts(ob, secure ? "&#47;" : "/");
+      break;
+    default: cmark_strbuf_putc(ob, src[i]); break;
+    }
+  }
+}
+
+// The length of the valid character at 'src', or minus the number of bytes
+// replaced by one U+FFFD, as RFC 3629 and cmark's utf8proc_valid have it.
+static int S_ref_utf8_char(const uint8_t *src, bufsize_t size) {
+  int length = src[0] < 0x80   ? 1
+               : src[0] < 0xC0 ? 0
+               : src[0] < 0xE0 ? 2
+               : src[0] < 0xF0 ? 3
+               : src[0] < 0xF8 ? 4
+                               : 0;
+  int k;
+
+  if (length == 0) {
+    return -1;
+  }
+  if (length > size) {
+    return -size;
+  }
+  for (k = 1; k < length; k++) {
+    if ((src[k] & 0xC0) != 0x80) {
+      return -k;
+    }
+  }
+  if ((length == 2 && src[0] < 0xC2) ||
+      (length == 3 && src[0] == 0xE0 && src[1] < 0xA0) ||
+      (length == 3 && src[0] == 0xED && src[1] >= 0xA0) ||
+      (length == 4 && src[0] == 0xF0 && src[1] < 0x90) ||
+      (length == 4 && (src[0] > 0xF4 || (src[0] == 0xF4 && src[1] >= 0x90)))) {
+    return -length;
+  }
+  return length;
+}
+
+static void S_ref_utf8_check(cmark_strbuf *ob, const uint8_t *src,
+                             bufsize_t size) {
+  static const uint8_t REPLACEMENT[] = {0xEF, 0xBF, 0xBD};
+  bufsize_t i = 0;
+
+  while (i < size) {
+    int n = src[i] == 0 ? -1 : S_ref_utf8_char(src + i, size - i);
+    if (n > 0) {
+      cmark_strbuf_put(ob, src + i, n);
+      i += n;
+    } else {
+      cmark_strbuf_put(ob, REPLACEMENT, 3);
+      i -= n;
+    }
+  }
+}
+
+// Characters and invalid sequences dropped around 16 byte block edges.
+static const char *const BYTE_PIECES[] = {
+    "a", "&", "<", ">", "\"", "'", "/", "\xC3\xA9", "\xE4\xB8\xAD",
+    "\xF0\x9F\x98\x80", "\xEF\xBF\xBF", "\xF4\x8F\xBF\xBF",
+    // Lone continuation, truncated leads, overlongs, a surrogate, above
+    // U+10FFFF, bytes that never start a character and NUL.
+    "\x80", "\xBF\xBF", "\xC3", "\xE4\xB8", "\xF0\x9F\x98", "\xC0\x80",
+    "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xED\xA0\x80",
+    "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF8",
+    "\xFF", "\xE4\xB8\x41", "\xF0\x9F\x41\x80", "\0",
+};
+#define BYTE_PIECE_COUNT (sizeof(BYTE_PIECES) / sizeof(BYTE_PIECES[0]))
+
+static size_t S_byte_piece_len(size_t piece) {
+  // NUL is the only piece that strlen can't measure.
+  return BYTE_PIECES[piece][0] ? strlen(BYTE_PIECES[piece]) : 1;
+}
+
+static void S_check_byte_loops_of(const uint8_t *src, bufsize_t size) {
+  cmark_strbuf got = CMARK_BUF_INIT(&COUNTING_MEM);
+  cmark_strbuf want = CMARK_BUF_INIT(&COUNTING_MEM);
+  int secure;
+
+  for (secure = 0; secure < 2; secure++) {
+    houdini_escape_html0(&got, src, size, secure);
+    S_ref_escape_html(&want, src, size, secure);
+    if (got.size != want.size || memcmp(got.ptr, want.ptr, got.size) != 0) {
+      S_fail("escape_html: secure %d differs on %d bytes", secure, size);
+    }
+    cmark_strbuf_clear(&got);
+    cmark_strbuf_clear(&want);
+  }
+
+  cmark_utf8proc_check(&got, src, size);
+  S_ref_utf8_check(&want, src, size);
+  if (got.size != want.size || memcmp(got.ptr, want.ptr, got.size) != 0) {
+    bufsize_t i;
+    S_fail("utf8_check: differs on %d bytes:", size);
+    for (i = 0; i < size && failures <= 10; i++) {
+      fprintf(stderr, "%02X%c", src[i], i % 16 == 15 ? '|' : ' ');
+    }
+    if (failures <= 10) {
+      fputc('\n', stderr);
+    }
+  }
+  cmark_strbuf_free(&got);
+  cmark_strbuf_free(&want);
+}
+
+static void S_check_byte_loops(int rounds) {
+  // Fillers keep the surrounding blocks all ASCII or all multi-byte, so both
+  // fast paths reach the block with the piece.
+  static const char *const FILLERS[] = {"a", "\xC3\xA9", "\xE4\xB8\xAD"};
+  uint8_t buf[96];
+  size_t piece, filler, f;
+  int pos, round, start;
+
+  // Every piece at every offset across two block edges.
+  for (filler = 0; filler < 3; filler++) {
+    size_t flen = strlen(FILLERS[filler]);
+    for (piece = 0; piece < BYTE_PIECE_COUNT; piece++) {
+      size_t plen = S_byte_piece_len(piece);
+      for (pos = 0; pos < 40; pos++) {
+        size_t len = 0;
+        while (len < (size_t)pos) {
+          memcpy(buf + len, FILLERS[filler], flen);
+          len += flen;
+        }
+        memcpy(buf + len, BYTE_PIECES[piece], plen);
+        len += plen;
+        while (len < 64) {
+          memcpy(buf + len, FILLERS[filler], flen);
+          len += flen;
+        }
+        // Unaligned starts move the block edges under the same bytes.
+        for (start = 0; start < 16; start++) {
+          S_check_byte_loops_of(buf + start, (bufsize_t)(len - start));
+        }
+      }
+    }
+  }
+
+  // Random mixes of pieces, of any length.
+  for (round = 0; round < rounds; round++) {
+    size_t len = 0, limit = S_random(80);
+    while (len < limit) {
+      piece = S_random(3) ? S_random(12) : S_random(BYTE_PIECE_COUNT);
+      f = S_byte_piece_len(piece);
+      memcpy(buf + len, BYTE_PIECES[piece], f);
+      len += f;
+    }
+    S_check_byte_loops_of(buf, (bufsize_t)len);
+  }
+}
+
+// MARK: Reparse
+
+static bool S_same_tree(cmark_node *a, cmark_node *b) {
+  char *xa = cmark_render_xml(a, CMARK_OPT_SOURCEPOS);
+  char *xb = cmark_render_xml(b, CMARK_OPT_SOURCEPOS);
+  bool same = strcmp(xa, xb) == 0;
+  free(xa);
+  free(xb);
+  return same;
+}
+
+static size_t S_common_prefix(const char *a, size_t alen, const char *b,
+                              size_t blen) {
+  size_t i = 0;
+  while (i < alen && i < blen && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+// Chains of random edits to random documents, each reparsed from the
+// previous result and compared with a full parse of the edited text.  Most
+// edits are near the end, as when an answer streams in or is regenerated.
+static void S_check_reparse(int edits) {
+  static const int OPTIONS[] = {CMARK_OPT_DEFAULT, CMARK_OPT_GFM,
+                                CMARK_OPT_GFM | CMARK_OPT_HARDBREAKS};
+  int done = 0, chain = 0;
+
+  while (done < edits) {
+    int options = OPTIONS[chain++ % 3];
+    text_buf text = {NULL, 0, 0};
+    cmark_node *doc;
+    int step;
+
+    S_random_blocks(&text, "", 3);
+    doc = cmark_parse_document(text.ptr, text.len, options);
+
+    for (step = 0; step < 10 && done < edits; step++, done++) {
+      text_buf edited = {NULL, 0, 0}, piece = {NULL, 0, 0};
+      size_t at, cut, unchanged;
+      cmark_node *reparsed, *full;
+
+      at = S_random(4) ? text.len - S_random((uint32_t)(text.len < 64 ? text.len + 1 : 64))
+                       : S_random((uint32_t)text.len + 1);
+      cut = S_random((uint32_t)(text.len - at) + 1);
+      switch (S_random(3)) {
+      case 0: S_random_inline(&piece); break;
+      case 1: S_random_blocks(&piece, "", 2); break;
+      default: break; // Deletes only.
+      }
+      S_append(&edited, "%.*s%s%.*s", (int)at, text.ptr,
+               piece.ptr ? piece.ptr : "", (int)(text.len - at - cut),
+               text.ptr + at + cut);
+
+      // Any length up to the common prefix is allowed.
+      unchanged = S_common_prefix(text.ptr, text.len, edited.ptr, edited.len);
+      if (S_random(4) == 0) {
+        unchanged = S_random((uint32_t)unchanged + 1);
+      }
+      reparsed = cmark_reparse_document(doc, unchanged, edited.ptr,
+                                        edited.len, options);
+      full = cmark_parse_document(edited.ptr, edited.len, options);
+      if (!S_same_tree(reparsed, full)) {
+        S_fail("reparse: differs from a full parse, options %d, unchanged "
+               "%zu:\n%s--- edited to\n%s",
+               options, unchanged, text.ptr, edited.ptr);
+      }
+
+      cmark_node_free(full);
+      cmark_node_free(doc);
+      doc = reparsed;
+      free(text.ptr);
+      free(piece.ptr);
+      text = edited;
+    }
+
+    cmark_node_free(doc);
+    free(text.ptr);
+  }
+}
+
+// MARK: - Report
+
+static void S_print_measurement(const char *name, struct measurement m,
+                                size_t bytes, bool last) {
+  printf("        \"%s\": {\"seconds\": %.9f, \"mb_per_s\": %.3f, "
+         "\"allocs\": %zu, \"alloc_bytes\": %zu, \"peak_bytes\": %zu}%s\n",
+         name, m.seconds, bytes / m.seconds / 1e6, m.alloc.allocs,
+         m.alloc.bytes, m.alloc.peak, last ? "" : ",");
+}
+
+static void S_print_string(const char *s) {
+  putchar('"');
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      putchar('\\');
+    }
+    if ((unsigned char)*s >= 0x20) {
+      putchar(*s);
+    }
+  }
+  putchar('"');
+}
+
+static void S_run_corpus(const char *name, const char *data, size_t len,
+                         bool last) {
+  struct input input = {data, len, CMARK_OPT_DEFAULT, NULL};
+  size_t i, count = sizeof(RENDERERS) / sizeof(RENDERERS[0]);
+
+  printf("    {\n      \"name\": ");
+  S_print_string(name);
+  printf(",\n      \"bytes\": %zu,\n", len);
+  printf("      \"results\": {\n");
+  S_print_measurement("parse", S_measure(bench_parse, &input), len, false);
+  input.options = CMARK_OPT_GFM;
+  S_print_measurement("parse_gfm", S_measure(bench_parse, &input), len, false);
+  input.options = CMARK_OPT_VALIDATE_UTF8;
+  S_print_measurement("parse_validate_utf8", S_measure(bench_parse, &input),
+                      len, false);
+  input.options = CMARK_OPT_DEFAULT;
+  S_print_measurement("escape_html", S_measure(bench_escape_html, &input), len,
+                      false);
+  S_print_measurement("validate_utf8", S_measure(bench_validate_utf8, &input),
+                      len, false);
+
+  input.doc = S_parse(&input);
+  for (i = 0; i < count; i++) {
+    S_print_measurement(RENDERERS[i].name, S_measure(RENDERERS[i].fn, &input),
+                        len, i + 1 == count);
+  }
+  cmark_node_free(input.doc);
+  printf("      }\n    }%s\n", last ? "" : ",");
+}
+
+// 'name' edits the last 'changed' bytes of 'base': regenerating replaces them
+// with other text, appending drops them from the older version.  Times
+// reparsing the edited text against a full parse of it; S_check_reparse
+// checks that both give the same tree.
+static void S_run_reparse(const char *name, const char *base, size_t len,
+                          size_t changed, bool regenerate, bool last) {
+  text_buf other = {NULL, 0, 0};
+  struct input input = {base, len, CMARK_OPT_GFM, NULL};
+  struct measurement full, incremental;
+
+  S_append(&other, "%.*s", (int)(len - changed), base);
+  if (regenerate) {
+    text_buf tail = S_script_corpus(CJK_WORDS,
+                                    sizeof(CJK_WORDS) / sizeof(CJK_WORDS[0]),
+                                    changed);
+    S_append(&other, "%s", tail.ptr);
+    free(tail.ptr);
+  }
+
+  full = S_measure(bench_parse, &input);
+  edit_state.texts[0] = base;
+  edit_state.lens[0] = len;
+  edit_state.texts[1] = other.ptr;
+  edit_state.lens[1] = other.len;
+  edit_state.unchanged = len - changed;
+  edit_state.doc = S_parse(&input);
+  edit_state.current = 0;
+  incremental = S_measure(bench_reparse, &input);
+  cmark_node_free(edit_state.doc);
+  free(other.ptr);
+
+  printf("    {\n      \"name\": \"%s\",\n      \"bytes\": %zu,\n"
+         "      \"changed_bytes\": %zu,\n      \"speedup\": %.1f,\n"
+         "      \"results\": {\n",
+         name, len, changed, full.seconds / incremental.seconds);
+  S_print_measurement("parse", full, len, false);
+  S_print_measurement("reparse", incremental, len, true);
+  printf("      }\n    }%s\n", last ? "" : ",");
+}
+
+// Least squares slope of log(seconds) over log(bytes).
+static double S_exponent(const double *bytes, const double *seconds, int n) {
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int i;
+  for (i = 0; i < n; i++) {
+    double x = log(bytes[i]), y = log(seconds[i]);
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+static void S_run_pathological(size_t index, bool last) {
+  int steps = quick ? 3 : 5, step;
+  double bytes[8], seconds[8], exponent;
+
+  printf("    {\n      \"name\": \"%s\",\n      \"points\": [\n",
+         PATHOLOGICAL[index].name);
+  for (step = 0; step < steps; step++) {
+    text_buf buf = {NULL, 0, 0};
+    struct input input;
+    struct measurement m;
+
+    PATHOLOGICAL[index].gen(&buf, PATHOLOGICAL[index].base << step);
+    input.data = buf.ptr;
+    input.len = buf.len;
+    input.options = PATHOLOGICAL[index].options;
+    input.doc = NULL;
+    m = S_measure(bench_parse, &input);
+    bytes[step] = (double)buf.len;
+    seconds[step] = m.seconds;
+    printf("        {\"bytes\": %zu, \"seconds\": %.9f, \"mb_per_s\": %.3f, "
+           "\"allocs\": %zu, \"peak_bytes\": %zu}%s\n",
+           buf.len, m.seconds, buf.len / m.seconds / 1e6, m.alloc.allocs,
+           m.alloc.peak, step + 1 == steps ? "" : ",");
+    free(buf.ptr);
+  }
+  exponent = S_exponent(bytes, seconds, steps);
+  printf("      ],\n      \"exponent\": %.3f,\n      \"superlinear\": %s\n"
+         "    }%s\n",
+         exponent, exponent > 1.5 ? "true" : "false", last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+  const char *files[MAX_FILES];
+  int nfiles = 0, i;
+  size_t p, s, count = sizeof(PATHOLOGICAL) / sizeof(PATHOLOGICAL[0]);
+  size_t corpus_bytes;
+  text_buf corpus;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+      min_time = 0.05;
+    } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      min_time = atof(argv[++i]);
+    } else if (nfiles < MAX_FILES) {
+      files[nfiles++] = argv[i];
+    }
+  }
+
+  S_check_gfm_spec();
+  S_check_reparse(quick ? 500 : 5000);
+  S_check_byte_loops(quick ? 20000 : 200000);
+  S_check_style_runs(quick ? 300 : 3000);
+  if (failures) {
+    return 1;
+  }
+
+  printf("{\n  \"cmark_version\": \"%s\",\n  \"corpora\": [\n",
+         cmark_version_string());
+  corpus_bytes = quick ? (64 << 10) : (1 << 20);
+
+  corpus = S_chat_corpus(corpus_bytes);
+  S_run_corpus("chat", corpus.ptr, corpus.len, false);
+  free(corpus.ptr);
+
+  for (s = 0; s < sizeof(SCRIPTS) / sizeof(SCRIPTS[0]); s++) {
+    corpus = S_script_corpus(SCRIPTS[s].words, SCRIPTS[s].count, corpus_bytes);
+    S_run_corpus(SCRIPTS[s].name, corpus.ptr, corpus.len,
+                 nfiles == 0 && s + 1 == sizeof(SCRIPTS) / sizeof(SCRIPTS[0]));
+    free(corpus.ptr);
+  }
+
+  for (i = 0; i < nfiles; i++) {
+    size_t len;
+    char *data = S_read_file(files[i], &len);
+    if (!data) {
+      fprintf(stderr, "cannot read %s\n", files[i]);
+      return 1;
+    }
+    S_run_corpus(files[i], data, len, i + 1 == nfiles);
+    free(data);
+  }
+
+  printf("  ],\n  \"reparse\": [\n");
+  corpus = S_chat_corpus(50 << 10);
+  S_run_reparse("regenerate_tail", corpus.ptr, corpus.len, 2 << 10, true,
+                false);
+  S_run_reparse("append_token", corpus.ptr, corpus.len, 16, false, true);
+  free(corpus.ptr);
+
+  printf("  ],\n  \"pathological\": [\n");
+  for (p = 0; p < count; p++) {
+    S_run_pathological(p, p + 1 == count);
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
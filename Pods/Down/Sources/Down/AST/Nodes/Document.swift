@@ -25,6 +25,40 @@ public class Document: BaseNode {
         return visitor.visit(document: self)
     }
 
+    /// Parses an edited version of the Markdown this document was parsed from, reusing the top-level
+    /// blocks that lie entirely within its first `unchangedUTF8Count` bytes instead of parsing them again.
+    ///
+    /// The reused blocks move to the returned document, so this document, and any nodes taken from it,
+    /// must not be used afterwards.
+    ///
+    /// - Parameters:
+    ///     - markdownString: The edited Markdown.
+    ///     - unchangedUTF8Count: The length in UTF-8 bytes of the prefix both versions have in common.
+    ///     - options: `DownOptions` to modify parsing, which must match those this document was parsed with.
+    ///
+    /// - Returns:
+    ///     The root Document node for the edited Markdown, identical to a full parse of it.
+    ///
+    /// - Throws:
+    ///     `MarkdownToASTError` if conversion fails.
+
+    public func reparsed(_ markdownString: String,
+                         unchangedUTF8Count: Int,
+                         options: DownOptions = .default) throws -> Document {
+        var tree: CMarkNode?
+
+        markdownString.withCString {
+            let stringLength = Int(strlen($0))
+            tree = cmark_reparse_document(cmarkNode, unchangedUTF8Count, $0, stringLength, options.rawValue)
+        }
+
+        guard let ast = tree else {
+            throw DownErrors.markdownToASTError
+        }
+
+        return Document(cmarkNode: ast)
+    }
+
 }
 
 // MARK: - Debug
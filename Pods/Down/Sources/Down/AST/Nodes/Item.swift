@@ -8,14 +8,43 @@
 import Foundation
 import libcmark
 
-public class Item: BaseNode {}
+public class Item: BaseNode {
+
+    // MARK: - Properties
+
+    /// The checkbox of a task list item, parsed with `DownOptions.taskLists`.
+
+    public lazy var taskState: TaskState = TaskState(cmarkTaskState: cmark_node_get_task_state(cmarkNode))
+
+}
+
+// MARK: - Task State
+
+public extension Item {
+
+    enum TaskState {
+        case none
+        case unchecked
+        case checked
+
+        init(cmarkTaskState: cmark_task_state) {
+            switch cmarkTaskState {
+            case CMARK_TASK_UNCHECKED: self = .unchecked
+            case CMARK_TASK_CHECKED: self = .checked
+            default: self = .none
+            }
+        }
+
+    }
+
+}
 
 // MARK: - Debug
 
 extension Item: CustomDebugStringConvertible {
 
     public var debugDescription: String {
-        return "Item"
+        return "Item - taskState: \(taskState)"
     }
 
 }
@@ -59,6 +59,9 @@ public extension CMarkNode {
         case CMARK_NODE_PARAGRAPH:      return Paragraph(cmarkNode: self)
         case CMARK_NODE_HEADING:        return Heading(cmarkNode: self)
         case CMARK_NODE_THEMATIC_BREAK: return ThematicBreak(cmarkNode: self)
+        case CMARK_NODE_TABLE:          return Table(cmarkNode: self)
+        case CMARK_NODE_TABLE_ROW:      return TableRow(cmarkNode: self)
+        case CMARK_NODE_TABLE_CELL:     return TableCell(cmarkNode: self)
         case CMARK_NODE_TEXT:           return Text(cmarkNode: self)
         case CMARK_NODE_SOFTBREAK:      return SoftBreak(cmarkNode: self)
         case CMARK_NODE_LINEBREAK:      return LineBreak(cmarkNode: self)
@@ -69,6 +72,7 @@ public extension CMarkNode {
         case CMARK_NODE_STRONG:         return Strong(cmarkNode: self)
         case CMARK_NODE_LINK:           return Link(cmarkNode: self)
         case CMARK_NODE_IMAGE:          return Image(cmarkNode: self)
+        case CMARK_NODE_STRIKETHROUGH:  return Strikethrough(cmarkNode: self)
         default:                        return nil
         }
     }
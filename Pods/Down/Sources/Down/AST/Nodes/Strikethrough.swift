@@ -0,0 +1,19 @@
+//
+//  Strikethrough.swift
+//  Down
+//
+
+import Foundation
+import libcmark
+
+public class Strikethrough: BaseNode {}
+
+// MARK: - Debug
+
+extension Strikethrough: CustomDebugStringConvertible {
+
+    public var debugDescription: String {
+        return "Strikethrough"
+    }
+
+}
@@ -0,0 +1,66 @@
+//
+//  Table.swift
+//  Down
+//
+
+import Foundation
+import libcmark
+
+public class Table: BaseNode {
+
+    // MARK: - Properties
+
+    /// The columns of the table, measured once by the parser.
+
+    public lazy var columns: [Column] = (0..<Int(cmark_node_get_table_columns(cmarkNode))).map { index in
+        Column(alignment: Alignment(cmarkAlignment: cmark_node_get_table_alignment(cmarkNode, Int32(index))),
+               utf16Width: Int(cmark_node_get_table_column_utf16_width(cmarkNode, Int32(index))),
+               displayWidth: Int(cmark_node_get_table_column_display_width(cmarkNode, Int32(index))))
+    }
+
+}
+
+// MARK: - Column
+
+public extension Table {
+
+    enum Alignment {
+        case none
+        case left
+        case center
+        case right
+
+        init(cmarkAlignment: cmark_table_align) {
+            switch cmarkAlignment {
+            case CMARK_TABLE_ALIGN_LEFT: self = .left
+            case CMARK_TABLE_ALIGN_CENTER: self = .center
+            case CMARK_TABLE_ALIGN_RIGHT: self = .right
+            default: self = .none
+            }
+        }
+
+    }
+
+    struct Column {
+
+        public let alignment: Alignment
+
+        /// The widest cell text in the column, in UTF-16 code units and in terminal cells (East Asian wide
+        /// characters and emoji count two, combining marks none). Inline markup is not counted.
+
+        public let utf16Width: Int
+        public let displayWidth: Int
+
+    }
+
+}
+
+// MARK: - Debug
+
+extension Table: CustomDebugStringConvertible {
+
+    public var debugDescription: String {
+        return "Table - columns: \(columns.count)"
+    }
+
+}
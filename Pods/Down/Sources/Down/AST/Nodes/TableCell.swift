@@ -0,0 +1,27 @@
+//
+//  TableCell.swift
+//  Down
+//
+
+import Foundation
+import libcmark
+
+public class TableCell: BaseNode {
+
+    // MARK: - Properties
+
+    /// The zero indexed column of the cell.
+
+    public lazy var column: Int = Int(cmark_node_get_table_cell_column(cmarkNode))
+
+}
+
+// MARK: - Debug
+
+extension TableCell: CustomDebugStringConvertible {
+
+    public var debugDescription: String {
+        return "Table Cell - column: \(column)"
+    }
+
+}
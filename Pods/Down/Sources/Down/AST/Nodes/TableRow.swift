@@ -0,0 +1,27 @@
+//
+//  TableRow.swift
+//  Down
+//
+
+import Foundation
+import libcmark
+
+public class TableRow: BaseNode {
+
+    // MARK: - Properties
+
+    /// Whether this is the header row of its table.
+
+    public lazy var isHeader: Bool = cmark_node_get_table_row_header(cmarkNode) == 1
+
+}
+
+// MARK: - Debug
+
+extension TableRow: CustomDebugStringConvertible {
+
+    public var debugDescription: String {
+        return "Table Row - isHeader: \(isHeader)"
+    }
+
+}
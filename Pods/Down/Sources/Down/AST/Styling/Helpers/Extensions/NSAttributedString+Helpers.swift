@@ -47,15 +47,23 @@ extension NSAttributedString {
     }
 
     func paragraphRanges() -> [NSRange] {
-        guard length > 0 else { return [] }
+        return paragraphRanges(in: wholeRange)
+    }
+
+    /// The paragraphs of the given range, clipped to it, as `paragraphRanges()` finds them in a copy of it.
+
+    func paragraphRanges(in range: NSRange) -> [NSRange] {
+        guard range.length > 0 else { return [] }
+
+        let string = NSString(string: self.string)
 
         func nextParagraphRange(at location: Int) -> NSRange {
-            return NSString(string: string).paragraphRange(for: NSRange(location: location, length: 1))
+            return NSIntersectionRange(string.paragraphRange(for: NSRange(location: location, length: 1)), range)
         }
 
-        var result = [nextParagraphRange(at: 0)]
+        var result = [nextParagraphRange(at: range.location)]
 
-        while let currentLocation = result.last?.upperBound, currentLocation < length {
+        while let currentLocation = result.last?.upperBound, currentLocation < range.upperBound {
             result.append(nextParagraphRange(at: currentLocation))
         }
 
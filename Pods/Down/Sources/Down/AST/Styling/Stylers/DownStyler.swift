@@ -22,7 +22,7 @@ import AppKit
 /// properties for font, text color and paragraph styling, as well as formatting
 /// of nested lists and quotes.
 
-open class DownStyler: Styler {
+open class DownStyler: RangeStyler {
 
     // MARK: - Properties
 
@@ -57,62 +57,155 @@ open class DownStyler: Styler {
     // MARK: - Styling
 
     open func style(document str: NSMutableAttributedString) {
-
+        style(document: str, in: str.wholeRange)
     }
 
     open func style(blockQuote str: NSMutableAttributedString, nestDepth: Int) {
+        style(blockQuote: str, in: str.wholeRange, nestDepth: nestDepth)
+    }
+
+    open func style(list str: NSMutableAttributedString, nestDepth: Int) {
+        style(list: str, in: str.wholeRange, nestDepth: nestDepth)
+    }
+
+    open func style(listItemPrefix str: NSMutableAttributedString) {
+        style(listItemPrefix: str, in: str.wholeRange)
+    }
+
+    open func style(item str: NSMutableAttributedString, prefixLength: Int) {
+        style(item: str, in: str.wholeRange, prefixLength: prefixLength)
+    }
+
+    open func style(codeBlock str: NSMutableAttributedString, fenceInfo: String?) {
+        style(codeBlock: str, in: str.wholeRange, fenceInfo: fenceInfo)
+    }
+
+    open func style(htmlBlock str: NSMutableAttributedString) {
+        style(htmlBlock: str, in: str.wholeRange)
+    }
+
+    open func style(customBlock str: NSMutableAttributedString) {
+        style(customBlock: str, in: str.wholeRange)
+    }
+
+    open func style(paragraph str: NSMutableAttributedString) {
+        style(paragraph: str, in: str.wholeRange)
+    }
+
+    open func style(heading str: NSMutableAttributedString, level: Int) {
+        style(heading: str, in: str.wholeRange, level: level)
+    }
+
+    open func style(thematicBreak str: NSMutableAttributedString) {
+        style(thematicBreak: str, in: str.wholeRange)
+    }
+
+    open func style(text str: NSMutableAttributedString) {
+        style(text: str, in: str.wholeRange)
+    }
+
+    open func style(softBreak str: NSMutableAttributedString) {
+        style(softBreak: str, in: str.wholeRange)
+    }
+
+    open func style(lineBreak str: NSMutableAttributedString) {
+        style(lineBreak: str, in: str.wholeRange)
+    }
+
+    open func style(code str: NSMutableAttributedString) {
+        style(code: str, in: str.wholeRange)
+    }
+
+    open func style(htmlInline str: NSMutableAttributedString) {
+        style(htmlInline: str, in: str.wholeRange)
+    }
+
+    open func style(customInline str: NSMutableAttributedString) {
+        style(customInline: str, in: str.wholeRange)
+    }
+
+    open func style(emphasis str: NSMutableAttributedString) {
+        style(emphasis: str, in: str.wholeRange)
+    }
+
+    open func style(strong str: NSMutableAttributedString) {
+        style(strong: str, in: str.wholeRange)
+    }
+
+    open func style(link str: NSMutableAttributedString, title: String?, url: String?) {
+        style(link: str, in: str.wholeRange, title: title, url: url)
+    }
+
+    open func style(image str: NSMutableAttributedString, title: String?, url: String?) {
+        style(image: str, in: str.wholeRange, title: title, url: url)
+    }
+
+    // MARK: - Range Styling
+
+    /// True only for `DownStyler` itself: a subclass may override the methods above without these, so
+    /// it styles each node on its own string unless it overrides this too.
+
+    open var stylesRangesInPlace: Bool {
+        return type(of: self) == DownStyler.self
+    }
+
+    open func style(document str: NSMutableAttributedString, in range: NSRange) {
+
+    }
+
+    open func style(blockQuote str: NSMutableAttributedString, in range: NSRange, nestDepth: Int) {
         let stripeAttribute = QuoteStripeAttribute(level: nestDepth + 1,
                                                    color: colors.quoteStripe,
                                                    options: quoteStripeOptions)
 
-        str.updateExistingAttributes(for: .paragraphStyle) { (style: NSParagraphStyle) in
+        str.updateExistingAttributes(for: .paragraphStyle, in: range) { (style: NSParagraphStyle) in
             style.indented(by: stripeAttribute.layoutWidth)
         }
 
-        str.addAttributeInMissingRanges(for: .quoteStripe, value: stripeAttribute)
-        str.addAttribute(for: .foregroundColor, value: colors.quote)
+        str.addAttributeInMissingRanges(for: .quoteStripe, value: stripeAttribute, within: range)
+        str.addAttribute(.foregroundColor, value: colors.quote, range: range)
     }
 
-    open func style(list str: NSMutableAttributedString, nestDepth: Int) {
+    open func style(list str: NSMutableAttributedString, in range: NSRange, nestDepth: Int) {
 
     }
 
-    open func style(listItemPrefix str: NSMutableAttributedString) {
-        str.setAttributes(listPrefixAttributes)
+    open func style(listItemPrefix str: NSMutableAttributedString, in range: NSRange) {
+        str.setAttributes(listPrefixAttributes, range: range)
     }
 
-    open func style(item str: NSMutableAttributedString, prefixLength: Int) {
-        let paragraphRanges = str.paragraphRanges()
+    open func style(item str: NSMutableAttributedString, in range: NSRange, prefixLength: Int) {
+        let paragraphRanges = str.paragraphRanges(in: range)
 
         guard let leadingParagraphRange = paragraphRanges.first else { return }
 
-        indentListItemLeadingParagraph(in: str, prefixLength: prefixLength, in: leadingParagraphRange)
+        indentListItemLeadingParagraph(in: str, itemRange: range, prefixLength: prefixLength, in: leadingParagraphRange)
 
         paragraphRanges.dropFirst().forEach {
             indentListItemTrailingParagraph(in: str, inRange: $0)
         }
     }
 
-    open func style(codeBlock str: NSMutableAttributedString, fenceInfo: String?) {
-        styleGenericCodeBlock(in: str)
+    open func style(codeBlock str: NSMutableAttributedString, in range: NSRange, fenceInfo: String?) {
+        styleGenericCodeBlock(in: str, range: range)
     }
 
-    open func style(htmlBlock str: NSMutableAttributedString) {
-        styleGenericCodeBlock(in: str)
+    open func style(htmlBlock str: NSMutableAttributedString, in range: NSRange) {
+        styleGenericCodeBlock(in: str, range: range)
     }
 
-    open func style(customBlock str: NSMutableAttributedString) {
+    open func style(customBlock str: NSMutableAttributedString, in range: NSRange) {
 
     }
 
-    open func style(paragraph str: NSMutableAttributedString) {
-        str.addAttribute(for: .paragraphStyle, value: paragraphStyles.body)
+    open func style(paragraph str: NSMutableAttributedString, in range: NSRange) {
+        str.addAttribute(.paragraphStyle, value: paragraphStyles.body, range: range)
     }
 
-    open func style(heading str: NSMutableAttributedString, level: Int) {
+    open func style(heading str: NSMutableAttributedString, in range: NSRange, level: Int) {
         let (font, color, paragraphStyle) = headingAttributes(for: level)
 
-        str.updateExistingAttributes(for: .font) { (currentFont: DownFont) in
+        str.updateExistingAttributes(for: .font, in: range) { (currentFont: DownFont) in
             var newFont = font
 
             if currentFont.isMonospace {
@@ -132,68 +225,68 @@ open class DownStyler: Styler {
 
         str.addAttributes([
             .foregroundColor: color,
-            .paragraphStyle: paragraphStyle])
+            .paragraphStyle: paragraphStyle], range: range)
     }
 
-    open func style(thematicBreak str: NSMutableAttributedString) {
+    open func style(thematicBreak str: NSMutableAttributedString, in range: NSRange) {
         let paragraphStyle = NSMutableParagraphStyle()
         paragraphStyle.firstLineHeadIndent = thematicBreakOptions.indentation
         let attr = ThematicBreakAttribute(thickness: thematicBreakOptions.thickness, color: colors.thematicBreak)
-        str.addAttribute(for: .thematicBreak, value: attr)
-        str.addAttribute(for: .paragraphStyle, value: paragraphStyle)
+        str.addAttribute(.thematicBreak, value: attr, range: range)
+        str.addAttribute(.paragraphStyle, value: paragraphStyle, range: range)
     }
 
-    open func style(text str: NSMutableAttributedString) {
+    open func style(text str: NSMutableAttributedString, in range: NSRange) {
         str.setAttributes([
             .font: fonts.body,
-            .foregroundColor: colors.body])
+            .foregroundColor: colors.body], range: range)
     }
 
-    open func style(softBreak str: NSMutableAttributedString) {
+    open func style(softBreak str: NSMutableAttributedString, in range: NSRange) {
 
     }
 
-    open func style(lineBreak str: NSMutableAttributedString) {
+    open func style(lineBreak str: NSMutableAttributedString, in range: NSRange) {
 
     }
 
-    open func style(code str: NSMutableAttributedString) {
-        styleGenericInlineCode(in: str)
+    open func style(code str: NSMutableAttributedString, in range: NSRange) {
+        styleGenericInlineCode(in: str, range: range)
     }
 
-    open func style(htmlInline str: NSMutableAttributedString) {
-        styleGenericInlineCode(in: str)
+    open func style(htmlInline str: NSMutableAttributedString, in range: NSRange) {
+        styleGenericInlineCode(in: str, range: range)
     }
 
-    open func style(customInline str: NSMutableAttributedString) {
+    open func style(customInline str: NSMutableAttributedString, in range: NSRange) {
 
     }
 
-    open func style(emphasis str: NSMutableAttributedString) {
-        str.updateExistingAttributes(for: .font) { (font: DownFont) in
+    open func style(emphasis str: NSMutableAttributedString, in range: NSRange) {
+        str.updateExistingAttributes(for: .font, in: range) { (font: DownFont) in
             font.emphasis
         }
     }
 
-    open func style(strong str: NSMutableAttributedString) {
-        str.updateExistingAttributes(for: .font) { (font: DownFont) in
+    open func style(strong str: NSMutableAttributedString, in range: NSRange) {
+        str.updateExistingAttributes(for: .font, in: range) { (font: DownFont) in
             font.strong
         }
     }
 
-    open func style(link str: NSMutableAttributedString, title: String?, url: String?) {
+    open func style(link str: NSMutableAttributedString, in range: NSRange, title: String?, url: String?) {
         guard let url = url else { return }
-        styleGenericLink(in: str, url: url)
+        styleGenericLink(in: str, range: range, url: url)
     }
 
-    open func style(image str: NSMutableAttributedString, title: String?, url: String?) {
+    open func style(image str: NSMutableAttributedString, in range: NSRange, title: String?, url: String?) {
         guard let url = url else { return }
-        styleGenericLink(in: str, url: url)
+        styleGenericLink(in: str, range: range, url: url)
     }
 
     // MARK: - Common Styling
 
-    private func styleGenericCodeBlock(in str: NSMutableAttributedString) {
+    private func styleGenericCodeBlock(in str: NSMutableAttributedString, range: NSRange) {
         let blockBackgroundAttribute = BlockBackgroundColorAttribute(
             color: colors.codeBlockBackground,
             inset: codeBlockOptions.containerInset)
@@ -204,19 +297,19 @@ open class DownStyler: Styler {
             .font: fonts.code,
             .foregroundColor: colors.code,
             .paragraphStyle: adjustedParagraphStyle,
-            .blockBackgroundColor: blockBackgroundAttribute])
+            .blockBackgroundColor: blockBackgroundAttribute], range: range)
     }
 
-    private func styleGenericInlineCode(in str: NSMutableAttributedString) {
+    private func styleGenericInlineCode(in str: NSMutableAttributedString, range: NSRange) {
         str.setAttributes([
             .font: fonts.code,
-            .foregroundColor: colors.code])
+            .foregroundColor: colors.code], range: range)
     }
 
-    private func styleGenericLink(in str: NSMutableAttributedString, url: String) {
+    private func styleGenericLink(in str: NSMutableAttributedString, range: NSRange, url: String) {
         str.addAttributes([
             .link: url,
-            .foregroundColor: colors.link])
+            .foregroundColor: colors.link], range: range)
     }
 
     // MARK: - Helpers
@@ -234,6 +327,7 @@ open class DownStyler: Styler {
     }
 
     private func indentListItemLeadingParagraph(in str: NSMutableAttributedString,
+                                                itemRange: NSRange,
                                                 prefixLength: Int,
                                                 in range: NSRange) {
 
@@ -241,7 +335,7 @@ open class DownStyler: Styler {
             existingStyle.indented(by: itemParagraphStyler.indentation)
         }
 
-        let attributedPrefix = str.prefix(with: prefixLength)
+        let attributedPrefix = str.prefix(with: prefixLength, in: itemRange)
         let prefixWidth = attributedPrefix.size().width
 
         let defaultStyle = itemParagraphStyler.leadingParagraphStyle(prefixWidth: prefixWidth)
@@ -297,10 +391,10 @@ private extension NSParagraphStyle {
 
 private extension NSAttributedString {
 
-    func prefix(with length: Int) -> NSAttributedString {
-        guard length <= self.length else { return self }
+    func prefix(with length: Int, in range: NSRange) -> NSAttributedString {
+        guard length <= range.length else { return attributedSubstring(from: range) }
         guard length > 0 else { return NSAttributedString() }
-        return attributedSubstring(from: NSRange(location: 0, length: length))
+        return attributedSubstring(from: NSRange(location: range.location, length: length))
     }
 
 }
@@ -16,8 +16,9 @@ import Foundation
 /// existing paragraph styles, as this can lead to visual bugs that are difficult to
 /// understand.
 ///
-/// A styler is used in conjunction with an instance of `AttributedStringVisitor` in order
-/// to generate an NSAttributedString from an abstract syntax tree.
+/// A styler is used in conjunction with `StyleRuns` or an instance of `AttributedStringVisitor`
+/// in order to generate an NSAttributedString from an abstract syntax tree. Either way it must
+/// not change the length of the strings it styles.
 
 public protocol Styler {
 
@@ -187,3 +188,41 @@ public protocol Styler {
     func style(image str: NSMutableAttributedString, title: String?, url: String?)
 
 }
+
+/// A styler that can style a range of a larger attributed string in place, as `Styler` styles a
+/// string holding just that range. `StyleRuns` uses it to style every node on the one string it
+/// builds, instead of styling a copy of each node's range and putting the copy back.
+///
+/// Each method must leave the attributes outside `range` as they are and style `range` exactly as
+/// the `Styler` method of the same name styles a string holding a copy of it.
+
+public protocol RangeStyler: Styler {
+
+    /// Whether the methods below style ranges as the `Styler` methods do. A subclass of a range
+    /// styler that overrides only `Styler` methods returns false, so its overrides are still used.
+
+    var stylesRangesInPlace: Bool { get }
+
+    func style(document str: NSMutableAttributedString, in range: NSRange)
+    func style(blockQuote str: NSMutableAttributedString, in range: NSRange, nestDepth: Int)
+    func style(list str: NSMutableAttributedString, in range: NSRange, nestDepth: Int)
+    func style(listItemPrefix str: NSMutableAttributedString, in range: NSRange)
+    func style(item str: NSMutableAttributedString, in range: NSRange, prefixLength: Int)
+    func style(codeBlock str: NSMutableAttributedString, in range: NSRange, fenceInfo: String?)
+    func style(htmlBlock str: NSMutableAttributedString, in range: NSRange)
+    func style(customBlock str: NSMutableAttributedString, in range: NSRange)
+    func style(paragraph str: NSMutableAttributedString, in range: NSRange)
+    func style(heading str: NSMutableAttributedString, in range: NSRange, level: Int)
+    func style(thematicBreak str: NSMutableAttributedString, in range: NSRange)
+    func style(text str: NSMutableAttributedString, in range: NSRange)
+    func style(softBreak str: NSMutableAttributedString, in range: NSRange)
+    func style(lineBreak str: NSMutableAttributedString, in range: NSRange)
+    func style(code str: NSMutableAttributedString, in range: NSRange)
+    func style(htmlInline str: NSMutableAttributedString, in range: NSRange)
+    func style(customInline str: NSMutableAttributedString, in range: NSRange)
+    func style(emphasis str: NSMutableAttributedString, in range: NSRange)
+    func style(strong str: NSMutableAttributedString, in range: NSRange)
+    func style(link str: NSMutableAttributedString, in range: NSRange, title: String?, url: String?)
+    func style(image str: NSMutableAttributedString, in range: NSRange, title: String?, url: String?)
+
+}
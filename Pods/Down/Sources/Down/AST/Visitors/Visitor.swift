@@ -65,6 +65,9 @@ extension Visitor {
             case let child as Strong:         return visit(strong: child)
             case let child as Link:           return visit(link: child)
             case let child as Image:          return visit(image: child)
+            // The GFM extensions are skipped, with their contents.
+            case is Table, is TableRow, is TableCell, is Strikethrough:
+                return nil
             default:
                 assertionFailure("Unexpected child")
                 return nil
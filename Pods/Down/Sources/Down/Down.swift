@@ -9,7 +9,8 @@
 import Foundation
 
 public struct Down: DownASTRenderable, DownHTMLRenderable, DownXMLRenderable,
-                    DownLaTeXRenderable, DownGroffRenderable, DownCommonMarkRenderable {
+                    DownLaTeXRenderable, DownGroffRenderable, DownCommonMarkRenderable,
+                    DownStyleRunsRenderable {
     /// A string containing CommonMark Markdown
     public var markdownString: String
 
@@ -69,10 +69,30 @@ public struct DownOptions: OptionSet {
 
     public static let smart = DownOptions(rawValue: CMARK_OPT_SMART)
 
+    /// Parse GitHub Flavored Markdown pipe tables.
+    ///
+    /// Note: `Visitor` skips table and strikethrough nodes along with their contents,
+    ///       and ignores task list checkboxes. Use the HTML or style run renderers, or
+    ///       inspect `Table`, `Strikethrough` and `Item.taskState` nodes directly.
+
+    public static let tables = DownOptions(rawValue: CMARK_OPT_TABLES)
+
+    /// Parse `~text~` and `~~text~~` as strikethrough.
+
+    public static let strikethrough = DownOptions(rawValue: CMARK_OPT_STRIKETHROUGH)
+
+    /// Parse `[ ]` and `[x]` at the start of list items as task checkboxes.
+
+    public static let taskLists = DownOptions(rawValue: CMARK_OPT_TASKLISTS)
+
     // MARK: - Combo Options
 
     /// Combines 'unsafe' and 'smart' to render raw HTML and produce smart typography.
 
     public static let smartUnsafe = DownOptions(rawValue: CMARK_OPT_SMART + CMARK_OPT_UNSAFE)
 
+    /// Combines 'tables', 'strikethrough' and 'taskLists'.
+
+    public static let gfm: DownOptions = [.tables, .strikethrough, .taskLists]
+
 }
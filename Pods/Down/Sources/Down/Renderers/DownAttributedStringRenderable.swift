@@ -47,9 +47,11 @@ extension DownAttributedStringRenderable {
 
     /// Generates an `NSAttributedString` from the `markdownString` property.
     ///
-    /// **Note:** The attributed string is constructed directly by traversing the abstract syntax tree. It is
-    /// much faster than the `toAttributedString(options: stylesheet)` method and it can be also be
-    /// rendered in a background thread.
+    /// **Note:** The attributed string is constructed directly from the abstract syntax tree: its text is
+    /// rendered into one string with style runs, which are then applied with the styler. It is much faster
+    /// than the `toAttributedString(options: stylesheet)` method and it can be also be rendered in a
+    /// background thread. The result is the one `AttributedStringVisitor` builds, except that tables and
+    /// strikethrough, which the visitor leaves out, are included.
     ///
     /// - Parameters:
     ///     - options: `DownOptions` to modify parsing or rendering.
@@ -63,6 +65,15 @@ extension DownAttributedStringRenderable {
     ///     `DownErrors` depending on the scenario.
 
     public func toAttributedString(_ options: DownOptions = .default, styler: Styler) throws -> NSAttributedString {
+        let ast = try DownASTRenderer.stringToAST(markdownString, options: options)
+        defer { cmark_node_free(ast) }
+        let styleRuns = try DownStyleRunsRenderer.astToStyleRuns(ast, options: options)
+
+        if let result = try? styleRuns.attributedString(styler: styler) {
+            return result
+        }
+
+        // The styler changed the length of a string; only joining per node keeps up with that.
         let document = try self.toDocument(options)
         let visitor = AttributedStringVisitor(styler: styler, options: options)
         return document.accept(visitor)
@@ -0,0 +1,259 @@
+//
+//  DownStyleRunsRenderable.swift
+//  Down
+//
+
+import Foundation
+import libcmark
+
+public protocol DownStyleRunsRenderable: DownRenderable {
+
+    func toStyleRuns(_ options: DownOptions) throws -> StyleRuns
+
+}
+
+extension DownStyleRunsRenderable {
+
+    /// Generates plain text and style runs from the `markdownString` property.
+    ///
+    /// - Parameters:
+    ///     - options: `DownOptions` to modify parsing or rendering, defaulting to `.default`.
+    ///
+    /// - Returns:
+    ///     The rendered text and the runs describing how to style it.
+    ///
+    /// - Throws:
+    ///     `DownErrors` depending on the scenario.
+
+    public func toStyleRuns(_ options: DownOptions = .default) throws -> StyleRuns {
+        let ast = try DownASTRenderer.stringToAST(markdownString, options: options)
+        defer { cmark_node_free(ast) }
+        return try DownStyleRunsRenderer.astToStyleRuns(ast, options: options)
+    }
+
+}
+
+/// The output of the style run renderer: the same text `AttributedStringVisitor` would produce, and a
+/// flat list of styled ranges in that text. Building an attributed string from `string` once and applying
+/// `runs` in reverse order styles every node before its ancestors, as the visitor does, without joining
+/// intermediate strings.
+
+public struct StyleRuns {
+
+    public let string: String
+    public let runs: [StyleRun]
+
+}
+
+public struct StyleRun {
+
+    public enum Kind: Equatable {
+        case node(cmark_node_type)
+        case listItemPrefix
+    }
+
+    /// The range in `StyleRuns.string`, in UTF-16 code units.
+
+    public let range: NSRange
+    public let kind: Kind
+
+    /// The zero indexed number of ancestors of the same type.
+
+    public let nestDepth: Int
+
+    /// The heading level for headings, the prefix length for list items and prefixes, the number of
+    /// columns for tables, 1 for header rows, the column for table cells, 0 otherwise.
+
+    public let payload: Int
+
+    /// The fence info for code blocks, the url and title for links and images.
+
+    public let fenceInfo: String?
+    public let url: String?
+    public let title: String?
+
+}
+
+public struct DownStyleRunsRenderer {
+
+    /// Generates plain text and style runs from the given abstract syntax tree.
+    ///
+    /// **Note:** caller is responsible for calling `cmark_node_free(ast)` after this returns.
+    ///
+    /// - Parameters:
+    ///     - ast: The `cmark_node` representing the abstract syntax tree.
+    ///     - options: `DownOptions` to modify parsing or rendering, defaulting to `.default`.
+    ///
+    /// - Returns:
+    ///     The rendered text and the runs describing how to style it.
+    ///
+    /// - Throws:
+    ///     `ASTRenderingError` if the AST could not be converted.
+
+    public static func astToStyleRuns(_ ast: CMarkNode, options: DownOptions = .default) throws -> StyleRuns {
+        guard let result = cmark_render_style_runs(ast, options.rawValue) else {
+            throw DownErrors.astRenderingError
+        }
+
+        defer {
+            cmark_style_runs_free(result)
+        }
+
+        guard let string = String(cString: result.pointee.text, encoding: String.Encoding.utf8) else {
+            throw DownErrors.astRenderingError
+        }
+
+        let buffer = UnsafeBufferPointer(start: result.pointee.runs, count: result.pointee.nruns)
+        let runs = buffer.map { run -> StyleRun in
+            let isPrefix = run.style == UInt16(CMARK_STYLE_LIST_ITEM_PREFIX.rawValue)
+            let type = cmark_node_type(rawValue: UInt32(run.style))
+            let node = run.node!
+
+            return StyleRun(
+                range: NSRange(location: Int(run.location), length: Int(run.length)),
+                kind: isPrefix ? .listItemPrefix : .node(type),
+                nestDepth: Int(run.nest_depth),
+                payload: Int(run.payload),
+                fenceInfo: !isPrefix && type == CMARK_NODE_CODE_BLOCK ? node.fenceInfo : nil,
+                url: !isPrefix && (type == CMARK_NODE_LINK || type == CMARK_NODE_IMAGE) ? node.url : nil,
+                title: !isPrefix && (type == CMARK_NODE_LINK || type == CMARK_NODE_IMAGE) ? node.title : nil
+            )
+        }
+
+        return StyleRuns(string: string, runs: runs)
+    }
+
+}
+
+#if !os(Linux)
+
+// MARK: - Styling
+
+extension StyleRuns {
+
+    /// Builds the attributed string `AttributedStringVisitor` builds with `styler`, from `string` at once.
+    ///
+    /// Runs are applied in reverse, so every node is styled after the nodes inside it. A `RangeStyler`
+    /// styles each run's range in place; any other styler is given a copy of just the range, as the
+    /// visitor would pass it, which then replaces the range again. Strikethrough, which `Styler` has no
+    /// method for, is struck through; tables are left as laid out text.
+    ///
+    /// - Parameters:
+    ///     - styler: a class/struct conforming to `Styler` to use when rendering the various
+    ///       elements of the attributed string
+    ///
+    /// - Returns:
+    ///     An `NSMutableAttributedString`.
+    ///
+    /// - Throws:
+    ///     `DownErrors.astRenderingError` if the styler changes the length of a string it styles, which
+    ///     the runs after it can't account for.
+
+    public func attributedString(styler: Styler) throws -> NSMutableAttributedString {
+        let result = NSMutableAttributedString(string: string)
+
+        if let styler = styler as? RangeStyler, styler.stylesRangesInPlace {
+            for run in runs.reversed() {
+                run.apply(styler: styler, to: result)
+            }
+
+            guard result.length == (string as NSString).length else {
+                throw DownErrors.astRenderingError
+            }
+
+            return result
+        }
+
+        for run in runs.reversed() {
+            let isWhole = run.range.location == 0 && run.range.length == result.length
+            let target = isWhole ? result : NSMutableAttributedString(attributedString: result.attributedSubstring(from: run.range))
+            run.apply(styler: styler, to: target)
+
+            guard target.length == run.range.length else {
+                throw DownErrors.astRenderingError
+            }
+
+            if !isWhole {
+                result.replaceCharacters(in: run.range, with: target)
+            }
+        }
+
+        return result
+    }
+
+}
+
+private extension StyleRun {
+
+    func apply(styler: Styler, to str: NSMutableAttributedString) {
+        guard case .node(let type) = kind else {
+            styler.style(listItemPrefix: str)
+            return
+        }
+
+        switch type {
+        case CMARK_NODE_DOCUMENT:       styler.style(document: str)
+        case CMARK_NODE_BLOCK_QUOTE:    styler.style(blockQuote: str, nestDepth: nestDepth)
+        case CMARK_NODE_LIST:           styler.style(list: str, nestDepth: nestDepth)
+        case CMARK_NODE_ITEM:           styler.style(item: str, prefixLength: payload)
+        case CMARK_NODE_CODE_BLOCK:     styler.style(codeBlock: str, fenceInfo: fenceInfo)
+        case CMARK_NODE_HTML_BLOCK:     styler.style(htmlBlock: str)
+        case CMARK_NODE_CUSTOM_BLOCK:   styler.style(customBlock: str)
+        case CMARK_NODE_PARAGRAPH:      styler.style(paragraph: str)
+        case CMARK_NODE_HEADING:        styler.style(heading: str, level: payload)
+        case CMARK_NODE_THEMATIC_BREAK: styler.style(thematicBreak: str)
+        case CMARK_NODE_TEXT:           styler.style(text: str)
+        case CMARK_NODE_SOFTBREAK:      styler.style(softBreak: str)
+        case CMARK_NODE_LINEBREAK:      styler.style(lineBreak: str)
+        case CMARK_NODE_CODE:           styler.style(code: str)
+        case CMARK_NODE_HTML_INLINE:    styler.style(htmlInline: str)
+        case CMARK_NODE_CUSTOM_INLINE:  styler.style(customInline: str)
+        case CMARK_NODE_EMPH:           styler.style(emphasis: str)
+        case CMARK_NODE_STRONG:         styler.style(strong: str)
+        case CMARK_NODE_LINK:           styler.style(link: str, title: title, url: url)
+        case CMARK_NODE_IMAGE:          styler.style(image: str, title: title, url: url)
+        case CMARK_NODE_STRIKETHROUGH:
+            str.addAttribute(.strikethroughStyle, value: NSUnderlineStyle.single.rawValue,
+                             range: NSRange(location: 0, length: str.length))
+        default:
+            break
+        }
+    }
+
+    func apply(styler: RangeStyler, to str: NSMutableAttributedString) {
+        guard case .node(let type) = kind else {
+            styler.style(listItemPrefix: str, in: range)
+            return
+        }
+
+        switch type {
+        case CMARK_NODE_DOCUMENT:       styler.style(document: str, in: range)
+        case CMARK_NODE_BLOCK_QUOTE:    styler.style(blockQuote: str, in: range, nestDepth: nestDepth)
+        case CMARK_NODE_LIST:           styler.style(list: str, in: range, nestDepth: nestDepth)
+        case CMARK_NODE_ITEM:           styler.style(item: str, in: range, prefixLength: payload)
+        case CMARK_NODE_CODE_BLOCK:     styler.style(codeBlock: str, in: range, fenceInfo: fenceInfo)
+        case CMARK_NODE_HTML_BLOCK:     styler.style(htmlBlock: str, in: range)
+        case CMARK_NODE_CUSTOM_BLOCK:   styler.style(customBlock: str, in: range)
+        case CMARK_NODE_PARAGRAPH:      styler.style(paragraph: str, in: range)
+        case CMARK_NODE_HEADING:        styler.style(heading: str, in: range, level: payload)
+        case CMARK_NODE_THEMATIC_BREAK: styler.style(thematicBreak: str, in: range)
+        case CMARK_NODE_TEXT:           styler.style(text: str, in: range)
+        case CMARK_NODE_SOFTBREAK:      styler.style(softBreak: str, in: range)
+        case CMARK_NODE_LINEBREAK:      styler.style(lineBreak: str, in: range)
+        case CMARK_NODE_CODE:           styler.style(code: str, in: range)
+        case CMARK_NODE_HTML_INLINE:    styler.style(htmlInline: str, in: range)
+        case CMARK_NODE_CUSTOM_INLINE:  styler.style(customInline: str, in: range)
+        case CMARK_NODE_EMPH:           styler.style(emphasis: str, in: range)
+        case CMARK_NODE_STRONG:         styler.style(strong: str, in: range)
+        case CMARK_NODE_LINK:           styler.style(link: str, in: range, title: title, url: url)
+        case CMARK_NODE_IMAGE:          styler.style(image: str, in: range, title: title, url: url)
+        case CMARK_NODE_STRIKETHROUGH:
+            str.addAttribute(.strikethroughStyle, value: NSUnderlineStyle.single.rawValue, range: range)
+        default:
+            break
+        }
+    }
+
+}
+
+#endif // !os(Linux)
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "cmark_ctype.h"
 #include "config.h"
@@ -20,6 +21,7 @@
 #include "inlines.h"
 #include "houdini.h"
 #include "buffer.h"
+#include "simd.h"
 
 #define CODE_INDENT 4
 #define TAB_STOP 4
@@ -112,6 +114,13 @@ cmark_parser *cmark_parser_new_with_mem(int options, cmark_mem *mem) {
   parser->last_line_length = 0;
   parser->options = options;
   parser->last_buffer_ended_with_cr = false;
+  parser->total_size = 0;
+  parser->checkpoint_block = NULL;
+  parser->checkpoint_blocks = 0;
+  parser->resume_block = NULL;
+  parser->resume_blocks = 0;
+
+  document->as.document.options = options;
 
   return parser;
 }
@@ -168,7 +177,8 @@ static CMARK_INLINE bool accepts_lines(cmark_node_type block_type) {
 
 static CMARK_INLINE bool contains_inlines(cmark_node_type block_type) {
   return (block_type == CMARK_NODE_PARAGRAPH ||
-          block_type == CMARK_NODE_HEADING);
+          block_type == CMARK_NODE_HEADING ||
+          block_type == CMARK_NODE_TABLE_CELL);
 }
 
 static void add_line(cmark_node *node, cmark_chunk *ch, cmark_parser *parser) {
@@ -383,6 +393,294 @@ static cmark_node *add_child(cmark_parser *parser, cmark_node *parent,
   return child;
 }
 
+// Widens the column of a table cell whose inlines have just been parsed
+// to fit the cell's text, so a table's column metrics are ready once the
+// document is.
+static void S_measure_table_cell(cmark_node *cell) {
+  cmark_node *table = cell->parent ? cell->parent->parent : NULL;
+  cmark_table_column *column;
+  cmark_node *cur = cell->first_child;
+  int32_t utf16_width = 0, display_width = 0;
+
+  if (table == NULL || S_type(table) != CMARK_NODE_TABLE ||
+      cell->as.table_cell_column >= table->as.table.n_columns) {
+    return;
+  }
+
+  while (cur != NULL) {
+    switch (S_type(cur)) {
+    case CMARK_NODE_TEXT:
+    case CMARK_NODE_CODE:
+    case CMARK_NODE_HTML_INLINE:
+      cmark_utf8proc_measure(cur->as.literal.data, cur->as.literal.len,
+                             &utf16_width, &display_width);
+      break;
+    default:
+      break;
+    }
+    if (cur->first_child) {
+      cur = cur->first_child;
+      continue;
+    }
+    while (cur != cell && cur->next == NULL) {
+      cur = cur->parent;
+    }
+    cur = cur == cell ? NULL : cur->next;
+  }
+
+  column = &table->as.table.columns[cell->as.table_cell_column];
+  if (utf16_width > column->utf16_width) {
+    column->utf16_width = utf16_width;
+  }
+  if (display_width > column->display_width) {
+    column->display_width = display_width;
+  }
+}
+
+// Scans the cell of a table row starting at '*pos' and ending at the next
+// unescaped pipe or at 'end', and moves '*pos' past the pipe.  Returns
+// false if there is no cell left, which is also the case after a trailing
+// pipe.
+static bool S_next_table_cell(const unsigned char *data, bufsize_t end,
+                              bufsize_t *pos, bufsize_t *cell_start,
+                              bufsize_t *cell_end) {
+  bufsize_t i = *pos;
+
+  if (i >= end) {
+    return false;
+  }
+  while (i < end && data[i] != '|') {
+    if (data[i] == '\\' && i + 1 < end) {
+      i++;
+    }
+    i++;
+  }
+  *cell_start = *pos;
+  *cell_end = i;
+  *pos = i < end ? i + 1 : i;
+
+  while (*cell_start < *cell_end && S_is_space_or_tab(data[*cell_start])) {
+    (*cell_start)++;
+  }
+  while (*cell_end > *cell_start && S_is_space_or_tab(data[*cell_end - 1])) {
+    (*cell_end)--;
+  }
+  return true;
+}
+
+// Narrows [*start, *end) to the row between its surrounding whitespace and
+// an optional leading pipe.
+static void S_trim_table_row(const unsigned char *data, bufsize_t *start,
+                             bufsize_t *end) {
+  while (*start < *end && S_is_space_or_tab(data[*start])) {
+    (*start)++;
+  }
+  while (*end > *start && (S_is_space_or_tab(data[*end - 1]) ||
+                           S_is_line_end_char(data[*end - 1]))) {
+    (*end)--;
+  }
+  if (*start < *end && data[*start] == '|') {
+    (*start)++;
+  }
+}
+
+static int S_count_table_cells(const unsigned char *data, bufsize_t start,
+                               bufsize_t end) {
+  bufsize_t cell_start, cell_end;
+  int count = 0;
+
+  S_trim_table_row(data, &start, &end);
+  while (S_next_table_cell(data, end, &start, &cell_start, &cell_end)) {
+    count++;
+  }
+  return count;
+}
+
+// Checks for a table delimiter row such as `| :--- | ---: |`: cells of
+// hyphens with optional alignment colons, with at least one pipe on the
+// line so that a setext heading underline is never one.  Returns the
+// number of columns, or 0, and fills in their alignments if 'columns' is
+// given.
+static int S_scan_table_delimiter_row(const unsigned char *data,
+                                      bufsize_t start, bufsize_t end,
+                                      cmark_table_column *columns) {
+  bufsize_t cell_start, cell_end, i;
+  bool has_pipe = false, left, right;
+  int count = 0;
+
+  for (i = start; i < end; i++) {
+    if (data[i] == '|') {
+      has_pipe = true;
+    } else if (data[i] != '-' && data[i] != ':' &&
+               !S_is_space_or_tab(data[i]) && !S_is_line_end_char(data[i])) {
+      return 0;
+    }
+  }
+  if (!has_pipe) {
+    return 0;
+  }
+
+  S_trim_table_row(data, &start, &end);
+  while (S_next_table_cell(data, end, &start, &cell_start, &cell_end)) {
+    left = cell_start < cell_end && data[cell_start] == ':';
+    right = cell_end - cell_start > left && data[cell_end - 1] == ':';
+    if (cell_end - cell_start - left - right < 1) {
+      return 0;
+    }
+    for (i = cell_start + left; i < cell_end - right; i++) {
+      if (data[i] != '-') {
+        return 0;
+      }
+    }
+    if (columns) {
+      columns[count].alignment =
+          left && right ? CMARK_TABLE_ALIGN_CENTER
+                        : left ? CMARK_TABLE_ALIGN_LEFT
+                               : right ? CMARK_TABLE_ALIGN_RIGHT
+                                       : CMARK_TABLE_ALIGN_NONE;
+      columns[count].utf16_width = 0;
+      columns[count].display_width = 0;
+    }
+    count++;
+  }
+  return count;
+}
+
+static cmark_node *S_make_table_node(cmark_mem *mem, cmark_node_type type,
+                                    int line, int start_column,
+                                    int end_column) {
+  cmark_node *node = make_block(mem, type, line, start_column);
+  node->flags = 0; // rows and cells are complete when they are made
+  node->end_line = line;
+  node->end_column = end_column;
+  return node;
+}
+
+// Makes a row of 'n_columns' cells from the line [start, end) of 'data',
+// dropping excess cells and padding missing ones.  Each cell holds its
+// trimmed text, with `\|` unescaped, for inline parsing; 'column_offset'
+// is the source column of data[0], less one.
+static cmark_node *S_make_table_row(cmark_parser *parser,
+                                    const unsigned char *data,
+                                    bufsize_t start, bufsize_t end, int line,
+                                    int column_offset, int n_columns,
+                                    bool header) {
+  cmark_node *row, *cell;
+  bufsize_t cell_start, cell_end, i;
+  int column = 0;
+
+  S_trim_table_row(data, &start, &end);
+  row = S_make_table_node(parser->mem, CMARK_NODE_TABLE_ROW, line,
+                          column_offset + start + 1, column_offset + end);
+  row->as.table_row_header = header;
+
+  while (column < n_columns &&
+         S_next_table_cell(data, end, &start, &cell_start, &cell_end)) {
+    cell = S_make_table_node(parser->mem, CMARK_NODE_TABLE_CELL, line,
+                             column_offset + cell_start + 1,
+                             column_offset + cell_end);
+    cell->as.table_cell_column = (uint16_t)column++;
+    for (i = cell_start; i < cell_end; i++) {
+      if (data[i] == '\\' && i + 1 < cell_end && data[i + 1] == '|') {
+        continue;
+      }
+      cmark_strbuf_putc(&cell->content, data[i]);
+    }
+    cmark_node_append_child(row, cell);
+  }
+  while (column < n_columns) {
+    cell = S_make_table_node(parser->mem, CMARK_NODE_TABLE_CELL, line,
+                             row->end_column + 1, row->end_column);
+    cell->as.table_cell_column = (uint16_t)column++;
+    cmark_node_append_child(row, cell);
+  }
+  return row;
+}
+
+// Turns the last line of an open paragraph into the header row of a table
+// if the current line is a delimiter row with as many cells.  Earlier lines
+// stay a paragraph, which is closed.  Returns the table, or NULL.
+static cmark_node *S_try_open_table(cmark_parser *parser,
+                                    cmark_node *paragraph,
+                                    cmark_chunk *input) {
+  cmark_strbuf *content = &paragraph->content;
+  cmark_table_column *columns;
+  cmark_node *table, *header;
+  bufsize_t header_start, header_end;
+  int n_columns, line = parser->line_number - 1;
+
+  n_columns = S_scan_table_delimiter_row(input->data, parser->first_nonspace,
+                                         input->len, NULL);
+  if (n_columns == 0 || n_columns > UINT16_MAX ||
+      !resolve_reference_link_definitions(parser, paragraph)) {
+    return NULL;
+  }
+
+  header_end = content->size;
+  while (header_end > 0 && S_is_line_end_char(content->ptr[header_end - 1])) {
+    header_end--;
+  }
+  header_start = header_end;
+  while (header_start > 0 &&
+         !S_is_line_end_char(content->ptr[header_start - 1])) {
+    header_start--;
+  }
+  if (S_count_table_cells(content->ptr, header_start, header_end) !=
+      n_columns) {
+    return NULL;
+  }
+
+  columns = (cmark_table_column *)parser->mem->calloc(
+      n_columns, sizeof(cmark_table_column));
+  S_scan_table_delimiter_row(input->data, parser->first_nonspace, input->len,
+                             columns);
+  header = S_make_table_row(parser, content->ptr, header_start, header_end,
+                            line, paragraph->start_column - 1 - header_start,
+                            n_columns, true);
+
+  if (header_start > 0) {
+    cmark_strbuf_truncate(content, header_start);
+    table = add_child(parser, paragraph, CMARK_NODE_TABLE,
+                      paragraph->start_column);
+    table->start_line = line;
+    paragraph->end_line = line - 1;
+  } else {
+    table = paragraph;
+    table->type = (uint16_t)CMARK_NODE_TABLE;
+    cmark_strbuf_clear(content);
+  }
+  table->as.table.n_columns = (uint16_t)n_columns;
+  table->as.table.columns = columns;
+  cmark_node_append_child(table, header);
+  return table;
+}
+
+// Adds a line of an open table as a row.  A row continues the table until
+// a blank line or the start of another block, even without any pipe.
+static void S_add_table_row(cmark_parser *parser, cmark_node *table,
+                            cmark_chunk *input) {
+  cmark_node *row =
+      S_make_table_row(parser, input->data, parser->first_nonspace,
+                       input->len, parser->line_number, 0,
+                       table->as.table.n_columns, false);
+  cmark_node_append_child(table, row);
+}
+
+// Checks for a task list marker, `[ ]`, `[x]` or `[X]` followed by
+// whitespace, at the start of a list item's first line.  Returns its
+// length, or 0.
+static bufsize_t S_scan_task_marker(cmark_chunk *input, bufsize_t pos) {
+  if (pos + 3 < input->len && peek_at(input, pos) == '[' &&
+      (peek_at(input, pos + 1) == ' ' || peek_at(input, pos + 1) == 'x' ||
+       peek_at(input, pos + 1) == 'X') &&
+      peek_at(input, pos + 2) == ']' &&
+      (S_is_space_or_tab(peek_at(input, pos + 3)) ||
+       S_is_line_end_char(peek_at(input, pos + 3)))) {
+    return 3;
+  }
+  return 0;
+}
+
 // Walk through node and all children, recursively, parsing
 // string content into inline content where appropriate.
 static void process_inlines(cmark_mem *mem, cmark_node *root,
@@ -396,6 +694,9 @@ static void process_inlines(cmark_mem *mem, cmark_node *root,
     if (ev_type == CMARK_EVENT_ENTER) {
       if (contains_inlines(S_type(cur))) {
         cmark_parse_inlines(mem, cur, refmap, options);
+        if (S_type(cur) == CMARK_NODE_TABLE_CELL) {
+          S_measure_table_cell(cur);
+        }
       }
     }
   }
@@ -500,13 +801,35 @@ static int lists_match(cmark_list *list_data, cmark_list *item_data) {
           list_data->bullet_char == item_data->bullet_char);
 }
 
+// The first top-level block not moved in by cmark_parser_resume.
+static cmark_node *S_first_new_block(cmark_parser *parser) {
+  return parser->resume_block ? parser->resume_block->next
+                              : parser->root->first_child;
+}
+
 static cmark_node *finalize_document(cmark_parser *parser) {
+  cmark_document *doc = &parser->root->as.document;
+  cmark_node *block;
+  int index = parser->resume_blocks;
+
   while (parser->current != parser->root) {
     parser->current = finalize(parser, parser->current);
   }
 
   finalize(parser, parser->root);
-  process_inlines(parser->mem, parser->root, parser->refmap, parser->options);
+
+  // Reused blocks already have their inlines.  Going block by block finds
+  // the first one with an unresolved reference link, which a definition
+  // added later could resolve, so no edit can resume after it.
+  doc->first_unresolved = INT_MAX;
+  for (block = S_first_new_block(parser); block; block = block->next) {
+    unsigned int misses = parser->refmap->misses;
+    process_inlines(parser->mem, block, parser->refmap, parser->options);
+    if (parser->refmap->misses != misses && doc->first_unresolved == INT_MAX)
+      doc->first_unresolved = index;
+    index++;
+  }
+  doc->has_references = parser->refmap->size > 0;
 
   return parser->root;
 }
@@ -545,8 +868,121 @@ void cmark_parser_feed(cmark_parser *parser, const char *buffer, size_t len) {
   S_parser_feed(parser, (const unsigned char *)buffer, len, false);
 }
 
+cmark_parser *cmark_parser_resume(cmark_node *document, size_t offset,
+                                  int options) {
+  cmark_parser *parser =
+      cmark_parser_new_with_mem(options, cmark_node_mem(document));
+  cmark_document *old = &document->as.document;
+  cmark_document *doc = &parser->root->as.document;
+  cmark_checkpoint checkpoint;
+  int low = 0, high, i;
+
+  if (S_type(document) != CMARK_NODE_DOCUMENT || old->options != options ||
+      old->has_references)
+    return parser;
+
+  // The last checkpoint at or before 'offset'...
+  high = old->n_checkpoints;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (old->checkpoints[mid].offset <= offset)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  // ...with every reference link before it resolved.
+  while (low > 0 && old->checkpoints[low - 1].blocks > old->first_unresolved)
+    low--;
+  if (low == 0)
+    return parser;
+
+  checkpoint = old->checkpoints[low - 1];
+  for (i = 0; i < checkpoint.blocks; i++) {
+    cmark_node *block = document->first_child;
+    if (block == NULL)
+      break;
+    cmark_node_unlink(block);
+    cmark_node_append_child(parser->root, block);
+  }
+
+  doc->checkpoints_size = low;
+  doc->n_checkpoints = low;
+  doc->checkpoints = (cmark_checkpoint *)parser->mem->calloc(
+      low, sizeof(cmark_checkpoint));
+  memcpy(doc->checkpoints, old->checkpoints, low * sizeof(cmark_checkpoint));
+
+  // 'document' lost its first blocks, so its checkpoints are stale.
+  parser->mem->free(old->checkpoints);
+  old->checkpoints = NULL;
+  old->n_checkpoints = 0;
+  old->checkpoints_size = 0;
+
+  parser->line_number = checkpoint.line_number;
+  parser->last_line_length = checkpoint.last_line_length;
+  parser->total_size = checkpoint.offset;
+  parser->checkpoint_block = parser->resume_block = parser->root->last_child;
+  parser->checkpoint_blocks = parser->resume_blocks = checkpoint.blocks;
+
+  return parser;
+}
+
+size_t cmark_parser_get_input_offset(cmark_parser *parser) {
+  return parser->total_size;
+}
+
+cmark_node *cmark_reparse_document(cmark_node *document, size_t unchanged,
+                                   const char *buffer, size_t len,
+                                   int options) {
+  cmark_parser *parser = cmark_parser_resume(
+      document, unchanged < len ? unchanged : len, options);
+  size_t resumed = parser->total_size;
+  cmark_node *result;
+
+  S_parser_feed(parser, (const unsigned char *)buffer + resumed,
+                len - resumed, true);
+
+  result = cmark_parser_finish(parser);
+  cmark_parser_free(parser);
+  return result;
+}
+
+// Records that the line starting at input 'offset' is parsed from scratch:
+// no block but the document is open.
+static void S_add_checkpoint(cmark_parser *parser, size_t offset) {
+  cmark_document *doc = &parser->root->as.document;
+  cmark_node *block = parser->checkpoint_block
+                          ? parser->checkpoint_block->next
+                          : parser->root->first_child;
+  cmark_checkpoint *checkpoint;
+
+  for (; block; block = block->next) {
+    parser->checkpoint_block = block;
+    parser->checkpoint_blocks++;
+  }
+
+  // Blank lines between blocks only move the same checkpoint along.
+  if (doc->n_checkpoints > 0 &&
+      doc->checkpoints[doc->n_checkpoints - 1].blocks ==
+          parser->checkpoint_blocks)
+    return;
+
+  if (doc->n_checkpoints == doc->checkpoints_size) {
+    doc->checkpoints_size = doc->checkpoints_size ? doc->checkpoints_size * 2
+                                                  : 16;
+    doc->checkpoints = (cmark_checkpoint *)parser->mem->realloc(
+        doc->checkpoints, doc->checkpoints_size * sizeof(cmark_checkpoint));
+  }
+
+  checkpoint = &doc->checkpoints[doc->n_checkpoints++];
+  checkpoint->offset = offset;
+  checkpoint->line_number = parser->line_number;
+  checkpoint->last_line_length = parser->last_line_length;
+  checkpoint->blocks = parser->checkpoint_blocks;
+}
+
 static void S_parser_feed(cmark_parser *parser, const unsigned char *buffer,
                           size_t len, bool eof) {
+  const unsigned char *start = buffer;
   const unsigned char *end = buffer + len;
   static const uint8_t repl[] = {239, 191, 189};
 
@@ -559,7 +995,12 @@ static void S_parser_feed(cmark_parser *parser, const unsigned char *buffer,
     const unsigned char *eol;
     bufsize_t chunk_len;
     bool process = false;
-    for (eol = buffer; eol < end; ++eol) {
+    eol = buffer;
+#ifdef CMARK_SIMD
+    eol += cmark_simd_span_excluding(buffer, (bufsize_t)(end - buffer),
+                                     "\n\r\0", 3);
+#endif
+    for (; eol < end; ++eol) {
       if (S_is_line_end_char(*eol)) {
         process = true;
         break;
@@ -604,11 +1045,17 @@ static void S_parser_feed(cmark_parser *parser, const unsigned char *buffer,
           if (buffer == end)
             parser->last_buffer_ended_with_cr = true;
         }
-        if (buffer < end && *buffer == '\n')
+        // A lone CR could turn into CRLF when the text is edited.
+        if (buffer < end && *buffer == '\n') {
           buffer++;
+          if (process && parser->current == parser->root)
+            S_add_checkpoint(parser, parser->total_size + (buffer - start));
+        }
       }
     }
   }
+
+  parser->total_size += len;
 }
 
 static void chop_trailing_hashtags(cmark_chunk *ch) {
@@ -886,6 +1333,7 @@ static cmark_node *check_open_blocks(cmark_parser *parser, cmark_chunk *input,
         goto done;
       break;
     case CMARK_NODE_PARAGRAPH:
+    case CMARK_NODE_TABLE:
       if (parser->blank)
         goto done;
       break;
@@ -920,6 +1368,7 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
   bool has_content;
   int save_offset;
   int save_column;
+  cmark_node *table;
 
   while (cont_type != CMARK_NODE_CODE_BLOCK &&
          cont_type != CMARK_NODE_HTML_BLOCK) {
@@ -987,6 +1436,11 @@ static void open_new_blocks(cmark_parser *parser, cmark_node **container,
       (*container)->as.html_block_type = matched;
       // note, we don't adjust parser->offset because the tag is part of the
       // text
+    } else if (!indented && cont_type == CMARK_NODE_PARAGRAPH &&
+               (parser->options & CMARK_OPT_TABLES) &&
+               (table = S_try_open_table(parser, *container, input))) {
+      *container = table;
+      S_advance_offset(parser, input, input->len - 1 - parser->offset, false);
     } else if (!indented && cont_type == CMARK_NODE_PARAGRAPH &&
                (lev =
                     scan_setext_heading_line(input, parser->first_nonspace))) {
@@ -1094,6 +1548,7 @@ static void add_text_to_container(cmark_parser *parser, cmark_node *container,
                                   cmark_node *last_matched_container,
                                   cmark_chunk *input) {
   cmark_node *tmp;
+  bufsize_t matched;
   // what remains at parser->offset is a text line.  add the text to the
   // appropriate container.
 
@@ -1110,6 +1565,7 @@ static void add_text_to_container(cmark_parser *parser, cmark_node *container,
   const bool last_line_blank =
       (parser->blank && ctype != CMARK_NODE_BLOCK_QUOTE &&
        ctype != CMARK_NODE_HEADING && ctype != CMARK_NODE_THEMATIC_BREAK &&
+       ctype != CMARK_NODE_TABLE &&
        !(ctype == CMARK_NODE_CODE_BLOCK && container->as.code.fenced) &&
        !(ctype == CMARK_NODE_ITEM && container->first_child == NULL &&
          container->start_line == parser->line_number));
@@ -1182,6 +1638,8 @@ static void add_text_to_container(cmark_parser *parser, cmark_node *container,
       }
     } else if (parser->blank) {
       // ??? do nothing
+    } else if (S_type(container) == CMARK_NODE_TABLE) {
+      S_add_table_row(parser, container, input);
     } else if (accepts_lines(S_type(container))) {
       if (S_type(container) == CMARK_NODE_HEADING &&
           container->as.heading.setext == false) {
@@ -1191,12 +1649,28 @@ static void add_text_to_container(cmark_parser *parser, cmark_node *container,
                        false);
       add_line(container, input, parser);
     } else {
-      // create paragraph container for line
-      container = add_child(parser, container, CMARK_NODE_PARAGRAPH,
-                            parser->first_nonspace + 1);
-      S_advance_offset(parser, input, parser->first_nonspace - parser->offset,
-                       false);
-      add_line(container, input, parser);
+      if ((parser->options & CMARK_OPT_TASKLISTS) &&
+          S_type(container) == CMARK_NODE_ITEM &&
+          container->first_child == NULL &&
+          container->start_line == parser->line_number &&
+          (matched = S_scan_task_marker(input, parser->first_nonspace))) {
+        container->as.list.task =
+            peek_at(input, parser->first_nonspace + 1) == ' '
+                ? CMARK_TASK_UNCHECKED
+                : CMARK_TASK_CHECKED;
+        S_advance_offset(parser, input,
+                         parser->first_nonspace + matched - parser->offset,
+                         false);
+        S_find_first_nonspace(parser, input);
+      }
+      if (!parser->blank) {
+        // create paragraph container for line
+        container = add_child(parser, container, CMARK_NODE_PARAGRAPH,
+                              parser->first_nonspace + 1);
+        S_advance_offset(parser, input,
+                         parser->first_nonspace - parser->offset, false);
+        add_line(container, input, parser);
+      }
     }
 
     parser->current = container;
@@ -1261,6 +1735,8 @@ finished:
 }
 
 cmark_node *cmark_parser_finish(cmark_parser *parser) {
+  cmark_node *block;
+
   if (parser->linebuf.size) {
     S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size);
     cmark_strbuf_clear(&parser->linebuf);
@@ -1268,7 +1744,8 @@ cmark_node *cmark_parser_finish(cmark_parser *parser) {
 
   finalize_document(parser);
 
-  cmark_consolidate_text_nodes(parser->root);
+  for (block = S_first_new_block(parser); block; block = block->next)
+    cmark_consolidate_text_nodes(block);
 
   cmark_strbuf_free(&parser->curline);
 
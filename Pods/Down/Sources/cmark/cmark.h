@@ -2,6 +2,7 @@
 #define CMARK_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <cmark_export.h>
 #include <cmark_version.h>
 
@@ -45,9 +46,12 @@ typedef enum {
   CMARK_NODE_PARAGRAPH,
   CMARK_NODE_HEADING,
   CMARK_NODE_THEMATIC_BREAK,
+  CMARK_NODE_TABLE,
+  CMARK_NODE_TABLE_ROW,
+  CMARK_NODE_TABLE_CELL,
 
   CMARK_NODE_FIRST_BLOCK = CMARK_NODE_DOCUMENT,
-  CMARK_NODE_LAST_BLOCK = CMARK_NODE_THEMATIC_BREAK,
+  CMARK_NODE_LAST_BLOCK = CMARK_NODE_TABLE_CELL,
 
   /* Inline */
   CMARK_NODE_TEXT,
@@ -60,9 +64,10 @@ typedef enum {
   CMARK_NODE_STRONG,
   CMARK_NODE_LINK,
   CMARK_NODE_IMAGE,
+  CMARK_NODE_STRIKETHROUGH,
 
   CMARK_NODE_FIRST_INLINE = CMARK_NODE_TEXT,
-  CMARK_NODE_LAST_INLINE = CMARK_NODE_IMAGE,
+  CMARK_NODE_LAST_INLINE = CMARK_NODE_STRIKETHROUGH,
 } cmark_node_type;
 
 /* For backwards compatibility: */
@@ -83,6 +88,19 @@ typedef enum {
   CMARK_PAREN_DELIM
 } cmark_delim_type;
 
+typedef enum {
+  CMARK_TABLE_ALIGN_NONE,
+  CMARK_TABLE_ALIGN_LEFT,
+  CMARK_TABLE_ALIGN_CENTER,
+  CMARK_TABLE_ALIGN_RIGHT
+} cmark_table_align;
+
+typedef enum {
+  CMARK_NO_TASK,
+  CMARK_TASK_UNCHECKED,
+  CMARK_TASK_CHECKED
+} cmark_task_state;
+
 typedef struct cmark_node cmark_node;
 typedef struct cmark_parser cmark_parser;
 typedef struct cmark_iter cmark_iter;
@@ -381,6 +399,54 @@ CMARK_EXPORT const char *cmark_node_get_on_exit(cmark_node *node);
  */
 CMARK_EXPORT int cmark_node_set_on_exit(cmark_node *node, const char *on_exit);
 
+/** Returns the task state of a list item 'node', or `CMARK_NO_TASK`
+ * if 'node' is not a task list item.
+ */
+CMARK_EXPORT cmark_task_state cmark_node_get_task_state(cmark_node *node);
+
+/** Sets the task state of a list item 'node', returning 1 on success
+ * and 0 on error.
+ */
+CMARK_EXPORT int cmark_node_set_task_state(cmark_node *node,
+                                           cmark_task_state state);
+
+/** Returns the number of columns of a table 'node', or 0 if 'node'
+ * is not a table.
+ */
+CMARK_EXPORT int cmark_node_get_table_columns(cmark_node *node);
+
+/** Returns the alignment of 'column' in a table 'node', or
+ * `CMARK_TABLE_ALIGN_NONE` if 'node' is not a table or has no such
+ * column.
+ */
+CMARK_EXPORT cmark_table_align cmark_node_get_table_alignment(cmark_node *node,
+                                                              int column);
+
+/** Returns the widest content of 'column' in a table 'node', in UTF-16
+ * code units, or 0 if 'node' is not a table or has no such column.
+ * The width is that of the text of the cells' inlines, so markup does
+ * not count; it is measured while parsing inlines.
+ */
+CMARK_EXPORT int cmark_node_get_table_column_utf16_width(cmark_node *node,
+                                                        int column);
+
+/** Like 'cmark_node_get_table_column_utf16_width', but in display cells:
+ * East Asian wide and fullwidth characters and emoji count as two cells,
+ * combining marks, variation selectors and characters joined by a zero
+ * width joiner as none.
+ */
+CMARK_EXPORT int cmark_node_get_table_column_display_width(cmark_node *node,
+                                                          int column);
+
+/** Returns 1 if 'node' is the header row of a table, 0 otherwise.
+ */
+CMARK_EXPORT int cmark_node_get_table_row_header(cmark_node *node);
+
+/** Returns the zero based column of a table cell 'node', or -1 if
+ * 'node' is not a table cell.
+ */
+CMARK_EXPORT int cmark_node_get_table_cell_column(cmark_node *node);
+
 /** Returns the line on which 'node' begins.
  */
 CMARK_EXPORT int cmark_node_get_start_line(cmark_node *node);
@@ -497,6 +563,54 @@ cmark_node *cmark_parse_document(const char *buffer, size_t len, int options);
 CMARK_EXPORT
 cmark_node *cmark_parse_file(FILE *f, int options);
 
+/**
+ * ## Incremental parsing
+ *
+ * Parsed documents remember the input offsets at which every open block
+ * but the document itself had been closed.  When the text is edited, a
+ * new parse can resume from the last such checkpoint before the edit:
+ * the top-level blocks before it are moved from the old document instead
+ * of being parsed again, so the cost is proportional to the changed
+ * suffix.
+ *
+ *     cmark_node *updated = cmark_reparse_document(document, unchanged,
+ *                                                  text, len, options);
+ *     cmark_node_free(document);
+ *
+ * The result is the same tree 'cmark_parse_document' would return.
+ * Nothing is reused when the old document defines link reference
+ * definitions, nor before a block with an unresolved reference link,
+ * since a definition added later could resolve it.
+ */
+
+/** Creates a parser that continues 'document', which must be unmodified
+ * since it was parsed with the same 'options', from its last checkpoint
+ * at or before byte 'offset' of the text it was parsed from.  The
+ * top-level blocks before the checkpoint are moved from 'document' into
+ * the parser's document; 'document' keeps the rest, can no longer be
+ * resumed from, and must still be freed by the caller.  Feed the parser
+ * the new text starting at 'cmark_parser_get_input_offset'.
+ */
+CMARK_EXPORT
+cmark_parser *cmark_parser_resume(cmark_node *document, size_t offset,
+                                  int options);
+
+/** Returns the input offset of the next byte 'parser' expects: the
+ * checkpoint offset for a resumed parser, plus the bytes fed since.
+ */
+CMARK_EXPORT
+size_t cmark_parser_get_input_offset(cmark_parser *parser);
+
+/** Parses 'buffer', an edit of the text 'document' was parsed from with
+ * the same 'options' whose first 'unchanged' bytes are the same, reusing
+ * the top-level blocks of 'document' before the edit (see
+ * 'cmark_parser_resume').  'document' must still be freed by the caller.
+ */
+CMARK_EXPORT
+cmark_node *cmark_reparse_document(cmark_node *document, size_t unchanged,
+                                   const char *buffer, size_t len,
+                                   int options);
+
 /**
  * ## Rendering
  */
@@ -532,6 +646,75 @@ char *cmark_render_commonmark(cmark_node *root, int options, int width);
 CMARK_EXPORT
 char *cmark_render_latex(cmark_node *root, int options, int width);
 
+/**
+ * ## Style Runs
+ *
+ * The style run renderer walks the tree once and produces the plain
+ * text of an attributed-string rendering together with a flat list of
+ * styled ranges.  The text matches what Down's `AttributedStringVisitor`
+ * would produce (list prefixes, U+2029 between blocks, U+2028 for line
+ * breaks), so a platform layer can build its attributed string from one
+ * buffer and apply the runs in a single pass instead of joining a new
+ * string at every level of the tree.
+ */
+
+/** Style of a run: either a `cmark_node_type`, or one of the values
+ * below for text that has no node of its own.
+ */
+typedef enum {
+  CMARK_STYLE_LIST_ITEM_PREFIX = CMARK_NODE_LAST_INLINE + 1
+} cmark_style_kind;
+
+/** A styled range of the rendered text.  'location' and 'length' are
+ * in UTF-16 code units, 'byte_offset' and 'byte_length' are the same
+ * range in the UTF-8 text.  'nest_depth' is the zero indexed number of
+ * ancestors with the same type.  'payload' is the heading level for
+ * headings, the prefix length (without the trailing tab) for items
+ * and item prefixes, the number of columns for tables, 1 for header
+ * rows, the column for table cells, and 0 otherwise.  Task list items
+ * are prefixed with U+2610 or U+2611 instead of a bullet or number.
+ * Table rows end with U+2028 and their cells are separated by tabs.
+ * 'node' is the node the run was
+ * generated for; it is only valid while the tree is alive.
+ */
+typedef struct {
+  int32_t location;
+  int32_t length;
+  int32_t byte_offset;
+  int32_t byte_length;
+  uint16_t style;
+  uint16_t nest_depth;
+  int32_t payload;
+  cmark_node *node;
+} cmark_style_run;
+
+/** Result of `cmark_render_style_runs`.  'text' is a null-terminated,
+ * UTF-8 encoded string of 'text_len' bytes and 'utf16_len' UTF-16 code
+ * units.  'runs' holds 'nruns' runs sorted by 'location'; a run always
+ * precedes the runs nested inside it, so applying them in reverse
+ * order styles children before their parents, like the visitor does.
+ */
+typedef struct {
+  cmark_mem *mem;
+  char *text;
+  int32_t text_len;
+  int32_t utf16_len;
+  cmark_style_run *runs;
+  size_t nruns;
+} cmark_style_runs;
+
+/** Render a 'node' tree as plain text plus style runs.  Only
+ * `CMARK_OPT_HARDBREAKS` affects the output.  Returns NULL if 'root'
+ * is NULL.  The result must be released with `cmark_style_runs_free`.
+ */
+CMARK_EXPORT
+cmark_style_runs *cmark_render_style_runs(cmark_node *root, int options);
+
+/** Frees a result returned by `cmark_render_style_runs`.
+ */
+CMARK_EXPORT
+void cmark_style_runs_free(cmark_style_runs *runs);
+
 /**
  * ## Options
  */
@@ -587,6 +770,23 @@ char *cmark_render_latex(cmark_node *root, int options, int width);
  */
 #define CMARK_OPT_SMART (1 << 10)
 
+/** Parse GitHub Flavored Markdown pipe tables.
+ */
+#define CMARK_OPT_TABLES (1 << 11)
+
+/** Parse GitHub Flavored Markdown `~strikethrough~` and `~~strikethrough~~`.
+ */
+#define CMARK_OPT_STRIKETHROUGH (1 << 12)
+
+/** Parse GitHub Flavored Markdown task list items (`- [ ]` and `- [x]`).
+ */
+#define CMARK_OPT_TASKLISTS (1 << 13)
+
+/** All of the GitHub Flavored Markdown extensions above.
+ */
+#define CMARK_OPT_GFM                                                          \
+  (CMARK_OPT_TABLES | CMARK_OPT_STRIKETHROUGH | CMARK_OPT_TASKLISTS)
+
 /**
  * ## Version information
  */
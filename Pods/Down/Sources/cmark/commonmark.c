@@ -166,6 +166,32 @@ static cmark_node *get_containing_block(cmark_node *node) {
   return NULL;
 }
 
+// Like OUT, but inside a table cell escapes the pipes that would otherwise
+// end the cell, including those in code spans.
+static void S_out_cell_safe(cmark_renderer *renderer, cmark_node *node,
+                            const char *source, bool wrap,
+                            cmark_escaping escape) {
+  cmark_node *block = get_containing_block(node);
+  cmark_strbuf segment;
+  const char *pipe;
+
+  if (block == NULL || block->type != CMARK_NODE_TABLE_CELL) {
+    renderer->out(renderer, source, wrap, escape);
+    return;
+  }
+
+  cmark_strbuf_init(renderer->mem, &segment, 0);
+  while ((pipe = strchr(source, '|')) != NULL) {
+    cmark_strbuf_set(&segment, (const unsigned char *)source,
+                     (bufsize_t)(pipe - source));
+    renderer->out(renderer, cmark_strbuf_cstr(&segment), false, escape);
+    renderer->out(renderer, "\\|", false, LITERAL);
+    source = pipe + 1;
+  }
+  renderer->out(renderer, source, false, escape);
+  cmark_strbuf_free(&segment);
+}
+
 static int S_render_node(cmark_renderer *renderer, cmark_node *node,
                          cmark_event_type ev_type, int options) {
   cmark_node *tmp;
@@ -251,6 +277,11 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
         LIT(listmarker);
         renderer->begin_content = true;
       }
+      if (node->as.list.task == CMARK_TASK_UNCHECKED) {
+        LIT("[ ] ");
+      } else if (node->as.list.task == CMARK_TASK_CHECKED) {
+        LIT("[x] ");
+      }
       for (i = marker_width; i--;) {
         cmark_strbuf_putc(renderer->prefix, ' ');
       }
@@ -343,8 +374,48 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
     }
     break;
 
+  case CMARK_NODE_TABLE:
+    BLANKLINE();
+    break;
+
+  case CMARK_NODE_TABLE_ROW:
+    if (entering) {
+      renderer->no_linebreaks = true;
+      LIT("|");
+    } else {
+      renderer->no_linebreaks = false;
+      CR();
+      if (node->as.table_row_header) {
+        tmp = node->parent;
+        LIT("|");
+        for (i = 0; i < tmp->as.table.n_columns; i++) {
+          switch (tmp->as.table.columns[i].alignment) {
+          case CMARK_TABLE_ALIGN_LEFT:
+            LIT(" :-- |");
+            break;
+          case CMARK_TABLE_ALIGN_CENTER:
+            LIT(" :-: |");
+            break;
+          case CMARK_TABLE_ALIGN_RIGHT:
+            LIT(" --: |");
+            break;
+          default:
+            LIT(" --- |");
+            break;
+          }
+        }
+        CR();
+      }
+    }
+    break;
+
+  case CMARK_NODE_TABLE_CELL:
+    LIT(entering ? " " : " |");
+    break;
+
   case CMARK_NODE_TEXT:
-    OUT(cmark_node_get_literal(node), allow_wrap, NORMAL);
+    S_out_cell_safe(renderer, node, cmark_node_get_literal(node), allow_wrap,
+                    NORMAL);
     break;
 
   case CMARK_NODE_LINEBREAK:
@@ -380,7 +451,8 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
     if (extra_spaces) {
       LIT(" ");
     }
-    OUT(cmark_node_get_literal(node), allow_wrap, LITERAL);
+    S_out_cell_safe(renderer, node, cmark_node_get_literal(node), allow_wrap,
+                    LITERAL);
     if (extra_spaces) {
       LIT(" ");
     }
@@ -406,6 +478,10 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
     }
     break;
 
+  case CMARK_NODE_STRIKETHROUGH:
+    LIT("~~");
+    break;
+
   case CMARK_NODE_EMPH:
     // If we have EMPH(EMPH(x)), we need to use *_x_*
     // because **x** is STRONG(x):
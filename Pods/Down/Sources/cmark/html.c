@@ -124,6 +124,12 @@ static int S_render_node(cmark_node *node, cmark_event_type ev_type,
       cmark_strbuf_puts(html, "<li");
       S_render_sourcepos(node, html, options);
       cmark_strbuf_putc(html, '>');
+      if (node->as.list.task == CMARK_TASK_UNCHECKED) {
+        cmark_strbuf_puts(html, "<input disabled=\"\" type=\"checkbox\"> ");
+      } else if (node->as.list.task == CMARK_TASK_CHECKED) {
+        cmark_strbuf_puts(
+            html, "<input checked=\"\" disabled=\"\" type=\"checkbox\"> ");
+      }
     } else {
       cmark_strbuf_puts(html, "</li>\n");
     }
@@ -197,6 +203,64 @@ static int S_render_node(cmark_node *node, cmark_event_type ev_type,
     cmark_strbuf_puts(html, " />\n");
     break;
 
+  case CMARK_NODE_TABLE:
+    if (entering) {
+      cr(html);
+      cmark_strbuf_puts(html, "<table");
+      S_render_sourcepos(node, html, options);
+      cmark_strbuf_puts(html, ">\n");
+    } else {
+      if (node->last_child && !node->last_child->as.table_row_header) {
+        cmark_strbuf_puts(html, "</tbody>\n");
+      }
+      cmark_strbuf_puts(html, "</table>\n");
+    }
+    break;
+
+  case CMARK_NODE_TABLE_ROW:
+    if (entering) {
+      if (node->as.table_row_header) {
+        cmark_strbuf_puts(html, "<thead>\n");
+      } else if (node->prev == NULL || node->prev->as.table_row_header) {
+        cmark_strbuf_puts(html, "<tbody>\n");
+      }
+      cmark_strbuf_puts(html, "<tr");
+      S_render_sourcepos(node, html, options);
+      cmark_strbuf_puts(html, ">\n");
+    } else {
+      cmark_strbuf_puts(html, "</tr>\n");
+      if (node->as.table_row_header) {
+        cmark_strbuf_puts(html, "</thead>\n");
+      }
+    }
+    break;
+
+  case CMARK_NODE_TABLE_CELL:
+    parent = cmark_node_parent(node);
+    if (entering) {
+      cmark_strbuf_puts(html, parent->as.table_row_header ? "<th" : "<td");
+      switch (cmark_node_get_table_alignment(cmark_node_parent(parent),
+                                             node->as.table_cell_column)) {
+      case CMARK_TABLE_ALIGN_LEFT:
+        cmark_strbuf_puts(html, " align=\"left\"");
+        break;
+      case CMARK_TABLE_ALIGN_CENTER:
+        cmark_strbuf_puts(html, " align=\"center\"");
+        break;
+      case CMARK_TABLE_ALIGN_RIGHT:
+        cmark_strbuf_puts(html, " align=\"right\"");
+        break;
+      default:
+        break;
+      }
+      S_render_sourcepos(node, html, options);
+      cmark_strbuf_putc(html, '>');
+    } else {
+      cmark_strbuf_puts(html, parent->as.table_row_header ? "</th>\n"
+                                                          : "</td>\n");
+    }
+    break;
+
   case CMARK_NODE_PARAGRAPH:
     parent = cmark_node_parent(node);
     grandparent = cmark_node_parent(parent);
@@ -275,6 +339,14 @@ static int S_render_node(cmark_node *node, cmark_event_type ev_type,
     }
     break;
 
+  case CMARK_NODE_STRIKETHROUGH:
+    if (entering) {
+      cmark_strbuf_puts(html, "<del>");
+    } else {
+      cmark_strbuf_puts(html, "</del>");
+    }
+    break;
+
   case CMARK_NODE_LINK:
     if (entering) {
       cmark_strbuf_puts(html, "<a href=\"");
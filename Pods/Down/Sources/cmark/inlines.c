@@ -29,6 +29,7 @@ static const char *RIGHTSINGLEQUOTE = "\xE2\x80\x99";
 #define make_softbreak(mem) make_simple(mem, CMARK_NODE_SOFTBREAK)
 #define make_emph(mem) make_simple(mem, CMARK_NODE_EMPH)
 #define make_strong(mem) make_simple(mem, CMARK_NODE_STRONG)
+#define make_strikethrough(mem) make_simple(mem, CMARK_NODE_STRIKETHROUGH)
 
 #define MAXBACKTICKS 1000
 
@@ -540,7 +541,9 @@ static cmark_node *handle_delim(subject *subj, unsigned char c, bool smart) {
 
   inl_text = make_str(subj, subj->pos - numdelims, subj->pos - 1, contents);
 
-  if ((can_open || can_close) && (!(c == '\'' || c == '"') || smart)) {
+  // Only runs of one or two tildes delimit strikethrough.
+  if ((can_open || can_close) && (!(c == '\'' || c == '"') || smart) &&
+      !(c == '~' && numdelims > 2)) {
     push_delimiter(subj, c, can_open, can_close, inl_text);
   }
 
@@ -612,8 +615,9 @@ static void process_emphasis(subject *subj, delimiter *stack_bottom) {
   delimiter *old_closer;
   bool opener_found;
   int openers_bottom_index = 0;
-  delimiter *openers_bottom[6] = {stack_bottom, stack_bottom, stack_bottom,
-                                  stack_bottom, stack_bottom, stack_bottom};
+  delimiter *openers_bottom[7] = {stack_bottom, stack_bottom, stack_bottom,
+                                  stack_bottom, stack_bottom, stack_bottom,
+                                  stack_bottom};
 
   // move back to first relevant delim.
   while (closer != NULL && closer->previous != stack_bottom) {
@@ -636,6 +640,9 @@ static void process_emphasis(subject *subj, delimiter *stack_bottom) {
       case '*':
         openers_bottom_index = 3 + (closer->length % 3);
         break;
+      case '~':
+        openers_bottom_index = 6;
+        break;
       default:
         assert(false);
       }
@@ -645,9 +652,15 @@ static void process_emphasis(subject *subj, delimiter *stack_bottom) {
       opener_found = false;
       while (opener != NULL && opener != openers_bottom[openers_bottom_index]) {
         if (opener->can_open && opener->delim_char == closer->delim_char) {
+          // a strikethrough closer only matches an opener of its length
+          if (closer->delim_char == '~') {
+            if (opener->length == closer->length) {
+              opener_found = true;
+              break;
+            }
           // interior closer of size 2 can't match opener of size 1
           // or of size 1 can't match 2
-          if (!(closer->can_open || opener->can_close) ||
+          } else if (!(closer->can_open || opener->can_close) ||
 	      closer->length % 3 == 0 ||
               (opener->length + closer->length) % 3 != 0) {
             opener_found = true;
@@ -657,7 +670,8 @@ static void process_emphasis(subject *subj, delimiter *stack_bottom) {
         opener = opener->previous;
       }
       old_closer = closer;
-      if (closer->delim_char == '*' || closer->delim_char == '_') {
+      if (closer->delim_char == '*' || closer->delim_char == '_' ||
+          closer->delim_char == '~') {
         if (opener_found) {
           closer = S_insert_emph(subj, opener, closer);
         } else {
@@ -711,7 +725,11 @@ static delimiter *S_insert_emph(subject *subj, delimiter *opener,
   cmark_node *tmp, *tmpnext, *emph;
 
   // calculate the actual number of characters used from this closer
-  use_delims = (closer_num_chars >= 2 && opener_num_chars >= 2) ? 2 : 1;
+  if (closer->delim_char == '~') {
+    use_delims = closer_num_chars;
+  } else {
+    use_delims = (closer_num_chars >= 2 && opener_num_chars >= 2) ? 2 : 1;
+  }
 
   // remove used characters from associated inlines.
   opener_num_chars -= use_delims;
@@ -729,7 +747,11 @@ static delimiter *S_insert_emph(subject *subj, delimiter *opener,
 
   // create new emph or strong, and splice it in to our inlines
   // between the opener and closer
-  emph = use_delims == 1 ? make_emph(subj->mem) : make_strong(subj->mem);
+  if (closer->delim_char == '~') {
+    emph = make_strikethrough(subj->mem);
+  } else {
+    emph = use_delims == 1 ? make_emph(subj->mem) : make_strong(subj->mem);
+  }
 
   tmp = opener_inl->next;
   while (tmp && tmp != closer_inl) {
@@ -1204,19 +1226,37 @@ static bufsize_t subject_find_special_char(subject *subj, int options) {
       return n;
     if (options & CMARK_OPT_SMART && SMART_PUNCT_CHARS[subj->input.data[n]])
       return n;
+    if (options & CMARK_OPT_STRIKETHROUGH && subj->input.data[n] == '~')
+      return n;
     n++;
   }
 
   return subj->input.len;
 }
 
+// Parse a run of text up to the next special character.
+static cmark_node *handle_text(subject *subj, int options) {
+  cmark_chunk contents;
+  bufsize_t startpos, endpos;
+
+  endpos = subject_find_special_char(subj, options);
+  contents = cmark_chunk_dup(&subj->input, subj->pos, endpos - subj->pos);
+  startpos = subj->pos;
+  subj->pos = endpos;
+
+  // if we're at a newline, strip trailing spaces.
+  if (S_is_line_end_char(peek_char(subj))) {
+    cmark_chunk_rtrim(&contents);
+  }
+
+  return make_str(subj, startpos, endpos - 1, contents);
+}
+
 // Parse an inline, advancing subject, and add it as a child of parent.
 // Return 0 if no inline can be parsed, 1 otherwise.
 static int parse_inline(subject *subj, cmark_node *parent, int options) {
   cmark_node *new_inl = NULL;
-  cmark_chunk contents;
   unsigned char c;
-  bufsize_t startpos, endpos;
   c = peek_char(subj);
   if (c == 0) {
     return 0;
@@ -1258,6 +1298,13 @@ static int parse_inline(subject *subj, cmark_node *parent, int options) {
   case ']':
     new_inl = handle_close_bracket(subj);
     break;
+  case '~':
+    if (options & CMARK_OPT_STRIKETHROUGH) {
+      new_inl = handle_delim(subj, c, false);
+      break;
+    }
+    new_inl = handle_text(subj, options);
+    break;
   case '!':
     advance(subj);
     if (peek_char(subj) == '[') {
@@ -1269,17 +1316,7 @@ static int parse_inline(subject *subj, cmark_node *parent, int options) {
     }
     break;
   default:
-    endpos = subject_find_special_char(subj, options);
-    contents = cmark_chunk_dup(&subj->input, subj->pos, endpos - subj->pos);
-    startpos = subj->pos;
-    subj->pos = endpos;
-
-    // if we're at a newline, strip trailing spaces.
-    if (S_is_line_end_char(peek_char(subj))) {
-      cmark_chunk_rtrim(&contents);
-    }
-
-    new_inl = make_str(subj, startpos, endpos - 1, contents);
+    new_inl = handle_text(subj, options);
   }
   if (new_inl != NULL) {
     cmark_node_append_child(parent, new_inl);
@@ -282,7 +282,13 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
 
   case CMARK_NODE_ITEM:
     if (entering) {
-      LIT("\\item ");
+      if (node->as.list.task == CMARK_TASK_UNCHECKED) {
+        LIT("\\item[$\\square$] ");
+      } else if (node->as.list.task == CMARK_TASK_CHECKED) {
+        LIT("\\item[$\\boxtimes$] "); // requires \usepackage{amssymb}
+      } else {
+        LIT("\\item ");
+      }
     } else {
       CR();
     }
@@ -346,6 +352,47 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
     }
     break;
 
+  case CMARK_NODE_TABLE:
+    if (entering) {
+      int i;
+      LIT("\\begin{tabular}{");
+      for (i = 0; i < node->as.table.n_columns; i++) {
+        switch (node->as.table.columns[i].alignment) {
+        case CMARK_TABLE_ALIGN_CENTER:
+          LIT("c");
+          break;
+        case CMARK_TABLE_ALIGN_RIGHT:
+          LIT("r");
+          break;
+        default:
+          LIT("l");
+          break;
+        }
+      }
+      LIT("}");
+      CR();
+    } else {
+      LIT("\\end{tabular}");
+      BLANKLINE();
+    }
+    break;
+
+  case CMARK_NODE_TABLE_ROW:
+    if (!entering) {
+      LIT(" \\\\");
+      if (node->as.table_row_header) {
+        LIT(" \\hline");
+      }
+      CR();
+    }
+    break;
+
+  case CMARK_NODE_TABLE_CELL:
+    if (entering && node->prev) {
+      LIT(" & ");
+    }
+    break;
+
   case CMARK_NODE_TEXT:
     OUT(cmark_node_get_literal(node), allow_wrap, NORMAL);
     break;
@@ -396,6 +443,14 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
     }
     break;
 
+  case CMARK_NODE_STRIKETHROUGH:
+    if (entering) {
+      LIT("\\sout{"); // requires \usepackage{ulem}
+    } else {
+      LIT("}");
+    }
+    break;
+
   case CMARK_NODE_LINK:
     if (entering) {
       const char *url = cmark_node_get_url(node);
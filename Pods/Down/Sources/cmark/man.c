@@ -117,6 +117,11 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
         LIT(list_number_s);
       }
       CR();
+      if (node->as.list.task == CMARK_TASK_UNCHECKED) {
+        LIT("[ ] ");
+      } else if (node->as.list.task == CMARK_TASK_CHECKED) {
+        LIT("[x] ");
+      }
     } else {
       CR();
     }
@@ -173,6 +178,50 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
     }
     break;
 
+  case CMARK_NODE_TABLE:
+    // requires tbl(1)
+    if (entering) {
+      int i;
+      CR();
+      LIT(".TS\nallbox;");
+      CR();
+      for (i = 0; i < node->as.table.n_columns; i++) {
+        if (i > 0) {
+          LIT(" ");
+        }
+        switch (node->as.table.columns[i].alignment) {
+        case CMARK_TABLE_ALIGN_CENTER:
+          LIT("c");
+          break;
+        case CMARK_TABLE_ALIGN_RIGHT:
+          LIT("r");
+          break;
+        default:
+          LIT("l");
+          break;
+        }
+      }
+      LIT(".");
+      CR();
+    } else {
+      CR();
+      LIT(".TE");
+      CR();
+    }
+    break;
+
+  case CMARK_NODE_TABLE_ROW:
+    if (!entering) {
+      CR();
+    }
+    break;
+
+  case CMARK_NODE_TABLE_CELL:
+    if (entering && node->prev) {
+      LIT("\t");
+    }
+    break;
+
   case CMARK_NODE_TEXT:
     OUT(cmark_node_get_literal(node), allow_wrap, NORMAL);
     break;
@@ -223,6 +272,10 @@ static int S_render_node(cmark_renderer *renderer, cmark_node *node,
     }
     break;
 
+  case CMARK_NODE_STRIKETHROUGH:
+    // roff has no strikethrough; the text is rendered as is.
+    break;
+
   case CMARK_NODE_LINK:
     if (!entering) {
       LIT(" (");
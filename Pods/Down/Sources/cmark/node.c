@@ -48,18 +48,28 @@ static bool S_can_contain(cmark_node *node, cmark_node *child) {
   case CMARK_NODE_DOCUMENT:
   case CMARK_NODE_BLOCK_QUOTE:
   case CMARK_NODE_ITEM:
-    return S_is_block(child) && child->type != CMARK_NODE_ITEM;
+    return S_is_block(child) && child->type != CMARK_NODE_ITEM &&
+           child->type != CMARK_NODE_TABLE_ROW &&
+           child->type != CMARK_NODE_TABLE_CELL;
 
   case CMARK_NODE_LIST:
     return child->type == CMARK_NODE_ITEM;
 
+  case CMARK_NODE_TABLE:
+    return child->type == CMARK_NODE_TABLE_ROW;
+
+  case CMARK_NODE_TABLE_ROW:
+    return child->type == CMARK_NODE_TABLE_CELL;
+
   case CMARK_NODE_CUSTOM_BLOCK:
     return true;
 
   case CMARK_NODE_PARAGRAPH:
   case CMARK_NODE_HEADING:
+  case CMARK_NODE_TABLE_CELL:
   case CMARK_NODE_EMPH:
   case CMARK_NODE_STRONG:
+  case CMARK_NODE_STRIKETHROUGH:
   case CMARK_NODE_LINK:
   case CMARK_NODE_IMAGE:
   case CMARK_NODE_CUSTOM_INLINE:
@@ -128,6 +138,12 @@ static void S_free_nodes(cmark_node *e) {
       cmark_chunk_free(NODE_MEM(e), &e->as.custom.on_enter);
       cmark_chunk_free(NODE_MEM(e), &e->as.custom.on_exit);
       break;
+    case CMARK_NODE_TABLE:
+      NODE_MEM(e)->free(e->as.table.columns);
+      break;
+    case CMARK_NODE_DOCUMENT:
+      NODE_MEM(e)->free(e->as.document.checkpoints);
+      break;
     default:
       break;
     }
@@ -184,6 +200,12 @@ const char *cmark_node_get_type_string(cmark_node *node) {
     return "heading";
   case CMARK_NODE_THEMATIC_BREAK:
     return "thematic_break";
+  case CMARK_NODE_TABLE:
+    return "table";
+  case CMARK_NODE_TABLE_ROW:
+    return "table_row";
+  case CMARK_NODE_TABLE_CELL:
+    return "table_cell";
   case CMARK_NODE_TEXT:
     return "text";
   case CMARK_NODE_SOFTBREAK:
@@ -204,6 +226,8 @@ const char *cmark_node_get_type_string(cmark_node *node) {
     return "link";
   case CMARK_NODE_IMAGE:
     return "image";
+  case CMARK_NODE_STRIKETHROUGH:
+    return "strikethrough";
   }
 
   return "<unknown>";
@@ -609,6 +633,96 @@ int cmark_node_set_on_exit(cmark_node *node, const char *on_exit) {
   return 0;
 }
 
+cmark_task_state cmark_node_get_task_state(cmark_node *node) {
+  if (node == NULL) {
+    return CMARK_NO_TASK;
+  }
+
+  if (node->type == CMARK_NODE_ITEM) {
+    return node->as.list.task;
+  } else {
+    return CMARK_NO_TASK;
+  }
+}
+
+int cmark_node_set_task_state(cmark_node *node, cmark_task_state state) {
+  if (!(state == CMARK_NO_TASK || state == CMARK_TASK_UNCHECKED ||
+        state == CMARK_TASK_CHECKED)) {
+    return 0;
+  }
+
+  if (node == NULL) {
+    return 0;
+  }
+
+  if (node->type == CMARK_NODE_ITEM) {
+    node->as.list.task = state;
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static cmark_table_column *S_table_column(cmark_node *node, int column) {
+  if (node == NULL || node->type != CMARK_NODE_TABLE || column < 0 ||
+      column >= node->as.table.n_columns) {
+    return NULL;
+  }
+  return &node->as.table.columns[column];
+}
+
+int cmark_node_get_table_columns(cmark_node *node) {
+  if (node == NULL) {
+    return 0;
+  }
+
+  if (node->type == CMARK_NODE_TABLE) {
+    return node->as.table.n_columns;
+  } else {
+    return 0;
+  }
+}
+
+cmark_table_align cmark_node_get_table_alignment(cmark_node *node,
+                                                 int column) {
+  cmark_table_column *col = S_table_column(node, column);
+  return col ? col->alignment : CMARK_TABLE_ALIGN_NONE;
+}
+
+int cmark_node_get_table_column_utf16_width(cmark_node *node, int column) {
+  cmark_table_column *col = S_table_column(node, column);
+  return col ? col->utf16_width : 0;
+}
+
+int cmark_node_get_table_column_display_width(cmark_node *node, int column) {
+  cmark_table_column *col = S_table_column(node, column);
+  return col ? col->display_width : 0;
+}
+
+int cmark_node_get_table_row_header(cmark_node *node) {
+  if (node == NULL) {
+    return 0;
+  }
+
+  if (node->type == CMARK_NODE_TABLE_ROW) {
+    return node->as.table_row_header;
+  } else {
+    return 0;
+  }
+}
+
+int cmark_node_get_table_cell_column(cmark_node *node) {
+  if (node == NULL) {
+    return -1;
+  }
+
+  if (node->type == CMARK_NODE_TABLE_CELL) {
+    return node->as.table_cell_column;
+  } else {
+    return -1;
+  }
+}
+
 int cmark_node_get_start_line(cmark_node *node) {
   if (node == NULL) {
     return 0;
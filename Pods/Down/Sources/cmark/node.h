@@ -20,6 +20,7 @@ typedef struct {
   cmark_delim_type delimiter;
   unsigned char bullet_char;
   bool tight;
+  cmark_task_state task;
 } cmark_list;
 
 typedef struct {
@@ -46,6 +47,35 @@ typedef struct {
   cmark_chunk on_exit;
 } cmark_custom;
 
+typedef struct {
+  cmark_table_align alignment;
+  // Widest cell text in the column, see cmark_node_get_table_column_*_width.
+  int32_t utf16_width;
+  int32_t display_width;
+} cmark_table_column;
+
+typedef struct {
+  uint16_t n_columns;
+  cmark_table_column *columns;
+} cmark_table;
+
+typedef struct {
+  size_t offset; // of the line after the checkpoint
+  int line_number;
+  bufsize_t last_line_length;
+  int blocks; // top-level blocks before the checkpoint
+} cmark_checkpoint;
+
+typedef struct {
+  cmark_checkpoint *checkpoints;
+  int n_checkpoints;
+  int checkpoints_size;
+  int options;
+  // Index of the first top-level block with an unresolved reference link.
+  int first_unresolved;
+  bool has_references;
+} cmark_document;
+
 enum cmark_node__internal_flags {
   CMARK_NODE__OPEN = (1 << 0),
   CMARK_NODE__LAST_LINE_BLANK = (1 << 1),
@@ -73,11 +103,15 @@ struct cmark_node {
 
   union {
     cmark_chunk literal;
+    cmark_document document;
     cmark_list list;
     cmark_code code;
     cmark_heading heading;
     cmark_link link;
     cmark_custom custom;
+    cmark_table table;
+    bool table_row_header;
+    uint16_t table_cell_column;
     int html_block_type;
   } as;
 };
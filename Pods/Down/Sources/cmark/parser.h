@@ -31,6 +31,13 @@ struct cmark_parser {
   cmark_strbuf linebuf;
   int options;
   bool last_buffer_ended_with_cr;
+  size_t total_size; // input offset of the next byte fed
+  // The last top-level block counted for checkpoints, and the count.
+  struct cmark_node *checkpoint_block;
+  int checkpoint_blocks;
+  // The last top-level block moved in by cmark_parser_resume, and the count.
+  struct cmark_node *resume_block;
+  int resume_blocks;
 };
 
 #ifdef __cplusplus
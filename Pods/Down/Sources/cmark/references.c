@@ -66,6 +66,7 @@ static void add_reference(cmark_reference_map *map, cmark_reference *ref) {
   }
 
   map->table[ref->hash % REFMAP_SIZE] = ref;
+  map->size++;
 }
 
 void cmark_reference_create(cmark_reference_map *map, cmark_chunk *label,
@@ -114,6 +115,9 @@ cmark_reference *cmark_reference_lookup(cmark_reference_map *map,
     ref = ref->next;
   }
 
+  if (ref == NULL)
+    map->misses++;
+
   map->mem->free(norm);
   return ref;
 }
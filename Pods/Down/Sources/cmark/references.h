@@ -22,6 +22,8 @@ typedef struct cmark_reference cmark_reference;
 struct cmark_reference_map {
   cmark_mem *mem;
   cmark_reference *table[REFMAP_SIZE];
+  unsigned int size;
+  unsigned int misses; // lookups of valid labels that found nothing
 };
 
 typedef struct cmark_reference_map cmark_reference_map;
@@ -0,0 +1,136 @@
+#ifndef CMARK_SIMD_H
+#define CMARK_SIMD_H
+
+#include <stdint.h>
+#include "config.h"
+#include "buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 16 byte fast paths for the hot byte loops: scanning for a handful of
+ * delimiter bytes, and validating UTF-8.  Every function here only looks at
+ * whole 16 byte blocks and returns how far it got; the caller's scalar loop
+ * takes over from there, handles the tail and produces the exact output it
+ * always did.
+ *
+ * CMARK_SIMD is defined when SSE2 or NEON is available.  UTF-8 validation
+ * needs a byte shuffle (SSSE3 or AArch64 NEON) and falls back to skipping
+ * ASCII blocks without it.  Define CMARK_NO_SIMD to use the scalar loops only.
+ */
+
+#if !defined(CMARK_NO_SIMD) && defined(__SSE2__)
+#define CMARK_SIMD
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#define CMARK_SIMD_SHUFFLE
+#include <tmmintrin.h>
+#endif
+typedef __m128i cmark_simd_vec;
+#elif !defined(CMARK_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#define CMARK_SIMD
+#define CMARK_SIMD_SHUFFLE
+#include <arm_neon.h>
+typedef uint8x16_t cmark_simd_vec;
+#endif
+
+#ifdef CMARK_SIMD
+
+#ifdef __SSE2__
+
+#define simd_load(p) _mm_loadu_si128((const __m128i *)(const void *)(p))
+#define simd_splat(c) _mm_set1_epi8((char)(c))
+#define simd_eq(a, b) _mm_cmpeq_epi8((a), (b))
+#define simd_or(a, b) _mm_or_si128((a), (b))
+#define simd_and(a, b) _mm_and_si128((a), (b))
+#define simd_xor(a, b) _mm_xor_si128((a), (b))
+
+// One bit per byte of a comparison result, lowest byte first.
+static CMARK_INLINE uint64_t simd_mask(cmark_simd_vec m) {
+  return (uint32_t)_mm_movemask_epi8(m);
+}
+#define SIMD_MASK_BITS 1
+
+// Whether any byte of 'v' is nonzero, or has its high bit set.
+static CMARK_INLINE bool simd_any(cmark_simd_vec v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+}
+
+static CMARK_INLINE bool simd_any_high(cmark_simd_vec v) {
+  return _mm_movemask_epi8(v) != 0;
+}
+
+#else
+
+#define simd_load(p) vld1q_u8((const uint8_t *)(p))
+#define simd_splat(c) vdupq_n_u8((uint8_t)(c))
+#define simd_eq(a, b) vceqq_u8((a), (b))
+#define simd_or(a, b) vorrq_u8((a), (b))
+#define simd_and(a, b) vandq_u8((a), (b))
+#define simd_xor(a, b) veorq_u8((a), (b))
+
+// Four bits per byte of a comparison result, lowest byte first.
+static CMARK_INLINE uint64_t simd_mask(cmark_simd_vec m) {
+  uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+#define SIMD_MASK_BITS 4
+
+static CMARK_INLINE bool simd_any(cmark_simd_vec v) { return vmaxvq_u8(v) != 0; }
+
+static CMARK_INLINE bool simd_any_high(cmark_simd_vec v) {
+  return vmaxvq_u8(v) >= 0x80;
+}
+
+#endif
+
+/**
+ * Returns the length of the prefix of 'src' that contains none of the
+ * 'count' bytes in 'set' (at most 8), scanning whole blocks only: the
+ * result is either the index of the first such byte or a multiple of 16
+ * with fewer than 16 bytes left to scan.
+ */
+static CMARK_INLINE bufsize_t cmark_simd_span_excluding(const uint8_t *src,
+                                                        bufsize_t size,
+                                                        const char *set,
+                                                        int count) {
+  cmark_simd_vec needles[8];
+  bufsize_t i = 0;
+  int k;
+
+  for (k = 0; k < count; k++)
+    needles[k] = simd_splat(set[k]);
+
+  for (; i + 16 <= size; i += 16) {
+    cmark_simd_vec block = simd_load(src + i);
+    cmark_simd_vec hits = simd_eq(block, needles[0]);
+    uint64_t mask;
+
+    for (k = 1; k < count; k++)
+      hits = simd_or(hits, simd_eq(block, needles[k]));
+
+    mask = simd_mask(hits);
+    if (mask)
+      return i + (bufsize_t)(__builtin_ctzll(mask) / SIMD_MASK_BITS);
+  }
+
+  return i;
+}
+
+/**
+ * Returns the length of a prefix of 'src' that is valid UTF-8 without NUL
+ * bytes and ends on a character boundary.  Validation stops at the first
+ * block with an error or when fewer than 16 bytes are left, so the rest,
+ * valid or not, is left to the scalar validator.
+ */
+bufsize_t cmark_simd_utf8_valid_prefix(const uint8_t *src, bufsize_t size);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,423 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "config.h"
+#include "cmark.h"
+#include "node.h"
+#include "buffer.h"
+
+#define BUFFER_SIZE 100
+
+// Renders a cmark_node tree into one plain text buffer plus a flat list of
+// style runs.  The text is the one Down's AttributedStringVisitor builds by
+// joining a new attributed string per node; here every node appends to the
+// same buffer and records its range instead.  Like the visitor, nodes with an
+// empty literal produce neither text nor a run.  The visitor has no table
+// nodes; tables render as rows of tab separated cells on their own lines, so
+// that a layout can place the cells from the table's column metrics.
+
+static const unsigned char PARAGRAPH_SEPARATOR[] = "\xE2\x80\xA9"; // U+2029
+static const unsigned char LINE_SEPARATOR[] = "\xE2\x80\xA8";      // U+2028
+static const unsigned char THEMATIC_BREAK[] = "\xE2\x80\x8B\n";    // U+200B
+
+struct list_state {
+  cmark_list_type list_type;
+  int next_number;
+};
+
+struct render_state {
+  cmark_mem *mem;
+  cmark_strbuf *text;
+  int32_t utf16_len;
+  cmark_style_run *runs;
+  size_t nruns;
+  size_t runs_size;
+  // Index of the open run of every entered container, innermost last.
+  size_t *open;
+  size_t nopen;
+  size_t open_size;
+  struct list_state *lists;
+  size_t nlists;
+  size_t lists_size;
+  // Number of open containers of each node type, for nest depths.
+  uint16_t depth[CMARK_NODE_LAST_INLINE + 1];
+};
+
+static void *S_grow(cmark_mem *mem, void *ptr, size_t *size, size_t count,
+                    size_t elem_size) {
+  if (count < *size) {
+    return ptr;
+  }
+  size_t new_size = *size ? *size * 2 : 16;
+  ptr = mem->realloc(ptr, new_size * elem_size);
+  *size = new_size;
+  return ptr;
+}
+
+// Appends UTF-8 bytes and keeps the UTF-16 length in sync.  Every byte that
+// is not a continuation byte starts a code point; 4-byte sequences encode a
+// surrogate pair.
+static void S_out(struct render_state *state, const unsigned char *data,
+                  bufsize_t len) {
+  bufsize_t i;
+  int32_t units = 0;
+
+  for (i = 0; i < len; i++) {
+    unsigned char c = data[i];
+    if ((c & 0xC0) != 0x80) {
+      units += c >= 0xF0 ? 2 : 1;
+    }
+  }
+  cmark_strbuf_put(state->text, data, len);
+  state->utf16_len += units;
+}
+
+static CMARK_INLINE void S_outs(struct render_state *state, const char *s) {
+  S_out(state, (const unsigned char *)s, (bufsize_t)strlen(s));
+}
+
+// Length in bytes of the newline at 'data', or 0.  Matches the code points
+// of Foundation's `CharacterSet.newlines`: U+000A-U+000D, U+0085, U+2028
+// and U+2029.
+static bufsize_t S_newline_len(const unsigned char *data, bufsize_t len) {
+  if (data[0] >= 0x0A && data[0] <= 0x0D) {
+    return 1;
+  }
+  if (len >= 2 && data[0] == 0xC2 && data[1] == 0x85) {
+    return 2;
+  }
+  if (len >= 3 && data[0] == 0xE2 && data[1] == 0x80 &&
+      (data[2] == 0xA8 || data[2] == 0xA9)) {
+    return 3;
+  }
+  return 0;
+}
+
+// Trims leading and trailing newlines and replaces every remaining newline
+// with U+2028, as the visitor does for code and HTML blocks.
+static void S_out_block_literal(struct render_state *state,
+                                const unsigned char *data, bufsize_t len) {
+  bufsize_t nl, start = 0, end = len, run = 0, i;
+
+  while (start < end && (nl = S_newline_len(data + start, end - start))) {
+    start += nl;
+  }
+  while (end > start) {
+    if (data[end - 1] >= 0x0A && data[end - 1] <= 0x0D) {
+      end -= 1;
+    } else if (end - start >= 2 && data[end - 2] == 0xC2 &&
+               data[end - 1] == 0x85) {
+      end -= 2;
+    } else if (end - start >= 3 && data[end - 3] == 0xE2 &&
+               data[end - 2] == 0x80 &&
+               (data[end - 1] == 0xA8 || data[end - 1] == 0xA9)) {
+      end -= 3;
+    } else {
+      break;
+    }
+  }
+
+  i = start;
+  run = start;
+  while (i < end) {
+    nl = S_newline_len(data + i, end - i);
+    if (nl) {
+      S_out(state, data + run, i - run);
+      S_out(state, LINE_SEPARATOR, 3);
+      i += nl;
+      run = i;
+    } else {
+      i++;
+    }
+  }
+  S_out(state, data + run, end - run);
+}
+
+static size_t S_open_run(struct render_state *state, cmark_node *node,
+                         uint16_t style, uint16_t nest_depth,
+                         int32_t payload) {
+  cmark_style_run *run;
+
+  state->runs = (cmark_style_run *)S_grow(state->mem, state->runs,
+                                          &state->runs_size, state->nruns,
+                                          sizeof(cmark_style_run));
+  run = &state->runs[state->nruns];
+  run->location = state->utf16_len;
+  run->length = 0;
+  run->byte_offset = state->text->size;
+  run->byte_length = 0;
+  run->style = style;
+  run->nest_depth = nest_depth;
+  run->payload = payload;
+  run->node = node;
+  return state->nruns++;
+}
+
+static void S_close_run(struct render_state *state, size_t index) {
+  cmark_style_run *run = &state->runs[index];
+  run->length = state->utf16_len - run->location;
+  run->byte_length = state->text->size - run->byte_offset;
+}
+
+static CMARK_INLINE void S_separate(struct render_state *state,
+                                    cmark_node *node) {
+  if (node->next) {
+    S_out(state, PARAGRAPH_SEPARATOR, 3);
+  }
+}
+
+static void S_enter_container(struct render_state *state, cmark_node *node,
+                              int32_t payload) {
+  size_t index = S_open_run(state, node, node->type, state->depth[node->type],
+                            payload);
+  state->depth[node->type]++;
+  state->open = (size_t *)S_grow(state->mem, state->open, &state->open_size,
+                                 state->nopen, sizeof(size_t));
+  state->open[state->nopen++] = index;
+}
+
+static void S_exit_container(struct render_state *state, cmark_node *node) {
+  assert(state->nopen > 0);
+  state->depth[node->type]--;
+  S_close_run(state, state->open[--state->nopen]);
+}
+
+static void S_enter_item(struct render_state *state, cmark_node *node) {
+  char prefix[BUFFER_SIZE];
+  struct list_state *list = NULL;
+  int32_t prefix_len;
+  size_t index;
+
+  if (state->nlists > 0) {
+    list = &state->lists[state->nlists - 1];
+  }
+  if (node->as.list.task != CMARK_NO_TASK) {
+    // U+2610 BALLOT BOX or U+2611 BALLOT BOX WITH CHECK; ordered task items
+    // still count.
+    strcpy(prefix, node->as.list.task == CMARK_TASK_CHECKED ? "\xE2\x98\x91"
+                                                            : "\xE2\x98\x90");
+    prefix_len = 1;
+    if (list && list->list_type == CMARK_ORDERED_LIST) {
+      list->next_number++;
+    }
+  } else if (list && list->list_type == CMARK_ORDERED_LIST) {
+    snprintf(prefix, BUFFER_SIZE, "%d.", list->next_number++);
+    prefix_len = (int32_t)strlen(prefix);
+  } else {
+    // U+2022 BULLET, a single UTF-16 code unit.
+    strcpy(prefix, "\xE2\x80\xA2");
+    prefix_len = 1;
+  }
+
+  S_enter_container(state, node, prefix_len);
+  index = S_open_run(state, node, CMARK_STYLE_LIST_ITEM_PREFIX, 0, prefix_len);
+  S_outs(state, prefix);
+  S_outs(state, "\t");
+  S_close_run(state, index);
+}
+
+static void S_render_leaf(struct render_state *state, cmark_node *node,
+                          const unsigned char *data, bufsize_t len) {
+  size_t index = S_open_run(state, node, node->type, 0, 0);
+  S_out(state, data, len);
+  S_close_run(state, index);
+}
+
+static void S_render_node(cmark_iter *iter, cmark_node *node,
+                          cmark_event_type ev_type,
+                          struct render_state *state, int options) {
+  bool entering = (ev_type == CMARK_EVENT_ENTER);
+  cmark_chunk *literal;
+  size_t index;
+
+  switch (node->type) {
+  case CMARK_NODE_DOCUMENT:
+  case CMARK_NODE_EMPH:
+  case CMARK_NODE_STRONG:
+  case CMARK_NODE_STRIKETHROUGH:
+  case CMARK_NODE_LINK:
+  case CMARK_NODE_IMAGE:
+    if (entering) {
+      S_enter_container(state, node, 0);
+    } else {
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_BLOCK_QUOTE:
+  case CMARK_NODE_PARAGRAPH:
+    if (entering) {
+      S_enter_container(state, node, 0);
+    } else {
+      S_separate(state, node);
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_HEADING:
+    if (entering) {
+      S_enter_container(state, node, node->as.heading.level);
+    } else {
+      S_separate(state, node);
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_TABLE:
+    if (entering) {
+      S_enter_container(state, node, node->as.table.n_columns);
+    } else {
+      S_separate(state, node);
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_TABLE_ROW:
+    if (entering) {
+      S_enter_container(state, node, node->as.table_row_header);
+    } else {
+      if (node->next) {
+        S_out(state, LINE_SEPARATOR, 3);
+      }
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_TABLE_CELL:
+    if (entering) {
+      S_enter_container(state, node, node->as.table_cell_column);
+    } else {
+      if (node->next) {
+        S_outs(state, "\t");
+      }
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_LIST:
+    if (entering) {
+      state->lists = (struct list_state *)S_grow(
+          state->mem, state->lists, &state->lists_size, state->nlists,
+          sizeof(struct list_state));
+      state->lists[state->nlists].list_type = node->as.list.list_type;
+      state->lists[state->nlists].next_number = node->as.list.start;
+      state->nlists++;
+      S_enter_container(state, node, 0);
+    } else {
+      state->nlists--;
+      S_separate(state, node);
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_ITEM:
+    if (entering) {
+      S_enter_item(state, node);
+    } else {
+      S_separate(state, node);
+      S_exit_container(state, node);
+    }
+    break;
+
+  case CMARK_NODE_CODE_BLOCK:
+  case CMARK_NODE_HTML_BLOCK:
+    literal = node->type == CMARK_NODE_CODE_BLOCK ? &node->as.code.literal
+                                                  : &node->as.literal;
+    if (literal->len == 0) {
+      break;
+    }
+    index = S_open_run(state, node, node->type, 0, 0);
+    S_out_block_literal(state, literal->data, literal->len);
+    S_separate(state, node);
+    S_close_run(state, index);
+    break;
+
+  case CMARK_NODE_THEMATIC_BREAK:
+    S_render_leaf(state, node, THEMATIC_BREAK, 4);
+    break;
+
+  case CMARK_NODE_TEXT:
+  case CMARK_NODE_CODE:
+  case CMARK_NODE_HTML_INLINE:
+    if (node->as.literal.len > 0) {
+      S_render_leaf(state, node, node->as.literal.data, node->as.literal.len);
+    }
+    break;
+
+  case CMARK_NODE_SOFTBREAK:
+    if (options & CMARK_OPT_HARDBREAKS) {
+      S_render_leaf(state, node, LINE_SEPARATOR, 3);
+    } else {
+      S_render_leaf(state, node, (const unsigned char *)" ", 1);
+    }
+    break;
+
+  case CMARK_NODE_LINEBREAK:
+    S_render_leaf(state, node, LINE_SEPARATOR, 3);
+    break;
+
+  case CMARK_NODE_CUSTOM_BLOCK:
+  case CMARK_NODE_CUSTOM_INLINE:
+    // Custom nodes have no literal, so the visitor renders neither them
+    // nor their children.
+    if (entering) {
+      cmark_iter_reset(iter, node, CMARK_EVENT_EXIT);
+    }
+    break;
+
+  default:
+    assert(false);
+    break;
+  }
+}
+
+cmark_style_runs *cmark_render_style_runs(cmark_node *root, int options) {
+  cmark_strbuf text;
+  cmark_event_type ev_type;
+  cmark_node *cur;
+  cmark_iter *iter;
+  cmark_style_runs *result;
+  cmark_mem *mem;
+  struct render_state state;
+
+  if (root == NULL) {
+    return NULL;
+  }
+
+  mem = cmark_node_mem(root);
+  cmark_strbuf_init(mem, &text, 0);
+  memset(&state, 0, sizeof(state));
+  state.mem = mem;
+  state.text = &text;
+
+  iter = cmark_iter_new(root);
+  while ((ev_type = cmark_iter_next(iter)) != CMARK_EVENT_DONE) {
+    cur = cmark_iter_get_node(iter);
+    S_render_node(iter, cur, ev_type, &state, options);
+  }
+  cmark_iter_free(iter);
+  assert(state.nopen == 0);
+
+  result = (cmark_style_runs *)mem->calloc(1, sizeof(cmark_style_runs));
+  result->mem = mem;
+  result->text_len = text.size;
+  result->text = (char *)cmark_strbuf_detach(&text);
+  result->utf16_len = state.utf16_len;
+  result->runs = state.runs;
+  result->nruns = state.nruns;
+
+  mem->free(state.open);
+  mem->free(state.lists);
+  return result;
+}
+
+void cmark_style_runs_free(cmark_style_runs *runs) {
+  if (runs == NULL) {
+    return;
+  }
+  runs->mem->free(runs->text);
+  runs->mem->free(runs->runs);
+  runs->mem->free(runs);
+}
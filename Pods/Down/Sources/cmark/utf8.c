@@ -3,6 +3,7 @@
 #include <assert.h>
 
 #include "cmark_ctype.h"
+#include "simd.h"
 #include "utf8.h"
 
 static const int8_t utf8proc_utf8class[256] = {
@@ -107,6 +108,135 @@ static int utf8proc_valid(const uint8_t *str, bufsize_t str_len) {
   return length;
 }
 
+#ifdef CMARK_SIMD
+
+#ifdef CMARK_SIMD_SHUFFLE
+
+// Block validation by table lookup (Keiser and Lemire, "Validating UTF-8 In
+// Less Than One Instruction Per Byte").  Each byte is classified by the high
+// and low nibble of the byte before it and by its own high nibble; ANDing
+// the three lookups leaves a bit set only for an invalid pair.  Sequences of
+// three and four bytes are checked by requiring continuation bytes two and
+// three positions after their lead.
+
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uint8_t BYTE_1_HIGH[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};
+
+static const uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+static const uint8_t BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+        OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT};
+
+#ifdef __SSE2__
+#define simd_lookup(table, nibbles) _mm_shuffle_epi8((table), (nibbles))
+#define simd_high_nibbles(v)                                                   \
+  _mm_and_si128(_mm_srli_epi16((v), 4), _mm_set1_epi8(0x0F))
+#define simd_low_nibbles(v) _mm_and_si128((v), _mm_set1_epi8(0x0F))
+#define simd_prev(v, prev, n) _mm_alignr_epi8((v), (prev), 16 - (n))
+#define simd_subs(v, c) _mm_subs_epu8((v), _mm_set1_epi8((char)(c)))
+#else
+#define simd_lookup(table, nibbles) vqtbl1q_u8((table), (nibbles))
+#define simd_high_nibbles(v) vshrq_n_u8((v), 4)
+#define simd_low_nibbles(v) vandq_u8((v), vdupq_n_u8(0x0F))
+#define simd_prev(v, prev, n) vextq_u8((prev), (v), 16 - (n))
+#define simd_subs(v, c) vqsubq_u8((v), vdupq_n_u8(c))
+#endif
+
+static CMARK_INLINE cmark_simd_vec S_utf8_errors(cmark_simd_vec input,
+                                                 cmark_simd_vec prev) {
+  cmark_simd_vec prev1 = simd_prev(input, prev, 1);
+  cmark_simd_vec special =
+      simd_and(simd_and(simd_lookup(simd_load(BYTE_1_HIGH),
+                                    simd_high_nibbles(prev1)),
+                        simd_lookup(simd_load(BYTE_1_LOW),
+                                    simd_low_nibbles(prev1))),
+               simd_lookup(simd_load(BYTE_2_HIGH), simd_high_nibbles(input)));
+  // Only leads of three and four byte sequences reach 0x80 here.
+  cmark_simd_vec must_continue =
+      simd_and(simd_or(simd_subs(simd_prev(input, prev, 2), 0xE0 - 0x80),
+                       simd_subs(simd_prev(input, prev, 3), 0xF0 - 0x80)),
+               simd_splat(0x80));
+
+  return simd_or(simd_xor(must_continue, special),
+                 simd_eq(input, simd_splat(0)));
+}
+
+#endif
+
+bufsize_t cmark_simd_utf8_valid_prefix(const uint8_t *src, bufsize_t size) {
+  cmark_simd_vec prev = simd_splat(0);
+  bool prev_ascii = true;
+  bufsize_t i = 0, j;
+
+  for (; i + 16 <= size; i += 16) {
+    cmark_simd_vec input = simd_load(src + i);
+    bool ascii = !simd_any_high(input);
+
+    if (ascii && prev_ascii) {
+      if (simd_any(simd_eq(input, simd_splat(0))))
+        break;
+    } else {
+#ifdef CMARK_SIMD_SHUFFLE
+      if (simd_any(S_utf8_errors(input, prev)))
+        break;
+#else
+      // Without a byte shuffle only ASCII blocks are validated here.
+      (void)prev;
+      break;
+#endif
+    }
+    prev = input;
+    prev_ascii = ascii;
+  }
+
+  // Everything before 'i' is valid, but a character may straddle it:
+  // back up to its lead byte unless an ASCII byte ends the run first.
+  for (j = i; j > 0 && j > i - 3 && src[j - 1] >= 0x80; j--) {
+    if (src[j - 1] >= 0xC0)
+      return j - 1;
+  }
+  return i;
+}
+
+#endif
+
 void cmark_utf8proc_check(cmark_strbuf *ob, const uint8_t *line,
                           bufsize_t size) {
   bufsize_t i = 0;
@@ -115,6 +245,10 @@ void cmark_utf8proc_check(cmark_strbuf *ob, const uint8_t *line,
     bufsize_t org = i;
     int charlen = 0;
 
+#ifdef CMARK_SIMD
+    i += cmark_simd_utf8_valid_prefix(line + i, size - i);
+#endif
+
     while (i < size) {
       if (line[i] < 0x80 && line[i] != 0) {
         i++;
@@ -152,6 +286,11 @@ int cmark_utf8proc_iterate(const uint8_t *str, bufsize_t str_len,
   int length;
   int32_t uc = -1;
 
+  if (str_len > 0 && str[0] < 0x80) {
+    *dst = str[0];
+    return 1;
+  }
+
   *dst = -1;
   length = utf8proc_charlen(str, str_len);
   if (length < 0)
@@ -315,3 +454,119 @@ int cmark_utf8proc_is_punctuation(int32_t uc) {
       uc == 92917 || (uc >= 92983 && uc <= 92987) || uc == 92996 ||
       uc == 113823);
 }
+
+typedef struct {
+  int32_t first;
+  int32_t last;
+} width_range;
+
+// Code points that take no cell: combining marks, zero width spaces and
+// joiners, variation selectors and emoji skin tone modifiers.
+static const width_range ZERO_WIDTH[] = {
+    {0x0300, 0x036F},   {0x0483, 0x0489},   {0x0591, 0x05BD},
+    {0x0610, 0x061A},   {0x064B, 0x065F},   {0x0E31, 0x0E31},
+    {0x0E34, 0x0E3A},   {0x0E47, 0x0E4E},   {0x1160, 0x11FF},
+    {0x1AB0, 0x1AFF},   {0x1DC0, 0x1DFF},   {0x200B, 0x200F},
+    {0x2028, 0x202E},   {0x2060, 0x2064},   {0x20D0, 0x20FF},
+    {0x302A, 0x302D},   {0x3099, 0x309A},   {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F},   {0xFEFF, 0xFEFF},   {0x1F3FB, 0x1F3FF},
+    {0xE0000, 0xE0FFF},
+};
+
+// East Asian Wide and Fullwidth code points, and emoji presented as such.
+static const width_range DOUBLE_WIDTH[] = {
+    {0x1100, 0x115F},   {0x231A, 0x231B},   {0x2329, 0x232A},
+    {0x23E9, 0x23EC},   {0x23F0, 0x23F0},   {0x23F3, 0x23F3},
+    {0x25FD, 0x25FE},   {0x2614, 0x2615},   {0x2648, 0x2653},
+    {0x267F, 0x267F},   {0x2693, 0x2693},   {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB},   {0x26BD, 0x26BE},   {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE},   {0x26D4, 0x26D4},   {0x26EA, 0x26EA},
+    {0x26F2, 0x26F3},   {0x26F5, 0x26F5},   {0x26FA, 0x26FA},
+    {0x26FD, 0x26FD},   {0x2705, 0x2705},   {0x270A, 0x270B},
+    {0x2728, 0x2728},   {0x274C, 0x274C},   {0x274E, 0x274E},
+    {0x2753, 0x2755},   {0x2757, 0x2757},   {0x2795, 0x2797},
+    {0x27B0, 0x27B0},   {0x27BF, 0x27BF},   {0x2B1B, 0x2B1C},
+    {0x2B50, 0x2B50},   {0x2B55, 0x2B55},   {0x2E80, 0x303E},
+    {0x3041, 0x33FF},   {0x3400, 0x4DBF},   {0x4E00, 0x9FFF},
+    {0xA000, 0xA4CF},   {0xA960, 0xA97F},   {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF},   {0xFE10, 0xFE19},   {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x16FE0, 0x16FE4},
+    {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004},
+    {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A},
+    {0x1F200, 0x1F251}, {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF},
+    {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+static bool S_in_ranges(int32_t uc, const width_range *ranges, size_t count) {
+  size_t lo = 0, hi = count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (uc < ranges[mid].first) {
+      hi = mid;
+    } else if (uc > ranges[mid].last) {
+      lo = mid + 1;
+    } else {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Number of terminal cells taken by a code point: 0, 1 or 2.
+int cmark_utf8proc_width(int32_t uc) {
+  if (uc < 0x20 || (uc >= 0x7F && uc < 0xA0)) {
+    return 0;
+  }
+  if (uc < 0x300) {
+    return 1;
+  }
+  if (S_in_ranges(uc, ZERO_WIDTH, sizeof(ZERO_WIDTH) / sizeof(ZERO_WIDTH[0]))) {
+    return 0;
+  }
+  if (S_in_ranges(uc, DOUBLE_WIDTH,
+                  sizeof(DOUBLE_WIDTH) / sizeof(DOUBLE_WIDTH[0]))) {
+    return 2;
+  }
+  return 1;
+}
+
+// Adds the length of 'str' in UTF-16 code units and in display cells to
+// '*utf16_units' and '*cells'.  A code point following U+200D ZERO WIDTH
+// JOINER is part of the preceding emoji and takes no cell.  Invalid bytes
+// count as one unit and one cell each, like the U+FFFD they would become.
+void cmark_utf8proc_measure(const uint8_t *str, bufsize_t len,
+                            int32_t *utf16_units, int32_t *cells) {
+  bufsize_t i = 0;
+  int32_t units = 0, width = 0, uc;
+  bool joined = false;
+  int n;
+
+  while (i < len) {
+    if (str[i] < 0x80) {
+      units += 1;
+      width += str[i] >= 0x20 && str[i] != 0x7F;
+      joined = false;
+      i++;
+      continue;
+    }
+    n = cmark_utf8proc_iterate(str + i, len - i, &uc);
+    if (n < 0) {
+      units += 1;
+      width += 1;
+      joined = false;
+      i++;
+      continue;
+    }
+    units += uc >= 0x10000 ? 2 : 1;
+    if (!joined) {
+      width += cmark_utf8proc_width(uc);
+    }
+    joined = uc == 0x200D;
+    i += n;
+  }
+
+  *utf16_units += units;
+  *cells += width;
+}
@@ -16,6 +16,9 @@ void cmark_utf8proc_check(cmark_strbuf *dest, const uint8_t *line,
                           bufsize_t size);
 int cmark_utf8proc_is_space(int32_t uc);
 int cmark_utf8proc_is_punctuation(int32_t uc);
+int cmark_utf8proc_width(int32_t uc);
+void cmark_utf8proc_measure(const uint8_t *str, bufsize_t len,
+                            int32_t *utf16_units, int32_t *cells);
 
 #ifdef __cplusplus
 }
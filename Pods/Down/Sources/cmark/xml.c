@@ -90,10 +90,43 @@ static int S_render_node(cmark_node *node, cmark_event_type ev_type,
                (cmark_node_get_list_tight(node) ? "true" : "false"));
       cmark_strbuf_puts(xml, buffer);
       break;
+    case CMARK_NODE_ITEM:
+      if (node->as.list.task != CMARK_NO_TASK) {
+        cmark_strbuf_puts(xml, node->as.list.task == CMARK_TASK_CHECKED
+                                   ? " task=\"checked\""
+                                   : " task=\"unchecked\"");
+      }
+      break;
     case CMARK_NODE_HEADING:
       snprintf(buffer, BUFFER_SIZE, " level=\"%d\"", node->as.heading.level);
       cmark_strbuf_puts(xml, buffer);
       break;
+    case CMARK_NODE_TABLE:
+      snprintf(buffer, BUFFER_SIZE, " columns=\"%d\"",
+               node->as.table.n_columns);
+      cmark_strbuf_puts(xml, buffer);
+      break;
+    case CMARK_NODE_TABLE_ROW:
+      if (node->as.table_row_header) {
+        cmark_strbuf_puts(xml, " header=\"true\"");
+      }
+      break;
+    case CMARK_NODE_TABLE_CELL:
+      switch (cmark_node_get_table_alignment(node->parent->parent,
+                                             node->as.table_cell_column)) {
+      case CMARK_TABLE_ALIGN_LEFT:
+        cmark_strbuf_puts(xml, " align=\"left\"");
+        break;
+      case CMARK_TABLE_ALIGN_CENTER:
+        cmark_strbuf_puts(xml, " align=\"center\"");
+        break;
+      case CMARK_TABLE_ALIGN_RIGHT:
+        cmark_strbuf_puts(xml, " align=\"right\"");
+        break;
+      default:
+        break;
+      }
+      break;
     case CMARK_NODE_CODE_BLOCK:
       if (node->as.code.info.len > 0) {
         cmark_strbuf_puts(xml, " info=\"");
@@ -0,0 +1,615 @@
+// Crash recovery checks and cold start timing of PINDiskCacheJournal, the
+// metadata log PINDiskCache reads at startup.
+//
+// Build and run from this directory (Linux, for its getxattr):
+//
+//   cc -O2 -DNDEBUG -o disk_cache_journal_bench disk_cache_journal_bench.c
+//      ../Source/PINDiskCacheJournal.c -lpthread
+//   ./disk_cache_journal_bench [--quick] > result.json
+//
+// First appends random sets and removals, then reopens the journal cut at
+// every byte of its last records, as a crash mid-append leaves it. Each must
+// replay exactly the records before the cut, and take appends after it. A
+// bad checksum in the last record drops just that record; anywhere else, or
+// in the header, the journal comes back empty for a rebuild. Compaction must
+// replay the same entries from one record each, and a crash before its
+// commit must leave the old journal. Exits with 1 on failure.
+//
+// Then times a cold start over 20k cache files: reading the directory, then
+// stat and two getxattr calls per file, as PINDiskCache did, against
+// replaying a journal of three records per file. Both build the same table.
+// The page cache is warm for both, which flatters the directory read.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../Source/PINDiskCacheJournal.h"
+
+#define TRIALS 3
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+static char S_dir[64];
+
+static void S_path(char *path, size_t size, const char *name) {
+  snprintf(path, size, "%s/%s", S_dir, name);
+}
+
+// MARK: - Model
+
+#define MODEL_KEYS 96
+
+typedef struct {
+  bool live;
+  PINDiskCacheJournalMetadata metadata;
+} model_entry;
+
+typedef struct {
+  int key;
+  bool remove;
+  PINDiskCacheJournalMetadata metadata;
+  // File length once the record is appended.
+  off_t end;
+} model_op;
+
+static char S_keys[MODEL_KEYS][320];
+
+static void S_make_keys(void) {
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    // Some keys are long, like full URLs.
+    int length = snprintf(S_keys[key], sizeof(S_keys[key]), "https://example.com/image/%d", key);
+    if (key % 7 == 0) {
+      memset(S_keys[key] + length, 'x', 250);
+      S_keys[key][length + 250] = '\0';
+    }
+  }
+}
+
+static int S_key_index(const char *key, size_t keyLength) {
+  for (int index = 0; index < MODEL_KEYS; index++) {
+    if (strlen(S_keys[index]) == keyLength && memcmp(S_keys[index], key, keyLength) == 0) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+static void S_apply(model_entry *entries, const model_op *op) {
+  entries[op->key].live = !op->remove;
+  entries[op->key].metadata = op->metadata;
+}
+
+static void S_replay_model(void *context, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata) {
+  model_entry *entries = (model_entry *)context;
+  int index = S_key_index(key, keyLength);
+  if (index < 0) {
+    fprintf(stderr, "replayed an unknown key\n");
+    exit(1);
+  }
+  entries[index].live = metadata != NULL;
+  if (metadata != NULL) {
+    entries[index].metadata = *metadata;
+  }
+}
+
+static bool S_same_metadata(const PINDiskCacheJournalMetadata *a, const PINDiskCacheJournalMetadata *b) {
+  // NaN marks a missing date, and must come back as one.
+  return a->size == b->size && (a->createdAt == b->createdAt || (isnan(a->createdAt) && isnan(b->createdAt))) &&
+         a->modifiedAt == b->modifiedAt && a->ageLimit == b->ageLimit && a->accessCount == b->accessCount &&
+         a->slabLocation == b->slabLocation;
+}
+
+static bool S_same(const model_entry *expected, const model_entry *actual, const char *what) {
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    if (expected[key].live != actual[key].live ||
+        (expected[key].live && !S_same_metadata(&expected[key].metadata, &actual[key].metadata))) {
+      fprintf(stderr, "%s: key %d differs\n", what, key);
+      return false;
+    }
+  }
+  return true;
+}
+
+static model_op S_random_op(void) {
+  model_op op;
+  op.key = (int)S_random(MODEL_KEYS);
+  op.remove = S_random(5) == 0;
+  memset(&op.metadata, 0, sizeof(op.metadata));
+  if (!op.remove) {
+    op.metadata.size = S_random(1 << 20);
+    op.metadata.createdAt = S_random(10) == 0 ? NAN : 7e8 + S_random(1000000);
+    op.metadata.modifiedAt = 7e8 + S_random(1000000) + 0.25;
+    op.metadata.ageLimit = S_random(3) == 0 ? S_random(86400) : 0;
+    op.metadata.accessCount = S_random(1000);
+    op.metadata.slabLocation = S_random(4) == 0 ? ((uint64_t)(1 + S_random(100)) << 32) | S_random(1 << 22) : 0;
+  }
+  return op;
+}
+
+static bool S_append(PINDiskCacheJournal *journal, model_op *op) {
+  const char *key = S_keys[op->key];
+  bool appended = op->remove ? PINDiskCacheJournalAppendRemove(journal, key, strlen(key))
+                             : PINDiskCacheJournalAppendSet(journal, key, strlen(key), &op->metadata);
+  op->end = lseek(journal->fd, 0, SEEK_CUR);
+  return appended;
+}
+
+// Opens `path` and compares what it replays with the first `count` ops.
+static bool S_expect(const char *path, const model_op *ops, int count, PINDiskCacheJournalState expectedState, const char *what) {
+  model_entry expected[MODEL_KEYS];
+  model_entry actual[MODEL_KEYS];
+  memset(expected, 0, sizeof(expected));
+  memset(actual, 0, sizeof(actual));
+  for (int i = 0; i < count; i++) {
+    S_apply(expected, &ops[i]);
+  }
+  PINDiskCacheJournal journal;
+  PINDiskCacheJournalState state = PINDiskCacheJournalOpen(&journal, path, S_replay_model, actual);
+  PINDiskCacheJournalClose(&journal);
+  if (state != expectedState) {
+    fprintf(stderr, "%s: state %d, expected %d\n", what, state, expectedState);
+    return false;
+  }
+  if (state == PINDiskCacheJournalStateEmpty) {
+    return true;
+  }
+  return S_same(expected, actual, what);
+}
+
+static bool S_copy_prefix(const char *from, const char *to, off_t length) {
+  int in = open(from, O_RDONLY);
+  int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  char buffer[1 << 16];
+  off_t copied = 0;
+  bool ok = in >= 0 && out >= 0;
+  while (ok && copied < length) {
+    size_t chunk = (size_t)(length - copied) < sizeof(buffer) ? (size_t)(length - copied) : sizeof(buffer);
+    ok = read(in, buffer, chunk) == (ssize_t)chunk && write(out, buffer, chunk) == (ssize_t)chunk;
+    copied += (off_t)chunk;
+  }
+  if (in >= 0) {
+    close(in);
+  }
+  if (out >= 0) {
+    close(out);
+  }
+  return ok;
+}
+
+static bool S_flip_byte(const char *path, off_t offset) {
+  int fd = open(path, O_RDWR);
+  unsigned char byte = 0;
+  bool ok = fd >= 0 && pread(fd, &byte, 1, offset) == 1;
+  byte ^= 0x40;
+  ok = ok && pwrite(fd, &byte, 1, offset) == 1;
+  if (fd >= 0) {
+    close(fd);
+  }
+  return ok;
+}
+
+static void S_ignore_replay(void *context, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata) {
+  (void)context;
+  (void)key;
+  (void)keyLength;
+  (void)metadata;
+}
+
+static bool S_check(int opCount) {
+  char path[128];
+  char cut[128];
+  S_path(path, sizeof(path), "journal");
+  S_path(cut, sizeof(cut), "cut");
+  unlink(path);
+
+  model_op *ops = (model_op *)calloc((size_t)opCount + 1, sizeof(model_op));
+  PINDiskCacheJournal journal;
+  if (PINDiskCacheJournalOpen(&journal, path, S_ignore_replay, NULL) != PINDiskCacheJournalStateEmpty) {
+    fprintf(stderr, "a new journal isn't empty\n");
+    return false;
+  }
+  off_t headerEnd = lseek(journal.fd, 0, SEEK_CUR);
+  for (int i = 0; i < opCount; i++) {
+    ops[i] = S_random_op();
+    if (!S_append(&journal, &ops[i])) {
+      fprintf(stderr, "append failed\n");
+      return false;
+    }
+  }
+  PINDiskCacheJournalClose(&journal);
+  if (!S_expect(path, ops, opCount, PINDiskCacheJournalStateReplayed, "reopen")) {
+    return false;
+  }
+
+  // Cut at every byte of the last few records, and then some anywhere.
+  int tail = opCount < 4 ? opCount : 4;
+  off_t cutStart = ops[opCount - tail - 1 < 0 ? 0 : opCount - tail - 1].end;
+  if (opCount - tail - 1 < 0) {
+    cutStart = headerEnd;
+  }
+  for (int trial = 0; trial < 2; trial++) {
+    off_t end = ops[opCount - 1].end;
+    for (off_t length = trial == 0 ? cutStart : headerEnd; length <= end; length += trial == 0 ? 1 : 1 + S_random(997)) {
+      int complete = 0;
+      while (complete < opCount && ops[complete].end <= length) {
+        complete++;
+      }
+      if (!S_copy_prefix(path, cut, length) || !S_expect(cut, ops, complete, PINDiskCacheJournalStateReplayed, "cut")) {
+        fprintf(stderr, "cut at %lld of %lld\n", (long long)length, (long long)end);
+        return false;
+      }
+      // The torn record is gone, so an append lands after the last whole one.
+      model_op saved = ops[complete];
+      ops[complete] = S_random_op();
+      PINDiskCacheJournal reopened;
+      PINDiskCacheJournalOpen(&reopened, cut, S_ignore_replay, NULL);
+      bool appended = S_append(&reopened, &ops[complete]);
+      PINDiskCacheJournalClose(&reopened);
+      if (!appended || !S_expect(cut, ops, complete + 1, PINDiskCacheJournalStateReplayed, "append after cut")) {
+        fprintf(stderr, "cut at %lld of %lld\n", (long long)length, (long long)end);
+        return false;
+      }
+      ops[complete] = saved;
+    }
+  }
+
+  // A bad checksum in the last record drops it, like a tear.
+  off_t lastStart = opCount > 1 ? ops[opCount - 2].end : headerEnd;
+  if (!S_copy_prefix(path, cut, ops[opCount - 1].end) || !S_flip_byte(cut, ops[opCount - 1].end - 1) ||
+      !S_expect(cut, ops, opCount - 1, PINDiskCacheJournalStateReplayed, "bad last record")) {
+    return false;
+  }
+  // Anywhere else it fails validation, whether in the body, the length or the header.
+  off_t corruptions[] = {ops[opCount / 2].end - 3, ops[opCount / 2].end, lastStart - 1, 2, 9, 13};
+  for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); i++) {
+    if (!S_copy_prefix(path, cut, ops[opCount - 1].end) || !S_flip_byte(cut, corruptions[i]) ||
+        !S_expect(cut, ops, 0, PINDiskCacheJournalStateEmpty, "corrupt record")) {
+      fprintf(stderr, "corrupt byte %lld\n", (long long)corruptions[i]);
+      return false;
+    }
+    // And is left empty, not replaying what came before the corruption.
+    if (!S_expect(cut, ops, 0, PINDiskCacheJournalStateReplayed, "after corruption")) {
+      return false;
+    }
+  }
+
+  // Compaction keeps one record per live entry.
+  model_entry live[MODEL_KEYS];
+  memset(live, 0, sizeof(live));
+  for (int i = 0; i < opCount; i++) {
+    S_apply(live, &ops[i]);
+  }
+  PINDiskCacheJournalOpen(&journal, path, S_ignore_replay, NULL);
+  uint32_t liveCount = 0;
+  bool rewritten = PINDiskCacheJournalBeginRewrite(&journal);
+  for (int key = 0; key < MODEL_KEYS && rewritten; key++) {
+    if (live[key].live) {
+      rewritten = PINDiskCacheJournalRewriteSet(&journal, S_keys[key], strlen(S_keys[key]), &live[key].metadata);
+      liveCount++;
+    }
+  }
+  // A crash before the commit leaves the old journal.
+  char rewritePath[160];
+  snprintf(rewritePath, sizeof(rewritePath), "%s.new", path);
+  if (!rewritten || access(rewritePath, F_OK) != 0) {
+    fprintf(stderr, "rewrite failed\n");
+    return false;
+  }
+  if (!S_expect(path, ops, opCount, PINDiskCacheJournalStateReplayed, "crash before commit") ||
+      access(rewritePath, F_OK) == 0) {
+    fprintf(stderr, "an uncommitted rewrite survived\n");
+    return false;
+  }
+  // Reopening removed the new file under the open rewrite, so start again.
+  PINDiskCacheJournalAbortRewrite(&journal);
+  rewritten = PINDiskCacheJournalBeginRewrite(&journal);
+  for (int key = 0; key < MODEL_KEYS && rewritten; key++) {
+    if (live[key].live) {
+      rewritten = PINDiskCacheJournalRewriteSet(&journal, S_keys[key], strlen(S_keys[key]), &live[key].metadata);
+    }
+  }
+  if (!rewritten || !PINDiskCacheJournalCommitRewrite(&journal) || journal.recordCount != liveCount) {
+    fprintf(stderr, "compaction failed\n");
+    return false;
+  }
+  // Appends go to the compacted file.
+  ops[opCount] = S_random_op();
+  bool appended = S_append(&journal, &ops[opCount]);
+  PINDiskCacheJournalClose(&journal);
+  if (!appended || !S_expect(path, ops, opCount + 1, PINDiskCacheJournalStateReplayed, "compacted")) {
+    return false;
+  }
+
+  // Compaction is worth it once most records are superseded, and not for small journals.
+  journal.fd = 3;
+  journal.recordCount = 1000;
+  bool small = PINDiskCacheJournalShouldCompact(&journal, 10);
+  journal.recordCount = 100000;
+  bool superseded = PINDiskCacheJournalShouldCompact(&journal, 1000) && PINDiskCacheJournalShouldCompact(&journal, 20000);
+  bool needed = PINDiskCacheJournalShouldCompact(&journal, 30000);
+  if (small || !superseded || needed) {
+    fprintf(stderr, "compaction threshold is off\n");
+    return false;
+  }
+
+  // Without a place to write, nothing is journaled.
+  PINDiskCacheJournalState state = PINDiskCacheJournalOpen(&journal, "/nonexistent/dir/journal", S_ignore_replay, NULL);
+  bool unavailable = state == PINDiskCacheJournalStateUnavailable && !PINDiskCacheJournalIsOpen(&journal) &&
+                     !PINDiskCacheJournalAppendRemove(&journal, "a", 1);
+  PINDiskCacheJournalClose(&journal);
+  if (!unavailable) {
+    fprintf(stderr, "an unwritable journal claims to be open\n");
+    return false;
+  }
+
+  unlink(cut);
+  unlink(path);
+  free(ops);
+  return true;
+}
+
+// MARK: - Cold start
+
+// The table both cold starts build, keyed by file name.
+typedef struct {
+  char *key;
+  PINDiskCacheJournalMetadata metadata;
+  bool live;
+} table_slot;
+
+typedef struct {
+  table_slot *slots;
+  size_t capacity;
+  size_t count;
+} table;
+
+static uint64_t S_hash(const char *key, size_t length) {
+  uint64_t hash = 1469598103934665603ull;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)key[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static void S_table_set(table *t, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata) {
+  size_t mask = t->capacity - 1;
+  for (size_t i = S_hash(key, keyLength) & mask;; i = (i + 1) & mask) {
+    table_slot *slot = &t->slots[i];
+    if (slot->key == NULL) {
+      if (metadata == NULL) {
+        return;
+      }
+      slot->key = strndup(key, keyLength);
+      slot->live = true;
+      slot->metadata = *metadata;
+      t->count++;
+      return;
+    }
+    if (strlen(slot->key) == keyLength && memcmp(slot->key, key, keyLength) == 0) {
+      if (slot->live != (metadata != NULL)) {
+        t->count += metadata != NULL ? 1 : (size_t)-1;
+      }
+      slot->live = metadata != NULL;
+      if (metadata != NULL) {
+        slot->metadata = *metadata;
+      }
+      return;
+    }
+  }
+}
+
+static void S_table_replay(void *context, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata) {
+  S_table_set((table *)context, key, keyLength, metadata);
+}
+
+static void S_table_init(table *t, size_t entries) {
+  t->capacity = 1;
+  while (t->capacity < entries * 2) {
+    t->capacity *= 2;
+  }
+  t->slots = (table_slot *)calloc(t->capacity, sizeof(table_slot));
+  t->count = 0;
+}
+
+static void S_table_free(table *t) {
+  for (size_t i = 0; i < t->capacity; i++) {
+    free(t->slots[i].key);
+  }
+  free(t->slots);
+}
+
+static const char *S_age_limit_attribute = "user.com.pinterest.PINDiskCache.ageLimit";
+static const char *S_access_count_attribute = "user.com.pinterest.PINDiskCache.accessCount";
+
+static size_t S_directory_start(const char *cacheDir, table *t) {
+  DIR *dir = opendir(cacheDir);
+  struct dirent *entry;
+  char path[512];
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", cacheDir, entry->d_name);
+    struct stat info;
+    PINDiskCacheJournalMetadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    if (stat(path, &info) == 0) {
+      metadata.size = (uint64_t)info.st_blocks * 512;
+      metadata.createdAt = (double)info.st_ctime;
+      metadata.modifiedAt = (double)info.st_mtime;
+    }
+    if (getxattr(path, S_age_limit_attribute, &metadata.ageLimit, sizeof(metadata.ageLimit)) < 0) {
+      metadata.ageLimit = 0;
+    }
+    if (getxattr(path, S_access_count_attribute, &metadata.accessCount, sizeof(metadata.accessCount)) < 0) {
+      metadata.accessCount = 0;
+    }
+    S_table_set(t, entry->d_name, strlen(entry->d_name), &metadata);
+  }
+  closedir(dir);
+  return t->count;
+}
+
+static size_t S_journal_start(const char *journalPath, table *t) {
+  PINDiskCacheJournal journal;
+  PINDiskCacheJournalOpen(&journal, journalPath, S_table_replay, t);
+  PINDiskCacheJournalClose(&journal);
+  return t->count;
+}
+
+static void S_remove_tree(const char *cacheDir) {
+  DIR *dir = opendir(cacheDir);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent *entry;
+  char path[512];
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      snprintf(path, sizeof(path), "%s/%s", cacheDir, entry->d_name);
+      unlink(path);
+    }
+  }
+  closedir(dir);
+  rmdir(cacheDir);
+}
+
+int main(int argc, char **argv) {
+  int opCount = 3000;
+  int files = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      opCount = 300;
+      files = 2000;
+    }
+  }
+  snprintf(S_dir, sizeof(S_dir), "/tmp/pin_journal_bench_%d", (int)getpid());
+  mkdir(S_dir, 0755);
+  S_make_keys();
+  if (!S_check(opCount)) {
+    return 1;
+  }
+
+  char cacheDir[128];
+  char journalPath[160];
+  S_path(cacheDir, sizeof(cacheDir), "cache");
+  snprintf(journalPath, sizeof(journalPath), "%s/.PINDiskCacheJournal", cacheDir);
+  mkdir(cacheDir, 0755);
+
+  PINDiskCacheJournal journal;
+  PINDiskCacheJournalOpen(&journal, journalPath, S_ignore_replay, NULL);
+  char name[64];
+  char path[512];
+  char content[2048];
+  memset(content, 'p', sizeof(content));
+  bool attributes = true;
+  double appendSeconds = 0;
+  for (int i = 0; i < files; i++) {
+    snprintf(name, sizeof(name), "https%%3A%%2F%%2Fexample%%2Ecom%%2F%d%%2Ejpg", i);
+    snprintf(path, sizeof(path), "%s/%s", cacheDir, name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, content, 512 + S_random(1536)) < 0) {
+      fprintf(stderr, "can't write %s\n", path);
+      return 1;
+    }
+    close(fd);
+    double ageLimit = 3600;
+    int64_t accessCount = 3;
+    attributes = attributes && setxattr(path, S_age_limit_attribute, &ageLimit, sizeof(ageLimit), 0) == 0 &&
+                 setxattr(path, S_access_count_attribute, &accessCount, sizeof(accessCount), 0) == 0;
+    // The file's record, then two accesses, as a journal between compactions holds.
+    PINDiskCacheJournalMetadata metadata = {2048, 7e8 + i, 7e8 + i, ageLimit, 1, 0};
+    double start = S_now();
+    for (int record = 0; record < 3; record++) {
+      metadata.accessCount = record + 1;
+      metadata.modifiedAt += record;
+      PINDiskCacheJournalAppendSet(&journal, name, strlen(name), &metadata);
+    }
+    appendSeconds += S_now() - start;
+  }
+  PINDiskCacheJournalClose(&journal);
+  struct stat journalInfo;
+  stat(journalPath, &journalInfo);
+
+  double directoryBest = 1e30;
+  double journalBest = 1e30;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    table t;
+    S_table_init(&t, (size_t)files);
+    double start = S_now();
+    size_t count = S_directory_start(cacheDir, &t);
+    double elapsed = S_now() - start;
+    S_table_free(&t);
+    if (count != (size_t)files) {
+      fprintf(stderr, "the directory has %zu files, expected %d\n", count, files);
+      return 1;
+    }
+    directoryBest = elapsed < directoryBest ? elapsed : directoryBest;
+
+    S_table_init(&t, (size_t)files);
+    start = S_now();
+    count = S_journal_start(journalPath, &t);
+    elapsed = S_now() - start;
+    S_table_free(&t);
+    if (count != (size_t)files) {
+      fprintf(stderr, "the journal has %zu entries, expected %d\n", count, files);
+      return 1;
+    }
+    journalBest = elapsed < journalBest ? elapsed : journalBest;
+  }
+
+  // Compacting it down to one record per file.
+  table t;
+  S_table_init(&t, (size_t)files);
+  PINDiskCacheJournalOpen(&journal, journalPath, S_table_replay, &t);
+  double start = S_now();
+  bool compacted = PINDiskCacheJournalBeginRewrite(&journal);
+  for (size_t i = 0; i < t.capacity && compacted; i++) {
+    if (t.slots[i].key != NULL && t.slots[i].live) {
+      compacted = PINDiskCacheJournalRewriteSet(&journal, t.slots[i].key, strlen(t.slots[i].key), &t.slots[i].metadata);
+    }
+  }
+  compacted = compacted && PINDiskCacheJournalCommitRewrite(&journal);
+  double compactSeconds = S_now() - start;
+  PINDiskCacheJournalClose(&journal);
+  S_table_free(&t);
+  struct stat compactedInfo;
+  stat(journalPath, &compactedInfo);
+  if (!compacted) {
+    fprintf(stderr, "compaction failed\n");
+    return 1;
+  }
+
+  S_remove_tree(cacheDir);
+  rmdir(S_dir);
+
+  printf("{\n  \"files\": %d,\n  \"xattrs\": %s,\n", files, attributes ? "true" : "false");
+  printf("  \"cold_start_ms\": {\"directory_stat_xattr\": %.2f, \"journal_replay\": %.2f},\n", directoryBest * 1e3,
+         journalBest * 1e3);
+  printf("  \"journal_kb\": {\"three_records_per_file\": %lld, \"compacted\": %lld},\n",
+         (long long)journalInfo.st_size / 1024, (long long)compactedInfo.st_size / 1024);
+  printf("  \"append_us\": %.2f,\n  \"compact_ms\": %.2f\n}\n", appendSeconds / (files * 3.0) * 1e6,
+         compactSeconds * 1e3);
+  return 0;
+}
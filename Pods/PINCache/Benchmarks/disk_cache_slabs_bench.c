@@ -0,0 +1,735 @@
+// Checks and throughput of PINDiskCacheSlabs, the store PINDiskCache packs
+// small objects into, against a file per object.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -o disk_cache_slabs_bench disk_cache_slabs_bench.c
+//      ../Source/PINDiskCacheSlabs.c
+//   ./disk_cache_slabs_bench [--quick] > result.json
+//
+// First runs random sets, reads and removals against a model, with the
+// store reopened now and then and its records retained from the model, as
+// PINDiskCache does from its journal. Every read must return the last data
+// set for the key. Compaction must keep every record in use readable at its
+// new location and shrink the slabs. Reopening after a record is cut off,
+// as a crash mid-append leaves it, must keep the records before it and fail
+// that one; a flipped byte must fail its record's read, and files that
+// aren't slabs are removed. Exits with 1 on failure.
+//
+// Then, for objects of 1 KB to 64 KB, times writing, reading in random order
+// and removing half of them, with compaction, both ways, and reports the
+// allocated size of each on disk. Files are written to a temporary file and
+// renamed, and stat'ed after, as NSDataWritingAtomic and PINDiskCache do.
+// The page cache is warm throughout, and nothing is fsync'ed.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../Source/PINDiskCacheSlabs.h"
+
+#define TRIALS 3
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+static char S_dir[64];
+
+static void S_path(char *path, size_t size, const char *name) {
+  snprintf(path, size, "%s/%s", S_dir, name);
+}
+
+static void S_remove_directory(const char *path) {
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent *entry;
+  char child[512];
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+      unlink(child);
+    }
+  }
+  closedir(dir);
+  rmdir(path);
+}
+
+// Allocated bytes of the files in a directory, as NSURLTotalFileAllocatedSizeKey reports.
+static uint64_t S_disk_usage(const char *path) {
+  DIR *dir = opendir(path);
+  struct dirent *entry;
+  char child[512];
+  uint64_t usage = 0;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+      struct stat info;
+      if (stat(child, &info) == 0) {
+        usage += (uint64_t)info.st_blocks * 512;
+      }
+    }
+  }
+  closedir(dir);
+  return usage;
+}
+
+// Object contents follow from the key and a version, so the model needn't hold them.
+static void S_fill(char *data, size_t length, int key, uint32_t version) {
+  uint64_t state = ((uint64_t)key << 32 | version) * 0x9E3779B97F4A7C15ull + 1;
+  for (size_t i = 0; i < length; i++) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    data[i] = (char)(state >> 56);
+  }
+}
+
+// MARK: - Model
+
+#define MODEL_KEYS 200
+#define MODEL_MAX_LENGTH 20000
+
+typedef struct {
+  PINDiskCacheSlabLocation location;
+  uint32_t version;
+  uint32_t length;
+} model_entry;
+
+static model_entry S_model[MODEL_KEYS];
+static char S_keys[MODEL_KEYS][64];
+
+static int S_key_index(const char *key, size_t keyLength) {
+  for (int index = 0; index < MODEL_KEYS; index++) {
+    if (strlen(S_keys[index]) == keyLength && memcmp(S_keys[index], key, keyLength) == 0) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+static size_t S_record_length(int key) {
+  return PINDiskCacheSlabRecordLength(strlen(S_keys[key]), S_model[key].length);
+}
+
+static bool S_model_live(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location) {
+  (void)context;
+  int index = S_key_index(key, keyLength);
+  return index >= 0 && S_model[index].location == location;
+}
+
+static int S_moves;
+
+static void S_model_moved(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location) {
+  (void)context;
+  int index = S_key_index(key, keyLength);
+  if (index < 0) {
+    fprintf(stderr, "moved an unknown key\n");
+    exit(1);
+  }
+  S_model[index].location = location;
+  S_moves++;
+}
+
+static bool S_read_matches(PINDiskCacheSlabStore *store, int key, char *expected) {
+  const void *data = NULL;
+  size_t length = 0;
+  if (!PINDiskCacheSlabStoreRead(store, S_model[key].location, S_keys[key], strlen(S_keys[key]), &data, &length)) {
+    fprintf(stderr, "key %d doesn't read\n", key);
+    return false;
+  }
+  S_fill(expected, S_model[key].length, key, S_model[key].version);
+  if (length != S_model[key].length || memcmp(data, expected, length) != 0) {
+    fprintf(stderr, "key %d reads the wrong data\n", key);
+    return false;
+  }
+  return true;
+}
+
+static bool S_check_all(PINDiskCacheSlabStore *store, char *expected, const char *what) {
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    if (S_model[key].location != PINDiskCacheSlabLocationNone && !S_read_matches(store, key, expected)) {
+      fprintf(stderr, "after %s\n", what);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reopens the store and retains the model's records, as PINDiskCache does from its journal.
+static bool S_reopen(PINDiskCacheSlabStore *store, const char *directory) {
+  PINDiskCacheSlabStoreClose(store);
+  if (!PINDiskCacheSlabStoreOpen(store, directory)) {
+    fprintf(stderr, "can't reopen\n");
+    return false;
+  }
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    if (S_model[key].location != PINDiskCacheSlabLocationNone &&
+        !PINDiskCacheSlabStoreRetain(store, S_model[key].location, S_record_length(key))) {
+      fprintf(stderr, "can't retain key %d\n", key);
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint64_t S_live_length(const PINDiskCacheSlabStore *store) {
+  uint64_t live = 0;
+  for (size_t i = 0; i < store->slabCount; i++) {
+    live += store->slabs[i].liveLength;
+  }
+  return live;
+}
+
+static uint64_t S_model_length(void) {
+  uint64_t length = 0;
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    if (S_model[key].location != PINDiskCacheSlabLocationNone) {
+      length += S_record_length(key);
+    }
+  }
+  return length;
+}
+
+static uint64_t S_slab_length(const PINDiskCacheSlabStore *store) {
+  uint64_t length = 0;
+  for (size_t i = 0; i < store->slabCount; i++) {
+    length += store->slabs[i].length;
+  }
+  return length;
+}
+
+static const PINDiskCacheSlab *S_find_slab(const PINDiskCacheSlabStore *store, PINDiskCacheSlabLocation location) {
+  for (size_t i = 0; i < store->slabCount; i++) {
+    if (store->slabs[i].identifier == (uint32_t)(location >> 32)) {
+      return &store->slabs[i];
+    }
+  }
+  return NULL;
+}
+
+static bool S_truncate(const char *path, off_t length) {
+  return truncate(path, length) == 0;
+}
+
+static bool S_flip_byte(const char *path, off_t offset) {
+  int fd = open(path, O_RDWR);
+  unsigned char byte = 0;
+  bool ok = fd >= 0 && pread(fd, &byte, 1, offset) == 1;
+  byte ^= 0x40;
+  ok = ok && pwrite(fd, &byte, 1, offset) == 1;
+  if (fd >= 0) {
+    close(fd);
+  }
+  return ok;
+}
+
+static void S_slab_path(char *path, size_t size, const char *directory, PINDiskCacheSlabLocation location) {
+  snprintf(path, size, "%s/%08x.slab", directory, (uint32_t)(location >> 32));
+}
+
+static bool S_check(int opCount) {
+  char directory[128];
+  S_path(directory, sizeof(directory), "check");
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    // Some keys are long, like full URLs.
+    snprintf(S_keys[key], sizeof(S_keys[key]), key % 9 == 0 ? "https://example.com/images/large/%d.jpg" : "k%d", key);
+  }
+  memset(S_model, 0, sizeof(S_model));
+  char *data = (char *)malloc(MODEL_MAX_LENGTH);
+  char *expected = (char *)malloc(MODEL_MAX_LENGTH);
+
+  // Small slabs, so records spread over many.
+  PINDiskCacheSlabStore store;
+  PINDiskCacheSlabStoreInit(&store, 64 * 1024);
+  bool spread = false;
+  if (!PINDiskCacheSlabStoreOpen(&store, directory)) {
+    fprintf(stderr, "can't open\n");
+    return false;
+  }
+  for (int op = 0; op < opCount; op++) {
+    int key = (int)S_random(MODEL_KEYS);
+    uint32_t choice = S_random(100);
+    if (choice < 45) {
+      uint32_t length = S_random(8) == 0 ? 0 : S_random(MODEL_MAX_LENGTH);
+      uint32_t version = S_model[key].version + 1;
+      S_fill(data, length, key, version);
+      PINDiskCacheSlabLocation location = PINDiskCacheSlabStoreAppend(&store, S_keys[key], strlen(S_keys[key]), data, length);
+      if (location == PINDiskCacheSlabLocationNone) {
+        fprintf(stderr, "append failed\n");
+        return false;
+      }
+      if (S_model[key].location != PINDiskCacheSlabLocationNone) {
+        PINDiskCacheSlabStoreRelease(&store, S_model[key].location, S_record_length(key));
+      }
+      S_model[key].location = location;
+      S_model[key].version = version;
+      S_model[key].length = length;
+    } else if (choice < 60) {
+      if (S_model[key].location != PINDiskCacheSlabLocationNone) {
+        PINDiskCacheSlabStoreRelease(&store, S_model[key].location, S_record_length(key));
+        S_model[key].location = PINDiskCacheSlabLocationNone;
+      }
+    } else if (choice < 97) {
+      if (S_model[key].location != PINDiskCacheSlabLocationNone && !S_read_matches(&store, key, expected)) {
+        return false;
+      }
+    } else if (!S_reopen(&store, directory)) {
+      return false;
+    }
+
+    // What's in use is exactly the model's records.
+    if (S_live_length(&store) != S_model_length()) {
+      fprintf(stderr, "%llu bytes in use, expected %llu\n", (unsigned long long)S_live_length(&store),
+              (unsigned long long)S_model_length());
+      return false;
+    }
+    for (size_t i = 0; i < store.slabCount; i++) {
+      if (store.slabs[i].length > store.slabs[i].capacity) {
+        fprintf(stderr, "slab %zu outgrew its capacity\n", i);
+        return false;
+      }
+    }
+    if (op % 50 == 49 && PINDiskCacheSlabStoreShouldCompact(&store)) {
+      // The older slab with the least in use goes.
+      uint32_t sparsest = 0;
+      double sparsestUse = 1;
+      for (size_t i = 0; i + 1 < store.slabCount; i++) {
+        double use = (double)store.slabs[i].liveLength / store.slabs[i].length;
+        if (use < sparsestUse) {
+          sparsest = store.slabs[i].identifier;
+          sparsestUse = use;
+        }
+      }
+      uint64_t before = S_slab_length(&store);
+      size_t slabs = store.slabCount;
+      bool compacted = PINDiskCacheSlabStoreCompact(&store, S_model_live, S_model_moved, NULL);
+      for (size_t i = 0; i < store.slabCount; i++) {
+        compacted = compacted && store.slabs[i].identifier != sparsest;
+      }
+      if (!compacted || !S_check_all(&store, expected, "compaction") || S_live_length(&store) != S_model_length() ||
+          S_slab_length(&store) >= before + 64 * 1024 || store.slabCount > slabs) {
+        fprintf(stderr, "compaction failed\n");
+        return false;
+      }
+    }
+    if (store.slabCount > 1) {
+      spread = true;
+    }
+  }
+  if (!spread) {
+    fprintf(stderr, "every record fit in one slab\n");
+    return false;
+  }
+  if (S_moves == 0) {
+    fprintf(stderr, "compaction never moved a record\n");
+    return false;
+  }
+
+  // Compacting until there's nothing to do leaves at most the newest slab half empty.
+  while (PINDiskCacheSlabStoreShouldCompact(&store)) {
+    if (!PINDiskCacheSlabStoreCompact(&store, S_model_live, S_model_moved, NULL)) {
+      fprintf(stderr, "compaction failed\n");
+      return false;
+    }
+  }
+  for (size_t i = 0; i + 1 < store.slabCount; i++) {
+    if ((uint64_t)store.slabs[i].liveLength * 2 <= store.slabs[i].length) {
+      fprintf(stderr, "slab %zu is mostly released\n", i);
+      return false;
+    }
+  }
+  // And deletes the files of the slabs it compacted.
+  DIR *listing = opendir(directory);
+  size_t files = 0;
+  for (struct dirent *entry; (entry = readdir(listing)) != NULL;) {
+    files += entry->d_name[0] != '.';
+  }
+  closedir(listing);
+  if (files != store.slabCount) {
+    fprintf(stderr, "%zu slab files for %zu slabs\n", files, store.slabCount);
+    return false;
+  }
+  if (!S_check_all(&store, expected, "full compaction") || !S_reopen(&store, directory) ||
+      !S_check_all(&store, expected, "reopening")) {
+    return false;
+  }
+
+  // Another key of the same length, a prefix of the key, a location past the end and a slab that
+  // isn't there don't read.
+  int present = -1;
+  for (int key = 10; key < MODEL_KEYS && present < 0; key++) {
+    if (S_model[key].location != PINDiskCacheSlabLocationNone && S_model[key].length >= 1000 && key % 9 != 0) {
+      present = key;
+    }
+  }
+  const void *read = NULL;
+  size_t readLength = 0;
+  char other[64];
+  char prefix[64];
+  snprintf(other, sizeof(other), "%s", S_keys[present]);
+  other[strlen(other) - 1] ^= 1;
+  snprintf(prefix, sizeof(prefix), "%s", S_keys[present]);
+  prefix[strlen(prefix) - 1] = '\0';
+  PINDiskCacheSlabLocation slabStart = (S_model[present].location & ~(uint64_t)UINT32_MAX) | 16;
+  if (present < 0 || PINDiskCacheSlabStoreRead(&store, S_model[present].location, other, strlen(other), &read, &readLength) ||
+      PINDiskCacheSlabStoreRead(&store, S_model[present].location, prefix, strlen(prefix), &read, &readLength) ||
+      PINDiskCacheSlabStoreRetain(&store, slabStart, S_find_slab(&store, slabStart)->length - 16) ||
+      PINDiskCacheSlabStoreRead(&store, S_model[present].location + 8, S_keys[present], strlen(S_keys[present]), &read, &readLength) ||
+      PINDiskCacheSlabStoreRead(&store, S_model[present].location + 3, S_keys[present], strlen(S_keys[present]), &read, &readLength) ||
+      PINDiskCacheSlabStoreRead(&store, ((uint64_t)0xFFFFFF << 32) | 16, S_keys[present], strlen(S_keys[present]), &read, &readLength) ||
+      PINDiskCacheSlabStoreRetain(&store, ((uint64_t)0xFFFFFF << 32) | 16, 64) ||
+      PINDiskCacheSlabStoreRetain(&store, S_model[present].location, 1ull << 31)) {
+    fprintf(stderr, "read or retained a record that isn't there\n");
+    return false;
+  }
+  // Records too long for a slab aren't packed.
+  char *large = (char *)calloc(64 * 1024, 1);
+  // 65,520 bytes fill a slab after its header.
+  bool packedLarge = PINDiskCacheSlabStoreAppend(&store, "large", 5, large, 65500) != PINDiskCacheSlabLocationNone;
+  PINDiskCacheSlabLocation largest = PINDiskCacheSlabStoreAppend(&store, "large", 5, large, 65499);
+  PINDiskCacheSlabStoreRelease(&store, largest, PINDiskCacheSlabRecordLength(5, 65499));
+  free(large);
+  if (packedLarge || largest == PINDiskCacheSlabLocationNone) {
+    fprintf(stderr, "packed a record longer than a slab\n");
+    return false;
+  }
+
+  // A record cut off by a crash mid-append fails, and those before it don't.
+  int last = (present + 1) % MODEL_KEYS;
+  S_fill(data, 3000, last, ++S_model[last].version);
+  if (S_model[last].location != PINDiskCacheSlabLocationNone) {
+    PINDiskCacheSlabStoreRelease(&store, S_model[last].location, S_record_length(last));
+  }
+  PINDiskCacheSlabLocation cut = PINDiskCacheSlabStoreAppend(&store, S_keys[last], strlen(S_keys[last]), data, 3000);
+  S_model[last].location = cut;
+  S_model[last].length = 3000;
+  char slabPath[192];
+  S_slab_path(slabPath, sizeof(slabPath), directory, cut);
+  PINDiskCacheSlabStoreClose(&store);
+  if (!S_truncate(slabPath, (off_t)(uint32_t)cut + 1000) || !PINDiskCacheSlabStoreOpen(&store, directory) ||
+      PINDiskCacheSlabStoreRetain(&store, cut, S_record_length(last)) ||
+      PINDiskCacheSlabStoreRead(&store, cut, S_keys[last], strlen(S_keys[last]), &read, &readLength)) {
+    fprintf(stderr, "a cut record survived\n");
+    return false;
+  }
+  S_model[last].location = PINDiskCacheSlabLocationNone;
+  if (!S_reopen(&store, directory) || !S_check_all(&store, expected, "a cut")) {
+    return false;
+  }
+  // Appends go on after the cut.
+  S_fill(data, 3000, last, ++S_model[last].version);
+  S_model[last].location = PINDiskCacheSlabStoreAppend(&store, S_keys[last], strlen(S_keys[last]), data, 3000);
+  if (S_model[last].location == PINDiskCacheSlabLocationNone || !S_check_all(&store, expected, "appending after a cut") ||
+      !S_reopen(&store, directory) || !S_check_all(&store, expected, "reopening after a cut")) {
+    return false;
+  }
+
+  // A flipped byte in the key or the data fails the record.
+  PINDiskCacheSlabStoreClose(&store);
+  S_slab_path(slabPath, sizeof(slabPath), directory, S_model[present].location);
+  off_t recordStart = (off_t)(uint32_t)S_model[present].location;
+  off_t dataStart = recordStart + 16 + (off_t)strlen(S_keys[present]);
+  off_t flips[] = {recordStart + 16, dataStart + S_model[present].length / 2, dataStart + S_model[present].length - 1};
+  for (size_t i = 0; i < sizeof(flips) / sizeof(flips[0]); i++) {
+    bool failed = S_flip_byte(slabPath, flips[i]) && PINDiskCacheSlabStoreOpen(&store, directory) &&
+                  !PINDiskCacheSlabStoreRead(&store, S_model[present].location, S_keys[present], strlen(S_keys[present]), &read, &readLength);
+    PINDiskCacheSlabStoreClose(&store);
+    if (!failed || !S_flip_byte(slabPath, flips[i])) {
+      fprintf(stderr, "a flipped byte went unnoticed\n");
+      return false;
+    }
+  }
+
+  // Files that aren't slabs, or slabs with a bad header, are removed.
+  char stray[192];
+  snprintf(stray, sizeof(stray), "%s/notes.txt", directory);
+  int fd = open(stray, O_WRONLY | O_CREAT, 0644);
+  if (fd >= 0) {
+    close(fd);
+  }
+  char badHeader[192];
+  char badVersion[192];
+  snprintf(badHeader, sizeof(badHeader), "%s/%08x.slab", directory, 0x7FFFFFu);
+  snprintf(badVersion, sizeof(badVersion), "%s/%08x.slab", directory, 0x7FFFFEu);
+  uint32_t header[4] = {0, 0, 2, 0x01020304};
+  memcpy(header, "PINSLAB0", 8);
+  fd = open(badHeader, O_WRONLY | O_CREAT, 0644);
+  if (fd >= 0) {
+    (void)write(fd, header, sizeof(header));
+    close(fd);
+  }
+  memcpy(header, "PINSLAB1", 8);
+  fd = open(badVersion, O_WRONLY | O_CREAT, 0644);
+  if (fd >= 0) {
+    (void)write(fd, header, sizeof(header));
+    close(fd);
+  }
+  if (!S_reopen(&store, directory) || access(stray, F_OK) == 0 || access(badHeader, F_OK) == 0 || access(badVersion, F_OK) == 0 ||
+      !S_check_all(&store, expected, "removing strays")) {
+    fprintf(stderr, "stray files survived\n");
+    return false;
+  }
+  PINDiskCacheSlabStoreClose(&store);
+
+  // Without a directory, nothing is packed.
+  bool unavailable = !PINDiskCacheSlabStoreOpen(&store, "/nonexistent/dir/slabs") && !PINDiskCacheSlabStoreIsOpen(&store) &&
+                     PINDiskCacheSlabStoreAppend(&store, "a", 1, "b", 1) == PINDiskCacheSlabLocationNone;
+  PINDiskCacheSlabStoreClose(&store);
+  free(data);
+  free(expected);
+  S_remove_directory(directory);
+  if (!unavailable) {
+    fprintf(stderr, "a store without a directory packed a record\n");
+    return false;
+  }
+  return true;
+}
+
+// MARK: - Throughput
+
+typedef struct {
+  double write;
+  double read;
+  double remove;
+  uint64_t written;
+  uint64_t remaining;
+} result;
+
+static void S_key_name(char *name, size_t size, int index) {
+  snprintf(name, size, "https%%3A%%2F%%2Fexample%%2Ecom%%2F%d%%2Ejpg", index);
+}
+
+static bool S_files(int count, size_t length, const int *order, char *data, result *r) {
+  char directory[128];
+  char name[96];
+  char path[256];
+  char temporary[256];
+  S_path(directory, sizeof(directory), "files");
+  mkdir(directory, 0755);
+
+  double start = S_now();
+  for (int i = 0; i < count; i++) {
+    S_key_name(name, sizeof(name), i);
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    snprintf(temporary, sizeof(temporary), "%s/.tmp-%s", directory, name);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct stat info;
+    if (fd < 0 || write(fd, data, length) != (ssize_t)length || close(fd) != 0 || rename(temporary, path) != 0 ||
+        stat(path, &info) != 0) {
+      fprintf(stderr, "can't write %s\n", path);
+      return false;
+    }
+  }
+  r->write = S_now() - start;
+  r->written = S_disk_usage(directory);
+
+  char *buffer = (char *)malloc(length);
+  start = S_now();
+  for (int i = 0; i < count; i++) {
+    S_key_name(name, sizeof(name), order[i]);
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || read(fd, buffer, (size_t)info.st_size) != (ssize_t)length) {
+      fprintf(stderr, "can't read %s\n", path);
+      return false;
+    }
+    close(fd);
+  }
+  r->read = S_now() - start;
+  free(buffer);
+
+  start = S_now();
+  for (int i = 0; i < count; i += 2) {
+    S_key_name(name, sizeof(name), order[i]);
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    unlink(path);
+  }
+  r->remove = S_now() - start;
+  r->remaining = S_disk_usage(directory);
+  S_remove_directory(directory);
+  return true;
+}
+
+typedef struct {
+  PINDiskCacheSlabLocation *locations;
+  int count;
+} bench_index;
+
+static bool S_bench_live(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location) {
+  bench_index *index = (bench_index *)context;
+  // Keys end in the object's number, then %2Ejpg.
+  int number = atoi(key + 30);
+  (void)keyLength;
+  return number < index->count && index->locations[number] == location;
+}
+
+static void S_bench_moved(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location) {
+  bench_index *index = (bench_index *)context;
+  (void)keyLength;
+  index->locations[atoi(key + 30)] = location;
+}
+
+static bool S_slabs(int count, size_t length, const int *order, char *data, result *r) {
+  char directory[128];
+  char name[96];
+  S_path(directory, sizeof(directory), "slabs");
+  PINDiskCacheSlabStore store;
+  PINDiskCacheSlabStoreInit(&store, PINDiskCacheSlabDefaultCapacity);
+  bench_index index = {(PINDiskCacheSlabLocation *)calloc((size_t)count, sizeof(PINDiskCacheSlabLocation)), count};
+
+  double start = S_now();
+  PINDiskCacheSlabStoreOpen(&store, directory);
+  for (int i = 0; i < count; i++) {
+    S_key_name(name, sizeof(name), i);
+    index.locations[i] = PINDiskCacheSlabStoreAppend(&store, name, strlen(name), data, length);
+    if (index.locations[i] == PINDiskCacheSlabLocationNone) {
+      fprintf(stderr, "can't append %s\n", name);
+      return false;
+    }
+  }
+  r->write = S_now() - start;
+  r->written = S_disk_usage(directory);
+
+  // Copied out, as PINDiskCache hands the deserializer its own NSData.
+  char *buffer = (char *)malloc(length);
+  start = S_now();
+  for (int i = 0; i < count; i++) {
+    S_key_name(name, sizeof(name), order[i]);
+    const void *contents = NULL;
+    size_t contentsLength = 0;
+    if (!PINDiskCacheSlabStoreRead(&store, index.locations[order[i]], name, strlen(name), &contents, &contentsLength) ||
+        contentsLength != length) {
+      fprintf(stderr, "can't read %s\n", name);
+      return false;
+    }
+    memcpy(buffer, contents, length);
+  }
+  r->read = S_now() - start;
+  free(buffer);
+
+  start = S_now();
+  for (int i = 0; i < count; i += 2) {
+    size_t recordLength = PINDiskCacheSlabRecordLength(strlen(name), length);
+    PINDiskCacheSlabStoreRelease(&store, index.locations[order[i]], recordLength);
+    index.locations[order[i]] = PINDiskCacheSlabLocationNone;
+  }
+  while (PINDiskCacheSlabStoreShouldCompact(&store)) {
+    if (!PINDiskCacheSlabStoreCompact(&store, S_bench_live, S_bench_moved, &index)) {
+      fprintf(stderr, "compaction failed\n");
+      return false;
+    }
+  }
+  r->remove = S_now() - start;
+  r->remaining = S_disk_usage(directory);
+
+  // Everything left still reads after compaction.
+  for (int i = 1; i < count; i += 2) {
+    S_key_name(name, sizeof(name), order[i]);
+    const void *contents = NULL;
+    size_t contentsLength = 0;
+    if (!PINDiskCacheSlabStoreRead(&store, index.locations[order[i]], name, strlen(name), &contents, &contentsLength) ||
+        memcmp(contents, data, length) != 0) {
+      fprintf(stderr, "%s is lost after compaction\n", name);
+      return false;
+    }
+  }
+  PINDiskCacheSlabStoreClose(&store);
+  free(index.locations);
+  S_remove_directory(directory);
+  return true;
+}
+
+static void S_keep_best(result *best, const result *r, int trial) {
+  if (trial == 0) {
+    *best = *r;
+    return;
+  }
+  best->write = r->write < best->write ? r->write : best->write;
+  best->read = r->read < best->read ? r->read : best->read;
+  best->remove = r->remove < best->remove ? r->remove : best->remove;
+}
+
+int main(int argc, char **argv) {
+  int opCount = 20000;
+  size_t budget = 64 * 1024 * 1024;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      opCount = 3000;
+      budget = 8 * 1024 * 1024;
+    }
+  }
+  snprintf(S_dir, sizeof(S_dir), "/tmp/pin_slabs_bench_%d", (int)getpid());
+  mkdir(S_dir, 0755);
+  if (!S_check(opCount)) {
+    return 1;
+  }
+
+  static const size_t lengths[] = {1024, 2048, 4096, 8192, 16384, 32768, 65536};
+  size_t lengthCount = sizeof(lengths) / sizeof(lengths[0]);
+  printf("{\n  \"objects\": [\n");
+  for (size_t l = 0; l < lengthCount; l++) {
+    size_t length = lengths[l];
+    // The same bytes written at every size, up to 8000 objects.
+    int count = (int)(budget / length);
+    count = count > 8000 ? 8000 : count;
+    int *order = (int *)malloc((size_t)count * sizeof(int));
+    for (int i = 0; i < count; i++) {
+      order[i] = i;
+    }
+    for (int i = count - 1; i > 0; i--) {
+      int j = (int)S_random((uint32_t)i + 1);
+      int swap = order[i];
+      order[i] = order[j];
+      order[j] = swap;
+    }
+    char *data = (char *)malloc(length);
+    S_fill(data, length, (int)l, 1);
+
+    result files = {0, 0, 0, 0, 0};
+    result slabs = {0, 0, 0, 0, 0};
+    for (int trial = 0; trial < TRIALS; trial++) {
+      result r;
+      if (!S_files(count, length, order, data, &r)) {
+        return 1;
+      }
+      S_keep_best(&files, &r, trial);
+      if (!S_slabs(count, length, order, data, &r)) {
+        return 1;
+      }
+      S_keep_best(&slabs, &r, trial);
+    }
+    printf("    {\"kb\": %zu, \"count\": %d,\n", length / 1024, count);
+    printf("     \"write_per_sec\": {\"files\": %.0f, \"slabs\": %.0f},\n", count / files.write, count / slabs.write);
+    printf("     \"read_per_sec\": {\"files\": %.0f, \"slabs\": %.0f},\n", count / files.read, count / slabs.read);
+    printf("     \"remove_half_ms\": {\"files\": %.2f, \"slabs_with_compaction\": %.2f},\n", files.remove * 1e3,
+           slabs.remove * 1e3);
+    printf("     \"disk_kb\": {\"payload\": %zu, \"files\": %llu, \"slabs\": %llu},\n", count * length / 1024,
+           (unsigned long long)(files.written / 1024), (unsigned long long)(slabs.written / 1024));
+    printf("     \"disk_kb_after_removing_half\": {\"files\": %llu, \"slabs\": %llu}}%s\n",
+           (unsigned long long)(files.remaining / 1024), (unsigned long long)(slabs.remaining / 1024),
+           l + 1 < lengthCount ? "," : "");
+    free(order);
+    free(data);
+  }
+  printf("  ]\n}\n");
+  rmdir(S_dir);
+  return 0;
+}
@@ -0,0 +1,524 @@
+// Checks and timing of PINMemoryCacheIndex, the bookkeeping behind
+// PINMemoryCache.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   cc -O2 -DNDEBUG -o memory_cache_bench memory_cache_bench.c
+//      ../Source/PINMemoryCacheIndex.c -lm
+//   ./memory_cache_bench [--quick] > result.json
+//
+// First runs random adds, sets, accesses and removals against a plain array
+// model, on a clock that ticks once per operation. After every step, the
+// least recently used victim, the least frequently used victim (ties to the
+// least recently used), the creation order and the total cost must match the
+// model. Expiry must hand out exactly the entries whose own age limit has
+// passed, across jumps of many turns of the wheel, and the costliest-first
+// snapshot must come out in cost order and skip entries removed since.
+// Exits with 1 on failure.
+//
+// Then times, at 100k entries, an insert over the cost limit that evicts one
+// entry, against sorting every key the way PINMemoryCache did on each trim,
+// and removing expired entries every second, against checking them all.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Source/PINMemoryCacheIndex.h"
+
+#define TRIALS 3
+
+static double min_time = 0.2;
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+// MARK: - Model
+
+#define MODEL_KEYS 64
+
+typedef struct {
+  bool live;
+  PINMemoryCacheHandle handle;
+  size_t cost;
+  double createdAt;
+  double accessedAt;
+  double ageLimit;
+  intptr_t accessCount;
+} model_entry;
+
+static model_entry S_model[MODEL_KEYS];
+static intptr_t S_keys[MODEL_KEYS];
+
+static const void *S_key(int key) {
+  return &S_keys[key];
+}
+
+static int S_key_of(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle) {
+  return (int)((const intptr_t *)PINMemoryCacheIndexEntry(index, handle)->key - S_keys);
+}
+
+static int S_model_victim(bool frequency) {
+  int victim = -1;
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    if (!S_model[key].live) {
+      continue;
+    }
+    if (victim < 0) {
+      victim = key;
+      continue;
+    }
+    const model_entry *a = &S_model[key];
+    const model_entry *b = &S_model[victim];
+    bool before = frequency && a->accessCount != b->accessCount ? a->accessCount < b->accessCount
+                                                                : a->accessedAt < b->accessedAt;
+    if (before) {
+      victim = key;
+    }
+  }
+  return victim;
+}
+
+static bool S_matches_model(PINMemoryCacheIndex *index) {
+  size_t total = 0;
+  uint32_t count = 0;
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    if (S_model[key].live) {
+      total += S_model[key].cost;
+      count++;
+    }
+  }
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    if (S_model[key].live && PINMemoryCacheIndexEntry(index, S_model[key].handle)->accessCount != S_model[key].accessCount) {
+      fprintf(stderr, "key %d has access count %ld, expected %ld\n", key,
+              (long)PINMemoryCacheIndexEntry(index, S_model[key].handle)->accessCount, (long)S_model[key].accessCount);
+      return false;
+    }
+  }
+  if (index->totalCost != total || index->entryCount != count) {
+    fprintf(stderr, "total cost %zu or count %u, expected %zu and %u\n", index->totalCost, index->entryCount, total,
+            count);
+    return false;
+  }
+  for (int frequency = 0; frequency < 2; frequency++) {
+    int expected = S_model_victim(frequency);
+    PINMemoryCacheHandle victim =
+        PINMemoryCacheIndexVictim(index, frequency ? PINMemoryCacheIndexOrderFrequency : PINMemoryCacheIndexOrderRecency);
+    int actual = victim == PINMemoryCacheHandleNone ? -1 : S_key_of(index, victim);
+    if (actual != expected) {
+      fprintf(stderr, "%s victim is %d, expected %d\n", frequency ? "frequency" : "recency", actual, expected);
+      return false;
+    }
+  }
+  // Creation order: every entry once, oldest first.
+  PINMemoryCacheCreationCursor cursor = PINMemoryCacheIndexCreationCursor(index);
+  PINMemoryCacheHandle handle;
+  double previous = -1;
+  uint32_t seen = 0;
+  while ((handle = PINMemoryCacheIndexNextByCreation(index, &cursor)) != PINMemoryCacheHandleNone) {
+    int key = S_key_of(index, handle);
+    if (!S_model[key].live || S_model[key].handle != handle || S_model[key].createdAt <= previous) {
+      fprintf(stderr, "creation order is wrong at key %d\n", key);
+      return false;
+    }
+    previous = S_model[key].createdAt;
+    seen++;
+  }
+  // And the entries without an age limit on their own.
+  previous = -1;
+  for (handle = PINMemoryCacheIndexOldestWithoutAgeLimit(index); handle != PINMemoryCacheHandleNone;
+       handle = PINMemoryCacheIndexNewer(index, handle)) {
+    int key = S_key_of(index, handle);
+    if (S_model[key].ageLimit > 0 || S_model[key].createdAt <= previous) {
+      fprintf(stderr, "order without age limits is wrong at key %d\n", key);
+      return false;
+    }
+    previous = S_model[key].createdAt;
+  }
+  if (seen != count) {
+    fprintf(stderr, "creation order has %u entries, expected %u\n", seen, count);
+    return false;
+  }
+  return true;
+}
+
+static void S_model_remove(PINMemoryCacheIndex *index, int key) {
+  PINMemoryCacheIndexRemove(index, S_model[key].handle);
+  S_model[key].live = false;
+}
+
+static bool S_check_expired(PINMemoryCacheIndex *index, double now) {
+  bool expired[MODEL_KEYS] = {false};
+  PINMemoryCacheHandle handle;
+  while ((handle = PINMemoryCacheIndexNextExpired(index, now)) != PINMemoryCacheHandleNone) {
+    int key = S_key_of(index, handle);
+    if (expired[key]) {
+      fprintf(stderr, "key %d expired twice\n", key);
+      return false;
+    }
+    expired[key] = true;
+  }
+  for (int key = 0; key < MODEL_KEYS; key++) {
+    const model_entry *e = &S_model[key];
+    bool due = e->live && e->ageLimit > 0 && e->createdAt + e->ageLimit < now;
+    if (due != expired[key]) {
+      fprintf(stderr, "key %d %s at %.0f\n", key, due ? "didn't expire" : "expired early", now);
+      return false;
+    }
+    if (due) {
+      S_model_remove(index, key);
+    }
+  }
+  return true;
+}
+
+// Evicts in the cache's order until a few entries are left, as trimming to a cost limit does.
+static bool S_check_eviction(PINMemoryCacheIndex *index, bool frequency) {
+  while (index->entryCount > 4) {
+    int expected = S_model_victim(frequency);
+    PINMemoryCacheHandle victim =
+        PINMemoryCacheIndexVictim(index, frequency ? PINMemoryCacheIndexOrderFrequency : PINMemoryCacheIndexOrderRecency);
+    if (S_key_of(index, victim) != expected) {
+      fprintf(stderr, "%s eviction took %d, expected %d\n", frequency ? "frequency" : "recency", S_key_of(index, victim),
+              expected);
+      return false;
+    }
+    S_model_remove(index, expected);
+  }
+  return true;
+}
+
+static bool S_check_costliest(PINMemoryCacheIndex *index) {
+  if (!PINMemoryCacheIndexSnapshotCosts(index)) {
+    return false;
+  }
+  // Entries removed after the snapshot, even if their handle is reused, are skipped.
+  int removed = S_model_victim(false);
+  if (removed >= 0) {
+    S_model_remove(index, removed);
+  }
+  size_t previous = SIZE_MAX;
+  uint32_t popped = 0;
+  PINMemoryCacheHandle handle;
+  while ((handle = PINMemoryCacheIndexNextCostliest(index)) != PINMemoryCacheHandleNone) {
+    int key = S_key_of(index, handle);
+    size_t cost = PINMemoryCacheIndexEntry(index, handle)->cost;
+    if (!S_model[key].live || cost > previous) {
+      fprintf(stderr, "costliest order is wrong at key %d\n", key);
+      return false;
+    }
+    previous = cost;
+    popped++;
+  }
+  if (popped != index->entryCount) {
+    fprintf(stderr, "costliest order has %u entries, expected %u\n", popped, index->entryCount);
+    return false;
+  }
+  return true;
+}
+
+static bool S_check(int steps) {
+  PINMemoryCacheIndex index;
+  PINMemoryCacheIndexInit(&index);
+  memset(S_model, 0, sizeof(S_model));
+  double now = 1000;
+  for (int step = 0; step < steps; step++) {
+    // Half ticks, so some expiry checks land inside an entry's last tick.
+    now += 0.5 * (1 + S_random(6));
+    int key = (int)S_random(MODEL_KEYS);
+    model_entry *e = &S_model[key];
+    uint32_t op = S_random(100);
+    if (op < 40) {
+      size_t cost = S_random(1000);
+      // Limits within a turn of the wheel, within its upper level, and beyond.
+      static const uint32_t spans[] = {100, 100, 100, 5000, 600000};
+      double ageLimit = S_random(3) == 0 ? 0.5 * (1 + S_random(2 * spans[S_random(5)])) : 0;
+      if (e->live) {
+        PINMemoryCacheIndexUpdate(&index, e->handle, S_key(key), cost, now, ageLimit);
+        e->accessCount++;
+      } else {
+        e->handle = PINMemoryCacheIndexAdd(&index, S_key(key), S_key(key), cost, now, ageLimit);
+        e->live = true;
+        e->accessCount = 1;
+      }
+      e->cost = cost;
+      e->createdAt = e->accessedAt = now;
+      e->ageLimit = ageLimit;
+    } else if (op < 80) {
+      if (e->live) {
+        PINMemoryCacheIndexTouch(&index, e->handle, now);
+        e->accessedAt = now;
+        e->accessCount++;
+      }
+    } else if (op < 90) {
+      if (e->live) {
+        S_model_remove(&index, key);
+      }
+    } else if (op < 95) {
+      // Sometimes far ahead, over many turns of either level of the wheel.
+      static const uint32_t jumps[] = {50, 50, 50, 7000, 1000000};
+      double later = now + S_random(jumps[S_random(5)]);
+      if (!S_check_expired(&index, later)) {
+        return false;
+      }
+      // Sometimes the clock then steps back, behind the wheel.
+      if (S_random(4) != 0) {
+        now = later;
+      }
+    } else if (op < 97) {
+      if (!S_check_costliest(&index)) {
+        return false;
+      }
+    } else if (op == 97 && S_random(10) == 0) {
+      if (!S_check_eviction(&index, S_random(2))) {
+        return false;
+      }
+    } else if (op == 98 && S_random(20) == 0) {
+      PINMemoryCacheIndexRemoveAll(&index);
+      memset(S_model, 0, sizeof(S_model));
+    }
+    if (!S_matches_model(&index)) {
+      fprintf(stderr, "at step %d\n", step);
+      return false;
+    }
+  }
+  PINMemoryCacheIndexDestroy(&index);
+  return true;
+}
+
+// Access counts stop at INTPTR_MAX, after which an access still makes the
+// entry the last to go among equals.
+static bool S_check_saturation(void) {
+  PINMemoryCacheIndex index;
+  PINMemoryCacheIndexInit(&index);
+  PINMemoryCacheHandle a = PINMemoryCacheIndexAdd(&index, NULL, NULL, 1, 1, 0);
+  PINMemoryCacheHandle b = PINMemoryCacheIndexAdd(&index, NULL, NULL, 1, 2, 0);
+  // Both share the count 1 bucket; take it, and them, to the top.
+  index.buckets[index.firstBucket].count = INTPTR_MAX;
+  PINMemoryCacheIndexEntry(&index, a)->accessCount = INTPTR_MAX;
+  PINMemoryCacheIndexEntry(&index, b)->accessCount = INTPTR_MAX;
+  bool passed = true;
+  for (int touch = 0; touch < 4; touch++) {
+    PINMemoryCacheHandle touched = touch % 2 ? b : a;
+    PINMemoryCacheIndexTouch(&index, touched, 3 + touch);
+    if (PINMemoryCacheIndexVictim(&index, PINMemoryCacheIndexOrderFrequency) != (touch % 2 ? a : b) ||
+        PINMemoryCacheIndexEntry(&index, touched)->accessCount != INTPTR_MAX) {
+      passed = false;
+    }
+  }
+  PINMemoryCacheIndexDestroy(&index);
+  if (!passed) {
+    fprintf(stderr, "saturated access counts are out of order\n");
+  }
+  return passed;
+}
+
+// MARK: - Timing
+
+typedef struct {
+  double accessedAt;
+  intptr_t accessCount;
+  uint32_t key;
+} sort_item;
+
+static int S_compare_recency(const void *a, const void *b) {
+  double x = ((const sort_item *)a)->accessedAt;
+  double y = ((const sort_item *)b)->accessedAt;
+  return x < y ? -1 : x > y;
+}
+
+static int S_compare_frequency(const void *a, const void *b) {
+  const sort_item *x = (const sort_item *)a;
+  const sort_item *y = (const sort_item *)b;
+  if (x->accessCount != y->accessCount) {
+    return x->accessCount < y->accessCount ? -1 : 1;
+  }
+  return S_compare_recency(a, b);
+}
+
+// What an insert over the cost limit cost before: snapshot every entry, sort
+// by the strategy and evict the first.
+typedef struct {
+  sort_item *entries;
+  sort_item *snapshot;
+  uint32_t count;
+  double clock;
+} sorted_cache;
+
+static void S_sorted_insert(sorted_cache *cache, bool frequency) {
+  memcpy(cache->snapshot, cache->entries, cache->count * sizeof(sort_item));
+  qsort(cache->snapshot, cache->count, sizeof(sort_item), frequency ? S_compare_frequency : S_compare_recency);
+  uint32_t victim = cache->snapshot[0].key;
+  // The new entry takes the victim's place.
+  for (uint32_t i = 0; i < cache->count; i++) {
+    if (cache->entries[i].key == victim) {
+      cache->entries[i].accessedAt = cache->clock++;
+      cache->entries[i].accessCount = 1;
+      break;
+    }
+  }
+}
+
+static void S_index_fill(PINMemoryCacheIndex *index, uint32_t count, double *clock) {
+  PINMemoryCacheIndexInit(index);
+  for (uint32_t i = 0; i < count; i++) {
+    PINMemoryCacheHandle handle = PINMemoryCacheIndexAdd(index, NULL, NULL, 1, (*clock)++, 0);
+    for (uint32_t touches = S_random(4); touches > 0; touches--) {
+      PINMemoryCacheIndexTouch(index, handle, (*clock)++);
+    }
+  }
+}
+
+static void S_index_insert(PINMemoryCacheIndex *index, double *clock, bool frequency) {
+  PINMemoryCacheIndexAdd(index, NULL, NULL, 1, (*clock)++, 0);
+  PINMemoryCacheHandle victim =
+      PINMemoryCacheIndexVictim(index, frequency ? PINMemoryCacheIndexOrderFrequency : PINMemoryCacheIndexOrderRecency);
+  PINMemoryCacheIndexRemove(index, victim);
+  // Keep the access pattern going, so buckets keep moving.
+  PINMemoryCacheIndexTouch(index, index->recencyHead, (*clock)++);
+}
+
+typedef void (*insert_fn)(void *cache, bool frequency);
+
+static double S_time_inserts(insert_fn insert, void *cache, bool frequency) {
+  double best = 1e30;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t count = 0;
+    double start = S_now();
+    double elapsed = 0;
+    do {
+      insert(cache, frequency);
+      count++;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time);
+    if (elapsed / count < best) {
+      best = elapsed / count;
+    }
+  }
+  return best;
+}
+
+static void S_sorted_insert_fn(void *cache, bool frequency) {
+  S_sorted_insert((sorted_cache *)cache, frequency);
+}
+
+typedef struct {
+  PINMemoryCacheIndex index;
+  double clock;
+} index_cache;
+
+static void S_index_insert_fn(void *cache, bool frequency) {
+  index_cache *c = (index_cache *)cache;
+  S_index_insert(&c->index, &c->clock, frequency);
+}
+
+// A trim every second for 1000 seconds, by which 1% of the entries have
+// expired, removing them by the wheel or by checking every entry each time.
+static void S_expiry_timing(uint32_t count, double *wheelSeconds, double *scanSeconds) {
+  PINMemoryCacheIndex index;
+  PINMemoryCacheIndexInit(&index);
+  double *expiries = (double *)malloc(count * sizeof(double));
+  for (uint32_t i = 0; i < count; i++) {
+    double ageLimit = 60 + S_random(100000);
+    PINMemoryCacheIndexAdd(&index, NULL, NULL, 1, 0, ageLimit);
+    expiries[i] = ageLimit;
+  }
+  const int trims = 1000;
+
+  double start = S_now();
+  uint32_t expired = 0;
+  for (int trim = 1; trim <= trims; trim++) {
+    PINMemoryCacheHandle handle;
+    while ((handle = PINMemoryCacheIndexNextExpired(&index, 60 + trim)) != PINMemoryCacheHandleNone) {
+      PINMemoryCacheIndexRemove(&index, handle);
+      expired++;
+    }
+  }
+  *wheelSeconds = (S_now() - start) / trims;
+
+  start = S_now();
+  uint32_t scanned = 0;
+  for (int trim = 1; trim <= trims; trim++) {
+    for (uint32_t i = 0; i < count; i++) {
+      if (expiries[i] < 60 + trim) {
+        expiries[i] = INFINITY;
+        scanned++;
+      }
+    }
+  }
+  *scanSeconds = (S_now() - start) / trims;
+  if (expired != scanned) {
+    fprintf(stderr, "the wheel expired %u entries, expected %u\n", expired, scanned);
+    exit(1);
+  }
+  free(expiries);
+  PINMemoryCacheIndexDestroy(&index);
+}
+
+int main(int argc, char **argv) {
+  int steps = 400000;
+  uint32_t count = 100000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.02;
+      steps = 40000;
+      count = 10000;
+    }
+  }
+  for (intptr_t i = 0; i < MODEL_KEYS; i++) {
+    S_keys[i] = i;
+  }
+  if (!S_check(steps) || !S_check_saturation()) {
+    return 1;
+  }
+
+  sorted_cache sorted;
+  sorted.entries = (sort_item *)malloc(count * sizeof(sort_item));
+  sorted.snapshot = (sort_item *)malloc(count * sizeof(sort_item));
+  sorted.count = count;
+  sorted.clock = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    sorted.entries[i].accessedAt = sorted.clock++;
+    sorted.entries[i].accessCount = 1 + S_random(4);
+    sorted.entries[i].key = i;
+  }
+  double sortedRecency = S_time_inserts(S_sorted_insert_fn, &sorted, false);
+  double sortedFrequency = S_time_inserts(S_sorted_insert_fn, &sorted, true);
+  free(sorted.entries);
+  free(sorted.snapshot);
+
+  index_cache cache;
+  cache.clock = 0;
+  S_index_fill(&cache.index, count, &cache.clock);
+  double indexRecency = S_time_inserts(S_index_insert_fn, &cache, false);
+  double indexFrequency = S_time_inserts(S_index_insert_fn, &cache, true);
+  if (cache.index.entryCount != count) {
+    fprintf(stderr, "evicting inserts changed the entry count\n");
+    return 1;
+  }
+  PINMemoryCacheIndexDestroy(&cache.index);
+
+  double wheelSeconds;
+  double scanSeconds;
+  S_expiry_timing(count, &wheelSeconds, &scanSeconds);
+
+  printf("{\n  \"entries\": %u,\n", count);
+  printf("  \"evicting_insert_us\": {\"sorted_lru\": %.2f, \"sorted_lfu\": %.2f, \"index_lru\": %.3f, \"index_lfu\": %.3f},\n",
+         sortedRecency * 1e6, sortedFrequency * 1e6, indexRecency * 1e6, indexFrequency * 1e6);
+  printf("  \"remove_expired_per_second_us\": {\"scan\": %.1f, \"wheel\": %.2f}\n}\n", scanSeconds * 1e6, wheelSeconds * 1e6);
+  return 0;
+}
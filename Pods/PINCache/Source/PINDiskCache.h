@@ -163,6 +163,16 @@ PIN_SUBCLASSING_RESTRICTED
  */
 @property (assign) NSUInteger byteLimit;
 
+/**
+ Objects whose serialized data is smaller than this many bytes are packed together into shared slab files
+ instead of getting a file each, which saves an inode, several syscalls and rounding up to a filesystem block
+ apiece. Packed objects have no file of their own: <fileURLForKey:> returns nil for them and enumeration passes
+ a nil `fileURL`. Objects that don't fit in a 4 MB slab always get a file. Defaults to 0, which packs nothing.
+ 
+ @note Packed objects are found through the cache's journal, so they're lost if it is.
+ */
+@property (assign) NSUInteger packedObjectThreshold;
+
 /**
  The maximum number of seconds an object is allowed to exist in the cache. Setting this to a value
  greater than `0.0` will start a recurring GCD timer with the same period that calls <trimToDate:>.
@@ -3,6 +3,8 @@
 //  Copyright (c) 2015 Pinterest. All rights reserved.
 
 #import "PINDiskCache.h"
+#import "PINDiskCacheJournal.h"
+#import "PINDiskCacheSlabs.h"
 
 #if __IPHONE_OS_VERSION_MIN_REQUIRED >= __IPHONE_4_0
 #import <UIKit/UIKit.h>
@@ -26,6 +28,9 @@ NSErrorUserInfoKey const PINDiskCacheErrorReadFailureCodeKey = @"PINDiskCacheErr
 NSErrorUserInfoKey const PINDiskCacheErrorWriteFailureCodeKey = @"PINDiskCacheErrorWriteFailureCodeKey";
 NSString * const PINDiskCachePrefix = @"com.pinterest.PINDiskCache";
 static NSString * const PINDiskCacheSharedName = @"PINDiskCacheShared";
+// Hidden, so directory enumeration skips them, and never an encoded key, which escapes dots.
+static NSString * const PINDiskCacheJournalFileName = @".PINDiskCacheJournal";
+static NSString * const PINDiskCacheSlabsDirectoryName = @".PINDiskCacheSlabs";
 
 NSUInteger PINDiskCacheDefaultByteLimit = 50 * 1024 * 1024; // 50 MB by default
 NSTimeInterval PINDiskCacheDefaultAgeLimit = 60 * 60 * 24 * 30; // 30 days by default
@@ -64,6 +69,8 @@ const char * PINDiskCacheFileSystemRepresentation(NSURL *url)
 @property (nonatomic) NSTimeInterval ageLimit;
 // Access count is how many times this object has been fetched. Used with the LFU
 @property (nonatomic) NSInteger accessCount;
+// Where the object is packed into the slabs, or PINDiskCacheSlabLocationNone if it has a file of its own
+@property (nonatomic) PINDiskCacheSlabLocation slabLocation;
 @end
 
 @interface PINDiskCache () {
@@ -72,6 +79,14 @@ const char * PINDiskCacheFileSystemRepresentation(NSURL *url)
     
     PINDiskCacheKeyEncoderBlock _keyEncoder;
     PINDiskCacheKeyDecoderBlock _keyDecoder;
+
+    // The metadata of every entry, logged as it changes so startup doesn't read every file's attributes.
+    PINDiskCacheJournal _journal;
+    BOOL _journalCompactionScheduled;
+
+    // Small objects packed together, found through their metadata's slab location.
+    PINDiskCacheSlabStore _slabs;
+    BOOL _slabCompactionScheduled;
 }
 
 @property (assign, nonatomic) pthread_mutex_t mutex;
@@ -100,6 +115,7 @@ static NSURL *_sharedTrashURL;
 @synthesize byteLimit = _byteLimit;
 @synthesize ageLimit = _ageLimit;
 @synthesize ttlCache = _ttlCache;
+@synthesize packedObjectThreshold = _packedObjectThreshold;
 
 #if TARGET_OS_IPHONE
 @synthesize writingProtectionOption = _writingProtectionOption;
@@ -110,6 +126,9 @@ static NSURL *_sharedTrashURL;
 
 - (void)dealloc
 {
+    PINDiskCacheJournalClose(&_journal);
+    PINDiskCacheSlabStoreClose(&_slabs);
+
     __unused int result = pthread_mutex_destroy(&_mutex);
     NSCAssert(result == 0, @"Failed to destroy lock in PINDiskCache %p. Code: %d", (void *)self, result);
     pthread_cond_destroy(&_diskWritableCondition);
@@ -274,6 +293,8 @@ static NSURL *_sharedTrashURL;
 #endif
         
         _metadata = [[NSMutableDictionary alloc] init];
+        PINDiskCacheJournalInit(&_journal);
+        PINDiskCacheSlabStoreInit(&_slabs, PINDiskCacheSlabDefaultCapacity);
         _diskStateKnown = NO;
       
         _cacheURL = [[self class] cacheURLWithRootPath:rootPath prefix:_prefix name:_name];
@@ -507,6 +528,217 @@ static NSURL *_sharedTrashURL;
     });
 }
 
+#pragma mark - Private Journal Methods -
+
+static void PINDiskCacheReplayJournalRecord(void *context, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *journalMetadata)
+{
+    NSMutableDictionary<NSString *, PINDiskCacheMetadata *> *metadata = (__bridge NSMutableDictionary *)context;
+    NSString *fileKey = [[NSString alloc] initWithBytes:key length:keyLength encoding:NSUTF8StringEncoding];
+    if (!fileKey)
+        return;
+
+    if (!journalMetadata) {
+        [metadata removeObjectForKey:fileKey];
+        return;
+    }
+
+    PINDiskCacheMetadata *fileMetadata = [[PINDiskCacheMetadata alloc] init];
+    if (!isnan(journalMetadata->createdAt))
+        fileMetadata.createdDate = [NSDate dateWithTimeIntervalSinceReferenceDate:journalMetadata->createdAt];
+    if (!isnan(journalMetadata->modifiedAt))
+        fileMetadata.lastModifiedDate = [NSDate dateWithTimeIntervalSinceReferenceDate:journalMetadata->modifiedAt];
+    fileMetadata.size = @(journalMetadata->size);
+    fileMetadata.ageLimit = journalMetadata->ageLimit;
+    fileMetadata.accessCount = (NSInteger)journalMetadata->accessCount;
+    fileMetadata.slabLocation = journalMetadata->slabLocation;
+    metadata[fileKey] = fileMetadata;
+}
+
+static PINDiskCacheJournalMetadata PINDiskCacheJournalMetadataMake(PINDiskCacheMetadata *metadata)
+{
+    PINDiskCacheJournalMetadata journalMetadata;
+    journalMetadata.size = [metadata.size unsignedLongLongValue];
+    // Missing dates are recorded as NaN.
+    journalMetadata.createdAt = metadata.createdDate ? [metadata.createdDate timeIntervalSinceReferenceDate] : NAN;
+    journalMetadata.modifiedAt = metadata.lastModifiedDate ? [metadata.lastModifiedDate timeIntervalSinceReferenceDate] : NAN;
+    journalMetadata.ageLimit = metadata.ageLimit;
+    journalMetadata.accessCount = metadata.accessCount;
+    journalMetadata.slabLocation = metadata.slabLocation;
+    return journalMetadata;
+}
+
+/**
+ * @return Whether the journal was replayed. If not, the cache directory has to be read.
+ */
+- (BOOL)_locked_openJournal
+{
+    PINDiskCacheJournalClose(&_journal);
+
+    NSURL *journalURL = [_cacheURL URLByAppendingPathComponent:PINDiskCacheJournalFileName isDirectory:NO];
+    NSMutableDictionary<NSString *, PINDiskCacheMetadata *> *journaledMetadata = [[NSMutableDictionary alloc] init];
+    PINDiskCacheJournalState state = PINDiskCacheJournalOpen(&_journal, PINDiskCacheFileSystemRepresentation(journalURL), PINDiskCacheReplayJournalRecord, (__bridge void *)journaledMetadata);
+    if (state != PINDiskCacheJournalStateReplayed)
+        return NO;
+
+    // Entries written or read since init are newer than their records.
+    NSMutableDictionary<NSString *, PINDiskCacheMetadata *> *metadata = _metadata;
+    _metadata = journaledMetadata;
+    for (NSString *key in metadata) {
+        _metadata[key] = metadata[key];
+        [self _locked_journalMetadataForKey:key];
+    }
+    return YES;
+}
+
+// Records the key's metadata, or its removal when there's none.
+- (void)_locked_journalMetadataForKey:(NSString *)key
+{
+    if (!PINDiskCacheJournalIsOpen(&_journal))
+        return;
+
+    const char *journalKey = [key UTF8String];
+    PINDiskCacheMetadata *metadata = _metadata[key];
+    if (metadata) {
+        PINDiskCacheJournalMetadata journalMetadata = PINDiskCacheJournalMetadataMake(metadata);
+        PINDiskCacheJournalAppendSet(&_journal, journalKey, strlen(journalKey), &journalMetadata);
+    } else {
+        PINDiskCacheJournalAppendRemove(&_journal, journalKey, strlen(journalKey));
+    }
+
+    if (!_journalCompactionScheduled && PINDiskCacheJournalShouldCompact(&_journal, (uint32_t)MIN(_metadata.count, UINT32_MAX))) {
+        _journalCompactionScheduled = YES;
+        [self.operationQueue scheduleOperation:^{
+            [self compactJournal];
+        } withPriority:PINOperationQueuePriorityLow];
+    }
+}
+
+- (void)_locked_rewriteJournal
+{
+    BOOL rewritten = PINDiskCacheJournalBeginRewrite(&_journal);
+    for (NSString *key in _metadata) {
+        if (!rewritten)
+            break;
+        const char *journalKey = [key UTF8String];
+        PINDiskCacheJournalMetadata journalMetadata = PINDiskCacheJournalMetadataMake(_metadata[key]);
+        rewritten = PINDiskCacheJournalRewriteSet(&_journal, journalKey, strlen(journalKey), &journalMetadata);
+    }
+
+    if (!rewritten || !PINDiskCacheJournalCommitRewrite(&_journal)) {
+        // Without a complete journal, the next start reads the directory.
+        PINDiskCacheJournalInvalidate(&_journal);
+    }
+}
+
+- (void)compactJournal
+{
+    // A file written just before a crash can miss its record; it is picked up here.
+    NSArray<NSString *> *fileNames = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:[_cacheURL path] error:nil];
+
+    [self lockAndWaitForKnownState];
+        _journalCompactionScheduled = NO;
+        for (NSString *fileName in fileNames) {
+            if ([fileName hasPrefix:@"."])
+                continue;
+            NSURL *fileURL = [_cacheURL URLByAppendingPathComponent:fileName isDirectory:NO];
+            NSString *fileKey = [self keyForEncodedFileURL:fileURL];
+            if (fileKey && _metadata[fileKey] == nil && [[NSFileManager defaultManager] fileExistsAtPath:[fileURL path]]) {
+                self.byteCount = _byteCount + [self _locked_initializeDiskPropertiesForFile:fileURL fileKey:fileKey]; // atomic
+            }
+        }
+        if (PINDiskCacheJournalIsOpen(&_journal))
+            [self _locked_rewriteJournal];
+    [self unlock];
+}
+
+#pragma mark - Private Slab Methods -
+
+static bool PINDiskCacheSlabRecordIsLive(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location)
+{
+    PINDiskCache *cache = (__bridge PINDiskCache *)context;
+    NSString *recordKey = [[NSString alloc] initWithBytes:key length:keyLength encoding:NSUTF8StringEncoding];
+    return recordKey && cache->_metadata[recordKey].slabLocation == location;
+}
+
+static void PINDiskCacheSlabRecordMoved(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location)
+{
+    PINDiskCache *cache = (__bridge PINDiskCache *)context;
+    NSString *recordKey = [[NSString alloc] initWithBytes:key length:keyLength encoding:NSUTF8StringEncoding];
+    cache->_metadata[recordKey].slabLocation = location;
+    [cache _locked_journalMetadataForKey:recordKey];
+}
+
+// Opens the slabs afresh and marks the records of packed entries in use. Entries whose records are gone are dropped,
+// and records no entry refers to, say all of them after the journal was lost, are left for compaction.
+- (void)_locked_openSlabs
+{
+    NSURL *slabsURL = [_cacheURL URLByAppendingPathComponent:PINDiskCacheSlabsDirectoryName isDirectory:YES];
+    PINDiskCacheSlabStoreOpen(&_slabs, PINDiskCacheFileSystemRepresentation(slabsURL));
+
+    NSMutableArray<NSString *> *lostKeys = [[NSMutableArray alloc] init];
+    for (NSString *key in _metadata) {
+        PINDiskCacheMetadata *metadata = _metadata[key];
+        if (metadata.slabLocation != PINDiskCacheSlabLocationNone
+            && !PINDiskCacheSlabStoreRetain(&_slabs, metadata.slabLocation, [metadata.size unsignedLongLongValue])) {
+            [lostKeys addObject:key];
+        }
+    }
+    for (NSString *key in lostKeys) {
+        [_metadata removeObjectForKey:key];
+        [self _locked_journalMetadataForKey:key];
+    }
+
+    [self _locked_scheduleSlabCompactionIfNeeded];
+}
+
+/**
+ * @return The packed object's data, or nil if its record can't be read, in which case the entry is dropped.
+ */
+- (NSData *)_locked_packedDataForKey:(NSString *)key
+{
+    const char *slabKey = [key UTF8String];
+    const void *bytes = NULL;
+    size_t length = 0;
+    if (!PINDiskCacheSlabStoreRead(&_slabs, _metadata[key].slabLocation, slabKey, strlen(slabKey), &bytes, &length)) {
+        // Say a crash lost the record before it reached the disk.
+        [self _locked_removePackedObjectForKey:key];
+        return nil;
+    }
+    // Copied, since compaction can move the record once the lock is released.
+    return [[NSData alloc] initWithBytes:bytes length:length];
+}
+
+- (void)_locked_removePackedObjectForKey:(NSString *)key
+{
+    PINDiskCacheMetadata *metadata = _metadata[key];
+    PINDiskCacheSlabStoreRelease(&_slabs, metadata.slabLocation, [metadata.size unsignedLongLongValue]);
+    self.byteCount = _byteCount - [metadata.size unsignedIntegerValue]; // atomic
+    [_metadata removeObjectForKey:key];
+    [self _locked_journalMetadataForKey:key];
+    [self _locked_scheduleSlabCompactionIfNeeded];
+}
+
+- (void)_locked_scheduleSlabCompactionIfNeeded
+{
+    if (_slabCompactionScheduled || !PINDiskCacheSlabStoreShouldCompact(&_slabs))
+        return;
+
+    _slabCompactionScheduled = YES;
+    [self.operationQueue scheduleOperation:^{
+        [self compactSlabs];
+    } withPriority:PINOperationQueuePriorityLow];
+}
+
+- (void)compactSlabs
+{
+    [self lockAndWaitForKnownState];
+        _slabCompactionScheduled = NO;
+        // A slab at a time, so other work gets the lock in between. A slab that can't be compacted waits for the next release.
+        if (PINDiskCacheSlabStoreCompact(&_slabs, PINDiskCacheSlabRecordIsLive, PINDiskCacheSlabRecordMoved, (__bridge void *)self))
+            [self _locked_scheduleSlabCompactionIfNeeded];
+    [self unlock];
+}
+
 #pragma mark - Private Queue Methods -
 
 - (BOOL)_locked_createCacheDirectory
@@ -602,30 +834,46 @@ static NSURL *_sharedTrashURL;
 
 - (void)initializeDiskProperties
 {
-    NSUInteger byteCount = 0;
-
-    NSError *error = nil;
-    
     [self lock];
-        NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtURL:_cacheURL
-                                                       includingPropertiesForKeys:[PINDiskCache resourceKeys]
-                                                                          options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                                            error:&error];
+        BOOL journalReplayed = [self _locked_openJournal];
     [self unlock];
-    
-    PINDiskCacheError(error);
-    
-    for (NSURL *fileURL in files) {
-        NSString *fileKey = [self keyForEncodedFileURL:fileURL];
-        // Continually grab and release lock while processing files to avoid contention
+
+    // Without a valid journal, every file's attributes are read, then journaled for next time.
+    if (!journalReplayed) {
+        NSError *error = nil;
+
         [self lock];
-        if (_metadata[fileKey] == nil) {
-            byteCount += [self _locked_initializeDiskPropertiesForFile:fileURL fileKey:fileKey];
+            NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtURL:_cacheURL
+                                                           includingPropertiesForKeys:[PINDiskCache resourceKeys]
+                                                                              options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                                error:&error];
+        [self unlock];
+
+        PINDiskCacheError(error);
+
+        for (NSURL *fileURL in files) {
+            NSString *fileKey = [self keyForEncodedFileURL:fileURL];
+            // Continually grab and release lock while processing files to avoid contention
+            [self lock];
+            if (_metadata[fileKey] == nil) {
+                [self _locked_initializeDiskPropertiesForFile:fileURL fileKey:fileKey];
+            }
+            [self unlock];
         }
+
+        [self lock];
+            [self _locked_rewriteJournal];
         [self unlock];
     }
     
     [self lock];
+        // Packed objects are only known through the journal, so they're only found once it's read.
+        [self _locked_openSlabs];
+
+        NSUInteger byteCount = 0;
+        for (PINDiskCacheMetadata *metadata in [_metadata objectEnumerator]) {
+            byteCount += [metadata.size unsignedIntegerValue];
+        }
         if (byteCount > 0)
             _byteCount = byteCount;
     
@@ -699,8 +947,9 @@ static NSURL *_sharedTrashURL;
 
     if (!error) {
         NSString *key = [self keyForEncodedFileURL:fileURL];
-        if (key) {
+        if (key && _metadata[key]) {
             _metadata[key].ageLimit = ageLimit;
+            [self _locked_journalMetadataForKey:key];
         }
     }
 
@@ -759,7 +1008,15 @@ static NSURL *_sharedTrashURL;
 
     // We only need to lock until writable at the top because once writable, always writable
     [self lockForWriting];
-        if (![[NSFileManager defaultManager] fileExistsAtPath:[fileURL path]]) {
+        if (_metadata[key].slabLocation == PINDiskCacheSlabLocationNone && ![[NSFileManager defaultManager] fileExistsAtPath:[fileURL path]]) {
+            // The file went without us, say with a crash before its removal was journaled.
+            if (_metadata[key]) {
+                NSNumber *byteSize = _metadata[key].size;
+                if (byteSize)
+                    self.byteCount = _byteCount - [byteSize unsignedIntegerValue]; // atomic
+                [_metadata removeObjectForKey:key];
+                [self _locked_journalMetadataForKey:key];
+            }
             [self unlock];
             return NO;
         }
@@ -771,19 +1028,24 @@ static NSURL *_sharedTrashURL;
             [self lock];
         }
         
-        BOOL trashed = [PINDiskCache moveItemAtURLToTrashOrRemove:fileURL];
-        if (!trashed) {
-            [self unlock];
-            return NO;
-        }
-    
-        [PINDiskCache emptyTrash];
-        
-        NSNumber *byteSize = _metadata[key].size;
-        if (byteSize)
-            self.byteCount = _byteCount - [byteSize unsignedIntegerValue]; // atomic
+        if (_metadata[key].slabLocation != PINDiskCacheSlabLocationNone) {
+            [self _locked_removePackedObjectForKey:key];
+        } else {
+            BOOL trashed = [PINDiskCache moveItemAtURLToTrashOrRemove:fileURL];
+            if (!trashed) {
+                [self unlock];
+                return NO;
+            }
         
-        [_metadata removeObjectForKey:key];
+            [PINDiskCache emptyTrash];
+            
+            NSNumber *byteSize = _metadata[key].size;
+            if (byteSize)
+                self.byteCount = _byteCount - [byteSize unsignedIntegerValue]; // atomic
+            
+            [_metadata removeObjectForKey:key];
+            [self _locked_journalMetadataForKey:key];
+        }
     
         PINDiskCacheObjectBlock didRemoveObjectBlock = _didRemoveObjectBlock;
         if (didRemoveObjectBlock) {
@@ -1146,8 +1408,9 @@ static NSURL *_sharedTrashURL;
                 NSTimeInterval ageLimit = _metadata[key].ageLimit > 0.0 ? _metadata[key].ageLimit : self->_ageLimit;
                 objectExpired = ageLimit > 0 && fabs([_metadata[key].createdDate timeIntervalSinceDate:[NSDate date]]) > ageLimit;
             }
+            BOOL packed = _metadata[key].slabLocation != PINDiskCacheSlabLocationNone;
             [self unlock];
-            return (!objectExpired && [self fileURLForKey:key updateFileModificationDate:NO] != nil);
+            return (!objectExpired && (packed || [self fileURLForKey:key updateFileModificationDate:NO] != nil));
         }
     [self unlock];
     return NO;
@@ -1190,7 +1453,14 @@ static NSURL *_sharedTrashURL;
         if (!self->_ttlCache || ageLimit <= 0 || fabs([_metadata[key].createdDate timeIntervalSinceDate:now]) < ageLimit) {
             // If the cache should behave like a TTL cache, then only fetch the object if there's a valid ageLimit and  the object is still alive
             
-            NSData *objectData = [[NSData alloc] initWithContentsOfFile:[fileURL path]];
+            PINDiskCacheSlabLocation slabLocation = _metadata[key].slabLocation;
+            NSData *objectData = nil;
+            if (slabLocation != PINDiskCacheSlabLocationNone) {
+                objectData = [self _locked_packedDataForKey:key];
+                fileURL = nil;
+            } else {
+                objectData = [[NSData alloc] initWithContentsOfFile:[fileURL path]];
+            }
           
             if (objectData) {
               //Be careful with locking below. We unlock here so that we're not locked while deserializing, we re-lock after.
@@ -1201,7 +1471,11 @@ static NSURL *_sharedTrashURL;
               @catch (NSException *exception) {
                   NSError *error = nil;
                   [self lock];
-                      [[NSFileManager defaultManager] removeItemAtPath:[fileURL path] error:&error];
+                      if (slabLocation == PINDiskCacheSlabLocationNone) {
+                          [[NSFileManager defaultManager] removeItemAtPath:[fileURL path] error:&error];
+                      } else if (_metadata[key].slabLocation == slabLocation) {
+                          [self _locked_removePackedObjectForKey:key];
+                      }
                   [self unlock];
                   PINDiskCacheError(error)
                   PINDiskCacheException(exception);
@@ -1209,14 +1483,20 @@ static NSURL *_sharedTrashURL;
               [self lock];
             }
             if (object) {
+                // A packed object's metadata is only in the journal.
+                BOOL hasFile = _metadata[key].slabLocation == PINDiskCacheSlabLocationNone;
                 _metadata[key].lastModifiedDate = now;
-                [self asynchronouslySetFileModificationDate:now forURL:fileURL];
+                if (hasFile)
+                    [self asynchronouslySetFileModificationDate:now forURL:fileURL];
                 NSInteger accessCount = _metadata[key].accessCount;
                 if (accessCount < NSIntegerMax) {
                     accessCount += 1;
                     _metadata[key].accessCount = accessCount;
-                    [self asynchronouslySetAccessCount:accessCount forURL:fileURL];
+                    if (hasFile)
+                        [self asynchronouslySetAccessCount:accessCount forURL:fileURL];
                 }
+                if (_metadata[key])
+                    [self _locked_journalMetadataForKey:key];
             }
         }
     [self unlock];
@@ -1245,18 +1525,26 @@ static NSURL *_sharedTrashURL;
     NSURL *fileURL = [self encodedFileURLForKey:key];
     
     [self lockForWriting];
-        if (fileURL.path && [[NSFileManager defaultManager] fileExistsAtPath:fileURL.path]) {
+        BOOL packed = _metadata[key].slabLocation != PINDiskCacheSlabLocationNone;
+        if (packed || (fileURL.path && [[NSFileManager defaultManager] fileExistsAtPath:fileURL.path])) {
             if (updateFileModificationDate) {
                 _metadata[key].lastModifiedDate = now;
-                [self asynchronouslySetFileModificationDate:now forURL:fileURL];
+                if (!packed)
+                    [self asynchronouslySetFileModificationDate:now forURL:fileURL];
                 
                 NSInteger accessCount = _metadata[key].accessCount;
                 if (accessCount < NSIntegerMax) {
                     accessCount += 1;
                     _metadata[key].accessCount = accessCount;
-                    [self asynchronouslySetAccessCount:accessCount forURL:fileURL];
+                    if (!packed)
+                        [self asynchronouslySetAccessCount:accessCount forURL:fileURL];
                 }
+                if (_metadata[key])
+                    [self _locked_journalMetadataForKey:key];
             }
+            // A packed object is still accessed, but has no file to hand out.
+            if (packed)
+                fileURL = nil;
         } else {
             fileURL = nil;
         }
@@ -1332,8 +1620,14 @@ static NSURL *_sharedTrashURL;
             [self lock];
         }
     
+        // Small objects are packed into the slabs rather than each getting a file.
+        const char *slabKey = [key UTF8String];
+        PINDiskCacheSlabLocation slabLocation = PINDiskCacheSlabLocationNone;
+        if (data.length < self->_packedObjectThreshold)
+            slabLocation = PINDiskCacheSlabStoreAppend(&self->_slabs, slabKey, strlen(slabKey), data.bytes, data.length);
+    
         NSError *writeError = nil;
-        BOOL written = [data writeToURL:fileURL options:writeOptions error:&writeError];
+        BOOL written = slabLocation != PINDiskCacheSlabLocationNone || [data writeToURL:fileURL options:writeOptions error:&writeError];
         PINDiskCacheError(writeError);
         
         if (written) {
@@ -1341,34 +1635,63 @@ static NSURL *_sharedTrashURL;
                 _metadata[key] = [[PINDiskCacheMetadata alloc] init];
             }
             
-            NSError *error = nil;
-            NSDictionary *values = [fileURL resourceValuesForKeys:@[ NSURLCreationDateKey, NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey ] error:&error];
-            PINDiskCacheError(error);
+            // Whatever held the object before goes.
+            PINDiskCacheSlabLocation previousSlabLocation = self->_metadata[key].slabLocation;
+            if (previousSlabLocation != PINDiskCacheSlabLocationNone) {
+                PINDiskCacheSlabStoreRelease(&self->_slabs, previousSlabLocation, [self->_metadata[key].size unsignedLongLongValue]);
+                [self _locked_scheduleSlabCompactionIfNeeded];
+            } else if (slabLocation != PINDiskCacheSlabLocationNone && (self->_metadata[key].size || !self->_diskStateKnown)) {
+                [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+            }
+            self->_metadata[key].slabLocation = slabLocation;
             
-            NSNumber *diskFileSize = [values objectForKey:NSURLTotalFileAllocatedSizeKey];
-            if (diskFileSize) {
-                NSNumber *prevDiskFileSize = self->_metadata[key].size;
-                if (prevDiskFileSize) {
-                    self.byteCount = self->_byteCount - [prevDiskFileSize unsignedIntegerValue];
+            if (slabLocation != PINDiskCacheSlabLocationNone) {
+                NSNumber *prevSize = self->_metadata[key].size;
+                if (prevSize) {
+                    self.byteCount = self->_byteCount - [prevSize unsignedIntegerValue];
+                }
+                NSUInteger recordSize = PINDiskCacheSlabRecordLength(strlen(slabKey), data.length);
+                self->_metadata[key].size = @(recordSize);
+                self.byteCount = self->_byteCount + recordSize; // atomic
+                NSDate *now = [NSDate date];
+                self->_metadata[key].createdDate = now;
+                self->_metadata[key].lastModifiedDate = now;
+                self->_metadata[key].ageLimit = ageLimit;
+                if (self->_metadata[key].accessCount < NSIntegerMax) {
+                    self->_metadata[key].accessCount += 1;
+                }
+                fileURL = nil;
+            } else {
+                NSError *error = nil;
+                NSDictionary *values = [fileURL resourceValuesForKeys:@[ NSURLCreationDateKey, NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey ] error:&error];
+                PINDiskCacheError(error);
+                
+                NSNumber *diskFileSize = [values objectForKey:NSURLTotalFileAllocatedSizeKey];
+                if (diskFileSize) {
+                    NSNumber *prevDiskFileSize = self->_metadata[key].size;
+                    if (prevDiskFileSize) {
+                        self.byteCount = self->_byteCount - [prevDiskFileSize unsignedIntegerValue];
+                    }
+                    self->_metadata[key].size = diskFileSize;
+                    self.byteCount = self->_byteCount + [diskFileSize unsignedIntegerValue]; // atomic
+                }
+                NSDate *createdDate = [values objectForKey:NSURLCreationDateKey];
+                if (createdDate) {
+                    self->_metadata[key].createdDate = createdDate;
+                }
+                NSDate *lastModifiedDate = [values objectForKey:NSURLContentModificationDateKey];
+                if (lastModifiedDate) {
+                    self->_metadata[key].lastModifiedDate = lastModifiedDate;
+                }
+                [self asynchronouslySetAgeLimit:ageLimit forURL:fileURL];
+                NSInteger accessCount = self->_metadata[key].accessCount;
+                if (accessCount < NSIntegerMax) {
+                    accessCount += 1;
+                    self->_metadata[key].accessCount = accessCount;
+                    [self asynchronouslySetAccessCount:accessCount forURL:fileURL];
                 }
-                self->_metadata[key].size = diskFileSize;
-                self.byteCount = self->_byteCount + [diskFileSize unsignedIntegerValue]; // atomic
-            }
-            NSDate *createdDate = [values objectForKey:NSURLCreationDateKey];
-            if (createdDate) {
-                self->_metadata[key].createdDate = createdDate;
-            }
-            NSDate *lastModifiedDate = [values objectForKey:NSURLContentModificationDateKey];
-            if (lastModifiedDate) {
-                self->_metadata[key].lastModifiedDate = lastModifiedDate;
-            }
-            [self asynchronouslySetAgeLimit:ageLimit forURL:fileURL];
-            NSInteger accessCount = self->_metadata[key].accessCount;
-            if (accessCount < NSIntegerMax) {
-                accessCount += 1;
-                self->_metadata[key].accessCount = accessCount;
-                [self asynchronouslySetAccessCount:accessCount forURL:fileURL];
             }
+            [self _locked_journalMetadataForKey:key];
             
             if (self->_byteLimit > 0 && self->_byteCount > self->_byteLimit)
                 [self trimToSizeByEvictionStrategyAsync:self->_byteLimit completion:nil];
@@ -1481,6 +1804,10 @@ static NSURL *_sharedTrashURL;
         
         [self->_metadata removeAllObjects];
         self.byteCount = 0; // atomic
+
+        // The journal and slabs went with the directory.
+        [self _locked_openJournal];
+        [self _locked_openSlabs];
     
         PINCacheBlock didRemoveAllObjectsBlock = self->_didRemoveAllObjectsBlock;
         if (didRemoveAllObjectsBlock) {
@@ -1501,7 +1828,8 @@ static NSURL *_sharedTrashURL;
         NSDate *now = [NSDate date];
     
         for (NSString *key in _metadata) {
-            NSURL *fileURL = [self encodedFileURLForKey:key];
+            // Packed objects have no file of their own.
+            NSURL *fileURL = _metadata[key].slabLocation == PINDiskCacheSlabLocationNone ? [self encodedFileURLForKey:key] : nil;
             // If the cache should behave like a TTL cache, then only fetch the object if there's a valid ageLimit and the object is still alive
             NSDate *createdDate = _metadata[key].createdDate;
             NSTimeInterval ageLimit = _metadata[key].ageLimit > 0.0 ? _metadata[key].ageLimit : self->_ageLimit;
@@ -1660,6 +1988,26 @@ static NSURL *_sharedTrashURL;
     } withPriority:PINOperationQueuePriorityHigh];
 }
 
+- (NSUInteger)packedObjectThreshold
+{
+    NSUInteger packedObjectThreshold;
+    
+    [self lock];
+        packedObjectThreshold = _packedObjectThreshold;
+    [self unlock];
+    
+    return packedObjectThreshold;
+}
+
+- (void)setPackedObjectThreshold:(NSUInteger)packedObjectThreshold
+{
+    [self.operationQueue scheduleOperation:^{
+        [self lock];
+            self->_packedObjectThreshold = packedObjectThreshold;
+        [self unlock];
+    } withPriority:PINOperationQueuePriorityHigh];
+}
+
 - (NSTimeInterval)ageLimit
 {
     NSTimeInterval ageLimit;
@@ -0,0 +1,409 @@
+//  PINCache is a modified version of TMCache
+//  Modifications by Garrett Moon
+//  Copyright (c) 2015 Pinterest. All rights reserved.
+
+#include "PINDiskCacheJournal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The file is a header, then records of a length and a CRC-32 of the body,
+// then the body: a type, the key length, the metadata for a set, the key.
+// Fields are in the device's byte order; the journal never leaves it.
+
+static const char PINJournalMagic[8] = {'P', 'I', 'N', 'J', 'R', 'N', 'L', '1'};
+static const uint32_t PINJournalVersion = 2;
+static const uint32_t PINJournalByteOrder = 0x01020304;
+
+#define PINJournalHeaderLength 16
+#define PINJournalRecordHeaderLength 8
+#define PINJournalBodyHeaderLength 8
+#define PINJournalMetadataLength 48
+#define PINJournalFlushLength (64 * 1024)
+
+enum {
+    PINJournalRecordSet = 1,
+    PINJournalRecordRemove = 2,
+};
+
+// MARK: - Checksum
+
+static uint32_t PINJournalCRCTable[256];
+static pthread_once_t PINJournalCRCOnce = PTHREAD_ONCE_INIT;
+
+static void PINJournalMakeCRCTable(void)
+{
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+        PINJournalCRCTable[byte] = crc;
+    }
+}
+
+static uint32_t PINJournalCRC(const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = PINJournalCRCTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// MARK: - Encoding
+
+static bool PINJournalReserve(PINDiskCacheJournal *journal, size_t length)
+{
+    if (journal->bufferCapacity - journal->bufferLength >= length) {
+        return true;
+    }
+    size_t capacity = journal->bufferCapacity ? journal->bufferCapacity : 256;
+    while (capacity - journal->bufferLength < length) {
+        capacity *= 2;
+    }
+    char *buffer = (char *)realloc(journal->buffer, capacity);
+    if (buffer == NULL) {
+        return false;
+    }
+    journal->buffer = buffer;
+    journal->bufferCapacity = capacity;
+    return true;
+}
+
+// Encodes a record at the end of the buffer.
+static bool PINJournalEncode(PINDiskCacheJournal *journal, uint32_t type, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata)
+{
+    if (keyLength > PINDiskCacheJournalMaxKeyLength) {
+        return false;
+    }
+    uint32_t bodyLength = PINJournalBodyHeaderLength + (type == PINJournalRecordSet ? PINJournalMetadataLength : 0) + (uint32_t)keyLength;
+    if (!PINJournalReserve(journal, PINJournalRecordHeaderLength + bodyLength)) {
+        return false;
+    }
+    char *record = journal->buffer + journal->bufferLength;
+    char *body = record + PINJournalRecordHeaderLength;
+    uint32_t keyLength32 = (uint32_t)keyLength;
+    memcpy(body, &type, 4);
+    memcpy(body + 4, &keyLength32, 4);
+    char *cursor = body + PINJournalBodyHeaderLength;
+    if (type == PINJournalRecordSet) {
+        memcpy(cursor, &metadata->size, 8);
+        memcpy(cursor + 8, &metadata->createdAt, 8);
+        memcpy(cursor + 16, &metadata->modifiedAt, 8);
+        memcpy(cursor + 24, &metadata->ageLimit, 8);
+        memcpy(cursor + 32, &metadata->accessCount, 8);
+        memcpy(cursor + 40, &metadata->slabLocation, 8);
+        cursor += PINJournalMetadataLength;
+    }
+    memcpy(cursor, key, keyLength);
+    uint32_t checksum = PINJournalCRC(body, bodyLength);
+    memcpy(record, &bodyLength, 4);
+    memcpy(record + 4, &checksum, 4);
+    journal->bufferLength += PINJournalRecordHeaderLength + bodyLength;
+    return true;
+}
+
+static bool PINJournalWriteAll(int fd, const char *bytes, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+static bool PINJournalWriteHeader(int fd)
+{
+    char header[PINJournalHeaderLength];
+    memcpy(header, PINJournalMagic, 8);
+    memcpy(header + 8, &PINJournalVersion, 4);
+    memcpy(header + 12, &PINJournalByteOrder, 4);
+    return PINJournalWriteAll(fd, header, sizeof(header));
+}
+
+// MARK: - Replay
+
+typedef enum {
+    PINJournalParseComplete,
+    PINJournalParseTorn,
+    PINJournalParseCorrupt,
+} PINJournalParseResult;
+
+// Replays records from `bytes`, setting `validLength` to the end of the last good one.
+static PINJournalParseResult PINJournalParse(const char *bytes, size_t length, size_t *validLength, uint32_t *recordCount, PINDiskCacheJournalReplayFunction replay, void *context)
+{
+    if (length < PINJournalHeaderLength || memcmp(bytes, PINJournalMagic, 8) != 0 || memcmp(bytes + 8, &PINJournalVersion, 4) != 0
+        || memcmp(bytes + 12, &PINJournalByteOrder, 4) != 0) {
+        return PINJournalParseCorrupt;
+    }
+    size_t offset = PINJournalHeaderLength;
+    *validLength = offset;
+    *recordCount = 0;
+    while (offset < length) {
+        if (length - offset < PINJournalRecordHeaderLength) {
+            return PINJournalParseTorn;
+        }
+        uint32_t bodyLength;
+        uint32_t checksum;
+        memcpy(&bodyLength, bytes + offset, 4);
+        memcpy(&checksum, bytes + offset + 4, 4);
+        size_t end = offset + PINJournalRecordHeaderLength;
+        if (length - end < bodyLength) {
+            return PINJournalParseTorn;
+        }
+        end += bodyLength;
+        const char *body = bytes + offset + PINJournalRecordHeaderLength;
+        uint32_t type = 0;
+        uint32_t keyLength = 0;
+        bool valid = bodyLength >= PINJournalBodyHeaderLength && PINJournalCRC(body, bodyLength) == checksum;
+        if (valid) {
+            memcpy(&type, body, 4);
+            memcpy(&keyLength, body + 4, 4);
+            size_t metadataLength = type == PINJournalRecordSet ? PINJournalMetadataLength : 0;
+            valid = (type == PINJournalRecordSet || type == PINJournalRecordRemove) && keyLength <= PINDiskCacheJournalMaxKeyLength
+                && bodyLength == PINJournalBodyHeaderLength + metadataLength + keyLength;
+        }
+        if (!valid) {
+            // Only the last append can be torn.
+            return end == length ? PINJournalParseTorn : PINJournalParseCorrupt;
+        }
+        const char *cursor = body + PINJournalBodyHeaderLength;
+        if (type == PINJournalRecordSet) {
+            PINDiskCacheJournalMetadata metadata;
+            memcpy(&metadata.size, cursor, 8);
+            memcpy(&metadata.createdAt, cursor + 8, 8);
+            memcpy(&metadata.modifiedAt, cursor + 16, 8);
+            memcpy(&metadata.ageLimit, cursor + 24, 8);
+            memcpy(&metadata.accessCount, cursor + 32, 8);
+            memcpy(&metadata.slabLocation, cursor + 40, 8);
+            replay(context, cursor + PINJournalMetadataLength, keyLength, &metadata);
+        } else {
+            replay(context, cursor, keyLength, NULL);
+        }
+        offset = end;
+        *validLength = offset;
+        (*recordCount)++;
+    }
+    return PINJournalParseComplete;
+}
+
+static char *PINJournalRewritePath(const PINDiskCacheJournal *journal)
+{
+    size_t length = strlen(journal->path);
+    char *path = (char *)malloc(length + 5);
+    if (path != NULL) {
+        memcpy(path, journal->path, length);
+        memcpy(path + length, ".new", 5);
+    }
+    return path;
+}
+
+// Empties the journal, leaving only a header.
+static bool PINJournalReset(PINDiskCacheJournal *journal)
+{
+    journal->recordCount = 0;
+    return ftruncate(journal->fd, 0) == 0 && lseek(journal->fd, 0, SEEK_SET) == 0 && PINJournalWriteHeader(journal->fd);
+}
+
+void PINDiskCacheJournalInit(PINDiskCacheJournal *journal)
+{
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = -1;
+    journal->rewriteFd = -1;
+}
+
+PINDiskCacheJournalState PINDiskCacheJournalOpen(PINDiskCacheJournal *journal, const char *path, PINDiskCacheJournalReplayFunction replay, void *context)
+{
+    pthread_once(&PINJournalCRCOnce, PINJournalMakeCRCTable);
+    PINDiskCacheJournalInit(journal);
+    journal->path = strdup(path);
+    if (journal->path == NULL) {
+        return PINDiskCacheJournalStateUnavailable;
+    }
+    // A compaction the last run didn't commit.
+    char *rewritePath = PINJournalRewritePath(journal);
+    if (rewritePath != NULL) {
+        unlink(rewritePath);
+        free(rewritePath);
+    }
+
+    journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (journal->fd < 0 || fstat(journal->fd, &info) != 0) {
+        PINDiskCacheJournalClose(journal);
+        return PINDiskCacheJournalStateUnavailable;
+    }
+
+    PINJournalParseResult result = PINJournalParseCorrupt;
+    size_t validLength = 0;
+    if (info.st_size > 0) {
+        size_t length = (size_t)info.st_size;
+        void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, journal->fd, 0);
+        if (mapping != MAP_FAILED) {
+            result = PINJournalParse((const char *)mapping, length, &validLength, &journal->recordCount, replay, context);
+            munmap(mapping, length);
+        }
+    }
+
+    PINDiskCacheJournalState state = PINDiskCacheJournalStateReplayed;
+    if (result == PINJournalParseCorrupt) {
+        // Records were replayed before the bad one; the caller starts over from the directory.
+        state = PINDiskCacheJournalStateEmpty;
+        if (!PINJournalReset(journal)) {
+            PINDiskCacheJournalInvalidate(journal);
+            return PINDiskCacheJournalStateUnavailable;
+        }
+    } else if ((result == PINJournalParseTorn && ftruncate(journal->fd, (off_t)validLength) != 0) || lseek(journal->fd, 0, SEEK_END) < 0) {
+        PINDiskCacheJournalInvalidate(journal);
+        return PINDiskCacheJournalStateUnavailable;
+    }
+    return state;
+}
+
+// MARK: - Appending
+
+bool PINDiskCacheJournalIsOpen(const PINDiskCacheJournal *journal)
+{
+    return journal->fd >= 0;
+}
+
+void PINDiskCacheJournalClose(PINDiskCacheJournal *journal)
+{
+    PINDiskCacheJournalAbortRewrite(journal);
+    if (journal->fd >= 0) {
+        close(journal->fd);
+    }
+    free(journal->path);
+    free(journal->buffer);
+    PINDiskCacheJournalInit(journal);
+}
+
+void PINDiskCacheJournalInvalidate(PINDiskCacheJournal *journal)
+{
+    if (journal->path != NULL) {
+        unlink(journal->path);
+    }
+    PINDiskCacheJournalClose(journal);
+}
+
+static bool PINJournalAppend(PINDiskCacheJournal *journal, uint32_t type, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata)
+{
+    if (journal->fd < 0) {
+        return false;
+    }
+    // Keep a rewrite's records in the buffer apart from this one.
+    size_t start = journal->bufferLength;
+    if (!PINJournalEncode(journal, type, key, keyLength, metadata) || !PINJournalWriteAll(journal->fd, journal->buffer + start, journal->bufferLength - start)) {
+        PINDiskCacheJournalInvalidate(journal);
+        return false;
+    }
+    journal->bufferLength = start;
+    journal->recordCount++;
+    return true;
+}
+
+bool PINDiskCacheJournalAppendSet(PINDiskCacheJournal *journal, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata)
+{
+    return PINJournalAppend(journal, PINJournalRecordSet, key, keyLength, metadata);
+}
+
+bool PINDiskCacheJournalAppendRemove(PINDiskCacheJournal *journal, const char *key, size_t keyLength)
+{
+    return PINJournalAppend(journal, PINJournalRecordRemove, key, keyLength, NULL);
+}
+
+bool PINDiskCacheJournalShouldCompact(const PINDiskCacheJournal *journal, uint32_t liveCount)
+{
+    return journal->fd >= 0 && journal->recordCount > 1024 && journal->recordCount / 4 > liveCount;
+}
+
+// MARK: - Compaction
+
+bool PINDiskCacheJournalBeginRewrite(PINDiskCacheJournal *journal)
+{
+    if (journal->fd < 0 || journal->rewriteFd >= 0) {
+        return false;
+    }
+    char *rewritePath = PINJournalRewritePath(journal);
+    if (rewritePath == NULL) {
+        return false;
+    }
+    journal->rewriteFd = open(rewritePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    free(rewritePath);
+    journal->rewriteCount = 0;
+    journal->bufferLength = 0;
+    if (journal->rewriteFd < 0 || !PINJournalWriteHeader(journal->rewriteFd)) {
+        PINDiskCacheJournalAbortRewrite(journal);
+        return false;
+    }
+    return true;
+}
+
+bool PINDiskCacheJournalRewriteSet(PINDiskCacheJournal *journal, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata)
+{
+    if (journal->rewriteFd < 0 || !PINJournalEncode(journal, PINJournalRecordSet, key, keyLength, metadata)) {
+        return false;
+    }
+    journal->rewriteCount++;
+    if (journal->bufferLength >= PINJournalFlushLength) {
+        if (!PINJournalWriteAll(journal->rewriteFd, journal->buffer, journal->bufferLength)) {
+            PINDiskCacheJournalAbortRewrite(journal);
+            return false;
+        }
+        journal->bufferLength = 0;
+    }
+    return true;
+}
+
+bool PINDiskCacheJournalCommitRewrite(PINDiskCacheJournal *journal)
+{
+    if (journal->rewriteFd < 0) {
+        return false;
+    }
+    char *rewritePath = PINJournalRewritePath(journal);
+    // The new file is complete on disk before it takes the old one's name.
+    bool written = rewritePath != NULL && PINJournalWriteAll(journal->rewriteFd, journal->buffer, journal->bufferLength) && fsync(journal->rewriteFd) == 0;
+    if (!written || rename(rewritePath, journal->path) != 0) {
+        free(rewritePath);
+        PINDiskCacheJournalAbortRewrite(journal);
+        return false;
+    }
+    free(rewritePath);
+    close(journal->fd);
+    journal->fd = journal->rewriteFd;
+    journal->rewriteFd = -1;
+    journal->recordCount = journal->rewriteCount;
+    journal->bufferLength = 0;
+    return true;
+}
+
+void PINDiskCacheJournalAbortRewrite(PINDiskCacheJournal *journal)
+{
+    if (journal->rewriteFd < 0) {
+        return;
+    }
+    close(journal->rewriteFd);
+    journal->rewriteFd = -1;
+    journal->bufferLength = 0;
+    char *rewritePath = PINJournalRewritePath(journal);
+    if (rewritePath != NULL) {
+        unlink(rewritePath);
+        free(rewritePath);
+    }
+}
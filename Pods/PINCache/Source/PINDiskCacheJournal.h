@@ -0,0 +1,117 @@
+//  PINCache is a modified version of TMCache
+//  Modifications by Garrett Moon
+//  Copyright (c) 2015 Pinterest. All rights reserved.
+
+#ifndef PINDiskCacheJournal_h
+#define PINDiskCacheJournal_h
+
+// Plain C with no Foundation dependency, so the journal format and its
+// recovery can be built, tested and benchmarked on their own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Longest key the journal records. Appending a longer one fails. */
+#define PINDiskCacheJournalMaxKeyLength 65535
+
+/** What PINDiskCache knows of an entry, as recorded in the journal. */
+typedef struct {
+    uint64_t size;
+    /** Seconds since the reference date, as NSDate's timeIntervalSinceReferenceDate. */
+    double createdAt;
+    double modifiedAt;
+    /** 0 when the entry has no age limit of its own. */
+    double ageLimit;
+    int64_t accessCount;
+    /** Where a packed entry is in the slabs, or 0 for an entry with its own file. */
+    uint64_t slabLocation;
+} PINDiskCacheJournalMetadata;
+
+typedef enum {
+    /** The journal was read back, up to any record torn by a crash, which is cut off. */
+    PINDiskCacheJournalStateReplayed,
+    /**
+     The journal was missing or failed validation and is now empty. The caller
+     drops anything replayed, rebuilds its state from the directory and
+     rewrites the journal.
+     */
+    PINDiskCacheJournalStateEmpty,
+    /** The journal couldn't be opened or written. Appends do nothing. */
+    PINDiskCacheJournalStateUnavailable,
+} PINDiskCacheJournalState;
+
+/**
+ Called for each record in order. `metadata` is NULL for a removal. The key
+ isn't NUL-terminated and is only valid during the call.
+ */
+typedef void (*PINDiskCacheJournalReplayFunction)(void *context, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata);
+
+/**
+ An append-only log of entry metadata, so a disk cache can learn its state
+ at startup without looking at every file.
+
+ Every set or removal appends one checksummed record in a single write. On
+ open the file is mapped and replayed, the last record of a key winning. A
+ record that runs past the end of the file, or the last record failing its
+ checksum, is what a crash mid-append leaves, and is cut off. A bad record
+ anywhere else fails validation. Compaction writes the live entries to a
+ new file and renames it over the old one, so a crash leaves one or the
+ other.
+
+ Not thread safe.
+ */
+typedef struct {
+    int fd;
+    char *path;
+    /** Records in the file, for deciding when to compact. */
+    uint32_t recordCount;
+    int rewriteFd;
+    uint32_t rewriteCount;
+    char *buffer;
+    size_t bufferLength;
+    size_t bufferCapacity;
+} PINDiskCacheJournal;
+
+/** Sets up a closed journal. */
+void PINDiskCacheJournalInit(PINDiskCacheJournal *journal);
+
+/** Opens or creates the journal at `path`, replaying its records into `replay`. */
+PINDiskCacheJournalState PINDiskCacheJournalOpen(PINDiskCacheJournal *journal, const char *path, PINDiskCacheJournalReplayFunction replay, void *context);
+
+void PINDiskCacheJournalClose(PINDiskCacheJournal *journal);
+
+/** Closes the journal and removes its file, so the next open rebuilds from the directory. */
+void PINDiskCacheJournalInvalidate(PINDiskCacheJournal *journal);
+
+bool PINDiskCacheJournalIsOpen(const PINDiskCacheJournal *journal);
+
+/**
+ Appends a record. A failed append invalidates the journal, since it no
+ longer describes the directory.
+ */
+bool PINDiskCacheJournalAppendSet(PINDiskCacheJournal *journal, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata);
+bool PINDiskCacheJournalAppendRemove(PINDiskCacheJournal *journal, const char *key, size_t keyLength);
+
+/** Whether enough records are superseded that compacting down to `liveCount` pays off. */
+bool PINDiskCacheJournalShouldCompact(const PINDiskCacheJournal *journal, uint32_t liveCount);
+
+/**
+ Compaction: begin a new file, add every live entry, then commit to replace
+ the journal with it, or abort to keep the old one. Nothing may be appended
+ in between.
+ */
+bool PINDiskCacheJournalBeginRewrite(PINDiskCacheJournal *journal);
+bool PINDiskCacheJournalRewriteSet(PINDiskCacheJournal *journal, const char *key, size_t keyLength, const PINDiskCacheJournalMetadata *metadata);
+bool PINDiskCacheJournalCommitRewrite(PINDiskCacheJournal *journal);
+void PINDiskCacheJournalAbortRewrite(PINDiskCacheJournal *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINDiskCacheJournal_h
@@ -0,0 +1,477 @@
+//  PINCache is a modified version of TMCache
+//  Modifications by Garrett Moon
+//  Copyright (c) 2015 Pinterest. All rights reserved.
+
+#include "PINDiskCacheSlabs.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A slab is a header, then records of a key length, a data length and a
+// checksum of both and the key and data, then the key and data, padded so
+// the next record is aligned. Fields are in the device's byte order.
+
+static const char PINSlabMagic[8] = {'P', 'I', 'N', 'S', 'L', 'A', 'B', '1'};
+static const uint32_t PINSlabVersion = 1;
+static const uint32_t PINSlabByteOrder = 0x01020304;
+
+#define PINSlabHeaderLength 16
+#define PINSlabRecordHeaderLength 16
+#define PINSlabAlignment 8
+#define PINSlabNameLength 13
+
+// MARK: - Records
+
+size_t PINDiskCacheSlabRecordLength(size_t keyLength, size_t dataLength)
+{
+    size_t length = PINSlabRecordHeaderLength + keyLength + dataLength;
+    return (length + PINSlabAlignment - 1) & ~(size_t)(PINSlabAlignment - 1);
+}
+
+static inline uint64_t PINSlabMix(uint64_t hash, uint64_t word)
+{
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+    return (hash << 31) | (hash >> 33);
+}
+
+// Catches a record torn by a crash, not tampering. Four lanes so a 64 KB
+// record checks in a few microseconds rather than a CRC's tens.
+static uint64_t PINSlabChecksum(const char *bytes, size_t length, uint64_t seed)
+{
+    uint64_t lanes[4] = {seed, seed ^ 0x6A09E667F3BCC908ull, seed ^ 0xBB67AE8584CAA73Bull, seed ^ 0x3C6EF372FE94F82Bull};
+    size_t offset = 0;
+    for (; length - offset >= 32; offset += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, bytes + offset + lane * 8, 8);
+            lanes[lane] = PINSlabMix(lanes[lane], word);
+        }
+    }
+    uint64_t hash = PINSlabMix(PINSlabMix(lanes[0], lanes[1]), PINSlabMix(lanes[2], lanes[3]));
+    for (; length - offset >= 8; offset += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + offset, 8);
+        hash = PINSlabMix(hash, word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + offset, length - offset);
+    return PINSlabMix(PINSlabMix(hash, tail), length);
+}
+
+static uint64_t PINSlabRecordChecksum(uint32_t keyLength, uint32_t dataLength, const char *contents)
+{
+    return PINSlabChecksum(contents, (size_t)keyLength + dataLength, ((uint64_t)keyLength << 32) | dataLength);
+}
+
+static PINDiskCacheSlabLocation PINSlabLocationMake(uint32_t identifier, uint32_t offset)
+{
+    return ((uint64_t)identifier << 32) | offset;
+}
+
+// The record at `offset` if its header fits in the slab and its key and data fit after it.
+static bool PINSlabRecordAt(const PINDiskCacheSlab *slab, uint32_t offset, uint32_t *keyLength, uint32_t *dataLength, uint64_t *checksum)
+{
+    if (offset < PINSlabHeaderLength || offset % PINSlabAlignment != 0 || slab->length - offset < PINSlabRecordHeaderLength) {
+        return false;
+    }
+    const char *header = slab->mapping + offset;
+    memcpy(keyLength, header, 4);
+    memcpy(dataLength, header + 4, 4);
+    memcpy(checksum, header + 8, 8);
+    return (uint64_t)*keyLength + *dataLength <= slab->length - offset - PINSlabRecordHeaderLength;
+}
+
+// MARK: - Files
+
+static bool PINSlabWriteAll(int fd, const char *bytes, size_t length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t written = pwrite(fd, bytes, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        length -= (size_t)written;
+        offset += written;
+    }
+    return true;
+}
+
+static void PINSlabName(char name[PINSlabNameLength + 1], uint32_t identifier)
+{
+    snprintf(name, PINSlabNameLength + 1, "%08x.slab", identifier);
+}
+
+static char *PINSlabPath(const PINDiskCacheSlabStore *store, const char *name)
+{
+    size_t directoryLength = strlen(store->directory);
+    size_t nameLength = strlen(name);
+    char *path = (char *)malloc(directoryLength + nameLength + 2);
+    if (path != NULL) {
+        memcpy(path, store->directory, directoryLength);
+        path[directoryLength] = '/';
+        memcpy(path + directoryLength + 1, name, nameLength + 1);
+    }
+    return path;
+}
+
+static void PINSlabUnlink(const PINDiskCacheSlabStore *store, uint32_t identifier)
+{
+    char name[PINSlabNameLength + 1];
+    PINSlabName(name, identifier);
+    char *path = PINSlabPath(store, name);
+    if (path != NULL) {
+        unlink(path);
+        free(path);
+    }
+}
+
+static void PINSlabClose(PINDiskCacheSlab *slab)
+{
+    if (slab->mapping != NULL) {
+        munmap((void *)slab->mapping, slab->capacity);
+    }
+    if (slab->fd >= 0) {
+        close(slab->fd);
+    }
+}
+
+static bool PINSlabMap(PINDiskCacheSlab *slab)
+{
+    if (slab->mapping != NULL) {
+        return true;
+    }
+    // Mapped past the end of the file, so appends show up without remapping.
+    void *mapping = mmap(NULL, slab->capacity, PROT_READ, MAP_SHARED, slab->fd, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    slab->mapping = (const char *)mapping;
+    return true;
+}
+
+static bool PINSlabAdd(PINDiskCacheSlabStore *store, PINDiskCacheSlab slab)
+{
+    if (store->slabCount == store->slabsAllocated) {
+        size_t allocated = store->slabsAllocated ? store->slabsAllocated * 2 : 8;
+        PINDiskCacheSlab *slabs = (PINDiskCacheSlab *)realloc(store->slabs, allocated * sizeof(PINDiskCacheSlab));
+        if (slabs == NULL) {
+            return false;
+        }
+        store->slabs = slabs;
+        store->slabsAllocated = allocated;
+    }
+    store->slabs[store->slabCount++] = slab;
+    return true;
+}
+
+static int PINSlabCompareIdentifiers(const void *a, const void *b)
+{
+    uint32_t left = ((const PINDiskCacheSlab *)a)->identifier;
+    uint32_t right = ((const PINDiskCacheSlab *)b)->identifier;
+    return left < right ? -1 : left > right;
+}
+
+// Opens an existing slab, or returns false if it isn't a valid one.
+static bool PINSlabOpenExisting(PINDiskCacheSlabStore *store, const char *name, uint32_t identifier, PINDiskCacheSlab *slab)
+{
+    char *path = PINSlabPath(store, name);
+    if (path == NULL) {
+        return false;
+    }
+    slab->identifier = identifier;
+    slab->fd = open(path, O_RDWR);
+    slab->mapping = NULL;
+    slab->liveLength = 0;
+    free(path);
+    char header[PINSlabHeaderLength];
+    struct stat info;
+    if (slab->fd < 0 || fstat(slab->fd, &info) != 0 || info.st_size < PINSlabHeaderLength || info.st_size > UINT32_MAX - PINSlabAlignment
+        || pread(slab->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) || memcmp(header, PINSlabMagic, 8) != 0
+        || memcmp(header + 8, &PINSlabVersion, 4) != 0 || memcmp(header + 12, &PINSlabByteOrder, 4) != 0) {
+        PINSlabClose(slab);
+        return false;
+    }
+    // A crash can leave part of a record at the end, which was never handed out.
+    slab->length = (uint32_t)(((size_t)info.st_size + PINSlabAlignment - 1) & ~(size_t)(PINSlabAlignment - 1));
+    slab->capacity = slab->length > store->slabCapacity ? slab->length : store->slabCapacity;
+    return true;
+}
+
+static PINDiskCacheSlab *PINSlabCreate(PINDiskCacheSlabStore *store)
+{
+    uint32_t identifier = store->slabCount ? store->slabs[store->slabCount - 1].identifier + 1 : 1;
+    if (identifier == 0) {
+        return NULL;
+    }
+    char name[PINSlabNameLength + 1];
+    PINSlabName(name, identifier);
+    char *path = PINSlabPath(store, name);
+    if (path == NULL) {
+        return NULL;
+    }
+    PINDiskCacheSlab slab;
+    slab.identifier = identifier;
+    slab.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    slab.length = PINSlabHeaderLength;
+    slab.liveLength = 0;
+    slab.capacity = store->slabCapacity;
+    slab.mapping = NULL;
+    char header[PINSlabHeaderLength];
+    memcpy(header, PINSlabMagic, 8);
+    memcpy(header + 8, &PINSlabVersion, 4);
+    memcpy(header + 12, &PINSlabByteOrder, 4);
+    if (slab.fd < 0 || !PINSlabWriteAll(slab.fd, header, sizeof(header), 0) || !PINSlabAdd(store, slab)) {
+        PINSlabClose(&slab);
+        unlink(path);
+        free(path);
+        return NULL;
+    }
+    free(path);
+    return &store->slabs[store->slabCount - 1];
+}
+
+static PINDiskCacheSlab *PINSlabFind(const PINDiskCacheSlabStore *store, uint32_t identifier)
+{
+    size_t low = 0;
+    size_t high = store->slabCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (store->slabs[middle].identifier < identifier) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < store->slabCount && store->slabs[low].identifier == identifier ? &store->slabs[low] : NULL;
+}
+
+// MARK: - Opening
+
+void PINDiskCacheSlabStoreInit(PINDiskCacheSlabStore *store, uint32_t slabCapacity)
+{
+    memset(store, 0, sizeof(*store));
+    store->slabCapacity = slabCapacity;
+}
+
+bool PINDiskCacheSlabStoreOpen(PINDiskCacheSlabStore *store, const char *directory)
+{
+    PINDiskCacheSlabStoreClose(store);
+    if ((mkdir(directory, 0755) != 0 && errno != EEXIST) || (store->directory = strdup(directory)) == NULL) {
+        return false;
+    }
+    DIR *entries = opendir(directory);
+    if (entries == NULL) {
+        PINDiskCacheSlabStoreClose(store);
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(entries)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.') {
+            continue;
+        }
+        char *end = NULL;
+        unsigned long identifier = strtoul(name, &end, 16);
+        PINDiskCacheSlab slab;
+        if (strlen(name) != PINSlabNameLength || end != name + 8 || strcmp(end, ".slab") != 0 || identifier == 0
+            || identifier > UINT32_MAX || !PINSlabOpenExisting(store, name, (uint32_t)identifier, &slab)) {
+            char *path = PINSlabPath(store, name);
+            if (path != NULL) {
+                unlink(path);
+                free(path);
+            }
+            continue;
+        }
+        if (!PINSlabAdd(store, slab)) {
+            PINSlabClose(&slab);
+        }
+    }
+    closedir(entries);
+    if (store->slabCount > 1) {
+        qsort(store->slabs, store->slabCount, sizeof(PINDiskCacheSlab), PINSlabCompareIdentifiers);
+    }
+    return true;
+}
+
+void PINDiskCacheSlabStoreClose(PINDiskCacheSlabStore *store)
+{
+    for (size_t i = 0; i < store->slabCount; i++) {
+        PINSlabClose(&store->slabs[i]);
+    }
+    free(store->slabs);
+    free(store->directory);
+    free(store->buffer);
+    PINDiskCacheSlabStoreInit(store, store->slabCapacity);
+}
+
+bool PINDiskCacheSlabStoreIsOpen(const PINDiskCacheSlabStore *store)
+{
+    return store->directory != NULL;
+}
+
+// MARK: - Records
+
+PINDiskCacheSlabLocation PINDiskCacheSlabStoreAppend(PINDiskCacheSlabStore *store, const char *key, size_t keyLength, const void *data, size_t dataLength)
+{
+    size_t recordLength = PINDiskCacheSlabRecordLength(keyLength, dataLength);
+    if (store->directory == NULL || recordLength > store->slabCapacity - PINSlabHeaderLength) {
+        return PINDiskCacheSlabLocationNone;
+    }
+    PINDiskCacheSlab *slab = store->slabCount ? &store->slabs[store->slabCount - 1] : NULL;
+    if (slab == NULL || slab->capacity - slab->length < recordLength) {
+        slab = PINSlabCreate(store);
+        if (slab == NULL) {
+            return PINDiskCacheSlabLocationNone;
+        }
+    }
+
+    // One write, so a crash leaves the record whole or cut off at the end.
+    if (store->bufferCapacity < recordLength) {
+        char *buffer = (char *)realloc(store->buffer, recordLength);
+        if (buffer == NULL) {
+            return PINDiskCacheSlabLocationNone;
+        }
+        store->buffer = buffer;
+        store->bufferCapacity = recordLength;
+    }
+    char *record = store->buffer;
+    uint32_t keyLength32 = (uint32_t)keyLength;
+    uint32_t dataLength32 = (uint32_t)dataLength;
+    memcpy(record + PINSlabRecordHeaderLength, key, keyLength);
+    if (dataLength > 0) {
+        memcpy(record + PINSlabRecordHeaderLength + keyLength, data, dataLength);
+    }
+    uint64_t checksum = PINSlabRecordChecksum(keyLength32, dataLength32, record + PINSlabRecordHeaderLength);
+    memcpy(record, &keyLength32, 4);
+    memcpy(record + 4, &dataLength32, 4);
+    memcpy(record + 8, &checksum, 8);
+    size_t end = PINSlabRecordHeaderLength + keyLength + dataLength;
+    memset(record + end, 0, recordLength - end);
+
+    uint32_t offset = slab->length;
+    if (!PINSlabWriteAll(slab->fd, record, recordLength, offset)) {
+        return PINDiskCacheSlabLocationNone;
+    }
+    slab->length += (uint32_t)recordLength;
+    slab->liveLength += (uint32_t)recordLength;
+    return PINSlabLocationMake(slab->identifier, offset);
+}
+
+bool PINDiskCacheSlabStoreRead(PINDiskCacheSlabStore *store, PINDiskCacheSlabLocation location, const char *key, size_t keyLength, const void **data, size_t *dataLength)
+{
+    PINDiskCacheSlab *slab = PINSlabFind(store, (uint32_t)(location >> 32));
+    uint32_t offset = (uint32_t)location;
+    uint32_t recordKeyLength;
+    uint32_t recordDataLength;
+    uint64_t checksum;
+    if (slab == NULL || !PINSlabMap(slab) || !PINSlabRecordAt(slab, offset, &recordKeyLength, &recordDataLength, &checksum)
+        || recordKeyLength != keyLength) {
+        return false;
+    }
+    const char *contents = slab->mapping + offset + PINSlabRecordHeaderLength;
+    if (memcmp(contents, key, keyLength) != 0 || PINSlabRecordChecksum(recordKeyLength, recordDataLength, contents) != checksum) {
+        return false;
+    }
+    *data = contents + keyLength;
+    *dataLength = recordDataLength;
+    return true;
+}
+
+bool PINDiskCacheSlabStoreRetain(PINDiskCacheSlabStore *store, PINDiskCacheSlabLocation location, uint64_t length)
+{
+    PINDiskCacheSlab *slab = PINSlabFind(store, (uint32_t)(location >> 32));
+    uint32_t offset = (uint32_t)location;
+    if (slab == NULL || offset < PINSlabHeaderLength || offset > slab->length || length > slab->length - offset
+        || length > slab->length - slab->liveLength) {
+        return false;
+    }
+    slab->liveLength += (uint32_t)length;
+    return true;
+}
+
+void PINDiskCacheSlabStoreRelease(PINDiskCacheSlabStore *store, PINDiskCacheSlabLocation location, uint64_t length)
+{
+    PINDiskCacheSlab *slab = PINSlabFind(store, (uint32_t)(location >> 32));
+    if (slab != NULL) {
+        slab->liveLength -= length < slab->liveLength ? (uint32_t)length : slab->liveLength;
+    }
+}
+
+// MARK: - Compaction
+
+// The older slab with the least in use, if at least half of it is released.
+static PINDiskCacheSlab *PINSlabCompactionCandidate(const PINDiskCacheSlabStore *store)
+{
+    PINDiskCacheSlab *candidate = NULL;
+    // The newest slab takes appends and is never compacted.
+    for (size_t i = 0; i + 1 < store->slabCount; i++) {
+        PINDiskCacheSlab *slab = &store->slabs[i];
+        if ((uint64_t)slab->liveLength * 2 <= slab->length
+            && (candidate == NULL || (uint64_t)slab->liveLength * candidate->length < (uint64_t)candidate->liveLength * slab->length)) {
+            candidate = slab;
+        }
+    }
+    return candidate;
+}
+
+bool PINDiskCacheSlabStoreShouldCompact(const PINDiskCacheSlabStore *store)
+{
+    return PINSlabCompactionCandidate(store) != NULL;
+}
+
+bool PINDiskCacheSlabStoreCompact(PINDiskCacheSlabStore *store, PINDiskCacheSlabLiveFunction isLive, PINDiskCacheSlabMovedFunction moved, void *context)
+{
+    PINDiskCacheSlab *slab = PINSlabCompactionCandidate(store);
+    if (slab == NULL) {
+        return false;
+    }
+    uint32_t identifier = slab->identifier;
+    if (slab->liveLength > 0 && !PINSlabMap(slab)) {
+        return false;
+    }
+
+    // Stops once everything in use has been moved.
+    for (uint32_t offset = PINSlabHeaderLength; slab->liveLength > 0;) {
+        uint32_t keyLength;
+        uint32_t dataLength;
+        uint64_t checksum;
+        if (!PINSlabRecordAt(slab, offset, &keyLength, &dataLength, &checksum)) {
+            break;
+        }
+        const char *contents = slab->mapping + offset + PINSlabRecordHeaderLength;
+        uint32_t recordLength = (uint32_t)PINDiskCacheSlabRecordLength(keyLength, dataLength);
+        PINDiskCacheSlabLocation from = PINSlabLocationMake(identifier, offset);
+        if (PINSlabRecordChecksum(keyLength, dataLength, contents) == checksum && isLive(context, contents, keyLength, from)) {
+            // Appending can grow the slab array, so the slab is found again afterwards.
+            PINDiskCacheSlabLocation to = PINDiskCacheSlabStoreAppend(store, contents, keyLength, contents + keyLength, dataLength);
+            slab = PINSlabFind(store, identifier);
+            if (to == PINDiskCacheSlabLocationNone) {
+                return false;
+            }
+            moved(context, contents, keyLength, to);
+            slab->liveLength -= recordLength < slab->liveLength ? recordLength : slab->liveLength;
+        }
+        if (recordLength > slab->length - offset) {
+            break;
+        }
+        offset += recordLength;
+    }
+
+    size_t index = (size_t)(slab - store->slabs);
+    PINSlabClose(slab);
+    PINSlabUnlink(store, identifier);
+    memmove(slab, slab + 1, (store->slabCount - index - 1) * sizeof(PINDiskCacheSlab));
+    store->slabCount--;
+    return true;
+}
@@ -0,0 +1,126 @@
+//  PINCache is a modified version of TMCache
+//  Modifications by Garrett Moon
+//  Copyright (c) 2015 Pinterest. All rights reserved.
+
+#ifndef PINDiskCacheSlabs_h
+#define PINDiskCacheSlabs_h
+
+// Plain C with no Foundation dependency, so slab storage and its compaction
+// can be built, tested and benchmarked on their own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default length of a slab file. Records longer than a slab can't be packed. */
+#define PINDiskCacheSlabDefaultCapacity (4 * 1024 * 1024)
+
+/** A slab's identifier in the high 32 bits and a record's offset in it in the low. */
+typedef uint64_t PINDiskCacheSlabLocation;
+
+/** No slab record; an entry with its own file. */
+#define PINDiskCacheSlabLocationNone 0
+
+/**
+ Asked during compaction whether the record for `key` at `location` is still
+ in use. The key isn't NUL-terminated and is only valid during the call.
+ */
+typedef bool (*PINDiskCacheSlabLiveFunction)(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location);
+
+/** Told during compaction that a record in use was copied to `location`. */
+typedef void (*PINDiskCacheSlabMovedFunction)(void *context, const char *key, size_t keyLength, PINDiskCacheSlabLocation location);
+
+typedef struct {
+    uint32_t identifier;
+    int fd;
+    /** Where the next record goes. */
+    uint32_t length;
+    /** Bytes of records in use. The rest is reclaimed by compaction. */
+    uint32_t liveLength;
+    /** Mapped length, at least the slab capacity so appends never remap. */
+    size_t capacity;
+    /** Mapped on first read. */
+    const char *mapping;
+} PINDiskCacheSlab;
+
+/**
+ Packs small objects into append-only slab files, so each doesn't cost a
+ file of its own: an inode, a directory entry, several syscalls and
+ rounding up to a filesystem block.
+
+ A record is its key and data behind a header with their lengths and a
+ checksum, and is read in place through the slab's mapping. Which records
+ are in use, and where, is up to the caller, who keeps each location
+ alongside the entry's other metadata and hands them back with Retain after
+ a restart. Records replaced or removed are released, and once half of an
+ older slab is released compaction copies what's left to the newest slab
+ and deletes it.
+
+ Not thread safe.
+ */
+typedef struct {
+    char *directory;
+    uint32_t slabCapacity;
+    /** In identifier order. Appends go to the last. */
+    PINDiskCacheSlab *slabs;
+    size_t slabCount;
+    size_t slabsAllocated;
+    char *buffer;
+    size_t bufferCapacity;
+} PINDiskCacheSlabStore;
+
+/** Sets up a closed store whose slabs hold up to `slabCapacity` bytes. */
+void PINDiskCacheSlabStoreInit(PINDiskCacheSlabStore *store, uint32_t slabCapacity);
+
+/**
+ Opens the slabs in `directory`, creating it if needed. Every record starts
+ out released: Retain the ones still in use. Files that aren't valid slabs
+ are removed.
+ */
+bool PINDiskCacheSlabStoreOpen(PINDiskCacheSlabStore *store, const char *directory);
+
+void PINDiskCacheSlabStoreClose(PINDiskCacheSlabStore *store);
+
+bool PINDiskCacheSlabStoreIsOpen(const PINDiskCacheSlabStore *store);
+
+/** Bytes a record takes in its slab, which is what it costs on disk. */
+size_t PINDiskCacheSlabRecordLength(size_t keyLength, size_t dataLength);
+
+/** Appends a record, or returns PINDiskCacheSlabLocationNone if it can't. */
+PINDiskCacheSlabLocation PINDiskCacheSlabStoreAppend(PINDiskCacheSlabStore *store, const char *key, size_t keyLength, const void *data, size_t dataLength);
+
+/**
+ Finds the data of the record for `key` at `location`, failing if the
+ record is missing, for another key or fails its checksum. The data stays
+ valid until the store is next changed.
+ */
+bool PINDiskCacheSlabStoreRead(PINDiskCacheSlabStore *store, PINDiskCacheSlabLocation location, const char *key, size_t keyLength, const void **data, size_t *dataLength);
+
+/**
+ Marks `length` bytes at `location` in use after opening. Fails if there's
+ no such slab or the record runs past its end.
+ */
+bool PINDiskCacheSlabStoreRetain(PINDiskCacheSlabStore *store, PINDiskCacheSlabLocation location, uint64_t length);
+
+/** Marks a record no longer in use, once it's been removed or replaced. */
+void PINDiskCacheSlabStoreRelease(PINDiskCacheSlabStore *store, PINDiskCacheSlabLocation location, uint64_t length);
+
+/** Whether an older slab is at least half released. */
+bool PINDiskCacheSlabStoreShouldCompact(const PINDiskCacheSlabStore *store);
+
+/**
+ Copies the records in use from the older slab with the least in use to the
+ newest one, then deletes it. Fails if a copy can't be written, leaving the
+ slab with whatever wasn't moved yet.
+ */
+bool PINDiskCacheSlabStoreCompact(PINDiskCacheSlabStore *store, PINDiskCacheSlabLiveFunction isLive, PINDiskCacheSlabMovedFunction moved, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINDiskCacheSlabs_h
@@ -3,6 +3,7 @@
 //  Copyright (c) 2015 Pinterest. All rights reserved.
 
 #import "PINMemoryCache.h"
+#import "PINMemoryCacheIndex.h"
 
 #import <pthread.h>
 
@@ -19,20 +20,18 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
 @property (copy, nonatomic) NSString *name;
 @property (strong, nonatomic) PINOperationQueue *operationQueue;
 @property (assign, nonatomic) pthread_mutex_t mutex;
-@property (strong, nonatomic) NSMutableDictionary *dictionary;
-@property (strong, nonatomic) NSMutableDictionary *createdDates;
-@property (strong, nonatomic) NSMutableDictionary *accessDates;
-@property (strong, nonatomic) NSMutableDictionary *costs;
-@property (strong, nonatomic) NSMutableDictionary *ageLimits;
-@property (strong, nonatomic) NSMutableDictionary *accessCounts;
 @end
 
-@implementation PINMemoryCache
+@implementation PINMemoryCache {
+    // Keys to entry handles. Each entry holds its key and object, retained, and
+    // everything eviction and trimming go by.
+    NSMutableDictionary<NSString *, NSNumber *> *_handles;
+    PINMemoryCacheIndex _index;
+}
 
 @synthesize name = _name;
 @synthesize ageLimit = _ageLimit;
 @synthesize costLimit = _costLimit;
-@synthesize totalCost = _totalCost;
 @synthesize ttlCache = _ttlCache;
 @synthesize willAddObjectBlock = _willAddObjectBlock;
 @synthesize willRemoveObjectBlock = _willRemoveObjectBlock;
@@ -49,6 +48,9 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
 {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
 
+    [self releaseAllEntries];
+    PINMemoryCacheIndexDestroy(&_index);
+
     __unused int result = pthread_mutex_destroy(&_mutex);
     NSCAssert(result == 0, @"Failed to destroy lock in PINMemoryCache %p. Code: %d", (void *)self, result);
 }
@@ -83,12 +85,8 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         _operationQueue = operationQueue;
         _ttlCache = ttlCache;
         
-        _dictionary = [[NSMutableDictionary alloc] init];
-        _createdDates = [[NSMutableDictionary alloc] init];
-        _accessDates = [[NSMutableDictionary alloc] init];
-        _costs = [[NSMutableDictionary alloc] init];
-        _ageLimits = [[NSMutableDictionary alloc] init];
-        _accessCounts = [[NSMutableDictionary alloc] init];
+        _handles = [[NSMutableDictionary alloc] init];
+        PINMemoryCacheIndexInit(&_index);
         
         _willAddObjectBlock = nil;
         _willRemoveObjectBlock = nil;
@@ -103,7 +101,6 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         
         _ageLimit = 0.0;
         _costLimit = 0;
-        _totalCost = 0;
         _evictionStrategy = evictionStrategy;
         
         _removeAllObjectsOnMemoryWarning = YES;
@@ -170,11 +167,50 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
     } withPriority:PINOperationQueuePriorityHigh];
 }
 
+// Call with the lock held.
+- (PINMemoryCacheHandle)handleForKey:(NSString *)key
+{
+    NSNumber *handle = _handles[key];
+    return handle ? (PINMemoryCacheHandle)[handle unsignedIntValue] : PINMemoryCacheHandleNone;
+}
+
+// Call with the lock held.
+- (void)removeEntry:(PINMemoryCacheHandle)handle
+{
+    PINMemoryCacheEntry *entry = PINMemoryCacheIndexEntry(&_index, handle);
+    NSString *key = (__bridge_transfer NSString *)entry->key;
+    CFRelease(entry->object);
+    PINMemoryCacheIndexRemove(&_index, handle);
+    [_handles removeObjectForKey:key];
+}
+
+// Call with the lock held.
+- (void)releaseAllEntries
+{
+    PINMemoryCacheCreationCursor cursor = PINMemoryCacheIndexCreationCursor(&_index);
+    PINMemoryCacheHandle handle;
+    while ((handle = PINMemoryCacheIndexNextByCreation(&_index, &cursor)) != PINMemoryCacheHandleNone) {
+        PINMemoryCacheEntry *entry = PINMemoryCacheIndexEntry(&_index, handle);
+        CFRelease(entry->key);
+        CFRelease(entry->object);
+    }
+    PINMemoryCacheIndexRemoveAll(&_index);
+    [_handles removeAllObjects];
+}
+
+// Call with the lock held. Whether a TTL cache still shows the entry at `now`.
+- (BOOL)isEntryAlive:(PINMemoryCacheHandle)handle now:(CFAbsoluteTime)now
+{
+    PINMemoryCacheEntry *entry = PINMemoryCacheIndexEntry(&_index, handle);
+    NSTimeInterval ageLimit = entry->ageLimit ?: _ageLimit;
+    return !_ttlCache || ageLimit <= 0 || fabs(entry->createdAt - now) < ageLimit;
+}
+
 - (void)removeObjectAndExecuteBlocksForKey:(NSString *)key
 {
     [self lock];
-        id object = _dictionary[key];
-        NSNumber *cost = _costs[key];
+        PINMemoryCacheHandle handle = [self handleForKey:key];
+        id object = handle != PINMemoryCacheHandleNone ? (__bridge id)PINMemoryCacheIndexEntry(&_index, handle)->object : nil;
         PINCacheObjectBlock willRemoveObjectBlock = _willRemoveObjectBlock;
         PINCacheObjectBlock didRemoveObjectBlock = _didRemoveObjectBlock;
     [self unlock];
@@ -187,15 +223,9 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         willRemoveObjectBlock(self, key, object);
 
     [self lock];
-        if (cost)
-            _totalCost -= [cost unsignedIntegerValue];
-
-        [_dictionary removeObjectForKey:key];
-        [_createdDates removeObjectForKey:key];
-        [_accessDates removeObjectForKey:key];
-        [_costs removeObjectForKey:key];
-        [_ageLimits removeObjectForKey:key];
-        [_accessCounts removeObjectForKey:key];
+        handle = [self handleForKey:key];
+        if (handle != PINMemoryCacheHandleNone)
+            [self removeEntry:handle];
     [self unlock];
     
     if (didRemoveObjectBlock)
@@ -204,67 +234,69 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
 
 - (void)trimMemoryToDate:(NSDate *)trimDate
 {
-    [self lock];
-        NSDictionary *createdDates = [_createdDates copy];
-        NSDictionary *ageLimits = [_ageLimits copy];
-    [self unlock];
-    
-    [createdDates enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull key, NSDate * _Nonnull createdDate, BOOL * _Nonnull stop) {
-        NSTimeInterval ageLimit = [ageLimits[key] doubleValue];
-        if (!createdDate || ageLimit > 0.0) {
-            return;
-        }
-        if ([createdDate compare:trimDate] == NSOrderedAscending) { // older than trim date
-            [self removeObjectAndExecuteBlocksForKey:key];
-        }
-    }];
+    CFAbsoluteTime trimTime = [trimDate timeIntervalSinceReferenceDate];
+
+    // Entries with their own age limit are left to removeExpiredObjects, so
+    // only the oldest of the others need looking at.
+    while (YES) {
+        [self lock];
+            PINMemoryCacheHandle handle = PINMemoryCacheIndexOldestWithoutAgeLimit(&_index);
+            NSString *key = nil;
+            if (handle != PINMemoryCacheHandleNone && PINMemoryCacheIndexEntry(&_index, handle)->createdAt < trimTime) {
+                key = (__bridge NSString *)PINMemoryCacheIndexEntry(&_index, handle)->key;
+            }
+        [self unlock];
+
+        if (key == nil)
+            break;
+
+        [self removeObjectAndExecuteBlocksForKey:key];
+    }
 }
 
 - (void)removeExpiredObjects
 {
-    [self lock];
-        NSDictionary<NSString *, NSDate *> *createdDates = [_createdDates copy];
-        NSDictionary<NSString *, NSNumber *> *ageLimits = [_ageLimits copy];
-        NSTimeInterval globalAgeLimit = self->_ageLimit;
-    [self unlock];
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
 
-    NSDate *now = [NSDate date];
-    for (NSString *key in ageLimits) {
-        NSDate *createdDate = createdDates[key];
-        NSTimeInterval ageLimit = [ageLimits[key] doubleValue] ?: globalAgeLimit;
-        if (!createdDate)
-            continue;
+    // The expiry wheel hands out only the entries whose age limit has passed.
+    while (YES) {
+        [self lock];
+            PINMemoryCacheHandle handle = PINMemoryCacheIndexNextExpired(&_index, now);
+            NSString *key = handle != PINMemoryCacheHandleNone ? (__bridge NSString *)PINMemoryCacheIndexEntry(&_index, handle)->key : nil;
+        [self unlock];
 
-        NSDate *expirationDate = [createdDate dateByAddingTimeInterval:ageLimit];
-        if ([expirationDate compare:now] == NSOrderedAscending) { // Expiration date has passed
-            [self removeObjectAndExecuteBlocksForKey:key];
-        }
+        if (key == nil)
+            break;
+
+        [self removeObjectAndExecuteBlocksForKey:key];
     }
 }
 
 - (void)trimToCostLimit:(NSUInteger)limit
 {
-    NSUInteger totalCost = 0;
-    
     [self lock];
-        totalCost = _totalCost;
+        NSUInteger totalCost = _index.totalCost;
+        if (totalCost > limit)
+            PINMemoryCacheIndexSnapshotCosts(&_index);
     [self unlock];
     
     if (totalCost <= limit) {
         return;
     }
 
-    [self lock];
-        NSDictionary *costs = [_costs copy];
-    [self unlock];
+    while (YES) { // costliest objects first
+        [self lock];
+            PINMemoryCacheHandle handle = PINMemoryCacheIndexNextCostliest(&_index);
+            NSString *key = handle != PINMemoryCacheHandleNone ? (__bridge NSString *)PINMemoryCacheIndexEntry(&_index, handle)->key : nil;
+        [self unlock];
 
-    NSArray *keysSortedByCost = [costs keysSortedByValueUsingSelector:@selector(compare:)];
+        if (key == nil)
+            break;
 
-    for (NSString *key in [keysSortedByCost reverseObjectEnumerator]) { // costliest objects first
         [self removeObjectAndExecuteBlocksForKey:key];
 
         [self lock];
-            totalCost = _totalCost;
+            totalCost = _index.totalCost;
         [self unlock];
         
         if (totalCost <= limit)
@@ -278,50 +310,22 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         [self removeExpiredObjects];
     }
 
-    [self lock];
-        NSUInteger totalCost = _totalCost;
-    [self unlock];
-    
-    if (totalCost <= limit)
-        return;
-    
-    [self lock];
-        NSDictionary *accessDates = [_accessDates copy];
-        NSDictionary *accessCounts = [_accessCounts copy];
-        PINCacheEvictionStrategy strategy = _evictionStrategy;
-    [self unlock];
+    // Evicts one entry at a time, from the front of the strategy's order.
+    while (YES) {
+        [self lock];
+            NSString *key = nil;
+            if (_index.totalCost > limit) {
+                PINMemoryCacheIndexOrder order = _evictionStrategy == PINCacheEvictionStrategyLeastFrequentlyUsed ? PINMemoryCacheIndexOrderFrequency : PINMemoryCacheIndexOrderRecency;
+                PINMemoryCacheHandle handle = PINMemoryCacheIndexVictim(&_index, order);
+                if (handle != PINMemoryCacheHandleNone)
+                    key = (__bridge NSString *)PINMemoryCacheIndexEntry(&_index, handle)->key;
+            }
+        [self unlock];
 
-    NSArray *keysSortedByEvictionStrategy = nil;
-    switch (strategy) {
-        case PINCacheEvictionStrategyLeastRecentlyUsed:
-            keysSortedByEvictionStrategy = [accessDates keysSortedByValueUsingSelector:@selector(compare:)];
-            break;
-            
-        case PINCacheEvictionStrategyLeastFrequentlyUsed:
-            keysSortedByEvictionStrategy = [[accessCounts allKeys] sortedArrayUsingComparator:^NSComparisonResult(NSString * _Nonnull key1, NSString * _Nonnull key2) {
-                NSInteger count1 = [accessCounts[key1] integerValue];
-                NSInteger count2 = [accessCounts[key2] integerValue];
-                if (count1 < count2) {
-                    return NSOrderedAscending;
-                } else if (count1 > count2) {
-                    return NSOrderedDescending;
-                } else {
-                    NSDate *date1 = accessDates[key1];
-                    NSDate *date2 = accessDates[key2];
-                    return [date1 compare:date2];
-                }
-            }];
+        if (key == nil)
             break;
-    }
 
-    for (NSString *key in keysSortedByEvictionStrategy) { // oldest objects first
         [self removeObjectAndExecuteBlocksForKey:key];
-
-        [self lock];
-            totalCost = _totalCost;
-        [self unlock];
-        if (totalCost <= limit)
-            break;
     }
 }
 
@@ -487,7 +491,7 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         return NO;
     
     [self lock];
-        BOOL containsObject = (_dictionary[key] != nil);
+        BOOL containsObject = (_handles[key] != nil);
     [self unlock];
     return containsObject;
 }
@@ -497,25 +501,16 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
     if (!key)
         return nil;
     
-    NSDate *now = [NSDate date];
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
     [self lock];
         id object = nil;
+        PINMemoryCacheHandle handle = [self handleForKey:key];
         // If the cache should behave like a TTL cache, then only fetch the object if there's a valid ageLimit and  the object is still alive
-        NSTimeInterval ageLimit = [_ageLimits[key] doubleValue] ?: self->_ageLimit;
-        if (!self->_ttlCache || ageLimit <= 0 || fabs([[_createdDates objectForKey:key] timeIntervalSinceDate:now]) < ageLimit) {
-            object = _dictionary[key];
+        if (handle != PINMemoryCacheHandleNone && [self isEntryAlive:handle now:now]) {
+            object = (__bridge id)PINMemoryCacheIndexEntry(&_index, handle)->object;
+            PINMemoryCacheIndexTouch(&_index, handle, now);
         }
     [self unlock];
-        
-    if (object) {
-        [self lock];
-            _accessDates[key] = now;
-            NSInteger accessCount = [_accessCounts[key] integerValue];
-            if (accessCount < NSIntegerMax) {
-                _accessCounts[key] = @(accessCount + 1);
-            }
-        [self unlock];
-    }
 
     return object;
 }
@@ -566,28 +561,23 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         willAddObjectBlock(self, key, object);
     
     [self lock];
-        NSNumber* oldCost = _costs[key];
-        if (oldCost)
-            _totalCost -= [oldCost unsignedIntegerValue];
-
-        NSDate *now = [NSDate date];
-        _dictionary[key] = object;
-        _createdDates[key] = now;
-        _accessDates[key] = now;
-        NSInteger accessCount = [_accessCounts[key] integerValue];
-        if (accessCount < NSIntegerMax) {
-            _accessCounts[key] = @(accessCount + 1);
-        }
-
-        _costs[key] = @(cost);
-
-        if (ageLimit > 0.0) {
-            _ageLimits[key] = @(ageLimit);
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        PINMemoryCacheHandle handle = [self handleForKey:key];
+        if (handle != PINMemoryCacheHandleNone) {
+            const void *oldObject = PINMemoryCacheIndexEntry(&_index, handle)->object;
+            PINMemoryCacheIndexUpdate(&_index, handle, CFBridgingRetain(object), cost, now, ageLimit);
+            CFRelease(oldObject);
         } else {
-            [_ageLimits removeObjectForKey:key];
+            NSString *copiedKey = [key copy];
+            handle = PINMemoryCacheIndexAdd(&_index, CFBridgingRetain(copiedKey), CFBridgingRetain(object), cost, now, ageLimit);
+            if (handle != PINMemoryCacheHandleNone) {
+                _handles[copiedKey] = @(handle);
+            } else {
+                NSAssert(NO, @"Failed to grow PINMemoryCache %@", self);
+                CFRelease((__bridge CFTypeRef)copiedKey);
+                CFRelease((__bridge CFTypeRef)object);
+            }
         }
-
-        _totalCost += cost;
     [self unlock];
     
     if (didAddObjectBlock)
@@ -639,14 +629,7 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         willRemoveAllObjectsBlock(self);
     
     [self lock];
-        [_dictionary removeAllObjects];
-        [_createdDates removeAllObjects];
-        [_accessDates removeAllObjects];
-        [_accessCounts removeAllObjects];
-        [_costs removeAllObjects];
-        [_ageLimits removeAllObjects];
-    
-        _totalCost = 0;
+        [self releaseAllEntries];
     [self unlock];
     
     if (didRemoveAllObjectsBlock)
@@ -660,15 +643,16 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
         return;
     
     [self lock];
-        NSDate *now = [NSDate date];
-        NSArray *keysSortedByCreatedDate = [_createdDates keysSortedByValueUsingSelector:@selector(compare:)];
-        
-        for (NSString *key in keysSortedByCreatedDate) {
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        // Creation order is kept as entries are set, so there is nothing to sort.
+        PINMemoryCacheCreationCursor cursor = PINMemoryCacheIndexCreationCursor(&_index);
+        PINMemoryCacheHandle handle;
+        while ((handle = PINMemoryCacheIndexNextByCreation(&_index, &cursor)) != PINMemoryCacheHandleNone) {
             // If the cache should behave like a TTL cache, then only fetch the object if there's a valid ageLimit and  the object is still alive
-            NSTimeInterval ageLimit = [_ageLimits[key] doubleValue] ?: self->_ageLimit;
-            if (!self->_ttlCache || ageLimit <= 0 || fabs([[_createdDates objectForKey:key] timeIntervalSinceDate:now]) < ageLimit) {
+            if ([self isEntryAlive:handle now:now]) {
+                PINMemoryCacheEntry *entry = PINMemoryCacheIndexEntry(&_index, handle);
                 BOOL stop = NO;
-                block(self, key, _dictionary[key], &stop);
+                block(self, (__bridge NSString *)entry->key, (__bridge id)entry->object, &stop);
                 if (stop)
                     break;
             }
@@ -846,7 +830,7 @@ static NSString * const PINMemoryCacheSharedName = @"PINMemoryCacheSharedName";
 - (NSUInteger)totalCost
 {
     [self lock];
-        NSUInteger cost = _totalCost;
+        NSUInteger cost = _index.totalCost;
     [self unlock];
     
     return cost;
@@ -0,0 +1,607 @@
+//  PINCache is a modified version of TMCache
+//  Modifications by Garrett Moon
+//  Copyright (c) 2015 Pinterest. All rights reserved.
+
+#include "PINMemoryCacheIndex.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PINMemoryCacheBucketNone UINT32_MAX
+
+#define PINEntry(index, handle) ((index)->entries[(handle)])
+
+// MARK: - Storage
+
+static bool PINMemoryCacheIndexGrow(void **storage, uint32_t *capacity, size_t size)
+{
+    uint32_t newCapacity = *capacity ? *capacity * 2 : 64;
+    if (newCapacity <= *capacity || newCapacity == PINMemoryCacheHandleNone) {
+        return false;
+    }
+    void *grown = realloc(*storage, (size_t)newCapacity * size);
+    if (grown == NULL) {
+        return false;
+    }
+    *storage = grown;
+    *capacity = newCapacity;
+    return true;
+}
+
+void PINMemoryCacheIndexInit(PINMemoryCacheIndex *index)
+{
+    memset(index, 0, sizeof(*index));
+    PINMemoryCacheIndexRemoveAll(index);
+}
+
+void PINMemoryCacheIndexDestroy(PINMemoryCacheIndex *index)
+{
+    free(index->entries);
+    free(index->buckets);
+    free(index->costHeap);
+    memset(index, 0, sizeof(*index));
+}
+
+void PINMemoryCacheIndexRemoveAll(PINMemoryCacheIndex *index)
+{
+    // Every record goes back on the free lists, so the storage is reused.
+    index->freeEntry = PINMemoryCacheHandleNone;
+    for (uint32_t handle = index->entryCapacity; handle > 0; handle--) {
+        PINEntry(index, handle - 1).live = false;
+        PINEntry(index, handle - 1).recencyNext = index->freeEntry;
+        index->freeEntry = handle - 1;
+    }
+    index->freeBucket = PINMemoryCacheBucketNone;
+    for (uint32_t bucket = index->bucketCapacity; bucket > 0; bucket--) {
+        index->buckets[bucket - 1].next = index->freeBucket;
+        index->freeBucket = bucket - 1;
+    }
+    index->entryCount = 0;
+    index->totalCost = 0;
+    index->firstBucket = PINMemoryCacheBucketNone;
+    index->recencyHead = index->recencyTail = PINMemoryCacheHandleNone;
+    for (int list = 0; list < 2; list++) {
+        index->createdHead[list] = index->createdTail[list] = PINMemoryCacheHandleNone;
+    }
+    for (int list = 0; list < PINMemoryCacheWheelLists; list++) {
+        index->wheel[list] = PINMemoryCacheHandleNone;
+    }
+    index->wheelCount = 0;
+    index->wheelNearCount = 0;
+    index->wheelCursor = 0;
+    index->costHeapCount = 0;
+}
+
+// MARK: - Recency and creation lists
+
+static void PINRecencyAppend(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    PINEntry(index, handle).recencyPrev = index->recencyTail;
+    PINEntry(index, handle).recencyNext = PINMemoryCacheHandleNone;
+    if (index->recencyTail != PINMemoryCacheHandleNone) {
+        PINEntry(index, index->recencyTail).recencyNext = handle;
+    } else {
+        index->recencyHead = handle;
+    }
+    index->recencyTail = handle;
+}
+
+static void PINRecencyUnlink(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    PINMemoryCacheHandle prev = PINEntry(index, handle).recencyPrev;
+    PINMemoryCacheHandle next = PINEntry(index, handle).recencyNext;
+    if (prev != PINMemoryCacheHandleNone) {
+        PINEntry(index, prev).recencyNext = next;
+    } else {
+        index->recencyHead = next;
+    }
+    if (next != PINMemoryCacheHandleNone) {
+        PINEntry(index, next).recencyPrev = prev;
+    } else {
+        index->recencyTail = prev;
+    }
+}
+
+static int PINCreatedList(const PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    return PINEntry(index, handle).ageLimit > 0.0 ? 1 : 0;
+}
+
+static void PINCreatedAppend(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    int list = PINCreatedList(index, handle);
+    PINEntry(index, handle).createdPrev = index->createdTail[list];
+    PINEntry(index, handle).createdNext = PINMemoryCacheHandleNone;
+    if (index->createdTail[list] != PINMemoryCacheHandleNone) {
+        PINEntry(index, index->createdTail[list]).createdNext = handle;
+    } else {
+        index->createdHead[list] = handle;
+    }
+    index->createdTail[list] = handle;
+}
+
+static void PINCreatedUnlink(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    int list = PINCreatedList(index, handle);
+    PINMemoryCacheHandle prev = PINEntry(index, handle).createdPrev;
+    PINMemoryCacheHandle next = PINEntry(index, handle).createdNext;
+    if (prev != PINMemoryCacheHandleNone) {
+        PINEntry(index, prev).createdNext = next;
+    } else {
+        index->createdHead[list] = next;
+    }
+    if (next != PINMemoryCacheHandleNone) {
+        PINEntry(index, next).createdPrev = prev;
+    } else {
+        index->createdTail[list] = prev;
+    }
+}
+
+// MARK: - Frequency buckets
+
+// Returns a new, empty bucket linked in after `after`, or first if that is none.
+static uint32_t PINBucketInsert(PINMemoryCacheIndex *index, uint32_t after, intptr_t count)
+{
+    if (index->freeBucket == PINMemoryCacheBucketNone) {
+        uint32_t oldCapacity = index->bucketCapacity;
+        if (!PINMemoryCacheIndexGrow((void **)&index->buckets, &index->bucketCapacity, sizeof(PINMemoryCacheBucket))) {
+            return PINMemoryCacheBucketNone;
+        }
+        for (uint32_t bucket = index->bucketCapacity; bucket > oldCapacity; bucket--) {
+            index->buckets[bucket - 1].next = index->freeBucket;
+            index->freeBucket = bucket - 1;
+        }
+    }
+    uint32_t bucket = index->freeBucket;
+    PINMemoryCacheBucket *b = &index->buckets[bucket];
+    index->freeBucket = b->next;
+
+    b->count = count;
+    b->head = b->tail = PINMemoryCacheHandleNone;
+    b->prev = after;
+    b->next = after != PINMemoryCacheBucketNone ? index->buckets[after].next : index->firstBucket;
+    if (b->next != PINMemoryCacheBucketNone) {
+        index->buckets[b->next].prev = bucket;
+    }
+    if (after != PINMemoryCacheBucketNone) {
+        index->buckets[after].next = bucket;
+    } else {
+        index->firstBucket = bucket;
+    }
+    return bucket;
+}
+
+static void PINBucketAppend(PINMemoryCacheIndex *index, uint32_t bucket, PINMemoryCacheHandle handle)
+{
+    PINMemoryCacheBucket *b = &index->buckets[bucket];
+    PINEntry(index, handle).bucket = bucket;
+    PINEntry(index, handle).frequencyPrev = b->tail;
+    PINEntry(index, handle).frequencyNext = PINMemoryCacheHandleNone;
+    if (b->tail != PINMemoryCacheHandleNone) {
+        PINEntry(index, b->tail).frequencyNext = handle;
+    } else {
+        b->head = handle;
+    }
+    b->tail = handle;
+}
+
+// Unlinks the entry from its bucket, and frees the bucket if that empties it.
+static void PINBucketUnlink(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    uint32_t bucket = PINEntry(index, handle).bucket;
+    PINMemoryCacheBucket *b = &index->buckets[bucket];
+    PINMemoryCacheHandle prev = PINEntry(index, handle).frequencyPrev;
+    PINMemoryCacheHandle next = PINEntry(index, handle).frequencyNext;
+    if (prev != PINMemoryCacheHandleNone) {
+        PINEntry(index, prev).frequencyNext = next;
+    } else {
+        b->head = next;
+    }
+    if (next != PINMemoryCacheHandleNone) {
+        PINEntry(index, next).frequencyPrev = prev;
+    } else {
+        b->tail = prev;
+    }
+    if (b->head != PINMemoryCacheHandleNone) {
+        return;
+    }
+    if (b->prev != PINMemoryCacheBucketNone) {
+        index->buckets[b->prev].next = b->next;
+    } else {
+        index->firstBucket = b->next;
+    }
+    if (b->next != PINMemoryCacheBucketNone) {
+        index->buckets[b->next].prev = b->prev;
+    }
+    b->next = index->freeBucket;
+    index->freeBucket = bucket;
+}
+
+// Counts one more access: up a bucket, or to the back of the top one once the count can't grow.
+static void PINBucketPromote(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    uint32_t bucket = PINEntry(index, handle).bucket;
+    intptr_t count = PINEntry(index, handle).accessCount;
+    uint32_t target = bucket;
+    if (count < INTPTR_MAX) {
+        uint32_t next = index->buckets[bucket].next;
+        if (next != PINMemoryCacheBucketNone && index->buckets[next].count == count + 1) {
+            target = next;
+        } else {
+            target = PINBucketInsert(index, bucket, count + 1);
+            if (target == PINMemoryCacheBucketNone) {
+                target = bucket;
+            }
+        }
+    }
+    if (target == bucket && index->buckets[bucket].tail == handle) {
+        return;
+    }
+    if (target != bucket) {
+        PINEntry(index, handle).accessCount = count + 1;
+    }
+    // Staying in its bucket, the entry isn't its tail and so not alone, and unlinking keeps the bucket.
+    PINBucketUnlink(index, handle);
+    PINBucketAppend(index, target, handle);
+}
+
+// MARK: - Expiry wheel
+
+static int64_t PINWheelTick(double time)
+{
+    double tick = floor(time / PINMemoryCacheWheelTick);
+    // Far off dates share the furthest tick; expiry is checked by date anyway.
+    if (!(tick < (double)(INT64_MAX / 4))) {
+        return INT64_MAX / 4;
+    }
+    if (tick < (double)(INT64_MIN / 4)) {
+        return INT64_MIN / 4;
+    }
+    return (int64_t)tick;
+}
+
+static double PINExpiry(const PINMemoryCacheEntry *entry)
+{
+    return entry->createdAt + entry->ageLimit;
+}
+
+#define PINWheelMask (PINMemoryCacheWheelSlots - 1)
+#define PINWheelTurns PINMemoryCacheWheelSlots
+#define PINWheelLater (2 * PINMemoryCacheWheelSlots)
+
+static void PINWheelLink(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    int64_t cursor = index->wheelCursor;
+    int64_t tick = PINWheelTick(PINExpiry(&PINEntry(index, handle)));
+    if (tick < cursor) {
+        // Already due; it goes where the next look starts.
+        tick = cursor;
+    }
+    uint32_t list;
+    if (tick - cursor < PINMemoryCacheWheelSlots) {
+        list = (uint32_t)((uint64_t)tick & PINWheelMask);
+        index->wheelNearCount++;
+    } else if ((tick >> PINMemoryCacheWheelBits) - (cursor >> PINMemoryCacheWheelBits) <= PINMemoryCacheWheelSlots) {
+        list = PINWheelTurns + (uint32_t)((uint64_t)(tick >> PINMemoryCacheWheelBits) & PINWheelMask);
+    } else {
+        list = PINWheelLater;
+    }
+    PINEntry(index, handle).wheelList = list;
+    PINEntry(index, handle).wheelPrev = PINMemoryCacheHandleNone;
+    PINEntry(index, handle).wheelNext = index->wheel[list];
+    if (index->wheel[list] != PINMemoryCacheHandleNone) {
+        PINEntry(index, index->wheel[list]).wheelPrev = handle;
+    }
+    index->wheel[list] = handle;
+}
+
+static void PINWheelInsert(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle, double now)
+{
+    if (index->wheelCount == 0) {
+        index->wheelCursor = PINWheelTick(now);
+    }
+    PINWheelLink(index, handle);
+    index->wheelCount++;
+}
+
+static void PINWheelUnlink(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    uint32_t list = PINEntry(index, handle).wheelList;
+    if (list == PINMemoryCacheWheelLists) {
+        return;
+    }
+    PINMemoryCacheHandle prev = PINEntry(index, handle).wheelPrev;
+    PINMemoryCacheHandle next = PINEntry(index, handle).wheelNext;
+    if (prev != PINMemoryCacheHandleNone) {
+        PINEntry(index, prev).wheelNext = next;
+    } else {
+        index->wheel[list] = next;
+    }
+    if (next != PINMemoryCacheHandleNone) {
+        PINEntry(index, next).wheelPrev = prev;
+    }
+    PINEntry(index, handle).wheelList = PINMemoryCacheWheelLists;
+    if (list < PINMemoryCacheWheelSlots) {
+        index->wheelNearCount--;
+    }
+    index->wheelCount--;
+}
+
+/** Places the entries of an upper list again, from the cursor. */
+static void PINWheelCascade(PINMemoryCacheIndex *index, uint32_t list)
+{
+    PINMemoryCacheHandle handle = index->wheel[list];
+    index->wheel[list] = PINMemoryCacheHandleNone;
+    while (handle != PINMemoryCacheHandleNone) {
+        PINMemoryCacheHandle next = PINEntry(index, handle).wheelNext;
+        PINWheelLink(index, handle);
+        handle = next;
+    }
+}
+
+static void PINWheelAdvance(PINMemoryCacheIndex *index, int64_t cursor)
+{
+    index->wheelCursor = cursor;
+    if ((cursor & PINWheelMask) != 0) {
+        return;
+    }
+    // A new turn: its entries move down to the tick slots.
+    int64_t turn = cursor >> PINMemoryCacheWheelBits;
+    if ((turn & PINWheelMask) == 0) {
+        PINWheelCascade(index, PINWheelLater);
+    }
+    PINWheelCascade(index, PINWheelTurns + (uint32_t)((uint64_t)turn & PINWheelMask));
+}
+
+PINMemoryCacheHandle PINMemoryCacheIndexNextExpired(PINMemoryCacheIndex *index, double now)
+{
+    if (index->wheelCount == 0) {
+        return PINMemoryCacheHandleNone;
+    }
+    int64_t nowTick = PINWheelTick(now);
+    while (true) {
+        // Everything in the cursor's slot is due by the end of its tick.
+        uint32_t slot = (uint32_t)((uint64_t)index->wheelCursor & PINWheelMask);
+        for (PINMemoryCacheHandle handle = index->wheel[slot]; handle != PINMemoryCacheHandleNone; handle = PINEntry(index, handle).wheelNext) {
+            if (PINExpiry(&PINEntry(index, handle)) < now) {
+                PINWheelUnlink(index, handle);
+                return handle;
+            }
+        }
+        if (index->wheelCursor >= nowTick) {
+            return PINMemoryCacheHandleNone;
+        }
+        if (index->wheelNearCount == 0) {
+            // Nothing in the tick slots; skip to the next turn.
+            int64_t nextTurn = (index->wheelCursor | PINWheelMask) + 1;
+            if (nowTick < nextTurn) {
+                index->wheelCursor = nowTick;
+                continue;
+            }
+            PINWheelAdvance(index, nextTurn);
+        } else {
+            PINWheelAdvance(index, index->wheelCursor + 1);
+        }
+    }
+}
+
+// MARK: - Entries
+
+PINMemoryCacheHandle PINMemoryCacheIndexAdd(PINMemoryCacheIndex *index, const void *key, const void *object, size_t cost, double now, double ageLimit)
+{
+    // The count 1 bucket comes first, since no entry has less.
+    uint32_t bucket = index->firstBucket;
+    if (bucket == PINMemoryCacheBucketNone || index->buckets[bucket].count != 1) {
+        bucket = PINBucketInsert(index, PINMemoryCacheBucketNone, 1);
+        if (bucket == PINMemoryCacheBucketNone) {
+            return PINMemoryCacheHandleNone;
+        }
+    }
+    if (index->freeEntry == PINMemoryCacheHandleNone) {
+        uint32_t oldCapacity = index->entryCapacity;
+        if (!PINMemoryCacheIndexGrow((void **)&index->entries, &index->entryCapacity, sizeof(PINMemoryCacheEntry))) {
+            if (index->buckets[bucket].head == PINMemoryCacheHandleNone) {
+                // Drop the bucket just made for it.
+                index->firstBucket = index->buckets[bucket].next;
+                if (index->firstBucket != PINMemoryCacheBucketNone) {
+                    index->buckets[index->firstBucket].prev = PINMemoryCacheBucketNone;
+                }
+                index->buckets[bucket].next = index->freeBucket;
+                index->freeBucket = bucket;
+            }
+            return PINMemoryCacheHandleNone;
+        }
+        for (uint32_t handle = index->entryCapacity; handle > oldCapacity; handle--) {
+            PINEntry(index, handle - 1).live = false;
+            PINEntry(index, handle - 1).generation = 0;
+            PINEntry(index, handle - 1).recencyNext = index->freeEntry;
+            index->freeEntry = handle - 1;
+        }
+    }
+    PINMemoryCacheHandle handle = index->freeEntry;
+    PINMemoryCacheEntry *entry = &PINEntry(index, handle);
+    index->freeEntry = entry->recencyNext;
+
+    entry->key = key;
+    entry->object = object;
+    entry->cost = cost;
+    entry->createdAt = now;
+    entry->accessedAt = now;
+    entry->ageLimit = ageLimit > 0.0 ? ageLimit : 0.0;
+    entry->accessCount = 1;
+    entry->generation++;
+    entry->live = true;
+    entry->wheelList = PINMemoryCacheWheelLists;
+
+    PINRecencyAppend(index, handle);
+    PINCreatedAppend(index, handle);
+    PINBucketAppend(index, bucket, handle);
+    if (entry->ageLimit > 0.0) {
+        PINWheelInsert(index, handle, now);
+    }
+    index->entryCount++;
+    index->totalCost += cost;
+    return handle;
+}
+
+void PINMemoryCacheIndexUpdate(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle, const void *object, size_t cost, double now, double ageLimit)
+{
+    PINWheelUnlink(index, handle);
+    PINCreatedUnlink(index, handle);
+
+    PINMemoryCacheEntry *entry = &PINEntry(index, handle);
+    index->totalCost = index->totalCost - entry->cost + cost;
+    entry->object = object;
+    entry->cost = cost;
+    entry->createdAt = now;
+    entry->ageLimit = ageLimit > 0.0 ? ageLimit : 0.0;
+
+    PINCreatedAppend(index, handle);
+    if (entry->ageLimit > 0.0) {
+        PINWheelInsert(index, handle, now);
+    }
+    PINMemoryCacheIndexTouch(index, handle, now);
+}
+
+void PINMemoryCacheIndexTouch(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle, double now)
+{
+    PINEntry(index, handle).accessedAt = now;
+    if (index->recencyTail != handle) {
+        PINRecencyUnlink(index, handle);
+        PINRecencyAppend(index, handle);
+    }
+    PINBucketPromote(index, handle);
+}
+
+void PINMemoryCacheIndexRemove(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    PINMemoryCacheEntry *entry = &PINEntry(index, handle);
+    if (!entry->live) {
+        return;
+    }
+    PINWheelUnlink(index, handle);
+    PINCreatedUnlink(index, handle);
+    PINRecencyUnlink(index, handle);
+    PINBucketUnlink(index, handle);
+    index->totalCost -= entry->cost;
+    index->entryCount--;
+
+    entry->live = false;
+    entry->key = NULL;
+    entry->object = NULL;
+    entry->recencyNext = index->freeEntry;
+    index->freeEntry = handle;
+}
+
+// MARK: - Orders
+
+PINMemoryCacheHandle PINMemoryCacheIndexVictim(const PINMemoryCacheIndex *index, PINMemoryCacheIndexOrder order)
+{
+    switch (order) {
+        case PINMemoryCacheIndexOrderRecency:
+            return index->recencyHead;
+        case PINMemoryCacheIndexOrderFrequency:
+            return index->firstBucket != PINMemoryCacheBucketNone ? index->buckets[index->firstBucket].head : PINMemoryCacheHandleNone;
+    }
+    return PINMemoryCacheHandleNone;
+}
+
+PINMemoryCacheHandle PINMemoryCacheIndexOldestWithoutAgeLimit(const PINMemoryCacheIndex *index)
+{
+    return index->createdHead[0];
+}
+
+PINMemoryCacheHandle PINMemoryCacheIndexNewer(const PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    return PINEntry(index, handle).createdNext;
+}
+
+PINMemoryCacheCreationCursor PINMemoryCacheIndexCreationCursor(const PINMemoryCacheIndex *index)
+{
+    PINMemoryCacheCreationCursor cursor = {{index->createdHead[0], index->createdHead[1]}};
+    return cursor;
+}
+
+PINMemoryCacheHandle PINMemoryCacheIndexNextByCreation(const PINMemoryCacheIndex *index, PINMemoryCacheCreationCursor *cursor)
+{
+    PINMemoryCacheHandle plain = cursor->next[0];
+    PINMemoryCacheHandle limited = cursor->next[1];
+    int list;
+    if (plain == PINMemoryCacheHandleNone && limited == PINMemoryCacheHandleNone) {
+        return PINMemoryCacheHandleNone;
+    } else if (plain == PINMemoryCacheHandleNone) {
+        list = 1;
+    } else if (limited == PINMemoryCacheHandleNone) {
+        list = 0;
+    } else {
+        list = PINEntry(index, limited).createdAt < PINEntry(index, plain).createdAt ? 1 : 0;
+    }
+    PINMemoryCacheHandle handle = cursor->next[list];
+    cursor->next[list] = PINEntry(index, handle).createdNext;
+    return handle;
+}
+
+// MARK: - Trimming by cost
+
+static bool PINCostItemLess(const PINMemoryCacheCostItem *a, const PINMemoryCacheCostItem *b)
+{
+    return a->cost < b->cost;
+}
+
+static void PINCostHeapSiftDown(PINMemoryCacheCostItem *heap, uint32_t count, uint32_t position)
+{
+    PINMemoryCacheCostItem item = heap[position];
+    while (true) {
+        uint32_t child = position * 2 + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && PINCostItemLess(&heap[child], &heap[child + 1])) {
+            child++;
+        }
+        if (!PINCostItemLess(&item, &heap[child])) {
+            break;
+        }
+        heap[position] = heap[child];
+        position = child;
+    }
+    heap[position] = item;
+}
+
+bool PINMemoryCacheIndexSnapshotCosts(PINMemoryCacheIndex *index)
+{
+    while (index->costHeapCapacity < index->entryCount) {
+        if (!PINMemoryCacheIndexGrow((void **)&index->costHeap, &index->costHeapCapacity, sizeof(PINMemoryCacheCostItem))) {
+            index->costHeapCount = 0;
+            return false;
+        }
+    }
+    uint32_t count = 0;
+    for (PINMemoryCacheHandle handle = index->recencyHead; handle != PINMemoryCacheHandleNone; handle = PINEntry(index, handle).recencyNext) {
+        PINMemoryCacheCostItem item = {PINEntry(index, handle).cost, handle, PINEntry(index, handle).generation};
+        index->costHeap[count++] = item;
+    }
+    // Heapifying is linear; only what is popped gets ordered.
+    for (uint32_t position = count / 2; position > 0; position--) {
+        PINCostHeapSiftDown(index->costHeap, count, position - 1);
+    }
+    index->costHeapCount = count;
+    return true;
+}
+
+PINMemoryCacheHandle PINMemoryCacheIndexNextCostliest(PINMemoryCacheIndex *index)
+{
+    while (index->costHeapCount > 0) {
+        PINMemoryCacheCostItem top = index->costHeap[0];
+        index->costHeap[0] = index->costHeap[--index->costHeapCount];
+        if (index->costHeapCount > 0) {
+            PINCostHeapSiftDown(index->costHeap, index->costHeapCount, 0);
+        }
+        const PINMemoryCacheEntry *entry = &PINEntry(index, top.handle);
+        if (entry->live && entry->generation == top.generation) {
+            return top.handle;
+        }
+    }
+    return PINMemoryCacheHandleNone;
+}
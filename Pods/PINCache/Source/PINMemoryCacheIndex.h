@@ -0,0 +1,194 @@
+//  PINCache is a modified version of TMCache
+//  Modifications by Garrett Moon
+//  Copyright (c) 2015 Pinterest. All rights reserved.
+
+#ifndef PINMemoryCacheIndex_h
+#define PINMemoryCacheIndex_h
+
+// Plain C with no Foundation dependency, so the bookkeeping behind
+// PINMemoryCache can be built, tested and benchmarked on its own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t PINMemoryCacheHandle;
+#define PINMemoryCacheHandleNone UINT32_MAX
+
+/**
+ The expiry wheel has two levels of PINMemoryCacheWheelSlots slots: ticks of
+ PINMemoryCacheWheelTick seconds for the next turn, then whole turns, which
+ are moved down a turn ahead. Later entries wait in one more list, looked at
+ once every turn of the upper level.
+ */
+#define PINMemoryCacheWheelBits 9
+#define PINMemoryCacheWheelSlots (1 << PINMemoryCacheWheelBits)
+#define PINMemoryCacheWheelLists (2 * PINMemoryCacheWheelSlots + 1)
+#define PINMemoryCacheWheelTick 1.0
+
+typedef enum {
+    /** Least recently accessed first. */
+    PINMemoryCacheIndexOrderRecency,
+    /** Least often accessed first, and least recently among equals. */
+    PINMemoryCacheIndexOrderFrequency,
+} PINMemoryCacheIndexOrder;
+
+/**
+ One record per entry, linked into every order the cache evicts or trims by.
+ Links are handles, so they stay valid when the records are reallocated.
+ */
+typedef struct {
+    /** Owned by the caller; the index never retains or compares them. */
+    const void *key;
+    const void *object;
+    size_t cost;
+    double createdAt;
+    double accessedAt;
+    /** 0 when the entry has no age limit of its own. */
+    double ageLimit;
+    intptr_t accessCount;
+    /** Tells apart entries that reuse a removed entry's handle. */
+    uint32_t generation;
+    bool live;
+
+    // Least recently accessed first.
+    PINMemoryCacheHandle recencyPrev;
+    PINMemoryCacheHandle recencyNext;
+    // Oldest first, in one list for entries with an age limit and one for the rest.
+    PINMemoryCacheHandle createdPrev;
+    PINMemoryCacheHandle createdNext;
+    // Within the entry's access count bucket, least recently accessed first.
+    PINMemoryCacheHandle frequencyPrev;
+    PINMemoryCacheHandle frequencyNext;
+    uint32_t bucket;
+    // Within the expiry wheel list, for entries with an age limit.
+    PINMemoryCacheHandle wheelPrev;
+    PINMemoryCacheHandle wheelNext;
+    /** PINMemoryCacheWheelLists when not on the wheel. */
+    uint32_t wheelList;
+} PINMemoryCacheEntry;
+
+typedef struct {
+    intptr_t count;
+    uint32_t prev;
+    uint32_t next;
+    PINMemoryCacheHandle head;
+    PINMemoryCacheHandle tail;
+} PINMemoryCacheBucket;
+
+typedef struct {
+    size_t cost;
+    PINMemoryCacheHandle handle;
+    uint32_t generation;
+} PINMemoryCacheCostItem;
+
+/**
+ The eviction bookkeeping of a memory cache, with every operation in constant
+ time but trimming by cost:
+
+ - Eviction by recency pops the head of a list that accesses move entries to
+   the tail of.
+ - Eviction by frequency keeps entries in buckets of equal access count,
+   ordered by count, each a list in access order. An access moves an entry to
+   the next bucket up.
+ - Entries with their own age limit sit in a timing wheel by expiry date, so
+   expired entries are found without looking at the others. Each entry moves
+   down a level at most twice.
+ - Trimming the costliest entries first heapifies a snapshot of the costs and
+   pops from it, which only orders as many as are removed.
+
+ Not thread safe.
+ */
+typedef struct {
+    PINMemoryCacheEntry *entries;
+    uint32_t entryCapacity;
+    uint32_t entryCount;
+    PINMemoryCacheHandle freeEntry;
+    size_t totalCost;
+
+    PINMemoryCacheBucket *buckets;
+    uint32_t bucketCapacity;
+    uint32_t freeBucket;
+    /** The bucket with the lowest count. */
+    uint32_t firstBucket;
+
+    PINMemoryCacheHandle recencyHead;
+    PINMemoryCacheHandle recencyTail;
+    PINMemoryCacheHandle createdHead[2];
+    PINMemoryCacheHandle createdTail[2];
+
+    PINMemoryCacheHandle wheel[PINMemoryCacheWheelLists];
+    uint32_t wheelCount;
+    /** Entries in the lower level, which holds the ticks from the cursor on. */
+    uint32_t wheelNearCount;
+    int64_t wheelCursor;
+
+    PINMemoryCacheCostItem *costHeap;
+    uint32_t costHeapCount;
+    uint32_t costHeapCapacity;
+} PINMemoryCacheIndex;
+
+void PINMemoryCacheIndexInit(PINMemoryCacheIndex *index);
+
+/** Frees the index's storage. The caller releases keys and objects first. */
+void PINMemoryCacheIndexDestroy(PINMemoryCacheIndex *index);
+
+/**
+ Adds an entry, created and accessed at `now` and accessed once. Returns its
+ handle, or PINMemoryCacheHandleNone if it can't grow.
+ */
+PINMemoryCacheHandle PINMemoryCacheIndexAdd(PINMemoryCacheIndex *index, const void *key, const void *object, size_t cost, double now, double ageLimit);
+
+/** Sets an entry again: replaces its object, cost and age limit, and counts it as created and accessed at `now`. */
+void PINMemoryCacheIndexUpdate(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle, const void *object, size_t cost, double now, double ageLimit);
+
+/** Counts an access to an entry at `now`. */
+void PINMemoryCacheIndexTouch(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle, double now);
+
+void PINMemoryCacheIndexRemove(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle);
+
+/** Removes every entry. The caller releases keys and objects first. */
+void PINMemoryCacheIndexRemoveAll(PINMemoryCacheIndex *index);
+
+static inline PINMemoryCacheEntry *PINMemoryCacheIndexEntry(PINMemoryCacheIndex *index, PINMemoryCacheHandle handle)
+{
+    return &index->entries[handle];
+}
+
+/** The entry to evict next in the given order, or PINMemoryCacheHandleNone if empty. */
+PINMemoryCacheHandle PINMemoryCacheIndexVictim(const PINMemoryCacheIndex *index, PINMemoryCacheIndexOrder order);
+
+/** The oldest entry without an age limit of its own, then the next newer one. */
+PINMemoryCacheHandle PINMemoryCacheIndexOldestWithoutAgeLimit(const PINMemoryCacheIndex *index);
+PINMemoryCacheHandle PINMemoryCacheIndexNewer(const PINMemoryCacheIndex *index, PINMemoryCacheHandle handle);
+
+/** Walks every entry, oldest first, merging the entries with and without an age limit. */
+typedef struct {
+    PINMemoryCacheHandle next[2];
+} PINMemoryCacheCreationCursor;
+
+PINMemoryCacheCreationCursor PINMemoryCacheIndexCreationCursor(const PINMemoryCacheIndex *index);
+PINMemoryCacheHandle PINMemoryCacheIndexNextByCreation(const PINMemoryCacheIndex *index, PINMemoryCacheCreationCursor *cursor);
+
+/**
+ Takes an entry whose own age limit has passed at `now` off the expiry wheel
+ and returns it, or PINMemoryCacheHandleNone once there are none. The entry
+ stays in the index until removed.
+ */
+PINMemoryCacheHandle PINMemoryCacheIndexNextExpired(PINMemoryCacheIndex *index, double now);
+
+/** Snapshots the entries' costs for PINMemoryCacheIndexNextCostliest. Returns false if it can't grow. */
+bool PINMemoryCacheIndexSnapshotCosts(PINMemoryCacheIndex *index);
+
+/** The costliest entry of the snapshot that is still in the index, or PINMemoryCacheHandleNone. */
+PINMemoryCacheHandle PINMemoryCacheIndexNextCostliest(PINMemoryCacheIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINMemoryCacheIndex_h
@@ -0,0 +1,883 @@
+// Checks and contention benchmark of PINOperationScheduler, the queue behind
+// PINOperationQueue, against a queue behind one lock.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -pthread -o operation_scheduler_bench
+//      operation_scheduler_bench.c ../Source/PINOperationScheduler.c
+//   ./operation_scheduler_bench [--quick] > result.json
+//
+// First checks ordering on one thread: with one worker operations run in
+// the order they were scheduled, even when reprioritized or taken while
+// held, and otherwise by priority, except that one
+// passed over by the aging limit goes next. Reprioritized operations run
+// once, from their new lane, and cancelled ones not at all. Coalescing finds
+// the queued operation for an identifier and never one that started, and an
+// operation taken while held runs once it's let go.
+//
+// Then stress tests it from several threads at once: producers schedule,
+// coalesce into, cancel and reprioritize operations while workers run
+// them, as PINOperationQueue does on GCD. Afterwards every operation must
+// have run or been cancelled, not both and at most once, with its context
+// released exactly once; every coalesce must have landed on an operation
+// before it ran; and the cancellations reported must add up to the
+// operations that didn't run. Exits with 1 on failure.
+//
+// Last, times producers scheduling trivial operations, half of them
+// coalescing over 4096 identifiers, for 4 workers, on both queues, and
+// reports the time a producer spends scheduling and the throughput.
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Source/PINOperationScheduler.h"
+
+#define TRIALS 3
+#define S_WORKERS 4
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t S_random(uint64_t *state, uint32_t bound) {
+  *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((*state >> 33) % bound);
+}
+
+// What an operation did, in place of a PINOperation.
+typedef struct {
+  atomic_int ran;
+  atomic_int released;
+  // Coalesced into while held, so plain.
+  int attaches;
+  int attachesWhenRun;
+} S_record;
+
+static void S_release_record(void *context) {
+  atomic_fetch_add(&((S_record *)context)->released, 1);
+}
+
+static void S_release_nothing(void *context) {
+  (void)context;
+}
+
+// MARK: - Ordering
+
+static uintptr_t S_next_value(PINOperationScheduler *scheduler) {
+  PINOperationSchedulerEntry *entry = PINOperationSchedulerNext(scheduler);
+  if (entry == NULL) {
+    return 0;
+  }
+  uintptr_t value = (uintptr_t)PINOperationSchedulerEntryContext(entry);
+  PINOperationSchedulerComplete(entry);
+  return value;
+}
+
+static bool S_check_order(void) {
+  uint64_t random = 7;
+
+  // One worker: first scheduled, first run.
+  PINOperationScheduler *scheduler = PINOperationSchedulerCreate(1, PINOperationSchedulerDefaultAgingLimit, S_release_nothing);
+  for (uintptr_t i = 1; i <= 1000; i++) {
+    PINOperationSchedulerEntryRelease(PINOperationSchedulerEnqueue(scheduler, S_random(&random, 3), (void *)i));
+  }
+  for (uintptr_t i = 1; i <= 1000; i++) {
+    if (S_next_value(scheduler) != i) {
+      fprintf(stderr, "one worker ran operation %lu out of order\n", (unsigned long)i);
+      return false;
+    }
+  }
+  if (S_next_value(scheduler) != 0 || PINOperationSchedulerStartWorker(scheduler)) {
+    fprintf(stderr, "work left after running everything\n");
+    return false;
+  }
+  PINOperationSchedulerDestroy(scheduler);
+
+  // Still first scheduled, first run when reprioritizing, or taking one while
+  // held, queues an operation again: it keeps its place.
+  scheduler = PINOperationSchedulerCreate(1, PINOperationSchedulerDefaultAgingLimit, S_release_nothing);
+  bool heldCreated = false;
+  PINOperationSchedulerEntry *held = PINOperationSchedulerAcquire(scheduler, S_random(&random, 3), "held", 4, &heldCreated);
+  PINOperationSchedulerSetContext(held, (void *)1);
+  PINOperationSchedulerEntry *queued[100];
+  for (uintptr_t i = 2; i <= 100; i++) {
+    queued[i - 1] = PINOperationSchedulerEnqueue(scheduler, S_random(&random, 3), (void *)i);
+  }
+  for (uintptr_t i = 2; i <= 100; i += 3) {
+    PINOperationSchedulerSetPriority(scheduler, queued[i - 1], S_random(&random, 3));
+    PINOperationSchedulerSetPriority(scheduler, queued[i - 1], S_random(&random, 3));
+  }
+  // Taken while held on the way to 2, so queued again once let go.
+  bool heldInOrder = S_next_value(scheduler) == 2;
+  PINOperationSchedulerUnhold(scheduler, held);
+  PINOperationSchedulerEntryRelease(held);
+  heldInOrder = heldInOrder && S_next_value(scheduler) == 1;
+  for (uintptr_t i = 3; i <= 100 && heldInOrder; i++) {
+    heldInOrder = S_next_value(scheduler) == i;
+  }
+  if (!heldCreated || !heldInOrder || S_next_value(scheduler) != 0) {
+    fprintf(stderr, "one worker ran a requeued operation out of order\n");
+    return false;
+  }
+  for (uintptr_t i = 2; i <= 100; i++) {
+    PINOperationSchedulerEntryRelease(queued[i - 1]);
+  }
+  PINOperationSchedulerDestroy(scheduler);
+
+  // By priority, with each lane in order and none passed over for long.
+  uint32_t agingLimit = 8;
+  scheduler = PINOperationSchedulerCreate(4, agingLimit, S_release_nothing);
+  int scheduled[3] = {0, 0, 0};
+  for (int i = 0; i < 3000; i++) {
+    uint32_t priority = S_random(&random, 10) < 6 ? 2 : S_random(&random, 2);
+    uintptr_t value = ((uintptr_t)priority << 16) | (uintptr_t)++scheduled[priority];
+    PINOperationSchedulerEntryRelease(PINOperationSchedulerEnqueue(scheduler, priority, (void *)value));
+  }
+  int ran[3] = {0, 0, 0};
+  int waited[3] = {0, 0, 0};
+  for (int i = 0; i < 3000; i++) {
+    uintptr_t value = S_next_value(scheduler);
+    uint32_t priority = (uint32_t)(value >> 16);
+    if (value == 0 || (int)(value & 0xffff) != ++ran[priority]) {
+      fprintf(stderr, "lane %u ran out of order\n", priority);
+      return false;
+    }
+    for (uint32_t other = 0; other < 3; other++) {
+      waited[other] = other == priority || ran[other] == scheduled[other] ? 0 : waited[other] + 1;
+      if (waited[other] > (int)agingLimit + 2) {
+        fprintf(stderr, "lane %u waited for %d operations\n", other, waited[other]);
+        return false;
+      }
+    }
+    // Higher lanes go first until something ages.
+    if (i < (int)agingLimit && priority != 2) {
+      fprintf(stderr, "low priority ran before aging\n");
+      return false;
+    }
+  }
+  PINOperationSchedulerDestroy(scheduler);
+
+  // Reprioritizing runs the operation once, from its new lane.
+  scheduler = PINOperationSchedulerCreate(4, agingLimit, S_release_nothing);
+  PINOperationSchedulerEntry *first = PINOperationSchedulerEnqueue(scheduler, 0, (void *)1);
+  PINOperationSchedulerEntry *second = PINOperationSchedulerEnqueue(scheduler, 0, (void *)2);
+  PINOperationSchedulerSetPriority(scheduler, second, 2);
+  PINOperationSchedulerSetPriority(scheduler, second, 1);
+  PINOperationSchedulerSetPriority(scheduler, second, 2);
+  PINOperationSchedulerEntry *third = PINOperationSchedulerEnqueue(scheduler, 1, (void *)3);
+  bool cancelled = PINOperationSchedulerCancel(scheduler, third);
+  if (S_next_value(scheduler) != 2 || S_next_value(scheduler) != 1 || S_next_value(scheduler) != 0 || !cancelled
+      || PINOperationSchedulerCancel(scheduler, third) || PINOperationSchedulerCancel(scheduler, first)) {
+    fprintf(stderr, "reprioritizing or cancelling went wrong\n");
+    return false;
+  }
+  PINOperationSchedulerSetPriority(scheduler, first, 1);
+  if (S_next_value(scheduler) != 0 || PINOperationSchedulerStartWorker(scheduler)) {
+    fprintf(stderr, "reprioritized an operation that ran\n");
+    return false;
+  }
+  PINOperationSchedulerEntryRelease(first);
+  PINOperationSchedulerEntryRelease(second);
+  PINOperationSchedulerEntryRelease(third);
+  PINOperationSchedulerDestroy(scheduler);
+
+  // Coalescing, and holding.
+  scheduler = PINOperationSchedulerCreate(4, agingLimit, S_release_record);
+  S_record records[5];
+  memset(records, 0, sizeof(records));
+  bool created = false;
+  PINOperationSchedulerEntry *entry = PINOperationSchedulerAcquire(scheduler, 1, "a", 1, &created);
+  if (!created || PINOperationSchedulerNext(scheduler) != NULL) {
+    fprintf(stderr, "a held operation started\n");
+    return false;
+  }
+  // Taken while held, so queued again when let go.
+  PINOperationSchedulerSetContext(entry, &records[0]);
+  PINOperationSchedulerUnhold(scheduler, entry);
+  PINOperationSchedulerEntryRelease(entry);
+  entry = PINOperationSchedulerAcquire(scheduler, 2, "a", 1, &created);
+  if (created || PINOperationSchedulerEntryContext(entry) != &records[0]) {
+    fprintf(stderr, "didn't coalesce\n");
+    return false;
+  }
+  PINOperationSchedulerUnhold(scheduler, entry);
+  PINOperationSchedulerEntryRelease(entry);
+  entry = PINOperationSchedulerAcquire(scheduler, 1, "ab", 2, &created);
+  PINOperationSchedulerSetContext(entry, &records[1]);
+  PINOperationSchedulerUnhold(scheduler, entry);
+  PINOperationSchedulerEntryRelease(entry);
+
+  // Cancelled while coalescing, its context is kept until it's let go.
+  entry = PINOperationSchedulerAcquire(scheduler, 1, "ab", 2, &created);
+  if (created || !PINOperationSchedulerCancel(scheduler, entry) || atomic_load(&records[1].released) != 0) {
+    fprintf(stderr, "released the context of a held operation\n");
+    return false;
+  }
+  PINOperationSchedulerUnhold(scheduler, entry);
+  PINOperationSchedulerEntryRelease(entry);
+  entry = PINOperationSchedulerAcquire(scheduler, 1, "ab", 2, &created);
+  PINOperationSchedulerSetContext(entry, &records[4]);
+  PINOperationSchedulerUnhold(scheduler, entry);
+  PINOperationSchedulerEntryRelease(entry);
+
+  PINOperationSchedulerEntry *next = PINOperationSchedulerNext(scheduler);
+  if (next == NULL || PINOperationSchedulerEntryContext(next) != &records[0]) {
+    fprintf(stderr, "an operation let go didn't run\n");
+    return false;
+  }
+  // Started, so not coalesced into.
+  entry = PINOperationSchedulerAcquire(scheduler, 1, "a", 1, &created);
+  if (!created) {
+    fprintf(stderr, "coalesced into a started operation\n");
+    return false;
+  }
+  PINOperationSchedulerComplete(next);
+  // Cancelled while held, before its context is set, which is released once it's let go.
+  PINOperationScheduler *other = PINOperationSchedulerCreate(4, agingLimit, S_release_record);
+  if (PINOperationSchedulerCancel(other, entry) || !PINOperationSchedulerCancel(scheduler, entry)) {
+    fprintf(stderr, "can't cancel a held operation, or cancelled it elsewhere\n");
+    return false;
+  }
+  PINOperationSchedulerDestroy(other);
+  PINOperationSchedulerSetContext(entry, &records[2]);
+  if (atomic_load(&records[2].released) != 0) {
+    fprintf(stderr, "released a held context\n");
+    return false;
+  }
+  PINOperationSchedulerUnhold(scheduler, entry);
+  PINOperationSchedulerEntryRelease(entry);
+  PINOperationSchedulerEntryRelease(PINOperationSchedulerEnqueue(scheduler, 0, &records[3]));
+  size_t cancelledCount = PINOperationSchedulerCancelAll(scheduler);
+  if (PINOperationSchedulerNext(scheduler) != NULL || cancelledCount != 2) {
+    fprintf(stderr, "cancelled %zu of 2\n", cancelledCount);
+    return false;
+  }
+  PINOperationSchedulerDestroy(scheduler);
+  for (int i = 0; i < 5; i++) {
+    if (atomic_load(&records[i].released) != 1) {
+      fprintf(stderr, "context %d released %d times\n", i, atomic_load(&records[i].released));
+      return false;
+    }
+  }
+
+  // Workers are started for queued work, up to the maximum.
+  scheduler = PINOperationSchedulerCreate(2, agingLimit, S_release_nothing);
+  for (uintptr_t i = 1; i <= 3; i++) {
+    PINOperationSchedulerEntryRelease(PINOperationSchedulerEnqueue(scheduler, 1, (void *)i));
+  }
+  bool started = PINOperationSchedulerStartWorker(scheduler) && PINOperationSchedulerStartWorker(scheduler)
+                 && !PINOperationSchedulerStartWorker(scheduler);
+  while (S_next_value(scheduler) != 0) {
+  }
+  bool finished = PINOperationSchedulerWorkerFinished(scheduler);
+  // Scheduled while the last worker still counted, so left to it.
+  PINOperationSchedulerEntryRelease(PINOperationSchedulerEnqueue(scheduler, 1, (void *)4));
+  bool left = !PINOperationSchedulerStartWorker(scheduler) && !PINOperationSchedulerWorkerFinished(scheduler);
+  while (S_next_value(scheduler) != 0) {
+  }
+  finished = finished && PINOperationSchedulerWorkerFinished(scheduler);
+  PINOperationSchedulerEntryRelease(PINOperationSchedulerEnqueue(scheduler, 1, (void *)5));
+  if (!started || !finished || !left || !PINOperationSchedulerStartWorker(scheduler)) {
+    fprintf(stderr, "started the wrong number of workers\n");
+    return false;
+  }
+  PINOperationSchedulerDestroy(scheduler);
+  return true;
+}
+
+// MARK: - Queues
+
+// Workers start on demand, on a pool of threads standing in for GCD.
+typedef struct S_queue S_queue;
+
+typedef struct {
+  const char *name;
+  void *(*create)(uint32_t maxWorkers);
+  void (*destroy)(void *queue);
+  // Returns a record's operation, reference kept, or NULL when coalesced.
+  void *(*schedule)(S_queue *queue, uint32_t priority, int identifier, S_record *record, S_record **coalesced);
+  void (*release)(S_queue *queue, void *operation);
+  bool (*cancel)(S_queue *queue, void *operation);
+  void (*set_priority)(S_queue *queue, void *operation, uint32_t priority);
+  void (*drain)(S_queue *queue);
+} S_implementation;
+
+struct S_queue {
+  const S_implementation *implementation;
+  void *state;
+  sem_t wake;
+  pthread_t threads[S_WORKERS];
+  atomic_bool stopping;
+  // Workers started while paused wait until it's over.
+  atomic_bool paused;
+  atomic_int deferred;
+  atomic_long finished;
+  atomic_long cancelled;
+};
+
+static void S_run(S_record *record) {
+  if (atomic_fetch_add(&record->ran, 1) != 0) {
+    fprintf(stderr, "an operation ran twice\n");
+    exit(1);
+  }
+  record->attachesWhenRun = record->attaches;
+}
+
+static void S_queue_wake(S_queue *queue) {
+  if (atomic_load(&queue->paused)) {
+    atomic_fetch_add(&queue->deferred, 1);
+  } else {
+    sem_post(&queue->wake);
+  }
+}
+
+static void S_queue_resume(S_queue *queue) {
+  atomic_store(&queue->paused, false);
+  for (int deferred = atomic_exchange(&queue->deferred, 0); deferred > 0; deferred--) {
+    sem_post(&queue->wake);
+  }
+}
+
+static void *S_pool_thread(void *argument) {
+  S_queue *queue = (S_queue *)argument;
+  for (;;) {
+    sem_wait(&queue->wake);
+    if (atomic_load(&queue->stopping)) {
+      return NULL;
+    }
+    queue->implementation->drain(queue);
+  }
+}
+
+static void S_queue_start(S_queue *queue, const S_implementation *implementation, bool paused) {
+  queue->implementation = implementation;
+  queue->state = implementation->create(S_WORKERS);
+  sem_init(&queue->wake, 0, 0);
+  atomic_init(&queue->stopping, false);
+  atomic_init(&queue->paused, paused);
+  atomic_init(&queue->deferred, 0);
+  atomic_init(&queue->finished, 0);
+  atomic_init(&queue->cancelled, 0);
+  for (int i = 0; i < S_WORKERS; i++) {
+    pthread_create(&queue->threads[i], NULL, S_pool_thread, queue);
+  }
+}
+
+static bool S_queue_wait(S_queue *queue, long operations) {
+  long done = 0;
+  long last = -1;
+  double progress = 0;
+  while ((done = atomic_load(&queue->finished) + atomic_load(&queue->cancelled)) < operations) {
+    if (done != last) {
+      last = done;
+      progress = S_now();
+    } else if (S_now() - progress > 5) {
+      fprintf(stderr, "%s: %ld operations never ran\n", queue->implementation->name, operations - done);
+      return false;
+    }
+    sched_yield();
+  }
+  return true;
+}
+
+static void S_queue_stop(S_queue *queue) {
+  atomic_store(&queue->stopping, true);
+  for (int i = 0; i < S_WORKERS; i++) {
+    sem_post(&queue->wake);
+  }
+  for (int i = 0; i < S_WORKERS; i++) {
+    pthread_join(queue->threads[i], NULL);
+  }
+  sem_destroy(&queue->wake);
+  queue->implementation->destroy(queue->state);
+}
+
+// MARK: - Scheduler queue
+
+static void *S_scheduler_create(uint32_t maxWorkers) {
+  return PINOperationSchedulerCreate(maxWorkers, PINOperationSchedulerDefaultAgingLimit, S_release_record);
+}
+
+static void S_scheduler_destroy(void *state) {
+  PINOperationSchedulerDestroy((PINOperationScheduler *)state);
+}
+
+static void S_scheduler_start_workers(S_queue *queue) {
+  while (PINOperationSchedulerStartWorker((PINOperationScheduler *)queue->state)) {
+    S_queue_wake(queue);
+  }
+}
+
+static void *S_scheduler_schedule(S_queue *queue, uint32_t priority, int identifier, S_record *record, S_record **coalesced) {
+  PINOperationScheduler *scheduler = (PINOperationScheduler *)queue->state;
+  PINOperationSchedulerEntry *entry;
+  *coalesced = NULL;
+  if (identifier < 0) {
+    entry = PINOperationSchedulerEnqueue(scheduler, priority, record);
+  } else {
+    char key[16];
+    int length = snprintf(key, sizeof(key), "op-%d", identifier);
+    bool created = false;
+    entry = PINOperationSchedulerAcquire(scheduler, priority, key, (size_t)length, &created);
+    if (created) {
+      PINOperationSchedulerSetContext(entry, record);
+    } else {
+      *coalesced = (S_record *)PINOperationSchedulerEntryContext(entry);
+      (*coalesced)->attaches++;
+    }
+    PINOperationSchedulerUnhold(scheduler, entry);
+  }
+  S_scheduler_start_workers(queue);
+  return entry;
+}
+
+static void S_scheduler_release(S_queue *queue, void *operation) {
+  (void)queue;
+  PINOperationSchedulerEntryRelease((PINOperationSchedulerEntry *)operation);
+}
+
+static bool S_scheduler_cancel(S_queue *queue, void *operation) {
+  return PINOperationSchedulerCancel((PINOperationScheduler *)queue->state, (PINOperationSchedulerEntry *)operation);
+}
+
+static void S_scheduler_set_priority(S_queue *queue, void *operation, uint32_t priority) {
+  PINOperationSchedulerSetPriority((PINOperationScheduler *)queue->state, (PINOperationSchedulerEntry *)operation, priority);
+  S_scheduler_start_workers(queue);
+}
+
+static void S_scheduler_drain(S_queue *queue) {
+  PINOperationScheduler *scheduler = (PINOperationScheduler *)queue->state;
+  do {
+    PINOperationSchedulerEntry *entry;
+    while ((entry = PINOperationSchedulerNext(scheduler)) != NULL) {
+      S_run((S_record *)PINOperationSchedulerEntryContext(entry));
+      PINOperationSchedulerComplete(entry);
+      atomic_fetch_add(&queue->finished, 1);
+    }
+  } while (!PINOperationSchedulerWorkerFinished(scheduler));
+}
+
+static const S_implementation S_scheduler = {
+  "scheduler", S_scheduler_create, S_scheduler_destroy, S_scheduler_schedule, S_scheduler_release,
+  S_scheduler_cancel, S_scheduler_set_priority, S_scheduler_drain,
+};
+
+// MARK: - Locked queue
+
+// Lanes and identifiers behind one recursive mutex, as PINOperationQueue
+// had them, but with the same workers; only the queue differs. Identifiers
+// are strings both ways, as they are NSStrings in PINOperationQueue.
+#define S_LOCKED_BUCKETS 1024
+
+typedef struct S_locked_operation {
+  struct S_locked_operation *next;
+  struct S_locked_operation *bucketNext;
+  S_record *record;
+  int identifier;
+  uint32_t hash;
+  char key[16];
+  bool queued;
+  int references;
+} S_locked_operation;
+
+typedef struct {
+  pthread_mutex_t lock;
+  S_locked_operation *heads[3];
+  S_locked_operation *tails[3];
+  S_locked_operation *buckets[S_LOCKED_BUCKETS];
+  long pending;
+  uint32_t workers;
+  uint32_t maxWorkers;
+} S_locked;
+
+static void *S_locked_create(uint32_t maxWorkers) {
+  S_locked *locked = (S_locked *)calloc(1, sizeof(S_locked));
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&locked->lock, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+  locked->maxWorkers = maxWorkers;
+  return locked;
+}
+
+static void S_locked_destroy(void *state) {
+  S_locked *locked = (S_locked *)state;
+  pthread_mutex_destroy(&locked->lock);
+  free(locked);
+}
+
+static void S_locked_unref(S_locked *locked, S_locked_operation *operation) {
+  (void)locked;
+  if (--operation->references == 0) {
+    atomic_fetch_add(&operation->record->released, 1);
+    free(operation);
+  }
+}
+
+// Call with the lock held.
+static void S_locked_unlink(S_locked *locked, S_locked_operation *operation, uint32_t priority) {
+  S_locked_operation **link = &locked->heads[priority];
+  S_locked_operation *previous = NULL;
+  while (*link != operation) {
+    previous = *link;
+    link = &(*link)->next;
+  }
+  *link = operation->next;
+  if (locked->tails[priority] == operation) {
+    locked->tails[priority] = previous;
+  }
+  if (operation->identifier >= 0) {
+    link = &locked->buckets[operation->hash % S_LOCKED_BUCKETS];
+    while (*link != operation) {
+      link = &(*link)->bucketNext;
+    }
+    *link = operation->bucketNext;
+  }
+  operation->queued = false;
+  locked->pending--;
+}
+
+static void S_locked_start_workers(S_queue *queue) {
+  S_locked *locked = (S_locked *)queue->state;
+  while (locked->workers < locked->maxWorkers && (long)locked->workers < locked->pending) {
+    locked->workers++;
+    S_queue_wake(queue);
+  }
+}
+
+typedef struct {
+  S_locked_operation operation;
+  uint32_t priority;
+} S_locked_reference;
+
+static void *S_locked_schedule(S_queue *queue, uint32_t priority, int identifier, S_record *record, S_record **coalesced) {
+  S_locked *locked = (S_locked *)queue->state;
+  *coalesced = NULL;
+  char key[16];
+  uint32_t hash = 2166136261u;
+  if (identifier >= 0) {
+    snprintf(key, sizeof(key), "op-%d", identifier);
+    for (const char *c = key; *c; c++) {
+      hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+  }
+  pthread_mutex_lock(&locked->lock);
+  if (identifier >= 0) {
+    for (S_locked_operation *operation = locked->buckets[hash % S_LOCKED_BUCKETS]; operation; operation = operation->bucketNext) {
+      if (operation->hash == hash && strcmp(operation->key, key) == 0) {
+        operation->record->attaches++;
+        *coalesced = operation->record;
+        operation->references++;
+        pthread_mutex_unlock(&locked->lock);
+        return operation;
+      }
+    }
+  }
+  S_locked_reference *reference = (S_locked_reference *)calloc(1, sizeof(S_locked_reference));
+  S_locked_operation *operation = &reference->operation;
+  reference->priority = priority;
+  operation->record = record;
+  operation->identifier = identifier;
+  operation->queued = true;
+  operation->references = 2;
+  if (locked->tails[priority]) {
+    locked->tails[priority]->next = operation;
+  } else {
+    locked->heads[priority] = operation;
+  }
+  locked->tails[priority] = operation;
+  if (identifier >= 0) {
+    operation->hash = hash;
+    memcpy(operation->key, key, sizeof(key));
+    operation->bucketNext = locked->buckets[hash % S_LOCKED_BUCKETS];
+    locked->buckets[hash % S_LOCKED_BUCKETS] = operation;
+  }
+  locked->pending++;
+  S_locked_start_workers(queue);
+  pthread_mutex_unlock(&locked->lock);
+  return operation;
+}
+
+static void S_locked_release(S_queue *queue, void *operation) {
+  S_locked *locked = (S_locked *)queue->state;
+  pthread_mutex_lock(&locked->lock);
+  S_locked_unref(locked, (S_locked_operation *)operation);
+  pthread_mutex_unlock(&locked->lock);
+}
+
+static bool S_locked_cancel(S_queue *queue, void *operation) {
+  S_locked *locked = (S_locked *)queue->state;
+  S_locked_reference *reference = (S_locked_reference *)operation;
+  pthread_mutex_lock(&locked->lock);
+  bool cancelled = reference->operation.queued;
+  if (cancelled) {
+    S_locked_unlink(locked, &reference->operation, reference->priority);
+    S_locked_unref(locked, &reference->operation);
+  }
+  pthread_mutex_unlock(&locked->lock);
+  return cancelled;
+}
+
+static void S_locked_set_priority(S_queue *queue, void *operation, uint32_t priority) {
+  S_locked *locked = (S_locked *)queue->state;
+  S_locked_reference *reference = (S_locked_reference *)operation;
+  pthread_mutex_lock(&locked->lock);
+  if (reference->operation.queued && reference->priority != priority) {
+    S_locked_unlink(locked, &reference->operation, reference->priority);
+    reference->priority = priority;
+    reference->operation.next = NULL;
+    reference->operation.queued = true;
+    if (locked->tails[priority]) {
+      locked->tails[priority]->next = &reference->operation;
+    } else {
+      locked->heads[priority] = &reference->operation;
+    }
+    locked->tails[priority] = &reference->operation;
+    if (reference->operation.identifier >= 0) {
+      uint32_t bucket = reference->operation.hash % S_LOCKED_BUCKETS;
+      reference->operation.bucketNext = locked->buckets[bucket];
+      locked->buckets[bucket] = &reference->operation;
+    }
+    locked->pending++;
+    S_locked_start_workers(queue);
+  }
+  pthread_mutex_unlock(&locked->lock);
+}
+
+static void S_locked_drain(S_queue *queue) {
+  S_locked *locked = (S_locked *)queue->state;
+  pthread_mutex_lock(&locked->lock);
+  for (;;) {
+    S_locked_operation *operation = NULL;
+    for (uint32_t priority = 3; priority-- > 0 && operation == NULL;) {
+      if ((operation = locked->heads[priority]) != NULL) {
+        S_locked_unlink(locked, operation, priority);
+      }
+    }
+    if (operation == NULL) {
+      locked->workers--;
+      pthread_mutex_unlock(&locked->lock);
+      return;
+    }
+    pthread_mutex_unlock(&locked->lock);
+    S_run(operation->record);
+    atomic_fetch_add(&queue->finished, 1);
+    pthread_mutex_lock(&locked->lock);
+    S_locked_unref(locked, operation);
+  }
+}
+
+static const S_implementation S_locked_implementation = {
+  "locked", S_locked_create, S_locked_destroy, S_locked_schedule, S_locked_release,
+  S_locked_cancel, S_locked_set_priority, S_locked_drain,
+};
+
+// MARK: - Producers
+
+typedef struct {
+  S_queue *queue;
+  S_record *records;
+  atomic_long *recordCount;
+  long requests;
+  int identifiers;
+  bool stress;
+  uint64_t random;
+  double schedulingTime;
+  long scheduled;
+  long coalesced;
+} S_producer;
+
+#define S_HELD_REFERENCES 64
+
+static void *S_produce(void *argument) {
+  S_producer *producer = (S_producer *)argument;
+  S_queue *queue = producer->queue;
+  const S_implementation *implementation = queue->implementation;
+  void *references[S_HELD_REFERENCES];
+  memset(references, 0, sizeof(references));
+  double schedulingTime = 0;
+  for (long i = 0; i < producer->requests; i++) {
+    uint32_t choice = S_random(&producer->random, 100);
+    if (producer->stress && choice >= 80) {
+      // Cancel or reprioritize an operation scheduled earlier, whatever became of it.
+      void *operation = references[S_random(&producer->random, S_HELD_REFERENCES)];
+      if (operation != NULL && choice >= 90) {
+        if (implementation->cancel(queue, operation)) {
+          atomic_fetch_add(&queue->cancelled, 1);
+        }
+      } else if (operation != NULL) {
+        implementation->set_priority(queue, operation, S_random(&producer->random, 3));
+      }
+      continue;
+    }
+    uint32_t priority = S_random(&producer->random, 3);
+    int identifier = choice < 50 ? (int)S_random(&producer->random, (uint32_t)producer->identifiers) : -1;
+    S_record *record = &producer->records[atomic_fetch_add(producer->recordCount, 1)];
+    S_record *coalesced = NULL;
+    double start = S_now();
+    void *operation = implementation->schedule(queue, priority, identifier, record, &coalesced);
+    schedulingTime += S_now() - start;
+    producer->scheduled++;
+    if (coalesced != NULL) {
+      // The record goes unused.
+      atomic_store(&record->released, -1);
+      producer->coalesced++;
+    }
+    void **slot = &references[S_random(&producer->random, S_HELD_REFERENCES)];
+    if (*slot != NULL) {
+      implementation->release(queue, *slot);
+    }
+    *slot = operation;
+  }
+  for (int i = 0; i < S_HELD_REFERENCES; i++) {
+    if (references[i] != NULL) {
+      implementation->release(queue, references[i]);
+    }
+  }
+  producer->schedulingTime = schedulingTime;
+  return NULL;
+}
+
+typedef struct {
+  double seconds;
+  double drainSeconds;
+  double schedulingNanoseconds;
+  long operations;
+} S_run_result;
+
+// Paused, workers only start once every producer is done, so scheduling and
+// running are timed apart.
+static bool S_produce_all(const S_implementation *implementation, int producerCount, long requests, bool stress,
+                          bool paused, int identifiers, uint64_t seed, S_run_result *result) {
+  S_queue queue;
+  S_queue_start(&queue, implementation, paused);
+  long total = requests * producerCount;
+  S_record *records = (S_record *)calloc((size_t)total, sizeof(S_record));
+  atomic_long recordCount;
+  atomic_init(&recordCount, 0);
+  S_producer producers[16];
+  pthread_t threads[16];
+  double start = S_now();
+  for (int p = 0; p < producerCount; p++) {
+    producers[p] = (S_producer){&queue, records, &recordCount, requests, identifiers, stress, seed + (uint64_t)p * 7919, 0, 0, 0};
+    pthread_create(&threads[p], NULL, S_produce, &producers[p]);
+  }
+  long coalesced = 0;
+  long scheduled = 0;
+  double schedulingTime = 0;
+  for (int p = 0; p < producerCount; p++) {
+    pthread_join(threads[p], NULL);
+    coalesced += producers[p].coalesced;
+    schedulingTime += producers[p].schedulingTime;
+    scheduled += producers[p].scheduled;
+  }
+  long created = atomic_load(&recordCount) - coalesced;
+  double drainStart = S_now();
+  S_queue_resume(&queue);
+  bool passed = S_queue_wait(&queue, created);
+  double end = S_now();
+  S_queue_stop(&queue);
+
+  long attaches = 0;
+  long notRun = 0;
+  for (long i = 0; i < atomic_load(&recordCount) && passed; i++) {
+    S_record *record = &records[i];
+    int released = atomic_load(&record->released);
+    if (released == -1) {
+      continue;
+    }
+    int ran = atomic_load(&record->ran);
+    attaches += record->attaches;
+    notRun += ran == 0;
+    if (released != 1) {
+      fprintf(stderr, "%s: context released %d times\n", implementation->name, released);
+      passed = false;
+    } else if (ran == 1 && record->attachesWhenRun != record->attaches) {
+      fprintf(stderr, "%s: coalesced into an operation that ran\n", implementation->name);
+      passed = false;
+    }
+  }
+  if (passed && attaches != coalesced) {
+    fprintf(stderr, "%s: %ld coalesced, %ld found\n", implementation->name, coalesced, attaches);
+    passed = false;
+  }
+  if (passed && notRun != atomic_load(&queue.cancelled)) {
+    fprintf(stderr, "%s: %ld cancelled, %ld didn't run\n", implementation->name, atomic_load(&queue.cancelled), notRun);
+    passed = false;
+  }
+  free(records);
+  result->seconds = end - start;
+  result->drainSeconds = end - drainStart;
+  result->schedulingNanoseconds = schedulingTime * 1e9 / (double)scheduled;
+  result->operations = created;
+  return passed;
+}
+
+int main(int argc, char **argv) {
+  long stressRequests = 200000;
+  long requests = 400000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      stressRequests = 20000;
+      requests = 40000;
+    }
+  }
+  if (!S_check_order()) {
+    return 1;
+  }
+  // Few identifiers, so coalescing races starting, cancelling and reprioritizing.
+  for (int producers = 1; producers <= 8; producers *= 2) {
+    S_run_result ignored;
+    if (!S_produce_all(&S_scheduler, producers, stressRequests / producers, true, false, 8, 11 * (uint64_t)producers, &ignored)
+        || !S_produce_all(&S_locked_implementation, producers, stressRequests / producers, true, false, 8,
+                          13 * (uint64_t)producers, &ignored)) {
+      return 1;
+    }
+  }
+
+  static const S_implementation *implementations[] = {&S_scheduler, &S_locked_implementation};
+  printf("{\n  \"workers\": %d,\n  \"producers\": [\n", S_WORKERS);
+  for (int producers = 1; producers <= 8; producers *= 2) {
+    S_run_result paused[2];
+    S_run_result mixed[2];
+    for (int i = 0; i < 2; i++) {
+      for (int trial = 0; trial < TRIALS; trial++) {
+        S_run_result result;
+        if (!S_produce_all(implementations[i], producers, requests / producers, false, true, 4096, 17 + (uint64_t)trial, &result)) {
+          return 1;
+        }
+        if (trial == 0 || result.seconds < paused[i].seconds) {
+          paused[i] = result;
+        }
+        if (!S_produce_all(implementations[i], producers, requests / producers, false, false, 4096, 17 + (uint64_t)trial, &result)) {
+          return 1;
+        }
+        if (trial == 0 || result.seconds < mixed[i].seconds) {
+          mixed[i] = result;
+        }
+      }
+    }
+    printf("    {\"count\": %d,\n", producers);
+    printf("     \"schedule_ns\": {\"scheduler\": %.0f, \"locked\": %.0f},\n", paused[0].schedulingNanoseconds,
+           paused[1].schedulingNanoseconds);
+    printf("     \"drain_per_sec\": {\"scheduler\": %.0f, \"locked\": %.0f},\n",
+           paused[0].operations / paused[0].drainSeconds, paused[1].operations / paused[1].drainSeconds);
+    printf("     \"schedule_ns_while_running\": {\"scheduler\": %.0f, \"locked\": %.0f},\n",
+           mixed[0].schedulingNanoseconds, mixed[1].schedulingNanoseconds);
+    printf("     \"operations_per_sec\": {\"scheduler\": %.0f, \"locked\": %.0f}}%s\n",
+           mixed[0].operations / mixed[0].seconds, mixed[1].operations / mixed[1].seconds, producers < 8 ? "," : "");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
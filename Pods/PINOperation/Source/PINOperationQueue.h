@@ -85,6 +85,8 @@ PINOP_SUBCLASSING_RESTRICTED
  *
  * Setting this value to 1 the operations will not be processed by priority as the operations will processed in a FIFO order to prevent deadlocks if operations depend on certain other operations to run in order.
  *
+ * Otherwise higher priority operations start first, but an operation is never starved: once 16 operations of higher priorities started while it waited at the front of its priority, it goes next.
+ *
  */
 @property (assign) NSUInteger maxConcurrentOperations;
 
@@ -7,50 +7,29 @@
 //
 
 #import "PINOperationQueue.h"
-#import <pthread.h>
-
-@class PINOperation;
-
-@interface NSNumber (PINOperationQueue) <PINOperationReference>
-
-@end
+#import "PINOperationScheduler.h"
 
 @interface PINOperationQueue () {
-  pthread_mutex_t _lock;
-  //increments with every operation to allow cancelation
-  NSUInteger _operationReferenceCount;
-  NSUInteger _maxConcurrentOperations;
+  // Lanes, coalescing and workers, none of which take a lock shared by the whole queue.
+  PINOperationScheduler *_scheduler;
   
   dispatch_group_t _group;
   
-  dispatch_queue_t _serialQueue;
-  BOOL _serialQueueBusy;
-  
-  dispatch_semaphore_t _concurrentSemaphore;
   dispatch_queue_t _concurrentQueue;
-  dispatch_queue_t _semaphoreQueue;
-  
-  NSMutableOrderedSet<PINOperation *> *_queuedOperations;
-  NSMutableOrderedSet<PINOperation *> *_lowPriorityOperations;
-  NSMutableOrderedSet<PINOperation *> *_defaultPriorityOperations;
-  NSMutableOrderedSet<PINOperation *> *_highPriorityOperations;
-  
-  NSMapTable<id<PINOperationReference>, PINOperation *> *_referenceToOperations;
-  NSMapTable<NSString *, PINOperation *> *_identifierToOperations;
 }
 
 @end
 
-@interface PINOperation : NSObject
+// Operations are their own references, so cancelling and reprioritizing needn't look them up.
+@interface PINOperation : NSObject <PINOperationReference>
 
 @property (nonatomic, strong) PINOperationBlock block;
-@property (nonatomic, strong) id <PINOperationReference> reference;
-@property (nonatomic, assign) PINOperationQueuePriority priority;
 @property (nonatomic, strong) NSMutableArray<dispatch_block_t> *completions;
-@property (nonatomic, strong) NSString *identifier;
 @property (nonatomic, strong) id data;
+// Owned; the scheduler in turn retains the operation until it runs or is cancelled.
+@property (nonatomic, assign) PINOperationSchedulerEntry *entry;
 
-+ (instancetype)operationWithBlock:(PINOperationBlock)block reference:(id <PINOperationReference>)reference priority:(PINOperationQueuePriority)priority identifier:(nullable NSString *)identifier data:(nullable id)data completion:(nullable dispatch_block_t)completion;
++ (instancetype)operationWithBlock:(PINOperationBlock)block data:(nullable id)data completion:(nullable dispatch_block_t)completion;
 
 - (void)addCompletion:(nullable dispatch_block_t)completion;
 
@@ -58,19 +37,21 @@
 
 @implementation PINOperation
 
-+ (instancetype)operationWithBlock:(PINOperationBlock)block reference:(id<PINOperationReference>)reference priority:(PINOperationQueuePriority)priority identifier:(NSString *)identifier data:(id)data completion:(dispatch_block_t)completion
++ (instancetype)operationWithBlock:(PINOperationBlock)block data:(id)data completion:(dispatch_block_t)completion
 {
   PINOperation *operation = [[self alloc] init];
   operation.block = block;
-  operation.reference = reference;
-  operation.priority = priority;
-  operation.identifier = identifier;
   operation.data = data;
   [operation addCompletion:completion];
   
   return operation;
 }
 
+- (void)dealloc
+{
+  PINOperationSchedulerEntryRelease(_entry);
+}
+
 - (void)addCompletion:(dispatch_block_t)completion
 {
   if (completion == nil) {
@@ -84,6 +65,17 @@
 
 @end
 
+static void PINOperationQueueReleaseOperation(void *context)
+{
+  CFRelease(context);
+}
+
+static uint32_t PINOperationQueueLane(PINOperationQueuePriority priority)
+{
+  NSCAssert(priority <= PINOperationQueuePriorityHigh, @"Invalid priority set");
+  return priority <= PINOperationQueuePriorityHigh ? (uint32_t)priority : (uint32_t)PINOperationQueuePriorityDefault;
+}
+
 @implementation PINOperationQueue
 
 - (instancetype)initWithMaxConcurrentOperations:(NSUInteger)maxConcurrentOperations
@@ -95,39 +87,22 @@
 {
   if (self = [super init]) {
     NSAssert(maxConcurrentOperations > 0, @"Max concurrent operations must be greater than 0.");
-    _maxConcurrentOperations = maxConcurrentOperations;
-    _operationReferenceCount = 0;
-    
-    pthread_mutexattr_t attr;
-    pthread_mutexattr_init(&attr);
-    //mutex must be recursive to allow scheduling of operations from within operations
-    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-    pthread_mutex_init(&_lock, &attr);
+    _scheduler = PINOperationSchedulerCreate((uint32_t)MIN(maxConcurrentOperations, UINT32_MAX), PINOperationSchedulerDefaultAgingLimit, PINOperationQueueReleaseOperation);
     
     _group = dispatch_group_create();
     
-    _serialQueue = dispatch_queue_create("PINOperationQueue Serial Queue", DISPATCH_QUEUE_SERIAL);
-    
     _concurrentQueue = concurrentQueue;
-    
-    //Create a queue with max - 1 because this plus the serial queue add up to max.
-    _concurrentSemaphore = dispatch_semaphore_create(_maxConcurrentOperations - 1);
-    _semaphoreQueue = dispatch_queue_create("PINOperationQueue Serial Semaphore Queue", DISPATCH_QUEUE_SERIAL);
-    
-    _queuedOperations = [[NSMutableOrderedSet alloc] init];
-    _lowPriorityOperations = [[NSMutableOrderedSet alloc] init];
-    _defaultPriorityOperations = [[NSMutableOrderedSet alloc] init];
-    _highPriorityOperations = [[NSMutableOrderedSet alloc] init];
-    
-    _referenceToOperations = [NSMapTable weakToWeakObjectsMapTable];
-    _identifierToOperations = [NSMapTable weakToWeakObjectsMapTable];
   }
   return self;
 }
 
 - (void)dealloc
 {
-  pthread_mutex_destroy(&_lock);
+  // A group can't be deallocated while it's entered.
+  for (size_t cancelled = PINOperationSchedulerCancelAll(_scheduler); cancelled > 0; cancelled--) {
+    dispatch_group_leave(_group);
+  }
+  PINOperationSchedulerDestroy(_scheduler);
 }
 
 + (instancetype)sharedOperationQueue
@@ -140,14 +115,6 @@
     return sharedOperationQueue;
 }
 
-- (id <PINOperationReference>)nextOperationReference
-{
-  [self lock];
-    id <PINOperationReference> reference = [NSNumber numberWithUnsignedInteger:++_operationReferenceCount];
-  [self unlock];
-  return reference;
-}
-
 // Deprecated
 - (id <PINOperationReference>)addOperation:(dispatch_block_t)block
 {
@@ -168,18 +135,14 @@
 - (id <PINOperationReference>)scheduleOperation:(dispatch_block_t)block withPriority:(PINOperationQueuePriority)priority
 {
   PINOperation *operation = [PINOperation operationWithBlock:^(id data) { block(); }
-                                                   reference:[self nextOperationReference]
-                                                    priority:priority
-                                                  identifier:nil
                                                         data:nil
                                                   completion:nil];
-  [self lock];
-    [self locked_addOperation:operation];
-  [self unlock];
+  dispatch_group_enter(_group);
+  operation.entry = PINOperationSchedulerEnqueue(_scheduler, PINOperationQueueLane(priority), (__bridge_retained void *)operation);
   
-  [self scheduleNextOperations:NO];
+  [self startWorkersIfNeeded];
   
-  return operation.reference;
+  return operation;
 }
 
 // Deprecated
@@ -205,267 +168,127 @@
                            dataCoalescingBlock:(PINOperationDataCoalescingBlock)dataCoalescingBlock
                                     completion:(dispatch_block_t)completion
 {
-  id<PINOperationReference> reference = nil;
-  BOOL isNewOperation = NO;
-  
-  [self lock];
-    PINOperation *operation = nil;
-    if (identifier != nil && (operation = [_identifierToOperations objectForKey:identifier]) != nil) {
-      // There is an exisiting operation with the provided identifier, let's coalesce these operations
-      if (dataCoalescingBlock != nil) {
-        operation.data = dataCoalescingBlock(operation.data, coalescingData);
-      }
-      
-      [operation addCompletion:completion];
-    } else {
-      isNewOperation = YES;
-      operation = [PINOperation operationWithBlock:block
-                                         reference:[self nextOperationReference]
-                                          priority:priority
-                                        identifier:identifier
-                                              data:coalescingData
-                                        completion:completion];
-      [self locked_addOperation:operation];
-    }
-    reference = operation.reference;
-  [self unlock];
+  dispatch_group_enter(_group);
   
-  if (isNewOperation) {
-    [self scheduleNextOperations:NO];
+  if (identifier == nil) {
+    PINOperation *operation = [PINOperation operationWithBlock:block data:coalescingData completion:completion];
+    operation.entry = PINOperationSchedulerEnqueue(_scheduler, PINOperationQueueLane(priority), (__bridge_retained void *)operation);
+    [self startWorkersIfNeeded];
+    return operation;
   }
   
-  return reference;
-}
-
-- (void)locked_addOperation:(PINOperation *)operation
-{
-  NSMutableOrderedSet *queue = [self operationQueueWithPriority:operation.priority];
+  const char *identifierString = identifier.UTF8String;
+  bool created = false;
+  PINOperationSchedulerEntry *entry = PINOperationSchedulerAcquire(_scheduler, PINOperationQueueLane(priority), identifierString, strlen(identifierString), &created);
   
-  dispatch_group_enter(_group);
-  [queue addObject:operation];
-  [_queuedOperations addObject:operation];
-  [_referenceToOperations setObject:operation forKey:operation.reference];
-  if (operation.identifier != nil) {
-    [_identifierToOperations setObject:operation forKey:operation.identifier];
+  PINOperation *operation = nil;
+  if (created) {
+    operation = [PINOperation operationWithBlock:block data:coalescingData completion:completion];
+    operation.entry = entry;
+    PINOperationSchedulerSetContext(entry, (__bridge_retained void *)operation);
+    PINOperationSchedulerUnhold(_scheduler, entry);
+  } else {
+    // There is an exisiting operation with the provided identifier, and holding it keeps it from
+    // starting while these operations are coalesced.
+    operation = (__bridge PINOperation *)PINOperationSchedulerEntryContext(entry);
+    if (dataCoalescingBlock != nil) {
+      operation.data = dataCoalescingBlock(operation.data, coalescingData);
+    }
+    [operation addCompletion:completion];
+    PINOperationSchedulerUnhold(_scheduler, entry);
+    PINOperationSchedulerEntryRelease(entry);
+    dispatch_group_leave(_group);
   }
+  
+  [self startWorkersIfNeeded];
+  
+  return operation;
 }
 
 - (void)cancelAllOperations
 {
-  [self lock];
-    for (PINOperation *operation in [[_referenceToOperations copy] objectEnumerator]) {
-      [self locked_cancelOperation:operation.reference];
-    }
-  [self unlock];
+  for (size_t cancelled = PINOperationSchedulerCancelAll(_scheduler); cancelled > 0; cancelled--) {
+    dispatch_group_leave(_group);
+  }
 }
 
-
 - (BOOL)cancelOperation:(id <PINOperationReference>)operationReference
 {
-  [self lock];
-    BOOL success = [self locked_cancelOperation:operationReference];
-  [self unlock];
+  if ([operationReference isKindOfClass:[PINOperation class]] == NO) {
+    return NO;
+  }
+  BOOL success = PINOperationSchedulerCancel(_scheduler, ((PINOperation *)operationReference).entry);
+  if (success) {
+    dispatch_group_leave(_group);
+  }
   return success;
 }
 
 - (NSUInteger)maxConcurrentOperations
 {
-  [self lock];
-    NSUInteger maxConcurrentOperations = _maxConcurrentOperations;
-  [self unlock];
-  return maxConcurrentOperations;
+  return PINOperationSchedulerMaxWorkers(_scheduler);
 }
 
 - (void)setMaxConcurrentOperations:(NSUInteger)maxConcurrentOperations
 {
   NSAssert(maxConcurrentOperations > 0, @"Max concurrent operations must be greater than 0.");
-  [self lock];
-    __block NSInteger difference = maxConcurrentOperations - _maxConcurrentOperations;
-    _maxConcurrentOperations = maxConcurrentOperations;
-  [self unlock];
+  PINOperationSchedulerSetMaxWorkers(_scheduler, (uint32_t)MIN(MAX(maxConcurrentOperations, 1), UINT32_MAX));
   
-  if (difference == 0) {
-    return;
-  }
-  
-  dispatch_async(_semaphoreQueue, ^{
-    while (difference != 0) {
-      if (difference > 0) {
-        dispatch_semaphore_signal(self->_concurrentSemaphore);
-        difference--;
-      } else {
-        dispatch_semaphore_wait(self->_concurrentSemaphore, DISPATCH_TIME_FOREVER);
-        difference++;
-      }
-    }
-  });
+  [self startWorkersIfNeeded];
 }
 
-#pragma mark - private methods
-
-- (BOOL)locked_cancelOperation:(id <PINOperationReference>)operationReference
+- (void)setOperationPriority:(PINOperationQueuePriority)priority withReference:(id <PINOperationReference>)operationReference
 {
-  PINOperation *operation = [_referenceToOperations objectForKey:operationReference];
-  BOOL success = [self locked_removeOperation:operation];
-  if (success) {
-    dispatch_group_leave(_group);
+  if ([operationReference isKindOfClass:[PINOperation class]] == NO) {
+    return;
   }
-  return success;
+  PINOperationSchedulerSetPriority(_scheduler, ((PINOperation *)operationReference).entry, PINOperationQueueLane(priority));
+  
+  [self startWorkersIfNeeded];
 }
 
-- (void)setOperationPriority:(PINOperationQueuePriority)priority withReference:(id <PINOperationReference>)operationReference
+- (void)waitUntilAllOperationsAreFinished
 {
-  [self lock];
-    PINOperation *operation = [_referenceToOperations objectForKey:operationReference];
-    if (operation && operation.priority != priority) {
-      NSMutableOrderedSet *oldQueue = [self operationQueueWithPriority:operation.priority];
-      [oldQueue removeObject:operation];
-      
-      operation.priority = priority;
-      
-      NSMutableOrderedSet *queue = [self operationQueueWithPriority:priority];
-      [queue addObject:operation];
-    }
-  [self unlock];
+  [self startWorkersIfNeeded];
+  dispatch_group_wait(_group, DISPATCH_TIME_FOREVER);
 }
 
+#pragma mark - private methods
+
 /**
- Schedule next operations schedules the next operation by queue order onto the serial queue if
- it's available and one operation by priority order onto the concurrent queue.
+ Starts workers on the concurrent queue while there are operations no running worker will get to,
+ up to the max concurrent operations. Workers run operations until none are left.
  */
-- (void)scheduleNextOperations:(BOOL)onlyCheckSerial
+- (void)startWorkersIfNeeded
 {
-  [self lock];
-  
-    //get next available operation in order, ignoring priority and run it on the serial queue
-    if (_serialQueueBusy == NO) {
-      PINOperation *operation = [self locked_nextOperationByQueue];
-      if (operation) {
-        _serialQueueBusy = YES;
-        dispatch_async(_serialQueue, ^{
-          operation.block(operation.data);
-          for (dispatch_block_t completion in operation.completions) {
-            completion();
-          }
-          dispatch_group_leave(self->_group);
-          
-          [self lock];
-            self->_serialQueueBusy = NO;
-          [self unlock];
-          
-          //see if there are any other operations
-          [self scheduleNextOperations:YES];
-        });
-      }
-    }
-  
-  NSInteger maxConcurrentOperations = _maxConcurrentOperations;
-  
-  [self unlock];
-  
-  if (onlyCheckSerial) {
-    return;
+  while (PINOperationSchedulerStartWorker(_scheduler)) {
+    dispatch_async(_concurrentQueue, ^{
+      [self runOperations];
+    });
   }
+}
 
-  //if only one concurrent operation is set, let's just use the serial queue for executing it
-  if (maxConcurrentOperations < 2) {
-    return;
-  }
-  
-  dispatch_async(_semaphoreQueue, ^{
-    dispatch_semaphore_wait(self->_concurrentSemaphore, DISPATCH_TIME_FOREVER);
-    [self lock];
-      PINOperation *operation = [self locked_nextOperationByPriority];
-    [self unlock];
-  
-    if (operation) {
-      dispatch_async(self->_concurrentQueue, ^{
+- (void)runOperations
+{
+  do {
+    PINOperationSchedulerEntry *entry;
+    while ((entry = PINOperationSchedulerNext(_scheduler)) != NULL) {
+      @autoreleasepool {
+        PINOperation *operation = (__bridge PINOperation *)PINOperationSchedulerEntryContext(entry);
         operation.block(operation.data);
         for (dispatch_block_t completion in operation.completions) {
           completion();
         }
-        dispatch_group_leave(self->_group);
-        dispatch_semaphore_signal(self->_concurrentSemaphore);
-      });
-    } else {
-      dispatch_semaphore_signal(self->_concurrentSemaphore);
-    }
-  });
-}
-
-- (NSMutableOrderedSet *)operationQueueWithPriority:(PINOperationQueuePriority)priority
-{
-  switch (priority) {
-    case PINOperationQueuePriorityLow:
-      return _lowPriorityOperations;
-      
-    case PINOperationQueuePriorityDefault:
-      return _defaultPriorityOperations;
-      
-    case PINOperationQueuePriorityHigh:
-      return _highPriorityOperations;
-          
-    default:
-      NSAssert(NO, @"Invalid priority set");
-      return _defaultPriorityOperations;
-  }
-}
-
-//Call with lock held
-- (PINOperation *)locked_nextOperationByPriority
-{
-  PINOperation *operation = [_highPriorityOperations firstObject];
-  if (operation == nil) {
-    operation = [_defaultPriorityOperations firstObject];
-  }
-  if (operation == nil) {
-    operation = [_lowPriorityOperations firstObject];
-  }
-  if (operation) {
-    [self locked_removeOperation:operation];
-  }
-  return operation;
-}
-
-//Call with lock held
-- (PINOperation *)locked_nextOperationByQueue
-{
-  PINOperation *operation = [_queuedOperations firstObject];
-  [self locked_removeOperation:operation];
-  return operation;
-}
-
-- (void)waitUntilAllOperationsAreFinished
-{
-  [self scheduleNextOperations:NO];
-  dispatch_group_wait(_group, DISPATCH_TIME_FOREVER);
-}
-
-//Call with lock held
-- (BOOL)locked_removeOperation:(PINOperation *)operation
-{
-  if (operation) {
-    NSMutableOrderedSet *priorityQueue = [self operationQueueWithPriority:operation.priority];
-    if ([priorityQueue containsObject:operation]) {
-      [priorityQueue removeObject:operation];
-      [_queuedOperations removeObject:operation];
-      if (operation.identifier) {
-        [_identifierToOperations removeObjectForKey:operation.identifier];
+        // References may outlive the operation; don't keep what it captured alive with them.
+        operation.block = nil;
+        operation.data = nil;
+        operation.completions = nil;
+        
+        PINOperationSchedulerComplete(entry);
       }
-      return YES;
+      dispatch_group_leave(_group);
     }
-  }
-  return NO;
-}
-
-- (void)lock
-{
-  pthread_mutex_lock(&_lock);
-}
-
-- (void)unlock
-{
-  pthread_mutex_unlock(&_lock);
+  } while (PINOperationSchedulerWorkerFinished(_scheduler) == NO);
 }
 
 @end
@@ -0,0 +1,778 @@
+//
+//  PINOperationScheduler.c
+//  PINOperation
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#include "PINOperationScheduler.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <os/lock.h>
+typedef os_unfair_lock PINOperationSchedulerLock;
+#define PINOperationSchedulerLockInit(lock) (*(lock) = OS_UNFAIR_LOCK_INIT)
+#define PINOperationSchedulerLockDestroy(lock)
+#define PINOperationSchedulerLockLock(lock) os_unfair_lock_lock(lock)
+#define PINOperationSchedulerLockUnlock(lock) os_unfair_lock_unlock(lock)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t PINOperationSchedulerLock;
+#define PINOperationSchedulerLockInit(lock) pthread_mutex_init(lock, NULL)
+#define PINOperationSchedulerLockDestroy(lock) pthread_mutex_destroy(lock)
+#define PINOperationSchedulerLockLock(lock) pthread_mutex_lock(lock)
+#define PINOperationSchedulerLockUnlock(lock) pthread_mutex_unlock(lock)
+#endif
+
+// MARK: - Types
+
+/** Held while its context is set or coalesced into, so it can't start. */
+#define PINOperationStateHeld 1u
+/** Taken out of its lane while held; whoever unholds it queues it again. */
+#define PINOperationStatePoppedWhileHeld 2u
+#define PINOperationStateClaimed 4u
+#define PINOperationStateCancelled 8u
+#define PINOperationStateFinished (PINOperationStateClaimed | PINOperationStateCancelled)
+
+/**
+ Identifiers hash to buckets, and buckets to the stripe of locks guarding
+ them, which stays the same as the table of buckets grows.
+ */
+#define PINOperationSchedulerStripeCount 64
+
+typedef struct PINOperationSchedulerNode {
+  _Atomic(struct PINOperationSchedulerNode *) next;
+  PINOperationSchedulerEntry *entry;
+  uint32_t generation;
+  uint32_t priority;
+  uint64_t sequence;
+} PINOperationSchedulerNode;
+
+struct PINOperationSchedulerEntry {
+  atomic_uint references;
+  atomic_uint state;
+  /** Bumped whenever the entry is queued again, which leaves the older queued nodes stale. */
+  atomic_uint generation;
+  atomic_uint priority;
+  _Atomic(void *) context;
+  PINOperationSchedulerReleaseFunction releaseContext;
+  /** Only compared, so references outliving it are told apart. */
+  PINOperationScheduler *scheduler;
+  uint64_t sequence;
+  /** Where the entry is first queued from, so only requeuing allocates. */
+  PINOperationSchedulerNode node;
+  /** Guarded by the entry's bucket. */
+  PINOperationSchedulerEntry *bucketNext;
+  bool hasIdentifier;
+  uint32_t hash;
+  size_t identifierLength;
+  char identifier[];
+};
+
+/**
+ An intrusive multi-producer queue: producers exchange the tail and link the
+ old one to their node, and the worker holding the consumer lock pops from
+ the head. The stub stands in while the queue is empty.
+ */
+typedef struct {
+  _Alignas(64) _Atomic(PINOperationSchedulerNode *) tail;
+  _Alignas(64) PINOperationSchedulerNode *head;
+  PINOperationSchedulerNode stub;
+  /** Popped to compare with the other lanes, but not taken yet. */
+  PINOperationSchedulerNode *front;
+  /**
+   Requeued nodes, a min-heap by sequence, so they keep the place they were
+   first scheduled in rather than go behind newer nodes. Consumer side only.
+   */
+  PINOperationSchedulerNode **requeued;
+  size_t requeuedCount;
+  size_t requeuedCapacity;
+  /** Operations started from other lanes while this one had a front. */
+  uint32_t passedOver;
+} PINOperationSchedulerLane;
+
+struct PINOperationScheduler {
+  PINOperationSchedulerLane lanes[PINOperationSchedulerPriorityCount];
+  /** Requeued nodes, pushed as a stack by anyone and sorted into the lanes by workers. */
+  _Alignas(64) _Atomic(PINOperationSchedulerNode *) requeued;
+  _Alignas(64) atomic_uint_fast64_t sequence;
+  /** Nodes queued and not taken, stale ones included. */
+  _Alignas(64) atomic_long pending;
+  _Alignas(64) atomic_uint workers;
+  atomic_uint maxWorkers;
+  uint32_t agingLimit;
+  PINOperationSchedulerReleaseFunction releaseContext;
+  PINOperationSchedulerLock consumerLock;
+  PINOperationSchedulerLock stripes[PINOperationSchedulerStripeCount];
+  /** Replaced with every stripe locked, so read with any. A power of two, at least the stripe count. */
+  PINOperationSchedulerEntry **buckets;
+  size_t bucketCount;
+  atomic_size_t identifiedCount;
+};
+
+// MARK: - Entries
+
+static uint32_t PINOperationSchedulerHash(const char *identifier, size_t length)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)identifier[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static PINOperationSchedulerEntry *PINOperationSchedulerEntryCreate(PINOperationScheduler *scheduler, uint32_t priority, uint32_t state, uint32_t references, size_t identifierLength)
+{
+  PINOperationSchedulerEntry *entry = malloc(sizeof(PINOperationSchedulerEntry) + identifierLength);
+  if (entry == NULL) {
+    abort();
+  }
+  entry->bucketNext = NULL;
+  entry->hasIdentifier = false;
+  entry->hash = 0;
+  entry->identifierLength = identifierLength;
+  atomic_init(&entry->references, references);
+  atomic_init(&entry->state, state);
+  atomic_init(&entry->generation, 0);
+  atomic_init(&entry->priority, priority);
+  atomic_init(&entry->context, NULL);
+  entry->releaseContext = scheduler->releaseContext;
+  entry->scheduler = scheduler;
+  entry->sequence = atomic_fetch_add(&scheduler->sequence, 1);
+  return entry;
+}
+
+void PINOperationSchedulerEntryRetain(PINOperationSchedulerEntry *entry)
+{
+  atomic_fetch_add(&entry->references, 1);
+}
+
+static void PINOperationSchedulerReleaseContext(PINOperationSchedulerEntry *entry)
+{
+  void *context = atomic_exchange(&entry->context, NULL);
+  if (context != NULL) {
+    entry->releaseContext(context);
+  }
+}
+
+void PINOperationSchedulerEntryRelease(PINOperationSchedulerEntry *entry)
+{
+  if (entry == NULL || atomic_fetch_sub(&entry->references, 1) != 1) {
+    return;
+  }
+  PINOperationSchedulerReleaseContext(entry);
+  free(entry);
+}
+
+void *PINOperationSchedulerEntryContext(PINOperationSchedulerEntry *entry)
+{
+  return atomic_load(&entry->context);
+}
+
+void PINOperationSchedulerSetContext(PINOperationSchedulerEntry *entry, void *context)
+{
+  atomic_store(&entry->context, context);
+}
+
+// MARK: - Identifiers
+
+static PINOperationSchedulerEntry **PINOperationSchedulerLockBucket(PINOperationScheduler *scheduler, uint32_t hash)
+{
+  PINOperationSchedulerLockLock(&scheduler->stripes[hash % PINOperationSchedulerStripeCount]);
+  return &scheduler->buckets[hash & (scheduler->bucketCount - 1)];
+}
+
+static void PINOperationSchedulerUnlockBucket(PINOperationScheduler *scheduler, uint32_t hash)
+{
+  PINOperationSchedulerLockUnlock(&scheduler->stripes[hash % PINOperationSchedulerStripeCount]);
+}
+
+/** Doubles the buckets once there are more than two entries to each. */
+static void PINOperationSchedulerGrowTable(PINOperationScheduler *scheduler)
+{
+  for (size_t stripe = 0; stripe < PINOperationSchedulerStripeCount; stripe++) {
+    PINOperationSchedulerLockLock(&scheduler->stripes[stripe]);
+  }
+  size_t bucketCount = scheduler->bucketCount;
+  PINOperationSchedulerEntry **buckets = NULL;
+  // Someone else may have grown it already.
+  if (atomic_load(&scheduler->identifiedCount) > 2 * bucketCount
+      && (buckets = calloc(2 * bucketCount, sizeof(PINOperationSchedulerEntry *))) != NULL) {
+    for (size_t i = 0; i < bucketCount; i++) {
+      PINOperationSchedulerEntry *entry = scheduler->buckets[i];
+      while (entry != NULL) {
+        PINOperationSchedulerEntry *next = entry->bucketNext;
+        PINOperationSchedulerEntry **bucket = &buckets[entry->hash & (2 * bucketCount - 1)];
+        entry->bucketNext = *bucket;
+        *bucket = entry;
+        entry = next;
+      }
+    }
+    free(scheduler->buckets);
+    scheduler->buckets = buckets;
+    scheduler->bucketCount = 2 * bucketCount;
+  }
+  for (size_t stripe = PINOperationSchedulerStripeCount; stripe-- > 0;) {
+    PINOperationSchedulerLockUnlock(&scheduler->stripes[stripe]);
+  }
+}
+
+/** Drops a finished entry from the identifier table. Called once, by whoever finished it. */
+static void PINOperationSchedulerForget(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry)
+{
+  if (!entry->hasIdentifier) {
+    return;
+  }
+  bool found = false;
+  for (PINOperationSchedulerEntry **link = PINOperationSchedulerLockBucket(scheduler, entry->hash); *link != NULL; link = &(*link)->bucketNext) {
+    if (*link == entry) {
+      *link = entry->bucketNext;
+      found = true;
+      break;
+    }
+  }
+  PINOperationSchedulerUnlockBucket(scheduler, entry->hash);
+  if (found) {
+    atomic_fetch_sub(&scheduler->identifiedCount, 1);
+    PINOperationSchedulerEntryRelease(entry);
+  }
+}
+
+// MARK: - Lanes
+
+static void PINOperationSchedulerLaneInit(PINOperationSchedulerLane *lane)
+{
+  atomic_init(&lane->stub.next, NULL);
+  lane->stub.entry = NULL;
+  atomic_init(&lane->tail, &lane->stub);
+  lane->head = &lane->stub;
+  lane->front = NULL;
+  lane->requeued = NULL;
+  lane->requeuedCount = 0;
+  lane->requeuedCapacity = 0;
+  lane->passedOver = 0;
+}
+
+static void PINOperationSchedulerLanePushNode(PINOperationSchedulerLane *lane, PINOperationSchedulerNode *node)
+{
+  atomic_store(&node->next, NULL);
+  PINOperationSchedulerNode *previous = atomic_exchange(&lane->tail, node);
+  // Until this store the node can't be popped, and a worker finding the
+  // lane in this state yields rather than spin.
+  atomic_store(&previous->next, node);
+}
+
+typedef enum {
+  PINOperationSchedulerPopNode,
+  PINOperationSchedulerPopEmpty,
+  /** A producer exchanged the tail but hasn't linked its node yet. */
+  PINOperationSchedulerPopBusy,
+} PINOperationSchedulerPopResult;
+
+/** Call with the consumer lock held. */
+static PINOperationSchedulerPopResult PINOperationSchedulerLanePop(PINOperationSchedulerLane *lane, PINOperationSchedulerNode **result)
+{
+  PINOperationSchedulerNode *head = lane->head;
+  PINOperationSchedulerNode *next = atomic_load(&head->next);
+  if (head == &lane->stub) {
+    if (next == NULL) {
+      return atomic_load(&lane->tail) == head ? PINOperationSchedulerPopEmpty : PINOperationSchedulerPopBusy;
+    }
+    lane->head = next;
+    head = next;
+    next = atomic_load(&head->next);
+  }
+  if (next != NULL) {
+    lane->head = next;
+    *result = head;
+    return PINOperationSchedulerPopNode;
+  }
+  if (atomic_load(&lane->tail) != head) {
+    return PINOperationSchedulerPopBusy;
+  }
+  // The head is the last node, which can only be popped with the stub behind it.
+  PINOperationSchedulerLanePushNode(lane, &lane->stub);
+  next = atomic_load(&head->next);
+  if (next == NULL) {
+    return PINOperationSchedulerPopBusy;
+  }
+  lane->head = next;
+  *result = head;
+  return PINOperationSchedulerPopNode;
+}
+
+/** Call with the consumer lock held. */
+static void PINOperationSchedulerLaneAddRequeued(PINOperationSchedulerLane *lane, PINOperationSchedulerNode *node)
+{
+  if (lane->requeuedCount == lane->requeuedCapacity) {
+    size_t capacity = lane->requeuedCapacity > 0 ? 2 * lane->requeuedCapacity : 16;
+    PINOperationSchedulerNode **requeued = realloc(lane->requeued, capacity * sizeof(PINOperationSchedulerNode *));
+    if (requeued == NULL) {
+      abort();
+    }
+    lane->requeued = requeued;
+    lane->requeuedCapacity = capacity;
+  }
+  size_t index = lane->requeuedCount++;
+  while (index > 0 && lane->requeued[(index - 1) / 2]->sequence > node->sequence) {
+    lane->requeued[index] = lane->requeued[(index - 1) / 2];
+    index = (index - 1) / 2;
+  }
+  lane->requeued[index] = node;
+}
+
+/** Call with the consumer lock held. */
+static PINOperationSchedulerNode *PINOperationSchedulerLaneRemoveRequeued(PINOperationSchedulerLane *lane)
+{
+  PINOperationSchedulerNode *first = lane->requeued[0];
+  PINOperationSchedulerNode *last = lane->requeued[--lane->requeuedCount];
+  size_t index = 0;
+  for (;;) {
+    size_t child = 2 * index + 1;
+    if (child >= lane->requeuedCount) {
+      break;
+    }
+    if (child + 1 < lane->requeuedCount && lane->requeued[child + 1]->sequence < lane->requeued[child]->sequence) {
+      child++;
+    }
+    if (lane->requeued[child]->sequence >= last->sequence) {
+      break;
+    }
+    lane->requeued[index] = lane->requeued[child];
+    index = child;
+  }
+  if (lane->requeuedCount > 0) {
+    lane->requeued[index] = last;
+  }
+  return first;
+}
+
+/** The first scheduled of the lane's front and requeued nodes, or NULL. Call with the consumer lock held. */
+static PINOperationSchedulerNode *PINOperationSchedulerLaneFirst(PINOperationSchedulerLane *lane)
+{
+  PINOperationSchedulerNode *front = lane->front;
+  if (lane->requeuedCount > 0 && (front == NULL || lane->requeued[0]->sequence < front->sequence)) {
+    return lane->requeued[0];
+  }
+  return front;
+}
+
+/** Takes PINOperationSchedulerLaneFirst off the lane. Call with the consumer lock held. */
+static PINOperationSchedulerNode *PINOperationSchedulerLaneTakeFirst(PINOperationSchedulerLane *lane)
+{
+  PINOperationSchedulerNode *node = PINOperationSchedulerLaneFirst(lane);
+  if (node == lane->front) {
+    lane->front = NULL;
+  } else {
+    PINOperationSchedulerLaneRemoveRequeued(lane);
+  }
+  return node;
+}
+
+/** Sorts the nodes requeued since into their lanes. Call with the consumer lock held. */
+static void PINOperationSchedulerCollectRequeued(PINOperationScheduler *scheduler)
+{
+  PINOperationSchedulerNode *node = atomic_exchange(&scheduler->requeued, NULL);
+  while (node != NULL) {
+    PINOperationSchedulerNode *next = atomic_load(&node->next);
+    PINOperationSchedulerLaneAddRequeued(&scheduler->lanes[node->priority], node);
+    node = next;
+  }
+}
+
+/**
+ Queues a node for a generation of the entry, which holds a reference to it.
+ The first goes to the back of its lane; later ones keep the entry's place.
+ */
+static void PINOperationSchedulerPush(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry, uint32_t priority, uint32_t generation)
+{
+  PINOperationSchedulerNode *node = generation == 0 ? &entry->node : malloc(sizeof(PINOperationSchedulerNode));
+  if (node == NULL) {
+    abort();
+  }
+  node->entry = entry;
+  node->generation = generation;
+  node->priority = priority;
+  node->sequence = entry->sequence;
+  if (generation == 0) {
+    PINOperationSchedulerLanePushNode(&scheduler->lanes[priority], node);
+  } else {
+    // Only ever emptied whole, so there's no ABA to worry about.
+    PINOperationSchedulerNode *head = atomic_load(&scheduler->requeued);
+    do {
+      atomic_store(&node->next, head);
+    } while (!atomic_compare_exchange_weak(&scheduler->requeued, &head, node));
+  }
+  atomic_fetch_add(&scheduler->pending, 1);
+}
+
+static void PINOperationSchedulerRequeue(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry)
+{
+  PINOperationSchedulerEntryRetain(entry);
+  uint32_t generation = atomic_fetch_add(&entry->generation, 1) + 1;
+  PINOperationSchedulerPush(scheduler, entry, atomic_load(&entry->priority), generation);
+}
+
+static void PINOperationSchedulerFreeNode(PINOperationSchedulerNode *node)
+{
+  if (node != &node->entry->node) {
+    free(node);
+  }
+}
+
+static void PINOperationSchedulerDropNode(PINOperationSchedulerNode *node)
+{
+  PINOperationSchedulerEntry *entry = node->entry;
+  PINOperationSchedulerFreeNode(node);
+  PINOperationSchedulerEntryRelease(entry);
+}
+
+// MARK: - Lifecycle
+
+PINOperationScheduler *PINOperationSchedulerCreate(uint32_t maxWorkers, uint32_t agingLimit, PINOperationSchedulerReleaseFunction releaseContext)
+{
+  PINOperationScheduler *scheduler = NULL;
+  if (posix_memalign((void **)&scheduler, 64, sizeof(PINOperationScheduler)) != 0) {
+    return NULL;
+  }
+  memset(scheduler, 0, sizeof(PINOperationScheduler));
+  for (uint32_t priority = 0; priority < PINOperationSchedulerPriorityCount; priority++) {
+    PINOperationSchedulerLaneInit(&scheduler->lanes[priority]);
+  }
+  atomic_init(&scheduler->requeued, NULL);
+  atomic_init(&scheduler->sequence, 0);
+  atomic_init(&scheduler->pending, 0);
+  atomic_init(&scheduler->workers, 0);
+  atomic_init(&scheduler->maxWorkers, maxWorkers > 0 ? maxWorkers : 1);
+  scheduler->agingLimit = agingLimit;
+  scheduler->releaseContext = releaseContext;
+  PINOperationSchedulerLockInit(&scheduler->consumerLock);
+  for (size_t stripe = 0; stripe < PINOperationSchedulerStripeCount; stripe++) {
+    PINOperationSchedulerLockInit(&scheduler->stripes[stripe]);
+  }
+  scheduler->bucketCount = PINOperationSchedulerStripeCount;
+  scheduler->buckets = calloc(scheduler->bucketCount, sizeof(PINOperationSchedulerEntry *));
+  atomic_init(&scheduler->identifiedCount, 0);
+  if (scheduler->buckets == NULL) {
+    free(scheduler);
+    return NULL;
+  }
+  return scheduler;
+}
+
+void PINOperationSchedulerDestroy(PINOperationScheduler *scheduler)
+{
+  if (scheduler == NULL) {
+    return;
+  }
+  PINOperationSchedulerCancelAll(scheduler);
+  for (uint32_t priority = 0; priority < PINOperationSchedulerPriorityCount; priority++) {
+    free(scheduler->lanes[priority].requeued);
+  }
+  PINOperationSchedulerLockDestroy(&scheduler->consumerLock);
+  for (size_t stripe = 0; stripe < PINOperationSchedulerStripeCount; stripe++) {
+    PINOperationSchedulerLockDestroy(&scheduler->stripes[stripe]);
+  }
+  free(scheduler->buckets);
+  free(scheduler);
+}
+
+uint32_t PINOperationSchedulerMaxWorkers(PINOperationScheduler *scheduler)
+{
+  return atomic_load(&scheduler->maxWorkers);
+}
+
+void PINOperationSchedulerSetMaxWorkers(PINOperationScheduler *scheduler, uint32_t maxWorkers)
+{
+  atomic_store(&scheduler->maxWorkers, maxWorkers > 0 ? maxWorkers : 1);
+}
+
+// MARK: - Scheduling
+
+PINOperationSchedulerEntry *PINOperationSchedulerEnqueue(PINOperationScheduler *scheduler, uint32_t priority, void *context)
+{
+  // One reference for the caller and one for the node.
+  PINOperationSchedulerEntry *entry = PINOperationSchedulerEntryCreate(scheduler, priority, 0, 2, 0);
+  atomic_store(&entry->context, context);
+  PINOperationSchedulerPush(scheduler, entry, priority, 0);
+  return entry;
+}
+
+PINOperationSchedulerEntry *PINOperationSchedulerAcquire(PINOperationScheduler *scheduler, uint32_t priority, const char *identifier, size_t identifierLength, bool *created)
+{
+  uint32_t hash = PINOperationSchedulerHash(identifier, identifierLength);
+  for (;;) {
+    PINOperationSchedulerEntry *entry = NULL;
+    PINOperationSchedulerEntry **bucket = PINOperationSchedulerLockBucket(scheduler, hash);
+    for (PINOperationSchedulerEntry *candidate = *bucket; candidate != NULL; candidate = candidate->bucketNext) {
+      // A finished entry is on its way out, and can be replaced meanwhile.
+      if (candidate->hash == hash && candidate->identifierLength == identifierLength
+          && memcmp(candidate->identifier, identifier, identifierLength) == 0
+          && !(atomic_load(&candidate->state) & PINOperationStateFinished)) {
+        entry = candidate;
+        PINOperationSchedulerEntryRetain(entry);
+        break;
+      }
+    }
+    if (entry == NULL) {
+      // One reference for the caller, one for the table and one for the node.
+      entry = PINOperationSchedulerEntryCreate(scheduler, priority, PINOperationStateHeld, 3, identifierLength);
+      entry->hasIdentifier = true;
+      entry->hash = hash;
+      memcpy(entry->identifier, identifier, identifierLength);
+      entry->bucketNext = *bucket;
+      *bucket = entry;
+      bool grow = atomic_fetch_add(&scheduler->identifiedCount, 1) + 1 > 2 * scheduler->bucketCount;
+      PINOperationSchedulerUnlockBucket(scheduler, hash);
+
+      if (grow) {
+        PINOperationSchedulerGrowTable(scheduler);
+      }
+      PINOperationSchedulerPush(scheduler, entry, priority, 0);
+      *created = true;
+      return entry;
+    }
+    PINOperationSchedulerUnlockBucket(scheduler, hash);
+
+    for (;;) {
+      unsigned int state = atomic_load(&entry->state);
+      if (state & PINOperationStateFinished) {
+        break;
+      }
+      if (state & PINOperationStateHeld) {
+        // Someone else is coalescing into it, which won't take long.
+        sched_yield();
+        continue;
+      }
+      if (atomic_compare_exchange_weak(&entry->state, &state, state | PINOperationStateHeld)) {
+        *created = false;
+        return entry;
+      }
+    }
+    // It started or was cancelled before it could be held; look again.
+    PINOperationSchedulerEntryRelease(entry);
+  }
+}
+
+void PINOperationSchedulerUnhold(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry)
+{
+  unsigned int state = atomic_load(&entry->state);
+  while (!atomic_compare_exchange_weak(&entry->state, &state, state & ~(PINOperationStateHeld | PINOperationStatePoppedWhileHeld))) {
+  }
+  if (state & PINOperationStateCancelled) {
+    // Left by cancelling to whoever held it.
+    PINOperationSchedulerReleaseContext(entry);
+  } else if (state & PINOperationStatePoppedWhileHeld) {
+    PINOperationSchedulerRequeue(scheduler, entry);
+  }
+}
+
+bool PINOperationSchedulerCancel(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry)
+{
+  if (entry->scheduler != scheduler) {
+    return false;
+  }
+  unsigned int state = atomic_load(&entry->state);
+  do {
+    if (state & PINOperationStateFinished) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak(&entry->state, &state, state | PINOperationStateCancelled));
+
+  // Its nodes are dropped as the lanes get to them.
+  PINOperationSchedulerForget(scheduler, entry);
+  if (!(state & PINOperationStateHeld)) {
+    PINOperationSchedulerReleaseContext(entry);
+  }
+  return true;
+}
+
+size_t PINOperationSchedulerCancelAll(PINOperationScheduler *scheduler)
+{
+  // Emptied under the lock and cancelled after, since releasing contexts can run any code.
+  PINOperationSchedulerNode *nodes = NULL;
+  PINOperationSchedulerLockLock(&scheduler->consumerLock);
+  PINOperationSchedulerCollectRequeued(scheduler);
+  for (uint32_t priority = 0; priority < PINOperationSchedulerPriorityCount; priority++) {
+    PINOperationSchedulerLane *lane = &scheduler->lanes[priority];
+    while (lane->requeuedCount > 0) {
+      PINOperationSchedulerNode *node = lane->requeued[--lane->requeuedCount];
+      atomic_fetch_sub(&scheduler->pending, 1);
+      atomic_store(&node->next, nodes);
+      nodes = node;
+    }
+    PINOperationSchedulerNode *node = lane->front;
+    lane->front = NULL;
+    lane->passedOver = 0;
+    for (;;) {
+      if (node == NULL) {
+        PINOperationSchedulerPopResult result = PINOperationSchedulerLanePop(lane, &node);
+        if (result == PINOperationSchedulerPopEmpty) {
+          break;
+        }
+        if (result == PINOperationSchedulerPopBusy) {
+          sched_yield();
+          continue;
+        }
+      }
+      atomic_fetch_sub(&scheduler->pending, 1);
+      atomic_store(&node->next, nodes);
+      nodes = node;
+      node = NULL;
+    }
+  }
+  PINOperationSchedulerLockUnlock(&scheduler->consumerLock);
+
+  size_t cancelled = 0;
+  while (nodes != NULL) {
+    PINOperationSchedulerNode *node = nodes;
+    nodes = atomic_load(&node->next);
+    if (PINOperationSchedulerCancel(scheduler, node->entry)) {
+      cancelled++;
+    }
+    PINOperationSchedulerDropNode(node);
+  }
+  return cancelled;
+}
+
+void PINOperationSchedulerSetPriority(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry, uint32_t priority)
+{
+  if (entry->scheduler != scheduler || (atomic_load(&entry->state) & PINOperationStateFinished)) {
+    return;
+  }
+  if (atomic_exchange(&entry->priority, priority) != priority) {
+    // The node in the old lane goes stale.
+    PINOperationSchedulerRequeue(scheduler, entry);
+  }
+}
+
+// MARK: - Workers
+
+bool PINOperationSchedulerStartWorker(PINOperationScheduler *scheduler)
+{
+  unsigned int workers = atomic_load(&scheduler->workers);
+  do {
+    if (workers >= atomic_load(&scheduler->maxWorkers) || (long)workers >= atomic_load(&scheduler->pending)) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak(&scheduler->workers, &workers, workers + 1));
+  return true;
+}
+
+bool PINOperationSchedulerWorkerFinished(PINOperationScheduler *scheduler)
+{
+  atomic_fetch_sub(&scheduler->workers, 1);
+  // Whoever queued work while this worker still counted left it to this worker.
+  return !PINOperationSchedulerStartWorker(scheduler);
+}
+
+/**
+ Claims the entry of a node taken from a lane, or leaves it to whoever holds
+ it. Fails for stale nodes: the entry finished, or was queued again since.
+ */
+static bool PINOperationSchedulerClaim(PINOperationSchedulerNode *node)
+{
+  PINOperationSchedulerEntry *entry = node->entry;
+  unsigned int state = atomic_load(&entry->state);
+  for (;;) {
+    if ((state & PINOperationStateFinished) || node->generation != atomic_load(&entry->generation)) {
+      return false;
+    }
+    unsigned int claimed = (state & PINOperationStateHeld) ? state | PINOperationStatePoppedWhileHeld : PINOperationStateClaimed;
+    if (atomic_compare_exchange_weak(&entry->state, &state, claimed)) {
+      return claimed == PINOperationStateClaimed;
+    }
+  }
+}
+
+/** The lane to take from next, or PINOperationSchedulerPriorityCount if all are empty. Call with the consumer lock held. */
+static uint32_t PINOperationSchedulerNextLane(PINOperationScheduler *scheduler, bool *busy)
+{
+  PINOperationSchedulerLane *lanes = scheduler->lanes;
+  PINOperationSchedulerCollectRequeued(scheduler);
+  PINOperationSchedulerNode *firsts[PINOperationSchedulerPriorityCount];
+  for (uint32_t priority = 0; priority < PINOperationSchedulerPriorityCount; priority++) {
+    if (lanes[priority].front == NULL) {
+      PINOperationSchedulerPopResult result = PINOperationSchedulerLanePop(&lanes[priority], &lanes[priority].front);
+      *busy = *busy || result == PINOperationSchedulerPopBusy;
+    }
+    firsts[priority] = PINOperationSchedulerLaneFirst(&lanes[priority]);
+    if (firsts[priority] == NULL) {
+      lanes[priority].passedOver = 0;
+    }
+  }
+
+  uint32_t next = PINOperationSchedulerPriorityCount;
+  if (atomic_load(&scheduler->maxWorkers) == 1) {
+    // First scheduled, first run, so operations can depend on ones scheduled before them.
+    for (uint32_t priority = 0; priority < PINOperationSchedulerPriorityCount; priority++) {
+      if (firsts[priority] && (next == PINOperationSchedulerPriorityCount || firsts[priority]->sequence < firsts[next]->sequence)) {
+        next = priority;
+      }
+    }
+    return next;
+  }
+
+  uint32_t aged = PINOperationSchedulerPriorityCount;
+  for (uint32_t priority = PINOperationSchedulerPriorityCount; priority-- > 0;) {
+    if (firsts[priority] == NULL) {
+      continue;
+    }
+    if (next == PINOperationSchedulerPriorityCount) {
+      next = priority;
+    } else if (lanes[priority].passedOver >= scheduler->agingLimit
+               && (aged == PINOperationSchedulerPriorityCount || lanes[priority].passedOver >= lanes[aged].passedOver)) {
+      aged = priority;
+    }
+  }
+  return aged != PINOperationSchedulerPriorityCount ? aged : next;
+}
+
+PINOperationSchedulerEntry *PINOperationSchedulerNext(PINOperationScheduler *scheduler)
+{
+  bool busy = false;
+  PINOperationSchedulerLockLock(&scheduler->consumerLock);
+  for (;;) {
+    uint32_t next = PINOperationSchedulerNextLane(scheduler, &busy);
+    if (next == PINOperationSchedulerPriorityCount) {
+      break;
+    }
+    PINOperationSchedulerLane *lane = &scheduler->lanes[next];
+    PINOperationSchedulerNode *node = PINOperationSchedulerLaneTakeFirst(lane);
+    atomic_fetch_sub(&scheduler->pending, 1);
+    if (!PINOperationSchedulerClaim(node)) {
+      PINOperationSchedulerDropNode(node);
+      continue;
+    }
+
+    lane->passedOver = 0;
+    for (uint32_t priority = 0; priority < PINOperationSchedulerPriorityCount; priority++) {
+      if (priority != next && PINOperationSchedulerLaneFirst(&scheduler->lanes[priority]) != NULL) {
+        scheduler->lanes[priority].passedOver++;
+      }
+    }
+    PINOperationSchedulerLockUnlock(&scheduler->consumerLock);
+
+    PINOperationSchedulerEntry *entry = node->entry;
+    PINOperationSchedulerFreeNode(node);
+    PINOperationSchedulerForget(scheduler, entry);
+    // The node's reference is the caller's now.
+    return entry;
+  }
+  PINOperationSchedulerLockUnlock(&scheduler->consumerLock);
+  if (busy) {
+    // Give the producer a chance to link its node.
+    sched_yield();
+  }
+  return NULL;
+}
+
+void PINOperationSchedulerComplete(PINOperationSchedulerEntry *entry)
+{
+  PINOperationSchedulerReleaseContext(entry);
+  PINOperationSchedulerEntryRelease(entry);
+}
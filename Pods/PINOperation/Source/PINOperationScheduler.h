@@ -0,0 +1,134 @@
+//
+//  PINOperationScheduler.h
+//  PINOperation
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#ifndef PINOperationScheduler_h
+#define PINOperationScheduler_h
+
+// Plain C with no Foundation dependency, so the scheduling behind
+// PINOperationQueue can be built, stress tested and benchmarked on its own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Priorities are those of PINOperationQueuePriority: low, default and high. */
+#define PINOperationSchedulerPriorityCount 3
+
+/**
+ How many operations of higher priorities may start while one of a lower
+ priority waits at the front of its lane before it goes first.
+ */
+#define PINOperationSchedulerDefaultAgingLimit 16
+
+/** Called with an operation's context once nothing needs it any more. */
+typedef void (*PINOperationSchedulerReleaseFunction)(void *context);
+
+/**
+ Queues operations in a lane per priority for up to a maximum number of
+ workers to take.
+
+ Nothing that schedules, coalesces, cancels or reprioritizes operations
+ takes a lock shared by the whole scheduler. Lanes take operations with an
+ atomic exchange, an operation's state changes with compare-and-swap, and
+ identifiers are looked up in a table striped over separately locked
+ buckets. Workers taking operations serialize among themselves only, since
+ aging compares the fronts of every lane.
+
+ Workers take the highest priority operation first, except that one waiting
+ at the front of a lower lane while PINOperationSchedulerDefaultAgingLimit
+ (or the limit given) others started goes next. With one worker, operations
+ run in the order they were first scheduled instead, whatever their priority.
+ An operation queued again, by reprioritizing it or because a worker reached
+ it while held, keeps that place; within its new lane too.
+
+ Thread safe.
+ */
+typedef struct PINOperationScheduler PINOperationScheduler;
+
+/**
+ A scheduled operation, reference counted. The scheduler keeps its own
+ references while it needs one; the ones handed out must be released.
+ */
+typedef struct PINOperationSchedulerEntry PINOperationSchedulerEntry;
+
+PINOperationScheduler *PINOperationSchedulerCreate(uint32_t maxWorkers, uint32_t agingLimit, PINOperationSchedulerReleaseFunction releaseContext);
+
+/** Cancels whatever is still queued. No worker may be running. */
+void PINOperationSchedulerDestroy(PINOperationScheduler *scheduler);
+
+uint32_t PINOperationSchedulerMaxWorkers(PINOperationScheduler *scheduler);
+
+/** Takes effect as workers start and finish; running ones aren't stopped. */
+void PINOperationSchedulerSetMaxWorkers(PINOperationScheduler *scheduler, uint32_t maxWorkers);
+
+// MARK: - Scheduling
+
+/** Queues an operation and returns a reference to it. */
+PINOperationSchedulerEntry *PINOperationSchedulerEnqueue(PINOperationScheduler *scheduler, uint32_t priority, void *context);
+
+/**
+ Finds the queued operation with `identifier`, or queues a new one without a
+ context if there isn't one, setting `created`. Either way it's returned
+ held: it can't start until PINOperationSchedulerUnhold, so its context can
+ be set or coalesced into. Anyone else acquiring it waits until then.
+ */
+PINOperationSchedulerEntry *PINOperationSchedulerAcquire(PINOperationScheduler *scheduler, uint32_t priority, const char *identifier, size_t identifierLength, bool *created);
+
+/** Sets the context of an operation just created by PINOperationSchedulerAcquire, while it's held. */
+void PINOperationSchedulerSetContext(PINOperationSchedulerEntry *entry, void *context);
+
+/** Lets a held operation start. */
+void PINOperationSchedulerUnhold(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry);
+
+/**
+ Fails if the operation started or was cancelled already, or belongs to
+ another scheduler. Its context is released, once let go if it's held.
+ */
+bool PINOperationSchedulerCancel(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry);
+
+/** Cancels every queued operation and returns how many were. */
+size_t PINOperationSchedulerCancelAll(PINOperationScheduler *scheduler);
+
+/** Moves a queued operation of this scheduler to another lane. */
+void PINOperationSchedulerSetPriority(PINOperationScheduler *scheduler, PINOperationSchedulerEntry *entry, uint32_t priority);
+
+void *PINOperationSchedulerEntryContext(PINOperationSchedulerEntry *entry);
+
+void PINOperationSchedulerEntryRetain(PINOperationSchedulerEntry *entry);
+
+void PINOperationSchedulerEntryRelease(PINOperationSchedulerEntry *entry);
+
+// MARK: - Workers
+
+/**
+ Counts another worker in if there's queued work no running worker will get
+ to and the maximum allows. Call after scheduling, and start one if so.
+ */
+bool PINOperationSchedulerStartWorker(PINOperationScheduler *scheduler);
+
+/** Claims the next operation for the calling worker, or returns NULL if none is queued. */
+PINOperationSchedulerEntry *PINOperationSchedulerNext(PINOperationScheduler *scheduler);
+
+/** Releases the context and reference of an operation from PINOperationSchedulerNext once it has run. */
+void PINOperationSchedulerComplete(PINOperationSchedulerEntry *entry);
+
+/**
+ Counts a worker out once PINOperationSchedulerNext returns NULL, unless
+ more work arrived in the meantime, in which case it returns false and the
+ worker carries on.
+ */
+bool PINOperationSchedulerWorkerFinished(PINOperationScheduler *scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINOperationScheduler_h
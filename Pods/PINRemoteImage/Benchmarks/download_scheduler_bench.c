@@ -0,0 +1,564 @@
+// Checks PINRemoteImageDownloadScheduler and compares it with the priority
+// FIFO PINRemoteImageDownloadQueue used before, on a simulated network.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -o download_scheduler_bench
+//      download_scheduler_bench.c ../Source/Classes/PINRemoteImageDownloadScheduler.c -lm
+//   ./download_scheduler_bench [--quick] > result.json
+//
+// First checks adding, removing, reprioritizing and finishing downloads
+// directly, then runs random operations against a model of what may run,
+// checking after every decision that no limit is exceeded, no URL is
+// fetched twice at once, nothing that could start is left waiting, and
+// nothing waits behind a lower priority download it could preempt. Exits
+// with 1 on failure.
+//
+// Then simulates scrolling a chat of attachment and generated images spread
+// over hosts of very different speeds: each host's bandwidth is shared by
+// its connections, and all of them share the phone's. Images are requested
+// as they come near the screen, raised to high priority while visible and
+// lowered once scrolled past, as ASNetworkImageNode does; some URLs appear
+// twice. Host speeds are learned from finished downloads as PINSpeedRecorder
+// does. Reports how long images were blank while on screen, the whole session,
+// bytes fetched twice at once, and the cost of each scheduling decision.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Source/Classes/PINRemoteImageDownloadScheduler.h"
+
+#define TRIALS 3
+#define MAX_CONCURRENT 10
+#define MAX_PER_HOST 4
+#define HOST_COUNT 4
+#define TICK 0.002
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+static double S_uniform(void) {
+  return S_random(1u << 30) / (double)(1u << 30);
+}
+
+static int S_failures = 0;
+
+#define S_CHECK(condition, ...)                                \
+  do {                                                         \
+    if (!(condition)) {                                        \
+      if (S_failures++ < 10) {                                 \
+        fprintf(stderr, "%s:%d: ", __func__, __LINE__);        \
+        fprintf(stderr, __VA_ARGS__);                          \
+        fprintf(stderr, "\n");                                 \
+      }                                                        \
+    }                                                          \
+  } while (0)
+
+// MARK: - Model
+
+// What the caller of the scheduler knows about a download.
+typedef struct {
+  bool added;
+  bool running;
+  uint32_t host;
+  uint32_t url;
+  uint32_t priority;
+} model_task;
+
+typedef struct {
+  model_task *tasks;
+  size_t count;
+} model;
+
+static const char *S_host_names[HOST_COUNT] = {"oss-cn-hangzhou.aliyuncs.com", "cos.ap-shanghai.myqcloud.com", "images.generated.example", "avatars.cdn.example"};
+
+static void S_url(char *buffer, size_t size, uint32_t url) {
+  snprintf(buffer, size, "https://host/%u.jpg", url);
+}
+
+static bool S_add(PINRemoteImageDownloadScheduler *scheduler, model *m, size_t index, double now) {
+  model_task *task = &m->tasks[index];
+  char url[64];
+  S_url(url, sizeof(url), task->url);
+  const char *host = S_host_names[task->host];
+  return PINRemoteImageDownloadSchedulerAdd(scheduler, &m->tasks[index], host, strlen(host), url, strlen(url), task->priority, 0, now);
+}
+
+// Applies what the scheduler decided to the model, and checks the decision.
+static void S_next(PINRemoteImageDownloadScheduler *scheduler, model *m, uint32_t maxConcurrent, uint32_t maxPerHost, size_t *preemptions) {
+  PINRemoteImageDownloadSchedulerAction actions[4];
+  size_t count;
+  do {
+    // Small, so decisions often span calls.
+    count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 2 + S_random(3));
+    for (size_t i = 0; i < count; i++) {
+      model_task *task = (model_task *)actions[i].context;
+      S_CHECK(task->added, "acted on a download that isn't there");
+      if (actions[i].kind == PINRemoteImageDownloadSchedulerActionStart) {
+        S_CHECK(!task->running, "started a running download");
+        task->running = true;
+      } else {
+        S_CHECK(task->running, "preempted a download that isn't running");
+        S_CHECK(i + 1 < count && actions[i + 1].kind == PINRemoteImageDownloadSchedulerActionStart, "preempted for nothing");
+        task->running = false;
+        *preemptions += 1;
+      }
+    }
+  } while (count > 0);
+
+  size_t running = 0, queued = 0;
+  size_t hostRunning[HOST_COUNT] = {0};
+  for (size_t i = 0; i < m->count; i++) {
+    const model_task *task = &m->tasks[i];
+    if (task->added && task->running) {
+      running++;
+      hostRunning[task->host]++;
+      for (size_t j = i + 1; j < m->count; j++) {
+        S_CHECK(!(m->tasks[j].added && m->tasks[j].running && m->tasks[j].url == task->url), "URL %u fetched twice at once", task->url);
+      }
+    } else if (task->added) {
+      queued++;
+    }
+  }
+  S_CHECK(running == PINRemoteImageDownloadSchedulerRunningCount(scheduler), "running count %zu, expected %zu", PINRemoteImageDownloadSchedulerRunningCount(scheduler), running);
+  S_CHECK(queued == PINRemoteImageDownloadSchedulerQueuedCount(scheduler), "queued count %zu, expected %zu", PINRemoteImageDownloadSchedulerQueuedCount(scheduler), queued);
+  S_CHECK(running <= maxConcurrent, "%zu running, limit %u", running, maxConcurrent);
+  for (uint32_t h = 0; h < HOST_COUNT; h++) {
+    S_CHECK(hostRunning[h] <= maxPerHost, "%zu running on host %u, limit %u", hostRunning[h], h, maxPerHost);
+  }
+  for (size_t i = 0; i < m->count; i++) {
+    const model_task *task = &m->tasks[i];
+    if (!task->added || task->running) {
+      continue;
+    }
+    bool urlRunning = false;
+    for (size_t j = 0; j < m->count; j++) {
+      urlRunning |= m->tasks[j].added && m->tasks[j].running && m->tasks[j].url == task->url;
+    }
+    if (urlRunning) {
+      continue;
+    }
+    bool room = running < maxConcurrent && hostRunning[task->host] < maxPerHost;
+    S_CHECK(!room, "download %zu could start but waits", i);
+    for (size_t j = 0; j < m->count && !room; j++) {
+      const model_task *other = &m->tasks[j];
+      if (other->added && other->running && other->priority < task->priority) {
+        bool wouldFit = running - 1 < maxConcurrent && hostRunning[task->host] - (other->host == task->host) < maxPerHost;
+        S_CHECK(!wouldFit, "download %zu of priority %u waits behind %zu of priority %u", i, task->priority, j, other->priority);
+      }
+    }
+  }
+}
+
+static void S_check_basics(void) {
+  model_task tasks[4] = {{0}};
+  PINRemoteImageDownloadScheduler *scheduler = PINRemoteImageDownloadSchedulerCreate(1, 1);
+  S_CHECK(PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[0], "a", 1, "u0", 2, 1, 0, 0), "add");
+  S_CHECK(!PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[0], "a", 1, "u0", 2, 1, 0, 0), "added twice");
+  S_CHECK(PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[1], "a", 1, "u1", 2, 1, 0, 1), "add");
+  PINRemoteImageDownloadSchedulerAction actions[4];
+  size_t count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4);
+  S_CHECK(count == 1 && actions[0].context == &tasks[0] && actions[0].kind == PINRemoteImageDownloadSchedulerActionStart, "first queued starts first");
+  S_CHECK(!PINRemoteImageDownloadSchedulerRemove(scheduler, &tasks[0]), "removed a running download");
+  S_CHECK(PINRemoteImageDownloadSchedulerRemove(scheduler, &tasks[1]), "remove queued");
+  S_CHECK(!PINRemoteImageDownloadSchedulerRemove(scheduler, &tasks[1]), "removed twice");
+  S_CHECK(!PINRemoteImageDownloadSchedulerSetPriority(scheduler, &tasks[1], 2), "reprioritized a removed download");
+
+  // Raising a queued download above the running one preempts it, as does lowering the running one.
+  S_CHECK(PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[2], "a", 1, "u2", 2, 1, 0, 2), "add");
+  S_CHECK(PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4) == 0, "no room");
+  PINRemoteImageDownloadSchedulerSetPriority(scheduler, &tasks[2], 2);
+  count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4);
+  S_CHECK(count == 2 && actions[0].context == &tasks[0] && actions[0].kind == PINRemoteImageDownloadSchedulerActionPreempt
+          && actions[1].context == &tasks[2], "preempts for higher priority");
+  S_CHECK(PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4) == 0, "settled");
+  PINRemoteImageDownloadSchedulerSetPriority(scheduler, &tasks[2], 0);
+  count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4);
+  S_CHECK(count == 2 && actions[0].context == &tasks[2] && actions[1].context == &tasks[0], "preempts what was lowered");
+  S_CHECK(PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4) == 0, "settled");
+
+  // A duplicate URL waits for the first to finish, even with room.
+  PINRemoteImageDownloadSchedulerFinish(scheduler, &tasks[0]);
+  PINRemoteImageDownloadSchedulerSetLimits(scheduler, 4, 0);
+  count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4);
+  S_CHECK(count == 1 && actions[0].context == &tasks[2], "the preempted download resumes");
+  S_CHECK(PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[3], "b", 1, "u2", 2, 2, 0, 3), "add");
+  S_CHECK(PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4) == 0, "duplicate waits");
+  PINRemoteImageDownloadSchedulerFinish(scheduler, &tasks[2]);
+  count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4);
+  S_CHECK(count == 1 && actions[0].context == &tasks[3], "duplicate starts once the first finishes");
+  PINRemoteImageDownloadSchedulerDestroy(scheduler);
+
+  // Within a priority, the host expected to finish first goes first, unless the other waited longer.
+  scheduler = PINRemoteImageDownloadSchedulerCreate(1, 0);
+  PINRemoteImageDownloadSchedulerSetHostSpeed(scheduler, "slow", 4, 10000, 0.5);
+  PINRemoteImageDownloadSchedulerSetHostSpeed(scheduler, "fast", 4, 1000000, 0.05);
+  PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[0], "slow", 4, "s", 1, 1, 0, 0);
+  PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[1], "fast", 4, "f", 1, 1, 0, 1);
+  PINRemoteImageDownloadSchedulerAdd(scheduler, &tasks[2], "fast", 4, "g", 1, 1, 0, 100);
+  count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4);
+  S_CHECK(count == 1 && actions[0].context == &tasks[1], "fast host first");
+  PINRemoteImageDownloadSchedulerFinish(scheduler, &tasks[1]);
+  count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 4);
+  S_CHECK(count == 1 && actions[0].context == &tasks[0], "slow host before a much later fast one");
+  PINRemoteImageDownloadSchedulerDestroy(scheduler);
+}
+
+static void S_check_random(int rounds) {
+  for (int round = 0; round < rounds; round++) {
+    uint32_t maxConcurrent = 1 + S_random(8), maxPerHost = 1 + S_random(4);
+    PINRemoteImageDownloadScheduler *scheduler = PINRemoteImageDownloadSchedulerCreate(maxConcurrent, maxPerHost);
+    model m = {(model_task *)calloc(200, sizeof(model_task)), 200};
+    size_t preemptions = 0;
+    for (int step = 0; step < 2000; step++) {
+      size_t index = S_random((uint32_t)m.count);
+      model_task *task = &m.tasks[index];
+      switch (S_random(8)) {
+        case 0:
+        case 1:
+          if (!task->added) {
+            task->host = S_random(HOST_COUNT);
+            task->url = S_random(60);
+            task->priority = S_random(3);
+            task->running = false;
+            task->added = S_add(scheduler, &m, index, step);
+            S_CHECK(task->added, "add");
+          }
+          break;
+        case 2:
+          if (task->added) {
+            task->priority = S_random(3);
+            S_CHECK(PINRemoteImageDownloadSchedulerSetPriority(scheduler, task, task->priority), "set priority");
+          }
+          break;
+        case 3:
+          S_CHECK(PINRemoteImageDownloadSchedulerRemove(scheduler, task) == (task->added && !task->running), "remove");
+          task->added = task->added && task->running;
+          break;
+        case 4:
+          PINRemoteImageDownloadSchedulerFinish(scheduler, task);
+          task->added = false;
+          task->running = false;
+          break;
+        case 5: {
+          const char *host = S_host_names[S_random(HOST_COUNT)];
+          PINRemoteImageDownloadSchedulerSetHostSpeed(scheduler, host, strlen(host), S_random(3) ? 1000.0 + S_random(1000000) : 0, S_uniform());
+          break;
+        }
+        default:
+          S_next(scheduler, &m, maxConcurrent, maxPerHost, &preemptions);
+          break;
+      }
+    }
+    PINRemoteImageDownloadSchedulerDestroy(scheduler);
+    free(m.tasks);
+  }
+}
+
+// MARK: - Simulated network
+
+typedef struct {
+  double bandwidth;
+  double timeToFirstByte;
+  // What the phone has learned, as PINSpeedRecorder does.
+  double learnedBytesPerSecond;
+  double learnedTimeToFirstByte;
+  int measurements;
+} sim_host;
+
+typedef struct {
+  model_task scheduled;
+  double bytes;
+  double received;
+  double requestedAt;
+  double startedAt;
+  double firstByteAt;
+  double finishedAt;
+  bool started;
+  bool finished;
+  double visibleAt;
+  // Time on screen before the image arrived.
+  double blank;
+  // For the FIFO queue.
+  uint64_t fifoOrder;
+} sim_task;
+
+typedef struct {
+  const char *name;
+  double meanBlank;
+  double p95Blank;
+  double maxBlank;
+  double session;
+  double duplicateBytes;
+  size_t preemptions;
+  double microsecondsPerDecision;
+} sim_result;
+
+static int S_compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// The queue before: a FIFO per priority, a total limit, and reprioritizing moving a download to the back.
+static void S_fifo_next(sim_task *tasks, size_t count, size_t maxConcurrent) {
+  size_t running = 0;
+  for (size_t i = 0; i < count; i++) {
+    running += tasks[i].scheduled.added && tasks[i].scheduled.running;
+  }
+  while (running < maxConcurrent) {
+    sim_task *best = NULL;
+    for (size_t i = 0; i < count; i++) {
+      sim_task *task = &tasks[i];
+      if (task->scheduled.added && !task->scheduled.running
+          && (best == NULL || task->scheduled.priority > best->scheduled.priority
+              || (task->scheduled.priority == best->scheduled.priority && task->fifoOrder < best->fifoOrder))) {
+        best = task;
+      }
+    }
+    if (best == NULL) {
+      break;
+    }
+    best->scheduled.running = true;
+    running++;
+  }
+}
+
+static sim_result S_simulate(bool useScheduler, size_t itemCount, uint64_t seed) {
+  S_state = seed;
+  sim_host hosts[HOST_COUNT] = {
+    {4.0e6, 0.06, 0, 0, 0},
+    {2.0e6, 0.12, 0, 0, 0},
+    {0.6e6, 0.8, 0, 0, 0},
+    {3.0e6, 0.03, 0, 0, 0},
+  };
+  const double downlink = 5.0e6;
+  const size_t visibleRows = 6, preloadRows = 12;
+
+  sim_task *tasks = (sim_task *)calloc(itemCount, sizeof(sim_task));
+  for (size_t i = 0; i < itemCount; i++) {
+    uint32_t kind = S_random(10);
+    // Mostly fast storage, some slow generated images, avatars.
+    tasks[i].scheduled.host = kind < 4 ? 0 : (kind < 6 ? 1 : (kind < 8 ? 2 : 3));
+    tasks[i].scheduled.url = (uint32_t)i;
+    if (i > 10 && S_random(20) == 0) {
+      // The same image shown again a few messages later.
+      size_t original = i - 1 - S_random(6);
+      tasks[i].scheduled.url = tasks[original].scheduled.url;
+      tasks[i].scheduled.host = tasks[original].scheduled.host;
+    }
+    tasks[i].bytes = tasks[i].scheduled.host == 3 ? 20e3 + S_random(30000) : 80e3 + S_random(600000) * S_uniform();
+    tasks[i].visibleAt = -1;
+  }
+
+  PINRemoteImageDownloadScheduler *scheduler = PINRemoteImageDownloadSchedulerCreate(MAX_CONCURRENT, MAX_PER_HOST);
+  model m = {&tasks[0].scheduled, 0};
+  (void)m;
+  size_t preemptions = 0;
+  size_t decisions = 0;
+  double decisionTime = 0;
+  uint64_t fifoOrder = 0;
+  double duplicateBytes = 0;
+
+  // Scrolling: reads a while, scrolls slowly, flings, and so on down the chat.
+  double top = 0;
+  double velocity = 0;
+  double phaseEnds = 0;
+  double now = 0;
+  size_t requested = 0;
+  size_t finished = 0;
+  bool changed = true;
+  while (finished < itemCount && now < 600) {
+    if (now >= phaseEnds) {
+      uint32_t phase = S_random(4);
+      velocity = phase == 0 ? 0 : (phase == 3 ? 40 + S_random(40) : 2 + S_random(6));
+      phaseEnds = now + (phase == 3 ? 0.4 : 1 + S_random(3));
+    }
+    top = fmin(top + velocity * TICK, (double)(itemCount - visibleRows));
+    size_t first = (size_t)top;
+
+    // Request what comes near the screen; raise what's visible, lower what scrolled past.
+    while (requested < itemCount && requested < first + visibleRows + preloadRows) {
+      sim_task *task = &tasks[requested];
+      task->requestedAt = now;
+      task->scheduled.priority = 1;
+      task->scheduled.added = true;
+      task->fifoOrder = fifoOrder++;
+      if (useScheduler) {
+        char url[64];
+        S_url(url, sizeof(url), task->scheduled.url);
+        const char *host = S_host_names[task->scheduled.host];
+        PINRemoteImageDownloadSchedulerAdd(scheduler, task, host, strlen(host), url, strlen(url), 1, 0, now);
+      }
+      requested++;
+      changed = true;
+    }
+    for (size_t i = 0; i < requested; i++) {
+      sim_task *task = &tasks[i];
+      uint32_t priority = (i >= first && i < first + visibleRows) ? 2 : (i >= first ? 1 : 0);
+      if (priority == 2 && task->visibleAt < 0) {
+        task->visibleAt = now;
+      }
+      if (priority == 2 && !task->finished) {
+        task->blank += TICK;
+      }
+      if (task->scheduled.added && priority != task->scheduled.priority) {
+        task->scheduled.priority = priority;
+        task->fifoOrder = fifoOrder++;
+        if (useScheduler) {
+          PINRemoteImageDownloadSchedulerSetPriority(scheduler, task, priority);
+        }
+        changed = true;
+      }
+    }
+
+    if (changed) {
+      if (useScheduler) {
+        PINRemoteImageDownloadSchedulerAction actions[8];
+        size_t count;
+        double start = S_now();
+        do {
+          count = PINRemoteImageDownloadSchedulerNext(scheduler, actions, 8);
+          for (size_t i = 0; i < count; i++) {
+            ((sim_task *)actions[i].context)->scheduled.running = actions[i].kind == PINRemoteImageDownloadSchedulerActionStart;
+            preemptions += actions[i].kind == PINRemoteImageDownloadSchedulerActionPreempt;
+          }
+        } while (count > 0);
+        decisionTime += S_now() - start;
+        decisions++;
+      } else {
+        S_fifo_next(tasks, requested, MAX_CONCURRENT);
+      }
+      changed = false;
+    }
+
+    // Transfer: each host's bandwidth is split among its connections, and the downlink among all.
+    size_t hostConnections[HOST_COUNT] = {0};
+    size_t connections = 0;
+    for (size_t i = 0; i < requested; i++) {
+      sim_task *task = &tasks[i];
+      if (task->scheduled.added && task->scheduled.running) {
+        if (!task->started) {
+          task->started = true;
+          task->startedAt = now;
+          task->firstByteAt = now + hosts[task->scheduled.host].timeToFirstByte;
+        }
+        if (now >= task->firstByteAt) {
+          hostConnections[task->scheduled.host]++;
+          connections++;
+        }
+      }
+    }
+    for (size_t i = 0; i < requested; i++) {
+      sim_task *task = &tasks[i];
+      if (!(task->scheduled.added && task->scheduled.running && now >= task->firstByteAt)) {
+        continue;
+      }
+      double rate = fmin(hosts[task->scheduled.host].bandwidth / hostConnections[task->scheduled.host], downlink / connections);
+      task->received += rate * TICK;
+      for (size_t j = 0; j < requested; j++) {
+        if (j != i && tasks[j].scheduled.added && tasks[j].scheduled.running && tasks[j].scheduled.url == task->scheduled.url && j < i) {
+          duplicateBytes += rate * TICK;
+          break;
+        }
+      }
+      if (task->received >= task->bytes) {
+        task->finished = true;
+        task->finishedAt = now;
+        task->scheduled.added = false;
+        task->scheduled.running = false;
+        finished++;
+        changed = true;
+        sim_host *host = &hosts[task->scheduled.host];
+        double transfer = fmax(now - task->firstByteAt, TICK);
+        double speed = task->bytes / transfer;
+        double ttfb = task->firstByteAt - task->startedAt;
+        // PINSpeedRecorder's exponentially weighted averages.
+        host->learnedBytesPerSecond = host->measurements ? host->learnedBytesPerSecond * 0.8 + speed * 0.2 : speed;
+        host->learnedTimeToFirstByte = host->measurements ? host->learnedTimeToFirstByte * 0.8 + ttfb * 0.2 : ttfb;
+        host->measurements++;
+        if (useScheduler) {
+          PINRemoteImageDownloadSchedulerFinish(scheduler, task);
+          const char *name = S_host_names[task->scheduled.host];
+          PINRemoteImageDownloadSchedulerSetHostSpeed(scheduler, name, strlen(name), host->learnedBytesPerSecond, host->learnedTimeToFirstByte);
+        }
+      }
+    }
+    now += TICK;
+  }
+
+  double *blanks = (double *)malloc(itemCount * sizeof(double));
+  size_t blankCount = 0;
+  double total = 0;
+  for (size_t i = 0; i < itemCount; i++) {
+    if (tasks[i].visibleAt >= 0) {
+      double blank = tasks[i].blank;
+      blanks[blankCount++] = blank;
+      total += blank;
+    }
+  }
+  qsort(blanks, blankCount, sizeof(double), S_compare_doubles);
+  sim_result result = {
+    useScheduler ? "scheduler" : "priority_fifo",
+    blankCount ? total / blankCount : 0,
+    blankCount ? blanks[(size_t)(blankCount * 0.95)] : 0,
+    blankCount ? blanks[blankCount - 1] : 0,
+    now,
+    duplicateBytes,
+    preemptions,
+    decisions ? decisionTime / decisions * 1e6 : 0,
+  };
+  free(blanks);
+  free(tasks);
+  PINRemoteImageDownloadSchedulerDestroy(scheduler);
+  return result;
+}
+
+// MARK: - Main
+
+int main(int argc, char **argv) {
+  size_t itemCount = 400;
+  int rounds = 200;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      itemCount = 120;
+      rounds = 30;
+    }
+  }
+
+  S_check_basics();
+  S_check_random(rounds);
+  if (S_failures) {
+    return 1;
+  }
+
+  printf("{\n  \"items\": %zu,\n  \"max_concurrent\": %d,\n  \"max_per_host\": %d,\n  \"sessions\": [", itemCount, MAX_CONCURRENT, MAX_PER_HOST);
+  for (int trial = 0; trial < TRIALS; trial++) {
+    uint64_t seed = 0x5EED0000ull + (uint64_t)trial;
+    sim_result results[2] = {S_simulate(false, itemCount, seed), S_simulate(true, itemCount, seed)};
+    printf("%s\n    {\"seed\": %d, \"policies\": [", trial ? "," : "", trial);
+    for (int p = 0; p < 2; p++) {
+      sim_result *r = &results[p];
+      printf("%s\n      {\"policy\": \"%s\", \"blank_on_screen_mean_s\": %.3f, \"blank_on_screen_p95_s\": %.3f, \"blank_on_screen_max_s\": %.3f, "
+             "\"session_s\": %.2f, \"bytes_fetched_twice_at_once\": %.0f, \"preemptions\": %zu, \"us_per_decision\": %.2f}",
+             p ? "," : "", r->name, r->meanBlank, r->p95Blank, r->maxBlank, r->session, r->duplicateBytes, r->preemptions, r->microsecondsPerDecision);
+    }
+    printf("\n    ]}");
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
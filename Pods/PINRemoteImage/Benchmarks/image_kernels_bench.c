@@ -0,0 +1,451 @@
+// Checks and throughput of PINImageKernels, which PINProgressiveImage blurs
+// with and pin_imageDownsampledToMaxPixelSize: resizes with.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -I../Source/Classes/include -o image_kernels_bench
+//      image_kernels_bench.c ../Source/Classes/PINImageKernels.c -lm
+//   ./image_kernels_bench [--quick] > result.json
+//
+// First checks every implementation the machine supports against the scalar
+// one, which they must match exactly: resizing with both filters between
+// random sizes, up and down, blurring with small and wide boxes, and
+// premultiplying, on rows with padding and widths that leave vector tails.
+// Resizing rows fed in random bands must match resizing them all at once.
+// Then checks the scalar kernels against the same algorithms in double
+// precision, which they must match to within 1 for resizing and 2 for
+// blurring, and premultiplying against rounding c * a / 255 for every color
+// and alpha. Exits with 1 on failure.
+//
+// Last, times each implementation on a 4032x3024 photo: downsampling to
+// 1536 pixels as APIManager does before uploading, Lanczos to a 256 pixel
+// thumbnail, a box and a gaussian blur, and premultiplying. Reports how
+// much memory the banded resizer holds against decoding the whole image.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <PINRemoteImage/PINImageKernels.h>
+
+#define TRIALS 3
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+static const char *S_isa_names[] = {"scalar", "sse2", "avx2", "neon"};
+
+// MARK: - Images
+
+static PINImageKernelsBuffer S_make(size_t width, size_t height, size_t padding) {
+  PINImageKernelsBuffer buffer = {NULL, width, height, width * 4 + padding};
+  buffer.data = (uint8_t *)calloc(buffer.rowBytes * height + 1, 1);
+  return buffer;
+}
+
+// Smooth gradients with noise and hard edges, premultiplied, so both filter
+// ringing and saturation are exercised.
+static PINImageKernelsBuffer S_make_photo(size_t width, size_t height, size_t padding) {
+  PINImageKernelsBuffer buffer = S_make(width, height, padding);
+  for (size_t y = 0; y < height; y++) {
+    uint8_t *row = buffer.data + y * buffer.rowBytes;
+    for (size_t x = 0; x < width; x++) {
+      uint32_t alpha = ((x / 7 + y / 5) % 3 == 0) ? S_random(256) : 255;
+      for (int c = 0; c < 3; c++) {
+        uint32_t value = (uint32_t)((x * (c + 1) * 255) / (width + 1) + (y * 97) / (height + 1)) % 256;
+        value = (x % 11 == 3) ? 255 * (y % 2) : (value + S_random(32)) % 256;
+        row[x * 4 + c] = (uint8_t)(value * alpha / 255);
+      }
+      row[x * 4 + 3] = (uint8_t)alpha;
+    }
+  }
+  return buffer;
+}
+
+static PINImageKernelsBuffer S_copy(const PINImageKernelsBuffer *source) {
+  PINImageKernelsBuffer copy = S_make(source->width, source->height, source->rowBytes - source->width * 4);
+  memcpy(copy.data, source->data, source->rowBytes * source->height);
+  return copy;
+}
+
+// Compares pixels, leaving padding out. Returns the largest difference.
+static int S_difference(const PINImageKernelsBuffer *a, const PINImageKernelsBuffer *b) {
+  int largest = 0;
+  for (size_t y = 0; y < a->height; y++) {
+    for (size_t i = 0; i < a->width * 4; i++) {
+      int difference = abs((int)a->data[y * a->rowBytes + i] - (int)b->data[y * b->rowBytes + i]);
+      largest = difference > largest ? difference : largest;
+    }
+  }
+  return largest;
+}
+
+static bool S_resize_banded(const PINImageKernelsBuffer *source, const PINImageKernelsBuffer *destination, PINImageKernelsFilter filter) {
+  PINImageKernelsResizer *resizer = PINImageKernelsResizerCreate(source->width, source->height, destination, filter);
+  if (resizer == NULL) {
+    return false;
+  }
+  size_t row = 0;
+  size_t finished = 0;
+  while (row < source->height) {
+    size_t band = 1 + S_random(S_random(4) == 0 ? 64 : 3);
+    band = row + band > source->height ? source->height - row : band;
+    size_t done = PINImageKernelsResizerConsumeRows(resizer, source->data + row * source->rowBytes, source->rowBytes, band);
+    if (done < finished) {
+      PINImageKernelsResizerDestroy(resizer);
+      return false;
+    }
+    finished = done;
+    row += band;
+  }
+  // Rows past the end are ignored.
+  finished = PINImageKernelsResizerConsumeRows(resizer, source->data, source->rowBytes, 3);
+  PINImageKernelsResizerDestroy(resizer);
+  return finished == destination->height;
+}
+
+// MARK: - Double precision references
+
+static double S_lanczos3(double x) {
+  if (fabs(x) < 1e-12) {
+    return 1;
+  }
+  if (fabs(x) >= 3) {
+    return 0;
+  }
+  return 3 * sin(M_PI * x) * sin(M_PI * x / 3) / (M_PI * M_PI * x * x);
+}
+
+// Normalized weights of every source pixel for destination pixel i.
+static void S_weights(double *weights, size_t sourceLength, size_t destinationLength, size_t i, PINImageKernelsFilter filter) {
+  double scale = (double)sourceLength / (double)destinationLength;
+  double filterScale = scale > 1 ? scale : 1;
+  double sum = 0;
+  for (size_t k = 0; k < sourceLength; k++) {
+    double weight;
+    if (filter == PINImageKernelsFilterArea) {
+      double from = fmax((double)k, i * scale);
+      double to = fmin((double)k + 1, (i + 1) * scale);
+      weight = to > from ? to - from : 0;
+    } else {
+      weight = S_lanczos3((k + 0.5 - (i + 0.5) * scale) / filterScale);
+    }
+    weights[k] = weight;
+    sum += weight;
+  }
+  for (size_t k = 0; k < sourceLength; k++) {
+    weights[k] /= sum;
+  }
+}
+
+static uint8_t S_round(double value) {
+  value = floor(value + 0.5);
+  return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// Horizontally into 8 bits, then vertically, as the resizer does.
+static void S_reference_resize(const PINImageKernelsBuffer *source, const PINImageKernelsBuffer *destination, PINImageKernelsFilter filter) {
+  size_t length = destination->width * 4;
+  uint8_t *middle = (uint8_t *)malloc(source->height * length);
+  double *weights = (double *)malloc((source->width > source->height ? source->width : source->height) * sizeof(double));
+  for (size_t x = 0; x < destination->width; x++) {
+    S_weights(weights, source->width, destination->width, x, filter);
+    for (size_t y = 0; y < source->height; y++) {
+      for (int c = 0; c < 4; c++) {
+        double sum = 0;
+        for (size_t k = 0; k < source->width; k++) {
+          sum += weights[k] * source->data[y * source->rowBytes + k * 4 + c];
+        }
+        middle[y * length + x * 4 + c] = S_round(sum);
+      }
+    }
+  }
+  for (size_t y = 0; y < destination->height; y++) {
+    S_weights(weights, source->height, destination->height, y, filter);
+    for (size_t i = 0; i < length; i++) {
+      double sum = 0;
+      for (size_t k = 0; k < source->height; k++) {
+        sum += weights[k] * middle[k * length + i];
+      }
+      destination->data[y * destination->rowBytes + i] = S_round(sum);
+    }
+  }
+  free(middle);
+  free(weights);
+}
+
+static void S_reference_box(const PINImageKernelsBuffer *buffer, uint32_t radius) {
+  size_t width = buffer->width, height = buffer->height, length = width * 4;
+  uint8_t *copy = (uint8_t *)malloc(height * length);
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t y = 0; y < height; y++) {
+      memcpy(copy + y * length, buffer->data + y * buffer->rowBytes, length);
+    }
+    for (size_t y = 0; y < height; y++) {
+      for (size_t x = 0; x < width; x++) {
+        for (int c = 0; c < 4; c++) {
+          double sum = 0;
+          for (long k = -(long)radius; k <= (long)radius; k++) {
+            long at = pass == 0 ? (long)x + k : (long)y + k;
+            long last = pass == 0 ? (long)width - 1 : (long)height - 1;
+            at = at < 0 ? 0 : (at > last ? last : at);
+            sum += pass == 0 ? copy[y * length + (size_t)at * 4 + c] : copy[(size_t)at * length + x * 4 + c];
+          }
+          buffer->data[y * buffer->rowBytes + x * 4 + c] = S_round(sum / (2 * radius + 1));
+        }
+      }
+    }
+  }
+  free(copy);
+}
+
+// MARK: - Checks
+
+typedef struct {
+  const char *name;
+  int failures;
+} checks;
+
+static void S_fail(checks *c, const char *what, size_t a, size_t b, size_t d, size_t e, int difference) {
+  if (c->failures++ < 10) {
+    fprintf(stderr, "%s: %s %zux%zu -> %zux%zu differs by %d\n", c->name, what, a, b, d, e, difference);
+  }
+}
+
+// Everything the ISA computes must equal what the scalar kernels compute.
+static int S_check_isa(PINImageKernelsISA isa, int cases) {
+  checks c = {S_isa_names[isa], 0};
+  for (int n = 0; n < cases; n++) {
+    size_t sourceWidth = 1 + S_random(n % 4 == 0 ? 300 : 40), sourceHeight = 1 + S_random(n % 4 == 1 ? 300 : 40);
+    size_t width = 1 + S_random(n % 2 ? 90 : (uint32_t)sourceWidth), height = 1 + S_random(n % 3 ? 90 : (uint32_t)sourceHeight);
+    PINImageKernelsBuffer source = S_make_photo(sourceWidth, sourceHeight, S_random(3) * 4 + S_random(4));
+    PINImageKernelsFilter filter = n % 2 ? PINImageKernelsFilterLanczos3 : PINImageKernelsFilterArea;
+    PINImageKernelsBuffer expected = S_make(width, height, S_random(9));
+    PINImageKernelsBuffer actual = S_make(width, height, S_random(9));
+
+    PINImageKernelsSetISA(PINImageKernelsISAScalar);
+    PINImageKernelsResize(&source, &expected, filter);
+    PINImageKernelsSetISA(isa);
+    if (!S_resize_banded(&source, &actual, filter)) {
+      S_fail(&c, "banded resize", sourceWidth, sourceHeight, width, height, -1);
+    }
+    int difference = S_difference(&expected, &actual);
+    if (difference != 0) {
+      S_fail(&c, filter == PINImageKernelsFilterArea ? "area resize" : "lanczos resize", sourceWidth, sourceHeight, width, height, difference);
+    }
+
+    uint32_t radius = n % 7 == 0 ? 128 + S_random(200) : S_random(40);
+    PINImageKernelsBuffer blurred = S_copy(&source);
+    PINImageKernelsSetISA(PINImageKernelsISAScalar);
+    PINImageKernelsBoxBlur(&source, radius);
+    PINImageKernelsSetISA(isa);
+    PINImageKernelsBoxBlur(&blurred, radius);
+    if ((difference = S_difference(&source, &blurred)) != 0) {
+      S_fail(&c, "box blur", sourceWidth, sourceHeight, radius, radius, difference);
+    }
+
+    memcpy(blurred.data, source.data, source.rowBytes * sourceHeight);
+    for (size_t y = 0; y < sourceHeight; y++) {
+      for (size_t i = 0; i < sourceWidth * 4; i += 4) {
+        source.data[y * source.rowBytes + i + 3] = (uint8_t)S_random(256);
+        blurred.data[y * blurred.rowBytes + i + 3] = source.data[y * source.rowBytes + i + 3];
+      }
+      PINImageKernelsSetISA(PINImageKernelsISAScalar);
+      PINImageKernelsPremultiply(source.data + y * source.rowBytes, sourceWidth);
+      PINImageKernelsSetISA(isa);
+      PINImageKernelsPremultiply(blurred.data + y * blurred.rowBytes, sourceWidth);
+    }
+    if ((difference = S_difference(&source, &blurred)) != 0) {
+      S_fail(&c, "premultiply", sourceWidth, sourceHeight, sourceWidth, sourceHeight, difference);
+    }
+    free(source.data);
+    free(expected.data);
+    free(actual.data);
+    free(blurred.data);
+  }
+  PINImageKernelsSetISA(PINImageKernelsISAScalar);
+  return c.failures;
+}
+
+static int S_check_accuracy(int cases, int *resizeError, int *boxError) {
+  checks c = {"accuracy", 0};
+  PINImageKernelsSetISA(PINImageKernelsISAScalar);
+  for (int n = 0; n < cases; n++) {
+    size_t sourceWidth = 1 + S_random(60), sourceHeight = 1 + S_random(60);
+    size_t width = 1 + S_random(n % 2 ? 60 : 20), height = 1 + S_random(n % 3 ? 60 : 20);
+    PINImageKernelsFilter filter = n % 2 ? PINImageKernelsFilterLanczos3 : PINImageKernelsFilterArea;
+    PINImageKernelsBuffer source = S_make_photo(sourceWidth, sourceHeight, 0);
+    PINImageKernelsBuffer expected = S_make(width, height, 0);
+    PINImageKernelsBuffer actual = S_make(width, height, 0);
+    S_reference_resize(&source, &expected, filter);
+    PINImageKernelsResize(&source, &actual, filter);
+    int difference = S_difference(&expected, &actual);
+    *resizeError = difference > *resizeError ? difference : *resizeError;
+    if (difference > 1) {
+      S_fail(&c, filter == PINImageKernelsFilterArea ? "area resize" : "lanczos resize", sourceWidth, sourceHeight, width, height, difference);
+    }
+
+    uint32_t radius = S_random(n % 5 == 0 ? 200 : 20);
+    PINImageKernelsBuffer blurred = S_copy(&source);
+    S_reference_box(&source, radius);
+    PINImageKernelsBoxBlur(&blurred, radius);
+    difference = S_difference(&source, &blurred);
+    *boxError = difference > *boxError ? difference : *boxError;
+    if (difference > 2) {
+      S_fail(&c, "box blur", sourceWidth, sourceHeight, radius, radius, difference);
+    }
+    free(source.data);
+    free(expected.data);
+    free(actual.data);
+    free(blurred.data);
+  }
+
+  uint8_t pixels[256 * 4];
+  for (uint32_t alpha = 0; alpha < 256; alpha++) {
+    for (uint32_t value = 0; value < 256; value++) {
+      memcpy(pixels + value * 4, (uint8_t[4]){(uint8_t)value, (uint8_t)value, (uint8_t)value, (uint8_t)alpha}, 4);
+    }
+    PINImageKernelsPremultiply(pixels, 256);
+    for (uint32_t value = 0; value < 256; value++) {
+      uint8_t expected = S_round(value * alpha / 255.0);
+      if (pixels[value * 4] != expected || pixels[value * 4 + 3] != alpha) {
+        S_fail(&c, "premultiply", value, alpha, pixels[value * 4], expected, -1);
+      }
+    }
+    // Every premultiplied color survives unpremultiplying and premultiplying again.
+    for (uint32_t value = 0; value <= alpha; value++) {
+      memcpy(pixels + value * 4, (uint8_t[4]){(uint8_t)value, (uint8_t)value, (uint8_t)value, (uint8_t)alpha}, 4);
+    }
+    PINImageKernelsUnpremultiply(pixels, alpha + 1);
+    for (uint32_t value = 0; value <= alpha; value++) {
+      uint8_t expected = alpha == 0 ? 0 : S_round(fmin(255, value * 255.0 / alpha));
+      if (pixels[value * 4] != expected) {
+        S_fail(&c, "unpremultiply", value, alpha, pixels[value * 4], expected, -1);
+      }
+    }
+    PINImageKernelsPremultiply(pixels, alpha + 1);
+    for (uint32_t value = 0; value <= alpha; value++) {
+      if (pixels[value * 4] != (alpha == 0 ? 0 : value)) {
+        S_fail(&c, "round trip", value, alpha, pixels[value * 4], value, -1);
+      }
+    }
+  }
+  return c.failures;
+}
+
+// MARK: - Benchmarks
+
+typedef enum {
+  S_area,
+  S_lanczos,
+  S_box,
+  S_gaussian,
+  S_premultiply,
+  S_kernel_count,
+} kernel;
+
+static const char *S_kernel_names[] = {"area_to_1536", "lanczos_to_256", "box_radius_8", "gaussian_sigma_4", "premultiply"};
+
+static PINImageKernelsBuffer S_fit(const PINImageKernelsBuffer *source, size_t longest) {
+  size_t width = source->width >= source->height ? longest : (source->width * longest + source->height / 2) / source->height;
+  size_t height = source->height > source->width ? longest : (source->height * longest + source->width / 2) / source->width;
+  return S_make(width, height, 0);
+}
+
+// Best of TRIALS, in megapixels of the source per second.
+static double S_time(kernel k, const PINImageKernelsBuffer *photo) {
+  double best = 1e30;
+  PINImageKernelsBuffer work = S_copy(photo);
+  PINImageKernelsBuffer destination = S_fit(photo, k == S_area ? 1536 : 256);
+  for (int trial = 0; trial < TRIALS; trial++) {
+    double start = S_now();
+    switch (k) {
+      case S_area:
+        PINImageKernelsResize(photo, &destination, PINImageKernelsFilterArea);
+        break;
+      case S_lanczos:
+        PINImageKernelsResize(photo, &destination, PINImageKernelsFilterLanczos3);
+        break;
+      case S_box:
+        PINImageKernelsBoxBlur(&work, 8);
+        break;
+      case S_gaussian:
+        PINImageKernelsGaussianBlur(&work, 4);
+        break;
+      default:
+        PINImageKernelsPremultiply(work.data, work.width * work.height);
+        break;
+    }
+    double elapsed = S_now() - start;
+    best = elapsed < best ? elapsed : best;
+  }
+  free(work.data);
+  free(destination.data);
+  return (double)photo->width * photo->height / best / 1e6;
+}
+
+int main(int argc, char **argv) {
+  int cases = 300;
+  size_t photoWidth = 4032, photoHeight = 3024;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      cases = 60;
+      photoWidth = 2048;
+      photoHeight = 1536;
+    }
+  }
+
+  PINImageKernelsISA best = PINImageKernelsGetISA();
+  for (PINImageKernelsISA isa = PINImageKernelsISASSE2; isa <= PINImageKernelsISANEON; isa++) {
+    if (PINImageKernelsISAIsSupported(isa) && S_check_isa(isa, cases) != 0) {
+      return 1;
+    }
+  }
+  int resizeError = 0, boxError = 0;
+  if (S_check_accuracy(cases / 2, &resizeError, &boxError) != 0) {
+    return 1;
+  }
+
+  PINImageKernelsBuffer photo = S_make_photo(photoWidth, photoHeight, 0);
+  PINImageKernelsBuffer downsampled = S_fit(&photo, 1536);
+  PINImageKernelsResizer *resizer = PINImageKernelsResizerCreate(photo.width, photo.height, &downsampled, PINImageKernelsFilterArea);
+  size_t scratch = PINImageKernelsResizerScratchBytes(resizer);
+  PINImageKernelsResizerDestroy(resizer);
+
+  printf("{\n  \"photo\": [%zu, %zu],\n  \"default_isa\": \"%s\",\n", photoWidth, photoHeight, S_isa_names[best]);
+  printf("  \"max_error\": {\"resize\": %d, \"box_blur\": %d},\n", resizeError, boxError);
+  printf("  \"downsample_memory\": {\"whole_image_bytes\": %zu, \"resizer_scratch_bytes\": %zu, \"destination_bytes\": %zu},\n",
+         photo.rowBytes * photo.height, scratch, downsampled.rowBytes * downsampled.height);
+  printf("  \"mpix_per_s\": {");
+  bool firstISA = true;
+  for (PINImageKernelsISA isa = PINImageKernelsISAScalar; isa <= PINImageKernelsISANEON; isa++) {
+    if (!PINImageKernelsISAIsSupported(isa)) {
+      continue;
+    }
+    PINImageKernelsSetISA(isa);
+    printf("%s\n    \"%s\": {", firstISA ? "" : ",", S_isa_names[isa]);
+    firstISA = false;
+    for (kernel k = 0; k < S_kernel_count; k++) {
+      printf("%s\"%s\": %.1f", k == 0 ? "" : ", ", S_kernel_names[k], S_time(k, &photo));
+    }
+    printf("}");
+  }
+  printf("\n  }\n}\n");
+  free(photo.data);
+  free(downsampled.data);
+  return 0;
+}
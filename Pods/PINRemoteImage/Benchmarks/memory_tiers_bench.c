@@ -0,0 +1,644 @@
+// Checks PINRemoteImageMemoryTiers and compares the memory cache it drives
+// with eager decoding, on a simulated scroll through a chat.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -o memory_tiers_bench
+//      memory_tiers_bench.c ../Source/Classes/PINRemoteImageMemoryTiers.c -lm
+//   ./memory_tiers_bench [--quick] > result.json
+//
+// First checks the policy directly, then runs random operations against a
+// model of it, checking after every call that the byte counts match, that
+// bitmaps off display fit the limit, and that exactly the least recently
+// used were dropped to make them fit. Exits with 1 on failure.
+//
+// Then scrolls a chat of photos, screenshots and generated images: reading,
+// scrolling, flinging and now and then scrolling back. Rows enter and leave
+// the preload and display ranges at Texture's default tuning. Compressed
+// bytes are read from disk when a row enters the preload range, and two
+// decoders work through a queue. Three memory caches are compared:
+//
+// - eager: what PINRemoteImageManager does without the tiers. Every image is
+//   decoded at full size once read and kept, with its bytes, until a memory
+//   warning.
+// - eager_lru: the same with the memory cache limited by cost, which evicts
+//   bytes and bitmap together, so coming back reads and decodes again.
+// - tiers: bytes kept for everything read, bitmaps decoded at the size they
+//   are drawn at when a row enters the display range, and kept by the
+//   policy.
+//
+// Reports peak and mean memory, how often and how long an image was blank
+// on screen, and the decoding time spent. Decoding costs are a rough model
+// of ImageIO on a phone, where downsampling while decoding skips most of a
+// JPEG's work but not a PNG's.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Source/Classes/PINRemoteImageMemoryTiers.h"
+
+#define TRIALS 3
+#define TICK 0.002
+#define SCREEN_HEIGHT 800.0
+#define DECODERS 2
+#define OFF_DISPLAY_LIMIT (16u << 20)
+#define EAGER_COST_LIMIT (64u << 20)
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int S_failures = 0;
+
+#define S_CHECK(condition, ...)                                \
+  do {                                                         \
+    if (!(condition)) {                                        \
+      if (S_failures++ < 10) {                                 \
+        fprintf(stderr, "%s:%d: ", __func__, __LINE__);        \
+        fprintf(stderr, __VA_ARGS__);                          \
+        fprintf(stderr, "\n");                                 \
+      }                                                        \
+    }                                                          \
+  } while (0)
+
+// MARK: - Checks
+
+#define KEY_COUNT 48
+
+typedef struct {
+  uint32_t dropped[KEY_COUNT * 2];
+  size_t count;
+} drops;
+
+static void S_key(char *buffer, size_t size, uint32_t key) {
+  snprintf(buffer, size, "https://oss-cn-hangzhou.aliyuncs.com/attachments/%u.jpg", key);
+}
+
+// Keys aren't terminated.
+static uint32_t S_key_index(const char *key, size_t keyLength) {
+  size_t start = keyLength;
+  while (start > 0 && key[start - 1] != '/') {
+    start--;
+  }
+  uint32_t index = 0;
+  for (size_t i = start; i < keyLength && key[i] >= '0' && key[i] <= '9'; i++) {
+    index = index * 10 + (uint32_t)(key[i] - '0');
+  }
+  return index;
+}
+
+static void S_record_drop(void *context, const char *key, size_t keyLength) {
+  drops *d = (drops *)context;
+  d->dropped[d->count++] = S_key_index(key, keyLength);
+}
+
+static void S_enter(PINRemoteImageMemoryTiers *tiers, uint32_t key) {
+  char buffer[96];
+  S_key(buffer, sizeof(buffer), key);
+  S_CHECK(PINRemoteImageMemoryTiersEnterDisplay(tiers, buffer, strlen(buffer)), "enter");
+}
+
+static void S_exit(PINRemoteImageMemoryTiers *tiers, uint32_t key, drops *d) {
+  char buffer[96];
+  S_key(buffer, sizeof(buffer), key);
+  PINRemoteImageMemoryTiersExitDisplay(tiers, buffer, strlen(buffer), S_record_drop, d);
+}
+
+static void S_set(PINRemoteImageMemoryTiers *tiers, uint32_t key, size_t bytes, drops *d) {
+  char buffer[96];
+  S_key(buffer, sizeof(buffer), key);
+  S_CHECK(PINRemoteImageMemoryTiersSetDecodedBytes(tiers, buffer, strlen(buffer), bytes, S_record_drop, d), "set");
+}
+
+static void S_touch(PINRemoteImageMemoryTiers *tiers, uint32_t key) {
+  char buffer[96];
+  S_key(buffer, sizeof(buffer), key);
+  PINRemoteImageMemoryTiersTouch(tiers, buffer, strlen(buffer));
+}
+
+static void S_check_basics(void) {
+  PINRemoteImageMemoryTiers *tiers = PINRemoteImageMemoryTiersCreate(100);
+  drops d = {{0}, 0};
+
+  // Off display, the least recently used go first.
+  S_set(tiers, 1, 60, &d);
+  S_set(tiers, 2, 30, &d);
+  S_touch(tiers, 1);
+  S_set(tiers, 3, 30, &d);
+  S_CHECK(d.count == 1 && d.dropped[0] == 2, "drops the least recently used");
+  S_CHECK(PINRemoteImageMemoryTiersDecodedBytes(tiers) == 90, "bytes %zu", PINRemoteImageMemoryTiersDecodedBytes(tiers));
+
+  // On display, bitmaps stay whatever their size, and count once however many show them.
+  d.count = 0;
+  S_enter(tiers, 4);
+  S_enter(tiers, 4);
+  S_set(tiers, 4, 500, &d);
+  S_CHECK(d.count == 0, "dropped for a bitmap on display");
+  S_CHECK(PINRemoteImageMemoryTiersOnDisplayBytes(tiers) == 500, "on display bytes");
+  S_exit(tiers, 4, &d);
+  S_CHECK(d.count == 0, "dropped while still shown");
+  S_exit(tiers, 4, &d);
+  S_CHECK(d.count == 3 && d.dropped[0] == 1 && d.dropped[1] == 3 && d.dropped[2] == 4, "older first, then what doesn't fit alone");
+  S_CHECK(PINRemoteImageMemoryTiersDecodedBytes(tiers) == 0 && PINRemoteImageMemoryTiersOnDisplayBytes(tiers) == 0, "all dropped");
+
+  // Entering display takes a bitmap out of reach of the limit; lowering the limit drops the rest.
+  d.count = 0;
+  S_set(tiers, 5, 50, &d);
+  S_set(tiers, 6, 50, &d);
+  S_enter(tiers, 5);
+  PINRemoteImageMemoryTiersSetByteLimit(tiers, 0, S_record_drop, &d);
+  S_CHECK(d.count == 1 && d.dropped[0] == 6, "limit drops only what's off display");
+  S_exit(tiers, 7, &d);
+  S_CHECK(d.count == 1, "exit without enter");
+  PINRemoteImageMemoryTiersDestroy(tiers);
+}
+
+typedef struct {
+  uint32_t displayCount;
+  size_t bytes;
+  uint64_t order;
+} model_key;
+
+static void S_check_random(int rounds) {
+  for (int round = 0; round < rounds; round++) {
+    size_t limit = S_random(4) == 0 ? 0 : S_random(400);
+    PINRemoteImageMemoryTiers *tiers = PINRemoteImageMemoryTiersCreate(limit);
+    model_key keys[KEY_COUNT] = {{0}};
+    uint64_t order = 0;
+    for (int step = 0; step < 3000; step++) {
+      uint32_t key = S_random(KEY_COUNT);
+      model_key *k = &keys[key];
+      drops d = {{0}, 0};
+      switch (S_random(6)) {
+        case 0:
+          S_enter(tiers, key);
+          k->displayCount++;
+          break;
+        case 1:
+          S_exit(tiers, key, &d);
+          if (k->displayCount > 0 && --k->displayCount == 0) {
+            k->order = ++order;
+          }
+          break;
+        case 2:
+        case 3: {
+          size_t bytes = S_random(3) == 0 ? 0 : S_random(120);
+          S_set(tiers, key, bytes, &d);
+          if (k->displayCount == 0 && bytes > 0) {
+            k->order = ++order;
+          }
+          k->bytes = bytes;
+          break;
+        }
+        case 4:
+          S_touch(tiers, key);
+          if (k->displayCount == 0 && k->bytes > 0) {
+            k->order = ++order;
+          }
+          break;
+        default:
+          limit = S_random(400);
+          PINRemoteImageMemoryTiersSetByteLimit(tiers, limit, S_record_drop, &d);
+          break;
+      }
+
+      // Drop in the model what the policy should have, and compare.
+      size_t expected = 0;
+      for (;;) {
+        size_t off = 0;
+        model_key *oldest = NULL;
+        for (uint32_t i = 0; i < KEY_COUNT; i++) {
+          if (keys[i].displayCount == 0 && keys[i].bytes > 0) {
+            off += keys[i].bytes;
+            oldest = (oldest == NULL || keys[i].order < oldest->order) ? &keys[i] : oldest;
+          }
+        }
+        if (off <= limit) {
+          break;
+        }
+        uint32_t index = (uint32_t)(oldest - keys);
+        S_CHECK(expected < d.count && d.dropped[expected] == index, "round %d step %d: expected %u dropped", round, step, index);
+        expected++;
+        oldest->bytes = 0;
+      }
+      S_CHECK(expected == d.count, "round %d step %d: dropped %zu, expected %zu", round, step, d.count, expected);
+
+      size_t total = 0, onDisplay = 0;
+      for (uint32_t i = 0; i < KEY_COUNT; i++) {
+        total += keys[i].bytes;
+        onDisplay += keys[i].displayCount > 0 ? keys[i].bytes : 0;
+        char buffer[96];
+        S_key(buffer, sizeof(buffer), i);
+        S_CHECK(PINRemoteImageMemoryTiersIsOnDisplay(tiers, buffer, strlen(buffer)) == (keys[i].displayCount > 0), "on display");
+      }
+      S_CHECK(total == PINRemoteImageMemoryTiersDecodedBytes(tiers), "bytes %zu, expected %zu", PINRemoteImageMemoryTiersDecodedBytes(tiers), total);
+      S_CHECK(onDisplay == PINRemoteImageMemoryTiersOnDisplayBytes(tiers), "on display bytes");
+      if (S_failures) {
+        break;
+      }
+    }
+    PINRemoteImageMemoryTiersDestroy(tiers);
+  }
+}
+
+// MARK: - Simulated scrolling
+
+typedef enum {
+  POLICY_EAGER,
+  POLICY_EAGER_LRU,
+  POLICY_TIERS,
+  POLICY_COUNT,
+} policy;
+
+static const char *S_policy_names[POLICY_COUNT] = {"eager", "eager_lru", "tiers"};
+
+typedef struct {
+  double top;
+  double height;
+  bool hasImage;
+  bool png;
+  double pixels;
+  double targetPixels;
+  double compressedBytes;
+
+  bool inPreload;
+  bool inDisplay;
+  bool visible;
+  // Bytes in the memory cache, or being read into it.
+  bool cached;
+  bool reading;
+  double readAt;
+  bool decodeQueued;
+  double decodedBytes;
+  // For eager_lru.
+  uint64_t lastUse;
+  // This time on screen.
+  bool blank;
+  double blankFor;
+} sim_row;
+
+typedef struct {
+  uint32_t row;
+  bool full;
+} sim_job;
+
+typedef struct {
+  sim_row *rows;
+  size_t count;
+  policy policy;
+  PINRemoteImageMemoryTiers *tiers;
+  sim_job *queue;
+  size_t queueHead;
+  size_t queueCount;
+  size_t queueCapacity;
+  sim_job running[DECODERS];
+  double busyUntil[DECODERS];
+  bool busy[DECODERS];
+  double compressedBytes;
+  double decodedBytes;
+  double decodeSeconds;
+  uint64_t uses;
+} sim;
+
+typedef struct {
+  const char *name;
+  double peakMegabytes;
+  double meanMegabytes;
+  size_t blankShows;
+  size_t shows;
+  double blankSeconds;
+  double p95Blank;
+  double maxBlank;
+  double decodeSeconds;
+} sim_result;
+
+static void S_drop_bitmap(void *context, const char *key, size_t keyLength) {
+  sim *s = (sim *)context;
+  sim_row *row = &s->rows[S_key_index(key, keyLength)];
+  s->decodedBytes -= row->decodedBytes;
+  row->decodedBytes = 0;
+}
+
+static double S_decode_cost(const sim_row *row, bool full) {
+  double cost = 0.001 + (row->png || full ? row->pixels * 6e-9 : row->pixels * 1.5e-9);
+  return full ? cost : cost + row->targetPixels * 4e-9;
+}
+
+static void S_enqueue(sim *s, uint32_t index, bool full) {
+  if (s->queueCount == s->queueCapacity) {
+    size_t capacity = s->queueCapacity ? s->queueCapacity * 2 : 64;
+    sim_job *queue = (sim_job *)malloc(capacity * sizeof(sim_job));
+    for (size_t i = 0; i < s->queueCount; i++) {
+      queue[i] = s->queue[(s->queueHead + i) % s->queueCapacity];
+    }
+    free(s->queue);
+    s->queue = queue;
+    s->queueHead = 0;
+    s->queueCapacity = capacity;
+  }
+  s->queue[(s->queueHead + s->queueCount++) % s->queueCapacity] = (sim_job){index, full};
+  s->rows[index].decodeQueued = true;
+}
+
+static void S_key_for_row(char *buffer, size_t size, uint32_t row) {
+  S_key(buffer, size, row);
+}
+
+static void S_evict_lru(sim *s) {
+  while (s->compressedBytes + s->decodedBytes > EAGER_COST_LIMIT) {
+    sim_row *victim = NULL;
+    for (size_t i = 0; i < s->count; i++) {
+      sim_row *row = &s->rows[i];
+      // Nodes in the preload range hold their images, so evicting them frees nothing.
+      if (row->cached && !row->reading && !row->decodeQueued && !row->inPreload && (victim == NULL || row->lastUse < victim->lastUse)) {
+        victim = row;
+      }
+    }
+    if (victim == NULL) {
+      return;
+    }
+    s->compressedBytes -= victim->compressedBytes;
+    s->decodedBytes -= victim->decodedBytes;
+    victim->cached = false;
+    victim->decodedBytes = 0;
+  }
+}
+
+static void S_finish_decode(sim *s, sim_job job) {
+  sim_row *row = &s->rows[job.row];
+  row->decodeQueued = false;
+  if (job.full) {
+    row->decodedBytes = row->pixels * 4;
+    s->decodedBytes += row->decodedBytes;
+    if (s->policy == POLICY_EAGER_LRU) {
+      row->lastUse = ++s->uses;
+      S_evict_lru(s);
+    }
+    return;
+  }
+  char key[96];
+  S_key_for_row(key, sizeof(key), job.row);
+  if (!PINRemoteImageMemoryTiersIsOnDisplay(s->tiers, key, strlen(key))) {
+    // Scrolled away while decoding: the bitmap isn't kept.
+    return;
+  }
+  row->decodedBytes = row->targetPixels * 4;
+  s->decodedBytes += row->decodedBytes;
+  PINRemoteImageMemoryTiersSetDecodedBytes(s->tiers, key, strlen(key), (size_t)row->decodedBytes, S_drop_bitmap, s);
+}
+
+static void S_run_decoders(sim *s, double now) {
+  for (int d = 0; d < DECODERS; d++) {
+    if (s->busy[d] && now >= s->busyUntil[d]) {
+      s->busy[d] = false;
+      S_finish_decode(s, s->running[d]);
+    }
+    while (!s->busy[d] && s->queueCount > 0) {
+      sim_job job = s->queue[s->queueHead];
+      s->queueHead = (s->queueHead + 1) % s->queueCapacity;
+      s->queueCount--;
+      sim_row *row = &s->rows[job.row];
+      if (!job.full && !row->inDisplay) {
+        // Cancelled before it started, as a PINOperation would be.
+        row->decodeQueued = false;
+        continue;
+      }
+      double cost = S_decode_cost(row, job.full);
+      s->decodeSeconds += cost;
+      s->running[d] = job;
+      s->busy[d] = true;
+      s->busyUntil[d] = now + cost;
+    }
+  }
+}
+
+static void S_request_display_decode(sim *s, uint32_t index) {
+  sim_row *row = &s->rows[index];
+  if (row->inDisplay && row->cached && !row->reading && row->decodedBytes == 0 && !row->decodeQueued) {
+    S_enqueue(s, index, false);
+  }
+}
+
+static int S_compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static sim_result S_simulate(policy p, size_t messageCount, double duration, uint64_t seed) {
+  S_state = seed;
+  sim s = {0};
+  s.policy = p;
+  s.count = messageCount;
+  s.rows = (sim_row *)calloc(messageCount, sizeof(sim_row));
+  s.tiers = PINRemoteImageMemoryTiersCreate(OFF_DISPLAY_LIMIT);
+
+  double contentHeight = 0;
+  for (size_t i = 0; i < messageCount; i++) {
+    sim_row *row = &s.rows[i];
+    row->top = contentHeight;
+    row->hasImage = S_random(100) < 55;
+    if (row->hasImage) {
+      uint32_t kind = S_random(10);
+      double width, height, bytesPerPixel;
+      if (kind < 4) {
+        width = 4032, height = 3024, bytesPerPixel = 0.25, row->png = false;
+      } else if (kind < 7) {
+        width = 1170, height = 2532, bytesPerPixel = 0.5, row->png = true;
+      } else {
+        width = 1024, height = 1024, bytesPerPixel = 1.2, row->png = true;
+      }
+      row->pixels = width * height;
+      row->compressedBytes = row->pixels * bytesPerPixel * (0.7 + 0.6 * S_random(1000) / 1000.0);
+      // Drawn within 240x260 points at 3x.
+      double scale = fmin(720.0 / width, 780.0 / height);
+      row->targetPixels = (width * scale) * (height * scale);
+      row->height = 260 + 16;
+    } else {
+      row->height = 60 + S_random(240);
+    }
+    contentHeight += row->height;
+  }
+
+  size_t showCapacity = 4096, showCount = 0;
+  double *blanks = (double *)malloc(showCapacity * sizeof(double));
+  size_t shows = 0, blankShows = 0;
+  double blankSeconds = 0, peak = 0, memorySum = 0;
+  size_t memorySamples = 0;
+
+  // Reads through the chat one way, then turns around at the end.
+  double top = 0, velocity = 0, direction = 1, heading = 1, phaseEnds = 0;
+  for (double now = 0; now < duration; now += TICK) {
+    if (now >= phaseEnds) {
+      uint32_t phase = S_random(10);
+      // Reading, scrolling, flinging, and scrolling back to look at something again.
+      velocity = phase < 3 ? 0 : (phase < 6 ? 150 + S_random(400) : (phase < 8 ? 2500 + S_random(3500) : -(300.0 + S_random(2000))));
+      velocity *= heading;
+      phaseEnds = now + (phase == 6 || phase == 7 ? 0.5 : 1 + S_random(3));
+    }
+    top += velocity * TICK;
+    if (top <= 0 || top >= contentHeight - SCREEN_HEIGHT) {
+      top = fmax(0, fmin(top, contentHeight - SCREEN_HEIGHT));
+      heading = top <= 0 ? 1 : -1;
+      phaseEnds = now;
+    }
+    direction = velocity > 0 ? 1 : (velocity < 0 ? -1 : direction);
+
+    // Texture's default tuning, in screens ahead and behind.
+    double ahead = direction > 0 ? 1 : 0, behind = 1 - ahead;
+    double displayTop = top - SCREEN_HEIGHT * (1.0 * behind + 0.5 * ahead), displayBottom = top + SCREEN_HEIGHT * (1 + 1.0 * ahead + 0.5 * behind);
+    double preloadTop = top - SCREEN_HEIGHT * (2.5 * behind + 1.5 * ahead), preloadBottom = top + SCREEN_HEIGHT * (1 + 2.5 * ahead + 1.5 * behind);
+
+    for (uint32_t i = 0; i < messageCount; i++) {
+      sim_row *row = &s.rows[i];
+      if (!row->hasImage) {
+        continue;
+      }
+      double bottom = row->top + row->height;
+      bool inPreload = bottom > preloadTop && row->top < preloadBottom;
+      bool inDisplay = bottom > displayTop && row->top < displayBottom;
+      bool visible = bottom > top && row->top < top + SCREEN_HEIGHT;
+
+      if (inPreload && !row->inPreload && !row->cached) {
+        row->cached = true;
+        row->reading = true;
+        row->readAt = now + 0.004 + row->compressedBytes / 300e6;
+        s.compressedBytes += row->compressedBytes;
+      }
+      if (row->reading && now >= row->readAt) {
+        row->reading = false;
+        if (p != POLICY_TIERS) {
+          S_enqueue(&s, i, true);
+        }
+      }
+      if (inPreload && p == POLICY_EAGER_LRU) {
+        row->lastUse = ++s.uses;
+      }
+      row->inPreload = inPreload;
+
+      if (p == POLICY_TIERS && inDisplay != row->inDisplay) {
+        char key[96];
+        S_key_for_row(key, sizeof(key), i);
+        if (inDisplay) {
+          PINRemoteImageMemoryTiersEnterDisplay(s.tiers, key, strlen(key));
+        } else {
+          PINRemoteImageMemoryTiersExitDisplay(s.tiers, key, strlen(key), S_drop_bitmap, &s);
+        }
+      }
+      row->inDisplay = inDisplay;
+      if (p == POLICY_TIERS) {
+        S_request_display_decode(&s, i);
+      }
+
+      if (visible && !row->visible) {
+        shows++;
+        row->blank = row->decodedBytes == 0;
+        row->blankFor = 0;
+      }
+      if (visible && row->decodedBytes == 0) {
+        row->blankFor += TICK;
+        blankSeconds += TICK;
+      }
+      if (row->visible && !visible && row->blank) {
+        blankShows++;
+        if (showCount == showCapacity) {
+          showCapacity *= 2;
+          blanks = (double *)realloc(blanks, showCapacity * sizeof(double));
+        }
+        blanks[showCount++] = row->blankFor;
+      }
+      row->visible = visible;
+    }
+
+    S_run_decoders(&s, now);
+    double memory = s.compressedBytes + s.decodedBytes;
+    peak = fmax(peak, memory);
+    memorySum += memory;
+    memorySamples++;
+  }
+
+  qsort(blanks, showCount, sizeof(double), S_compare_doubles);
+  sim_result result = {
+    S_policy_names[p],
+    peak / (1 << 20),
+    memorySum / memorySamples / (1 << 20),
+    blankShows,
+    shows,
+    blankSeconds,
+    showCount ? blanks[(size_t)(showCount * 0.95)] : 0,
+    showCount ? blanks[showCount - 1] : 0,
+    s.decodeSeconds,
+  };
+  free(blanks);
+  free(s.queue);
+  free(s.rows);
+  PINRemoteImageMemoryTiersDestroy(s.tiers);
+  return result;
+}
+
+// MARK: - Cost
+
+static double S_time_policy(void) {
+  PINRemoteImageMemoryTiers *tiers = PINRemoteImageMemoryTiersCreate(OFF_DISPLAY_LIMIT);
+  drops d = {{0}, 0};
+  const int operations = 400000;
+  double start = S_now();
+  for (int i = 0; i < operations / 4; i++) {
+    uint32_t key = S_random(KEY_COUNT);
+    d.count = 0;
+    S_enter(tiers, key);
+    S_set(tiers, key, 1 << 20, &d);
+    S_touch(tiers, S_random(KEY_COUNT));
+    S_exit(tiers, key, &d);
+  }
+  double elapsed = S_now() - start;
+  PINRemoteImageMemoryTiersDestroy(tiers);
+  return elapsed / operations * 1e9;
+}
+
+int main(int argc, char **argv) {
+  size_t messageCount = 600;
+  double duration = 120;
+  int rounds = 200;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      messageCount = 200;
+      duration = 30;
+      rounds = 30;
+    }
+  }
+
+  S_check_basics();
+  S_check_random(rounds);
+  if (S_failures) {
+    return 1;
+  }
+
+  printf("{\n  \"messages\": %zu,\n  \"seconds\": %.0f,\n  \"off_display_limit_mb\": %u,\n  \"eager_cost_limit_mb\": %u,\n  \"sessions\": [",
+         messageCount, duration, OFF_DISPLAY_LIMIT >> 20, EAGER_COST_LIMIT >> 20);
+  for (int trial = 0; trial < TRIALS; trial++) {
+    printf("%s\n    {\"seed\": %d, \"policies\": [", trial ? "," : "", trial);
+    for (int p = 0; p < POLICY_COUNT; p++) {
+      sim_result r = S_simulate((policy)p, messageCount, duration, 0x5EED0000ull + (uint64_t)trial);
+      printf("%s\n      {\"policy\": \"%s\", \"peak_mb\": %.1f, \"mean_mb\": %.1f, \"blank_shows\": %zu, \"shows\": %zu, "
+             "\"blank_s\": %.2f, \"blank_p95_s\": %.3f, \"blank_max_s\": %.3f, \"decode_s\": %.2f}",
+             p ? "," : "", r.name, r.peakMegabytes, r.meanMegabytes, r.blankShows, r.shows, r.blankSeconds, r.p95Blank, r.maxBlank, r.decodeSeconds);
+    }
+    printf("\n    ]}");
+  }
+  printf("\n  ],\n  \"ns_per_operation\": %.1f\n}\n", S_time_policy());
+  return 0;
+}
@@ -0,0 +1,731 @@
+// Checks, fuzzing and throughput of PINProgressiveImageScanner, which
+// PINProgressiveImage follows downloading images with.
+//
+// Build and run from this directory:
+//
+//   cc -O2 -DNDEBUG -o progressive_image_scanner_bench
+//      progressive_image_scanner_bench.c ../Source/Classes/PINProgressiveImageScanner.c
+//   ./progressive_image_scanner_bench [--quick] [image ...] > result.json
+//
+// First builds JPEGs (progressive and baseline, with restarts, fill bytes,
+// a DNL and an EXIF thumbnail whose SOS must not count), interlaced and
+// plain PNGs and GIFs, knowing where their dimensions and scans end. Fed a
+// byte at a time, the scanner must know the dimensions from exactly the
+// byte they end on, and complete each scan on exactly the byte that shows
+// it ended, at the right offset. Fed in random chunks, it must end up as it
+// does fed all at once. Any images given, such as the app's assets, are
+// fed truncated and in random chunks the same way.
+//
+// Then fuzzes: the built images with bytes flipped, inserted, removed and
+// cut off, and random bytes after each signature, must scan the same in
+// chunks as all at once without reading out of bounds (build with
+// -fsanitize=address,undefined to check), and keep its counts consistent.
+// Exits with 1 on failure.
+//
+// Last, times scanning 8 MB images arriving in 4 KB and 64 KB chunks,
+// against copying the chunks into a buffer as the download does anyway, and
+// against searching each chunk for FF DA as PINProgressiveImage did.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../Source/Classes/PINProgressiveImageScanner.h"
+
+#define TRIALS 3
+#define MAX_SCANS 64
+
+static double S_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t S_random(uint32_t bound) {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (uint32_t)((S_state >> 33) % bound);
+}
+
+// MARK: - Building images
+
+typedef struct {
+  uint8_t *bytes;
+  size_t length;
+  size_t capacity;
+} buffer;
+
+static void S_put(buffer *b, const void *bytes, size_t length) {
+  if (b->length + length > b->capacity) {
+    b->capacity = (b->length + length) * 2;
+    b->bytes = (uint8_t *)realloc(b->bytes, b->capacity);
+  }
+  memcpy(b->bytes + b->length, bytes, length);
+  b->length += length;
+}
+
+static void S_put8(buffer *b, uint8_t value) {
+  S_put(b, &value, 1);
+}
+
+static void S_put16(buffer *b, uint16_t value) {
+  S_put8(b, (uint8_t)(value >> 8));
+  S_put8(b, (uint8_t)value);
+}
+
+static void S_put16le(buffer *b, uint16_t value) {
+  S_put8(b, (uint8_t)value);
+  S_put8(b, (uint8_t)(value >> 8));
+}
+
+static void S_put32(buffer *b, uint32_t value) {
+  S_put16(b, (uint16_t)(value >> 16));
+  S_put16(b, (uint16_t)value);
+}
+
+static void S_put_random(buffer *b, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    S_put8(b, (uint8_t)S_random(256));
+  }
+}
+
+// What scanning an image must find, and from which byte on.
+typedef struct {
+  const char *name;
+  buffer data;
+  PINProgressiveImageScannerFormat format;
+  uint32_t width;
+  uint32_t height;
+  bool progressive;
+  // Prefix length from which both dimensions are known.
+  size_t sizeAt;
+  int scanCount;
+  size_t scanEnd[MAX_SCANS];
+  // Prefix length from which each scan is complete.
+  size_t scanCompleteAt[MAX_SCANS];
+} image;
+
+static void S_jpeg_segment(buffer *b, uint8_t marker, size_t payloadLength) {
+  S_put8(b, 0xFF);
+  S_put8(b, marker);
+  S_put16(b, (uint16_t)(payloadLength + 2));
+  S_put_random(b, payloadLength);
+}
+
+// Entropy-coded data: random, with every 0xFF stuffed, and restarts every `restartInterval` bytes.
+static void S_jpeg_entropy(buffer *b, size_t length, size_t restartInterval) {
+  int restart = 0;
+  for (size_t i = 0; i < length; i++) {
+    uint8_t byte = (uint8_t)S_random(256);
+    // Plenty of 0xFF, which is what makes scanning entropy-coded data slow.
+    if (S_random(16) == 0) {
+      byte = 0xFF;
+    }
+    S_put8(b, byte);
+    if (byte == 0xFF) {
+      S_put8(b, 0x00);
+    }
+    if (restartInterval > 0 && i % restartInterval == restartInterval - 1 && i + 1 < length) {
+      S_put8(b, 0xFF);
+      S_put8(b, (uint8_t)(0xD0 + restart));
+      restart = (restart + 1) % 8;
+    }
+  }
+}
+
+typedef struct {
+  bool progressive;
+  int scans;
+  size_t scanLength;
+  size_t restartInterval;
+  bool thumbnail;
+  bool fill;
+  bool dnl;
+} jpeg_options;
+
+static void S_make_jpeg(image *img, const char *name, uint16_t width, uint16_t height, jpeg_options options) {
+  memset(img, 0, sizeof(*img));
+  img->name = name;
+  img->format = PINProgressiveImageScannerFormatJPEG;
+  img->width = width;
+  img->height = height;
+  img->progressive = options.progressive;
+  buffer *b = &img->data;
+  S_put8(b, 0xFF);
+  S_put8(b, 0xD8);
+  // JFIF
+  S_put8(b, 0xFF);
+  S_put8(b, 0xE0);
+  S_put16(b, 16);
+  S_put(b, "JFIF\0\1\1\0\0\1\0\1\0\0", 14);
+  if (options.thumbnail) {
+    // EXIF with a thumbnail, whose SOF and SOS only a naive search sees.
+    buffer thumbnail = {0};
+    S_put8(&thumbnail, 0xFF);
+    S_put8(&thumbnail, 0xD8);
+    S_put8(&thumbnail, 0xFF);
+    S_put8(&thumbnail, 0xC0);
+    S_put16(&thumbnail, 17);
+    S_put8(&thumbnail, 8);
+    S_put16(&thumbnail, 12);
+    S_put16(&thumbnail, 34);
+    S_put_random(&thumbnail, 10);
+    for (int i = 0; i < 2; i++) {
+      S_put8(&thumbnail, 0xFF);
+      S_put8(&thumbnail, 0xDA);
+      S_put16(&thumbnail, 8);
+      S_put_random(&thumbnail, 6);
+      S_jpeg_entropy(&thumbnail, 200, 0);
+    }
+    S_put8(&thumbnail, 0xFF);
+    S_put8(&thumbnail, 0xD9);
+    S_put8(b, 0xFF);
+    S_put8(b, 0xE1);
+    S_put16(b, (uint16_t)(thumbnail.length + 2 + 6));
+    S_put(b, "Exif\0\0", 6);
+    S_put(b, thumbnail.bytes, thumbnail.length);
+    free(thumbnail.bytes);
+  }
+  S_jpeg_segment(b, 0xDB, 65);
+  // SOF: precision, height, width, then three components.
+  S_put8(b, 0xFF);
+  S_put8(b, options.progressive ? 0xC2 : 0xC0);
+  S_put16(b, 17);
+  S_put8(b, 8);
+  S_put16(b, options.dnl ? 0 : height);
+  S_put16(b, width);
+  if (!options.dnl) {
+    img->sizeAt = b->length;
+  }
+  S_put_random(b, 10);
+  if (options.restartInterval > 0) {
+    S_put8(b, 0xFF);
+    S_put8(b, 0xDD);
+    S_put16(b, 4);
+    S_put16(b, (uint16_t)options.restartInterval);
+  }
+  S_jpeg_segment(b, 0xC4, 30);
+  for (int scan = 0; scan < options.scans; scan++) {
+    if (scan > 0 && options.progressive && scan % 2 == 0) {
+      S_jpeg_segment(b, 0xC4, 20);
+    }
+    S_put8(b, 0xFF);
+    S_put8(b, 0xDA);
+    S_put16(b, 12);
+    S_put_random(b, 10);
+    img->scanCount++;
+    S_jpeg_entropy(b, options.scanLength, options.restartInterval);
+    img->scanEnd[scan] = b->length;
+    if (options.fill) {
+      S_put8(b, 0xFF);
+      S_put8(b, 0xFF);
+    }
+    if (options.dnl && scan == 0) {
+      S_put8(b, 0xFF);
+      S_put8(b, 0xDC);
+      img->scanCompleteAt[scan] = b->length;
+      S_put16(b, 4);
+      S_put16(b, height);
+      img->sizeAt = b->length;
+    } else if (scan + 1 == options.scans) {
+      S_put8(b, 0xFF);
+      S_put8(b, 0xD9);
+      img->scanCompleteAt[scan] = b->length;
+    } else {
+      // The marker following, up to its code, shows the scan ended.
+      img->scanCompleteAt[scan] = b->length + 2;
+    }
+  }
+  if (options.dnl) {
+    S_put8(b, 0xFF);
+    S_put8(b, 0xD9);
+  }
+}
+
+static void S_png_chunk(buffer *b, const char *type, const uint8_t *data, size_t length) {
+  S_put32(b, (uint32_t)length);
+  S_put(b, type, 4);
+  if (data != NULL) {
+    S_put(b, data, length);
+  } else {
+    S_put_random(b, length);
+  }
+  // The scanner leaves CRCs to the decoder.
+  S_put32(b, (uint32_t)S_random(UINT32_MAX));
+}
+
+static void S_make_png(image *img, const char *name, uint32_t width, uint32_t height, bool interlaced, int idatCount, size_t idatLength) {
+  memset(img, 0, sizeof(*img));
+  img->name = name;
+  img->format = PINProgressiveImageScannerFormatPNG;
+  img->width = width;
+  img->height = height;
+  img->progressive = interlaced;
+  buffer *b = &img->data;
+  S_put(b, "\x89PNG\r\n\x1a\n", 8);
+  uint8_t header[13] = {
+    (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+    (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+    8, 6, 0, 0, interlaced ? 1 : 0,
+  };
+  S_png_chunk(b, "IHDR", header, sizeof(header));
+  img->sizeAt = 8 + 8 + 13;
+  S_png_chunk(b, "tEXt", (const uint8_t *)"Comment\0\xff\xda\xff\xda", 12);
+  for (int i = 0; i < idatCount; i++) {
+    S_png_chunk(b, "IDAT", NULL, idatLength);
+    img->scanEnd[i] = b->length;
+    img->scanCompleteAt[i] = b->length;
+    img->scanCount++;
+  }
+  S_png_chunk(b, "IEND", NULL, 0);
+}
+
+static void S_gif_sub_blocks(buffer *b, size_t length) {
+  while (length > 0) {
+    size_t block = 1 + S_random(255);
+    block = block > length ? length : block;
+    S_put8(b, (uint8_t)block);
+    S_put_random(b, block);
+    length -= block;
+  }
+  S_put8(b, 0);
+}
+
+static void S_make_gif(image *img, const char *name, uint16_t width, uint16_t height, bool interlaced, int frames, size_t frameLength) {
+  memset(img, 0, sizeof(*img));
+  img->name = name;
+  img->format = PINProgressiveImageScannerFormatGIF;
+  img->width = width;
+  img->height = height;
+  img->progressive = interlaced;
+  buffer *b = &img->data;
+  S_put(b, "GIF89a", 6);
+  S_put16le(b, width);
+  S_put16le(b, height);
+  // A global color table of 256 entries.
+  S_put8(b, 0xF7);
+  S_put8(b, 0);
+  S_put8(b, 0);
+  // The logical screen descriptor is read whole.
+  img->sizeAt = b->length;
+  S_put_random(b, 768);
+  // Looping, then a graphic control extension before each frame.
+  S_put8(b, 0x21);
+  S_put8(b, 0xFF);
+  S_put8(b, 11);
+  S_put(b, "NETSCAPE2.0", 11);
+  S_put8(b, 3);
+  S_put8(b, 1);
+  S_put16le(b, 0);
+  S_put8(b, 0);
+  for (int i = 0; i < frames; i++) {
+    S_put8(b, 0x21);
+    S_put8(b, 0xF9);
+    S_put8(b, 4);
+    S_put_random(b, 4);
+    S_put8(b, 0);
+    S_put8(b, 0x2C);
+    S_put16le(b, 0);
+    S_put16le(b, 0);
+    S_put16le(b, width);
+    S_put16le(b, height);
+    // The second frame has a local color table of 4 entries.
+    uint8_t packed = (uint8_t)((i == 0 && interlaced ? 0x40 : 0) | (i == 1 ? 0x81 : 0));
+    S_put8(b, packed);
+    if (i == 1) {
+      S_put_random(b, 12);
+    }
+    S_put8(b, 8);
+    S_gif_sub_blocks(b, frameLength);
+    img->scanEnd[i] = b->length;
+    img->scanCompleteAt[i] = b->length;
+    img->scanCount++;
+  }
+  S_put8(b, 0x3B);
+}
+
+// MARK: - Checks
+
+static void S_scan_all(PINProgressiveImageScanner *scanner, const uint8_t *bytes, size_t length) {
+  PINProgressiveImageScannerInit(scanner);
+  PINProgressiveImageScannerScan(scanner, bytes, length);
+}
+
+static void S_scan_chunked(PINProgressiveImageScanner *scanner, const uint8_t *bytes, size_t length, uint32_t maxChunk) {
+  PINProgressiveImageScannerInit(scanner);
+  size_t offset = 0;
+  while (offset < length) {
+    size_t chunk = 1 + S_random(maxChunk);
+    chunk = chunk > length - offset ? length - offset : chunk;
+    // Empty chunks arrive too.
+    if (S_random(8) == 0) {
+      PINProgressiveImageScannerScan(scanner, bytes + offset, 0);
+    }
+    PINProgressiveImageScannerScan(scanner, bytes + offset, chunk);
+    offset += chunk;
+  }
+}
+
+static bool S_same(const PINProgressiveImageScanner *a, const PINProgressiveImageScanner *b) {
+  return a->format == b->format && a->status == b->status && a->width == b->width && a->height == b->height
+      && a->progressive == b->progressive && a->scanCount == b->scanCount
+      && a->completedScanCount == b->completedScanCount && a->completedScanEnd == b->completedScanEnd
+      && a->scannedLength == b->scannedLength && a->state == b->state && a->remaining == b->remaining;
+}
+
+static bool S_consistent(const PINProgressiveImageScanner *s, size_t length) {
+  if (s->completedScanCount > s->scanCount || s->completedScanEnd > s->scannedLength || s->scannedLength > length) {
+    return false;
+  }
+  if (s->status == PINProgressiveImageScannerStatusScanning && s->scannedLength != length) {
+    return false;
+  }
+  return s->completedScanCount > 0 || s->completedScanEnd == 0;
+}
+
+static bool S_check_image(const image *img, int chunkings) {
+  const uint8_t *bytes = img->data.bytes;
+  size_t length = img->data.length;
+  PINProgressiveImageScanner scanner;
+  PINProgressiveImageScannerInit(&scanner);
+  for (size_t n = 1; n <= length; n++) {
+    PINProgressiveImageScannerScan(&scanner, bytes + n - 1, 1);
+    bool sized = scanner.width > 0 && scanner.height > 0;
+    if (sized != (n >= img->sizeAt) || (sized && (scanner.width != img->width || scanner.height != img->height))) {
+      fprintf(stderr, "%s: size %ux%u after %zu bytes, expected %ux%u from %zu\n", img->name, scanner.width,
+              scanner.height, n, img->width, img->height, img->sizeAt);
+      return false;
+    }
+    int completed = 0;
+    while (completed < img->scanCount && img->scanCompleteAt[completed] <= n) {
+      completed++;
+    }
+    size_t end = completed > 0 ? img->scanEnd[completed - 1] : 0;
+    if ((int)scanner.completedScanCount != completed || scanner.completedScanEnd != end) {
+      fprintf(stderr, "%s: %u scans complete, ending at %llu, after %zu bytes; expected %d, ending at %zu\n",
+              img->name, scanner.completedScanCount, (unsigned long long)scanner.completedScanEnd, n, completed, end);
+      return false;
+    }
+    bool finished = scanner.status == PINProgressiveImageScannerStatusFinished;
+    if (finished != (n == length) || (!finished && scanner.status != PINProgressiveImageScannerStatusScanning)) {
+      fprintf(stderr, "%s: status %d after %zu of %zu bytes\n", img->name, (int)scanner.status, n, length);
+      return false;
+    }
+  }
+  if (scanner.format != img->format || scanner.progressive != img->progressive
+      || (int)scanner.scanCount != img->scanCount || scanner.scannedLength != length) {
+    fprintf(stderr, "%s: format %d, progressive %d, %u scans, %llu bytes scanned\n", img->name, (int)scanner.format,
+            scanner.progressive, scanner.scanCount, (unsigned long long)scanner.scannedLength);
+    return false;
+  }
+
+  PINProgressiveImageScanner whole;
+  S_scan_all(&whole, bytes, length);
+  if (!S_same(&whole, &scanner)) {
+    fprintf(stderr, "%s: scanned all at once differs from a byte at a time\n", img->name);
+    return false;
+  }
+  for (int i = 0; i < chunkings; i++) {
+    PINProgressiveImageScanner chunked;
+    S_scan_chunked(&chunked, bytes, length, i % 2 == 0 ? 16 : 4096);
+    if (!S_same(&whole, &chunked)) {
+      fprintf(stderr, "%s: scanned in chunks differs from all at once\n", img->name);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Truncated anywhere and fed in chunks, a file must scan as its prefix does
+// all at once, and what's known must only grow.
+static bool S_check_truncated(const char *name, const uint8_t *bytes, size_t length, int truncations) {
+  PINProgressiveImageScanner whole;
+  S_scan_all(&whole, bytes, length);
+  for (int i = 0; i < truncations; i++) {
+    size_t cut = i == 0 ? length : S_random((uint32_t)length + 1);
+    PINProgressiveImageScanner prefix;
+    S_scan_all(&prefix, bytes, cut);
+    PINProgressiveImageScanner chunked;
+    S_scan_chunked(&chunked, bytes, cut, i % 2 == 0 ? 64 : 8192);
+    if (!S_same(&prefix, &chunked) || !S_consistent(&chunked, cut)) {
+      fprintf(stderr, "%s: cut at %zu, scanned in chunks differs from all at once\n", name, cut);
+      return false;
+    }
+    if (whole.status != PINProgressiveImageScannerStatusInvalid && prefix.status != PINProgressiveImageScannerStatusInvalid) {
+      if (prefix.completedScanCount > whole.completedScanCount
+          || (prefix.width != 0 && prefix.width != whole.width) || (prefix.height != 0 && prefix.height != whole.height)) {
+        fprintf(stderr, "%s: cut at %zu, knows what the whole file doesn't\n", name, cut);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void S_mutate(buffer *out, const buffer *in) {
+  out->length = 0;
+  S_put(out, in->bytes, in->length);
+  int mutations = 1 + (int)S_random(8);
+  for (int m = 0; m < mutations && out->length > 0; m++) {
+    size_t at = S_random((uint32_t)out->length);
+    switch (S_random(6)) {
+      case 0:
+        out->bytes[at] ^= (uint8_t)(1 << S_random(8));
+        break;
+      case 1:
+        out->bytes[at] = (uint8_t)S_random(256);
+        break;
+      case 2: {
+        // Marker-like bytes are the interesting ones.
+        static const uint8_t interesting[] = {0x00, 0xFF, 0xD8, 0xD9, 0xDA, 0xDC, 0xC0, 0xC2, 0x2C, 0x21, 0x3B};
+        out->bytes[at] = interesting[S_random(sizeof(interesting))];
+        break;
+      }
+      case 3: {
+        size_t count = 1 + S_random(16);
+        for (size_t i = 0; i < count; i++) {
+          S_put8(out, 0);
+        }
+        memmove(out->bytes + at + count, out->bytes + at, out->length - count - at);
+        for (size_t i = 0; i < count; i++) {
+          out->bytes[at + i] = (uint8_t)S_random(256);
+        }
+        break;
+      }
+      case 4: {
+        size_t count = 1 + S_random(64);
+        count = count > out->length - at ? out->length - at : count;
+        memmove(out->bytes + at, out->bytes + at + count, out->length - at - count);
+        out->length -= count;
+        break;
+      }
+      default:
+        out->length = at;
+        break;
+    }
+  }
+}
+
+static bool S_fuzz_one(const uint8_t *bytes, size_t length, int iteration) {
+  PINProgressiveImageScanner whole;
+  S_scan_all(&whole, bytes, length);
+  PINProgressiveImageScanner chunked;
+  S_scan_chunked(&chunked, bytes, length, iteration % 3 == 0 ? 3 : 512);
+  if (!S_same(&whole, &chunked) || !S_consistent(&whole, length)) {
+    fprintf(stderr, "fuzz %d: %zu bytes scanned inconsistently\n", iteration, length);
+    return false;
+  }
+  return true;
+}
+
+static bool S_fuzz(const image *images, int imageCount, int iterations, int *statusCounts) {
+  buffer mutated = {0};
+  for (int i = 0; i < iterations; i++) {
+    if (i % 4 == 3) {
+      // Random bytes after a signature.
+      static const char *signatures[] = {"\xff\xd8", "\x89PNG\r\n\x1a\n", "GIF89a"};
+      const char *signature = signatures[S_random(3)];
+      mutated.length = 0;
+      S_put(&mutated, signature, strlen(signature));
+      S_put_random(&mutated, S_random(2048));
+    } else {
+      S_mutate(&mutated, &images[S_random((uint32_t)imageCount)].data);
+    }
+    if (!S_fuzz_one(mutated.bytes, mutated.length, i)) {
+      return false;
+    }
+    PINProgressiveImageScanner scanner;
+    S_scan_all(&scanner, mutated.bytes, mutated.length);
+    statusCounts[scanner.status]++;
+  }
+  free(mutated.bytes);
+  return true;
+}
+
+// Where PINProgressiveImage used to decide the first scan was complete: the
+// second FF DA anywhere in the data.
+static size_t S_naive_first_scan(const uint8_t *bytes, size_t length) {
+  int found = 0;
+  for (size_t i = 0; i + 1 < length; i++) {
+    if (bytes[i] == 0xFF && bytes[i + 1] == 0xDA && ++found == 2) {
+      return i + 2;
+    }
+  }
+  return 0;
+}
+
+static uint8_t *S_read_file(const char *path, size_t *length) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t *bytes = (uint8_t *)malloc(size > 0 ? (size_t)size : 1);
+  *length = fread(bytes, 1, size > 0 ? (size_t)size : 0, file);
+  fclose(file);
+  return bytes;
+}
+
+// MARK: - Throughput
+
+static volatile uint64_t S_sink;
+
+static double S_time_scanner(const buffer *data, size_t chunk) {
+  double best = 0;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    double start = S_now();
+    PINProgressiveImageScanner scanner;
+    PINProgressiveImageScannerInit(&scanner);
+    for (size_t offset = 0; offset < data->length; offset += chunk) {
+      size_t length = chunk < data->length - offset ? chunk : data->length - offset;
+      PINProgressiveImageScannerScan(&scanner, data->bytes + offset, length);
+    }
+    double elapsed = S_now() - start;
+    S_sink += scanner.completedScanCount;
+    best = trial == 0 || elapsed < best ? elapsed : best;
+  }
+  return data->length / best / 1e6;
+}
+
+static double S_time_append(const buffer *data, size_t chunk) {
+  double best = 0;
+  uint8_t *received = (uint8_t *)malloc(data->length);
+  for (int trial = 0; trial < TRIALS; trial++) {
+    double start = S_now();
+    for (size_t offset = 0; offset < data->length; offset += chunk) {
+      size_t length = chunk < data->length - offset ? chunk : data->length - offset;
+      memcpy(received + offset, data->bytes + offset, length);
+    }
+    double elapsed = S_now() - start;
+    S_sink += received[data->length - 1];
+    best = trial == 0 || elapsed < best ? elapsed : best;
+  }
+  free(received);
+  return data->length / best / 1e6;
+}
+
+// Searches every chunk for FF DA, one byte back into the last, counting all of them.
+static double S_time_search(const buffer *data, size_t chunk) {
+  double best = 0;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    double start = S_now();
+    uint64_t found = 0;
+    size_t scanned = 0;
+    for (size_t offset = 0; offset < data->length; offset += chunk) {
+      size_t end = offset + chunk < data->length ? offset + chunk : data->length;
+      size_t from = scanned > 0 ? scanned - 1 : 0;
+      while (from + 1 < end) {
+        const uint8_t *hit = (const uint8_t *)memchr(data->bytes + from, 0xFF, end - from - 1);
+        if (hit == NULL) {
+          break;
+        }
+        from = (size_t)(hit - data->bytes) + 1;
+        if (data->bytes[from] == 0xDA) {
+          found++;
+          from++;
+        }
+      }
+      scanned = end;
+    }
+    double elapsed = S_now() - start;
+    S_sink += found;
+    best = trial == 0 || elapsed < best ? elapsed : best;
+  }
+  return data->length / best / 1e6;
+}
+
+int main(int argc, char **argv) {
+  int iterations = 200000;
+  size_t benchLength = 8 * 1024 * 1024;
+  int firstFile = argc;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      iterations = 20000;
+      benchLength = 2 * 1024 * 1024;
+    } else if (firstFile == argc) {
+      firstFile = i;
+    }
+  }
+
+  image images[9];
+  S_make_jpeg(&images[0], "progressive_jpeg", 640, 480, (jpeg_options){true, 10, 300, 0, false, false, false});
+  S_make_jpeg(&images[1], "baseline_jpeg", 320, 200, (jpeg_options){false, 1, 2000, 0, false, false, false});
+  S_make_jpeg(&images[2], "restarts_and_fill", 1024, 768, (jpeg_options){true, 6, 500, 37, false, true, false});
+  S_make_jpeg(&images[3], "exif_thumbnail", 4032, 3024, (jpeg_options){true, 4, 400, 0, true, false, false});
+  S_make_jpeg(&images[4], "dnl", 800, 600, (jpeg_options){false, 1, 600, 0, false, false, true});
+  S_make_png(&images[5], "interlaced_png", 300, 200, true, 5, 700);
+  S_make_png(&images[6], "png", 70000, 3, false, 1, 40);
+  S_make_gif(&images[7], "interlaced_gif", 120, 90, true, 3, 900);
+  S_make_gif(&images[8], "gif", 16, 16, false, 1, 20);
+  int imageCount = (int)(sizeof(images) / sizeof(images[0]));
+  for (int i = 0; i < imageCount; i++) {
+    if (!S_check_image(&images[i], 50) || !S_check_truncated(images[i].name, images[i].data.bytes, images[i].data.length, 200)) {
+      return 1;
+    }
+  }
+  const image *exif = &images[3];
+  size_t naive = S_naive_first_scan(exif->data.bytes, exif->data.length);
+  if (naive == 0 || naive >= exif->scanCompleteAt[0]) {
+    fprintf(stderr, "exif_thumbnail: the thumbnail should fool a search for FF DA\n");
+    return 1;
+  }
+
+  printf("{\n  \"files\": [");
+  for (int i = firstFile; i < argc; i++) {
+    size_t length = 0;
+    uint8_t *bytes = S_read_file(argv[i], &length);
+    if (bytes == NULL) {
+      fprintf(stderr, "%s: can't read\n", argv[i]);
+      return 1;
+    }
+    if (!S_check_truncated(argv[i], bytes, length, 500)) {
+      return 1;
+    }
+    PINProgressiveImageScanner scanner;
+    S_scan_all(&scanner, bytes, length);
+    printf("%s\n    {\"path\": \"%s\", \"bytes\": %zu, \"format\": %d, \"status\": %d, \"width\": %u, \"height\": %u,"
+           " \"progressive\": %s, \"scans\": %u, \"complete_scans\": %u}",
+           i == firstFile ? "" : ",", argv[i], length, (int)scanner.format, (int)scanner.status, scanner.width,
+           scanner.height, scanner.progressive ? "true" : "false", scanner.scanCount, scanner.completedScanCount);
+    free(bytes);
+  }
+  printf("%s],\n", firstFile < argc ? "\n  " : "");
+  printf("  \"exif_thumbnail\": {\"first_scan_complete_at\": %zu, \"ff_da_search_decided_at\": %zu},\n",
+         exif->scanCompleteAt[0], naive);
+
+  int statusCounts[3] = {0, 0, 0};
+  if (!S_fuzz(images, imageCount, iterations, statusCounts)) {
+    return 1;
+  }
+  printf("  \"fuzz\": {\"inputs\": %d, \"scanning\": %d, \"finished\": %d, \"invalid\": %d},\n", iterations,
+         statusCounts[PINProgressiveImageScannerStatusScanning], statusCounts[PINProgressiveImageScannerStatusFinished],
+         statusCounts[PINProgressiveImageScannerStatusInvalid]);
+
+  image large[3];
+  size_t jpegScan = benchLength / 12;
+  S_make_jpeg(&large[0], "jpeg", 4032, 3024, (jpeg_options){true, 10, jpegScan, 64, true, false, false});
+  S_make_png(&large[1], "png", 4032, 3024, true, (int)(benchLength / 65536), 65536);
+  S_make_gif(&large[2], "gif", 1024, 1024, false, 8, benchLength / 8);
+  static const size_t chunks[] = {4096, 65536};
+  printf("  \"throughput_mb_per_sec\": [");
+  for (int i = 0; i < 3; i++) {
+    for (int c = 0; c < 2; c++) {
+      printf("%s\n    {\"image\": \"%s\", \"mb\": %.1f, \"chunk_kb\": %zu, \"scanner\": %.0f, \"append\": %.0f, \"ff_da_search\": %.0f}",
+             i + c == 0 ? "" : ",", large[i].name, large[i].data.length / 1e6, chunks[c] / 1024,
+             S_time_scanner(&large[i].data, chunks[c]), S_time_append(&large[i].data, chunks[c]),
+             S_time_search(&large[i].data, chunks[c]));
+    }
+    free(large[i].data.bytes);
+  }
+  printf("\n  ]\n}\n");
+  for (int i = 0; i < imageCount; i++) {
+    free(images[i].data.bytes);
+  }
+  return 0;
+}
@@ -154,6 +154,38 @@ NSData * __nullable PINImagePNGRepresentation(PINImage * __nonnull image) {
     return decodedImage;
 }
 
++ (PINImage *)pin_decodedImageWithData:(NSData *)data maxPixelSize:(NSUInteger)maxPixelSize
+{
+    if (data == nil || maxPixelSize == 0) {
+        return nil;
+    }
+    
+    PINImage *decodedImage = nil;
+    
+    CGImageSourceRef imageSourceRef = CGImageSourceCreateWithData((CFDataRef)data, (CFDictionaryRef)@{(NSString *)kCGImageSourceShouldCache : (NSNumber *)kCFBooleanFalse});
+    
+    if (imageSourceRef) {
+        NSDictionary *options = @{(NSString *)kCGImageSourceCreateThumbnailFromImageAlways : (NSNumber *)kCFBooleanTrue,
+                                  (NSString *)kCGImageSourceCreateThumbnailWithTransform : (NSNumber *)kCFBooleanTrue,
+                                  (NSString *)kCGImageSourceShouldCacheImmediately : (NSNumber *)kCFBooleanTrue,
+                                  (NSString *)kCGImageSourceThumbnailMaxPixelSize : @(maxPixelSize)};
+        CGImageRef imageRef = CGImageSourceCreateThumbnailAtIndex(imageSourceRef, 0, (CFDictionaryRef)options);
+        if (imageRef) {
+            // Already decoded, and with the transform applied, so the orientation is up.
+#if PIN_TARGET_IOS
+            decodedImage = [PINImage imageWithCGImage:imageRef scale:1.0 orientation:UIImageOrientationUp];
+#elif PIN_TARGET_MAC
+            decodedImage = [[NSImage alloc] initWithCGImage:imageRef size:CGSizeMake(CGImageGetWidth(imageRef), CGImageGetHeight(imageRef))];
+#endif
+            CGImageRelease(imageRef);
+        }
+        
+        CFRelease(imageSourceRef);
+    }
+    
+    return decodedImage;
+}
+
 + (PINImage *)pin_decodedImageWithCGImageRef:(CGImageRef)imageRef
 {
 #if PIN_TARGET_IOS
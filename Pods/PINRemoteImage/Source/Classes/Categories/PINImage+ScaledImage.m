@@ -8,6 +8,23 @@
 
 #import <PINRemoteImage/PINImage+ScaledImage.h>
 
+#import <PINRemoteImage/PINImageKernels.h>
+
+// Rows drawn at a time while downsampling.
+static const size_t PINDownsampleBandRows = 64;
+
+// Whether the resizer can read the image's bitmap as it is, without drawing it.
+static BOOL PINImageHasResizerLayout(CGImageRef imageRef)
+{
+    CGBitmapInfo bitmapInfo = CGImageGetBitmapInfo(imageRef);
+    CGColorSpaceRef colorSpace = CGImageGetColorSpace(imageRef);
+    return CGImageGetBitsPerComponent(imageRef) == 8 && CGImageGetBitsPerPixel(imageRef) == 32 &&
+           (bitmapInfo & kCGBitmapFloatComponents) == 0 &&
+           (bitmapInfo & kCGBitmapAlphaInfoMask) == kCGImageAlphaPremultipliedFirst &&
+           (bitmapInfo & kCGBitmapByteOrderMask) == kCGBitmapByteOrder32Little &&
+           colorSpace != NULL && CGColorSpaceGetModel(colorSpace) == kCGColorSpaceModelRGB;
+}
+
 static inline PINImage *PINScaledImageForKey(NSString * __nullable key, PINImage * __nullable image) {
     if (image == nil) {
         return nil;
@@ -53,4 +70,80 @@ static inline PINImage *PINScaledImageForKey(NSString * __nullable key, PINImage
     return PINScaledImageForKey(key, image);
 }
 
+- (PINImage *)pin_imageDownsampledToMaxPixelSize:(CGFloat)maxPixelSize
+{
+#if PIN_TARGET_IOS
+    CGImageRef imageRef = self.CGImage;
+#elif PIN_TARGET_MAC
+    CGImageRef imageRef = [self CGImageForProposedRect:NULL context:nil hints:nil];
+#endif
+    if (imageRef == NULL) {
+        return nil;
+    }
+    size_t width = CGImageGetWidth(imageRef);
+    size_t height = CGImageGetHeight(imageRef);
+    size_t longest = MAX(width, height);
+    if (maxPixelSize < 1 || longest <= maxPixelSize) {
+        return self;
+    }
+    CGFloat scale = maxPixelSize / longest;
+    size_t targetWidth = MAX((size_t)1, (size_t)floor(width * scale));
+    size_t targetHeight = MAX((size_t)1, (size_t)floor(height * scale));
+    
+    // A bitmap already in the resizer's layout is read where it is, in its own color space. Core Graphics
+    // hands back the bitmap of a decoded image rather than a copy where it can.
+    CFDataRef bitmapData = NULL;
+    if (PINImageHasResizerLayout(imageRef)) {
+        bitmapData = CGDataProviderCopyData(CGImageGetDataProvider(imageRef));
+    }
+    
+    // Premultiplied, so averaging doesn't bleed color out of transparent pixels.
+    CGColorSpaceRef colorSpace = bitmapData ? CGColorSpaceRetain(CGImageGetColorSpace(imageRef)) : CGColorSpaceCreateDeviceRGB();
+    CGBitmapInfo bitmapInfo = kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little;
+    CGContextRef targetContext = CGBitmapContextCreate(NULL, targetWidth, targetHeight, 8, 0, colorSpace, bitmapInfo);
+    CGContextRef bandContext = bitmapData ? NULL : CGBitmapContextCreate(NULL, width, MIN(height, PINDownsampleBandRows), 8, 0, colorSpace, bitmapInfo);
+    CGColorSpaceRelease(colorSpace);
+    
+    PINImage *image = nil;
+    PINImageKernelsResizer *resizer = NULL;
+    if (targetContext && (bitmapData || bandContext)) {
+        PINImageKernelsBuffer target = {CGBitmapContextGetData(targetContext), targetWidth, targetHeight, CGBitmapContextGetBytesPerRow(targetContext)};
+        resizer = PINImageKernelsResizerCreate(width, height, &target, PINImageKernelsFilterArea);
+    }
+    if (resizer) {
+        if (bitmapData) {
+            PINImageKernelsResizerConsumeRows(resizer, CFDataGetBytePtr(bitmapData), CGImageGetBytesPerRow(imageRef), height);
+        } else {
+            size_t bandHeight = CGBitmapContextGetHeight(bandContext);
+            CGContextSetBlendMode(bandContext, kCGBlendModeCopy);
+            CGContextSetInterpolationQuality(bandContext, kCGInterpolationNone);
+            for (size_t row = 0; row < height; row += bandHeight) {
+                // Shifts the image up so rows row..row + bandHeight land in the band, which is
+                // bottom-up like all of Core Graphics. An image not decoded yet is decoded whole by
+                // the first draw, and cached by it unless its source was told not to cache.
+                CGContextDrawImage(bandContext, CGRectMake(0, (CGFloat)row + bandHeight - height, width, height), imageRef);
+                PINImageKernelsResizerConsumeRows(resizer, CGBitmapContextGetData(bandContext), CGBitmapContextGetBytesPerRow(bandContext), MIN(bandHeight, height - row));
+            }
+        }
+        PINImageKernelsResizerDestroy(resizer);
+        
+        CGImageRef targetImageRef = CGBitmapContextCreateImage(targetContext);
+        if (targetImageRef) {
+#if PIN_TARGET_IOS
+            image = [UIImage imageWithCGImage:targetImageRef scale:1.0 orientation:self.imageOrientation];
+#elif PIN_TARGET_MAC
+            image = [[NSImage alloc] initWithCGImage:targetImageRef size:CGSizeMake(targetWidth, targetHeight)];
+#endif
+            CGImageRelease(targetImageRef);
+        }
+    }
+    
+    CGContextRelease(targetContext);
+    CGContextRelease(bandContext);
+    if (bitmapData) {
+        CFRelease(bitmapData);
+    }
+    return image;
+}
+
 @end
@@ -0,0 +1,879 @@
+//
+//  PINImageKernels.c
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#include <PINRemoteImage/PINImageKernels.h>
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#define PINImageKernelsX86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PINImageKernelsARM 1
+#include <arm_neon.h>
+#endif
+
+#define PINImageKernelsWeightBits 14
+#define PINImageKernelsWeightOne (1 << PINImageKernelsWeightBits)
+#define PINImageKernelsWeightRound (1 << (PINImageKernelsWeightBits - 1))
+
+/** Boxes up to 255 pixels a side sum in 16 bits, which the vector paths need. */
+#define PINImageKernelsNarrowBoxRadius 127
+
+/** Where each destination pixel's source pixels start, how many there are, and where their weights are. */
+typedef struct {
+    uint32_t *start;
+    uint32_t *count;
+    uint32_t *offset;
+    int16_t *weights;
+    /** The most source pixels any destination pixel could need, before dropping zero weights. */
+    uint32_t window;
+} PINImageKernelsAxis;
+
+/**
+ The kernels every implementation provides. Each must produce exactly what
+ the scalar one does, so they only differ in speed.
+ */
+typedef struct {
+    void (*horizontal)(const uint8_t *source, uint8_t *destination, const PINImageKernelsAxis *axis, size_t width);
+    void (*vertical)(const uint8_t *const *rows, const int16_t *weights, uint32_t count, uint8_t *destination, size_t length);
+    /** Writes averages of `sums`, then slides the box down a row, unless `add` is NULL. */
+    void (*boxColumns)(uint16_t *sums, uint8_t *destination, const uint8_t *add, const uint8_t *subtract, size_t length, uint16_t multiplier);
+    void (*premultiply)(uint8_t *pixels, size_t count);
+} PINImageKernelsFunctions;
+
+// MARK: - Scalar
+
+static inline uint8_t PINImageKernelsClamp(int32_t value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : (uint8_t)value);
+}
+
+// Right shifts of negative sums are arithmetic on every compiler this builds with, as in the vector paths.
+static inline uint8_t PINImageKernelsWeighted(int32_t sum)
+{
+    return PINImageKernelsClamp((sum + PINImageKernelsWeightRound) >> PINImageKernelsWeightBits);
+}
+
+static inline uint8_t PINImageKernelsAverage(uint32_t sum, uint32_t multiplier)
+{
+    uint32_t average = (sum * multiplier + 32768) >> 16;
+    return average > 255 ? 255 : (uint8_t)average;
+}
+
+static inline uint8_t PINImageKernelsPremultiplied(uint32_t value, uint32_t alpha)
+{
+    uint32_t product = value * alpha + 128;
+    return (uint8_t)((product + (product >> 8)) >> 8);
+}
+
+static void PINImageKernelsHorizontalScalar(const uint8_t *source, uint8_t *destination, const PINImageKernelsAxis *axis, size_t width)
+{
+    for (size_t x = 0; x < width; x++) {
+        const uint8_t *pixel = source + (size_t)axis->start[x] * 4;
+        const int16_t *weights = axis->weights + axis->offset[x];
+        int32_t sums[4] = {0, 0, 0, 0};
+        for (uint32_t k = 0; k < axis->count[x]; k++) {
+            for (int c = 0; c < 4; c++) {
+                sums[c] += weights[k] * pixel[k * 4 + c];
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            destination[x * 4 + c] = PINImageKernelsWeighted(sums[c]);
+        }
+    }
+}
+
+static void PINImageKernelsVerticalScalarFrom(const uint8_t *const *rows, const int16_t *weights, uint32_t count, uint8_t *destination, size_t from, size_t length)
+{
+    for (size_t i = from; i < length; i++) {
+        int32_t sum = 0;
+        for (uint32_t k = 0; k < count; k++) {
+            sum += weights[k] * rows[k][i];
+        }
+        destination[i] = PINImageKernelsWeighted(sum);
+    }
+}
+
+static void PINImageKernelsVerticalScalar(const uint8_t *const *rows, const int16_t *weights, uint32_t count, uint8_t *destination, size_t length)
+{
+    PINImageKernelsVerticalScalarFrom(rows, weights, count, destination, 0, length);
+}
+
+static void PINImageKernelsBoxColumnsScalarFrom(uint16_t *sums, uint8_t *destination, const uint8_t *add, const uint8_t *subtract, size_t from, size_t length, uint16_t multiplier)
+{
+    for (size_t i = from; i < length; i++) {
+        destination[i] = PINImageKernelsAverage(sums[i], multiplier);
+        if (add) {
+            sums[i] = (uint16_t)(sums[i] + add[i] - subtract[i]);
+        }
+    }
+}
+
+static void PINImageKernelsBoxColumnsScalar(uint16_t *sums, uint8_t *destination, const uint8_t *add, const uint8_t *subtract, size_t length, uint16_t multiplier)
+{
+    PINImageKernelsBoxColumnsScalarFrom(sums, destination, add, subtract, 0, length, multiplier);
+}
+
+/** For boxes too large to sum in 16 bits, whatever the implementation. */
+static void PINImageKernelsBoxColumnsWide(uint32_t *sums, uint8_t *destination, const uint8_t *add, const uint8_t *subtract, size_t length, uint32_t multiplier)
+{
+    for (size_t i = 0; i < length; i++) {
+        destination[i] = PINImageKernelsAverage(sums[i], multiplier);
+        if (add) {
+            sums[i] = sums[i] + add[i] - subtract[i];
+        }
+    }
+}
+
+static void PINImageKernelsPremultiplyScalar(uint8_t *pixels, size_t count)
+{
+    for (size_t i = 0; i < count; i++, pixels += 4) {
+        uint32_t alpha = pixels[3];
+        pixels[0] = PINImageKernelsPremultiplied(pixels[0], alpha);
+        pixels[1] = PINImageKernelsPremultiplied(pixels[1], alpha);
+        pixels[2] = PINImageKernelsPremultiplied(pixels[2], alpha);
+    }
+}
+
+static const PINImageKernelsFunctions PINImageKernelsScalar = {
+    PINImageKernelsHorizontalScalar,
+    PINImageKernelsVerticalScalar,
+    PINImageKernelsBoxColumnsScalar,
+    PINImageKernelsPremultiplyScalar,
+};
+
+// MARK: - SSE2 and AVX2
+
+#if PINImageKernelsX86
+
+static inline __m128i PINImageKernelsWeightPairSSE2(int16_t first, int16_t second)
+{
+    return _mm_set1_epi32((int32_t)(((uint32_t)(uint16_t)second << 16) | (uint16_t)first));
+}
+
+static void PINImageKernelsHorizontalSSE2(const uint8_t *source, uint8_t *destination, const PINImageKernelsAxis *axis, size_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(PINImageKernelsWeightRound);
+    for (size_t x = 0; x < width; x++) {
+        const uint8_t *pixel = source + (size_t)axis->start[x] * 4;
+        const int16_t *weights = axis->weights + axis->offset[x];
+        uint32_t count = axis->count[x];
+        __m128i sums = round;
+        uint32_t k = 0;
+        for (; k + 1 < count; k += 2) {
+            // Two pixels, their channels interleaved so each 32-bit lane sums one channel of both.
+            __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(pixel + k * 4)), zero);
+            __m128i pairs = _mm_unpacklo_epi16(pixels, _mm_srli_si128(pixels, 8));
+            sums = _mm_add_epi32(sums, _mm_madd_epi16(pairs, PINImageKernelsWeightPairSSE2(weights[k], weights[k + 1])));
+        }
+        if (k < count) {
+            int32_t bits;
+            memcpy(&bits, pixel + k * 4, 4);
+            __m128i pixels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero);
+            sums = _mm_add_epi32(sums, _mm_madd_epi16(pixels, PINImageKernelsWeightPairSSE2(weights[k], 0)));
+        }
+        sums = _mm_srai_epi32(sums, PINImageKernelsWeightBits);
+        sums = _mm_packs_epi32(sums, sums);
+        int32_t result = _mm_cvtsi128_si32(_mm_packus_epi16(sums, sums));
+        memcpy(destination + x * 4, &result, 4);
+    }
+}
+
+static void PINImageKernelsVerticalSSE2(const uint8_t *const *rows, const int16_t *weights, uint32_t count, uint8_t *destination, size_t length)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(PINImageKernelsWeightRound);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i sums0 = round, sums1 = round, sums2 = round, sums3 = round;
+        for (uint32_t k = 0; k < count; k += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(rows[k] + i));
+            __m128i b = zero;
+            __m128i pair;
+            if (k + 1 < count) {
+                b = _mm_loadu_si128((const __m128i *)(rows[k + 1] + i));
+                pair = PINImageKernelsWeightPairSSE2(weights[k], weights[k + 1]);
+            } else {
+                pair = PINImageKernelsWeightPairSSE2(weights[k], 0);
+            }
+            __m128i aLow = _mm_unpacklo_epi8(a, zero), aHigh = _mm_unpackhi_epi8(a, zero);
+            __m128i bLow = _mm_unpacklo_epi8(b, zero), bHigh = _mm_unpackhi_epi8(b, zero);
+            sums0 = _mm_add_epi32(sums0, _mm_madd_epi16(_mm_unpacklo_epi16(aLow, bLow), pair));
+            sums1 = _mm_add_epi32(sums1, _mm_madd_epi16(_mm_unpackhi_epi16(aLow, bLow), pair));
+            sums2 = _mm_add_epi32(sums2, _mm_madd_epi16(_mm_unpacklo_epi16(aHigh, bHigh), pair));
+            sums3 = _mm_add_epi32(sums3, _mm_madd_epi16(_mm_unpackhi_epi16(aHigh, bHigh), pair));
+        }
+        __m128i low = _mm_packs_epi32(_mm_srai_epi32(sums0, PINImageKernelsWeightBits), _mm_srai_epi32(sums1, PINImageKernelsWeightBits));
+        __m128i high = _mm_packs_epi32(_mm_srai_epi32(sums2, PINImageKernelsWeightBits), _mm_srai_epi32(sums3, PINImageKernelsWeightBits));
+        _mm_storeu_si128((__m128i *)(destination + i), _mm_packus_epi16(low, high));
+    }
+    PINImageKernelsVerticalScalarFrom(rows, weights, count, destination, i, length);
+}
+
+// (sum * multiplier + 32768) >> 16 in 16-bit lanes: the high half, plus one if the low half rounds up.
+static inline __m128i PINImageKernelsAverageSSE2(__m128i sums, __m128i multiplier)
+{
+    return _mm_add_epi16(_mm_mulhi_epu16(sums, multiplier), _mm_srli_epi16(_mm_mullo_epi16(sums, multiplier), 15));
+}
+
+static void PINImageKernelsBoxColumnsSSE2(uint16_t *sums, uint8_t *destination, const uint8_t *add, const uint8_t *subtract, size_t length, uint16_t multiplier)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i factor = _mm_set1_epi16((int16_t)multiplier);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i low = _mm_loadu_si128((const __m128i *)(sums + i));
+        __m128i high = _mm_loadu_si128((const __m128i *)(sums + i + 8));
+        __m128i averages = _mm_packus_epi16(PINImageKernelsAverageSSE2(low, factor), PINImageKernelsAverageSSE2(high, factor));
+        _mm_storeu_si128((__m128i *)(destination + i), averages);
+        if (add) {
+            __m128i in = _mm_loadu_si128((const __m128i *)(add + i));
+            __m128i out = _mm_loadu_si128((const __m128i *)(subtract + i));
+            low = _mm_sub_epi16(_mm_add_epi16(low, _mm_unpacklo_epi8(in, zero)), _mm_unpacklo_epi8(out, zero));
+            high = _mm_sub_epi16(_mm_add_epi16(high, _mm_unpackhi_epi8(in, zero)), _mm_unpackhi_epi8(out, zero));
+            _mm_storeu_si128((__m128i *)(sums + i), low);
+            _mm_storeu_si128((__m128i *)(sums + i + 8), high);
+        }
+    }
+    PINImageKernelsBoxColumnsScalarFrom(sums, destination, add, subtract, i, length, multiplier);
+}
+
+static void PINImageKernelsPremultiplySSE2(uint8_t *pixels, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(pixels + i * 4));
+        __m128i halves[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+        for (int h = 0; h < 2; h++) {
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[h], 0xFF), 0xFF);
+            __m128i product = _mm_add_epi16(_mm_mullo_epi16(halves[h], alpha), round);
+            product = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+            halves[h] = _mm_or_si128(_mm_and_si128(alphaLanes, halves[h]), _mm_andnot_si128(alphaLanes, product));
+        }
+        _mm_storeu_si128((__m128i *)(pixels + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+    }
+    PINImageKernelsPremultiplyScalar(pixels + i * 4, count - i);
+}
+
+static const PINImageKernelsFunctions PINImageKernelsSSE2 = {
+    PINImageKernelsHorizontalSSE2,
+    PINImageKernelsVerticalSSE2,
+    PINImageKernelsBoxColumnsSSE2,
+    PINImageKernelsPremultiplySSE2,
+};
+
+#define PINImageKernelsAVX2Function __attribute__((target("avx2")))
+
+PINImageKernelsAVX2Function
+static inline __m256i PINImageKernelsWeightPairAVX2(int16_t first, int16_t second)
+{
+    return _mm256_set1_epi32((int32_t)(((uint32_t)(uint16_t)second << 16) | (uint16_t)first));
+}
+
+// Unpacking and packing both work within 128-bit lanes, so packing puts bytes back where they were.
+PINImageKernelsAVX2Function
+static void PINImageKernelsVerticalAVX2(const uint8_t *const *rows, const int16_t *weights, uint32_t count, uint8_t *destination, size_t length)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(PINImageKernelsWeightRound);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i sums0 = round, sums1 = round, sums2 = round, sums3 = round;
+        for (uint32_t k = 0; k < count; k += 2) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(rows[k] + i));
+            __m256i b = zero;
+            __m256i pair;
+            if (k + 1 < count) {
+                b = _mm256_loadu_si256((const __m256i *)(rows[k + 1] + i));
+                pair = PINImageKernelsWeightPairAVX2(weights[k], weights[k + 1]);
+            } else {
+                pair = PINImageKernelsWeightPairAVX2(weights[k], 0);
+            }
+            __m256i aLow = _mm256_unpacklo_epi8(a, zero), aHigh = _mm256_unpackhi_epi8(a, zero);
+            __m256i bLow = _mm256_unpacklo_epi8(b, zero), bHigh = _mm256_unpackhi_epi8(b, zero);
+            sums0 = _mm256_add_epi32(sums0, _mm256_madd_epi16(_mm256_unpacklo_epi16(aLow, bLow), pair));
+            sums1 = _mm256_add_epi32(sums1, _mm256_madd_epi16(_mm256_unpackhi_epi16(aLow, bLow), pair));
+            sums2 = _mm256_add_epi32(sums2, _mm256_madd_epi16(_mm256_unpacklo_epi16(aHigh, bHigh), pair));
+            sums3 = _mm256_add_epi32(sums3, _mm256_madd_epi16(_mm256_unpackhi_epi16(aHigh, bHigh), pair));
+        }
+        __m256i low = _mm256_packs_epi32(_mm256_srai_epi32(sums0, PINImageKernelsWeightBits), _mm256_srai_epi32(sums1, PINImageKernelsWeightBits));
+        __m256i high = _mm256_packs_epi32(_mm256_srai_epi32(sums2, PINImageKernelsWeightBits), _mm256_srai_epi32(sums3, PINImageKernelsWeightBits));
+        _mm256_storeu_si256((__m256i *)(destination + i), _mm256_packus_epi16(low, high));
+    }
+    PINImageKernelsVerticalScalarFrom(rows, weights, count, destination, i, length);
+}
+
+PINImageKernelsAVX2Function
+static inline __m256i PINImageKernelsAverageAVX2(__m256i sums, __m256i multiplier)
+{
+    return _mm256_add_epi16(_mm256_mulhi_epu16(sums, multiplier), _mm256_srli_epi16(_mm256_mullo_epi16(sums, multiplier), 15));
+}
+
+PINImageKernelsAVX2Function
+static void PINImageKernelsBoxColumnsAVX2(uint16_t *sums, uint8_t *destination, const uint8_t *add, const uint8_t *subtract, size_t length, uint16_t multiplier)
+{
+    const __m256i factor = _mm256_set1_epi16((int16_t)multiplier);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i low = _mm256_loadu_si256((const __m256i *)(sums + i));
+        __m256i high = _mm256_loadu_si256((const __m256i *)(sums + i + 16));
+        // Packing interleaves the lanes of both halves; put them back in order.
+        __m256i averages = _mm256_packus_epi16(PINImageKernelsAverageAVX2(low, factor), PINImageKernelsAverageAVX2(high, factor));
+        _mm256_storeu_si256((__m256i *)(destination + i), _mm256_permute4x64_epi64(averages, 0xD8));
+        if (add) {
+            low = _mm256_add_epi16(low, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(add + i))));
+            low = _mm256_sub_epi16(low, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(subtract + i))));
+            high = _mm256_add_epi16(high, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(add + i + 16))));
+            high = _mm256_sub_epi16(high, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(subtract + i + 16))));
+            _mm256_storeu_si256((__m256i *)(sums + i), low);
+            _mm256_storeu_si256((__m256i *)(sums + i + 16), high);
+        }
+    }
+    PINImageKernelsBoxColumnsScalarFrom(sums, destination, add, subtract, i, length, multiplier);
+}
+
+PINImageKernelsAVX2Function
+static void PINImageKernelsPremultiplyAVX2(uint8_t *pixels, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi16(128);
+    const __m256i alphaLanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(pixels + i * 4));
+        __m256i halves[2] = {_mm256_unpacklo_epi8(bytes, zero), _mm256_unpackhi_epi8(bytes, zero)};
+        for (int h = 0; h < 2; h++) {
+            __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(halves[h], 0xFF), 0xFF);
+            __m256i product = _mm256_add_epi16(_mm256_mullo_epi16(halves[h], alpha), round);
+            product = _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+            halves[h] = _mm256_blendv_epi8(product, halves[h], alphaLanes);
+        }
+        _mm256_storeu_si256((__m256i *)(pixels + i * 4), _mm256_packus_epi16(halves[0], halves[1]));
+    }
+    PINImageKernelsPremultiplySSE2(pixels + i * 4, count - i);
+}
+
+// Horizontal resampling gathers a few pixels at a time, which wider vectors don't help with.
+static const PINImageKernelsFunctions PINImageKernelsAVX2 = {
+    PINImageKernelsHorizontalSSE2,
+    PINImageKernelsVerticalAVX2,
+    PINImageKernelsBoxColumnsAVX2,
+    PINImageKernelsPremultiplyAVX2,
+};
+
+#endif
+
+// MARK: - NEON
+
+#if PINImageKernelsARM
+
+static void PINImageKernelsHorizontalNEON(const uint8_t *source, uint8_t *destination, const PINImageKernelsAxis *axis, size_t width)
+{
+    for (size_t x = 0; x < width; x++) {
+        const uint8_t *pixel = source + (size_t)axis->start[x] * 4;
+        const int16_t *weights = axis->weights + axis->offset[x];
+        uint32_t count = axis->count[x];
+        int32x4_t sums = vdupq_n_s32(0);
+        uint32_t k = 0;
+        for (; k + 1 < count; k += 2) {
+            int16x8_t pixels = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pixel + k * 4)));
+            sums = vmlal_n_s16(sums, vget_low_s16(pixels), weights[k]);
+            sums = vmlal_n_s16(sums, vget_high_s16(pixels), weights[k + 1]);
+        }
+        if (k < count) {
+            uint32_t bits;
+            memcpy(&bits, pixel + k * 4, 4);
+            int16x8_t pixels = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bits))));
+            sums = vmlal_n_s16(sums, vget_low_s16(pixels), weights[k]);
+        }
+        int16x4_t narrowed = vqmovn_s32(vrshrq_n_s32(sums, PINImageKernelsWeightBits));
+        uint32_t result = vget_lane_u32(vreinterpret_u32_u8(vqmovun_s16(vcombine_s16(narrowed, narrowed))), 0);
+        memcpy(destination + x * 4, &result, 4);
+    }
+}
+
+static void PINImageKernelsVerticalNEON(const uint8_t *const *rows, const int16_t *weights, uint32_t count, uint8_t *destination, size_t length)
+{
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        int32x4_t sums0 = vdupq_n_s32(0), sums1 = vdupq_n_s32(0), sums2 = vdupq_n_s32(0), sums3 = vdupq_n_s32(0);
+        for (uint32_t k = 0; k < count; k++) {
+            uint8x16_t bytes = vld1q_u8(rows[k] + i);
+            int16x8_t low = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(bytes)));
+            int16x8_t high = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(bytes)));
+            sums0 = vmlal_n_s16(sums0, vget_low_s16(low), weights[k]);
+            sums1 = vmlal_n_s16(sums1, vget_high_s16(low), weights[k]);
+            sums2 = vmlal_n_s16(sums2, vget_low_s16(high), weights[k]);
+            sums3 = vmlal_n_s16(sums3, vget_high_s16(high), weights[k]);
+        }
+        int16x8_t low = vcombine_s16(vqmovn_s32(vrshrq_n_s32(sums0, PINImageKernelsWeightBits)), vqmovn_s32(vrshrq_n_s32(sums1, PINImageKernelsWeightBits)));
+        int16x8_t high = vcombine_s16(vqmovn_s32(vrshrq_n_s32(sums2, PINImageKernelsWeightBits)), vqmovn_s32(vrshrq_n_s32(sums3, PINImageKernelsWeightBits)));
+        vst1q_u8(destination + i, vcombine_u8(vqmovun_s16(low), vqmovun_s16(high)));
+    }
+    PINImageKernelsVerticalScalarFrom(rows, weights, count, destination, i, length);
+}
+
+static void PINImageKernelsBoxColumnsNEON(uint16_t *sums, uint8_t *destination, const uint8_t *add, const uint8_t *subtract, size_t length, uint16_t multiplier)
+{
+    const uint16x4_t factor = vdup_n_u16(multiplier);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint16x8_t current = vld1q_u16(sums + i);
+        uint16x8_t averages = vcombine_u16(vrshrn_n_u32(vmull_u16(vget_low_u16(current), factor), 16),
+                                           vrshrn_n_u32(vmull_u16(vget_high_u16(current), factor), 16));
+        vst1_u8(destination + i, vqmovn_u16(averages));
+        if (add) {
+            vst1q_u16(sums + i, vsubw_u8(vaddw_u8(current, vld1_u8(add + i)), vld1_u8(subtract + i)));
+        }
+    }
+    PINImageKernelsBoxColumnsScalarFrom(sums, destination, add, subtract, i, length, multiplier);
+}
+
+static void PINImageKernelsPremultiplyNEON(uint8_t *pixels, size_t count)
+{
+    const uint16x8_t round = vdupq_n_u16(128);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t channels = vld4_u8(pixels + i * 4);
+        for (int c = 0; c < 3; c++) {
+            uint16x8_t product = vaddq_u16(vmull_u8(channels.val[c], channels.val[3]), round);
+            channels.val[c] = vshrn_n_u16(vaddq_u16(product, vshrq_n_u16(product, 8)), 8);
+        }
+        vst4_u8(pixels + i * 4, channels);
+    }
+    PINImageKernelsPremultiplyScalar(pixels + i * 4, count - i);
+}
+
+static const PINImageKernelsFunctions PINImageKernelsNEON = {
+    PINImageKernelsHorizontalNEON,
+    PINImageKernelsVerticalNEON,
+    PINImageKernelsBoxColumnsNEON,
+    PINImageKernelsPremultiplyNEON,
+};
+
+#endif
+
+// MARK: - Choosing an implementation
+
+static _Atomic(const PINImageKernelsFunctions *) PINImageKernelsCurrent;
+
+bool PINImageKernelsISAIsSupported(PINImageKernelsISA isa)
+{
+    switch (isa) {
+        case PINImageKernelsISAScalar:
+            return true;
+#if PINImageKernelsX86
+        case PINImageKernelsISASSE2:
+            return true;
+        case PINImageKernelsISAAVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+#if PINImageKernelsARM
+        case PINImageKernelsISANEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+static const PINImageKernelsFunctions *PINImageKernelsFunctionsForISA(PINImageKernelsISA isa)
+{
+    switch (isa) {
+#if PINImageKernelsX86
+        case PINImageKernelsISASSE2:
+            return &PINImageKernelsSSE2;
+        case PINImageKernelsISAAVX2:
+            return &PINImageKernelsAVX2;
+#endif
+#if PINImageKernelsARM
+        case PINImageKernelsISANEON:
+            return &PINImageKernelsNEON;
+#endif
+        default:
+            return &PINImageKernelsScalar;
+    }
+}
+
+static const PINImageKernelsFunctions *PINImageKernelsGetFunctions(void)
+{
+    const PINImageKernelsFunctions *functions = atomic_load_explicit(&PINImageKernelsCurrent, memory_order_acquire);
+    if (functions == NULL) {
+        static const PINImageKernelsISA preferred[] = {PINImageKernelsISANEON, PINImageKernelsISAAVX2, PINImageKernelsISASSE2, PINImageKernelsISAScalar};
+        for (size_t i = 0; functions == NULL; i++) {
+            if (PINImageKernelsISAIsSupported(preferred[i])) {
+                functions = PINImageKernelsFunctionsForISA(preferred[i]);
+            }
+        }
+        atomic_store_explicit(&PINImageKernelsCurrent, functions, memory_order_release);
+    }
+    return functions;
+}
+
+PINImageKernelsISA PINImageKernelsGetISA(void)
+{
+    const PINImageKernelsFunctions *functions = PINImageKernelsGetFunctions();
+    for (PINImageKernelsISA isa = PINImageKernelsISAScalar; isa <= PINImageKernelsISANEON; isa++) {
+        if (PINImageKernelsISAIsSupported(isa) && PINImageKernelsFunctionsForISA(isa) == functions) {
+            return isa;
+        }
+    }
+    return PINImageKernelsISAScalar;
+}
+
+bool PINImageKernelsSetISA(PINImageKernelsISA isa)
+{
+    if (PINImageKernelsISAIsSupported(isa) == false) {
+        return false;
+    }
+    atomic_store_explicit(&PINImageKernelsCurrent, PINImageKernelsFunctionsForISA(isa), memory_order_release);
+    return true;
+}
+
+// MARK: - Conversion
+
+void PINImageKernelsPremultiply(uint8_t *pixels, size_t count)
+{
+    PINImageKernelsGetFunctions()->premultiply(pixels, count);
+}
+
+void PINImageKernelsUnpremultiply(uint8_t *pixels, size_t count)
+{
+    for (size_t i = 0; i < count; i++, pixels += 4) {
+        uint32_t alpha = pixels[3];
+        for (int c = 0; c < 3; c++) {
+            if (alpha == 0) {
+                pixels[c] = 0;
+            } else {
+                uint32_t value = (pixels[c] * 255 + alpha / 2) / alpha;
+                pixels[c] = value > 255 ? 255 : (uint8_t)value;
+            }
+        }
+    }
+}
+
+// MARK: - Resizing
+
+struct PINImageKernelsResizer {
+    const PINImageKernelsFunctions *functions;
+    size_t sourceWidth;
+    size_t sourceHeight;
+    PINImageKernelsBuffer destination;
+    PINImageKernelsAxis horizontal;
+    PINImageKernelsAxis vertical;
+    /** Horizontally resampled rows, enough for any destination row, each kept in slot `row % ringRows`. */
+    uint8_t *ring;
+    size_t ringRows;
+    size_t consumedRows;
+    size_t finishedRows;
+    const uint8_t **taps;
+};
+
+static double PINImageKernelsLanczos3(double x)
+{
+    if (x == 0) {
+        return 1;
+    }
+    if (x <= -3 || x >= 3) {
+        return 0;
+    }
+    double pi = x * M_PI;
+    return 3 * sin(pi) * sin(pi / 3) / (pi * pi);
+}
+
+static void PINImageKernelsAxisFree(PINImageKernelsAxis *axis)
+{
+    free(axis->start);
+    free(axis->count);
+    free(axis->offset);
+    free(axis->weights);
+}
+
+static bool PINImageKernelsAxisInit(PINImageKernelsAxis *axis, size_t sourceLength, size_t destinationLength, PINImageKernelsFilter filter)
+{
+    double scale = (double)sourceLength / (double)destinationLength;
+    double filterScale = scale > 1 ? scale : 1;
+    double support = 3 * filterScale;
+    size_t window = (size_t)ceil(filter == PINImageKernelsFilterLanczos3 ? 2 * support : scale) + 2;
+    window = window > sourceLength ? sourceLength : window;
+
+    memset(axis, 0, sizeof(*axis));
+    axis->start = (uint32_t *)malloc(destinationLength * sizeof(uint32_t));
+    axis->count = (uint32_t *)malloc(destinationLength * sizeof(uint32_t));
+    axis->offset = (uint32_t *)malloc(destinationLength * sizeof(uint32_t));
+    axis->weights = (int16_t *)malloc(destinationLength * window * sizeof(int16_t));
+    double *weights = (double *)malloc(window * sizeof(double));
+    if (axis->start == NULL || axis->count == NULL || axis->offset == NULL || axis->weights == NULL || weights == NULL) {
+        PINImageKernelsAxisFree(axis);
+        free(weights);
+        return false;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < destinationLength; i++) {
+        double first, last;
+        if (filter == PINImageKernelsFilterArea) {
+            first = i * scale;
+            last = (i + 1) * scale;
+        } else {
+            double center = (i + 0.5) * scale;
+            first = center - support;
+            last = center + support;
+        }
+        long start = (long)floor(first);
+        long end = (long)ceil(last);
+        start = start < 0 ? 0 : start;
+        end = end > (long)sourceLength ? (long)sourceLength : end;
+        end = end - start > (long)window ? start + (long)window : end;
+
+        double sum = 0;
+        for (long k = start; k < end; k++) {
+            double weight;
+            if (filter == PINImageKernelsFilterArea) {
+                double from = k > first ? k : first;
+                double to = k + 1 < last ? k + 1 : last;
+                weight = to > from ? to - from : 0;
+            } else {
+                weight = PINImageKernelsLanczos3((k + 0.5 - (i + 0.5) * scale) / filterScale);
+            }
+            weights[k - start] = weight;
+            sum += weight;
+        }
+
+        // Quantize so the weights sum to exactly one, correcting the largest for rounding.
+        int16_t *quantized = axis->weights + offset;
+        long count = end - start;
+        int32_t total = 0;
+        long largest = 0;
+        for (long k = 0; k < count; k++) {
+            double weight = sum > 0 ? weights[k] / sum : (k == 0 ? 1 : 0);
+            quantized[k] = (int16_t)lround(weight * PINImageKernelsWeightOne);
+            total += quantized[k];
+            largest = quantized[k] > quantized[largest] ? k : largest;
+        }
+        quantized[largest] = (int16_t)(quantized[largest] + PINImageKernelsWeightOne - total);
+
+        // Drop zero weights at either end; the window still covers the untrimmed span.
+        long skip = 0;
+        while (skip < count - 1 && quantized[skip] == 0) {
+            skip++;
+        }
+        while (count > skip + 1 && quantized[count - 1] == 0) {
+            count--;
+        }
+        memmove(quantized, quantized + skip, (size_t)(count - skip) * sizeof(int16_t));
+        axis->start[i] = (uint32_t)(start + skip);
+        axis->count[i] = (uint32_t)(count - skip);
+        axis->offset[i] = (uint32_t)offset;
+        offset += (size_t)(count - skip);
+    }
+    axis->window = (uint32_t)window;
+    free(weights);
+    return true;
+}
+
+PINImageKernelsResizer *PINImageKernelsResizerCreate(size_t sourceWidth, size_t sourceHeight, const PINImageKernelsBuffer *destination, PINImageKernelsFilter filter)
+{
+    if (sourceWidth == 0 || sourceHeight == 0 || destination->width == 0 || destination->height == 0
+        || sourceWidth > UINT32_MAX / 4 || sourceHeight > UINT32_MAX) {
+        return NULL;
+    }
+    PINImageKernelsResizer *resizer = (PINImageKernelsResizer *)calloc(1, sizeof(PINImageKernelsResizer));
+    if (resizer == NULL) {
+        return NULL;
+    }
+    resizer->functions = PINImageKernelsGetFunctions();
+    resizer->sourceWidth = sourceWidth;
+    resizer->sourceHeight = sourceHeight;
+    resizer->destination = *destination;
+    if (PINImageKernelsAxisInit(&resizer->horizontal, sourceWidth, destination->width, filter) == false) {
+        free(resizer);
+        return NULL;
+    }
+    if (PINImageKernelsAxisInit(&resizer->vertical, sourceHeight, destination->height, filter) == false) {
+        PINImageKernelsAxisFree(&resizer->horizontal);
+        free(resizer);
+        return NULL;
+    }
+    resizer->ringRows = resizer->vertical.window;
+    resizer->ring = (uint8_t *)malloc(resizer->ringRows * destination->width * 4);
+    resizer->taps = (const uint8_t **)malloc(resizer->ringRows * sizeof(uint8_t *));
+    if (resizer->ring == NULL || resizer->taps == NULL) {
+        PINImageKernelsResizerDestroy(resizer);
+        return NULL;
+    }
+    return resizer;
+}
+
+void PINImageKernelsResizerDestroy(PINImageKernelsResizer *resizer)
+{
+    if (resizer == NULL) {
+        return;
+    }
+    PINImageKernelsAxisFree(&resizer->horizontal);
+    PINImageKernelsAxisFree(&resizer->vertical);
+    free(resizer->ring);
+    free(resizer->taps);
+    free(resizer);
+}
+
+size_t PINImageKernelsResizerConsumeRows(PINImageKernelsResizer *resizer, const uint8_t *rows, size_t rowBytes, size_t rowCount)
+{
+    size_t width = resizer->destination.width;
+    size_t length = width * 4;
+    const PINImageKernelsAxis *vertical = &resizer->vertical;
+    for (size_t r = 0; r < rowCount && resizer->consumedRows < resizer->sourceHeight; r++) {
+        size_t row = resizer->consumedRows++;
+        resizer->functions->horizontal(rows + r * rowBytes, resizer->ring + (row % resizer->ringRows) * length, &resizer->horizontal, width);
+        while (resizer->finishedRows < resizer->destination.height) {
+            size_t y = resizer->finishedRows;
+            uint32_t count = vertical->count[y];
+            if (vertical->start[y] + count > row + 1) {
+                break;
+            }
+            for (uint32_t k = 0; k < count; k++) {
+                resizer->taps[k] = resizer->ring + ((vertical->start[y] + k) % resizer->ringRows) * length;
+            }
+            resizer->functions->vertical(resizer->taps, vertical->weights + vertical->offset[y], count,
+                                         resizer->destination.data + y * resizer->destination.rowBytes, length);
+            resizer->finishedRows++;
+        }
+    }
+    return resizer->finishedRows;
+}
+
+size_t PINImageKernelsResizerScratchBytes(const PINImageKernelsResizer *resizer)
+{
+    size_t horizontalWeights = resizer->horizontal.offset[resizer->destination.width - 1] + resizer->horizontal.count[resizer->destination.width - 1];
+    size_t verticalWeights = resizer->vertical.offset[resizer->destination.height - 1] + resizer->vertical.count[resizer->destination.height - 1];
+    return resizer->ringRows * (resizer->destination.width * 4 + sizeof(uint8_t *))
+        + (resizer->destination.width + resizer->destination.height) * 3 * sizeof(uint32_t)
+        + (horizontalWeights + verticalWeights) * sizeof(int16_t);
+}
+
+bool PINImageKernelsResize(const PINImageKernelsBuffer *source, const PINImageKernelsBuffer *destination, PINImageKernelsFilter filter)
+{
+    PINImageKernelsResizer *resizer = PINImageKernelsResizerCreate(source->width, source->height, destination, filter);
+    if (resizer == NULL) {
+        return false;
+    }
+    PINImageKernelsResizerConsumeRows(resizer, source->data, source->rowBytes, source->height);
+    PINImageKernelsResizerDestroy(resizer);
+    return true;
+}
+
+// MARK: - Blurring
+
+static void PINImageKernelsBoxRow(const uint8_t *source, uint8_t *destination, size_t width, uint32_t radius, uint32_t multiplier)
+{
+    size_t last = width - 1;
+    uint32_t sums[4];
+    for (int c = 0; c < 4; c++) {
+        sums[c] = (radius + 1) * source[c];
+        for (uint32_t k = 1; k <= radius; k++) {
+            sums[c] += source[(k < last ? k : last) * 4 + c];
+        }
+    }
+    for (size_t x = 0; x < width; x++) {
+        size_t in = x + radius + 1 < last ? x + radius + 1 : last;
+        size_t out = x > radius ? x - radius : 0;
+        for (int c = 0; c < 4; c++) {
+            destination[x * 4 + c] = PINImageKernelsAverage(sums[c], multiplier);
+            sums[c] = sums[c] + source[in * 4 + c] - source[out * 4 + c];
+        }
+    }
+}
+
+bool PINImageKernelsBoxBlur(const PINImageKernelsBuffer *buffer, uint32_t radius)
+{
+    size_t width = buffer->width;
+    size_t height = buffer->height;
+    if (radius == 0 || width == 0 || height == 0) {
+        return true;
+    }
+    const PINImageKernelsFunctions *functions = PINImageKernelsGetFunctions();
+    size_t length = width * 4;
+    uint32_t size = 2 * radius + 1;
+    uint32_t multiplier = (65536 + size / 2) / size;
+    bool narrow = radius <= PINImageKernelsNarrowBoxRadius;
+    size_t ringRows = (size_t)radius + 1;
+
+    uint8_t *row = (uint8_t *)malloc(length);
+    // The original rows the box still covers, once rows above have been overwritten.
+    uint8_t *ring = (uint8_t *)malloc(ringRows * length);
+    void *sums = malloc(length * (narrow ? sizeof(uint16_t) : sizeof(uint32_t)));
+    if (row == NULL || ring == NULL || sums == NULL) {
+        free(row);
+        free(ring);
+        free(sums);
+        return false;
+    }
+
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *line = buffer->data + y * buffer->rowBytes;
+        memcpy(row, line, length);
+        PINImageKernelsBoxRow(row, line, width, radius, multiplier);
+    }
+
+    // The box around the first row, extending the top edge.
+    for (uint32_t k = 0; k <= radius; k++) {
+        const uint8_t *line = buffer->data + (k < height - 1 ? k : height - 1) * buffer->rowBytes;
+        uint32_t times = k == 0 ? radius + 1 : 1;
+        for (size_t i = 0; i < length; i++) {
+            if (narrow) {
+                ((uint16_t *)sums)[i] = (uint16_t)((k == 0 ? 0 : ((uint16_t *)sums)[i]) + times * line[i]);
+            } else {
+                ((uint32_t *)sums)[i] = (k == 0 ? 0 : ((uint32_t *)sums)[i]) + times * line[i];
+            }
+        }
+    }
+
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *line = buffer->data + y * buffer->rowBytes;
+        memcpy(ring + (y % ringRows) * length, line, length);
+        const uint8_t *subtract = ring + ((y > radius ? y - radius : 0) % ringRows) * length;
+        const uint8_t *add = NULL;
+        if (y + 1 < height) {
+            size_t in = y + radius + 1 < height - 1 ? y + radius + 1 : height - 1;
+            add = buffer->data + in * buffer->rowBytes;
+        }
+        if (narrow) {
+            functions->boxColumns((uint16_t *)sums, line, add, subtract, length, (uint16_t)multiplier);
+        } else {
+            PINImageKernelsBoxColumnsWide((uint32_t *)sums, line, add, subtract, length, multiplier);
+        }
+    }
+
+    free(row);
+    free(ring);
+    free(sums);
+    return true;
+}
+
+bool PINImageKernelsGaussianBlur(const PINImageKernelsBuffer *buffer, double sigma)
+{
+    // Three boxes of this size, as the SVG spec describes for feGaussianBlur.
+    uint32_t size = (uint32_t)floor(sigma * 3 * sqrt(2 * M_PI) / 4 + 0.5);
+    uint32_t radius = size / 2;
+    for (int pass = 0; pass < 3; pass++) {
+        if (PINImageKernelsBoxBlur(buffer, radius) == false) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -12,10 +12,16 @@
 #import <Accelerate/Accelerate.h>
 
 #import <PINRemoteImage/PINImage+DecodedImage.h>
+#import <PINRemoteImage/PINImageKernels.h>
+#import "PINProgressiveImageScanner.h"
 #import "PINRemoteImageDownloadTask.h"
 #import "PINSpeedRecorder.h"
 
 @interface PINProgressiveImage ()
+{
+    // Follows the image's structure as it arrives, for its size and where its scans end.
+    PINProgressiveImageScanner _scanner;
+}
 
 @property (nonatomic, strong) NSURLSessionDataTask *dataTask;
 @property (nonatomic, strong) NSMutableData *mutableData;
@@ -25,8 +31,6 @@
 @property (nonatomic, assign) BOOL isProgressiveJPEG;
 @property (nonatomic, assign) NSUInteger currentThreshold;
 @property (nonatomic, assign) NSUInteger startingBytes;
-@property (nonatomic, assign) NSUInteger scannedByte;
-@property (nonatomic, assign) NSInteger sosCount;
 @property (nonatomic, strong) PINRemoteLock *lock;
 #if DEBUG
 @property (nonatomic, assign) CFTimeInterval scanTime;
@@ -51,8 +55,7 @@
         self.currentThreshold = 0;
         self.progressThresholds = @[@0.00, @0.35, @0.65];
         self.estimatedRemainingTimeThreshold = -1;
-        self.sosCount = 0;
-        self.scannedByte = 0;
+        PINProgressiveImageScannerInit(&_scanner);
 #if DEBUG
         self.scanTime = 0;
 #endif
@@ -148,22 +151,24 @@
         }
         [self.mutableData appendData:data];
         
-        while ([self l_hasCompletedFirstScan] == NO && self.scannedByte < self.mutableData.length) {
     #if DEBUG
-            CFTimeInterval start = CACurrentMediaTime();
+        CFTimeInterval start = CACurrentMediaTime();
     #endif
-            NSUInteger startByte = self.scannedByte;
-            if (startByte > 0) {
-                startByte--;
-            }
-            if ([self l_scanForSOSinData:self.mutableData startByte:startByte scannedByte:&_scannedByte]) {
-                self.sosCount++;
-            }
+        // Only the new bytes are scanned, and without flattening them.
+        [data enumerateByteRangesUsingBlock:^(const void * _Nonnull bytes, NSRange byteRange, BOOL * _Nonnull stop) {
+            PINProgressiveImageScannerScan(&self->_scanner, bytes, byteRange.length);
+        }];
+        
+        // The frame header arrives before the first scan, so the size and whether the JPEG is
+        // progressive are known without asking the image source.
+        if (_scanner.width > 0 && _scanner.height > 0) {
+            self.size = CGSizeMake(_scanner.width, _scanner.height);
+        }
+        self.isProgressiveJPEG = _scanner.format == PINProgressiveImageScannerFormatJPEG && _scanner.progressive;
     #if DEBUG
-            CFTimeInterval total = CACurrentMediaTime() - start;
-            self.scanTime += total;
+        CFTimeInterval total = CACurrentMediaTime() - start;
+        self.scanTime += total;
     #endif
-        }
         
         if (self.imageSource) {
             CGImageSourceUpdateData(self.imageSource, (CFDataRef)self.mutableData, NO);
@@ -203,26 +208,6 @@
         
         PINImage *currentImage = nil;
         
-        //Size information comes after JFIF so jpeg properties should be available at or before size?
-        if (self.size.width <= 0 || self.size.height <= 0) {
-            //attempt to get size info
-            NSDictionary *imageProperties = (NSDictionary *)CFBridgingRelease(CGImageSourceCopyPropertiesAtIndex(self.imageSource, 0, NULL));
-            CGSize size = self.size;
-            if (size.width <= 0 && imageProperties[(NSString *)kCGImagePropertyPixelWidth]) {
-                size.width = [imageProperties[(NSString *)kCGImagePropertyPixelWidth] floatValue];
-            }
-            
-            if (size.height <= 0 && imageProperties[(NSString *)kCGImagePropertyPixelHeight]) {
-                size.height = [imageProperties[(NSString *)kCGImagePropertyPixelHeight] floatValue];
-            }
-            
-            self.size = size;
-            
-            NSDictionary *jpegProperties = imageProperties[(NSString *)kCGImagePropertyJFIFDictionary];
-            NSNumber *isProgressive = jpegProperties[(NSString *)kCGImagePropertyJFIFIsProgressive];
-            self.isProgressiveJPEG = jpegProperties && [isProgressive boolValue];
-        }
-    
         if (self.size.width > maxProgressiveRenderSize.width || self.size.height > maxProgressiveRenderSize.height) {
             [self.lock unlock];
             return nil;
@@ -272,34 +257,9 @@
 
 #pragma mark - private
 
-- (BOOL)l_scanForSOSinData:(NSData *)data startByte:(NSUInteger)startByte scannedByte:(NSUInteger *)scannedByte
-{
-    //check if we have a complete scan
-    Byte scanMarker[2];
-    //SOS marker
-    scanMarker[0] = 0xFF;
-    scanMarker[1] = 0xDA;
-    
-    //scan one byte back in case we only got half the SOS on the last data append
-    NSRange scanRange;
-    scanRange.location = startByte;
-    scanRange.length = data.length - scanRange.location;
-    NSRange sosRange = [data rangeOfData:[NSData dataWithBytes:scanMarker length:2] options:0 range:scanRange];
-    if (sosRange.location != NSNotFound) {
-        if (scannedByte) {
-            *scannedByte = NSMaxRange(sosRange);
-        }
-        return YES;
-    }
-    if (scannedByte) {
-        *scannedByte = NSMaxRange(scanRange);
-    }
-    return NO;
-}
-
 - (BOOL)l_hasCompletedFirstScan
 {
-    return self.sosCount >= 2;
+    return _scanner.completedScanCount >= 1;
 }
 
 //Heavily cribbed from https://developer.apple.com/library/ios/samplecode/UIImageEffects/Listings/UIImageEffects_UIImageEffects_m.html#//apple_ref/doc/uid/DTS40013396-UIImageEffects_UIImageEffects_m-DontLinkElementID_9
@@ -349,10 +309,6 @@
 #endif
         
         vImage_Buffer effectInBuffer;
-        vImage_Buffer scratchBuffer;
-        
-        vImage_Buffer *inputBuffer;
-        vImage_Buffer *outputBuffer;
         
         vImage_CGImageFormat format = {
             .bitsPerComponent = 8,
@@ -369,73 +325,52 @@
         vImage_Error e = vImageBuffer_InitWithCGImage(&effectInBuffer, &format, NULL, inputImage.CGImage, kvImagePrintDiagnosticsToConsole);
         if (e == kvImageNoError)
         {
-            e = vImageBuffer_Init(&scratchBuffer, effectInBuffer.height, effectInBuffer.width, format.bitsPerPixel, kvImageNoFlags);
-            if (e == kvImageNoError) {
-                inputBuffer = &effectInBuffer;
-                outputBuffer = &scratchBuffer;
-                
-                // A description of how to compute the box kernel width from the Gaussian
-                // radius (aka standard deviation) appears in the SVG spec:
-                // http://www.w3.org/TR/SVG/filters.html#feGaussianBlurElement
-                //
-                // For larger values of 's' (s >= 2.0), an approximation can be used: Three
-                // successive box-blurs build a piece-wise quadratic convolution kernel, which
-                // approximates the Gaussian kernel to within roughly 3%.
-                //
-                // let d = floor(s * 3*sqrt(2*pi)/4 + 0.5)
-                //
-                // ... if d is odd, use three box-blurs of size 'd', centered on the output pixel.
-                //
-                if (radius - 2. < __FLT_EPSILON__)
-                    radius = 2.;
-                uint32_t wholeRadius = floor((radius * 3. * sqrt(2 * M_PI) / 4 + 0.5) / 2);
-                
-                wholeRadius |= 1; // force wholeRadius to be odd so that the three box-blur methodology works.
-                
-                //calculate the size necessary for vImageBoxConvolve_ARGB8888, this does not actually do any operations.
-                NSInteger tempBufferSize = vImageBoxConvolve_ARGB8888(inputBuffer, outputBuffer, NULL, 0, 0, wholeRadius, wholeRadius, NULL, kvImageGetTempBufferSize | kvImageEdgeExtend);
-                void *tempBuffer = malloc(tempBufferSize);
+            // A description of how to compute the box kernel width from the Gaussian
+            // radius (aka standard deviation) appears in the SVG spec:
+            // http://www.w3.org/TR/SVG/filters.html#feGaussianBlurElement
+            //
+            // For larger values of 's' (s >= 2.0), an approximation can be used: Three
+            // successive box-blurs build a piece-wise quadratic convolution kernel, which
+            // approximates the Gaussian kernel to within roughly 3%.
+            //
+            // let d = floor(s * 3*sqrt(2*pi)/4 + 0.5)
+            //
+            // ... if d is odd, use three box-blurs of size 'd', centered on the output pixel.
+            //
+            if (radius - 2. < __FLT_EPSILON__)
+                radius = 2.;
+            uint32_t wholeRadius = floor((radius * 3. * sqrt(2 * M_PI) / 4 + 0.5) / 2);
+            
+            wholeRadius |= 1; // force wholeRadius to be odd so that the three box-blur methodology works.
+            
+            // The kernels blur in place, with no scratch image, each box spanning wholeRadius pixels.
+            PINImageKernelsBuffer buffer = {effectInBuffer.data, effectInBuffer.width, effectInBuffer.height, effectInBuffer.rowBytes};
+            BOOL blurred = YES;
+            for (NSUInteger pass = 0; pass < 3 && blurred; pass++) {
+                blurred = PINImageKernelsBoxBlur(&buffer, wholeRadius / 2);
+            }
+            
+            if (blurred) {
+                CGImageRef effectCGImage = vImageCreateCGImageFromBuffer(&effectInBuffer, &format, &cleanupBuffer, NULL, kvImageNoAllocate, NULL);
+                if (effectCGImage == NULL) {
+                    //if creating the cgimage failed, the cleanup buffer on input buffer will not be called, we must dealloc ourselves
+                    free(effectInBuffer.data);
+                } else {
+                    // draw effect image
+                    CGContextSaveGState(ctx);
+                    CGContextDrawImage(ctx, CGRectMake(0, 0, inputSize.width, inputSize.height), effectCGImage);
+                    CGContextRestoreGState(ctx);
+                    CGImageRelease(effectCGImage);
+                }
                 
-                if (tempBuffer) {
-                    //errors can be ignored because we've passed in allocated memory
-                    vImageBoxConvolve_ARGB8888(inputBuffer, outputBuffer, tempBuffer, 0, 0, wholeRadius, wholeRadius, NULL, kvImageEdgeExtend);
-                    vImageBoxConvolve_ARGB8888(outputBuffer, inputBuffer, tempBuffer, 0, 0, wholeRadius, wholeRadius, NULL, kvImageEdgeExtend);
-                    vImageBoxConvolve_ARGB8888(inputBuffer, outputBuffer, tempBuffer, 0, 0, wholeRadius, wholeRadius, NULL, kvImageEdgeExtend);
-                    
-                    free(tempBuffer);
-                    
-                    //switch input and output
-                    vImage_Buffer *temp = inputBuffer;
-                    inputBuffer = outputBuffer;
-                    outputBuffer = temp;
-                    
-                    CGImageRef effectCGImage = vImageCreateCGImageFromBuffer(inputBuffer, &format, &cleanupBuffer, NULL, kvImageNoAllocate, NULL);
-                    if (effectCGImage == NULL) {
-                        //if creating the cgimage failed, the cleanup buffer on input buffer will not be called, we must dealloc ourselves
-                        free(inputBuffer->data);
-                    } else {
-                        // draw effect image
-                        CGContextSaveGState(ctx);
-                        CGContextDrawImage(ctx, CGRectMake(0, 0, inputSize.width, inputSize.height), effectCGImage);
-                        CGContextRestoreGState(ctx);
-                        CGImageRelease(effectCGImage);
-                    }
-                    
-                    // Cleanup
-                    free(outputBuffer->data);
 #if PIN_TARGET_IOS
-                    outputImage = UIGraphicsGetImageFromCurrentImageContext();
+                outputImage = UIGraphicsGetImageFromCurrentImageContext();
 #elif PIN_TARGET_MAC
-                    CGImageRef outputImageRef = CGBitmapContextCreateImage(ctx);
-                    outputImage = [[NSImage alloc] initWithCGImage:outputImageRef size:inputSize];
-                    CFRelease(outputImageRef);
+                CGImageRef outputImageRef = CGBitmapContextCreateImage(ctx);
+                outputImage = [[NSImage alloc] initWithCGImage:outputImageRef size:inputSize];
+                CFRelease(outputImageRef);
 #endif
-                    
-                }
             } else {
-                if (scratchBuffer.data) {
-                    free(scratchBuffer.data);
-                }
                 free(effectInBuffer.data);
             }
         } else {
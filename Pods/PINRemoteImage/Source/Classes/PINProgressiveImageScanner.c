@@ -0,0 +1,456 @@
+//
+//  PINProgressiveImageScanner.c
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#include "PINProgressiveImageScanner.h"
+
+#include <string.h>
+
+enum {
+    PINProgressiveImageScannerStateSignature,
+    /** Between JPEG segments, expecting the 0xFF of the next marker. */
+    PINProgressiveImageScannerStateJPEGMarker,
+    PINProgressiveImageScannerStateJPEGMarkerCode,
+    PINProgressiveImageScannerStateJPEGLength,
+    /** Reading the start of a SOF or DNL segment. */
+    PINProgressiveImageScannerStateJPEGSegment,
+    PINProgressiveImageScannerStateJPEGEntropy,
+    /** After a 0xFF in entropy-coded data, which is stuffing, a restart or the end of the scan. */
+    PINProgressiveImageScannerStateJPEGEntropyMarker,
+    PINProgressiveImageScannerStatePNGChunkHeader,
+    PINProgressiveImageScannerStatePNGHeader,
+    /** Skipping a chunk's data and CRC. */
+    PINProgressiveImageScannerStatePNGChunkData,
+    PINProgressiveImageScannerStateGIFScreen,
+    PINProgressiveImageScannerStateGIFBlock,
+    PINProgressiveImageScannerStateGIFExtensionLabel,
+    PINProgressiveImageScannerStateGIFImageDescriptor,
+    PINProgressiveImageScannerStateGIFCodeSize,
+    PINProgressiveImageScannerStateGIFSubBlockSize,
+    PINProgressiveImageScannerStateSkip,
+};
+
+/** What `marker` holds for PNG chunks and GIF sub-blocks. */
+enum {
+    PINProgressiveImageScannerChunkOther,
+    PINProgressiveImageScannerChunkImageData,
+    PINProgressiveImageScannerChunkEnd,
+};
+
+static const uint8_t PINProgressiveImageScannerJPEGSignature[] = { 0xFF, 0xD8 };
+static const uint8_t PINProgressiveImageScannerPNGSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+static const uint8_t PINProgressiveImageScannerGIF87Signature[] = { 'G', 'I', 'F', '8', '7', 'a' };
+static const uint8_t PINProgressiveImageScannerGIF89Signature[] = { 'G', 'I', 'F', '8', '9', 'a' };
+
+void PINProgressiveImageScannerInit(PINProgressiveImageScanner *scanner)
+{
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->state = PINProgressiveImageScannerStateSignature;
+    scanner->fieldCapacity = sizeof(PINProgressiveImageScannerPNGSignature);
+}
+
+// MARK: - Helpers
+
+static uint16_t PINProgressiveImageScannerBigEndian16(const uint8_t *bytes)
+{
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static uint32_t PINProgressiveImageScannerBigEndian32(const uint8_t *bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static uint16_t PINProgressiveImageScannerLittleEndian16(const uint8_t *bytes)
+{
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static void PINProgressiveImageScannerExpectField(PINProgressiveImageScanner *scanner, int state, uint8_t length)
+{
+    scanner->state = state;
+    scanner->fieldLength = 0;
+    scanner->fieldCapacity = length;
+}
+
+static void PINProgressiveImageScannerSkip(PINProgressiveImageScanner *scanner, uint64_t length, int nextState)
+{
+    if (length == 0) {
+        scanner->state = nextState;
+    } else {
+        scanner->state = PINProgressiveImageScannerStateSkip;
+        scanner->remaining = length;
+        scanner->nextState = nextState;
+    }
+}
+
+/** Copies bytes into `field` until it's full, returning whether it is. */
+static bool PINProgressiveImageScannerCollect(PINProgressiveImageScanner *scanner, const uint8_t **cursor, const uint8_t *end)
+{
+    size_t wanted = scanner->fieldCapacity - scanner->fieldLength;
+    size_t available = (size_t)(end - *cursor);
+    size_t length = wanted < available ? wanted : available;
+    memcpy(scanner->field + scanner->fieldLength, *cursor, length);
+    scanner->fieldLength += (uint8_t)length;
+    *cursor += length;
+    return scanner->fieldLength == scanner->fieldCapacity;
+}
+
+static bool PINProgressiveImageScannerMatches(const PINProgressiveImageScanner *scanner, const uint8_t *signature, size_t signatureLength)
+{
+    size_t length = scanner->fieldLength < signatureLength ? scanner->fieldLength : signatureLength;
+    return memcmp(scanner->field, signature, length) == 0;
+}
+
+// MARK: - Formats
+
+static void PINProgressiveImageScannerSignature(PINProgressiveImageScanner *scanner)
+{
+    bool jpeg = PINProgressiveImageScannerMatches(scanner, PINProgressiveImageScannerJPEGSignature, sizeof(PINProgressiveImageScannerJPEGSignature));
+    bool png = PINProgressiveImageScannerMatches(scanner, PINProgressiveImageScannerPNGSignature, sizeof(PINProgressiveImageScannerPNGSignature));
+    bool gif = PINProgressiveImageScannerMatches(scanner, PINProgressiveImageScannerGIF87Signature, sizeof(PINProgressiveImageScannerGIF87Signature))
+            || PINProgressiveImageScannerMatches(scanner, PINProgressiveImageScannerGIF89Signature, sizeof(PINProgressiveImageScannerGIF89Signature));
+
+    if (jpeg && scanner->fieldLength == sizeof(PINProgressiveImageScannerJPEGSignature)) {
+        scanner->format = PINProgressiveImageScannerFormatJPEG;
+        scanner->state = PINProgressiveImageScannerStateJPEGMarker;
+    } else if (png && scanner->fieldLength == sizeof(PINProgressiveImageScannerPNGSignature)) {
+        scanner->format = PINProgressiveImageScannerFormatPNG;
+        PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStatePNGChunkHeader, 8);
+    } else if (gif && scanner->fieldLength == sizeof(PINProgressiveImageScannerGIF87Signature)) {
+        scanner->format = PINProgressiveImageScannerFormatGIF;
+        PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStateGIFScreen, 7);
+    } else if (jpeg == false && png == false && gif == false) {
+        scanner->status = PINProgressiveImageScannerStatusInvalid;
+    }
+}
+
+static bool PINProgressiveImageScannerIsJPEGFrameMarker(uint8_t marker)
+{
+    // SOF0-SOF15, except DHT, JPG and DAC which share the range.
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+/** Acts on a JPEG marker code, once whatever it follows is done with. */
+static void PINProgressiveImageScannerJPEGMarker(PINProgressiveImageScanner *scanner, uint8_t marker)
+{
+    if (marker == 0xD9) {
+        scanner->status = PINProgressiveImageScannerStatusFinished;
+    } else if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+        // Markers without a segment: SOI, TEM and restarts.
+        scanner->state = PINProgressiveImageScannerStateJPEGMarker;
+    } else {
+        scanner->marker = marker;
+        PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStateJPEGLength, 2);
+    }
+}
+
+static void PINProgressiveImageScannerJPEGLength(PINProgressiveImageScanner *scanner)
+{
+    uint16_t length = PINProgressiveImageScannerBigEndian16(scanner->field);
+    if (length < 2) {
+        scanner->status = PINProgressiveImageScannerStatusInvalid;
+        return;
+    }
+    uint16_t payloadLength = length - 2;
+    uint8_t fieldLength = 0;
+    if (PINProgressiveImageScannerIsJPEGFrameMarker(scanner->marker)) {
+        // Precision, height and width.
+        fieldLength = 5;
+    } else if (scanner->marker == 0xDC) {
+        // DNL, the height of a frame header that left it at 0.
+        fieldLength = 2;
+    } else if (scanner->marker == 0xDA) {
+        scanner->scanCount++;
+        PINProgressiveImageScannerSkip(scanner, payloadLength, PINProgressiveImageScannerStateJPEGEntropy);
+        return;
+    } else {
+        PINProgressiveImageScannerSkip(scanner, payloadLength, PINProgressiveImageScannerStateJPEGMarker);
+        return;
+    }
+    if (payloadLength < fieldLength) {
+        scanner->status = PINProgressiveImageScannerStatusInvalid;
+        return;
+    }
+    scanner->remaining = payloadLength - fieldLength;
+    PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStateJPEGSegment, fieldLength);
+}
+
+static void PINProgressiveImageScannerJPEGSegment(PINProgressiveImageScanner *scanner)
+{
+    if (scanner->marker == 0xDC) {
+        if (scanner->height == 0) {
+            scanner->height = PINProgressiveImageScannerBigEndian16(scanner->field);
+        }
+    } else if (scanner->width == 0) {
+        // Only the first frame header counts; hierarchical JPEGs have more.
+        scanner->height = PINProgressiveImageScannerBigEndian16(scanner->field + 1);
+        scanner->width = PINProgressiveImageScannerBigEndian16(scanner->field + 3);
+        scanner->progressive = scanner->marker == 0xC2 || scanner->marker == 0xC6 || scanner->marker == 0xCA || scanner->marker == 0xCE;
+        if (scanner->width == 0) {
+            scanner->status = PINProgressiveImageScannerStatusInvalid;
+            return;
+        }
+    }
+    PINProgressiveImageScannerSkip(scanner, scanner->remaining, PINProgressiveImageScannerStateJPEGMarker);
+}
+
+static void PINProgressiveImageScannerPNGChunkHeader(PINProgressiveImageScanner *scanner)
+{
+    uint32_t length = PINProgressiveImageScannerBigEndian32(scanner->field);
+    const uint8_t *type = scanner->field + 4;
+    if (length > INT32_MAX) {
+        scanner->status = PINProgressiveImageScannerStatusInvalid;
+        return;
+    }
+    bool header = memcmp(type, "IHDR", 4) == 0;
+    // IHDR comes first, and only then.
+    if (header != (scanner->width == 0)) {
+        scanner->status = PINProgressiveImageScannerStatusInvalid;
+        return;
+    }
+    if (header) {
+        if (length != 13) {
+            scanner->status = PINProgressiveImageScannerStatusInvalid;
+            return;
+        }
+        PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStatePNGHeader, 13);
+        return;
+    }
+    if (memcmp(type, "IDAT", 4) == 0) {
+        scanner->scanCount++;
+        scanner->marker = PINProgressiveImageScannerChunkImageData;
+    } else if (memcmp(type, "IEND", 4) == 0) {
+        scanner->marker = PINProgressiveImageScannerChunkEnd;
+    } else {
+        scanner->marker = PINProgressiveImageScannerChunkOther;
+    }
+    scanner->state = PINProgressiveImageScannerStatePNGChunkData;
+    scanner->remaining = (uint64_t)length + 4;
+}
+
+static void PINProgressiveImageScannerPNGHeader(PINProgressiveImageScanner *scanner)
+{
+    uint32_t width = PINProgressiveImageScannerBigEndian32(scanner->field);
+    uint32_t height = PINProgressiveImageScannerBigEndian32(scanner->field + 4);
+    if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX) {
+        scanner->status = PINProgressiveImageScannerStatusInvalid;
+        return;
+    }
+    scanner->width = width;
+    scanner->height = height;
+    scanner->progressive = scanner->field[12] == 1;
+    // Past the CRC, the next chunk header is read into `field`.
+    PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStatePNGChunkHeader, 8);
+    PINProgressiveImageScannerSkip(scanner, 4, PINProgressiveImageScannerStatePNGChunkHeader);
+}
+
+static void PINProgressiveImageScannerGIFScreen(PINProgressiveImageScanner *scanner)
+{
+    scanner->width = PINProgressiveImageScannerLittleEndian16(scanner->field);
+    scanner->height = PINProgressiveImageScannerLittleEndian16(scanner->field + 2);
+    uint8_t packed = scanner->field[4];
+    uint64_t colorTableLength = (packed & 0x80) ? 3u << ((packed & 0x07) + 1) : 0;
+    PINProgressiveImageScannerSkip(scanner, colorTableLength, PINProgressiveImageScannerStateGIFBlock);
+}
+
+static void PINProgressiveImageScannerGIFImageDescriptor(PINProgressiveImageScanner *scanner)
+{
+    uint8_t packed = scanner->field[8];
+    scanner->scanCount++;
+    if (scanner->scanCount == 1) {
+        scanner->progressive = (packed & 0x40) != 0;
+        // Some encoders leave the logical screen at 0 and size the frame instead.
+        if (scanner->width == 0 || scanner->height == 0) {
+            scanner->width = PINProgressiveImageScannerLittleEndian16(scanner->field + 4);
+            scanner->height = PINProgressiveImageScannerLittleEndian16(scanner->field + 6);
+        }
+    }
+    uint64_t colorTableLength = (packed & 0x80) ? 3u << ((packed & 0x07) + 1) : 0;
+    PINProgressiveImageScannerSkip(scanner, colorTableLength, PINProgressiveImageScannerStateGIFCodeSize);
+}
+
+// MARK: - Scanning
+
+void PINProgressiveImageScannerScan(PINProgressiveImageScanner *scanner, const uint8_t *bytes, size_t length)
+{
+    const uint8_t *cursor = bytes;
+    const uint8_t *end = bytes + length;
+    uint64_t start = scanner->scannedLength;
+#define PINProgressiveImageScannerOffset() (start + (uint64_t)(cursor - bytes))
+
+    while (cursor < end && scanner->status == PINProgressiveImageScannerStatusScanning) {
+        switch (scanner->state) {
+            case PINProgressiveImageScannerStateSignature:
+                scanner->field[scanner->fieldLength++] = *cursor++;
+                PINProgressiveImageScannerSignature(scanner);
+                break;
+
+            case PINProgressiveImageScannerStateJPEGMarker: {
+                // Anything but 0xFF between segments is garbage, which decoders skip.
+                const uint8_t *found = memchr(cursor, 0xFF, (size_t)(end - cursor));
+                if (found == NULL) {
+                    cursor = end;
+                } else {
+                    cursor = found + 1;
+                    scanner->state = PINProgressiveImageScannerStateJPEGMarkerCode;
+                }
+                break;
+            }
+
+            case PINProgressiveImageScannerStateJPEGMarkerCode: {
+                uint8_t marker = *cursor++;
+                if (marker == 0x00) {
+                    scanner->state = PINProgressiveImageScannerStateJPEGMarker;
+                } else if (marker != 0xFF) {
+                    PINProgressiveImageScannerJPEGMarker(scanner, marker);
+                }
+                break;
+            }
+
+            case PINProgressiveImageScannerStateJPEGLength:
+                if (PINProgressiveImageScannerCollect(scanner, &cursor, end)) {
+                    PINProgressiveImageScannerJPEGLength(scanner);
+                }
+                break;
+
+            case PINProgressiveImageScannerStateJPEGSegment:
+                if (PINProgressiveImageScannerCollect(scanner, &cursor, end)) {
+                    PINProgressiveImageScannerJPEGSegment(scanner);
+                }
+                break;
+
+            case PINProgressiveImageScannerStateJPEGEntropy: {
+                const uint8_t *found = memchr(cursor, 0xFF, (size_t)(end - cursor));
+                if (found == NULL) {
+                    cursor = end;
+                } else {
+                    cursor = found;
+                    scanner->markerOffset = PINProgressiveImageScannerOffset();
+                    cursor++;
+                    scanner->state = PINProgressiveImageScannerStateJPEGEntropyMarker;
+                }
+                break;
+            }
+
+            case PINProgressiveImageScannerStateJPEGEntropyMarker: {
+                uint8_t marker = *cursor++;
+                if (marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7)) {
+                    // Stuffing or a restart, both part of the scan.
+                    scanner->state = PINProgressiveImageScannerStateJPEGEntropy;
+                } else if (marker != 0xFF) {
+                    scanner->completedScanCount++;
+                    scanner->completedScanEnd = scanner->markerOffset;
+                    PINProgressiveImageScannerJPEGMarker(scanner, marker);
+                }
+                break;
+            }
+
+            case PINProgressiveImageScannerStatePNGChunkHeader:
+                if (PINProgressiveImageScannerCollect(scanner, &cursor, end)) {
+                    PINProgressiveImageScannerPNGChunkHeader(scanner);
+                }
+                break;
+
+            case PINProgressiveImageScannerStatePNGHeader:
+                if (PINProgressiveImageScannerCollect(scanner, &cursor, end)) {
+                    PINProgressiveImageScannerPNGHeader(scanner);
+                }
+                break;
+
+            case PINProgressiveImageScannerStatePNGChunkData: {
+                size_t available = (size_t)(end - cursor);
+                size_t skipped = scanner->remaining < available ? (size_t)scanner->remaining : available;
+                cursor += skipped;
+                scanner->remaining -= skipped;
+                if (scanner->remaining > 0) {
+                    break;
+                }
+                if (scanner->marker == PINProgressiveImageScannerChunkImageData) {
+                    scanner->completedScanCount++;
+                    scanner->completedScanEnd = PINProgressiveImageScannerOffset();
+                } else if (scanner->marker == PINProgressiveImageScannerChunkEnd) {
+                    scanner->status = PINProgressiveImageScannerStatusFinished;
+                    break;
+                }
+                PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStatePNGChunkHeader, 8);
+                break;
+            }
+
+            case PINProgressiveImageScannerStateGIFScreen:
+                if (PINProgressiveImageScannerCollect(scanner, &cursor, end)) {
+                    PINProgressiveImageScannerGIFScreen(scanner);
+                }
+                break;
+
+            case PINProgressiveImageScannerStateGIFBlock: {
+                uint8_t introducer = *cursor;
+                if (introducer == 0x21) {
+                    scanner->state = PINProgressiveImageScannerStateGIFExtensionLabel;
+                } else if (introducer == 0x2C) {
+                    PINProgressiveImageScannerExpectField(scanner, PINProgressiveImageScannerStateGIFImageDescriptor, 9);
+                } else if (introducer == 0x3B) {
+                    scanner->status = PINProgressiveImageScannerStatusFinished;
+                } else {
+                    scanner->status = PINProgressiveImageScannerStatusInvalid;
+                    break;
+                }
+                cursor++;
+                break;
+            }
+
+            case PINProgressiveImageScannerStateGIFExtensionLabel:
+                cursor++;
+                scanner->marker = PINProgressiveImageScannerChunkOther;
+                scanner->state = PINProgressiveImageScannerStateGIFSubBlockSize;
+                break;
+
+            case PINProgressiveImageScannerStateGIFImageDescriptor:
+                if (PINProgressiveImageScannerCollect(scanner, &cursor, end)) {
+                    PINProgressiveImageScannerGIFImageDescriptor(scanner);
+                }
+                break;
+
+            case PINProgressiveImageScannerStateGIFCodeSize:
+                cursor++;
+                scanner->marker = PINProgressiveImageScannerChunkImageData;
+                scanner->state = PINProgressiveImageScannerStateGIFSubBlockSize;
+                break;
+
+            case PINProgressiveImageScannerStateGIFSubBlockSize: {
+                uint8_t size = *cursor++;
+                if (size > 0) {
+                    PINProgressiveImageScannerSkip(scanner, size, PINProgressiveImageScannerStateGIFSubBlockSize);
+                    break;
+                }
+                if (scanner->marker == PINProgressiveImageScannerChunkImageData) {
+                    scanner->completedScanCount++;
+                    scanner->completedScanEnd = PINProgressiveImageScannerOffset();
+                }
+                scanner->state = PINProgressiveImageScannerStateGIFBlock;
+                break;
+            }
+
+            case PINProgressiveImageScannerStateSkip: {
+                size_t available = (size_t)(end - cursor);
+                size_t skipped = scanner->remaining < available ? (size_t)scanner->remaining : available;
+                cursor += skipped;
+                scanner->remaining -= skipped;
+                if (scanner->remaining == 0) {
+                    scanner->state = scanner->nextState;
+                }
+                break;
+            }
+
+            default:
+                scanner->status = PINProgressiveImageScannerStatusInvalid;
+                break;
+        }
+    }
+
+    scanner->scannedLength = PINProgressiveImageScannerOffset();
+#undef PINProgressiveImageScannerOffset
+}
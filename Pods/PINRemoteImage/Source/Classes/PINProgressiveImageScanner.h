@@ -0,0 +1,89 @@
+//
+//  PINProgressiveImageScanner.h
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#ifndef PINProgressiveImageScanner_h
+#define PINProgressiveImageScanner_h
+
+// Plain C with no Foundation dependency, so the scanner can be built, fuzzed
+// and benchmarked on its own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    PINProgressiveImageScannerFormatUnknown,
+    PINProgressiveImageScannerFormatJPEG,
+    PINProgressiveImageScannerFormatPNG,
+    PINProgressiveImageScannerFormatGIF,
+} PINProgressiveImageScannerFormat;
+
+typedef enum {
+    /** More bytes are expected. */
+    PINProgressiveImageScannerStatusScanning,
+    /** The end of the image (EOI, IEND or the GIF trailer) was read. Later bytes are ignored. */
+    PINProgressiveImageScannerStatusFinished,
+    /** The bytes aren't a JPEG, PNG or GIF, or their structure is broken. Later bytes are ignored. */
+    PINProgressiveImageScannerStatusInvalid,
+} PINProgressiveImageScannerStatus;
+
+/**
+ Follows the container structure of a JPEG, PNG or GIF as its bytes arrive,
+ in chunks of any size, without looking at a byte twice or keeping any.
+
+ It learns the dimensions from the JPEG frame header, PNG IHDR or GIF
+ logical screen descriptor as soon as those arrive, and counts scans: JPEG
+ SOS segments, PNG IDAT chunks and GIF frames. A scan is complete once the
+ structure following it starts, which for JPEG is the next marker other
+ than a restart. Only the structure is checked; entropy-coded and
+ compressed data, and PNG CRCs, are left to the decoder.
+
+ Not thread safe.
+ */
+typedef struct {
+    PINProgressiveImageScannerFormat format;
+    PINProgressiveImageScannerStatus status;
+    /** 0 until known. */
+    uint32_t width;
+    uint32_t height;
+    /** A progressive JPEG, an interlaced PNG, or a GIF whose first frame is interlaced. */
+    bool progressive;
+    /** Scans started. */
+    uint32_t scanCount;
+    uint32_t completedScanCount;
+    /** Where the last complete scan's data ends, so decoding up to here decodes whole scans. */
+    uint64_t completedScanEnd;
+    /** Bytes consumed, which stops growing once finished or invalid. */
+    uint64_t scannedLength;
+
+    // Parser state.
+    int state;
+    /** The state to return to after skipping `remaining` bytes or reading GIF sub-blocks. */
+    int nextState;
+    uint64_t remaining;
+    uint8_t marker;
+    uint8_t fieldLength;
+    uint8_t fieldCapacity;
+    uint8_t field[16];
+    /** Where a run of 0xFF ending JPEG entropy-coded data began. */
+    uint64_t markerOffset;
+} PINProgressiveImageScanner;
+
+void PINProgressiveImageScannerInit(PINProgressiveImageScanner *scanner);
+
+/** Consumes the next bytes of the image. */
+void PINProgressiveImageScannerScan(PINProgressiveImageScanner *scanner, const uint8_t *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINProgressiveImageScanner_h
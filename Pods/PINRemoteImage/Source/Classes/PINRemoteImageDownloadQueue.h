@@ -19,9 +19,13 @@ typedef void (^PINRemoteImageDownloadCompletion)(NSURLResponse * _Nullable respo
 @interface PINRemoteImageDownloadQueue : NSObject
 
 @property (atomic, assign) NSUInteger maxNumberOfConcurrentDownloads;
+/** How many of them may be to the same host; 0 for no limit. */
+@property (atomic, assign) NSUInteger maxNumberOfConcurrentDownloadsPerHost;
 
 - (instancetype)init NS_UNAVAILABLE;
 + (PINRemoteImageDownloadQueue *)queueWithMaxConcurrentDownloads:(NSUInteger)maxNumberOfConcurrentDownloads;
++ (PINRemoteImageDownloadQueue *)queueWithMaxConcurrentDownloads:(NSUInteger)maxNumberOfConcurrentDownloads
+                                   maxConcurrentDownloadsPerHost:(NSUInteger)maxNumberOfConcurrentDownloadsPerHost;
 
 - (NSURLSessionDataTask *)addDownloadWithSessionManager:(PINURLSessionManager *)sessionManager
                                                 request:(NSURLRequest *)request
@@ -30,7 +34,7 @@ typedef void (^PINRemoteImageDownloadCompletion)(NSURLResponse * _Nullable respo
 
 /***
  This prevents a task from being run if it hasn't already started yet. It is the caller's responsibility to cancel
- the task if it has already been started.
+ the task if it has already been started. A task suspended to make room for a higher priority one counts as started.
  
  @return BOOL Returns YES if the task was in the queue. 
  */
@@ -38,7 +42,7 @@ typedef void (^PINRemoteImageDownloadCompletion)(NSURLResponse * _Nullable respo
 
 /*
  This sets the tasks priority of execution. It is the caller's responsibility to set the priority on the task itself
- for NSURLSessionManager.
+ for NSURLSessionManager. Raising a task may suspend running tasks of lower priority until there's room again.
  */
 - (void)setQueuePriority:(PINRemoteImageManagerPriority)priority forTask:(NSURLSessionDataTask *)downloadTask;
 
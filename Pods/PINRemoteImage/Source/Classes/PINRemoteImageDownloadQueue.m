@@ -9,16 +9,20 @@
 #import "PINRemoteImageDownloadQueue.h"
 
 #import <PINRemoteImage/PINURLSessionManager.h>
+#import "PINRemoteImageDownloadScheduler.h"
 #import "PINRemoteLock.h"
+#import "PINSpeedRecorder.h"
+
+static const NSUInteger PINRemoteImageDownloadQueueActionCount = 16;
 
 @interface PINRemoteImageDownloadQueue ()
 {
     PINRemoteLock *_lock;
     
-    NSMutableOrderedSet <NSURLSessionDataTask *> *_highPriorityQueuedOperations;
-    NSMutableOrderedSet <NSURLSessionDataTask *> *_defaultPriorityQueuedOperations;
-    NSMutableOrderedSet <NSURLSessionDataTask *> *_lowPriorityQueuedOperations;
-    NSMutableSet <NSURLSessionTask *> *_runningTasks;
+    PINRemoteImageDownloadScheduler *_scheduler;
+    // The scheduler refers to tasks without retaining them.
+    NSMutableSet <NSURLSessionDataTask *> *_tasks;
+    NSMutableSet <NSURLSessionDataTask *> *_preemptedTasks;
 }
 
 @end
@@ -26,26 +30,44 @@
 @implementation PINRemoteImageDownloadQueue
 
 @synthesize maxNumberOfConcurrentDownloads = _maxNumberOfConcurrentDownloads;
+@synthesize maxNumberOfConcurrentDownloadsPerHost = _maxNumberOfConcurrentDownloadsPerHost;
+
++ (PINRemoteImageDownloadQueue *)queueWithMaxConcurrentDownloads:(NSUInteger)maxNumberOfConcurrentDownloads
+{
+    return [self queueWithMaxConcurrentDownloads:maxNumberOfConcurrentDownloads maxConcurrentDownloadsPerHost:0];
+}
 
 + (PINRemoteImageDownloadQueue *)queueWithMaxConcurrentDownloads:(NSUInteger)maxNumberOfConcurrentDownloads
+                                   maxConcurrentDownloadsPerHost:(NSUInteger)maxNumberOfConcurrentDownloadsPerHost
 {
-    return [[PINRemoteImageDownloadQueue alloc] initWithMaxConcurrentDownloads:maxNumberOfConcurrentDownloads];
+    return [[PINRemoteImageDownloadQueue alloc] initWithMaxConcurrentDownloads:maxNumberOfConcurrentDownloads
+                                                 maxConcurrentDownloadsPerHost:maxNumberOfConcurrentDownloadsPerHost];
 }
 
 - (PINRemoteImageDownloadQueue *)initWithMaxConcurrentDownloads:(NSUInteger)maxNumberOfConcurrentDownloads
+                                  maxConcurrentDownloadsPerHost:(NSUInteger)maxNumberOfConcurrentDownloadsPerHost
 {
     if (self = [super init]) {
         _maxNumberOfConcurrentDownloads = maxNumberOfConcurrentDownloads;
+        _maxNumberOfConcurrentDownloadsPerHost = maxNumberOfConcurrentDownloadsPerHost;
 
         _lock = [[PINRemoteLock alloc] initWithName:@"PINRemoteImageDownloadQueue Lock"];
-        _highPriorityQueuedOperations = [[NSMutableOrderedSet alloc] init];
-        _defaultPriorityQueuedOperations = [[NSMutableOrderedSet alloc] init];
-        _lowPriorityQueuedOperations = [[NSMutableOrderedSet alloc] init];
-        _runningTasks = [[NSMutableSet alloc] init];
+        _scheduler = PINRemoteImageDownloadSchedulerCreate((uint32_t)MIN(maxNumberOfConcurrentDownloads, UINT32_MAX),
+                                                           (uint32_t)MIN(maxNumberOfConcurrentDownloadsPerHost, UINT32_MAX));
+        if (_scheduler == NULL) {
+            return nil;
+        }
+        _tasks = [[NSMutableSet alloc] init];
+        _preemptedTasks = [[NSMutableSet alloc] init];
     }
     return self;
 }
 
+- (void)dealloc
+{
+    PINRemoteImageDownloadSchedulerDestroy(_scheduler);
+}
+
 - (NSUInteger)maxNumberOfConcurrentDownloads
 {
     [self lock];
@@ -58,11 +80,36 @@
 {
     [self lock];
         _maxNumberOfConcurrentDownloads = maxNumberOfConcurrentDownloads;
+        [self l_updateLimits];
+    [self unlock];
+    
+    [self scheduleDownloadsIfNeeded];
+}
+
+- (NSUInteger)maxNumberOfConcurrentDownloadsPerHost
+{
+    [self lock];
+        NSUInteger maxNumberOfConcurrentDownloadsPerHost = _maxNumberOfConcurrentDownloadsPerHost;
+    [self unlock];
+    return maxNumberOfConcurrentDownloadsPerHost;
+}
+
+- (void)setMaxNumberOfConcurrentDownloadsPerHost:(NSUInteger)maxNumberOfConcurrentDownloadsPerHost
+{
+    [self lock];
+        _maxNumberOfConcurrentDownloadsPerHost = maxNumberOfConcurrentDownloadsPerHost;
+        [self l_updateLimits];
     [self unlock];
     
     [self scheduleDownloadsIfNeeded];
 }
 
+- (void)l_updateLimits
+{
+    PINRemoteImageDownloadSchedulerSetLimits(_scheduler, (uint32_t)MIN(_maxNumberOfConcurrentDownloads, UINT32_MAX),
+                                             (uint32_t)MIN(_maxNumberOfConcurrentDownloadsPerHost, UINT32_MAX));
+}
+
 - (NSURLSessionDataTask *)addDownloadWithSessionManager:(PINURLSessionManager *)sessionManager
                                                 request:(NSURLRequest *)request
                                                priority:(PINRemoteImageManagerPriority)priority
@@ -72,59 +119,88 @@
                                                                 priority:priority
                                                        completionHandler:^(NSURLSessionTask *task, NSError *error) {
                                                            completionHandler(task.response, error);
+                                                           // PINSpeedRecorder has this task's metrics by now.
+                                                           [self updateSpeedForHost:task.originalRequest.URL.host];
                                                            [self lock];
-                                                               [self->_runningTasks removeObject:task];
+                                                               PINRemoteImageDownloadSchedulerFinish(self->_scheduler, (__bridge void *)task);
+                                                               [self->_tasks removeObject:(NSURLSessionDataTask *)task];
+                                                               [self->_preemptedTasks removeObject:(NSURLSessionDataTask *)task];
                                                            [self unlock];
 
                                                            [self scheduleDownloadsIfNeeded];
                                                        }];
 
-    [self setQueuePriority:priority forTask:dataTask addIfNecessary:YES];
+    NSString *host = request.URL.host ?: @"";
+    NSString *URLString = request.URL.absoluteString ?: @"";
+    [self updateSpeedForHost:host];
+    [self lock];
+        const char *hostBytes = host.UTF8String;
+        const char *URLBytes = URLString.UTF8String;
+        if (PINRemoteImageDownloadSchedulerAdd(_scheduler, (__bridge void *)dataTask, hostBytes, strlen(hostBytes), URLBytes, strlen(URLBytes),
+                                               [self schedulerPriority:priority], 0, CACurrentMediaTime())) {
+            [_tasks addObject:dataTask];
+        } else {
+            // Out of memory: run it rather than lose it.
+            [dataTask resume];
+        }
+    [self unlock];
 
     [self scheduleDownloadsIfNeeded];
 
     return dataTask;
 }
 
+- (void)updateSpeedForHost:(NSString *)host
+{
+    if (host == nil) {
+        return;
+    }
+    PINSpeedRecorder *recorder = [PINSpeedRecorder sharedRecorder];
+    double bytesPerSecond = [recorder weightedAdjustedBytesPerSecondForHost:host];
+    NSTimeInterval timeToFirstByte = [recorder weightedTimeToFirstByteForHost:host];
+    const char *hostBytes = host.UTF8String;
+    [self lock];
+        PINRemoteImageDownloadSchedulerSetHostSpeed(_scheduler, hostBytes, strlen(hostBytes), bytesPerSecond, timeToFirstByte);
+    [self unlock];
+}
+
+- (uint32_t)schedulerPriority:(PINRemoteImageManagerPriority)priority
+{
+    NSAssert(priority < PINRemoteImageDownloadSchedulerPriorityCount, @"invalid priority: %tu", priority);
+    return (uint32_t)MIN(priority, (NSUInteger)PINRemoteImageManagerPriorityHigh);
+}
+
 - (void)scheduleDownloadsIfNeeded
 {
+    PINRemoteImageDownloadSchedulerAction actions[PINRemoteImageDownloadQueueActionCount];
     [self lock];
-        while (_runningTasks.count < _maxNumberOfConcurrentDownloads) {
-            NSMutableOrderedSet <NSURLSessionDataTask *> *queue = nil;
-            if (_highPriorityQueuedOperations.count > 0) {
-                queue = _highPriorityQueuedOperations;
-            } else if (_defaultPriorityQueuedOperations.count > 0) {
-                queue = _defaultPriorityQueuedOperations;
-            } else if (_lowPriorityQueuedOperations.count > 0) {
-                queue = _lowPriorityQueuedOperations;
+        size_t count;
+        while ((count = PINRemoteImageDownloadSchedulerNext(_scheduler, actions, PINRemoteImageDownloadQueueActionCount)) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                NSURLSessionDataTask *task = (__bridge NSURLSessionDataTask *)actions[i].context;
+                if (actions[i].kind == PINRemoteImageDownloadSchedulerActionStart) {
+                    [_preemptedTasks removeObject:task];
+                    [task resume];
+                } else {
+                    [_preemptedTasks addObject:task];
+                    [task suspend];
+                }
             }
-            
-            if (!queue) {
-                break;
-            }
-            
-            NSURLSessionDataTask *task = [queue firstObject];
-            [queue removeObjectAtIndex:0];
-            [task resume];
-            
-            [_runningTasks addObject:task];
         }
     [self unlock];
 }
 
 - (BOOL)removeDownloadTaskFromQueue:(NSURLSessionDataTask *)downloadTask
 {
-    BOOL containsTask = NO;
     [self lock];
-        if ([_highPriorityQueuedOperations containsObject:downloadTask]) {
-            containsTask = YES;
-            [_highPriorityQueuedOperations removeObject:downloadTask];
-        } else if ([_defaultPriorityQueuedOperations containsObject:downloadTask]) {
-            containsTask = YES;
-            [_defaultPriorityQueuedOperations removeObject:downloadTask];
-        } else if ([_lowPriorityQueuedOperations containsObject:downloadTask]) {
-            containsTask = YES;
-            [_lowPriorityQueuedOperations removeObject:downloadTask];
+        BOOL containsTask = PINRemoteImageDownloadSchedulerRemove(_scheduler, (__bridge void *)downloadTask);
+        if (containsTask) {
+            [_tasks removeObject:downloadTask];
+            // It would otherwise hold its connection, suspended, forever.
+            if ([_preemptedTasks containsObject:downloadTask]) {
+                [_preemptedTasks removeObject:downloadTask];
+                [downloadTask cancel];
+            }
         }
     [self unlock];
     return containsTask;
@@ -132,35 +208,12 @@
 
 - (void)setQueuePriority:(PINRemoteImageManagerPriority)priority forTask:(NSURLSessionDataTask *)downloadTask
 {
-    [self setQueuePriority:priority forTask:downloadTask addIfNecessary:NO];
-}
-
-- (void)setQueuePriority:(PINRemoteImageManagerPriority)priority forTask:(NSURLSessionDataTask *)downloadTask addIfNecessary:(BOOL)addIfNecessary
-{
-    BOOL containsTask = [self removeDownloadTaskFromQueue:downloadTask];
+    [self lock];
+        BOOL containsTask = PINRemoteImageDownloadSchedulerSetPriority(_scheduler, (__bridge void *)downloadTask, [self schedulerPriority:priority]);
+    [self unlock];
     
-    if (containsTask || addIfNecessary) {
-        NSMutableOrderedSet <NSURLSessionDataTask *> *queue = nil;
-        [self lock];
-            switch (priority) {
-                case PINRemoteImageManagerPriorityLow:
-                    queue = _lowPriorityQueuedOperations;
-                    break;
-                    
-                case PINRemoteImageManagerPriorityDefault:
-                    queue = _defaultPriorityQueuedOperations;
-                    break;
-                    
-                case PINRemoteImageManagerPriorityHigh:
-                    queue = _highPriorityQueuedOperations;
-                    break;
-                    
-                default:
-                    NSAssert(NO, @"invalid priority: %tu", priority);
-                    break;
-            }
-            [queue addObject:downloadTask];
-        [self unlock];
+    if (containsTask) {
+        [self scheduleDownloadsIfNeeded];
     }
 }
 
@@ -0,0 +1,463 @@
+//
+//  PINRemoteImageDownloadScheduler.c
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#include "PINRemoteImageDownloadScheduler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// MARK: - Types
+
+typedef struct {
+    char *name;
+    size_t nameLength;
+    uint32_t running;
+    double bytesPerSecond;
+    double timeToFirstByte;
+} PINRemoteImageDownloadSchedulerHost;
+
+typedef struct PINRemoteImageDownloadSchedulerEntry PINRemoteImageDownloadSchedulerEntry;
+
+struct PINRemoteImageDownloadSchedulerEntry {
+    void *context;
+    /** The next entry whose context hashes to the same bucket. */
+    PINRemoteImageDownloadSchedulerEntry *chain;
+    uint32_t host;
+    char *url;
+    size_t urlLength;
+    uint32_t urlHash;
+    uint32_t priority;
+    uint64_t expectedBytes;
+    double queuedAt;
+    /** Breaks ties in the order downloads were added. */
+    uint64_t sequence;
+    /** Orders running downloads by when they last started, to preempt the newest. */
+    uint64_t startSequence;
+    /** Ranks queued downloads; only valid during PINRemoteImageDownloadSchedulerNext. */
+    double expectedFinish;
+    bool running;
+    /** Where it is in `queued` or `running`. */
+    size_t index;
+};
+
+typedef struct {
+    PINRemoteImageDownloadSchedulerEntry **entries;
+    size_t count;
+    size_t capacity;
+} PINRemoteImageDownloadSchedulerList;
+
+struct PINRemoteImageDownloadScheduler {
+    uint32_t maxConcurrent;
+    uint32_t maxConcurrentPerHost;
+    // Hosts are few, so they're searched in order and kept for their speeds.
+    PINRemoteImageDownloadSchedulerHost *hosts;
+    uint32_t hostCount;
+    uint32_t hostCapacity;
+    PINRemoteImageDownloadSchedulerEntry **buckets;
+    size_t bucketCount;
+    size_t entryCount;
+    PINRemoteImageDownloadSchedulerList queued;
+    PINRemoteImageDownloadSchedulerList running;
+    uint64_t sequence;
+};
+
+static uint32_t PINRemoteImageDownloadSchedulerHash(const char *bytes, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t PINRemoteImageDownloadSchedulerBucket(const PINRemoteImageDownloadScheduler *scheduler, const void *context)
+{
+    uint64_t bits = (uint64_t)(uintptr_t)context;
+    return (size_t)(((bits >> 4) * 0x9E3779B97F4A7C15ull) >> 32) & (scheduler->bucketCount - 1);
+}
+
+// MARK: - Lists
+
+static bool PINRemoteImageDownloadSchedulerListReserve(PINRemoteImageDownloadSchedulerList *list, size_t capacity)
+{
+    if (capacity <= list->capacity) {
+        return true;
+    }
+    size_t newCapacity = list->capacity ? list->capacity * 2 : 16;
+    newCapacity = newCapacity < capacity ? capacity : newCapacity;
+    PINRemoteImageDownloadSchedulerEntry **entries = (PINRemoteImageDownloadSchedulerEntry **)realloc(list->entries, newCapacity * sizeof(*entries));
+    if (entries == NULL) {
+        return false;
+    }
+    list->entries = entries;
+    list->capacity = newCapacity;
+    return true;
+}
+
+static void PINRemoteImageDownloadSchedulerListAppend(PINRemoteImageDownloadSchedulerList *list, PINRemoteImageDownloadSchedulerEntry *entry)
+{
+    entry->index = list->count;
+    list->entries[list->count++] = entry;
+}
+
+static void PINRemoteImageDownloadSchedulerListRemove(PINRemoteImageDownloadSchedulerList *list, PINRemoteImageDownloadSchedulerEntry *entry)
+{
+    PINRemoteImageDownloadSchedulerEntry *last = list->entries[--list->count];
+    list->entries[entry->index] = last;
+    last->index = entry->index;
+}
+
+// MARK: - Lifetime
+
+PINRemoteImageDownloadScheduler *PINRemoteImageDownloadSchedulerCreate(uint32_t maxConcurrent, uint32_t maxConcurrentPerHost)
+{
+    PINRemoteImageDownloadScheduler *scheduler = (PINRemoteImageDownloadScheduler *)calloc(1, sizeof(PINRemoteImageDownloadScheduler));
+    if (scheduler == NULL) {
+        return NULL;
+    }
+    scheduler->maxConcurrent = maxConcurrent;
+    scheduler->maxConcurrentPerHost = maxConcurrentPerHost;
+    scheduler->bucketCount = 64;
+    scheduler->buckets = (PINRemoteImageDownloadSchedulerEntry **)calloc(scheduler->bucketCount, sizeof(PINRemoteImageDownloadSchedulerEntry *));
+    if (scheduler->buckets == NULL) {
+        free(scheduler);
+        return NULL;
+    }
+    return scheduler;
+}
+
+static void PINRemoteImageDownloadSchedulerFreeEntry(PINRemoteImageDownloadSchedulerEntry *entry)
+{
+    free(entry->url);
+    free(entry);
+}
+
+void PINRemoteImageDownloadSchedulerDestroy(PINRemoteImageDownloadScheduler *scheduler)
+{
+    if (scheduler == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < scheduler->queued.count; i++) {
+        PINRemoteImageDownloadSchedulerFreeEntry(scheduler->queued.entries[i]);
+    }
+    for (size_t i = 0; i < scheduler->running.count; i++) {
+        PINRemoteImageDownloadSchedulerFreeEntry(scheduler->running.entries[i]);
+    }
+    for (uint32_t i = 0; i < scheduler->hostCount; i++) {
+        free(scheduler->hosts[i].name);
+    }
+    free(scheduler->hosts);
+    free(scheduler->buckets);
+    free(scheduler->queued.entries);
+    free(scheduler->running.entries);
+    free(scheduler);
+}
+
+void PINRemoteImageDownloadSchedulerSetLimits(PINRemoteImageDownloadScheduler *scheduler, uint32_t maxConcurrent, uint32_t maxConcurrentPerHost)
+{
+    scheduler->maxConcurrent = maxConcurrent;
+    scheduler->maxConcurrentPerHost = maxConcurrentPerHost;
+}
+
+// MARK: - Hosts
+
+/** Returns the host's index, adding it if it's new, or UINT32_MAX on allocation failure. */
+static uint32_t PINRemoteImageDownloadSchedulerFindHost(PINRemoteImageDownloadScheduler *scheduler, const char *name, size_t nameLength)
+{
+    for (uint32_t i = 0; i < scheduler->hostCount; i++) {
+        PINRemoteImageDownloadSchedulerHost *host = &scheduler->hosts[i];
+        if (host->nameLength == nameLength && memcmp(host->name, name, nameLength) == 0) {
+            return i;
+        }
+    }
+    if (scheduler->hostCount == scheduler->hostCapacity) {
+        uint32_t capacity = scheduler->hostCapacity ? scheduler->hostCapacity * 2 : 8;
+        PINRemoteImageDownloadSchedulerHost *hosts = (PINRemoteImageDownloadSchedulerHost *)realloc(scheduler->hosts, capacity * sizeof(*hosts));
+        if (hosts == NULL) {
+            return UINT32_MAX;
+        }
+        scheduler->hosts = hosts;
+        scheduler->hostCapacity = capacity;
+    }
+    char *copy = (char *)malloc(nameLength + 1);
+    if (copy == NULL) {
+        return UINT32_MAX;
+    }
+    memcpy(copy, name, nameLength);
+    copy[nameLength] = '\0';
+    PINRemoteImageDownloadSchedulerHost *host = &scheduler->hosts[scheduler->hostCount];
+    memset(host, 0, sizeof(*host));
+    host->name = copy;
+    host->nameLength = nameLength;
+    return scheduler->hostCount++;
+}
+
+void PINRemoteImageDownloadSchedulerSetHostSpeed(PINRemoteImageDownloadScheduler *scheduler, const char *host, size_t hostLength, double bytesPerSecond, double timeToFirstByte)
+{
+    uint32_t index = PINRemoteImageDownloadSchedulerFindHost(scheduler, host, hostLength);
+    if (index == UINT32_MAX) {
+        return;
+    }
+    scheduler->hosts[index].bytesPerSecond = bytesPerSecond > 0 ? bytesPerSecond : 0;
+    scheduler->hosts[index].timeToFirstByte = timeToFirstByte > 0 ? timeToFirstByte : 0;
+}
+
+// MARK: - Downloads
+
+static PINRemoteImageDownloadSchedulerEntry *PINRemoteImageDownloadSchedulerLookup(const PINRemoteImageDownloadScheduler *scheduler, const void *context)
+{
+    PINRemoteImageDownloadSchedulerEntry *entry = scheduler->buckets[PINRemoteImageDownloadSchedulerBucket(scheduler, context)];
+    while (entry && entry->context != context) {
+        entry = entry->chain;
+    }
+    return entry;
+}
+
+static void PINRemoteImageDownloadSchedulerGrowBuckets(PINRemoteImageDownloadScheduler *scheduler)
+{
+    size_t oldCount = scheduler->bucketCount;
+    PINRemoteImageDownloadSchedulerEntry **old = scheduler->buckets;
+    PINRemoteImageDownloadSchedulerEntry **buckets = (PINRemoteImageDownloadSchedulerEntry **)calloc(oldCount * 2, sizeof(PINRemoteImageDownloadSchedulerEntry *));
+    if (buckets == NULL) {
+        // Chains just get longer.
+        return;
+    }
+    scheduler->buckets = buckets;
+    scheduler->bucketCount = oldCount * 2;
+    for (size_t i = 0; i < oldCount; i++) {
+        PINRemoteImageDownloadSchedulerEntry *entry = old[i];
+        while (entry) {
+            PINRemoteImageDownloadSchedulerEntry *next = entry->chain;
+            size_t bucket = PINRemoteImageDownloadSchedulerBucket(scheduler, entry->context);
+            entry->chain = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(old);
+}
+
+bool PINRemoteImageDownloadSchedulerAdd(PINRemoteImageDownloadScheduler *scheduler, void *context,
+                                        const char *host, size_t hostLength, const char *url, size_t urlLength,
+                                        uint32_t priority, uint64_t expectedBytes, double now)
+{
+    if (PINRemoteImageDownloadSchedulerLookup(scheduler, context) != NULL) {
+        return false;
+    }
+    // Every download may end up queued at once, after preemptions.
+    if (PINRemoteImageDownloadSchedulerListReserve(&scheduler->queued, scheduler->entryCount + 1) == false
+        || PINRemoteImageDownloadSchedulerListReserve(&scheduler->running, scheduler->entryCount + 1) == false) {
+        return false;
+    }
+    uint32_t hostIndex = PINRemoteImageDownloadSchedulerFindHost(scheduler, host, hostLength);
+    PINRemoteImageDownloadSchedulerEntry *entry = (PINRemoteImageDownloadSchedulerEntry *)calloc(1, sizeof(PINRemoteImageDownloadSchedulerEntry));
+    char *urlCopy = (char *)malloc(urlLength + 1);
+    if (hostIndex == UINT32_MAX || entry == NULL || urlCopy == NULL) {
+        free(entry);
+        free(urlCopy);
+        return false;
+    }
+    memcpy(urlCopy, url, urlLength);
+    urlCopy[urlLength] = '\0';
+
+    entry->context = context;
+    entry->host = hostIndex;
+    entry->url = urlCopy;
+    entry->urlLength = urlLength;
+    entry->urlHash = PINRemoteImageDownloadSchedulerHash(url, urlLength);
+    entry->priority = priority;
+    entry->expectedBytes = expectedBytes ? expectedBytes : PINRemoteImageDownloadSchedulerDefaultExpectedBytes;
+    entry->queuedAt = now;
+    entry->sequence = scheduler->sequence++;
+
+    if (scheduler->entryCount >= scheduler->bucketCount) {
+        PINRemoteImageDownloadSchedulerGrowBuckets(scheduler);
+    }
+    size_t bucket = PINRemoteImageDownloadSchedulerBucket(scheduler, context);
+    entry->chain = scheduler->buckets[bucket];
+    scheduler->buckets[bucket] = entry;
+    scheduler->entryCount++;
+    PINRemoteImageDownloadSchedulerListAppend(&scheduler->queued, entry);
+    return true;
+}
+
+static void PINRemoteImageDownloadSchedulerForget(PINRemoteImageDownloadScheduler *scheduler, PINRemoteImageDownloadSchedulerEntry *entry)
+{
+    PINRemoteImageDownloadSchedulerEntry **link = &scheduler->buckets[PINRemoteImageDownloadSchedulerBucket(scheduler, entry->context)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+    scheduler->entryCount--;
+    if (entry->running) {
+        scheduler->hosts[entry->host].running--;
+        PINRemoteImageDownloadSchedulerListRemove(&scheduler->running, entry);
+    } else {
+        PINRemoteImageDownloadSchedulerListRemove(&scheduler->queued, entry);
+    }
+    PINRemoteImageDownloadSchedulerFreeEntry(entry);
+}
+
+bool PINRemoteImageDownloadSchedulerRemove(PINRemoteImageDownloadScheduler *scheduler, void *context)
+{
+    PINRemoteImageDownloadSchedulerEntry *entry = PINRemoteImageDownloadSchedulerLookup(scheduler, context);
+    if (entry == NULL || entry->running) {
+        return false;
+    }
+    PINRemoteImageDownloadSchedulerForget(scheduler, entry);
+    return true;
+}
+
+bool PINRemoteImageDownloadSchedulerSetPriority(PINRemoteImageDownloadScheduler *scheduler, void *context, uint32_t priority)
+{
+    PINRemoteImageDownloadSchedulerEntry *entry = PINRemoteImageDownloadSchedulerLookup(scheduler, context);
+    if (entry == NULL) {
+        return false;
+    }
+    entry->priority = priority;
+    return true;
+}
+
+void PINRemoteImageDownloadSchedulerFinish(PINRemoteImageDownloadScheduler *scheduler, void *context)
+{
+    PINRemoteImageDownloadSchedulerEntry *entry = PINRemoteImageDownloadSchedulerLookup(scheduler, context);
+    if (entry) {
+        PINRemoteImageDownloadSchedulerForget(scheduler, entry);
+    }
+}
+
+size_t PINRemoteImageDownloadSchedulerRunningCount(const PINRemoteImageDownloadScheduler *scheduler)
+{
+    return scheduler->running.count;
+}
+
+size_t PINRemoteImageDownloadSchedulerQueuedCount(const PINRemoteImageDownloadScheduler *scheduler)
+{
+    return scheduler->queued.count;
+}
+
+// MARK: - Scheduling
+
+static int PINRemoteImageDownloadSchedulerCompare(const void *a, const void *b)
+{
+    const PINRemoteImageDownloadSchedulerEntry *first = *(PINRemoteImageDownloadSchedulerEntry *const *)a;
+    const PINRemoteImageDownloadSchedulerEntry *second = *(PINRemoteImageDownloadSchedulerEntry *const *)b;
+    if (first->priority != second->priority) {
+        return first->priority > second->priority ? -1 : 1;
+    }
+    if (first->expectedFinish != second->expectedFinish) {
+        return first->expectedFinish < second->expectedFinish ? -1 : 1;
+    }
+    return first->sequence < second->sequence ? -1 : (first->sequence > second->sequence ? 1 : 0);
+}
+
+static bool PINRemoteImageDownloadSchedulerURLIsRunning(const PINRemoteImageDownloadScheduler *scheduler, const PINRemoteImageDownloadSchedulerEntry *entry)
+{
+    for (size_t i = 0; i < scheduler->running.count; i++) {
+        const PINRemoteImageDownloadSchedulerEntry *running = scheduler->running.entries[i];
+        if (running->urlHash == entry->urlHash && running->urlLength == entry->urlLength
+            && memcmp(running->url, entry->url, entry->urlLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool PINRemoteImageDownloadSchedulerHasRoom(const PINRemoteImageDownloadScheduler *scheduler, uint32_t host, const PINRemoteImageDownloadSchedulerEntry *without)
+{
+    size_t running = scheduler->running.count - (without ? 1 : 0);
+    uint32_t hostRunning = scheduler->hosts[host].running - (without && without->host == host ? 1 : 0);
+    return running < scheduler->maxConcurrent
+        && (scheduler->maxConcurrentPerHost == 0 || hostRunning < scheduler->maxConcurrentPerHost);
+}
+
+/** The running download of lower priority whose preemption makes room for `entry`, if any. */
+static PINRemoteImageDownloadSchedulerEntry *PINRemoteImageDownloadSchedulerVictim(const PINRemoteImageDownloadScheduler *scheduler, const PINRemoteImageDownloadSchedulerEntry *entry)
+{
+    PINRemoteImageDownloadSchedulerEntry *victim = NULL;
+    for (size_t i = 0; i < scheduler->running.count; i++) {
+        PINRemoteImageDownloadSchedulerEntry *running = scheduler->running.entries[i];
+        if (running->priority >= entry->priority || PINRemoteImageDownloadSchedulerHasRoom(scheduler, entry->host, running) == false) {
+            continue;
+        }
+        if (victim == NULL || running->priority < victim->priority
+            || (running->priority == victim->priority && running->startSequence > victim->startSequence)) {
+            victim = running;
+        }
+    }
+    return victim;
+}
+
+size_t PINRemoteImageDownloadSchedulerNext(PINRemoteImageDownloadScheduler *scheduler, PINRemoteImageDownloadSchedulerAction *actions, size_t capacity)
+{
+    PINRemoteImageDownloadSchedulerList *queued = &scheduler->queued;
+    if (queued->count == 0 || capacity < 2) {
+        return 0;
+    }
+
+    double knownSpeed = 0;
+    uint32_t knownHosts = 0;
+    for (uint32_t i = 0; i < scheduler->hostCount; i++) {
+        if (scheduler->hosts[i].bytesPerSecond > 0) {
+            knownSpeed += scheduler->hosts[i].bytesPerSecond;
+            knownHosts++;
+        }
+    }
+    double averageSpeed = knownHosts ? knownSpeed / knownHosts : 0;
+    for (size_t i = 0; i < queued->count; i++) {
+        PINRemoteImageDownloadSchedulerEntry *entry = queued->entries[i];
+        const PINRemoteImageDownloadSchedulerHost *host = &scheduler->hosts[entry->host];
+        double speed = host->bytesPerSecond > 0 ? host->bytesPerSecond : averageSpeed;
+        entry->expectedFinish = entry->queuedAt + host->timeToFirstByte + (speed > 0 ? entry->expectedBytes / speed : 0);
+    }
+    qsort(queued->entries, queued->count, sizeof(PINRemoteImageDownloadSchedulerEntry *), PINRemoteImageDownloadSchedulerCompare);
+
+    // Keeps what doesn't start at the front, in order. Preempted downloads wait past the end, which
+    // has room for every download, and join after.
+    size_t count = queued->count;
+    size_t kept = 0;
+    size_t preempted = 0;
+    size_t written = 0;
+    bool full = false;
+    for (size_t i = 0; i < count; i++) {
+        PINRemoteImageDownloadSchedulerEntry *entry = queued->entries[i];
+        bool starts = false;
+        if (full == false && PINRemoteImageDownloadSchedulerURLIsRunning(scheduler, entry) == false) {
+            if (PINRemoteImageDownloadSchedulerHasRoom(scheduler, entry->host, NULL)) {
+                starts = true;
+            } else {
+                PINRemoteImageDownloadSchedulerEntry *victim = PINRemoteImageDownloadSchedulerVictim(scheduler, entry);
+                // Without room for both actions, stop here so the next call starts with this one.
+                full = victim && capacity - written < 2;
+                if (victim && full == false) {
+                    scheduler->hosts[victim->host].running--;
+                    PINRemoteImageDownloadSchedulerListRemove(&scheduler->running, victim);
+                    victim->running = false;
+                    queued->entries[count + preempted++] = victim;
+                    actions[written++] = (PINRemoteImageDownloadSchedulerAction){PINRemoteImageDownloadSchedulerActionPreempt, victim->context};
+                    starts = true;
+                }
+            }
+        }
+        if (starts) {
+            entry->running = true;
+            entry->startSequence = scheduler->sequence++;
+            scheduler->hosts[entry->host].running++;
+            PINRemoteImageDownloadSchedulerListAppend(&scheduler->running, entry);
+            actions[written++] = (PINRemoteImageDownloadSchedulerAction){PINRemoteImageDownloadSchedulerActionStart, entry->context};
+            full = written == capacity;
+        } else {
+            entry->index = kept;
+            queued->entries[kept++] = entry;
+        }
+    }
+    queued->count = kept;
+    for (size_t i = 0; i < preempted; i++) {
+        PINRemoteImageDownloadSchedulerListAppend(queued, queued->entries[count + i]);
+    }
+    return written;
+}
@@ -0,0 +1,113 @@
+//
+//  PINRemoteImageDownloadScheduler.h
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#ifndef PINRemoteImageDownloadScheduler_h
+#define PINRemoteImageDownloadScheduler_h
+
+// Plain C with no Foundation dependency, so the policy behind
+// PINRemoteImageDownloadQueue can be built and checked against a simulated
+// network on its own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Priorities are those of PINRemoteImageManagerPriority: low, default and high. */
+#define PINRemoteImageDownloadSchedulerPriorityCount 3
+
+/** Assumed for downloads whose size isn't known, which is most of them. */
+#define PINRemoteImageDownloadSchedulerDefaultExpectedBytes (256 * 1024)
+
+typedef enum {
+    /** Resume the download: start it, or continue it if it was preempted. */
+    PINRemoteImageDownloadSchedulerActionStart,
+    /** Suspend the running download; it's queued again and will be started again. */
+    PINRemoteImageDownloadSchedulerActionPreempt,
+} PINRemoteImageDownloadSchedulerActionKind;
+
+typedef struct {
+    PINRemoteImageDownloadSchedulerActionKind kind;
+    void *context;
+} PINRemoteImageDownloadSchedulerAction;
+
+/**
+ Decides which downloads run, given limits on how many run at once in all
+ and to any one host.
+
+ Queued downloads are ranked by priority, then by when they're expected to
+ finish had they started when queued: the time they were queued, plus the
+ host's time to first byte, plus their size at the host's throughput. Hosts
+ whose throughput isn't known yet are assumed to be average. So within a
+ priority, downloads from fast hosts overtake those from slow ones, but not
+ ones that have waited longer than the difference.
+
+ Going down the ranking, a download starts if its host and the total are
+ under their limits. One whose host is at its limit is passed over rather
+ than holding up downloads from other hosts. One whose URL is already being
+ downloaded waits for that download to finish instead of fetching the same
+ bytes alongside it. If a download can't start for lack of room, a running
+ download of lower priority that would make room is preempted: the lowest
+ priority one, most recently started. Raising the priority of what became
+ visible therefore pushes out what scrolled away.
+
+ Downloads are identified by a context pointer the caller chooses, such as
+ the task itself. Not thread safe.
+ */
+typedef struct PINRemoteImageDownloadScheduler PINRemoteImageDownloadScheduler;
+
+/** A per-host limit of 0 means only the total is limited. */
+PINRemoteImageDownloadScheduler *PINRemoteImageDownloadSchedulerCreate(uint32_t maxConcurrent, uint32_t maxConcurrentPerHost);
+
+void PINRemoteImageDownloadSchedulerDestroy(PINRemoteImageDownloadScheduler *scheduler);
+
+/** Take effect at the next PINRemoteImageDownloadSchedulerNext; running downloads aren't stopped to meet them. */
+void PINRemoteImageDownloadSchedulerSetLimits(PINRemoteImageDownloadScheduler *scheduler, uint32_t maxConcurrent, uint32_t maxConcurrentPerHost);
+
+/**
+ Records a host's measured throughput and time to first byte, in seconds.
+ A throughput of 0 or less means it isn't known.
+ */
+void PINRemoteImageDownloadSchedulerSetHostSpeed(PINRemoteImageDownloadScheduler *scheduler, const char *host, size_t hostLength, double bytesPerSecond, double timeToFirstByte);
+
+/**
+ Queues a download. `expectedBytes` may be 0 if unknown. `now` is in
+ seconds, from any clock as long as it's always the same one. Fails if
+ `context` is already queued or running, or on allocation failure.
+ */
+bool PINRemoteImageDownloadSchedulerAdd(PINRemoteImageDownloadScheduler *scheduler, void *context,
+                                        const char *host, size_t hostLength, const char *url, size_t urlLength,
+                                        uint32_t priority, uint64_t expectedBytes, double now);
+
+/** Forgets a queued download. Returns false, leaving it, if it's running or unknown. */
+bool PINRemoteImageDownloadSchedulerRemove(PINRemoteImageDownloadScheduler *scheduler, void *context);
+
+/** Changes the priority of a queued or running download. Returns false if it's unknown. */
+bool PINRemoteImageDownloadSchedulerSetPriority(PINRemoteImageDownloadScheduler *scheduler, void *context, uint32_t priority);
+
+/** Forgets a download that finished, failed or was cancelled, running or not. */
+void PINRemoteImageDownloadSchedulerFinish(PINRemoteImageDownloadScheduler *scheduler, void *context);
+
+/**
+ Decides what to start and preempt, writing up to `capacity` actions, which
+ must be at least 2, and returning how many. A preemption is always followed
+ by the start it made room for. Call again until it returns 0.
+ */
+size_t PINRemoteImageDownloadSchedulerNext(PINRemoteImageDownloadScheduler *scheduler, PINRemoteImageDownloadSchedulerAction *actions, size_t capacity);
+
+size_t PINRemoteImageDownloadSchedulerRunningCount(const PINRemoteImageDownloadScheduler *scheduler);
+
+size_t PINRemoteImageDownloadSchedulerQueuedCount(const PINRemoteImageDownloadScheduler *scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINRemoteImageDownloadScheduler_h
@@ -28,6 +28,7 @@
 #import "PINRemoteImageDownloadTask.h"
 #import "PINResume.h"
 #import "PINRemoteImageMemoryContainer.h"
+#import "PINRemoteImageMemoryTiers.h"
 #import <PINRemoteImage/PINRemoteImageCaching.h>
 #import <PINRemoteImage/PINRequestRetryStrategy.h>
 #import "PINRemoteImageDownloadQueue.h"
@@ -126,6 +127,9 @@ typedef void (^PINRemoteImageManagerDataCompletion)(NSData *data, NSURLResponse
   PINRemoteLock *_lock;
   PINOperationQueue *_concurrentOperationQueue;
   PINRemoteImageDownloadQueue *_urlSessionTaskQueue;
+  // Which images keep decoded bitmaps in the memory cache.
+  PINRemoteLock *_memoryTiersLock;
+  PINRemoteImageMemoryTiers *_memoryTiers;
   
   // Necessary to have a strong reference to _defaultAlternateRepresentationProvider because _alternateRepProvider is __weak
   PINAlternateRepresentationProvider *_defaultAlternateRepresentationProvider;
@@ -164,6 +168,21 @@ typedef void (^PINRemoteImageManagerDataCompletion)(NSData *data, NSURLResponse
 
 #pragma mark PINRemoteImageManager
 
+static NSUInteger PINRemoteImageManagerDecodedBytes(PINImage *image)
+{
+    CGImageRef imageRef = image.CGImage;
+    return imageRef ? CGImageGetHeight(imageRef) * CGImageGetBytesPerRow(imageRef) : 0;
+}
+
+static void PINRemoteImageManagerCollectDroppedKey(void *context, const char *key, size_t keyLength)
+{
+    NSMutableArray <NSString *> *droppedKeys = (__bridge NSMutableArray <NSString *> *)context;
+    NSString *droppedKey = [[NSString alloc] initWithBytes:key length:keyLength encoding:NSUTF8StringEncoding];
+    if (droppedKey) {
+        [droppedKeys addObject:droppedKey];
+    }
+}
+
 @implementation PINRemoteImageManager
 
 static PINRemoteImageManager *sharedImageManager = nil;
@@ -250,7 +269,10 @@ static dispatch_once_t sharedDispatchToken;
         _lock = [[PINRemoteLock alloc] initWithName:@"PINRemoteImageManager"];
         
         _concurrentOperationQueue = [[PINOperationQueue alloc] initWithMaxConcurrentOperations: configuration.maxConcurrentOperations];
-        _urlSessionTaskQueue = [PINRemoteImageDownloadQueue queueWithMaxConcurrentDownloads:configuration.maxConcurrentDownloads];
+        _urlSessionTaskQueue = [PINRemoteImageDownloadQueue queueWithMaxConcurrentDownloads:configuration.maxConcurrentDownloads
+                                                              maxConcurrentDownloadsPerHost:configuration.maxConcurrentDownloadsPerHost];
+        _memoryTiersLock = [[PINRemoteLock alloc] initWithName:@"PINRemoteImageManager memory tiers" lockType:PINRemoteLockTypeNonRecursive];
+        _memoryTiers = PINRemoteImageMemoryTiersCreate(configuration.offDisplayDecodedByteLimit);
         
         self.sessionManager = [[PINURLSessionManager alloc] initWithSessionConfiguration:_sessionConfiguration];
         self.sessionManager.delegate = self;
@@ -287,6 +309,7 @@ static dispatch_once_t sharedDispatchToken;
 - (void)dealloc
 {
     [self.sessionManager invalidateSessionAndCancelTasks];
+    PINRemoteImageMemoryTiersDestroy(_memoryTiers);
 }
 
 - (id<PINRemoteImageCaching>)defaultImageCache {
@@ -433,6 +456,28 @@ static dispatch_once_t sharedDispatchToken;
     });
 }
 
+- (void)setOffDisplayDecodedByteLimit:(NSUInteger)offDisplayDecodedByteLimit completion:(dispatch_block_t)completion
+{
+    __weak typeof(self) weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        typeof(self) strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        NSMutableArray <NSString *> *droppedKeys = [[NSMutableArray alloc] init];
+        [strongSelf->_memoryTiersLock lock];
+            if (strongSelf->_memoryTiers) {
+                PINRemoteImageMemoryTiersSetByteLimit(strongSelf->_memoryTiers, offDisplayDecodedByteLimit,
+                                                      PINRemoteImageManagerCollectDroppedKey, (__bridge void *)droppedKeys);
+            }
+        [strongSelf->_memoryTiersLock unlock];
+        [strongSelf dropDecodedImagesForKeys:droppedKeys];
+        if (completion) {
+            completion();
+        }
+    });
+}
+
 - (void)setEstimatedRemainingTimeThresholdForProgressiveDownloads:(NSTimeInterval)estimatedRemainingTimeThreshold completion:(dispatch_block_t)completion
 {
     __weak typeof(self) weakSelf = self;
@@ -1483,6 +1528,9 @@ static dispatch_once_t sharedDispatchToken;
         [container.lock lockWithBlock:^{
             image = container.image;
         }];
+        if (image != nil) {
+            [self touchDecodedImagesForKey:key];
+        }
         if (image == nil && container.data) {
             image = [PINImage pin_decodedImageWithData:container.data skipDecodeIfPossible:skipDecode];
             
@@ -1522,6 +1570,7 @@ static dispatch_once_t sharedDispatchToken;
                     [self.cache setObjectInMemory:container forKey:key withCost:cacheCost withAgeLimit:[maxAge integerValue]];
                 }
             }];
+            [self recordDecodedImagesOfContainer:container forKey:key];
         }
 
         if (diskData) {
@@ -1640,6 +1689,167 @@ static dispatch_once_t sharedDispatchToken;
     }
 }
 
+#pragma mark - Decoded images
+
+- (void)imageWillEnterDisplayWithURL:(NSURL *)url
+                        processorKey:(NSString *)processorKey
+                     targetPixelSize:(CGSize)targetPixelSize
+                          completion:(void (^)(PINImage *image))completion
+{
+    NSString *key = [self cacheKeyForURL:url processorKey:processorKey];
+    const char *keyBytes = key.UTF8String;
+    [_memoryTiersLock lock];
+        if (_memoryTiers) {
+            PINRemoteImageMemoryTiersEnterDisplay(_memoryTiers, keyBytes, strlen(keyBytes));
+        }
+    [_memoryTiersLock unlock];
+
+    NSUInteger maxPixelSize = (NSUInteger)ceil(MAX(targetPixelSize.width, targetPixelSize.height));
+    [_concurrentOperationQueue scheduleOperation:^{
+        PINImage *image = [self displayImageForKey:key maxPixelSize:maxPixelSize];
+        if (completion) {
+            completion(image);
+        }
+    } withPriority:PINOperationQueuePriorityHigh];
+}
+
+- (void)imageDidExitDisplayWithURL:(NSURL *)url processorKey:(NSString *)processorKey
+{
+    NSString *key = [self cacheKeyForURL:url processorKey:processorKey];
+    const char *keyBytes = key.UTF8String;
+    NSMutableArray <NSString *> *droppedKeys = [[NSMutableArray alloc] init];
+    [_memoryTiersLock lock];
+        if (_memoryTiers) {
+            PINRemoteImageMemoryTiersExitDisplay(_memoryTiers, keyBytes, strlen(keyBytes),
+                                                 PINRemoteImageManagerCollectDroppedKey, (__bridge void *)droppedKeys);
+        }
+    [_memoryTiersLock unlock];
+    [self dropDecodedImagesForKeys:droppedKeys];
+}
+
+- (BOOL)imageIsOnDisplayForKey:(NSString *)key
+{
+    const char *keyBytes = key.UTF8String;
+    [_memoryTiersLock lock];
+        BOOL onDisplay = _memoryTiers && PINRemoteImageMemoryTiersIsOnDisplay(_memoryTiers, keyBytes, strlen(keyBytes));
+    [_memoryTiersLock unlock];
+    return onDisplay;
+}
+
+- (PINImage *)displayImageForKey:(NSString *)key maxPixelSize:(NSUInteger)maxPixelSize
+{
+    // Left the display range before this ran.
+    if ([self imageIsOnDisplayForKey:key] == NO) {
+        return nil;
+    }
+
+    PINRemoteImageMemoryContainer *container = [self.cache objectFromMemoryForKey:key];
+    if ([container isKindOfClass:[PINRemoteImageMemoryContainer class]] == NO) {
+        container = nil;
+    }
+    __block PINImage *image = nil;
+    __block NSData *data = nil;
+    [container.lock lockWithBlock:^{
+        image = container.displayImage ?: container.image;
+        data = container.data;
+    }];
+    if (image) {
+        [self touchDecodedImagesForKey:key];
+        return image;
+    }
+    if (data == nil) {
+        id object = [self.cache objectFromDiskForKey:key];
+        data = [object isKindOfClass:[NSData class]] ? object : nil;
+    }
+
+    PINImage *displayImage = data ? [PINImage pin_decodedImageWithData:data maxPixelSize:maxPixelSize] : nil;
+    if (displayImage == nil || [self imageIsOnDisplayForKey:key] == NO) {
+        return displayImage;
+    }
+
+    BOOL inMemory = container != nil;
+    if (inMemory == NO) {
+        container = [[PINRemoteImageMemoryContainer alloc] init];
+        container.data = data;
+    }
+    __block NSUInteger cacheCost = 0;
+    [container.lock lockWithBlock:^{
+        container.displayImage = displayImage;
+        cacheCost = container.data.length + PINRemoteImageManagerDecodedBytes(container.image) + PINRemoteImageManagerDecodedBytes(displayImage);
+    }];
+    // Setting it again would drop a time to live given it when it was cached.
+    if (inMemory == NO || self.memoryCacheTTLIsEnabled == NO) {
+        [self.cache setObjectInMemory:container forKey:key withCost:cacheCost];
+    }
+    [self recordDecodedImagesOfContainer:container forKey:key];
+    return displayImage;
+}
+
+- (void)recordDecodedImagesOfContainer:(PINRemoteImageMemoryContainer *)container forKey:(NSString *)key
+{
+    if (key == nil) {
+        return;
+    }
+    __block NSUInteger decodedBytes = 0;
+    __block BOOL hasData = NO;
+    [container.lock lockWithBlock:^{
+        decodedBytes = PINRemoteImageManagerDecodedBytes(container.image) + PINRemoteImageManagerDecodedBytes(container.displayImage);
+        hasData = container.data != nil;
+    }];
+    // Processed images have no compressed bytes to decode again, so they keep their bitmaps.
+    if (hasData == NO) {
+        return;
+    }
+
+    const char *keyBytes = key.UTF8String;
+    NSMutableArray <NSString *> *droppedKeys = [[NSMutableArray alloc] init];
+    [_memoryTiersLock lock];
+        BOOL recorded = _memoryTiers && PINRemoteImageMemoryTiersSetDecodedBytes(_memoryTiers, keyBytes, strlen(keyBytes), decodedBytes,
+                                                                                 PINRemoteImageManagerCollectDroppedKey, (__bridge void *)droppedKeys);
+    [_memoryTiersLock unlock];
+    if (recorded == NO) {
+        [droppedKeys addObject:key];
+    }
+    [self dropDecodedImagesForKeys:droppedKeys];
+}
+
+- (void)touchDecodedImagesForKey:(NSString *)key
+{
+    if (key == nil) {
+        return;
+    }
+    const char *keyBytes = key.UTF8String;
+    [_memoryTiersLock lock];
+        if (_memoryTiers) {
+            PINRemoteImageMemoryTiersTouch(_memoryTiers, keyBytes, strlen(keyBytes));
+        }
+    [_memoryTiersLock unlock];
+}
+
+// Leaves the compressed bytes in the memory cache, to be decoded again when next asked for. Images the cache has
+// evicted since are skipped.
+- (void)dropDecodedImagesForKeys:(NSArray <NSString *> *)keys
+{
+    for (NSString *key in keys) {
+        PINRemoteImageMemoryContainer *container = [self.cache objectFromMemoryForKey:key];
+        if ([container isKindOfClass:[PINRemoteImageMemoryContainer class]] == NO) {
+            continue;
+        }
+        __block NSUInteger cacheCost = 0;
+        [container.lock lockWithBlock:^{
+            if (container.data) {
+                container.image = nil;
+                container.displayImage = nil;
+                cacheCost = container.data.length;
+            }
+        }];
+        // A time to live would be lost by setting it again, so there the cost stays as it was.
+        if (cacheCost > 0 && self.memoryCacheTTLIsEnabled == NO) {
+            [self.cache setObjectInMemory:container forKey:key withCost:cacheCost];
+        }
+    }
+}
+
 #pragma mark - Resume support
 
 - (NSString *)resumeCacheKeyForURL:(NSURL *)url
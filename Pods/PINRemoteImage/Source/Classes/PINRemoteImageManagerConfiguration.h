@@ -25,6 +25,12 @@
 /** The maximum number of concurrent downloads. Defaults to 10, maximum 65535. */
 @property (nonatomic, readwrite, assign) NSUInteger maxConcurrentDownloads;
 
+/** The maximum number of concurrent downloads from any one host, 0 for no limit. Defaults to 4. */
+@property (nonatomic, readwrite, assign) NSUInteger maxConcurrentDownloadsPerHost;
+
+/** The bytes of decoded bitmaps the memory cache keeps for images not on display, besides their compressed bytes. Defaults to 32 MB. */
+@property (nonatomic, readwrite, assign) NSUInteger offDisplayDecodedByteLimit;
+
 /** The estimated remaining time threshold used to decide to skip progressive rendering. Defaults to 0.1. */
 @property (nonatomic, readwrite, assign) NSTimeInterval estimatedRemainingTimeThreshold;
 
@@ -16,6 +16,8 @@
     if (self = [super init]) {
         _maxConcurrentOperations = [[NSProcessInfo processInfo] activeProcessorCount] * 2;
         _maxConcurrentDownloads = 10;
+        _maxConcurrentDownloadsPerHost = 4;
+        _offDisplayDecodedByteLimit = 32 * 1024 * 1024;
         _estimatedRemainingTimeThreshold = 0.1;
         _shouldBlurProgressive = YES;
         _maxProgressiveRenderSize = CGSizeMake(1024, 1024);
@@ -16,6 +16,8 @@
 @interface PINRemoteImageMemoryContainer : NSObject
 
 @property (nonatomic, strong) PINImage *image;
+// Decoded at the size it is drawn at, while on display.
+@property (nonatomic, strong) PINImage *displayImage;
 @property (nonatomic, strong) NSData *data;
 @property (nonatomic, strong) PINRemoteLock *lock;
 
@@ -0,0 +1,302 @@
+//
+//  PINRemoteImageMemoryTiers.c
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#include "PINRemoteImageMemoryTiers.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// MARK: - Types
+
+typedef struct PINRemoteImageMemoryTiersEntry PINRemoteImageMemoryTiersEntry;
+
+struct PINRemoteImageMemoryTiersEntry {
+    /** The next entry in the same bucket. */
+    PINRemoteImageMemoryTiersEntry *chain;
+    /** Neighbors in the recency list, which holds off display images with bitmaps. */
+    PINRemoteImageMemoryTiersEntry *older;
+    PINRemoteImageMemoryTiersEntry *newer;
+    uint32_t hash;
+    uint32_t displayCount;
+    size_t decodedBytes;
+    size_t keyLength;
+    char key[];
+};
+
+struct PINRemoteImageMemoryTiers {
+    size_t byteLimit;
+    PINRemoteImageMemoryTiersEntry **buckets;
+    size_t bucketCount;
+    size_t entryCount;
+    PINRemoteImageMemoryTiersEntry *oldest;
+    PINRemoteImageMemoryTiersEntry *newest;
+    size_t decodedBytes;
+    size_t onDisplayBytes;
+};
+
+static uint32_t PINRemoteImageMemoryTiersHash(const char *bytes, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// MARK: - Lifetime
+
+PINRemoteImageMemoryTiers *PINRemoteImageMemoryTiersCreate(size_t offDisplayByteLimit)
+{
+    PINRemoteImageMemoryTiers *tiers = (PINRemoteImageMemoryTiers *)calloc(1, sizeof(PINRemoteImageMemoryTiers));
+    if (tiers == NULL) {
+        return NULL;
+    }
+    tiers->byteLimit = offDisplayByteLimit;
+    tiers->bucketCount = 64;
+    tiers->buckets = (PINRemoteImageMemoryTiersEntry **)calloc(tiers->bucketCount, sizeof(PINRemoteImageMemoryTiersEntry *));
+    if (tiers->buckets == NULL) {
+        free(tiers);
+        return NULL;
+    }
+    return tiers;
+}
+
+void PINRemoteImageMemoryTiersDestroy(PINRemoteImageMemoryTiers *tiers)
+{
+    if (tiers == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < tiers->bucketCount; i++) {
+        PINRemoteImageMemoryTiersEntry *entry = tiers->buckets[i];
+        while (entry) {
+            PINRemoteImageMemoryTiersEntry *next = entry->chain;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(tiers->buckets);
+    free(tiers);
+}
+
+// MARK: - Entries
+
+static PINRemoteImageMemoryTiersEntry *PINRemoteImageMemoryTiersLookup(const PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength, uint32_t hash)
+{
+    PINRemoteImageMemoryTiersEntry *entry = tiers->buckets[hash & (tiers->bucketCount - 1)];
+    while (entry && (entry->hash != hash || entry->keyLength != keyLength || memcmp(entry->key, key, keyLength) != 0)) {
+        entry = entry->chain;
+    }
+    return entry;
+}
+
+static void PINRemoteImageMemoryTiersGrowBuckets(PINRemoteImageMemoryTiers *tiers)
+{
+    size_t oldCount = tiers->bucketCount;
+    PINRemoteImageMemoryTiersEntry **old = tiers->buckets;
+    PINRemoteImageMemoryTiersEntry **buckets = (PINRemoteImageMemoryTiersEntry **)calloc(oldCount * 2, sizeof(PINRemoteImageMemoryTiersEntry *));
+    if (buckets == NULL) {
+        // Chains just get longer.
+        return;
+    }
+    tiers->buckets = buckets;
+    tiers->bucketCount = oldCount * 2;
+    for (size_t i = 0; i < oldCount; i++) {
+        PINRemoteImageMemoryTiersEntry *entry = old[i];
+        while (entry) {
+            PINRemoteImageMemoryTiersEntry *next = entry->chain;
+            size_t bucket = entry->hash & (tiers->bucketCount - 1);
+            entry->chain = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(old);
+}
+
+static PINRemoteImageMemoryTiersEntry *PINRemoteImageMemoryTiersInsert(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength, uint32_t hash)
+{
+    PINRemoteImageMemoryTiersEntry *entry = (PINRemoteImageMemoryTiersEntry *)calloc(1, sizeof(PINRemoteImageMemoryTiersEntry) + keyLength);
+    if (entry == NULL) {
+        return NULL;
+    }
+    memcpy(entry->key, key, keyLength);
+    entry->keyLength = keyLength;
+    entry->hash = hash;
+    if (tiers->entryCount >= tiers->bucketCount) {
+        PINRemoteImageMemoryTiersGrowBuckets(tiers);
+    }
+    size_t bucket = hash & (tiers->bucketCount - 1);
+    entry->chain = tiers->buckets[bucket];
+    tiers->buckets[bucket] = entry;
+    tiers->entryCount++;
+    return entry;
+}
+
+/** Frees an entry that's neither on display nor holding a bitmap, so only images in memory are tracked. */
+static void PINRemoteImageMemoryTiersForgetIfUnused(PINRemoteImageMemoryTiers *tiers, PINRemoteImageMemoryTiersEntry *entry)
+{
+    if (entry->displayCount > 0 || entry->decodedBytes > 0) {
+        return;
+    }
+    PINRemoteImageMemoryTiersEntry **link = &tiers->buckets[entry->hash & (tiers->bucketCount - 1)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+    tiers->entryCount--;
+    free(entry);
+}
+
+// MARK: - Recency
+
+static void PINRemoteImageMemoryTiersUnlink(PINRemoteImageMemoryTiers *tiers, PINRemoteImageMemoryTiersEntry *entry)
+{
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        tiers->oldest = entry->newer;
+    }
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        tiers->newest = entry->older;
+    }
+    entry->older = NULL;
+    entry->newer = NULL;
+}
+
+static void PINRemoteImageMemoryTiersLinkNewest(PINRemoteImageMemoryTiers *tiers, PINRemoteImageMemoryTiersEntry *entry)
+{
+    entry->older = tiers->newest;
+    entry->newer = NULL;
+    if (tiers->newest) {
+        tiers->newest->newer = entry;
+    } else {
+        tiers->oldest = entry;
+    }
+    tiers->newest = entry;
+}
+
+static void PINRemoteImageMemoryTiersTrim(PINRemoteImageMemoryTiers *tiers, PINRemoteImageMemoryTiersDropFunction drop, void *context)
+{
+    while (tiers->decodedBytes - tiers->onDisplayBytes > tiers->byteLimit && tiers->oldest) {
+        PINRemoteImageMemoryTiersEntry *entry = tiers->oldest;
+        PINRemoteImageMemoryTiersUnlink(tiers, entry);
+        tiers->decodedBytes -= entry->decodedBytes;
+        entry->decodedBytes = 0;
+        if (drop) {
+            drop(context, entry->key, entry->keyLength);
+        }
+        PINRemoteImageMemoryTiersForgetIfUnused(tiers, entry);
+    }
+}
+
+// MARK: - Display
+
+void PINRemoteImageMemoryTiersSetByteLimit(PINRemoteImageMemoryTiers *tiers, size_t offDisplayByteLimit,
+                                           PINRemoteImageMemoryTiersDropFunction drop, void *context)
+{
+    tiers->byteLimit = offDisplayByteLimit;
+    PINRemoteImageMemoryTiersTrim(tiers, drop, context);
+}
+
+bool PINRemoteImageMemoryTiersEnterDisplay(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength)
+{
+    uint32_t hash = PINRemoteImageMemoryTiersHash(key, keyLength);
+    PINRemoteImageMemoryTiersEntry *entry = PINRemoteImageMemoryTiersLookup(tiers, key, keyLength, hash);
+    if (entry == NULL) {
+        entry = PINRemoteImageMemoryTiersInsert(tiers, key, keyLength, hash);
+        if (entry == NULL) {
+            return false;
+        }
+    }
+    if (entry->displayCount++ == 0 && entry->decodedBytes > 0) {
+        PINRemoteImageMemoryTiersUnlink(tiers, entry);
+        tiers->onDisplayBytes += entry->decodedBytes;
+    }
+    return true;
+}
+
+void PINRemoteImageMemoryTiersExitDisplay(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength,
+                                          PINRemoteImageMemoryTiersDropFunction drop, void *context)
+{
+    PINRemoteImageMemoryTiersEntry *entry = PINRemoteImageMemoryTiersLookup(tiers, key, keyLength, PINRemoteImageMemoryTiersHash(key, keyLength));
+    if (entry == NULL || entry->displayCount == 0) {
+        return;
+    }
+    if (--entry->displayCount > 0) {
+        return;
+    }
+    if (entry->decodedBytes > 0) {
+        tiers->onDisplayBytes -= entry->decodedBytes;
+        PINRemoteImageMemoryTiersLinkNewest(tiers, entry);
+        PINRemoteImageMemoryTiersTrim(tiers, drop, context);
+    } else {
+        PINRemoteImageMemoryTiersForgetIfUnused(tiers, entry);
+    }
+}
+
+bool PINRemoteImageMemoryTiersIsOnDisplay(const PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength)
+{
+    PINRemoteImageMemoryTiersEntry *entry = PINRemoteImageMemoryTiersLookup(tiers, key, keyLength, PINRemoteImageMemoryTiersHash(key, keyLength));
+    return entry && entry->displayCount > 0;
+}
+
+// MARK: - Bitmaps
+
+bool PINRemoteImageMemoryTiersSetDecodedBytes(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength, size_t bytes,
+                                              PINRemoteImageMemoryTiersDropFunction drop, void *context)
+{
+    uint32_t hash = PINRemoteImageMemoryTiersHash(key, keyLength);
+    PINRemoteImageMemoryTiersEntry *entry = PINRemoteImageMemoryTiersLookup(tiers, key, keyLength, hash);
+    if (entry == NULL) {
+        if (bytes == 0) {
+            return true;
+        }
+        entry = PINRemoteImageMemoryTiersInsert(tiers, key, keyLength, hash);
+        if (entry == NULL) {
+            return false;
+        }
+    }
+    tiers->decodedBytes += bytes - entry->decodedBytes;
+    if (entry->displayCount > 0) {
+        tiers->onDisplayBytes += bytes - entry->decodedBytes;
+        entry->decodedBytes = bytes;
+        PINRemoteImageMemoryTiersForgetIfUnused(tiers, entry);
+        return true;
+    }
+    if (entry->decodedBytes > 0) {
+        PINRemoteImageMemoryTiersUnlink(tiers, entry);
+    }
+    entry->decodedBytes = bytes;
+    if (bytes > 0) {
+        PINRemoteImageMemoryTiersLinkNewest(tiers, entry);
+        PINRemoteImageMemoryTiersTrim(tiers, drop, context);
+    } else {
+        PINRemoteImageMemoryTiersForgetIfUnused(tiers, entry);
+    }
+    return true;
+}
+
+void PINRemoteImageMemoryTiersTouch(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength)
+{
+    PINRemoteImageMemoryTiersEntry *entry = PINRemoteImageMemoryTiersLookup(tiers, key, keyLength, PINRemoteImageMemoryTiersHash(key, keyLength));
+    if (entry && entry->displayCount == 0 && entry->decodedBytes > 0 && entry != tiers->newest) {
+        PINRemoteImageMemoryTiersUnlink(tiers, entry);
+        PINRemoteImageMemoryTiersLinkNewest(tiers, entry);
+    }
+}
+
+size_t PINRemoteImageMemoryTiersDecodedBytes(const PINRemoteImageMemoryTiers *tiers)
+{
+    return tiers->decodedBytes;
+}
+
+size_t PINRemoteImageMemoryTiersOnDisplayBytes(const PINRemoteImageMemoryTiers *tiers)
+{
+    return tiers->onDisplayBytes;
+}
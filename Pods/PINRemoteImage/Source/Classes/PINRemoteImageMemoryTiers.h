@@ -0,0 +1,79 @@
+//
+//  PINRemoteImageMemoryTiers.h
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#ifndef PINRemoteImageMemoryTiers_h
+#define PINRemoteImageMemoryTiers_h
+
+// Plain C with no Foundation dependency, so the policy behind
+// PINRemoteImageManager's memory cache can be built and replayed against
+// scroll traces on its own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Called for each image whose decoded bitmap should be dropped, leaving its compressed bytes. */
+typedef void (*PINRemoteImageMemoryTiersDropFunction)(void *context, const char *key, size_t keyLength);
+
+/**
+ Decides which images in memory keep a decoded bitmap besides their
+ compressed bytes.
+
+ An image is on display from when a view showing it enters the display
+ range, as ASRangeController reports it, until it exits; several views may
+ show the same image. Images on display always keep their bitmaps. The
+ others keep theirs, most recently used first, up to a byte limit; past it
+ the least recently used are dropped, so scrolling back a little finds
+ bitmaps but a long chat holds only compressed bytes for what scrolled away.
+
+ Images are identified by their cache keys. Drop functions are called
+ before the call that passes them returns, and must not call back in. Not
+ thread safe.
+ */
+typedef struct PINRemoteImageMemoryTiers PINRemoteImageMemoryTiers;
+
+PINRemoteImageMemoryTiers *PINRemoteImageMemoryTiersCreate(size_t offDisplayByteLimit);
+
+void PINRemoteImageMemoryTiersDestroy(PINRemoteImageMemoryTiers *tiers);
+
+void PINRemoteImageMemoryTiersSetByteLimit(PINRemoteImageMemoryTiers *tiers, size_t offDisplayByteLimit,
+                                           PINRemoteImageMemoryTiersDropFunction drop, void *context);
+
+/** Returns false on allocation failure, leaving the image off display. */
+bool PINRemoteImageMemoryTiersEnterDisplay(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength);
+
+/** Balances PINRemoteImageMemoryTiersEnterDisplay. */
+void PINRemoteImageMemoryTiersExitDisplay(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength,
+                                          PINRemoteImageMemoryTiersDropFunction drop, void *context);
+
+bool PINRemoteImageMemoryTiersIsOnDisplay(const PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength);
+
+/**
+ Records that an image now keeps a bitmap of `bytes`, replacing what was
+ recorded for it, and counts as a use. 0 records that it has none. Returns
+ false on allocation failure, in which case the caller should drop the
+ bitmap itself.
+ */
+bool PINRemoteImageMemoryTiersSetDecodedBytes(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength, size_t bytes,
+                                              PINRemoteImageMemoryTiersDropFunction drop, void *context);
+
+/** Counts a use of an image's bitmap, keeping it longer once off display. */
+void PINRemoteImageMemoryTiersTouch(PINRemoteImageMemoryTiers *tiers, const char *key, size_t keyLength);
+
+/** Bytes of bitmaps recorded in all, and for images on display. */
+size_t PINRemoteImageMemoryTiersDecodedBytes(const PINRemoteImageMemoryTiers *tiers);
+size_t PINRemoteImageMemoryTiersOnDisplayBytes(const PINRemoteImageMemoryTiers *tiers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINRemoteImageMemoryTiers_h
@@ -35,6 +35,11 @@ NSData * __nullable PINImagePNGRepresentation(PINImage * __nonnull image);
 
 + (nullable PINImage *)pin_decodedImageWithData:(nonnull NSData *)data;
 + (nullable PINImage *)pin_decodedImageWithData:(nonnull NSData *)data skipDecodeIfPossible:(BOOL)skipDecodeIfPossible;
+/**
+ Decodes at no more than `maxPixelSize` pixels on the longer side, with the orientation applied. JPEGs are
+ downsampled while decoding, so this costs far less than decoding at full size and scaling.
+ */
++ (nullable PINImage *)pin_decodedImageWithData:(nonnull NSData *)data maxPixelSize:(NSUInteger)maxPixelSize;
 + (nullable PINImage *)pin_decodedImageWithCGImageRef:(nonnull CGImageRef)imageRef;
 #if PIN_TARGET_IOS
 + (nullable PINImage *)pin_decodedImageWithCGImageRef:(nonnull CGImageRef)imageRef orientation:(UIImageOrientation) orientation;
@@ -21,4 +21,15 @@
 - (PINImage *)pin_scaledImageForKey:(NSString *)key;
 + (PINImage *)pin_scaledImageForImage:(PINImage *)image withKey:(NSString *)key;
 
+/**
+ Returns the image averaged down so neither side exceeds maxPixelSize pixels, or
+ the receiver if it already fits. A bitmap already decoded as 32-bit premultiplied
+ BGRA is read as it is. Any other image is drawn a band of rows at a time into the
+ resizer, so no second full size bitmap is drawn; but an image that is not decoded
+ yet, e.g. one made from JPEG data, is still decoded whole by the first draw. Given
+ the encoded data, +pin_decodedImageWithData:maxPixelSize: decodes straight to the
+ smaller size instead. Returns nil if the image has no bitmap or memory runs out.
+ */
+- (PINImage *)pin_imageDownsampledToMaxPixelSize:(CGFloat)maxPixelSize;
+
 @end
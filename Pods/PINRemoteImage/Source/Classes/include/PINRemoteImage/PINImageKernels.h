@@ -0,0 +1,119 @@
+//
+//  PINImageKernels.h
+//  PINRemoteImage
+//
+//  Copyright © 2017 Pinterest. All rights reserved.
+//
+
+#ifndef PINImageKernels_h
+#define PINImageKernels_h
+
+// Plain C with no Foundation dependency, so the kernels can be built, checked
+// against their scalar reference and benchmarked on their own.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Pixels of four 8-bit channels with alpha last, as RGBA or BGRA, premultiplied
+ unless a kernel says otherwise. Rows may be padded to `rowBytes`.
+ */
+typedef struct {
+    uint8_t *data;
+    size_t width;
+    size_t height;
+    size_t rowBytes;
+} PINImageKernelsBuffer;
+
+typedef enum {
+    /** The reference every other implementation must match exactly. */
+    PINImageKernelsISAScalar,
+    PINImageKernelsISASSE2,
+    PINImageKernelsISAAVX2,
+    PINImageKernelsISANEON,
+} PINImageKernelsISA;
+
+bool PINImageKernelsISAIsSupported(PINImageKernelsISA isa);
+
+/** The implementation kernels use, by default the best one supported. */
+PINImageKernelsISA PINImageKernelsGetISA(void);
+
+/**
+ Switches implementations, for checking and benchmarking them against each
+ other. Fails if `isa` isn't supported. Not thread safe with kernels running.
+ */
+bool PINImageKernelsSetISA(PINImageKernelsISA isa);
+
+// MARK: - Conversion
+
+/** Premultiplies `count` pixels by their alpha, rounding to nearest. */
+void PINImageKernelsPremultiply(uint8_t *pixels, size_t count);
+
+/** Undoes PINImageKernelsPremultiply as closely as 8 bits allow. Scalar everywhere. */
+void PINImageKernelsUnpremultiply(uint8_t *pixels, size_t count);
+
+// MARK: - Resizing
+
+typedef enum {
+    /** Each destination pixel averages the source pixels it covers. Best for downsampling. */
+    PINImageKernelsFilterArea,
+    /** Lanczos with three lobes, stretched by the downsampling factor. Sharper, slower. */
+    PINImageKernelsFilterLanczos3,
+} PINImageKernelsFilter;
+
+/**
+ Resizes an image whose rows arrive in bands, such as from a decoder or from
+ drawing a large image a strip at a time, holding only as many resampled rows
+ as one destination row needs.
+
+ Rows are resampled horizontally into 8-bit rows, then vertically into the
+ destination, with 14-bit fixed-point weights. Premultiplied pixels resample
+ correctly; unpremultiplied ones bleed color out of transparent areas.
+
+ Not thread safe.
+ */
+typedef struct PINImageKernelsResizer PINImageKernelsResizer;
+
+/** Writes into `destination`, which must outlive the resizer. Returns NULL on bad sizes or allocation failure. */
+PINImageKernelsResizer *PINImageKernelsResizerCreate(size_t sourceWidth, size_t sourceHeight, const PINImageKernelsBuffer *destination, PINImageKernelsFilter filter);
+
+void PINImageKernelsResizerDestroy(PINImageKernelsResizer *resizer);
+
+/**
+ Consumes the next `rowCount` source rows, writing every destination row they
+ complete, and returns how many destination rows are complete so far. Rows
+ past the source height are ignored.
+ */
+size_t PINImageKernelsResizerConsumeRows(PINImageKernelsResizer *resizer, const uint8_t *rows, size_t rowBytes, size_t rowCount);
+
+/** Bytes the resizer holds besides the destination. */
+size_t PINImageKernelsResizerScratchBytes(const PINImageKernelsResizer *resizer);
+
+/** Resizes a whole image. Returns false on bad sizes or allocation failure. */
+bool PINImageKernelsResize(const PINImageKernelsBuffer *source, const PINImageKernelsBuffer *destination, PINImageKernelsFilter filter);
+
+// MARK: - Blurring
+
+/**
+ Blurs in place with a box of 2 * `radius` + 1 pixels a side, extending the
+ edges, horizontally then vertically. Holds about `radius` + 4 rows besides
+ the image. Returns false on allocation failure.
+ */
+bool PINImageKernelsBoxBlur(const PINImageKernelsBuffer *buffer, uint32_t radius);
+
+/**
+ Approximates a gaussian blur of standard deviation `sigma` with three box
+ blurs, to within about 3%.
+ */
+bool PINImageKernelsGaussianBlur(const PINImageKernelsBuffer *buffer, double sigma);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PINImageKernels_h
@@ -326,6 +326,16 @@ typedef void(^PINRemoteImageManagerMetrics)(NSURL  * __nonnull url, NSURLSession
 - (void)setMaxNumberOfConcurrentDownloads:(NSInteger)maxNumberOfConcurrentDownloads
                                completion:(nullable dispatch_block_t)completion;
 
+/**
+ Set the bytes of decoded bitmaps the memory cache keeps for images not on display.
+ @see imageWillEnterDisplayWithURL:processorKey:targetPixelSize:completion:
+ 
+ @param offDisplayDecodedByteLimit The byte limit. Defaults to 32 MB.
+ @param completion Completion to be called once offDisplayDecodedByteLimit is set.
+ */
+- (void)setOffDisplayDecodedByteLimit:(NSUInteger)offDisplayDecodedByteLimit
+                           completion:(nullable dispatch_block_t)completion;
+
 /**
  Set the estimated time remaining to download threshold at which to generate progressive images. Progressive images previews will only be generated if the estimated remaining time on a download is greater than estimatedTimeRemainingThreshold. If estimatedTimeRemainingThreshold is less than or equal to zero, this check is skipped.
  
@@ -655,6 +665,33 @@ typedef void(^PINRemoteImageManagerMetrics)(NSURL  * __nonnull url, NSURLSession
  */
 - (nonnull PINRemoteImageManagerResult *)synchronousImageFromCacheWithURL:(nonnull NSURL *)url processorKey:(nullable NSString *)processorKey options:(PINRemoteImageManagerDownloadOptions)options;
 
+/**
+ Tells the manager that a view showing the image at url has entered the display range, and decodes it, from
+ compressed bytes in the memory or disk cache, at the size it is drawn at. The memory cache keeps decoded bitmaps
+ of images on display; those of other images are dropped, least recently used first, past the limit set by
+ setOffDisplayDecodedByteLimit:completion:, leaving their compressed bytes.
+ 
+ Balance each call with imageDidExitDisplayWithURL:processorKey:.
+ 
+ @param url NSURL that was used to download image
+ @param processorKey An optional key to uniquely identify the processor used to post-process the downloaded image.
+ @param targetPixelSize The size in pixels the image is drawn at. The image is decoded no larger on its longer side.
+ @param completion Called on an arbitrary queue with the decoded image, or nil if it isn't cached or the view left the
+ display range first.
+ */
+- (void)imageWillEnterDisplayWithURL:(nonnull NSURL *)url
+                        processorKey:(nullable NSString *)processorKey
+                     targetPixelSize:(CGSize)targetPixelSize
+                          completion:(nullable void (^)(PINImage * _Nullable image))completion;
+
+/**
+ Tells the manager that a view showing the image at url has left the display range.
+ 
+ @param url NSURL that was passed to imageWillEnterDisplayWithURL:processorKey:targetPixelSize:completion:
+ @param processorKey The processorKey that was passed with it.
+ */
+- (void)imageDidExitDisplayWithURL:(nonnull NSURL *)url processorKey:(nullable NSString *)processorKey;
+
 /**
  Cancel a download. Canceling will only cancel the download if all other downloads are also canceled with their associated UUIDs. 
  Canceling *does not* guarantee that your completion will not be called. You can use the UUID provided on the result object to verify
@@ -22,6 +22,7 @@
 #import "PINGIFAnimatedImage.h"
 #import "PINImage+DecodedImage.h"
 #import "PINImage+ScaledImage.h"
+#import "PINImageKernels.h"
 #import "PINImageView+PINRemoteImage.h"
 #import "PINProgressiveImage.h"
 #import "PINRemoteImage.h"
@@ -98,6 +98,7 @@
 #import "ASIntegerMap.h"
 #import "ASLayoutController.h"
 #import "ASLayoutRangeType.h"
+#import "ASLockProfiler.h"
 #import "ASMainSerialQueue.h"
 #import "ASMutableAttributedStringBuilder.h"
 #import "ASObjectDescriptionHelpers.h"
@@ -159,6 +160,7 @@
 #import "ASEqualityHelpers.h"
 #import "ASLog.h"
 #import "ASSignpost.h"
+#import "ASTrace.h"
 #import "AsyncDisplayKit+Debug.h"
 #import "AsyncDisplayKit+Tips.h"
 #import "ASTextNodeTypes.h"
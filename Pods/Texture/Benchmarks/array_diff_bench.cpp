@@ -0,0 +1,506 @@
+// Scaling of -[NSArray asdk_diffWithArray:insertions:deletions:moves:].
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -o array_diff_bench array_diff_bench.cpp
+//   ./array_diff_bench [--quick] > result.json
+//
+// Compares AS::DiffArrays with a copy of the algorithm it replaced: a full
+// (n+1) x (m+1) longest common subsequence table, then move detection through
+// an unordered_multimap. Elements are heap objects whose hash and equality go
+// through virtual calls, standing in for -hash and -isEqual:. The old
+// algorithm only runs up to 4000 elements, where its table takes 128 MB.
+//
+// First checks random pairs of short sequences over small alphabets, so most
+// hold duplicates: the longest common subsequence must be as long as the old
+// table's, and applying each diff's deletions, insertions and moves to the
+// old sequence must rebuild the new one. Exits with 1 on any mismatch.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "../Source/Private/ASArrayDiff.h"
+
+#define TRIALS 3
+#define LEGACY_MAX 4000
+
+static double min_time = 0.2;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// MARK: - Elements
+
+class Element {
+public:
+  explicit Element(uint64_t id) : _id(id) {}
+  virtual ~Element() {}
+  virtual uint64_t Hash() const;
+  virtual bool IsEqual(const Element *other) const;
+
+private:
+  uint64_t _id;
+};
+
+// Out of line, so every call is a real dispatch.
+__attribute__((noinline)) uint64_t Element::Hash() const {
+  return _id * 0x9E3779B97F4A7C15ull;
+}
+
+__attribute__((noinline)) bool Element::IsEqual(const Element *other) const {
+  return _id == other->_id;
+}
+
+typedef std::vector<const Element *> Elements;
+
+// MARK: - Previous algorithm
+
+static std::set<size_t> S_legacy_common(const Elements &a, const Elements &b) {
+  size_t n = a.size(), m = b.size();
+  long **lengths = (long **)malloc(sizeof(long *) * (n + 1));
+  for (size_t i = 0; i <= n; i++) {
+    lengths[i] = (long *)malloc(sizeof(long) * (m + 1));
+    for (size_t j = 0; j <= m; j++) {
+      if (i == 0 || j == 0) {
+        lengths[i][j] = 0;
+      } else if (a[i - 1]->IsEqual(b[j - 1])) {
+        lengths[i][j] = 1 + lengths[i - 1][j - 1];
+      } else {
+        lengths[i][j] = std::max(lengths[i - 1][j], lengths[i][j - 1]);
+      }
+    }
+  }
+  std::set<size_t> common;
+  size_t i = n, j = m;
+  while (i > 0 && j > 0) {
+    if (a[i - 1]->IsEqual(b[j - 1])) {
+      common.insert(i - 1);
+      i--;
+      j--;
+    } else if (lengths[i - 1][j] > lengths[i][j - 1]) {
+      i--;
+    } else {
+      j--;
+    }
+  }
+  for (i = 0; i <= n; i++) {
+    free(lengths[i]);
+  }
+  free(lengths);
+  return common;
+}
+
+struct ElementHash {
+  size_t operator()(const Element *e) const { return (size_t)e->Hash(); }
+};
+struct ElementEqual {
+  bool operator()(const Element *l, const Element *r) const {
+    return l->IsEqual(r);
+  }
+};
+
+static void S_legacy_diff(const Elements &a, const Elements &b,
+                          AS::ArrayDiff &diff) {
+  std::unordered_multimap<const Element *, size_t, ElementHash, ElementEqual>
+      potentialMoves;
+  std::set<size_t> common = S_legacy_common(a, b), deletions;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!common.count(i)) {
+      deletions.insert(i);
+    }
+    potentialMoves.insert(std::make_pair(a[i], i));
+  }
+  Elements commonObjects;
+  for (size_t i : common) {
+    commonObjects.push_back(a[i]);
+  }
+  for (size_t i = 0, j = 0; j < b.size(); j++) {
+    auto found = potentialMoves.find(b[j]);
+    size_t movedFrom = SIZE_MAX;
+    if (found != potentialMoves.end() && found->second != j) {
+      movedFrom = found->second;
+      potentialMoves.erase(found);
+      diff.moves.emplace_back(movedFrom, j);
+    }
+    if (i < commonObjects.size() && commonObjects[i]->IsEqual(b[j])) {
+      i++;
+    } else if (movedFrom != SIZE_MAX) {
+      deletions.erase(movedFrom);
+      if (common.erase(movedFrom)) {
+        commonObjects.clear();
+        for (size_t c : common) {
+          commonObjects.push_back(a[c]);
+        }
+      }
+    } else {
+      diff.insertions.push_back(j);
+    }
+  }
+  diff.deletions.assign(deletions.begin(), deletions.end());
+}
+
+// MARK: - New algorithm
+
+// As NSArray+Diffing drives it: hashes first, equality only on hash matches.
+static void S_diff(const Elements &a, const Elements &b, AS::ArrayDiff &diff) {
+  std::vector<uint64_t> aHashes(a.size()), bHashes(b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    aHashes[i] = a[i]->Hash();
+  }
+  for (size_t j = 0; j < b.size(); j++) {
+    bHashes[j] = b[j]->Hash();
+  }
+  AS::DiffArrays(a.size(), b.size(), aHashes.data(), bHashes.data(),
+                 [&](size_t i, size_t j) { return a[i]->IsEqual(b[j]); }, true,
+                 diff);
+}
+
+// MARK: - Checks
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t S_random() {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return S_state >> 17;
+}
+
+static bool S_equal(const Elements &a, const Elements &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!a[i]->IsEqual(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool S_ascending(const std::vector<size_t> &indexes, size_t bound) {
+  for (size_t k = 0; k < indexes.size(); k++) {
+    if (indexes[k] >= bound || (k > 0 && indexes[k] <= indexes[k - 1])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Deletes from the top down, then inserts from the bottom up.
+static bool S_rebuilds(const Elements &a, const Elements &b,
+                       const AS::ArrayDiff &diff) {
+  if (!diff.moves.empty() || !S_ascending(diff.deletions, a.size()) ||
+      !S_ascending(diff.insertions, b.size())) {
+    return false;
+  }
+  Elements result = a;
+  for (size_t k = diff.deletions.size(); k-- > 0;) {
+    result.erase(result.begin() + diff.deletions[k]);
+  }
+  for (size_t j : diff.insertions) {
+    if (j > result.size()) {
+      return false;
+    }
+    result.insert(result.begin() + j, b[j]);
+  }
+  return S_equal(result, b);
+}
+
+// Every new index is a move's or an insertion's destination, or keeps the
+// old element at the same index; every old index is moved from, deleted or
+// kept, exactly one of them.
+static bool S_rebuilds_with_moves(const Elements &a, const Elements &b,
+                                  const AS::ArrayDiff &diff) {
+  if (!S_ascending(diff.deletions, a.size()) ||
+      !S_ascending(diff.insertions, b.size())) {
+    return false;
+  }
+  std::vector<int> from(a.size(), 0), to(b.size(), 0);
+  Elements result(b.size(), nullptr);
+  for (size_t k = 0; k < diff.moves.size(); k++) {
+    size_t i = diff.moves[k].first, j = diff.moves[k].second;
+    if (i >= a.size() || j >= b.size() || i == j ||
+        (k > 0 && j <= diff.moves[k - 1].second)) {
+      return false;
+    }
+    from[i]++;
+    to[j]++;
+    result[j] = a[i];
+  }
+  for (size_t i : diff.deletions) {
+    from[i]++;
+  }
+  for (size_t j : diff.insertions) {
+    to[j]++;
+    result[j] = b[j];
+  }
+  for (size_t j = 0; j < b.size(); j++) {
+    if (to[j] == 0) {
+      if (j >= a.size() || from[j] != 0) {
+        return false;
+      }
+      from[j]++;
+      to[j]++;
+      result[j] = a[j];
+    }
+    if (to[j] != 1) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (from[i] != 1) {
+      return false;
+    }
+  }
+  return S_equal(result, b);
+}
+
+// Random sequences over a small alphabet, so most of them hold duplicates,
+// and edits of them.
+static void S_random_pair(std::vector<std::unique_ptr<Element>> &pool,
+                          Elements &a, Elements &b) {
+  const uint64_t alphabet = 1 + S_random() % 12;
+  auto element = [&]() {
+    pool.emplace_back(new Element(S_random() % alphabet));
+    return pool.back().get();
+  };
+  const size_t n = S_random() % 40;
+  for (size_t i = 0; i < n; i++) {
+    a.push_back(element());
+  }
+  if (S_random() % 5 == 0) {
+    const size_t m = S_random() % 40;
+    for (size_t j = 0; j < m; j++) {
+      b.push_back(element());
+    }
+    return;
+  }
+  b = a;
+  const size_t edits = S_random() % 8;
+  for (size_t e = 0; e < edits; e++) {
+    const size_t at = S_random() % (b.size() + 1);
+    switch (S_random() % 4) {
+    case 0:
+      b.insert(b.begin() + at, element());
+      break;
+    case 1:
+      if (at < b.size()) b.erase(b.begin() + at);
+      break;
+    case 2:
+      if (at < b.size()) b[at] = element();
+      break;
+    default:
+      if (at < b.size()) {
+        const Element *moved = b[at];
+        b.erase(b.begin() + at);
+        b.insert(b.begin() + S_random() % (b.size() + 1), moved);
+      }
+      break;
+    }
+  }
+}
+
+// Compares the common subsequence's length with the legacy table's and
+// rebuilds the new sequence from each diff: with hashes and moves, with
+// hashes only, and without either. Returns the number of mismatches.
+static size_t S_check_random(size_t pairs) {
+  size_t mismatches = 0;
+  for (size_t p = 0; p < pairs; p++) {
+    std::vector<std::unique_ptr<Element>> pool;
+    Elements a, b;
+    S_random_pair(pool, a, b);
+    auto equal = [&](size_t i, size_t j) { return a[i]->IsEqual(b[j]); };
+
+    std::vector<size_t> common;
+    AS::LongestCommonSubsequence(a.size(), b.size(), equal, common);
+    const size_t legacy = S_legacy_common(a, b).size();
+    bool ok = common.size() == legacy && S_ascending(common, a.size());
+
+    std::vector<uint64_t> aHashes(a.size()), bHashes(b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+      aHashes[i] = a[i]->Hash();
+    }
+    for (size_t j = 0; j < b.size(); j++) {
+      bHashes[j] = b[j]->Hash();
+    }
+    AS::ArrayDiff moved, hashed, plain;
+    AS::DiffArrays(a.size(), b.size(), aHashes.data(), bHashes.data(), equal,
+                   true, moved);
+    AS::DiffArrays(a.size(), b.size(), aHashes.data(), bHashes.data(), equal,
+                   false, hashed);
+    AS::DiffArrays(a.size(), b.size(), nullptr, nullptr, equal, false, plain);
+    ok = ok && a.size() - plain.deletions.size() == legacy &&
+         b.size() - plain.insertions.size() == legacy &&
+         S_rebuilds(a, b, plain) && S_rebuilds(a, b, hashed) &&
+         hashed.deletions == plain.deletions &&
+         hashed.insertions == plain.insertions &&
+         S_rebuilds_with_moves(a, b, moved);
+
+    if (!ok) {
+      if (mismatches++ < 10) {
+        fprintf(stderr, "pair %zu (%zu -> %zu elements, common %zu, legacy "
+                        "%zu) doesn't match\n",
+                p, a.size(), b.size(), common.size(), legacy);
+      }
+    }
+  }
+  return mismatches;
+}
+
+// MARK: - Workloads
+
+struct edit {
+  const char *name;
+  size_t max_elements;
+  void (*apply)(Elements &b, std::vector<std::unique_ptr<Element>> &pool,
+                std::mt19937 &rng);
+};
+
+static const Element *S_new_element(std::vector<std::unique_ptr<Element>> &pool) {
+  pool.emplace_back(new Element(1000000000ull + pool.size()));
+  return pool.back().get();
+}
+
+// A streamed reply: a few new messages at the end.
+static void edit_append(Elements &b, std::vector<std::unique_ptr<Element>> &pool,
+                        std::mt19937 &) {
+  for (int i = 0; i < 20; i++) {
+    b.push_back(S_new_element(pool));
+  }
+}
+
+// One percent of the elements inserted, deleted or replaced anywhere.
+static void edit_scattered(Elements &b,
+                           std::vector<std::unique_ptr<Element>> &pool,
+                           std::mt19937 &rng) {
+  size_t edits = b.size() / 100 + 1;
+  for (size_t e = 0; e < edits; e++) {
+    size_t at = rng() % (b.size() + 1);
+    switch (rng() % 3) {
+    case 0:
+      b.insert(b.begin() + at, S_new_element(pool));
+      break;
+    case 1:
+      if (at < b.size()) b.erase(b.begin() + at);
+      break;
+    default:
+      if (at < b.size()) b[at] = S_new_element(pool);
+      break;
+    }
+  }
+}
+
+// Ten elements moved elsewhere.
+static void edit_moves(Elements &b, std::vector<std::unique_ptr<Element>> &,
+                       std::mt19937 &rng) {
+  for (int i = 0; i < 10 && b.size() > 1; i++) {
+    size_t from = rng() % b.size();
+    const Element *e = b[from];
+    b.erase(b.begin() + from);
+    b.insert(b.begin() + rng() % (b.size() + 1), e);
+  }
+}
+
+// Nothing stays in order: the O(n^2) worst case for the new algorithm too.
+static void edit_reverse(Elements &b, std::vector<std::unique_ptr<Element>> &,
+                         std::mt19937 &) {
+  std::reverse(b.begin(), b.end());
+}
+
+static const edit EDITS[] = {
+    {"append", SIZE_MAX, edit_append},
+    {"scattered_1pct", SIZE_MAX, edit_scattered},
+    {"moves", SIZE_MAX, edit_moves},
+    {"reverse", 16000, edit_reverse},
+};
+
+typedef void (*diff_fn)(const Elements &a, const Elements &b,
+                        AS::ArrayDiff &diff);
+
+// Best per-call time over TRIALS runs of at least min_time / TRIALS each.
+static double S_measure(diff_fn fn, const Elements &a, const Elements &b) {
+  double best = 1e30;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t iterations = 0;
+    double start = S_now(), elapsed;
+    do {
+      AS::ArrayDiff diff;
+      fn(a, b, diff);
+      iterations++;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time / TRIALS);
+    best = std::min(best, elapsed / iterations);
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  static const size_t SIZES[] = {250, 1000, 4000, 16000, 64000};
+  size_t sizes = sizeof(SIZES) / sizeof(SIZES[0]);
+  size_t edits = sizeof(EDITS) / sizeof(EDITS[0]);
+  size_t pairs = 50000;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.02;
+      sizes = 3;
+      pairs = 5000;
+    }
+  }
+
+  const size_t mismatches = S_check_random(pairs);
+  if (mismatches) {
+    fprintf(stderr, "%zu of %zu random pairs don't match\n", mismatches, pairs);
+    return 1;
+  }
+
+  printf("{\n  \"edits\": [\n");
+  for (size_t e = 0; e < edits; e++) {
+    printf("    {\n      \"name\": \"%s\",\n      \"points\": [\n",
+           EDITS[e].name);
+    size_t points = 0;
+    while (points < sizes && SIZES[points] <= EDITS[e].max_elements) {
+      points++;
+    }
+    for (size_t s = 0; s < points; s++) {
+      std::vector<std::unique_ptr<Element>> pool;
+      std::mt19937 rng(42);
+      Elements a, b;
+      for (size_t i = 0; i < SIZES[s]; i++) {
+        a.push_back(S_new_element(pool));
+      }
+      b = a;
+      EDITS[e].apply(b, pool, rng);
+
+      AS::ArrayDiff diff;
+      S_diff(a, b, diff);
+      double seconds = S_measure(S_diff, a, b);
+      printf("        {\"elements\": %zu, \"insertions\": %zu, "
+             "\"deletions\": %zu, \"moves\": %zu, \"seconds\": %.9f",
+             SIZES[s], diff.insertions.size(), diff.deletions.size(),
+             diff.moves.size(), seconds);
+      if (SIZES[s] <= LEGACY_MAX) {
+        double legacy = S_measure(S_legacy_diff, a, b);
+        printf(", \"legacy_seconds\": %.9f, \"legacy_table_bytes\": %zu, "
+               "\"speedup\": %.1f",
+               legacy, (a.size() + 1) * (b.size() + 1) * sizeof(long),
+               legacy / seconds);
+      }
+      printf("}%s\n", s + 1 == points ? "" : ",");
+    }
+    printf("      ]\n    }%s\n", e + 1 == edits ? "" : ",");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
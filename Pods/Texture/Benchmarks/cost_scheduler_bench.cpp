@@ -0,0 +1,293 @@
+// Checks and simulation of ASDataController's cost-aware node allocation.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -pthread -o cost_scheduler_bench
+//       cost_scheduler_bench.cpp
+//   ./cost_scheduler_bench [--quick] > result.json
+//
+// First the checks: the claim order must put prioritized items first and the
+// most expensive first within each group, keep the order of equal costs, and
+// leave the order alone without hints. Threads racing to claim must get every
+// item exactly once, and exactly one of them must be told it finished the
+// last prioritized item, after all of them had finished. Exits with 1 on
+// failure.
+//
+// Then simulates batches of chat cells on 4 cores: most are short bubbles, a
+// few are long code blocks, and the visible ones are the last rows. The cost
+// hints are the true costs off by up to 60%, as text length would be. Compares
+// claiming in index order (the old dispatch_apply over an atomic counter)
+// against most expensive first, and against streaming, where the batch can be
+// applied once the visible rows are ready and the rest get their frames on the
+// main thread as they finish. Reports the median and tail of the time until a
+// batch can be applied and until it is fully prepared.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../Source/Private/ASCostScheduler.h"
+
+// MARK: - Checks
+
+static bool S_check_order() {
+  AS::CostScheduler scheduler;
+  const double costs[] = {1, 5, 0, 5, 3, 0, 9, 2};
+  const bool prioritized[] = {false, false, true, false, true, false, false, true};
+  scheduler.Reset(8, [&](size_t i) { return costs[i]; }, [&](size_t i) { return prioritized[i]; });
+  const size_t expected[] = {4, 7, 2, 6, 1, 3, 0, 5};
+  for (size_t i = 0; i < 8; i++) {
+    size_t index = 0;
+    if (!scheduler.Claim(index) || index != expected[i]) {
+      fprintf(stderr, "claim %zu is %zu, expected %zu\n", i, index, expected[i]);
+      return false;
+    }
+  }
+  size_t index = 0;
+  if (scheduler.Claim(index) || scheduler.PrioritizedCount() != 3) {
+    fprintf(stderr, "claims past the end\n");
+    return false;
+  }
+
+  scheduler.Reset(8, [](size_t) { return 0.0; }, [](size_t) { return false; });
+  for (size_t i = 0; i < 8; i++) {
+    if (!scheduler.Claim(index) || index != i) {
+      fprintf(stderr, "order without hints changed\n");
+      return false;
+    }
+  }
+  if (!scheduler.PrioritizedFinished()) {
+    fprintf(stderr, "no prioritized items is not finished\n");
+    return false;
+  }
+
+  scheduler.Reset(8, [&](size_t i) { return costs[i]; }, [&](size_t i) { return prioritized[i]; });
+  size_t claimed = 0;
+  while (scheduler.ClaimPrioritized(index)) {
+    if (!prioritized[index]) {
+      fprintf(stderr, "claimed an item that isn't prioritized\n");
+      return false;
+    }
+    claimed++;
+  }
+  if (claimed != 3 || !scheduler.Claim(index) || index != 6 || scheduler.IsPrioritized(index) || !scheduler.IsPrioritized(7)) {
+    fprintf(stderr, "prioritized claims don't stop at the rest\n");
+    return false;
+  }
+
+  // Finishing items that aren't prioritized doesn't count towards them.
+  scheduler.Reset(8, [&](size_t i) { return costs[i]; }, [&](size_t i) { return prioritized[i]; });
+  if (scheduler.Finish(0) || scheduler.Finish(1) || scheduler.Finish(3) || scheduler.PrioritizedFinished()
+      || scheduler.Finish(2) || scheduler.Finish(4) || !scheduler.Finish(7)) {
+    fprintf(stderr, "finishing is reported at the wrong item\n");
+    return false;
+  }
+
+  // Enough equal costs that an unstable sort would reorder them.
+  const size_t count = 1000;
+  scheduler.Reset(count, [](size_t i) { return (double)(i % 3); }, [](size_t) { return false; });
+  size_t previous = 0;
+  for (size_t i = 0; i < count; i++) {
+    scheduler.Claim(index);
+    if (i > 0 && index % 3 == previous % 3 && index <= previous) {
+      fprintf(stderr, "equal costs were reordered\n");
+      return false;
+    }
+    previous = index;
+  }
+  return true;
+}
+
+static bool S_check_threads(size_t count, size_t threads) {
+  AS::CostScheduler scheduler;
+  scheduler.Reset(count, [](size_t i) { return (double)((i * 7919) % 101); }, [](size_t i) { return i % 5 == 0; });
+  std::vector<std::atomic<int>> claims(count);
+  for (std::atomic<int> &claim : claims) {
+    claim.store(0);
+  }
+  std::atomic<size_t> prioritizedDone(0);
+  std::atomic<int> lastReports(0);
+  std::atomic<bool> reportedEarly(false);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      size_t index;
+      // Half the threads only take prioritized items, like a streaming caller.
+      while (t % 2 == 0 ? scheduler.ClaimPrioritized(index) : scheduler.Claim(index)) {
+        claims[index]++;
+        const bool prioritized = index % 5 == 0;
+        if (prioritized) {
+          prioritizedDone++;
+        }
+        if (scheduler.Finish(index)) {
+          lastReports++;
+          if (prioritizedDone.load() != scheduler.PrioritizedCount() || !scheduler.PrioritizedFinished()) {
+            reportedEarly = true;
+          }
+        }
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (claims[i].load() != 1) {
+      fprintf(stderr, "item %zu was claimed %d times\n", i, claims[i].load());
+      return false;
+    }
+  }
+  if (lastReports.load() != 1 || reportedEarly.load()) {
+    fprintf(stderr, "the last prioritized item was reported %d times, early: %d\n", lastReports.load(),
+            (int)reportedEarly.load());
+    return false;
+  }
+  return true;
+}
+
+// MARK: - Simulation
+
+static const size_t kCores = 4;
+static const size_t kVisible = 6;
+// Helpers start a little after the calling thread.
+static const double kHelperStart = 0.05;
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static double S_uniform() {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return (double)(S_state >> 11) / (double)(1ull << 53);
+}
+
+struct Batch {
+  std::vector<double> costs; // ms
+  std::vector<double> hints;
+};
+
+static Batch S_batch() {
+  Batch batch;
+  const size_t count = 8 + (size_t)(S_uniform() * 32);
+  for (size_t i = 0; i < count; i++) {
+    const bool code = S_uniform() < 0.12;
+    const double cost = code ? 10 + S_uniform() * 50 : 0.5 + S_uniform() * 2.5;
+    batch.costs.push_back(cost);
+    batch.hints.push_back(cost * (0.6 + S_uniform() * 1.0));
+  }
+  return batch;
+}
+
+enum class Policy { IndexOrder, CostOrder, Streaming };
+
+struct Outcome {
+  double applied; // when the change set can go to the main thread
+  double prepared; // when every node is ready
+};
+
+static Outcome S_simulate(const Batch &batch, Policy policy) {
+  const size_t count = batch.costs.size();
+  AS::CostScheduler scheduler;
+  const bool streaming = policy == Policy::Streaming;
+  scheduler.Reset(count, [&](size_t i) {
+    return policy == Policy::IndexOrder ? 0.0 : batch.hints[i];
+  }, [&](size_t i) {
+    return streaming && i + kVisible >= count;
+  });
+  // Worker 0 is the calling thread.
+  std::vector<double> freeAt(kCores, kHelperStart);
+  freeAt[0] = 0;
+  std::vector<bool> retired(kCores, false);
+  Outcome outcome = {0, 0};
+  bool prioritizedReported = false;
+  while (true) {
+    size_t worker = kCores;
+    for (size_t w = 0; w < kCores; w++) {
+      if (!retired[w] && (worker == kCores || freeAt[w] < freeAt[worker])) {
+        worker = w;
+      }
+    }
+    if (worker == kCores) {
+      break;
+    }
+    size_t index;
+    const bool claimed = worker == 0 && streaming ? scheduler.ClaimPrioritized(index) : scheduler.Claim(index);
+    if (!claimed) {
+      retired[worker] = true;
+      continue;
+    }
+    freeAt[worker] += batch.costs[index];
+    outcome.prepared = std::max(outcome.prepared, freeAt[worker]);
+    if (scheduler.Finish(index)) {
+      outcome.applied = freeAt[worker];
+      prioritizedReported = true;
+    }
+  }
+  if (!streaming || !prioritizedReported) {
+    outcome.applied = outcome.prepared;
+  }
+  return outcome;
+}
+
+struct Percentiles {
+  double p50;
+  double p99;
+};
+
+static Percentiles S_percentiles(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return {values[values.size() / 2], values[values.size() * 99 / 100]};
+}
+
+int main(int argc, char **argv) {
+  size_t batches = 5000;
+  size_t items = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      batches = 500;
+      items = 2000;
+    }
+  }
+
+  if (!S_check_order() || !S_check_threads(items, 4) || !S_check_threads(7, 8)) {
+    return 1;
+  }
+
+  const Policy policies[] = {Policy::IndexOrder, Policy::CostOrder, Policy::Streaming};
+  const char *names[] = {"index_order", "cost_order", "streaming"};
+  std::vector<double> applied[3];
+  std::vector<double> prepared[3];
+  for (size_t b = 0; b < batches; b++) {
+    const Batch batch = S_batch();
+    for (int p = 0; p < 3; p++) {
+      const Outcome outcome = S_simulate(batch, policies[p]);
+      applied[p].push_back(outcome.applied);
+      prepared[p].push_back(outcome.prepared);
+    }
+  }
+
+  Percentiles appliedPercentiles[3];
+  Percentiles preparedPercentiles[3];
+  for (int p = 0; p < 3; p++) {
+    appliedPercentiles[p] = S_percentiles(applied[p]);
+    preparedPercentiles[p] = S_percentiles(prepared[p]);
+  }
+  if (preparedPercentiles[1].p99 > preparedPercentiles[0].p99 || appliedPercentiles[2].p99 > appliedPercentiles[1].p99) {
+    fprintf(stderr, "cost order or streaming made the tail worse\n");
+    return 1;
+  }
+
+  printf("{\n  \"batches\": %zu,\n  \"cores\": %zu,\n", batches, kCores);
+  for (int key = 0; key < 2; key++) {
+    printf("  \"%s\": {", key == 0 ? "applied_ms" : "prepared_ms");
+    for (int p = 0; p < 3; p++) {
+      const Percentiles &percentiles = key == 0 ? appliedPercentiles[p] : preparedPercentiles[p];
+      printf("\"%s\": {\"p50\": %.2f, \"p99\": %.2f}%s", names[p], percentiles.p50, percentiles.p99, p < 2 ? ", " : "");
+    }
+    printf("}%s\n", key == 0 ? "," : "");
+  }
+  printf("}\n");
+  return 0;
+}
@@ -0,0 +1,345 @@
+// Checks and simulation of ASRunLoopQueue's frame-budgeted draining.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -o frame_budget_bench frame_budget_bench.cpp
+//   ./frame_budget_bench [--quick] > result.json
+//
+// Drains a simulated queue one run loop pass per 60Hz frame, on a simulated
+// clock, the way -[ASRunLoopQueue processQueue] does. Items cost 50us with
+// jitter, then 400us, then 20ms, which is more than a whole budget. Compares
+// a fixed batch of 1 and of 10 against a 2ms budget, and a budget while
+// scrolling, then has the run loop turn four times a frame. Checks that no
+// budgeted frame overruns its budget by more than one item, however often the
+// run loop turns, even right after the cost jumps and a batch is sized for
+// cheaper items, that the cost estimate follows the step changes, that an item
+// costlier than the budget still drains one per pass, and that RingQueue is
+// first in, first out across growth and shrinking, handing back at the
+// front, and destroys what it holds.
+// Exits with 1 on failure.
+//
+// Then times RingQueue against the front erasure that compaction amounts to.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "../Source/Private/ASFrameBudget.h"
+#include "../Source/Private/ASRingQueue.h"
+
+#define TRIALS 3
+
+static double min_time = 0.2;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// MARK: - Simulation
+
+static const double kFrame = 1.0 / 60;
+static const double kBudget = 0.002;
+static const double kScrollingBudget = 0.0005;
+
+struct Workload {
+  std::vector<double> costs;
+  double maxCost;
+};
+
+static Workload S_workload(size_t count) {
+  Workload workload;
+  workload.maxCost = 0;
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for (size_t i = 0; i < count; i++) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    const double jitter = 0.8 + 0.4 * (double)(state >> 11) / (double)(1ull << 53);
+    const double base = i < count / 2 ? 50e-6 : i < count - 5 ? 400e-6 : 20e-3;
+    workload.costs.push_back(base * jitter);
+    workload.maxCost = std::max(workload.maxCost, base * jitter);
+  }
+  return workload;
+}
+
+struct Result {
+  size_t frames;
+  // The time spent per frame, over all of its passes.
+  double maxPass;
+  // Over frames where every item fits the budget on its own.
+  double maxPassOfCheapItems;
+  bool withinBudget;
+  bool tracksCost;
+};
+
+// batchSize 0 means by budget. The run loop turns `passesPerFrame` times a
+// frame, evenly spaced, or as soon as the last pass ends if that is later.
+static Result S_simulate(const Workload &workload, size_t batchSize, bool scrolling, size_t passesPerFrame) {
+  AS::FrameBudget budget(batchSize == 0 ? kBudget : 0, kScrollingBudget, 0.1);
+  AS::RingQueue<double> queue;
+  for (double cost : workload.costs) {
+    queue.PushBack(cost);
+  }
+  Result result = {0, 0, 0, true, true};
+  double now = 0;
+  size_t processed = 0;
+  while (!queue.IsEmpty()) {
+    const double frameStart = result.frames * kFrame;
+    result.frames++;
+    double frameSpent = 0;
+    double frameMaxCost = 0;
+    double frameBudget = 0;
+    for (size_t turn = 0; turn < passesPerFrame && !queue.IsEmpty(); turn++) {
+      now = std::max(now, frameStart + turn * kFrame / passesPerFrame);
+      if (now >= frameStart + kFrame) {
+        break;
+      }
+      const double passStart = now;
+      // A spent frame defers the rest of the queue to the next one.
+      if (batchSize == 0 && !budget.BeginPass(now, scrolling)) {
+        break;
+      }
+      if (batchSize == 0 && turn == 0) {
+        frameBudget = budget.PassBudget();
+      }
+      do {
+        const size_t count = batchSize == 0 ? budget.NextBatchSize(now, queue.Size()) : std::min(batchSize, queue.Size());
+        if (count == 0) {
+          break;
+        }
+        std::vector<double> batch;
+        for (size_t i = 0; i < count; i++) {
+          batch.push_back(queue.Front());
+          queue.PopFront();
+        }
+        const double batchStart = now;
+        size_t done = 0;
+        while (done < batch.size()) {
+          now += batch[done];
+          frameMaxCost = std::max(frameMaxCost, batch[done]);
+          done++;
+          if (batchSize == 0 && !budget.HasTimeLeft(now)) {
+            break;
+          }
+        }
+        for (size_t i = batch.size(); i > done; i--) {
+          queue.PushFront(std::move(batch[i - 1]));
+        }
+        if (batchSize == 0) {
+          budget.DidProcess(done, now - batchStart);
+        }
+        // Fifty items after each step change, the estimate should have caught up.
+        const size_t before = processed;
+        processed += done;
+        const size_t half = workload.costs.size() / 2;
+        if (batchSize == 0 && before < half + 50 && processed >= half + 50 && processed < half + 100) {
+          result.tracksCost = result.tracksCost && std::fabs(budget.EstimatedItemCost() - 400e-6) < 40e-6;
+        }
+        if (batchSize == 0 && processed >= 50 && before < 50) {
+          result.tracksCost = result.tracksCost && std::fabs(budget.EstimatedItemCost() - 50e-6) < 5e-6;
+        }
+      } while (batchSize == 0 && !queue.IsEmpty());
+      if (batchSize == 0) {
+        budget.EndPass(now);
+      }
+      frameSpent += now - passStart;
+    }
+    result.maxPass = std::max(result.maxPass, frameSpent);
+    if (frameMaxCost < kScrollingBudget) {
+      result.maxPassOfCheapItems = std::max(result.maxPassOfCheapItems, frameSpent);
+    }
+    if (batchSize == 0) {
+      // Items are checked one by one, so a frame overruns by at most its last item.
+      result.withinBudget = result.withinBudget && frameSpent <= frameBudget + frameMaxCost;
+    }
+  }
+  return result;
+}
+
+// MARK: - RingQueue checks
+
+struct Counted {
+  static int live;
+  int value;
+  explicit Counted(int v) : value(v) { live++; }
+  Counted(const Counted &other) : value(other.value) { live++; }
+  Counted(Counted &&other) : value(other.value) { live++; }
+  ~Counted() { live--; }
+};
+int Counted::live = 0;
+
+static bool S_check_ring() {
+  {
+    AS::RingQueue<Counted> queue;
+    std::deque<int> model;
+    int next = 0;
+    uint64_t state = 1;
+    size_t peak = 0;
+    for (int step = 0; step < 200000; step++) {
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      // Grow for a while, then shrink, so the ring wraps, doubles and halves.
+      const bool push = (step / 20000) % 2 == 0 ? (state >> 33) % 4 != 0 : (state >> 33) % 4 == 0;
+      if (push) {
+        queue.PushBack(Counted(next));
+        model.push_back(next++);
+      } else if (!model.empty() && (state >> 40) % 8 == 0) {
+        // Pop and hand back, as a pass out of time does.
+        Counted front = std::move(queue.Front());
+        queue.PopFront();
+        queue.PushFront(std::move(front));
+      } else if (!model.empty()) {
+        if (queue.Front().value != model.front()) {
+          fprintf(stderr, "ring is not first in, first out\n");
+          return false;
+        }
+        queue.PopFront();
+        model.pop_front();
+      }
+      peak = std::max(peak, queue.Capacity());
+      if (queue.Size() != model.size() || Counted::live != (int)model.size()
+          || (!model.empty() && queue[model.size() - 1].value != model.back())) {
+        fprintf(stderr, "ring size or contents are wrong\n");
+        return false;
+      }
+    }
+    while (!model.empty()) {
+      queue.PopFront();
+      model.pop_front();
+    }
+    if (queue.Capacity() > 32 || peak < 4096) {
+      fprintf(stderr, "ring does not grow and shrink (peak %zu, now %zu)\n", peak, queue.Capacity());
+      return false;
+    }
+    for (int i = 0; i < 100; i++) {
+      queue.PushBack(Counted(i));
+    }
+    queue.Clear();
+    if (Counted::live != 0 || !queue.IsEmpty()) {
+      fprintf(stderr, "ring clear leaks\n");
+      return false;
+    }
+    for (int i = 0; i < 100; i++) {
+      queue.PushBack(Counted(i));
+    }
+  }
+  if (Counted::live != 0) {
+    fprintf(stderr, "ring destructor leaks\n");
+    return false;
+  }
+  return true;
+}
+
+// MARK: - Storage timing
+
+// Enqueue `count`, then drain 10 per pass, as the deallocation queue did.
+__attribute__((noinline)) static uint64_t S_drain_ring(size_t count) {
+  AS::RingQueue<uint64_t> queue;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    queue.PushBack(i);
+  }
+  while (!queue.IsEmpty()) {
+    for (int i = 0; i < 10 && !queue.IsEmpty(); i++) {
+      sum += queue.Front();
+      queue.PopFront();
+    }
+  }
+  return sum;
+}
+
+// NSPointerArray nulls out what it hands over, then compacts the rest down.
+__attribute__((noinline)) static uint64_t S_drain_compacting(size_t count) {
+  std::vector<uint64_t> queue;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    queue.push_back(i);
+  }
+  while (!queue.empty()) {
+    const size_t n = std::min<size_t>(10, queue.size());
+    for (size_t i = 0; i < n; i++) {
+      sum += queue[i];
+    }
+    queue.erase(queue.begin(), queue.begin() + n);
+  }
+  return sum;
+}
+
+template <typename Drain>
+static double S_measure(Drain drain, size_t count) {
+  double best = 1e30;
+  volatile uint64_t sink = 0;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t items = 0;
+    const double start = S_now();
+    double elapsed = 0;
+    do {
+      sink += drain(count);
+      items += count;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time);
+    best = std::min(best, elapsed / items);
+  }
+  (void)sink;
+  return best;
+}
+
+int main(int argc, char **argv) {
+  size_t items = 4000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.02;
+      items = 1000;
+    }
+  }
+
+  if (!S_check_ring()) {
+    return 1;
+  }
+
+  const Workload workload = S_workload(items);
+  const Result one = S_simulate(workload, 1, false, 1);
+  const Result ten = S_simulate(workload, 10, false, 1);
+  const Result budgeted = S_simulate(workload, 0, false, 1);
+  const Result scrolling = S_simulate(workload, 0, true, 1);
+  const Result turning = S_simulate(workload, 0, false, 4);
+  if (!budgeted.withinBudget || !scrolling.withinBudget || !turning.withinBudget) {
+    fprintf(stderr, "a budgeted frame overran by more than one item\n");
+    return 1;
+  }
+  if (turning.frames != budgeted.frames) {
+    fprintf(stderr, "more run loop passes changed how many frames the queue takes\n");
+    return 1;
+  }
+  if (!budgeted.tracksCost) {
+    fprintf(stderr, "the cost estimate does not follow the workload\n");
+    return 1;
+  }
+  if (budgeted.frames >= one.frames || scrolling.frames <= budgeted.frames || scrolling.frames >= one.frames) {
+    fprintf(stderr, "budgeted draining is not faster than one per pass or slower while scrolling\n");
+    return 1;
+  }
+  if (budgeted.maxPass > workload.maxCost + kBudget) {
+    fprintf(stderr, "an item costlier than the budget was not processed alone\n");
+    return 1;
+  }
+
+  const size_t storageCount = 10000;
+  const double ringSeconds = S_measure(S_drain_ring, storageCount);
+  const double compactingSeconds = S_measure(S_drain_compacting, storageCount);
+
+  printf("{\n  \"items\": %zu,\n", items);
+  printf("  \"frames_to_drain\": {\"batch_1\": %zu, \"batch_10\": %zu, \"budget_2ms\": %zu, \"budget_scrolling\": %zu, \"budget_4_passes\": %zu},\n",
+         one.frames, ten.frames, budgeted.frames, scrolling.frames, turning.frames);
+  printf("  \"max_frame_ms\": {\"batch_1\": %.2f, \"batch_10\": %.2f, \"budget_2ms\": %.2f, \"budget_scrolling\": %.2f, \"budget_4_passes\": %.2f},\n",
+         one.maxPass * 1e3, ten.maxPass * 1e3, budgeted.maxPass * 1e3, scrolling.maxPass * 1e3, turning.maxPass * 1e3);
+  printf("  \"max_frame_ms_cheap_items\": {\"batch_1\": %.2f, \"batch_10\": %.2f, \"budget_2ms\": %.2f, \"budget_scrolling\": %.2f},\n",
+         one.maxPassOfCheapItems * 1e3, ten.maxPassOfCheapItems * 1e3, budgeted.maxPassOfCheapItems * 1e3,
+         scrolling.maxPassOfCheapItems * 1e3);
+  printf("  \"drain_%zu_ns_per_item\": {\"ring\": %.2f, \"compacting\": %.2f}\n}\n", storageCount,
+         ringSeconds * 1e9, compactingSeconds * 1e9);
+  return 0;
+}
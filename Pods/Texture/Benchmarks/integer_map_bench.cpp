@@ -0,0 +1,436 @@
+// Checks and timing of AS::FlatIntegerMap, the storage behind ASIntegerMap.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -o integer_map_bench integer_map_bench.cpp
+//   ./integer_map_bench [--quick] > result.json
+//
+// First checks the map against std::unordered_map. Mappings for random
+// updates (random old counts, deleted and inserted index sets) must match
+// what +[ASIntegerMap mapForUpdateWithOldCount:deleted:inserted:] used to
+// build item by item, along with their inverses, and take no more runs than
+// there are changed ranges plus one. A plain shift must be a single run.
+// Random sequences of sets, ascending and not, with negative and extreme
+// keys, must read back the same as std::unordered_map, survive copying and
+// compare equal to the same contents built another way. Exits with 1 on
+// failure.
+//
+// Then times building a section's mapping and its inverse and looking up
+// every old item, as _ASHierarchyChangeSet does per batch update, against
+// the std::unordered_map it replaces, for appending to a chat, inserting at
+// the top, reloading one item and scattered edits. Allocations are counted
+// by replacing operator new.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+#include "../Source/Private/ASFlatIntegerMap.h"
+
+#define TRIALS 3
+
+static double min_time = 0.2;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static size_t S_allocations = 0;
+
+void *operator new(size_t size) {
+  S_allocations++;
+  if (void *p = malloc(size ? size : 1)) {
+    return p;
+  }
+  abort();
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+typedef AS::FlatIntegerMap Map;
+typedef Map::Integer Integer;
+typedef std::unordered_map<Integer, Integer> Reference;
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t S_random() {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return S_state >> 17;
+}
+
+// MARK: - Updates
+
+struct Update {
+  Integer oldCount;
+  std::vector<Map::Range> deleted;
+  std::vector<Map::Range> inserted;
+};
+
+static std::vector<Map::Range> S_ranges(const std::vector<bool> &indexes) {
+  std::vector<Map::Range> ranges;
+  for (size_t i = 0; i < indexes.size(); i++) {
+    if (!indexes[i]) {
+      continue;
+    }
+    if (!ranges.empty() && ranges.back().location + ranges.back().length == (Integer)i) {
+      ranges.back().length++;
+    } else {
+      ranges.push_back({(Integer)i, 1});
+    }
+  }
+  return ranges;
+}
+
+static Update S_random_update() {
+  Update update;
+  update.oldCount = 1 + (Integer)(S_random() % 60);
+  const uint64_t deleteOdds = S_random() % 4;
+  const uint64_t insertOdds = S_random() % 4;
+  std::vector<bool> deleted(update.oldCount);
+  size_t survivors = 0;
+  for (Integer i = 0; i < update.oldCount; i++) {
+    deleted[i] = deleteOdds > 0 && S_random() % (2 + deleteOdds * 3) == 0;
+    survivors += deleted[i] ? 0 : 1;
+  }
+  // Some insertions past the end too, which leave the survivors below them.
+  std::vector<bool> inserted(survivors + 8);
+  for (size_t i = 0; i < inserted.size(); i++) {
+    inserted[i] = insertOdds > 0 && S_random() % (2 + insertOdds * 3) == 0;
+  }
+  update.deleted = S_ranges(deleted);
+  update.inserted = S_ranges(inserted);
+  return update;
+}
+
+// What ASIntegerMap did: shift the old indexes by each deletion and insertion,
+// then hand them out to the old indexes that weren't deleted.
+static Reference S_reference_update(const Update &update) {
+  std::vector<bool> isDeleted(update.oldCount, false);
+  for (const Map::Range &range : update.deleted) {
+    for (Integer i = range.location; i < range.location + range.length && i < update.oldCount; i++) {
+      isDeleted[i] = true;
+    }
+  }
+  std::vector<Integer> indexes;
+  for (Integer i = 0; i < update.oldCount; i++) {
+    if (!isDeleted[i]) {
+      indexes.push_back((Integer)indexes.size());
+    }
+  }
+  for (const Map::Range &range : update.inserted) {
+    for (Integer &index : indexes) {
+      if (index >= range.location) {
+        index += range.length;
+      }
+    }
+  }
+  Reference reference;
+  size_t next = 0;
+  for (Integer i = 0; i < update.oldCount; i++) {
+    if (!isDeleted[i]) {
+      reference[i] = indexes[next++];
+    }
+  }
+  return reference;
+}
+
+static Reference S_reference_inverse(const Reference &reference) {
+  Reference inverse;
+  for (const auto &e : reference) {
+    inverse[e.second] = e.first;
+  }
+  return inverse;
+}
+
+// MARK: - Checks
+
+static bool S_matches(const Map &map, const Reference &reference, Integer low, Integer high) {
+  if (map.Size() != reference.size()) {
+    fprintf(stderr, "size %zu, expected %zu\n", map.Size(), reference.size());
+    return false;
+  }
+  for (Integer key = low; key < high; key++) {
+    Integer value;
+    const bool found = map.Find(key, value);
+    const auto e = reference.find(key);
+    if (found != (e != reference.end()) || (found && value != e->second)) {
+      fprintf(stderr, "key %ld reads %s %ld\n", (long)key, found ? "as" : "missing", found ? (long)value : 0L);
+      return false;
+    }
+  }
+  size_t visited = 0;
+  bool agrees = true;
+  map.ForEach([&](Integer key, Integer value) {
+    const auto e = reference.find(key);
+    agrees = agrees && e != reference.end() && e->second == value;
+    visited++;
+  });
+  if (!agrees || visited != reference.size()) {
+    fprintf(stderr, "entries don't match\n");
+    return false;
+  }
+  return true;
+}
+
+static bool S_check_updates(size_t count) {
+  for (size_t n = 0; n < count; n++) {
+    const Update update = S_random_update();
+    Map map;
+    map.BuildForUpdate(update.oldCount, update.deleted.data(), update.deleted.size(), update.inserted.data(),
+                       update.inserted.size());
+    const Reference reference = S_reference_update(update);
+    const Integer high = update.oldCount + (Integer)update.inserted.size() * 8 + 80;
+    if (!S_matches(map, reference, -3, high)) {
+      fprintf(stderr, "update %zu doesn't match\n", n);
+      return false;
+    }
+    if (!map.IsRuns() || map.RunCount() > update.deleted.size() + update.inserted.size() + 1) {
+      fprintf(stderr, "update %zu took %zu runs\n", n, map.RunCount());
+      return false;
+    }
+    const Map inverse = map.Inverse();
+    if (!S_matches(inverse, S_reference_inverse(reference), -3, high) || !inverse.IsRuns()) {
+      fprintf(stderr, "inverse of update %zu doesn't match\n", n);
+      return false;
+    }
+  }
+
+  // Inserting at the top shifts everything by one.
+  const Map::Range top = {0, 1};
+  Map shift;
+  shift.BuildForUpdate(100, nullptr, 0, &top, 1);
+  Integer value;
+  if (shift.RunCount() != 1 || !shift.Find(99, value) || value != 100 || shift.Find(100, value)) {
+    fprintf(stderr, "a shift isn't a single run\n");
+    return false;
+  }
+  return true;
+}
+
+static bool S_check_sets(size_t count) {
+  const Integer extremes[] = {INTPTR_MIN, INTPTR_MIN + 1, INTPTR_MAX, -1, 0};
+  for (size_t n = 0; n < count; n++) {
+    Map map;
+    Reference reference;
+    const size_t sets = S_random() % 200;
+    const bool ascending = S_random() % 3 == 0;
+    Integer key = 0;
+    for (size_t s = 0; s < sets; s++) {
+      if (ascending) {
+        key += 1 + (Integer)(S_random() % 3 == 0 ? S_random() % 5 : 0);
+      } else if (S_random() % 20 == 0) {
+        key = extremes[S_random() % 5];
+      } else {
+        key = (Integer)(S_random() % 300) - 100;
+      }
+      const bool small = key > -1000 && key < 1000;
+      const Integer value = small && S_random() % 2 == 0 ? key + 7 : (Integer)(S_random() % 1000);
+      map.Set(key, value);
+      reference[key] = value;
+    }
+    if (!S_matches(map, reference, -120, 700)) {
+      fprintf(stderr, "sets %zu don't match\n", n);
+      return false;
+    }
+    for (Integer extreme : extremes) {
+      Integer value;
+      const auto e = reference.find(extreme);
+      if (map.Find(extreme, value) != (e != reference.end()) || (e != reference.end() && e->second != value)) {
+        fprintf(stderr, "extreme key %ld reads wrong\n", (long)extreme);
+        return false;
+      }
+    }
+    if (ascending && !map.IsRuns()) {
+      fprintf(stderr, "ascending sets left runs\n");
+      return false;
+    }
+
+    // Copies, and the same contents set in another order.
+    Map copy(map);
+    Map assigned;
+    assigned.Set(5, 5);
+    assigned = map;
+    Map shuffled;
+    std::vector<std::pair<Integer, Integer>> entries(reference.begin(), reference.end());
+    std::reverse(entries.begin(), entries.end());
+    for (const auto &e : entries) {
+      shuffled.Set(e.first, e.second);
+    }
+    if (copy != map || assigned != map || shuffled != map || !S_matches(copy, reference, -120, 700)) {
+      fprintf(stderr, "copies of sets %zu don't match\n", n);
+      return false;
+    }
+    if (!reference.empty()) {
+      Map changed(map);
+      changed.Set(entries[0].first, entries[0].second + 1);
+      Map larger(map);
+      larger.Set(INTPTR_MAX - 1, 0);
+      if (changed == map || larger == map || map == larger) {
+        fprintf(stderr, "different contents compare equal\n");
+        return false;
+      }
+    }
+
+    // Inverses agree where the map is one to one.
+    // Otherwise every value maps back to one of its keys.
+    const Map inverse = map.Inverse();
+    Reference inverseReference = S_reference_inverse(reference);
+    if (inverseReference.size() == reference.size() && !S_matches(inverse, inverseReference, -120, 1100)) {
+      fprintf(stderr, "inverse of sets %zu doesn't match\n", n);
+      return false;
+    }
+    bool mapsBack = inverse.Size() == inverseReference.size();
+    for (const auto &e : inverseReference) {
+      Integer key;
+      Integer value;
+      mapsBack = mapsBack && inverse.Find(e.first, key) && map.Find(key, value) && value == e.first;
+    }
+    if (!mapsBack) {
+      fprintf(stderr, "inverse of sets %zu doesn't map back\n", n);
+      return false;
+    }
+  }
+  return true;
+}
+
+// MARK: - Timing
+
+struct Shape {
+  const char *name;
+  Update update;
+};
+
+static std::vector<Shape> S_shapes(Integer count) {
+  std::vector<Shape> shapes;
+  shapes.push_back({"append", {count, {}, {{count, 1}}}});
+  shapes.push_back({"insert_top", {count, {}, {{0, 1}}}});
+  shapes.push_back({"reload_one", {count, {{count / 2, 1}}, {{count / 2, 1}}}});
+  Update scattered = {count, {}, {}};
+  for (Integer i = 0; i < 10; i++) {
+    scattered.deleted.push_back({i * count / 10 + 1, 1});
+    scattered.inserted.push_back({i * count / 10 + 3, 1});
+  }
+  shapes.push_back({"scattered_10", scattered});
+  return shapes;
+}
+
+// The old mapping: one entry per surviving item, then the inverse.
+__attribute__((noinline)) static Integer S_update_unordered(const Update &update) {
+  Reference map;
+  Integer oldIndex = 0;
+  Integer newIndex = 0;
+  size_t d = 0;
+  size_t i = 0;
+  for (; oldIndex < update.oldCount; oldIndex++) {
+    while (d < update.deleted.size() && update.deleted[d].location + update.deleted[d].length <= oldIndex) {
+      d++;
+    }
+    if (d < update.deleted.size() && update.deleted[d].location <= oldIndex) {
+      continue;
+    }
+    while (i < update.inserted.size() && update.inserted[i].location <= newIndex) {
+      newIndex += update.inserted[i].length;
+      i++;
+    }
+    map[oldIndex] = newIndex++;
+  }
+  Reference inverse;
+  for (const auto &e : map) {
+    inverse[e.second] = e.first;
+  }
+  Integer sum = 0;
+  for (Integer key = 0; key < update.oldCount; key++) {
+    const auto e = map.find(key);
+    sum += e != map.end() ? e->second : -1;
+  }
+  return sum + (Integer)inverse.size();
+}
+
+__attribute__((noinline)) static Integer S_update_flat(const Update &update) {
+  Map map;
+  map.BuildForUpdate(update.oldCount, update.deleted.data(), update.deleted.size(), update.inserted.data(),
+                     update.inserted.size());
+  const Map inverse = map.Inverse();
+  Integer sum = 0;
+  for (Integer key = 0; key < update.oldCount; key++) {
+    Integer value;
+    sum += map.Find(key, value) ? value : -1;
+  }
+  return sum + (Integer)inverse.Size();
+}
+
+struct Timing {
+  double seconds;
+  double allocations;
+};
+
+template <typename F>
+static Timing S_measure(F f, const Update &update) {
+  Timing best = {1e30, 0};
+  volatile Integer sink = 0;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t count = 0;
+    const size_t before = S_allocations;
+    const double start = S_now();
+    double elapsed = 0;
+    do {
+      sink += f(update);
+      count++;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time);
+    best.seconds = std::min(best.seconds, elapsed / count);
+    best.allocations = (double)(S_allocations - before) / count;
+  }
+  (void)sink;
+  return best;
+}
+
+int main(int argc, char **argv) {
+  size_t checks = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.02;
+      checks = 2000;
+    }
+  }
+
+  if (!S_check_updates(checks) || !S_check_sets(checks / 4)) {
+    return 1;
+  }
+
+  printf("{\n");
+  const Integer counts[] = {50, 1000};
+  for (size_t c = 0; c < 2; c++) {
+    const std::vector<Shape> shapes = S_shapes(counts[c]);
+    printf("  \"section_%ld\": {\n", (long)counts[c]);
+    for (size_t s = 0; s < shapes.size(); s++) {
+      if (S_update_flat(shapes[s].update) != S_update_unordered(shapes[s].update)) {
+        fprintf(stderr, "%s mappings differ\n", shapes[s].name);
+        return 1;
+      }
+      const Timing unordered = S_measure(S_update_unordered, shapes[s].update);
+      const Timing flat = S_measure(S_update_flat, shapes[s].update);
+      printf("    \"%s\": {\"unordered_map_us\": %.3f, \"flat_us\": %.3f, \"unordered_map_allocations\": %.0f, "
+             "\"flat_allocations\": %.0f}%s\n",
+             shapes[s].name, unordered.seconds * 1e6, flat.seconds * 1e6, unordered.allocations, flat.allocations,
+             s + 1 < shapes.size() ? "," : "");
+    }
+    printf("  }%s\n", c == 0 ? "," : "");
+  }
+  printf("}\n");
+  return 0;
+}
@@ -0,0 +1,520 @@
+// Equivalence, allocations and speed of flattening a layout tree.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -o layout_flatten_bench layout_flatten_bench.cpp
+//   ./layout_flatten_bench [--quick] > result.json
+//
+// Layouts are reference counted heap objects with a child array, like an
+// ASLayout. Trees are flattened once with a copy of the code
+// AS::FlatLayoutTree replaced in -[ASLayout filteredNodeLayoutTree] (a deque
+// work queue, a new layout for every repositioned node, a growing vector
+// handed over to the result) and once the way it now works: one walk into a
+// tree kept per thread, then the nodes copied out as plain frames. The cost of
+// later asking the flat result for its sublayouts is timed too.
+//
+// The run fails unless both produce the same nodes, sizes and positions on
+// hand-built and random trees, every record's parent is its nearest enclosing
+// layout with positions adding up along the way, a reused tree builds without
+// allocating, and an unusually big tree gives its storage back on Reset.
+// Allocations are counted by replacing operator new.
+//
+// Then times deep, wide and chat-like trees.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <new>
+#include <vector>
+
+#include "../Source/Private/Layout/ASFlatLayoutTree.h"
+
+#define TRIALS 3
+
+static double min_time = 0.2;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// MARK: - Allocation counting
+
+static size_t S_allocations = 0;
+
+void *operator new(size_t size) {
+  S_allocations++;
+  if (void *p = malloc(size ? size : 1)) {
+    return p;
+  }
+  abort();
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+// MARK: - Mock layouts
+
+struct Point {
+  double x;
+  double y;
+  Point() : x(0), y(0) {}
+  Point(double x, double y) : x(x), y(y) {}
+  Point operator+(const Point &other) const { return Point(x + other.x, y + other.y); }
+  bool operator==(const Point &other) const { return x == other.x && y == other.y; }
+};
+
+struct Size {
+  double width;
+  double height;
+};
+
+static Point S_ceil(Point p) {
+  return Point(std::ceil(p.x), std::ceil(p.y));
+}
+
+struct Layout {
+  int refCount;
+  int element;
+  bool isNode;
+  Size size;
+  Point position;
+  std::vector<Layout *> sublayouts;
+
+  static Layout *Make(int element, bool isNode, Size size, Point position) {
+    Layout *layout = new Layout();
+    layout->refCount = 1;
+    layout->element = element;
+    layout->isNode = isNode;
+    layout->size = size;
+    // ASLayout rounds positions up when it is made.
+    layout->position = S_ceil(position);
+    return layout;
+  }
+
+  void Retain() { refCount++; }
+
+  void Release() {
+    if (--refCount == 0) {
+      for (Layout *sublayout : sublayouts) {
+        sublayout->Release();
+      }
+      delete this;
+    }
+  }
+};
+
+struct FlatSublayout {
+  int element;
+  Size size;
+  Point position;
+};
+
+// What -filteredNodeLayoutTree now returns: the nodes as plain values.
+struct FlatLayout {
+  int element;
+  Size size;
+  std::vector<FlatSublayout> sublayouts;
+};
+
+typedef AS::FlatLayoutTree<Layout *, Point> Tree;
+
+// MARK: - Trees
+
+static int S_nextElement = 0;
+
+static Layout *S_node(Point position, bool withSpec) {
+  Layout *node = Layout::Make(S_nextElement++, true, {40.5, 20}, position);
+  if (withSpec) {
+    // A node's own layout from its layout spec, which flattening must not walk into.
+    node->sublayouts.push_back(Layout::Make(S_nextElement++, true, {10, 10}, Point(2, 2)));
+  }
+  return node;
+}
+
+static Layout *S_spec(Point position) {
+  return Layout::Make(S_nextElement++, false, {100, 100}, position);
+}
+
+// A column of inset specs, each with a node and the next spec.
+static Layout *S_deep(size_t depth) {
+  Layout *root = Layout::Make(S_nextElement++, true, {320, 10000}, Point());
+  Layout *parent = root;
+  for (size_t i = 0; i < depth; i++) {
+    Layout *spec = S_spec(Point(i == 0 ? 0 : 1.5, i == 0 ? 0 : 20.25));
+    spec->sublayouts.push_back(S_node(Point(4, 0), i % 7 == 0));
+    parent->sublayouts.push_back(spec);
+    parent = spec;
+  }
+  return root;
+}
+
+// One stack of nodes directly under the root.
+static Layout *S_wide(size_t width) {
+  Layout *root = Layout::Make(S_nextElement++, true, {320, 10000}, Point());
+  Layout *stack = S_spec(Point());
+  for (size_t i = 0; i < width; i++) {
+    stack->sublayouts.push_back(S_node(Point(0, 20.0 * i), false));
+  }
+  root->sublayouts.push_back(stack);
+  return root;
+}
+
+static uint64_t S_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t S_random() {
+  S_state = S_state * 6364136223846793005ull + 1442695040888963407ull;
+  return S_state >> 33;
+}
+
+static Layout *S_random_subtree(int depth) {
+  const bool node = depth == 0 || S_random() % 3 == 0;
+  const Point position((double)(S_random() % 400) / 4, (double)(S_random() % 400) / 4);
+  if (node) {
+    return S_node(position, S_random() % 4 == 0);
+  }
+  Layout *spec = S_spec(position);
+  const size_t count = S_random() % 5;
+  for (size_t i = 0; i < count; i++) {
+    spec->sublayouts.push_back(S_random_subtree(depth - 1));
+  }
+  return spec;
+}
+
+static Layout *S_random_tree(int depth) {
+  Layout *root = Layout::Make(S_nextElement++, true, {320, 480}, Point());
+  const size_t count = 1 + S_random() % 4;
+  for (size_t i = 0; i < count; i++) {
+    root->sublayouts.push_back(S_random_subtree(depth));
+  }
+  return root;
+}
+
+// A chat cell: an avatar, a name, and a bubble of text and code nodes.
+static Layout *S_chat() {
+  Layout *root = Layout::Make(S_nextElement++, true, {320, 400}, Point());
+  Layout *inset = S_spec(Point());
+  Layout *row = S_spec(Point(12, 8));
+  row->sublayouts.push_back(S_node(Point(0, 0), false));
+  Layout *column = S_spec(Point(44, 0));
+  column->sublayouts.push_back(S_node(Point(0, 0), false));
+  Layout *bubble = S_spec(Point(0, 18.5));
+  Layout *background = S_spec(Point());
+  background->sublayouts.push_back(S_node(Point(), false));
+  Layout *blocks = S_spec(Point(10, 10));
+  for (int i = 0; i < 12; i++) {
+    blocks->sublayouts.push_back(S_node(Point(0, 24.0 * i), i % 4 == 3));
+  }
+  background->sublayouts.push_back(blocks);
+  bubble->sublayouts.push_back(background);
+  column->sublayouts.push_back(bubble);
+  row->sublayouts.push_back(column);
+  inset->sublayouts.push_back(row);
+  root->sublayouts.push_back(inset);
+  return root;
+}
+
+// MARK: - Flattening
+
+// The code AS::FlatLayoutTree replaced.
+static Layout *S_flatten_legacy(Layout *root) {
+  struct Context {
+    Layout *layout;
+    Point absolutePosition;
+  };
+
+  std::deque<Context> queue;
+  for (Layout *sublayout : root->sublayouts) {
+    queue.push_back({sublayout, sublayout->position});
+  }
+
+  std::vector<Layout *> flattenedSublayouts;
+
+  while (!queue.empty()) {
+    const Context context = std::move(queue.front());
+    queue.pop_front();
+
+    Layout *layout = context.layout;
+    const size_t sublayoutsCount = layout->sublayouts.size();
+    const Point absolutePosition = context.absolutePosition;
+
+    if (layout->isNode) {
+      if (sublayoutsCount > 0 || !(S_ceil(absolutePosition) == layout->position)) {
+        flattenedSublayouts.push_back(Layout::Make(layout->element, true, layout->size, absolutePosition));
+      } else {
+        layout->Retain();
+        flattenedSublayouts.push_back(layout);
+      }
+    } else if (sublayoutsCount > 0) {
+      Layout *rawSublayouts[sublayoutsCount];
+      std::copy(layout->sublayouts.begin(), layout->sublayouts.end(), rawSublayouts);
+      for (size_t i = sublayoutsCount; i > 0; i--) {
+        queue.push_front({rawSublayouts[i - 1], absolutePosition + rawSublayouts[i - 1]->position});
+      }
+    }
+  }
+
+  // arrayByTransferring makes one array, and the new layout keeps it.
+  Layout *layout = Layout::Make(root->element, true, root->size, Point());
+  layout->sublayouts.reserve(flattenedSublayouts.size());
+  layout->sublayouts.insert(layout->sublayouts.end(), flattenedSublayouts.begin(), flattenedSublayouts.end());
+  return layout;
+}
+
+static Tree &S_tree() {
+  static Tree *tree = new Tree();
+  return *tree;
+}
+
+static FlatLayout *S_flatten(Layout *root) {
+  Tree &tree = S_tree();
+  tree.Build(root, [](Layout *layout) {
+    return layout->isNode;
+  }, [](Layout *layout) {
+    return layout->position;
+  }, [](Layout *layout, std::vector<Layout *> &children) {
+    children.insert(children.end(), layout->sublayouts.begin(), layout->sublayouts.end());
+  });
+  std::vector<FlatSublayout> sublayouts;
+  sublayouts.reserve(tree.NodeCount());
+  for (const Tree::Record &record : tree) {
+    if (record.isNode) {
+      sublayouts.push_back({record.layout->element, record.layout->size, S_ceil(record.position)});
+    }
+  }
+  tree.Reset();
+  FlatLayout *layout = new FlatLayout();
+  layout->element = root->element;
+  layout->size = root->size;
+  layout->sublayouts.swap(sublayouts);
+  return layout;
+}
+
+// What the first call to -sublayouts on the flat result does.
+static Layout *S_materialize(const FlatLayout *flat) {
+  Layout *layout = Layout::Make(flat->element, true, flat->size, Point());
+  layout->sublayouts.reserve(flat->sublayouts.size());
+  for (const FlatSublayout &sublayout : flat->sublayouts) {
+    layout->sublayouts.push_back(Layout::Make(sublayout.element, true, sublayout.size, sublayout.position));
+  }
+  return layout;
+}
+
+// MARK: - Checks
+
+static bool S_same(Layout *legacy, const FlatLayout *flat) {
+  if (legacy->sublayouts.size() != flat->sublayouts.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < flat->sublayouts.size(); i++) {
+    const Layout *a = legacy->sublayouts[i];
+    const FlatSublayout &b = flat->sublayouts[i];
+    if (a->element != b.element || a->size.width != b.size.width || a->size.height != b.size.height
+        || !(a->position == b.position) || !a->sublayouts.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parents must be the nearest enclosing layout in preorder, and positions must add up.
+static bool S_check_records(const Tree &tree) {
+  if (tree.Size() == 0 || tree[0].parent != Tree::kNoParent || tree[0].isNode) {
+    return false;
+  }
+  std::vector<uint32_t> open(1, 0);
+  size_t nodes = 0;
+  for (uint32_t i = 1; i < tree.Size(); i++) {
+    const Tree::Record &record = tree[i];
+    while (!open.empty() && open.back() != record.parent) {
+      open.pop_back();
+    }
+    if (open.empty() || tree[record.parent].isNode || record.isNode != record.layout->isNode) {
+      return false;
+    }
+    const Point expected = tree[record.parent].position + record.layout->position;
+    if (!(expected == record.position)) {
+      return false;
+    }
+    if (std::find(tree[record.parent].layout->sublayouts.begin(), tree[record.parent].layout->sublayouts.end(),
+                  record.layout) == tree[record.parent].layout->sublayouts.end()) {
+      return false;
+    }
+    nodes += record.isNode ? 1 : 0;
+    if (!record.isNode) {
+      open.push_back(i);
+    }
+  }
+  return nodes == tree.NodeCount();
+}
+
+static bool S_check_tree(Layout *root, const char *name) {
+  Layout *legacy = S_flatten_legacy(root);
+  FlatLayout *flat = S_flatten(root);
+  const bool same = S_same(legacy, flat);
+  Layout *materialized = S_materialize(flat);
+  const bool sameMaterialized = S_same(materialized, flat);
+  legacy->Release();
+  materialized->Release();
+  delete flat;
+  if (!same || !sameMaterialized) {
+    fprintf(stderr, "%s: flat tree differs from the old flattening\n", name);
+    return false;
+  }
+
+  // Twice without a Reset in between: a build replaces what was there.
+  Tree &tree = S_tree();
+  for (int i = 0; i < 2; i++) {
+    tree.Build(root, [](Layout *layout) {
+      return layout->isNode;
+    }, [](Layout *layout) {
+      return layout->position;
+    }, [](Layout *layout, std::vector<Layout *> &children) {
+      children.insert(children.end(), layout->sublayouts.begin(), layout->sublayouts.end());
+    });
+  }
+  const bool records = S_check_records(tree);
+  tree.Reset();
+  if (!records) {
+    fprintf(stderr, "%s: records have wrong parents or positions\n", name);
+    return false;
+  }
+  return true;
+}
+
+static size_t S_build_allocations(Layout *root) {
+  Tree &tree = S_tree();
+  const size_t before = S_allocations;
+  tree.Build(root, [](Layout *layout) {
+    return layout->isNode;
+  }, [](Layout *layout) {
+    return layout->position;
+  }, [](Layout *layout, std::vector<Layout *> &children) {
+    children.insert(children.end(), layout->sublayouts.begin(), layout->sublayouts.end());
+  });
+  tree.Reset();
+  return S_allocations - before;
+}
+
+static bool S_check() {
+  Layout *empty = Layout::Make(S_nextElement++, true, {10, 10}, Point());
+  Layout *deep = S_deep(300);
+  Layout *wide = S_wide(500);
+  Layout *chat = S_chat();
+  bool ok = S_check_tree(empty, "empty") && S_check_tree(deep, "deep") && S_check_tree(wide, "wide")
+            && S_check_tree(chat, "chat");
+  for (int i = 0; ok && i < 300; i++) {
+    Layout *root = S_random_tree(1 + i % 7);
+    ok = S_check_tree(root, "random");
+    root->Release();
+  }
+  if (ok) {
+    S_build_allocations(deep);
+    if (S_build_allocations(deep) != 0 || S_build_allocations(chat) != 0) {
+      fprintf(stderr, "building a tree again allocates\n");
+      ok = false;
+    }
+  }
+  if (ok) {
+    Layout *huge = S_wide(10000);
+    S_build_allocations(huge);
+    huge->Release();
+    if (S_build_allocations(chat) == 0) {
+      fprintf(stderr, "a huge tree's storage was kept\n");
+      ok = false;
+    }
+  }
+  empty->Release();
+  deep->Release();
+  wide->Release();
+  chat->Release();
+  return ok;
+}
+
+// MARK: - Timing
+
+struct Cost {
+  double seconds;
+  double allocations;
+};
+
+template <typename Flatten>
+static Cost S_measure(Layout *root, Flatten flatten) {
+  Cost best = {1e30, 0};
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t count = 0;
+    const size_t before = S_allocations;
+    const double start = S_now();
+    double elapsed = 0;
+    do {
+      flatten(root);
+      count++;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time);
+    best.seconds = std::min(best.seconds, elapsed / count);
+    best.allocations = (double)(S_allocations - before) / count;
+  }
+  return best;
+}
+
+static void S_report(const char *name, Layout *root, bool last) {
+  size_t nodes = 0;
+  {
+    FlatLayout *flat = S_flatten(root);
+    nodes = flat->sublayouts.size();
+    delete flat;
+  }
+  const Cost legacy = S_measure(root, [](Layout *layout) {
+    S_flatten_legacy(layout)->Release();
+  });
+  const Cost flat = S_measure(root, [](Layout *layout) {
+    delete S_flatten(layout);
+  });
+  const Cost materialized = S_measure(root, [](Layout *layout) {
+    FlatLayout *flat = S_flatten(layout);
+    S_materialize(flat)->Release();
+    delete flat;
+  });
+  printf("  \"%s\": {\"nodes\": %zu, \"us\": {\"legacy\": %.2f, \"flat\": %.2f, \"flat_then_sublayouts\": %.2f},\n"
+         "    \"allocations\": {\"legacy\": %.1f, \"flat\": %.1f, \"flat_then_sublayouts\": %.1f}}%s\n",
+         name, nodes, legacy.seconds * 1e6, flat.seconds * 1e6, materialized.seconds * 1e6, legacy.allocations,
+         flat.allocations, materialized.allocations, last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+  size_t scale = 1000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.02;
+      scale = 200;
+    }
+  }
+
+  if (!S_check()) {
+    return 1;
+  }
+
+  Layout *deep = S_deep(scale);
+  Layout *wide = S_wide(scale);
+  Layout *chat = S_chat();
+  printf("{\n");
+  S_report("deep", deep, false);
+  S_report("wide", wide, false);
+  S_report("chat", chat, true);
+  printf("}\n");
+  deep->Release();
+  wide->Release();
+  chat->Release();
+  return 0;
+}
@@ -0,0 +1,218 @@
+// Checks and overhead of the AS::Mutex contention profiler.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -pthread -o lock_profiler_bench
+//       lock_profiler_bench.cpp
+//   ./lock_profiler_bench [--quick] > result.json
+//
+// ProfiledMutex below is AS::Mutex's std::mutex path as compiled with
+// AS_LOCK_PROFILING. First a synthetic contention test: worker threads fight
+// over one "hot" lock, which starts out held so that every worker has to wait
+// for it, while each also takes a private "cold" lock and a recursive lock
+// twice over. Once the workers have exited, the report must rank the hot lock
+// first, count every acquisition, hold and contention where it happened, and
+// nothing taken while profiling was off. Exits with 1 on failure.
+//
+// Then times an uncontended lock and unlock with a bare std::mutex, with
+// profiling compiled in but off, and with it on.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../Source/Details/ASLockProfiler.h"
+
+#define TRIALS 3
+
+static double min_time = 0.2;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// MARK: - Mutex
+
+template <typename Underlying>
+class ProfiledMutex {
+public:
+  explicit ProfiledMutex(const char *name) { _probe.SetName(name); }
+
+  bool try_lock() {
+    bool success = _m.try_lock();
+    if (success && AS::LockProfiler::IsEnabled()) {
+      _probe.DidTryLock();
+    }
+    return success;
+  }
+
+  void lock() {
+    if (AS::LockProfiler::IsEnabled()) {
+      _probe.Lock([this] { return _m.try_lock(); }, [this] { _m.lock(); });
+      return;
+    }
+    _m.lock();
+  }
+
+  void unlock() {
+    _probe.WillUnlock();
+    _m.unlock();
+  }
+
+private:
+  Underlying _m;
+  AS::LockProbe _probe;
+};
+
+// MARK: - Contention test
+
+static const char *const kHot = "hot";
+static const char *const kCold = "cold";
+static const char *const kRecursive = "recursive";
+static const char *const kUnprofiled = "unprofiled";
+
+static void S_spin(uint64_t nanoseconds) {
+  const uint64_t end = AS::LockProfiler::Now() + nanoseconds;
+  while (AS::LockProfiler::Now() < end) {
+  }
+}
+
+static uint64_t S_sum(const uint64_t *histogram) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < AS::LockStatistics::kBuckets; i++) {
+    sum += histogram[i];
+  }
+  return sum;
+}
+
+static const AS::LockStatistics *S_find(const std::vector<AS::LockStatistics> &report, const char *name) {
+  for (const AS::LockStatistics &s : report) {
+    if (s.name == name) {
+      return &s;
+    }
+  }
+  return nullptr;
+}
+
+static bool S_check_contention(size_t threads, size_t iterations) {
+  AS::LockProfiler::Reset();
+  ProfiledMutex<std::mutex> unprofiled(kUnprofiled);
+  unprofiled.lock();
+  unprofiled.unlock();
+
+  AS::LockProfiler::SetEnabled(true);
+  ProfiledMutex<std::mutex> hot(kHot);
+  ProfiledMutex<std::recursive_mutex> recursive(kRecursive);
+  hot.lock();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&] {
+      ProfiledMutex<std::mutex> cold(kCold);
+      for (size_t i = 0; i < iterations; i++) {
+        {
+          std::lock_guard<ProfiledMutex<std::mutex>> l(hot);
+          S_spin(200);
+        }
+        std::lock_guard<ProfiledMutex<std::mutex>> l(cold);
+        std::lock_guard<ProfiledMutex<std::recursive_mutex>> r1(recursive);
+        std::lock_guard<ProfiledMutex<std::recursive_mutex>> r2(recursive);
+      }
+    });
+  }
+  // Every worker blocks on its first acquisition.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  hot.unlock();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  AS::LockProfiler::SetEnabled(false);
+  unprofiled.lock();
+  unprofiled.unlock();
+
+  const std::vector<AS::LockStatistics> report = AS::LockProfiler::Report(10);
+  const AS::LockStatistics *h = S_find(report, kHot);
+  const AS::LockStatistics *c = S_find(report, kCold);
+  const AS::LockStatistics *r = S_find(report, kRecursive);
+  if (report.empty() || report[0].name != kHot || !h || !c || !r || S_find(report, kUnprofiled)) {
+    fprintf(stderr, "report is missing locks or misranks them\n");
+    return false;
+  }
+  const uint64_t n = threads * iterations;
+  // The main thread's first acquisition of the hot lock counts too.
+  if (h->acquisitions != n + 1 || c->acquisitions != n || r->acquisitions != 2 * n) {
+    fprintf(stderr, "acquisitions are miscounted\n");
+    return false;
+  }
+  if (h->contentions < threads || c->contentions != 0 || h->waitNanoseconds < 40 * 1000 * 1000) {
+    fprintf(stderr, "contention is miscounted\n");
+    return false;
+  }
+  if (S_sum(h->waitHistogram) != h->acquisitions || S_sum(h->holdHistogram) != h->acquisitions
+      || S_sum(r->holdHistogram) != n || h->holdNanoseconds < n * 200) {
+    fprintf(stderr, "histograms are miscounted\n");
+    return false;
+  }
+  AS::LockProfiler::Reset();
+  return AS::LockProfiler::Report(10).empty();
+}
+
+// MARK: - Overhead
+
+template <typename Lock>
+__attribute__((noinline)) static void S_lock_unlock(Lock &lock, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    lock.lock();
+    lock.unlock();
+  }
+}
+
+template <typename Lock>
+static double S_measure(Lock &lock) {
+  double best = 1e30;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t count = 0;
+    const double start = S_now();
+    double elapsed = 0;
+    do {
+      S_lock_unlock(lock, 10000);
+      count += 10000;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time);
+    best = std::min(best, elapsed / count);
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  size_t iterations = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.02;
+      iterations = 2000;
+    }
+  }
+
+  if (!S_check_contention(4, iterations)) {
+    return 1;
+  }
+
+  std::mutex bare;
+  ProfiledMutex<std::mutex> profiled(kHot);
+  const double bareSeconds = S_measure(bare);
+  AS::LockProfiler::SetEnabled(false);
+  const double offSeconds = S_measure(profiled);
+  AS::LockProfiler::SetEnabled(true);
+  const double onSeconds = S_measure(profiled);
+  AS::LockProfiler::SetEnabled(false);
+
+  printf("{\n  \"uncontended_ns\": {\"std_mutex\": %.1f, \"profiling_off\": %.1f, "
+         "\"profiling_on\": %.1f}\n}\n",
+         bareSeconds * 1e9, offSeconds * 1e9, onSeconds * 1e9);
+  return 0;
+}
@@ -0,0 +1,681 @@
+// Equivalence and speed of the ASStackLayoutSpec flex solver.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -o stack_flex_bench stack_flex_bench.cpp
+//   ./stack_flex_bench [--quick] > result.json
+//
+// Stacks are laid out over a small tree of mock elements, once with a copy of
+// the flex code AS::FlexStackLine replaced (per-line item vectors,
+// std::function adjustments, std::accumulate passes reading the style every
+// time) and once the way ASStackUnpositionedLayout now drives the solver.
+// Style getters go through a call and an atomic load, like the real ones, and
+// each layout is a reference counted object, like an ASLayout.
+//
+// The run fails unless the new code reproduces a few hand-computed golden
+// layouts and matches the old code exactly on randomly generated trees. It
+// then times deep, wide and wrapping stacks and a chat-like list. Only the
+// stack axis is modeled: no stretching, alignment or positioning.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "../Source/Private/ASScratchArena.h"
+#include "../Source/Private/ASSmallVector.h"
+#include "../Source/Private/Layout/ASStackFlexSolver.h"
+
+#define TRIALS 3
+
+static const double kViolationEpsilon = 0.01;
+static double min_time = 0.3;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// MARK: - Mock elements
+
+struct Size {
+  double width, height;
+};
+
+struct SizeRange {
+  Size min, max;
+};
+
+enum Direction { Horizontal, Vertical };
+
+class Style {
+public:
+  Style() : _flexGrow(0), _flexShrink(0), _spacingBefore(0), _spacingAfter(0) {}
+  double flexGrow() const;
+  double flexShrink() const;
+  double spacingBefore() const;
+  double spacingAfter() const;
+
+  std::atomic<double> _flexGrow, _flexShrink, _spacingBefore, _spacingAfter;
+};
+
+// Out of line, as every -[ASLayoutElementStyle flexGrow] is a message send.
+__attribute__((noinline)) double Style::flexGrow() const { return _flexGrow.load(); }
+__attribute__((noinline)) double Style::flexShrink() const { return _flexShrink.load(); }
+__attribute__((noinline)) double Style::spacingBefore() const { return _spacingBefore.load(); }
+__attribute__((noinline)) double Style::spacingAfter() const { return _spacingAfter.load(); }
+
+struct Node {
+  enum Kind { Box, Text, Stack } kind;
+  Style style;
+  Size size;        // Box
+  double textWidth; // Text: one 20pt line per textWidth of width
+  Direction direction;
+  double spacing;
+  bool wrap;
+  std::vector<std::unique_ptr<Node>> children;
+
+  Node() : kind(Box), size({0, 0}), textWidth(0), direction(Horizontal), spacing(0), wrap(false) {}
+};
+
+struct Layout {
+  Size size;
+  std::vector<std::shared_ptr<const Layout>> sublayouts;
+};
+typedef std::shared_ptr<const Layout> LayoutRef;
+
+static double S_stack(Direction d, Size s) { return d == Vertical ? s.height : s.width; }
+static double S_cross(Direction d, Size s) { return d == Vertical ? s.width : s.height; }
+static Size S_size(Direction d, double stack, double cross) {
+  return d == Vertical ? Size{cross, stack} : Size{stack, cross};
+}
+static double S_clamp(double v, double lo, double hi) { return std::min(std::max(v, lo), hi); }
+
+template <class Engine>
+static LayoutRef S_layout(const Node &node, const SizeRange &range);
+
+template <class Engine>
+static LayoutRef S_layout_child(const Node &child, Direction d, double stackMin,
+                                double stackMax, double crossMax) {
+  return S_layout<Engine>(child, {S_size(d, stackMin, 0), S_size(d, stackMax, crossMax)});
+}
+
+template <class Engine>
+static LayoutRef S_layout(const Node &node, const SizeRange &range) {
+  switch (node.kind) {
+  case Node::Box: {
+    std::shared_ptr<Layout> layout(new Layout());
+    layout->size = {S_clamp(node.size.width, range.min.width, range.max.width),
+                    S_clamp(node.size.height, range.min.height, range.max.height)};
+    return layout;
+  }
+  case Node::Text: {
+    std::shared_ptr<Layout> layout(new Layout());
+    double width = S_clamp(node.textWidth, range.min.width, range.max.width);
+    double lines = width > 0 ? std::ceil(node.textWidth / width) : 0;
+    layout->size = {width, S_clamp(lines * 20, range.min.height, range.max.height)};
+    return layout;
+  }
+  case Node::Stack:
+    return Engine::LayoutStack(node, range);
+  }
+  return nullptr;
+}
+
+static bool S_flexible(const Style &style) {
+  return style.flexGrow() > 0 && style.flexShrink() > 0;
+}
+
+static double S_violation(double sum, double minimum, double maximum) {
+  if (sum < minimum) {
+    return minimum - sum;
+  } else if (sum > maximum) {
+    return maximum - sum;
+  }
+  return 0;
+}
+
+// MARK: - Previous implementation
+
+struct Legacy {
+  struct Item {
+    const Node *child;
+    LayoutRef layout;
+  };
+  struct Line {
+    std::vector<Item> items;
+    double stackDimensionSum;
+    double crossSize;
+  };
+
+  static double ItemsStackDimensionSum(const std::vector<Item> &items, Direction d, double spacing) {
+    const double childSpacingSum = std::accumulate(items.begin(), items.end(),
+                                                   items.empty() ? 0 : spacing * (items.size() - 1),
+                                                   [&](double x, const Item &l) {
+                                                     return x + l.child->style.spacingBefore() + l.child->style.spacingAfter();
+                                                   });
+    return std::accumulate(items.begin(), items.end(), childSpacingSum, [&](double x, const Item &l) {
+      return x + S_stack(d, l.layout->size);
+    });
+  }
+
+  static std::function<double(const Item &)> FlexFactor(const double violation) {
+    if (std::fabs(violation) < kViolationEpsilon) {
+      return [](const Item &) { return 0.0; };
+    } else if (violation > 0) {
+      return [](const Item &item) { return item.child->style.flexGrow(); };
+    } else {
+      return [](const Item &item) { return item.child->style.flexShrink(); };
+    }
+  }
+
+  static double ScaledFlexShrinkFactor(const Item &item, Direction d, const double flexFactorSum) {
+    return S_stack(d, item.layout->size) * (item.child->style.flexShrink() / flexFactorSum);
+  }
+
+  static std::function<double(const Item &)> FlexAdjustment(const std::vector<Item> &items, Direction d,
+                                                            const double violation, const double flexFactorSum) {
+    if (violation > 0) {
+      return [violation, flexFactorSum](const Item &item) {
+        return std::floor(violation * (item.child->style.flexGrow() / flexFactorSum));
+      };
+    }
+    const double scaledSum = std::accumulate(items.begin(), items.end(), 0.0, [&](double x, const Item &item) {
+      return x + ScaledFlexShrinkFactor(item, d, flexFactorSum);
+    });
+    return [d, scaledSum, violation, flexFactorSum](const Item &item) {
+      if (scaledSum == 0.0) {
+        return 0.0;
+      }
+      const double ratio = ScaledFlexShrinkFactor(item, d, flexFactorSum) / scaledSum;
+      return -std::fabs(ratio * violation);
+    };
+  }
+
+  static LayoutRef LayoutStack(const Node &node, const SizeRange &range) {
+    const Direction d = node.direction;
+    const double stackMin = S_stack(d, range.min), stackMax = S_stack(d, range.max);
+    const double crossMin = S_cross(d, range.min), crossMax = S_cross(d, range.max);
+    if (node.children.empty()) {
+      std::shared_ptr<Layout> layout(new Layout());
+      layout->size = range.min;
+      return layout;
+    }
+
+    const long flexibleChildren = std::count_if(node.children.begin(), node.children.end(),
+                                                [](const std::unique_ptr<Node> &c) { return S_flexible(c->style); });
+    const bool optimizedFlexing = flexibleChildren == 1 && stackMin == stackMax;
+
+    std::vector<Item> items;
+    for (const auto &child : node.children) {
+      items.push_back({child.get(), nullptr});
+    }
+    for (auto &item : items) {
+      if (optimizedFlexing && S_flexible(item.child->style)) {
+        std::shared_ptr<Layout> layout(new Layout());
+        layout->size = {0, 0};
+        item.layout = layout;
+      } else {
+        item.layout = S_layout_child<Legacy>(*item.child, d, 0, INFINITY, crossMax);
+      }
+    }
+
+    // Collect items into lines.
+    std::vector<Line> lines;
+    if (!node.wrap) {
+      lines.push_back({items, 0, 0});
+    } else {
+      std::vector<Item> lineItems;
+      double lineStackDimensionSum = 0;
+      double interitemSpacing = 0;
+      for (const auto &item : items) {
+        const double itemAndSpacing = item.child->style.spacingBefore() + S_stack(d, item.layout->size) + item.child->style.spacingAfter();
+        const bool negative = S_violation(lineStackDimensionSum + interitemSpacing + itemAndSpacing, stackMin, stackMax) < 0;
+        if (negative && !lineItems.empty()) {
+          lines.push_back({std::vector<Item>(lineItems), 0, 0});
+          lineItems.clear();
+          lineStackDimensionSum = 0;
+          interitemSpacing = 0;
+        }
+        lineItems.push_back(item);
+        lineStackDimensionSum += interitemSpacing + itemAndSpacing;
+        interitemSpacing = node.spacing;
+      }
+      lines.push_back({std::vector<Item>(lineItems), 0, 0});
+    }
+
+    // Resolve flexible lengths.
+    for (auto &line : lines) {
+      auto &lineItems = line.items;
+      const double violation = S_violation(ItemsStackDimensionSum(lineItems, d, node.spacing), stackMin, stackMax);
+      std::function<double(const Item &)> flexFactor = FlexFactor(violation);
+      const double flexFactorSum = std::accumulate(lineItems.begin(), lineItems.end(), 0.0, [&](double x, const Item &item) {
+        return x + flexFactor(item);
+      });
+      if (flexFactorSum == 0) {
+        if (optimizedFlexing) {
+          for (auto &item : lineItems) {
+            if (S_flexible(item.child->style)) {
+              item.layout = S_layout_child<Legacy>(*item.child, d, 0, 0, crossMax);
+            }
+          }
+        }
+        continue;
+      }
+      std::function<double(const Item &)> flexAdjustment = FlexAdjustment(lineItems, d, violation, flexFactorSum);
+      const double remainingViolation = std::accumulate(lineItems.begin(), lineItems.end(), violation, [&](double x, const Item &item) {
+        return x - flexAdjustment(item);
+      });
+      size_t firstFlexItem = -1;
+      for (size_t i = 0; i < lineItems.size(); i++) {
+        if (flexAdjustment(lineItems[i]) != 0) {
+          firstFlexItem = i;
+          break;
+        }
+      }
+      if (firstFlexItem == (size_t)-1) {
+        continue;
+      }
+      for (size_t i = 0; i < lineItems.size(); i++) {
+        auto &item = lineItems[i];
+        const double adjustment = flexAdjustment(item);
+        if (adjustment != 0) {
+          const double flexed = S_stack(d, item.layout->size) + adjustment + (i == firstFlexItem && item.child->style.flexGrow() > 0 ? remainingViolation : 0);
+          const double size = flexed < 0 ? 0 : flexed;
+          item.layout = S_layout_child<Legacy>(*item.child, d, size, size, crossMax);
+        }
+      }
+    }
+
+    // Line cross sizes and the stack's size.
+    double stackSum = 0, crossSum = 0;
+    std::shared_ptr<Layout> layout(new Layout());
+    for (auto &line : lines) {
+      for (const auto &item : line.items) {
+        line.crossSize = std::max(line.crossSize, S_cross(d, item.layout->size));
+      }
+      if (lines.size() == 1) {
+        line.crossSize = S_clamp(line.crossSize, crossMin, crossMax);
+      }
+      line.stackDimensionSum = ItemsStackDimensionSum(line.items, d, node.spacing);
+      stackSum = std::max(stackSum, line.stackDimensionSum);
+      crossSum += line.crossSize;
+    }
+    // As ASStackPositionedLayout gathered them, line by line.
+    std::vector<Item> positionedItems;
+    for (const auto &line : lines) {
+      std::copy(line.items.begin(), line.items.end(), std::back_inserter(positionedItems));
+    }
+    for (const auto &item : positionedItems) {
+      layout->sublayouts.push_back(item.layout);
+    }
+    const Size size = S_size(d, stackSum, crossSum);
+    layout->size = {S_clamp(size.width, range.min.width, range.max.width),
+                    S_clamp(size.height, range.min.height, range.max.height)};
+    return layout;
+  }
+};
+
+// MARK: - Solver
+
+struct Solver {
+  typedef AS::StackFlexItem<double> FlexItem;
+
+  struct Item {
+    const Node *child;
+    LayoutRef layout;
+  };
+  struct Line {
+    size_t begin, end;
+    double stackDimensionSum;
+    double crossSize;
+  };
+
+  static AS::ScratchArena &Arena() {
+    static AS::ScratchArena arena;
+    return arena;
+  }
+
+  static LayoutRef LayoutStack(const Node &node, const SizeRange &range) {
+    const Direction d = node.direction;
+    const double stackMin = S_stack(d, range.min), stackMax = S_stack(d, range.max);
+    const double crossMin = S_cross(d, range.min), crossMax = S_cross(d, range.max);
+    const size_t count = node.children.size();
+    if (count == 0) {
+      std::shared_ptr<Layout> layout(new Layout());
+      layout->size = range.min;
+      return layout;
+    }
+
+    AS::ScratchArena::Scope scratch(Arena());
+    FlexItem *flexItems = scratch.Allocate<FlexItem>(count);
+    size_t flexibleChildren = 0;
+    for (size_t i = 0; i < count; i++) {
+      const Style &style = node.children[i]->style;
+      flexItems[i] = {0, style.flexGrow(), style.flexShrink(), style.spacingBefore(), style.spacingAfter(), false, 0};
+      flexibleChildren += flexItems[i].IsFlexibleInBothDirections() ? 1 : 0;
+    }
+    const bool optimizedFlexing = flexibleChildren == 1 && stackMin == stackMax;
+
+    std::vector<Item> items;
+    items.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      const Node &child = *node.children[i];
+      if (optimizedFlexing && flexItems[i].IsFlexibleInBothDirections()) {
+        std::shared_ptr<Layout> layout(new Layout());
+        layout->size = {0, 0};
+        items.push_back({&child, layout});
+      } else {
+        items.push_back({&child, S_layout_child<Solver>(child, d, 0, INFINITY, crossMax)});
+      }
+      flexItems[i].stackSize = S_stack(d, items[i].layout->size);
+    }
+
+    AS::SmallVector<Line, 1> lines;
+    AS::CollectStackLines(flexItems, count, node.spacing, stackMin, stackMax, node.wrap, [&](size_t begin, size_t end) {
+      lines.push_back({begin, end, 0, 0});
+    });
+
+    for (const auto &line : lines) {
+      FlexItem *lineFlexItems = flexItems + line.begin;
+      const size_t lineCount = line.end - line.begin;
+      if (!AS::FlexStackLine(lineFlexItems, lineCount, node.spacing, stackMin, stackMax, kViolationEpsilon)) {
+        if (optimizedFlexing) {
+          for (size_t i = 0; i < lineCount; i++) {
+            if (lineFlexItems[i].IsFlexibleInBothDirections()) {
+              items[line.begin + i].layout = S_layout_child<Solver>(*items[line.begin + i].child, d, 0, 0, crossMax);
+            }
+          }
+        }
+        continue;
+      }
+      for (size_t i = 0; i < lineCount; i++) {
+        if (lineFlexItems[i].flexed) {
+          const double size = lineFlexItems[i].flexedStackSize;
+          items[line.begin + i].layout = S_layout_child<Solver>(*items[line.begin + i].child, d, size, size, crossMax);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      flexItems[i].stackSize = S_stack(d, items[i].layout->size);
+    }
+    double stackSum = 0, crossSum = 0;
+    for (auto &line : lines) {
+      for (size_t i = line.begin; i < line.end; i++) {
+        line.crossSize = std::max(line.crossSize, S_cross(d, items[i].layout->size));
+      }
+      if (lines.size() == 1) {
+        line.crossSize = S_clamp(line.crossSize, crossMin, crossMax);
+      }
+      line.stackDimensionSum = AS::StackDimensionSum(flexItems + line.begin, line.end - line.begin, node.spacing);
+      stackSum = std::max(stackSum, line.stackDimensionSum);
+      crossSum += line.crossSize;
+    }
+
+    std::shared_ptr<Layout> layout(new Layout());
+    layout->sublayouts.reserve(count);
+    for (const auto &item : items) {
+      layout->sublayouts.push_back(item.layout);
+    }
+    const Size size = S_size(d, stackSum, crossSum);
+    layout->size = {S_clamp(size.width, range.min.width, range.max.width),
+                    S_clamp(size.height, range.min.height, range.max.height)};
+    return layout;
+  }
+};
+
+// MARK: - Trees
+
+static Node *S_box(double width, double height, double grow = 0, double shrink = 0) {
+  Node *node = new Node();
+  node->size = {width, height};
+  node->style._flexGrow = grow;
+  node->style._flexShrink = shrink;
+  return node;
+}
+
+static Node *S_text(double textWidth, double grow = 0, double shrink = 1) {
+  Node *node = new Node();
+  node->kind = Node::Text;
+  node->textWidth = textWidth;
+  node->style._flexGrow = grow;
+  node->style._flexShrink = shrink;
+  return node;
+}
+
+static Node *S_stack_node(Direction d, double spacing, bool wrap, std::vector<Node *> children) {
+  Node *node = new Node();
+  node->kind = Node::Stack;
+  node->direction = d;
+  node->spacing = spacing;
+  node->wrap = wrap;
+  for (Node *child : children) {
+    node->children.emplace_back(child);
+  }
+  return node;
+}
+
+static Node *S_random_node(std::mt19937 &rng, int depth) {
+  static const double GROW[] = {0, 0, 0, 1, 2, 0.5};
+  static const double SHRINK[] = {0, 1, 1, 1, 3, 0.25};
+  static const double SPACING[] = {0, 0, 4, 8.5, 1.0 / 3};
+  Node *node;
+  unsigned kind = rng() % (depth > 0 ? 4 : 2);
+  if (kind == 0) {
+    node = S_box(rng() % 200 + (rng() % 3) / 3.0, rng() % 60);
+  } else if (kind == 1) {
+    node = S_text(rng() % 600 + 1);
+  } else {
+    std::vector<Node *> children;
+    for (unsigned i = 0, n = rng() % 8 + 1; i < n; i++) {
+      children.push_back(S_random_node(rng, depth - 1));
+    }
+    node = S_stack_node(rng() % 2 ? Vertical : Horizontal, SPACING[rng() % 5], rng() % 4 == 0, children);
+  }
+  node->style._flexGrow = GROW[rng() % 6];
+  node->style._flexShrink = SHRINK[rng() % 6];
+  node->style._spacingBefore = SPACING[rng() % 5];
+  node->style._spacingAfter = SPACING[rng() % 5];
+  return node;
+}
+
+static SizeRange S_random_range(std::mt19937 &rng) {
+  double width = rng() % 500 + 20, height = rng() % 800 + 20;
+  switch (rng() % 3) {
+  case 0:
+    return {{width, height}, {width, height}};
+  case 1:
+    return {{0, 0}, {width, INFINITY}};
+  default:
+    return {{width / 2, 0}, {width, height}};
+  }
+}
+
+static void S_flatten(const LayoutRef &layout, std::vector<double> &out) {
+  out.push_back(layout->size.width);
+  out.push_back(layout->size.height);
+  out.push_back((double)layout->sublayouts.size());
+  for (const auto &sublayout : layout->sublayouts) {
+    S_flatten(sublayout, out);
+  }
+}
+
+// MARK: - Checks
+
+struct golden {
+  const char *name;
+  Node *(*build)();
+  SizeRange range;
+  std::vector<double> sizes; // stack, then each child, as width/height pairs
+};
+
+// A fixed avatar and a message that must shrink to fit 300pt and wraps to 3 lines.
+static Node *S_golden_shrink() {
+  return S_stack_node(Horizontal, 0, false, {S_box(100, 40), S_text(500)});
+}
+
+// Three boxes sharing 131pt of growth: 43 each, and the rounding remainder to the first.
+static Node *S_golden_grow() {
+  return S_stack_node(Horizontal, 10, false, {S_box(50, 10, 1), S_box(50, 10, 1), S_box(50, 10, 1)});
+}
+
+// Five 40pt boxes wrapping at 100pt into lines of two, two and one.
+static Node *S_golden_wrap() {
+  return S_stack_node(Horizontal, 10, true, {S_box(40, 10), S_box(40, 10), S_box(40, 10), S_box(40, 10), S_box(40, 10)});
+}
+
+static bool S_check_goldens() {
+  const golden GOLDENS[] = {
+      {"shrink", S_golden_shrink, {{300, 0}, {300, INFINITY}}, {300, 60, 100, 40, 200, 60}},
+      {"grow", S_golden_grow, {{301, 0}, {301, INFINITY}}, {301, 10, 95, 10, 93, 10, 93, 10}},
+      {"wrap", S_golden_wrap, {{0, 0}, {100, INFINITY}}, {90, 30, 40, 10, 40, 10, 40, 10, 40, 10, 40, 10}},
+  };
+  bool ok = true;
+  for (const golden &g : GOLDENS) {
+    std::unique_ptr<Node> root(g.build());
+    for (int engine = 0; engine < 2; engine++) {
+      LayoutRef layout = engine == 0 ? S_layout<Legacy>(*root, g.range) : S_layout<Solver>(*root, g.range);
+      std::vector<double> sizes = {layout->size.width, layout->size.height};
+      for (const auto &sublayout : layout->sublayouts) {
+        sizes.push_back(sublayout->size.width);
+        sizes.push_back(sublayout->size.height);
+      }
+      if (sizes != g.sizes) {
+        fprintf(stderr, "golden %s: %s layout differs\n", g.name, engine == 0 ? "legacy" : "solver");
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+static size_t S_check_random(size_t trees) {
+  std::mt19937 rng(7);
+  size_t mismatches = 0;
+  for (size_t t = 0; t < trees; t++) {
+    std::unique_ptr<Node> root(S_random_node(rng, 4));
+    if (root->kind != Node::Stack) {
+      continue;
+    }
+    const SizeRange range = S_random_range(rng);
+    std::vector<double> legacy, solver;
+    S_flatten(S_layout<Legacy>(*root, range), legacy);
+    S_flatten(S_layout<Solver>(*root, range), solver);
+    if (legacy != solver) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+// MARK: - Workloads
+
+// A vertical list of message rows: avatar, then name, text and time stacked.
+static Node *S_chat() {
+  std::mt19937 rng(1);
+  std::vector<Node *> rows;
+  for (int i = 0; i < 100; i++) {
+    Node *bubble = S_stack_node(Vertical, 4, false, {S_box(80, 16), S_text(rng() % 900 + 40), S_box(40, 12)});
+    bubble->style._flexShrink = 1;
+    bubble->style._flexGrow = 1;
+    rows.push_back(S_stack_node(Horizontal, 8, false, {S_box(36, 36), bubble}));
+  }
+  return S_stack_node(Vertical, 12, false, rows);
+}
+
+// Twenty levels of nesting, alternating direction, each between two boxes.
+static Node *S_deep() {
+  Node *node = S_text(300);
+  for (int depth = 0; depth < 20; depth++) {
+    node->style._flexShrink = 1;
+    node = S_stack_node(depth % 2 ? Vertical : Horizontal, 2, false, {S_box(10, 10), node, S_box(10, 10, 1)});
+  }
+  return node;
+}
+
+// One row of 200 shrinkable children.
+static Node *S_wide() {
+  std::vector<Node *> children;
+  for (int i = 0; i < 200; i++) {
+    children.push_back(S_box(20 + i % 7, 20, i % 3 == 0 ? 1 : 0, 1));
+  }
+  return S_stack_node(Horizontal, 2, false, children);
+}
+
+// The same 200 children wrapping into lines.
+static Node *S_wide_wrap() {
+  Node *node = S_wide();
+  node->wrap = true;
+  return node;
+}
+
+struct workload {
+  const char *name;
+  Node *(*build)();
+  SizeRange range;
+};
+
+static const workload WORKLOADS[] = {
+    {"chat_list", S_chat, {{375, 0}, {375, INFINITY}}},
+    {"deep_20", S_deep, {{200, 0}, {200, INFINITY}}},
+    {"wide_200", S_wide, {{2000, 0}, {2000, INFINITY}}},
+    {"wide_200_wrap", S_wide_wrap, {{0, 0}, {375, INFINITY}}},
+};
+
+template <class Engine>
+static double S_measure(const Node &root, const SizeRange &range) {
+  double best = 1e30;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t iterations = 0;
+    double start = S_now(), elapsed;
+    do {
+      LayoutRef layout = S_layout<Engine>(root, range);
+      iterations++;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time / TRIALS);
+    best = std::min(best, elapsed / iterations);
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  size_t trees = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.03;
+      trees = 2000;
+    }
+  }
+
+  if (!S_check_goldens()) {
+    return 1;
+  }
+  const size_t mismatches = S_check_random(trees);
+  if (mismatches > 0) {
+    fprintf(stderr, "%zu of %zu random trees differ\n", mismatches, trees);
+    return 1;
+  }
+
+  const size_t workloads = sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+  printf("{\n  \"random_trees_matched\": %zu,\n  \"workloads\": [\n", trees);
+  for (size_t w = 0; w < workloads; w++) {
+    std::unique_ptr<Node> root(WORKLOADS[w].build());
+    const double legacy = S_measure<Legacy>(*root, WORKLOADS[w].range);
+    const double solver = S_measure<Solver>(*root, WORKLOADS[w].range);
+    printf("    {\"name\": \"%s\", \"legacy_us\": %.2f, \"solver_us\": %.2f, "
+           "\"speedup\": %.2f}%s\n",
+           WORKLOADS[w].name, legacy * 1e6, solver * 1e6, legacy / solver,
+           w + 1 == workloads ? "" : ",");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
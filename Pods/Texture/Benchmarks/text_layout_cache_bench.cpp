@@ -0,0 +1,495 @@
+// Checks and cost of the ASTextNode2 layout cache.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -pthread -o text_layout_cache_bench
+//       text_layout_cache_bench.cpp
+//   ./text_layout_cache_bench [--quick] > result.json
+//
+// First checks AS::ShardedLRUCache on its own: recency order, the byte bound,
+// replacement, and then several threads hammering one cache while another
+// clears it, with every hit checked against its key. Exits with 1 on failure.
+// Build with -fsanitize=thread to check the locking as well.
+//
+// Then replays a chat transcript being scrolled, measuring each lookup the way
+// ASTextNode2 makes it. The previous cache is copied in outline: an unbounded
+// map keyed by the whole attributed string, where the key is hashed from a few
+// characters but compared in full on every hit, each entry holding up to three
+// layouts at exact sizes behind its own lock, and the caller copying and
+// preparing the string before every lookup. The new one looks up a key built
+// from fingerprints the node already holds. A layout is stood in for by one
+// pass over its text; CoreText costs far more, so misses are cheap here.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../Source/Private/ASTextLayoutCache.h"
+
+#define TRIALS 3
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// MARK: - Cache checks
+
+struct Payload {
+  uint64_t id;
+  std::shared_ptr<uint64_t> check;
+};
+
+struct IntHash {
+  size_t operator()(uint64_t key) const { return (size_t)key; }
+};
+
+typedef AS::ShardedLRUCache<uint64_t, Payload, IntHash> IntCache;
+
+static Payload S_payload(uint64_t id) {
+  return Payload{id, std::make_shared<uint64_t>(id)};
+}
+
+static bool S_has(IntCache &cache, uint64_t key) {
+  Payload p;
+  return cache.Find(key, p) && p.id == key && *p.check == key;
+}
+
+static bool S_check_order() {
+  IntCache cache(300, 1);
+  cache.Insert(1, S_payload(1), 100);
+  cache.Insert(2, S_payload(2), 100);
+  cache.Insert(3, S_payload(3), 100);
+  // 1 becomes the most recently used, so 2 goes first.
+  if (!S_has(cache, 1)) return false;
+  cache.Insert(4, S_payload(4), 100);
+  if (S_has(cache, 2) || !S_has(cache, 1) || !S_has(cache, 3) || !S_has(cache, 4)) {
+    return false;
+  }
+  // A rejected lookup counts as a miss and leaves the entry in place.
+  Payload p;
+  if (cache.Find(3, [](const Payload &) { return false; }, p) || !S_has(cache, 3)) {
+    return false;
+  }
+  // Replacing an entry updates its size; a large one pushes out the oldest two.
+  cache.Insert(4, S_payload(4), 250);
+  IntCache::Statistics s = cache.GetStatistics();
+  if (s.entries != 1 || s.bytes != 250 || !S_has(cache, 4)) return false;
+  // Values bigger than the whole shard are not cached, and the old one is gone.
+  cache.Insert(4, S_payload(4), 301);
+  s = cache.GetStatistics();
+  if (s.entries != 0 || s.bytes != 0 || S_has(cache, 4)) return false;
+  cache.Insert(5, S_payload(5), 10);
+  cache.Clear();
+  s = cache.GetStatistics();
+  return s.entries == 0 && s.bytes == 0 && s.evictions == 3 && s.insertions == 6;
+}
+
+static bool S_check_size_classes() {
+  typedef AS::TextLayoutKey Key;
+  return Key::SizeClass(375.0) == Key::SizeClass(374.99999)
+      && Key::SizeClass(375.0) == Key::SizeClass(375.06)
+      && Key::SizeClass(375.0) != Key::SizeClass(375.07)
+      && Key::SizeClass(1048575.0) < INT32_MAX
+      && Key::SizeClass(INFINITY) == INT32_MAX
+      && Key::SizeClass(NAN) == INT32_MAX;
+}
+
+static bool S_check_threads(size_t opsPerThread) {
+  const size_t kThreads = 4;
+  const size_t kCapacity = 1 << 20;
+  IntCache cache(kCapacity, 8);
+  std::atomic<bool> failed(false);
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> finds(0);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      std::mt19937_64 rng(t + 1);
+      uint64_t localFinds = 0;
+      for (size_t i = 0; i < opsPerThread; i++) {
+        // Skewed towards low keys, so some stay hot and others churn.
+        const double r = (double)(rng() >> 11) / (double)(1ull << 53);
+        const uint64_t key = (uint64_t)(r * r * 20000);
+        Payload p;
+        localFinds++;
+        if (cache.Find(key, p)) {
+          if (p.id != key || *p.check != key) {
+            failed = true;
+          }
+        } else {
+          cache.Insert(key, S_payload(key), 512 + (key % 64) * 512);
+        }
+      }
+      finds += localFinds;
+    });
+  }
+  std::thread clearer([&] {
+    while (!done) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      cache.Clear();
+      IntCache::Statistics s = cache.GetStatistics();
+      if (s.bytes > s.capacityBytes) {
+        failed = true;
+      }
+    }
+  });
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  done = true;
+  clearer.join();
+
+  IntCache::Statistics s = cache.GetStatistics();
+  return !failed && s.hits + s.misses == finds && s.bytes <= kCapacity
+      && s.entries <= s.insertions - s.evictions;
+}
+
+// MARK: - Transcript
+
+struct Run {
+  uint32_t length;
+  uint32_t style;
+};
+
+// An attributed string: UTF-16 characters and runs of attributes. Copies are
+// deep, as -mutableCopy's are.
+struct Text {
+  std::u16string characters;
+  std::vector<Run> runs;
+};
+
+static bool S_equal(const Text &a, const Text &b) {
+  if (a.characters != b.characters || a.runs.size() != b.runs.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.runs.size(); i++) {
+    if (a.runs[i].length != b.runs[i].length || a.runs[i].style != b.runs[i].style) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint64_t S_fingerprint(const Text &text) {
+  AS::Fingerprint f;
+  f.Add(text.characters.data(), text.characters.size() * sizeof(char16_t));
+  uint64_t location = 0;
+  for (const Run &run : text.runs) {
+    f.Add(location);
+    f.Add(run.length);
+    f.Add(AS::Fingerprint::Hash(run.style));
+    location += run.length;
+  }
+  return f.Value();
+}
+
+// Stands in for the paragraph style and shadow pass of -prepareAttributedString:.
+static void S_prepare(Text &text) {
+  for (Run &run : text.runs) {
+    run.style |= 0x10000;
+  }
+}
+
+struct Layout {
+  std::shared_ptr<const Text> text;
+  double width;
+  size_t lines;
+};
+
+// One pass over the text, breaking lines every 40 characters or so.
+__attribute__((noinline)) static Layout S_layout(const Text &text, double width) {
+  Layout layout;
+  layout.text = std::make_shared<const Text>(text);
+  layout.width = width;
+  layout.lines = 1;
+  size_t column = 0;
+  for (char16_t c : text.characters) {
+    if (++column > 40 && c == u' ') {
+      layout.lines++;
+      column = 0;
+    }
+  }
+  return layout;
+}
+
+static size_t S_estimated_bytes(const Layout &layout) {
+  return 1024 + layout.text->characters.size() * 24 + layout.lines * 256;
+}
+
+struct Message {
+  std::shared_ptr<const Text> text;
+  uint64_t fingerprint;
+};
+
+static std::vector<Message> S_transcript(size_t count) {
+  std::mt19937 rng(7);
+  // Mostly short messages with the odd long answer.
+  std::lognormal_distribution<double> length(5.3, 1.1);
+  std::vector<Message> messages;
+  for (size_t i = 0; i < count; i++) {
+    Text text;
+    const size_t n = std::min<size_t>(12000, 4 + (size_t)length(rng));
+    for (size_t c = 0; c < n; c++) {
+      text.characters.push_back(rng() % 6 == 0 ? u' ' : (char16_t)(u'a' + rng() % 26));
+    }
+    for (size_t at = 0; at < n;) {
+      const uint32_t run = std::min<uint32_t>((uint32_t)(n - at), 1 + rng() % 200);
+      text.runs.push_back(Run{run, (uint32_t)(rng() % 4)});
+      at += run;
+    }
+    Message m;
+    m.text = std::make_shared<const Text>(text);
+    m.fingerprint = S_fingerprint(text);
+    messages.push_back(m);
+  }
+  return messages;
+}
+
+struct Lookup {
+  uint32_t message;
+  bool prepared;  // sizing and drawing lay out the prepared text
+  double width;
+};
+
+// Scrolls down through the transcript and back up a third of the way, twice.
+// Each visible message is measured and drawn; widths sometimes carry rounding
+// noise from the layout pass.
+static std::vector<Lookup> S_scroll(size_t messages) {
+  std::mt19937 rng(11);
+  std::vector<Lookup> lookups;
+  const size_t kVisible = 10;
+  auto visit = [&](size_t first) {
+    for (size_t i = first; i < std::min(messages, first + kVisible); i++) {
+      const double width = rng() % 4 == 0 ? 343.0 - 1e-5 : 343.0;
+      lookups.push_back(Lookup{(uint32_t)i, true, width});
+      lookups.push_back(Lookup{(uint32_t)i, false, width});
+    }
+  };
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t top = 0; top + kVisible <= messages; top++) {
+      visit(top);
+    }
+    for (size_t top = messages - kVisible; top > messages * 2 / 3; top--) {
+      visit(top);
+    }
+  }
+  return lookups;
+}
+
+// MARK: - Previous cache
+
+class LegacyCache {
+public:
+  struct Value {
+    std::mutex m;
+    std::deque<Layout> layouts;
+  };
+
+  struct KeyHash {
+    // -[NSString hash] reads at most 96 characters: the first, middle and last 32.
+    size_t operator()(const std::shared_ptr<const Text> &text) const {
+      const std::u16string &c = text->characters;
+      AS::Fingerprint f;
+      if (c.size() <= 96) {
+        f.Add(c.data(), c.size() * sizeof(char16_t));
+      } else {
+        f.Add(c.data(), 64);
+        f.Add(c.data() + c.size() / 2 - 16, 64);
+        f.Add(c.data() + c.size() - 32, 64);
+      }
+      f.Add(c.size());
+      return (size_t)f.Value();
+    }
+  };
+
+  struct KeyEqual {
+    bool operator()(const std::shared_ptr<const Text> &a, const std::shared_ptr<const Text> &b) const {
+      return a == b || S_equal(*a, *b);
+    }
+  };
+
+  Layout Get(const Text &text, double width, bool &hit) {
+    // The key is a throwaway copy until it is stored.
+    std::shared_ptr<const Text> key = std::make_shared<const Text>(text);
+    _lock.lock();
+    std::unique_ptr<Value> &slot = _map[key];
+    if (!slot) {
+      slot.reset(new Value);
+    }
+    Value *value = slot.get();
+    std::lock_guard<std::mutex> l(value->m);
+    _lock.unlock();
+    for (const Layout &layout : value->layouts) {
+      if (layout.width == width) {
+        hit = true;
+        return layout;
+      }
+    }
+    hit = false;
+    Layout layout = S_layout(text, width);
+    value->layouts.push_front(layout);
+    if (value->layouts.size() > 3) {
+      value->layouts.pop_back();
+    }
+    return layout;
+  }
+
+  size_t EstimatedBytes() {
+    size_t bytes = 0;
+    for (auto &entry : _map) {
+      for (const Layout &layout : entry.second->layouts) {
+        bytes += S_estimated_bytes(layout);
+      }
+    }
+    return bytes;
+  }
+
+private:
+  std::mutex _lock;
+  std::unordered_map<std::shared_ptr<const Text>, std::unique_ptr<Value>, KeyHash, KeyEqual> _map;
+};
+
+// MARK: - Workloads
+
+struct Result {
+  double seconds;
+  size_t misses;
+  size_t bytes;
+};
+
+static Result S_run_legacy(const std::vector<Message> &messages, const std::vector<Lookup> &lookups) {
+  LegacyCache cache;
+  Result result = {0, 0, 0};
+  const double start = S_now();
+  for (const Lookup &lookup : lookups) {
+    // -calculateSizeThatFits: and -drawParametersForAsyncLayer: copy the text first.
+    Text text = *messages[lookup.message].text;
+    if (lookup.prepared) {
+      S_prepare(text);
+    }
+    bool hit;
+    cache.Get(text, lookup.width, hit);
+    result.misses += hit ? 0 : 1;
+  }
+  result.seconds = S_now() - start;
+  result.bytes = cache.EstimatedBytes();
+  return result;
+}
+
+struct Source {
+  std::shared_ptr<const Text> text;
+  Layout layout;
+};
+
+static Result S_run_new(const std::vector<Message> &messages, const std::vector<Lookup> &lookups, size_t capacity) {
+  typedef AS::ShardedLRUCache<AS::TextLayoutKey, Source, AS::TextLayoutKeyHash> Cache;
+  Cache cache(capacity, 8);
+  Result result = {0, 0, 0};
+  const double start = S_now();
+  for (const Lookup &lookup : lookups) {
+    const Message &message = messages[lookup.message];
+    const AS::TextLayoutKey key = {
+      message.fingerprint,
+      lookup.prepared ? 1u : 0u,
+      0,
+      AS::TextLayoutKey::SizeClass(lookup.width),
+      AS::TextLayoutKey::SizeClass(INFINITY)
+    };
+    Source cached;
+    const bool found = cache.Find(key, [&](const Source &value) {
+      return value.text == message.text || S_equal(*value.text, *message.text);
+    }, cached);
+    if (!found) {
+      Text text = *message.text;
+      if (lookup.prepared) {
+        S_prepare(text);
+      }
+      Source value = {message.text, S_layout(text, lookup.width)};
+      const size_t bytes = S_estimated_bytes(value.layout);
+      cache.Insert(key, value, bytes);
+    }
+  }
+  result.seconds = S_now() - start;
+  Cache::Statistics s = cache.GetStatistics();
+  result.misses = (size_t)s.misses;
+  result.bytes = (size_t)s.bytes;
+  return result;
+}
+
+template <typename F>
+static Result S_measure(F &&run) {
+  Result best = run();
+  for (int trial = 1; trial < TRIALS; trial++) {
+    Result r = run();
+    if (r.seconds < best.seconds) {
+      best = r;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  size_t messages = 2000;
+  size_t ops = 200000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      messages = 300;
+      ops = 20000;
+    }
+  }
+  if (!S_check_order()) {
+    fprintf(stderr, "recency order or byte accounting is wrong\n");
+    return 1;
+  }
+  if (!S_check_size_classes()) {
+    fprintf(stderr, "size classes are wrong\n");
+    return 1;
+  }
+  if (!S_check_threads(ops)) {
+    fprintf(stderr, "concurrent use lost or corrupted entries\n");
+    return 1;
+  }
+
+  const std::vector<Message> transcript = S_transcript(messages);
+  const std::vector<Lookup> lookups = S_scroll(messages);
+  size_t characters = 0;
+  for (const Message &m : transcript) {
+    characters += m.text->characters.size();
+  }
+
+  Result legacy = S_measure([&] { return S_run_legacy(transcript, lookups); });
+  printf("{\n  \"messages\": %zu,\n  \"characters\": %zu,\n  \"lookups\": %zu,\n",
+         messages, characters, lookups.size());
+  printf("  \"legacy\": {\"seconds\": %.6f, \"ns_per_lookup\": %.1f, "
+         "\"hit_rate\": %.4f, \"retained_bytes\": %zu},\n",
+         legacy.seconds, legacy.seconds * 1e9 / lookups.size(),
+         1.0 - (double)legacy.misses / lookups.size(), legacy.bytes);
+  printf("  \"sharded_lru\": [\n");
+  static const size_t CAPACITIES[] = {1 << 20, 4 << 20, 8 << 20};
+  const size_t capacities = sizeof(CAPACITIES) / sizeof(CAPACITIES[0]);
+  for (size_t c = 0; c < capacities; c++) {
+    Result r = S_measure([&] { return S_run_new(transcript, lookups, CAPACITIES[c]); });
+    printf("    {\"capacity_bytes\": %zu, \"seconds\": %.6f, \"ns_per_lookup\": %.1f, "
+           "\"hit_rate\": %.4f, \"retained_bytes\": %zu, \"speedup\": %.1f}%s\n",
+           CAPACITIES[c], r.seconds, r.seconds * 1e9 / lookups.size(),
+           1.0 - (double)r.misses / lookups.size(), r.bytes, legacy.seconds / r.seconds,
+           c + 1 == capacities ? "" : ",");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,310 @@
+// Checks and overhead of the trace recorder behind ASTrace.h.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -pthread -o trace_recorder_bench
+//       trace_recorder_bench.cpp
+//   ./trace_recorder_bench [--quick] > result.json
+//
+// First the checks: worker threads record nested begin/end pairs and counters
+// while the flusher runs, and exit before the export, so their rings must be
+// flushed as they retire. Every event must be either stored or counted as
+// dropped, each thread's events must come out in order and balanced, nothing
+// recorded while tracing is off may appear, a full ring must count what it
+// drops, and the export must be well-formed Chrome trace JSON with names
+// escaped. Exits with 1 on failure.
+//
+// Then times one Record call with tracing off and on, and one read of the
+// clock, which is most of the cost with tracing on. The time with tracing on
+// excludes flushing, which happens on the flusher thread in the app.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Source/Private/ASTraceRecorder.h"
+
+#define TRIALS 3
+
+static double min_time = 0.2;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// MARK: - Export parsing
+
+struct ParsedEvent {
+  std::string ph;
+  double ts;
+  unsigned tid;
+  std::string name;
+  unsigned long long arg;
+};
+
+// Just enough of a reader for the exporter's own output: one event per line.
+static bool S_parse(const std::string &json, std::vector<ParsedEvent> &events, std::map<unsigned, std::string> &threads) {
+  if (json.compare(0, 15, "{\"traceEvents\":") != 0 || json.find("\n],\"displayTimeUnit\":\"ms\"}") == std::string::npos) {
+    return false;
+  }
+  size_t start = json.find('\n');
+  while (start != std::string::npos && json.compare(start + 1, 2, "{\"") == 0) {
+    const size_t end = json.find('\n', start + 1);
+    const std::string line = json.substr(start + 1, end - start - 1);
+    start = end;
+    unsigned tid = 0;
+    const size_t tidAt = line.find("\"tid\":");
+    if (tidAt == std::string::npos || sscanf(line.c_str() + tidAt, "\"tid\":%u", &tid) != 1) {
+      return false;
+    }
+    const std::string metadata = "{\"name\":\"thread_name\",\"ph\":\"M\",";
+    if (line.compare(0, metadata.size(), metadata) == 0) {
+      const std::string args = "\"args\":{\"name\":\"";
+      const size_t nameAt = line.find(args) + args.size();
+      threads[tid] = line.substr(nameAt, line.size() - nameAt - 3);
+      continue;
+    }
+    ParsedEvent event;
+    char ph[2] = {0};
+    if (sscanf(line.c_str(), "{\"ph\":\"%1[BEiC]\",\"ts\":%lf", ph, &event.ts) != 2) {
+      return false;
+    }
+    event.ph = ph;
+    event.tid = tid;
+    const size_t nameAt = line.find("\"name\":\"") + 8;
+    size_t nameEnd = nameAt;
+    while (line[nameEnd] != '"') {
+      nameEnd += line[nameEnd] == '\\' ? 2 : 1;
+    }
+    event.name = line.substr(nameAt, nameEnd - nameAt);
+    const char *argKey = event.ph == "C" ? "{\"value\":" : "{\"arg\":";
+    const size_t argAt = line.find(argKey);
+    if (argAt == std::string::npos || sscanf(line.c_str() + argAt + strlen(argKey), "%llu", &event.arg) != 1) {
+      return false;
+    }
+    events.push_back(event);
+  }
+  return true;
+}
+
+// MARK: - Checks
+
+static bool S_check_threads(size_t threads, size_t pairs) {
+  AS::TraceRecorder::Reset();
+  const uint32_t outer = AS::TraceRecorder::Intern("Outer");
+  const uint32_t inner = AS::TraceRecorder::Intern("Inner \"quoted\"");
+  const uint32_t counter = AS::TraceRecorder::Intern("Depth");
+  const uint32_t hidden = AS::TraceRecorder::Intern("Hidden");
+  if (AS::TraceRecorder::Intern("Outer") != outer) {
+    fprintf(stderr, "interning is not stable\n");
+    return false;
+  }
+
+  AS::TraceRecorder::Record(AS::TracePhase::Instant, hidden, 0);
+  AS::TraceRecorder::SetEnabled(true);
+  AS::TraceRecorder::StartFlusher(1);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([=] {
+      for (size_t i = 0; i < pairs; i++) {
+        AS::TraceRecorder::Record(AS::TracePhase::Begin, outer, i);
+        AS::TraceRecorder::Record(AS::TracePhase::Begin, inner, i);
+        AS::TraceRecorder::Record(AS::TracePhase::Counter, counter, 2);
+        AS::TraceRecorder::Record(AS::TracePhase::End, inner, i);
+        AS::TraceRecorder::Record(AS::TracePhase::End, outer, i);
+        if (i % 256 == 0) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  AS::TraceRecorder::StopFlusher();
+  AS::TraceRecorder::SetEnabled(false);
+  AS::TraceRecorder::Record(AS::TracePhase::Instant, hidden, 0);
+
+  const uint64_t recorded = threads * pairs * 5;
+  const uint64_t stored = AS::TraceRecorder::StoredCount();
+  const uint64_t dropped = AS::TraceRecorder::DroppedCount();
+  if (stored + dropped != recorded) {
+    fprintf(stderr, "%llu stored and %llu dropped of %llu recorded\n", (unsigned long long)stored,
+            (unsigned long long)dropped, (unsigned long long)recorded);
+    return false;
+  }
+
+  std::vector<ParsedEvent> events;
+  std::map<unsigned, std::string> threadNames;
+  if (!S_parse(AS::TraceRecorder::ExportChromeTrace(), events, threadNames) || events.size() != stored) {
+    fprintf(stderr, "export is malformed\n");
+    return false;
+  }
+  std::map<unsigned, std::vector<const ParsedEvent *>> byThread;
+  for (const ParsedEvent &event : events) {
+    if (event.name == "Hidden" || threadNames.count(event.tid) == 0) {
+      fprintf(stderr, "export has stray events\n");
+      return false;
+    }
+    if (event.name != "Outer" && event.name != "Inner \\\"quoted\\\"" && event.name != "Depth") {
+      fprintf(stderr, "name is not escaped: %s\n", event.name.c_str());
+      return false;
+    }
+    byThread[event.tid].push_back(&event);
+  }
+  if (byThread.size() != threads) {
+    fprintf(stderr, "events come from %zu threads\n", byThread.size());
+    return false;
+  }
+  for (const auto &thread : byThread) {
+    double last = 0;
+    int depth = 0;
+    for (const ParsedEvent *event : thread.second) {
+      if (event->ts < last) {
+        fprintf(stderr, "thread %u is out of order\n", thread.first);
+        return false;
+      }
+      last = event->ts;
+      depth += event->ph == "B" ? 1 : event->ph == "E" ? -1 : 0;
+      // Drops can only leave a slice unclosed or unopened at the ends of a gap.
+      if (dropped == 0 && (depth < 0 || depth > 2)) {
+        fprintf(stderr, "thread %u is unbalanced\n", thread.first);
+        return false;
+      }
+    }
+    if (dropped == 0 && depth != 0) {
+      fprintf(stderr, "thread %u is unbalanced\n", thread.first);
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool S_check_overflow() {
+  AS::TraceRecorder::Reset();
+  const uint32_t name = AS::TraceRecorder::Intern("Overflow");
+  const size_t extra = 100;
+  uint64_t stored = 0;
+  uint64_t dropped = 0;
+  std::thread([&] {
+    AS::TraceRecorder::SetEnabled(true);
+    for (size_t i = 0; i < AS::TraceRing::kCapacity + extra; i++) {
+      AS::TraceRecorder::Record(AS::TracePhase::Instant, name, i);
+    }
+    AS::TraceRecorder::SetEnabled(false);
+    dropped = AS::TraceRecorder::DroppedCount();
+    AS::TraceRecorder::Flush();
+    stored = AS::TraceRecorder::StoredCount();
+  }).join();
+  if (stored != AS::TraceRing::kCapacity || dropped != extra || AS::TraceRecorder::DroppedCount() != extra) {
+    fprintf(stderr, "a full ring stored %llu and dropped %llu\n", (unsigned long long)stored, (unsigned long long)dropped);
+    return false;
+  }
+  AS::TraceRecorder::SetStoreCapacity(10);
+  AS::TraceRecorder::Reset();
+  AS::TraceRecorder::SetEnabled(true);
+  for (size_t i = 0; i < 15; i++) {
+    AS::TraceRecorder::Record(AS::TracePhase::Instant, name, i);
+  }
+  AS::TraceRecorder::SetEnabled(false);
+  AS::TraceRecorder::Flush();
+  const bool capped = AS::TraceRecorder::StoredCount() == 10 && AS::TraceRecorder::DroppedCount() == 5;
+  AS::TraceRecorder::SetStoreCapacity(1 << 20);
+  AS::TraceRecorder::Reset();
+  if (!capped || AS::TraceRecorder::StoredCount() != 0 || AS::TraceRecorder::DroppedCount() != 0) {
+    fprintf(stderr, "the store cap is not enforced\n");
+    return false;
+  }
+  return true;
+}
+
+// MARK: - Overhead
+
+__attribute__((noinline)) static void S_record(uint32_t name, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    AS::TraceRecorder::Record(AS::TracePhase::Instant, name, i);
+  }
+}
+
+__attribute__((noinline)) static uint64_t S_read_clock(size_t count) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += AS::TraceRecorder::Now();
+  }
+  return sum;
+}
+
+static double S_measure_clock() {
+  double best = 1e30;
+  volatile uint64_t sink = 0;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t count = 0;
+    const double start = S_now();
+    double elapsed = 0;
+    do {
+      sink += S_read_clock(10000);
+      count += 10000;
+      elapsed = S_now() - start;
+    } while (elapsed < min_time);
+    best = std::min(best, elapsed / count);
+  }
+  (void)sink;
+  return best;
+}
+
+static double S_measure(uint32_t name) {
+  // Fills at most half a ring between flushes, so no event is dropped.
+  const size_t batch = AS::TraceRing::kCapacity / 2;
+  double best = 1e30;
+  for (int trial = 0; trial < TRIALS; trial++) {
+    size_t count = 0;
+    double elapsed = 0;
+    do {
+      const double start = S_now();
+      S_record(name, batch);
+      elapsed += S_now() - start;
+      count += batch;
+      AS::TraceRecorder::Reset();
+    } while (elapsed < min_time);
+    best = std::min(best, elapsed / count);
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  size_t pairs = 20000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      min_time = 0.02;
+      pairs = 2000;
+    }
+  }
+
+  if (!S_check_threads(4, pairs) || !S_check_overflow()) {
+    return 1;
+  }
+
+  const uint32_t name = AS::TraceRecorder::Intern("Overhead");
+  AS::TraceRecorder::SetEnabled(false);
+  const double offSeconds = S_measure(name);
+  AS::TraceRecorder::SetEnabled(true);
+  const double onSeconds = S_measure(name);
+  AS::TraceRecorder::SetEnabled(false);
+  const double clockSeconds = S_measure_clock();
+  if (AS::TraceRecorder::DroppedCount() != 0) {
+    fprintf(stderr, "events were dropped while timing\n");
+    return 1;
+  }
+
+  printf("{\n  \"record_ns\": {\"tracing_off\": %.1f, \"tracing_on\": %.1f},\n"
+         "  \"clock_read_ns\": %.1f,\n  \"event_bytes\": %zu\n}\n",
+         offSeconds * 1e9, onSeconds * 1e9, clockSeconds * 1e9, sizeof(AS::TraceEvent));
+  return 0;
+}
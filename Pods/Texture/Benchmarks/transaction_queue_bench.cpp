@@ -0,0 +1,395 @@
+// Scheduling overhead and scaling of the _ASAsyncTransaction queue.
+//
+// Build and run from this directory (Linux or macOS):
+//
+//   c++ -std=c++11 -O2 -DNDEBUG -pthread -o transaction_queue_bench
+//       transaction_queue_bench.cpp
+//   ./transaction_queue_bench [--quick] > result.json
+//
+// Compares AS::WorkStealingExecutor with a copy of the queue it replaced: one
+// std::list of operations indexed by a std::map of priorities, all behind a
+// single mutex. Both are driven the way _ASAsyncTransaction drives them. One
+// thread schedules groups of operations at mixed priorities and every group
+// notifies on completion. Workers run on a fixed pool of threads standing in
+// for a libdispatch queue. Each workload runs with worker limits from 1 to 16.
+// Empty operations measure pure scheduling cost; spinning ones show scaling.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../Source/Private/ASWorkStealingExecutor.h"
+
+#define TRIALS 3
+
+static bool quick = false;
+
+static double S_now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void S_spin(int nanoseconds) {
+  if (nanoseconds <= 0) {
+    return;
+  }
+  double end = S_now() + nanoseconds * 1e-9;
+  while (S_now() < end) {
+  }
+}
+
+// MARK: - Dispatch queue stand-in
+
+// A concurrent queue over a fixed thread pool, like a global dispatch queue.
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned threads) : _busy(0), _stop(false) {
+    for (unsigned i = 0; i < threads; i++) {
+      _threads.emplace_back([this] { Loop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> l(_mutex);
+      _stop = true;
+    }
+    _condition.notify_all();
+    for (auto &t : _threads) {
+      t.join();
+    }
+  }
+
+  void Async(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> l(_mutex);
+      _jobs.push_back(std::move(job));
+    }
+    _condition.notify_one();
+  }
+
+  // Waits until every job has returned.
+  void Drain() {
+    std::unique_lock<std::mutex> l(_mutex);
+    _idle.wait(l, [this] { return _jobs.empty() && _busy == 0; });
+  }
+
+private:
+  void Loop() {
+    for (;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> l(_mutex);
+        _condition.wait(l, [this] { return _stop || !_jobs.empty(); });
+        if (_jobs.empty()) {
+          return;
+        }
+        job = std::move(_jobs.front());
+        _jobs.pop_front();
+        _busy++;
+      }
+      job();
+      job = nullptr;
+      {
+        std::lock_guard<std::mutex> l(_mutex);
+        if (--_busy == 0 && _jobs.empty()) {
+          _idle.notify_all();
+        }
+      }
+    }
+  }
+
+  std::vector<std::thread> _threads;
+  std::deque<std::function<void()>> _jobs;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  std::condition_variable _idle;
+  unsigned _busy;
+  bool _stop;
+};
+
+// MARK: - Previous design
+
+// The former ASAsyncTransactionQueue, with dispatch_async replaced by the pool
+// and the worker limit passed in.
+class LegacyQueue {
+public:
+  class Group {
+  public:
+    explicit Group(LegacyQueue &queue)
+        : _pendingOperations(0), _releaseCalled(false), _queue(queue) {}
+
+    void release() {
+      std::lock_guard<std::mutex> l(_queue._mutex);
+      if (_pendingOperations == 0) {
+        delete this;
+      } else {
+        _releaseCalled = true;
+      }
+    }
+
+    void schedule(long priority, std::function<void()> block);
+
+    void notify(std::function<void()> block) {
+      std::lock_guard<std::mutex> l(_queue._mutex);
+      if (_pendingOperations == 0) {
+        block();
+      } else {
+        _notifyList.push_back(std::move(block));
+      }
+    }
+
+    void leave() {
+      std::lock_guard<std::mutex> l(_queue._mutex);
+      --_pendingOperations;
+      if (_pendingOperations == 0) {
+        std::list<std::function<void()>> notifyList;
+        _notifyList.swap(notifyList);
+        for (auto &notify : notifyList) {
+          notify();
+        }
+        _condition.notify_one();
+        if (_releaseCalled) {
+          delete this;
+        }
+      }
+    }
+
+    int _pendingOperations;
+    std::list<std::function<void()>> _notifyList;
+    std::condition_variable _condition;
+    bool _releaseCalled;
+    LegacyQueue &_queue;
+  };
+
+  LegacyQueue(ThreadPool &pool, unsigned maxThreads)
+      : _pool(pool), _maxThreads(maxThreads), _threadCount(0) {}
+
+private:
+  struct Operation {
+    std::function<void()> _block;
+    Group *_group;
+    long _priority;
+  };
+
+  typedef std::list<Operation> OperationQueue;
+  typedef std::list<OperationQueue::iterator> OperationIteratorList;
+  typedef std::map<long, OperationIteratorList> OperationPriorityMap;
+
+  Operation popNextOperation(bool respectPriority) {
+    OperationQueue::iterator queueIterator;
+    OperationPriorityMap::iterator mapIterator;
+    if (respectPriority) {
+      mapIterator = --_operationPriorityMap.end();
+      queueIterator = *mapIterator->second.begin();
+    } else {
+      queueIterator = _operationQueue.begin();
+      mapIterator = _operationPriorityMap.find(queueIterator->_priority);
+    }
+    Operation res = *queueIterator;
+    _operationQueue.erase(queueIterator);
+    mapIterator->second.pop_front();
+    if (mapIterator->second.empty()) {
+      _operationPriorityMap.erase(mapIterator);
+    }
+    return res;
+  }
+
+  ThreadPool &_pool;
+  unsigned _maxThreads;
+  unsigned _threadCount;
+  OperationQueue _operationQueue;
+  OperationPriorityMap _operationPriorityMap;
+  std::mutex _mutex;
+};
+
+void LegacyQueue::Group::schedule(long priority, std::function<void()> block) {
+  LegacyQueue &q = _queue;
+  std::lock_guard<std::mutex> l(q._mutex);
+
+  q._operationQueue.push_back({std::move(block), this, priority});
+  q._operationPriorityMap[priority].push_back(--q._operationQueue.end());
+  ++_pendingOperations;
+
+  if (q._threadCount < q._maxThreads) {
+    bool respectPriority = q._threadCount > 0;
+    ++q._threadCount;
+    q._pool.Async([&q, respectPriority] {
+      std::unique_lock<std::mutex> lock(q._mutex);
+      while (!q._operationQueue.empty()) {
+        Operation operation = q.popNextOperation(respectPriority);
+        lock.unlock();
+        operation._block();
+        operation._group->leave();
+        operation._block = nullptr;
+        lock.lock();
+      }
+      --q._threadCount;
+    });
+  }
+}
+
+// MARK: - Executor
+
+class Operation : public AS::WorkItem {
+public:
+  explicit Operation(int work) : _work(work) {}
+  void Perform(bool canceled) override {
+    if (!canceled) {
+      S_spin(_work);
+    }
+  }
+
+private:
+  int _work;
+};
+
+// MARK: - Workloads
+
+struct workload {
+  const char *name;
+  int groups;
+  int operations; // per group
+  int work_ns;    // spin per operation
+};
+
+static const workload WORKLOADS[] = {
+    {"empty", 2000, 32, 0},
+    {"work_2us", 500, 32, 2000},
+    {"work_20us", 100, 32, 20000},
+};
+
+static const unsigned THREADS[] = {1, 2, 4, 8, 16};
+
+// The default, a higher and a lower drawing priority.
+static long S_priority(int i) { return (i % 3) - 1; }
+
+// Schedules every group from this thread and waits until all have notified.
+static double S_run_legacy(ThreadPool &pool, unsigned threads,
+                           const workload &w) {
+  LegacyQueue queue(pool, threads);
+  std::atomic<int> done(0);
+  std::mutex mutex;
+  std::condition_variable condition;
+  double start = S_now();
+
+  for (int g = 0; g < w.groups; g++) {
+    LegacyQueue::Group *group = new LegacyQueue::Group(queue);
+    for (int i = 0; i < w.operations; i++) {
+      int work = w.work_ns;
+      group->schedule(S_priority(i), [work] { S_spin(work); });
+    }
+    group->notify([&] {
+      if (done.fetch_add(1) + 1 == w.groups) {
+        std::lock_guard<std::mutex> l(mutex);
+        condition.notify_one();
+      }
+    });
+    group->release();
+  }
+
+  std::unique_lock<std::mutex> l(mutex);
+  condition.wait(l, [&] { return done.load() == w.groups; });
+  double elapsed = S_now() - start;
+  l.unlock();
+
+  // Let the last workers leave the queue before it is destroyed.
+  pool.Drain();
+  return elapsed;
+}
+
+static double S_run_executor(ThreadPool &pool, unsigned threads,
+                             const workload &w) {
+  AS::WorkStealingExecutor executor(threads, [&pool](AS::WorkStealingExecutor &e) {
+    pool.Async([&e] { e.RunWorker(); });
+  });
+  std::atomic<int> done(0);
+  std::mutex mutex;
+  std::condition_variable condition;
+  double start = S_now();
+
+  for (int g = 0; g < w.groups; g++) {
+    AS::WorkGroup *group = AS::WorkGroup::Create();
+    for (int i = 0; i < w.operations; i++) {
+      long priority = S_priority(i);
+      int lane = priority > 0 ? 0 : (priority == 0 ? 1 : 2);
+      group->Schedule(executor, new Operation(w.work_ns), lane, threads);
+    }
+    group->Notify([&] {
+      if (done.fetch_add(1) + 1 == w.groups) {
+        std::lock_guard<std::mutex> l(mutex);
+        condition.notify_one();
+      }
+    });
+    group->Release();
+  }
+
+  std::unique_lock<std::mutex> l(mutex);
+  condition.wait(l, [&] { return done.load() == w.groups; });
+  double elapsed = S_now() - start;
+  l.unlock();
+
+  pool.Drain();
+  return elapsed;
+}
+
+typedef double (*run_fn)(ThreadPool &pool, unsigned threads, const workload &w);
+
+// Best of TRIALS, in nanoseconds per operation.
+static double S_measure(run_fn fn, ThreadPool &pool, unsigned threads,
+                        const workload &w) {
+  workload scaled = w;
+  double best = 1e30;
+  if (quick) {
+    scaled.groups = std::max(1, w.groups / 10);
+  }
+  for (int trial = 0; trial < TRIALS; trial++) {
+    best = std::min(best, fn(pool, threads, scaled));
+  }
+  return best / (scaled.groups * scaled.operations) * 1e9;
+}
+
+int main(int argc, char **argv) {
+  const size_t workloads = sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+  const size_t counts = sizeof(THREADS) / sizeof(THREADS[0]);
+  ThreadPool pool(THREADS[counts - 1]);
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    }
+  }
+
+  printf("{\n  \"hardware_threads\": %u,\n  \"workloads\": [\n",
+         std::thread::hardware_concurrency());
+  for (size_t w = 0; w < workloads; w++) {
+    printf("    {\n      \"name\": \"%s\",\n      \"groups\": %d,\n"
+           "      \"operations_per_group\": %d,\n      \"work_ns\": %d,\n"
+           "      \"points\": [\n",
+           WORKLOADS[w].name, WORKLOADS[w].groups, WORKLOADS[w].operations,
+           WORKLOADS[w].work_ns);
+    for (size_t t = 0; t < counts; t++) {
+      double legacy = S_measure(S_run_legacy, pool, THREADS[t], WORKLOADS[w]);
+      double stealing =
+          S_measure(S_run_executor, pool, THREADS[t], WORKLOADS[w]);
+      printf("        {\"threads\": %u, \"legacy_ns_per_op\": %.1f, "
+             "\"work_stealing_ns_per_op\": %.1f, \"speedup\": %.2f}%s\n",
+             THREADS[t], legacy, stealing, legacy / stealing,
+             t + 1 == counts ? "" : ",");
+    }
+    printf("      ]\n    }%s\n", w + 1 == workloads ? "" : ",");
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -587,6 +587,18 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (nullable id)collectionNode:(ASCollectionNode *)collectionNode nodeModelForItemAtIndexPath:(NSIndexPath *)indexPath;
 
+/**
+ * Asks the data source how expensive the node for the item is to allocate and lay out, relative to the other items,
+ * such as the length of its text. Nodes are prepared in the background most expensive first, so a long one doesn't
+ * start last and hold up the batch.
+ *
+ * @param collectionNode The sender.
+ * @param indexPath The index path of the item.
+ *
+ * @return A relative cost, or 0 if unknown. Items without a cost go after those with one.
+ */
+- (CGFloat)collectionNode:(ASCollectionNode *)collectionNode layoutCostHintForItemAtIndexPath:(NSIndexPath *)indexPath;
+
 /**
  * Similar to -collectionNode:nodeForItemAtIndexPath:
  * This method takes precedence over collectionNode:nodeForItemAtIndexPath: if implemented.
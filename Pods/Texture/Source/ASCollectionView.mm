@@ -213,6 +213,7 @@ static NSString * const kReuseIdentifier = @"_ASCollectionReuseIdentifier";
     unsigned int collectionNodeNodeForItem:1;
     unsigned int collectionNodeNodeBlockForItem:1;
     unsigned int nodeModelForItem:1;
+    unsigned int collectionNodeLayoutCostHintForItem:1;
     unsigned int collectionNodeNodeForSupplementaryElement:1;
     unsigned int collectionNodeNodeBlockForSupplementaryElement:1;
     unsigned int collectionNodeSupplementaryElementKindsInSection:1;
@@ -464,6 +465,7 @@ static NSString * const kReuseIdentifier = @"_ASCollectionReuseIdentifier";
     _asyncDataSourceFlags.collectionNodeNodeBlockForSupplementaryElement = [_asyncDataSource respondsToSelector:@selector(collectionNode:nodeBlockForSupplementaryElementOfKind:atIndexPath:)];
     _asyncDataSourceFlags.collectionNodeSupplementaryElementKindsInSection = [_asyncDataSource respondsToSelector:@selector(collectionNode:supplementaryElementKindsInSection:)];
     _asyncDataSourceFlags.nodeModelForItem = [_asyncDataSource respondsToSelector:@selector(collectionNode:nodeModelForItemAtIndexPath:)];
+    _asyncDataSourceFlags.collectionNodeLayoutCostHintForItem = [_asyncDataSource respondsToSelector:@selector(collectionNode:layoutCostHintForItemAtIndexPath:)];
     _asyncDataSourceFlags.collectionNodeCanMoveItem = [_asyncDataSource respondsToSelector:@selector(collectionNode:canMoveItemWithNode:)];
     _asyncDataSourceFlags.collectionNodeMoveItem = [_asyncDataSource respondsToSelector:@selector(collectionNode:moveItemAtIndexPath:toIndexPath:)];
 
@@ -1937,6 +1939,16 @@ static NSString * const kReuseIdentifier = @"_ASCollectionReuseIdentifier";
   return [_asyncDataSource collectionNode:collectionNode nodeModelForItemAtIndexPath:indexPath];
 }
 
+- (CGFloat)dataController:(ASDataController *)dataController layoutCostHintForNodeOfKind:(NSString *)kind atIndexPath:(NSIndexPath *)indexPath
+{
+  if (!_asyncDataSourceFlags.collectionNodeLayoutCostHintForItem || ![kind isEqualToString:ASDataControllerRowNodeKind]) {
+    return 0;
+  }
+
+  GET_COLLECTIONNODE_OR_RETURN(collectionNode, 0);
+  return [_asyncDataSource collectionNode:collectionNode layoutCostHintForItemAtIndexPath:indexPath];
+}
+
 - (ASCellNodeBlock)dataController:(ASDataController *)dataController nodeBlockAtIndexPath:(NSIndexPath *)indexPath shouldAsyncLayout:(BOOL *)shouldAsyncLayout
 {
   ASDisplayNodeAssertMainThread();
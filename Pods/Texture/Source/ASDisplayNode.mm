@@ -32,6 +32,7 @@
 #import <AsyncDisplayKit/ASNodeController+Beta.h>
 #import <AsyncDisplayKit/ASRunLoopQueue.h>
 #import <AsyncDisplayKit/ASSignpost.h>
+#import <AsyncDisplayKit/ASTrace.h>
 #import <AsyncDisplayKit/ASWeakProxy.h>
 #import <AsyncDisplayKit/ASResponderChainEnumerator.h>
 
@@ -1071,6 +1072,11 @@ ASSynthesizeLockingMethodsWithMutex(__instanceLock__);
     ASSignpostStart(CalculateLayout, self, "%@", ASObjectDescriptionMakeTiny(self));
   }
 #endif
+  // Likewise one trace slice per outermost layout pass, tagged with the node.
+  static _Thread_local NSInteger tls_traceDepth;
+  if (tls_traceDepth++ == 0) {
+    ASTraceBegin("Calculate layout", (uintptr_t)self);
+  }
 
   ASSizeRange styleAndParentSize = ASLayoutElementSizeResolve(self.style.size, parentSize);
   const ASSizeRange resolvedRange = ASSizeRangeIntersect(constrainedSize, styleAndParentSize);
@@ -1082,6 +1088,9 @@ ASSynthesizeLockingMethodsWithMutex(__instanceLock__);
     ASSignpostEnd(CalculateLayout, self, "");
   }
 #endif
+  if (--tls_traceDepth == 0) {
+    ASTraceEnd("Calculate layout", (uintptr_t)self);
+  }
   
   return result;
 }
@@ -1302,6 +1311,8 @@ NSString * const ASRenderingEngineDidDisplayNodesScheduledBeforeTimestamp = @"AS
                                                           userInfo:@{ASRenderingEngineDidDisplayNodesScheduledBeforeTimestamp: @(timestamp)}];
       }
     }];
+    // Trigger as many displays as fit in 2ms of each frame rather than one per run loop pass.
+    renderQueue.frameBudget = 0.002;
   });
 
   as_log_verbose(ASDisplayLog(), "%s %@", sel_getName(_cmd), node);
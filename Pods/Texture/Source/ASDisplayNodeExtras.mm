@@ -23,7 +23,8 @@ void ASPerformMainThreadDeallocation(id _Nullable __strong * _Nonnull objectPtr)
   static dispatch_once_t onceToken;
   dispatch_once(&onceToken, ^{
     queue = [[ASRunLoopQueue alloc] initWithRunLoop:CFRunLoopGetMain() retainObjects:YES handler:nil];
-    queue.batchSize = 10;
+    // Release for up to 2ms of each frame, or 0.5ms while scrolling, rather than a fixed count.
+    queue.frameBudget = 0.002;
   });
 
   if (objectPtr != NULL && *objectPtr != nil) {
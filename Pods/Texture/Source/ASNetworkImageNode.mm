@@ -41,6 +41,11 @@
   CGFloat _renderedImageQuality;
   CGFloat _downloadProgress;
 
+  // The URL the cache was told entered the display range, and the image loaded for it while the cache's
+  // decoded one is shown.
+  NSURL *_displayURL;
+  UIImage *_undecodedImage;
+
     // Immutable and set on init only. We don't need to lock in this case.
   __weak id<ASImageDownloaderProtocol> _downloader;
 
@@ -68,6 +73,7 @@
 
       unsigned int cacheSupportsClearing:1;
       unsigned int cacheSupportsSynchronousFetch:1;
+      unsigned int cacheSupportsDisplayTracking:1;
 
       unsigned int imageLoaded:1;
       unsigned int imageWasSetExternally:1;
@@ -100,6 +106,8 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
 
   _networkImageNodeFlags.cacheSupportsClearing = [cache respondsToSelector:@selector(clearFetchedImageFromCacheWithURL:)];
   _networkImageNodeFlags.cacheSupportsSynchronousFetch = [cache respondsToSelector:@selector(synchronouslyFetchedCachedImageWithURL:)];
+  _networkImageNodeFlags.cacheSupportsDisplayTracking = [cache respondsToSelector:@selector(imageWillEnterDisplayWithURL:targetPixelSize:callbackQueue:completion:)]
+                                                        && [cache respondsToSelector:@selector(imageDidExitDisplayWithURL:)];
   
   _networkImageNodeFlags.shouldCacheImage = YES;
   _networkImageNodeFlags.shouldRenderProgressImages = YES;
@@ -121,6 +129,10 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
 - (void)dealloc
 {
   [self _cancelImageDownloadWithResumePossibility:NO];
+  {
+    ASLockScopeSelf();
+    [self _locked_exitDisplayOnCacheRestoringImage:NO];
+  }
 }
 
 - (dispatch_queue_t)callbackQueue
@@ -205,6 +217,7 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
     _networkImageNodeFlags.imageWasSetExternally = NO;
     
     [self _locked_cancelImageDownloadWithResumePossibility:NO];
+    [self _locked_exitDisplayOnCacheRestoringImage:NO];
     
     [self _setDownloadProgress:0.0];
     
@@ -396,6 +409,7 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
         [self _setDownloadProgress:1.0];
         [self _locked__setImage:result];
         _networkImageNodeFlags.imageLoaded = YES;
+        [self _locked_enterDisplayOnCacheIfNeeded];
         
         // Call out to the delegate.
         if (_networkImageNodeFlags.delegateDidLoadImageWithInfo) {
@@ -431,10 +445,19 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
   [self _updateProgressImageBlockOnDownloaderIfNeeded];
 }
 
+- (void)didEnterDisplayState
+{
+  [super didEnterDisplayState];
+  ASLockScopeSelf();
+  [self _locked_enterDisplayOnCacheIfNeeded];
+}
+
 - (void)didExitDisplayState
 {
   [super didExitDisplayState];
   [self _updatePriorityOnDownloaderIfNeeded];
+  ASLockScopeSelf();
+  [self _locked_exitDisplayOnCacheRestoringImage:YES];
 }
 
 - (void)didExitPreloadState
@@ -467,6 +490,87 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
   return _useMainThreadDelegateCallbacks;
 }
 
+#pragma mark - Display range
+
+/// Tells the cache this image is near the screen, so it can keep a bitmap decoded at the size drawn at, and shows that
+/// instead of the loaded image, which would otherwise be decoded at full size on every draw.
+- (void)_locked_enterDisplayOnCacheIfNeeded
+{
+  DISABLED_ASAssertLocked(__instanceLock__);
+
+  if (_networkImageNodeFlags.cacheSupportsDisplayTracking == NO || _displayURL != nil) {
+    return;
+  }
+  UIImage *image = self.image;
+  if (_networkImageNodeFlags.imageLoaded == NO || image == nil || _URL == nil || _URL.isFileURL
+      || ASInterfaceStateIncludesDisplay(_interfaceState) == NO) {
+    return;
+  }
+
+  CGSize boundsSize = [self _locked_threadSafeBounds].size;
+  CGSize imageSize = CGSizeMake(image.size.width * image.scale, image.size.height * image.scale);
+  if (boundsSize.width <= 0 || boundsSize.height <= 0 || imageSize.width <= 0 || imageSize.height <= 0) {
+    return;
+  }
+  CGFloat widthScale = boundsSize.width * ASScreenScale() / imageSize.width;
+  CGFloat heightScale = boundsSize.height * ASScreenScale() / imageSize.height;
+  CGFloat scale;
+  switch (self.contentMode) {
+    case UIViewContentModeScaleAspectFit:
+      scale = MIN(widthScale, heightScale);
+      break;
+    case UIViewContentModeScaleAspectFill:
+    case UIViewContentModeScaleToFill:
+      scale = MAX(widthScale, heightScale);
+      break;
+    default:
+      // Drawn at its own size.
+      return;
+  }
+  if (scale >= 1) {
+    return;
+  }
+
+  NSURL *URL = _URL;
+  _displayURL = URL;
+  __weak __typeof__(self) weakSelf = self;
+  [_cache imageWillEnterDisplayWithURL:URL
+                       targetPixelSize:CGSizeMake(ceil(imageSize.width * scale), ceil(imageSize.height * scale))
+                         callbackQueue:[self callbackQueue]
+                            completion:^(UIImage * _Nullable displayImage) {
+    __typeof__(self) strongSelf = weakSelf;
+    if (strongSelf == nil || displayImage == nil) {
+      return;
+    }
+    ASLockScope(strongSelf);
+    // Still showing what was decoded.
+    if (ASObjectIsEqual(strongSelf->_displayURL, URL) && strongSelf->_undecodedImage == nil && strongSelf.image == image) {
+      strongSelf->_undecodedImage = image;
+      [strongSelf _locked__setImage:displayImage];
+    }
+  }];
+}
+
+/// Balances _locked_enterDisplayOnCacheIfNeeded, showing the loaded image again if asked to, so the cache may drop
+/// its bitmap.
+- (void)_locked_exitDisplayOnCacheRestoringImage:(BOOL)restoreImage
+{
+  DISABLED_ASAssertLocked(__instanceLock__);
+
+  if (_displayURL == nil) {
+    return;
+  }
+  NSURL *URL = _displayURL;
+  _displayURL = nil;
+  if (_undecodedImage != nil) {
+    if (restoreImage) {
+      [self _locked__setImage:_undecodedImage];
+    }
+    _undecodedImage = nil;
+  }
+  [_cache imageDidExitDisplayWithURL:URL];
+}
+
 #pragma mark - Progress
 
 - (void)_updateDownloadedProgress:(CGFloat)progress
@@ -573,6 +677,7 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
   DISABLED_ASAssertLocked(__instanceLock__);
   
   [self _locked_cancelImageDownloadWithResumePossibility:storeResume];
+  [self _locked_exitDisplayOnCacheRestoringImage:NO];
   
   [self _locked_setAnimatedImage:nil];
   [self _setCurrentImageQuality:0.0];
@@ -825,6 +930,7 @@ static std::atomic_bool _useMainThreadDelegateCallbacks(true);
               [strongSelf _locked__setImage:newImage];
             }
             strongSelf->_networkImageNodeFlags.imageLoaded = YES;
+            [strongSelf _locked_enterDisplayOnCacheIfNeeded];
           }
           
           strongSelf->_downloadIdentifier = nil;
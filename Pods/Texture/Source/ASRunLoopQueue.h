@@ -45,6 +45,20 @@ AS_SUBCLASSING_RESTRICTED
 @property (nonatomic) NSUInteger batchSize;           // Default == 1.
 @property (nonatomic) BOOL ensureExclusiveMembership; // Default == YES.  Set-like behavior.
 
+/**
+ * When positive, the run loop passes of each 60Hz frame together process items until about
+ * this much time has been spent, going by a moving average of the time per item, instead of
+ * batchSize items per pass. Once a frame's budget is spent, the rest waits for the next frame.
+ * At least one item is processed per frame. Default == 0, which uses batchSize.
+ */
+@property (nonatomic) CFTimeInterval frameBudget;
+
+/**
+ * The budget while the run loop tracks a touch, e.g. while the user scrolls.
+ * Default == 0, which means a quarter of frameBudget.
+ */
+@property (nonatomic) CFTimeInterval scrollingFrameBudget;
+
 @end
 
 
@@ -9,10 +9,14 @@
 
 #import <AsyncDisplayKit/ASAvailability.h>
 #import <AsyncDisplayKit/ASConfigurationInternal.h>
+#import <AsyncDisplayKit/ASFrameBudget.h>
 #import <AsyncDisplayKit/ASLog.h>
+#import <AsyncDisplayKit/ASRingQueue.h>
 #import <AsyncDisplayKit/ASRunLoopQueue.h>
 #import <AsyncDisplayKit/ASThread.h>
 #import <AsyncDisplayKit/ASSignpost.h>
+#import <QuartzCore/QuartzCore.h>
+#import <UIKit/UIKit.h>
 #import <vector>
 
 #define ASRunLoopQueueLoggingEnabled 0
@@ -27,6 +31,47 @@ static void runLoopSourceCallback(void *info) {
 #endif
 }
 
+/// Far enough off that a timer set to it never fires.
+static const CFTimeInterval kASRunLoopQueueNeverInterval = 1.0e10;
+
+/// Whether the run loop is tracking a touch, e.g. a scroll, and frames matter most.
+static BOOL ASRunLoopIsTracking(CFRunLoopRef runLoop)
+{
+  CFRunLoopMode mode = CFRunLoopCopyCurrentMode(runLoop);
+  if (mode == NULL) {
+    return NO;
+  }
+  BOOL tracking = CFEqual(mode, (__bridge CFStringRef)UITrackingRunLoopMode);
+  CFRelease(mode);
+  return tracking;
+}
+
+template <typename Queue>
+static BOOL ASRunLoopQueueContains(Queue &queue, id object)
+{
+  for (size_t i = 0; i < queue.Size(); i++) {
+    if (queue[i] == object) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+/// Moves up to `count` live items from the front of `queue` to `items`. Weak items that have gone away are dropped.
+template <typename Queue>
+static void ASRunLoopQueueDequeue(Queue &queue, size_t count, std::vector<id> &items)
+{
+  size_t found = 0;
+  while (found < count && !queue.IsEmpty()) {
+    id item = std::move(queue.Front());
+    queue.PopFront();
+    if (item != nil) {
+      items.push_back(std::move(item));
+      found++;
+    }
+  }
+}
+
 @implementation ASAbstractRunLoopQueue
 
 - (instancetype)init
@@ -47,9 +92,17 @@ static void runLoopSourceCallback(void *info) {
   CFRunLoopRef _runLoop;
   CFRunLoopSourceRef _runLoopSource;
   CFRunLoopObserverRef _runLoopObserver;
-  NSPointerArray *_internalQueue; // Use NSPointerArray so we can decide __strong or __weak per-instance.
+  // Fires at the start of the next frame once a budgeted frame is spent, and at no other time.
+  CFRunLoopTimerRef _nextFrameTimer;
+  // Only the one matching _retainsObjects is used, so we can decide __strong or __weak per-instance.
+  AS::RingQueue<id> _strongQueue;
+  AS::RingQueue<__weak id> _weakQueue;
+  BOOL _retainsObjects;
   AS::RecursiveMutex _internalQueueLock;
 
+  // Touched only while processing, apart from the budgets, which change under the lock.
+  AS::FrameBudget _frameBudgetScheduler;
+
   // In order to not pollute the top-level activities, each queue has 1 root activity.
   os_activity_t _rootActivity;
 
@@ -68,8 +121,7 @@ static void runLoopSourceCallback(void *info) {
 {
   if (self = [super init]) {
     _runLoop = runloop;
-    NSPointerFunctionsOptions options = retainsObjects ? NSPointerFunctionsStrongMemory : NSPointerFunctionsWeakMemory;
-    _internalQueue = [[NSPointerArray alloc] initWithOptions:options];
+    _retainsObjects = retainsObjects;
     _queueConsumer = handlerBlock;
     _batchSize = 1;
     _ensureExclusiveMembership = YES;
@@ -102,6 +154,12 @@ static void runLoopSourceCallback(void *info) {
     _runLoopSource = CFRunLoopSourceCreate(NULL, 0, &sourceContext);
     CFRunLoopAddSource(runloop, _runLoopSource, kCFRunLoopCommonModes);
 
+    // Repeats so that it stays valid after firing; every fire date is set by hand.
+    _nextFrameTimer = CFRunLoopTimerCreateWithHandler(NULL, CFAbsoluteTimeGetCurrent() + kASRunLoopQueueNeverInterval, kASRunLoopQueueNeverInterval, 0, 0, ^(CFRunLoopTimerRef timer) {
+      [weakSelf processQueue];
+    });
+    CFRunLoopAddTimer(runloop, _nextFrameTimer, kCFRunLoopCommonModes);
+
 #if ASRunLoopQueueLoggingEnabled
     _runloopQueueLoggingTimer = [NSTimer timerWithTimeInterval:1.0 target:self selector:@selector(checkRunLoop) userInfo:nil repeats:YES];
     [[NSRunLoop mainRunLoop] addTimer:_runloopQueueLoggingTimer forMode:NSRunLoopCommonModes];
@@ -123,92 +181,135 @@ static void runLoopSourceCallback(void *info) {
   }
   CFRelease(_runLoopObserver);
   _runLoopObserver = nil;
+
+  CFRunLoopTimerInvalidate(_nextFrameTimer);
+  CFRelease(_nextFrameTimer);
+  _nextFrameTimer = nil;
 }
 
 #if ASRunLoopQueueLoggingEnabled
 - (void)checkRunLoop
 {
-    NSLog(@"<%@> - Jobs: %ld", self, _internalQueue.count);
+    NSLog(@"<%@> - Jobs: %ld", self, (long)[self _locked_count]);
 }
 #endif
 
-- (void)processQueue
+- (size_t)_locked_count
 {
-  BOOL hasExecutionBlock = (_queueConsumer != nil);
+  return _retainsObjects ? _strongQueue.Size() : _weakQueue.Size();
+}
 
-  // If we have an execution block, this vector will be populated, otherwise remains empty.
-  // This is to avoid needlessly retaining/releasing the objects if we don't have a block.
-  std::vector<id> itemsToProcess;
+- (void)setFrameBudget:(CFTimeInterval)frameBudget
+{
+  MutexLocker l(_internalQueueLock);
+  _frameBudget = frameBudget;
+  [self _locked_updateFrameBudgetScheduler];
+}
 
-  BOOL isQueueDrained = NO;
+- (void)setScrollingFrameBudget:(CFTimeInterval)scrollingFrameBudget
+{
+  MutexLocker l(_internalQueueLock);
+  _scrollingFrameBudget = scrollingFrameBudget;
+  [self _locked_updateFrameBudgetScheduler];
+}
+
+- (void)_locked_updateFrameBudgetScheduler
+{
+  CFTimeInterval scrollingFrameBudget = _scrollingFrameBudget > 0 ? _scrollingFrameBudget : _frameBudget / 4;
+  _frameBudgetScheduler.SetBudgets(_frameBudget, scrollingFrameBudget);
+}
+
+- (void)processQueue
+{
+  BOOL hasExecutionBlock = (_queueConsumer != nil);
+  BOOL budgeted = NO;
   {
     MutexLocker l(_internalQueueLock);
-
-    NSInteger internalQueueCount = _internalQueue.count;
     // Early-exit if the queue is empty.
-    if (internalQueueCount == 0) {
+    if ([self _locked_count] == 0) {
       return;
     }
-
-    ASSignpostStart(RunLoopQueueBatch, self, "%s", object_getClassName(self));
-
-    // Snatch the next batch of items.
-    NSInteger maxCountToProcess = MIN(internalQueueCount, self.batchSize);
-
-    /**
-     * For each item in the next batch, if it's non-nil then NULL it out
-     * and if we have an execution block then add it in.
-     * This could be written a bunch of different ways but
-     * this particular one nicely balances readability, safety, and efficiency.
-     */
-    NSInteger foundItemCount = 0;
-    for (NSInteger i = 0; i < internalQueueCount && foundItemCount < maxCountToProcess; i++) {
-      /**
-       * It is safe to use unsafe_unretained here. If the queue is weak, the
-       * object will be added to the autorelease pool. If the queue is strong,
-       * it will retain the object until we transfer it (retain it) in itemsToProcess.
-       */
-      unowned id ptr = (__bridge id)[_internalQueue pointerAtIndex:i];
-      if (ptr != nil) {
-        foundItemCount++;
-        if (hasExecutionBlock) {
-          itemsToProcess.push_back(ptr);
-        }
-        [_internalQueue replacePointerAtIndex:i withPointer:NULL];
-      }
+    budgeted = _frameBudgetScheduler.IsEnabled();
+    if (budgeted && !_frameBudgetScheduler.BeginPass(CACurrentMediaTime(), ASRunLoopIsTracking(_runLoop))) {
+      // This frame's budget is spent, however many times the run loop turns before the next one.
+      [self _locked_processAtNextFrame];
+      return;
     }
+  }
 
-    if (foundItemCount == 0) {
-      // If _internalQueue holds weak references, and all of them just become NULL, then the array
-      // is never marked as needsCompletion, and compact will return early, not removing the NULL's.
-      // Inserting a NULL here ensures the compaction will take place.
-      // See http://www.openradar.me/15396578 and https://stackoverflow.com/a/40274426/1136669
-      [_internalQueue addPointer:NULL];
-    }
+  ASSignpostStart(RunLoopQueueBatch, self, "%s", object_getClassName(self));
+  as_activity_scope_verbose(as_activity_create("Process run loop queue batch", _rootActivity, OS_ACTIVITY_FLAG_DEFAULT));
 
-    [_internalQueue compact];
-    if (_internalQueue.count == 0) {
-      isQueueDrained = YES;
+  // Items are moved out under the lock, then processed and released after it.
+  std::vector<id> itemsToProcess;
+  size_t count = 0;
+  BOOL isQueueDrained = NO;
+  do {
+    {
+      MutexLocker l(_internalQueueLock);
+      const size_t available = [self _locked_count];
+      const size_t batchCount = budgeted ? _frameBudgetScheduler.NextBatchSize(CACurrentMediaTime(), available) : MIN(available, (size_t)self.batchSize);
+      if (batchCount == 0) {
+        break;
+      }
+      if (_retainsObjects) {
+        ASRunLoopQueueDequeue(_strongQueue, batchCount, itemsToProcess);
+      } else {
+        ASRunLoopQueueDequeue(_weakQueue, batchCount, itemsToProcess);
+      }
+      isQueueDrained = ([self _locked_count] == 0);
     }
-  }
 
-  // itemsToProcess will be empty if _queueConsumer == nil so no need to check again.
-  const auto count = itemsToProcess.size();
-  if (count > 0) {
-    as_activity_scope_verbose(as_activity_create("Process run loop queue batch", _rootActivity, OS_ACTIVITY_FLAG_DEFAULT));
-    const auto itemsEnd = itemsToProcess.cend();
-    for (auto iterator = itemsToProcess.begin(); iterator < itemsEnd; iterator++) {
-      unowned id value = *iterator;
-      _queueConsumer(value, isQueueDrained && iterator == itemsEnd - 1);
-      as_log_verbose(ASDisplayLog(), "processed %@", value);
+    const CFTimeInterval batchStart = budgeted ? CACurrentMediaTime() : 0;
+    const size_t batchCount = itemsToProcess.size();
+    size_t processedCount = 0;
+    while (processedCount < batchCount) {
+      id &item = itemsToProcess[processedCount];
+      if (hasExecutionBlock) {
+        _queueConsumer(item, isQueueDrained && processedCount == batchCount - 1);
+        as_log_verbose(ASDisplayLog(), "processed %@", item);
+      }
+      // Release now, so that with a budget the time measured includes deallocation, which may be all the work.
+      item = nil;
+      processedCount++;
+      if (budgeted && !_frameBudgetScheduler.HasTimeLeft(CACurrentMediaTime())) {
+        break;
+      }
     }
-    if (count > 1) {
-      as_log_verbose(ASDisplayLog(), "processed %lu items", (unsigned long)count);
+    count += processedCount;
+
+    if (budgeted) {
+      MutexLocker l(_internalQueueLock);
+      _frameBudgetScheduler.DidProcess(processedCount, CACurrentMediaTime() - batchStart);
+      // Hand back what the budget did not cover, in order, ahead of anything enqueued meanwhile.
+      for (size_t i = batchCount; i > processedCount; i--) {
+        id item = std::move(itemsToProcess[i - 1]);
+        if (_retainsObjects) {
+          if (!_ensureExclusiveMembership || !ASRunLoopQueueContains(_strongQueue, item)) {
+            _strongQueue.PushFront(std::move(item));
+          }
+        } else if (!_ensureExclusiveMembership || !ASRunLoopQueueContains(_weakQueue, item)) {
+          _weakQueue.PushFront(std::move(item));
+        }
+        isQueueDrained = NO;
+      }
     }
+    itemsToProcess.clear();
+  } while (budgeted && !isQueueDrained);
+
+  if (count > 1) {
+    as_log_verbose(ASDisplayLog(), "processed %lu items", (unsigned long)count);
   }
 
-  // If the queue is not fully drained yet force another run loop to process next batch of items
-  if (!isQueueDrained) {
+  if (budgeted) {
+    MutexLocker l(_internalQueueLock);
+    _frameBudgetScheduler.EndPass(CACurrentMediaTime());
+    // Budgeted passes only stop short of draining once the frame's budget is spent.
+    if (!isQueueDrained) {
+      [self _locked_processAtNextFrame];
+    }
+  } else if (!isQueueDrained) {
+    // If the queue is not fully drained yet force another run loop to process next batch of items
     CFRunLoopSourceSignal(_runLoopSource);
     CFRunLoopWakeUp(_runLoop);
   }
@@ -216,6 +317,13 @@ static void runLoopSourceCallback(void *info) {
   ASSignpostEnd(RunLoopQueueBatch, self, "count: %d", (int)count);
 }
 
+- (void)_locked_processAtNextFrame
+{
+  // CACurrentMediaTime and CFAbsoluteTimeGetCurrent differ in origin, not in rate, over a frame.
+  const CFTimeInterval delay = MAX(_frameBudgetScheduler.NextFrameStart() - CACurrentMediaTime(), 0);
+  CFRunLoopTimerSetNextFireDate(_nextFrameTimer, CFAbsoluteTimeGetCurrent() + delay);
+}
+
 - (void)enqueue:(id)object
 {
   if (!object) {
@@ -225,30 +333,28 @@ static void runLoopSourceCallback(void *info) {
   MutexLocker l(_internalQueueLock);
 
   // Check if the object exists.
-  BOOL foundObject = NO;
-    
   if (_ensureExclusiveMembership) {
-    for (id currentObject in _internalQueue) {
-      if (currentObject == object) {
-        foundObject = YES;
-        break;
-      }
+    BOOL foundObject = _retainsObjects ? ASRunLoopQueueContains(_strongQueue, object) : ASRunLoopQueueContains(_weakQueue, object);
+    if (foundObject) {
+      return;
     }
   }
 
-  if (!foundObject) {
-    [_internalQueue addPointer:(__bridge void *)object];
-    if (_internalQueue.count == 1) {
-      CFRunLoopSourceSignal(_runLoopSource);
-      CFRunLoopWakeUp(_runLoop);
-    }
+  if (_retainsObjects) {
+    _strongQueue.PushBack(object);
+  } else {
+    _weakQueue.PushBack(object);
+  }
+  if ([self _locked_count] == 1) {
+    CFRunLoopSourceSignal(_runLoopSource);
+    CFRunLoopWakeUp(_runLoop);
   }
 }
 
 - (BOOL)isEmpty
 {
   MutexLocker l(_internalQueueLock);
-  return _internalQueue.count == 0;
+  return [self _locked_count] == 0;
 }
 
 ASSynthesizeLockingMethodsWithMutex(_internalQueueLock)
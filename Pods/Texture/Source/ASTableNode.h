@@ -530,6 +530,18 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (ASCellNode *)tableNode:(ASTableNode *)tableNode nodeForRowAtIndexPath:(NSIndexPath *)indexPath;
 
+/**
+ * Asks the data source how expensive the node for the row is to allocate and lay out, relative to the other rows,
+ * such as the length of its text. Nodes are prepared in the background most expensive first, so a long one doesn't
+ * start last and hold up the batch.
+ *
+ * @param tableNode The sender.
+ * @param indexPath The index path of the row.
+ *
+ * @return A relative cost, or 0 if unknown. Rows without a cost go after those with one.
+ */
+- (CGFloat)tableNode:(ASTableNode *)tableNode layoutCostHintForRowAtIndexPath:(NSIndexPath *)indexPath;
+
 /**
  * Similar to -tableView:cellForRowAtIndexPath:.
  *
@@ -273,6 +273,7 @@ static NSString * const kCellReuseIdentifier = @"_ASTableViewCell";
     unsigned int tableNodeCanMoveRow:1;
     unsigned int tableViewMoveRow:1;
     unsigned int tableNodeMoveRow:1;
+    unsigned int tableNodeLayoutCostHintForRow:1;
     unsigned int sectionIndexMethods:1; // if both section index methods are implemented
     unsigned int modelIdentifierMethods:1; // if both modelIdentifierForElementAtIndexPath and indexPathForElementWithModelIdentifier are implemented
   } _asyncDataSourceFlags;
@@ -424,6 +425,7 @@ static NSString * const kCellReuseIdentifier = @"_ASTableViewCell";
     _asyncDataSourceFlags.tableNodeNodeBlockForRow = [_asyncDataSource respondsToSelector:@selector(tableNode:nodeBlockForRowAtIndexPath:)];
     _asyncDataSourceFlags.tableViewCanMoveRow = [_asyncDataSource respondsToSelector:@selector(tableView:canMoveRowAtIndexPath:)];
     _asyncDataSourceFlags.tableViewMoveRow = [_asyncDataSource respondsToSelector:@selector(tableView:moveRowAtIndexPath:toIndexPath:)];
+    _asyncDataSourceFlags.tableNodeLayoutCostHintForRow = [_asyncDataSource respondsToSelector:@selector(tableNode:layoutCostHintForRowAtIndexPath:)];
     _asyncDataSourceFlags.sectionIndexMethods = [_asyncDataSource respondsToSelector:@selector(sectionIndexTitlesForTableView:)] && [_asyncDataSource respondsToSelector:@selector(tableView:sectionForSectionIndexTitle:atIndex:)];
     _asyncDataSourceFlags.modelIdentifierMethods = [_asyncDataSource respondsToSelector:@selector(modelIdentifierForElementAtIndexPath:inNode:)] && [_asyncDataSource respondsToSelector:@selector(indexPathForElementWithModelIdentifier:inNode:)];
     
@@ -1735,6 +1737,16 @@ static NSString * const kCellReuseIdentifier = @"_ASTableViewCell";
   return nil;
 }
 
+- (CGFloat)dataController:(ASDataController *)dataController layoutCostHintForNodeOfKind:(NSString *)kind atIndexPath:(NSIndexPath *)indexPath
+{
+  if (!_asyncDataSourceFlags.tableNodeLayoutCostHintForRow || ![kind isEqualToString:ASDataControllerRowNodeKind]) {
+    return 0;
+  }
+
+  GET_TABLENODE_OR_RETURN(tableNode, 0);
+  return [_asyncDataSource tableNode:tableNode layoutCostHintForRowAtIndexPath:indexPath];
+}
+
 - (ASCellNodeBlock)dataController:(ASDataController *)dataController nodeBlockAtIndexPath:(NSIndexPath *)indexPath shouldAsyncLayout:(BOOL *)shouldAsyncLayout
 {
   ASCellNodeBlock block = nil;
@@ -14,6 +14,19 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+/**
+ @abstract Counters of the text layout cache that all text nodes share.
+ @discussion Lookups that find no compatible layout count as misses. Sizes are estimates.
+ */
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  NSUInteger entryCount;
+  NSUInteger bytes;
+  NSUInteger capacityBytes;
+} ASTextNodeLayoutCacheStatistics;
+
 /**
  @abstract Draws interactive rich text.
  @discussion Backed by the code in TextExperiment folder, on top of CoreText.
@@ -228,6 +241,11 @@ NS_ASSUME_NONNULL_BEGIN
 
 + (void)enableDebugging;
 
+/**
+ @abstract Counters of the shared text layout cache, for profiling.
+ */
++ (ASTextNodeLayoutCacheStatistics)layoutCacheStatistics;
+
 #pragma mark - Layout and Sizing
 
 @property (nullable, nonatomic) id<ASTextLinePositionModifier> textContainerLinePositionModifier;
@@ -10,7 +10,6 @@
 #import <AsyncDisplayKit/ASTextNode.h>  // Definition of ASTextNodeDelegate
 
 #import <tgmath.h>
-#import <deque>
 
 #import <AsyncDisplayKit/_ASDisplayLayer.h>
 #import <AsyncDisplayKit/ASDisplayNode+FrameworkPrivate.h>
@@ -23,15 +22,7 @@
 #import <AsyncDisplayKit/ASEqualityHelpers.h>
 
 #import <AsyncDisplayKit/ASTextLayout.h>
-
-@interface ASTextCacheValue : NSObject {
-  @package
-  AS::Mutex _m;
-  std::deque<std::tuple<CGSize, ASTextLayout *>> _layouts;
-}
-@end
-@implementation ASTextCacheValue
-@end
+#import <AsyncDisplayKit/ASTextLayoutCache.h>
 
 /**
  * If set, we will record all values set to attributedText into an array
@@ -43,92 +34,229 @@
 #define AS_TEXTNODE2_RECORD_ATTRIBUTED_STRINGS 0
 
 /**
- * If it can't find a compatible layout, this method creates one.
- *
- * NOTE: Be careful to copy `text` if needed.
+ * The cached layout and the string its text was made from, which rules out fingerprint collisions.
  */
-static NS_RETURNS_RETAINED ASTextLayout *ASTextNodeCompatibleLayoutWithContainerAndText(ASTextContainer *container, NSAttributedString *text)  {
+struct ASTextNodeLayoutCacheValue {
+  NSAttributedString *source;
+  ASTextLayout *layout;
+};
+
+typedef AS::ShardedLRUCache<AS::TextLayoutKey, ASTextNodeLayoutCacheValue, AS::TextLayoutKeyHash> ASTextNodeLayoutCache;
+
+/**
+ * The layouts of all text nodes, bounded by their estimated memory rather than their number. Emptied on memory warnings.
+ */
+static ASTextNodeLayoutCache &ASTextNodeSharedLayoutCache()
+{
   static dispatch_once_t onceToken;
-  static AS::Mutex *layoutCacheLock;
-  static NSCache<NSAttributedString *, ASTextCacheValue *> *textLayoutCache;
+  static ASTextNodeLayoutCache *cache;
   dispatch_once(&onceToken, ^{
-    layoutCacheLock = new AS::Mutex();
-    textLayoutCache = [[NSCache alloc] init];
+    cache = new ASTextNodeLayoutCache(8 * 1024 * 1024, 8);
+    [[NSNotificationCenter defaultCenter] addObserverForName:UIApplicationDidReceiveMemoryWarningNotification object:nil queue:nil usingBlock:^(NSNotification *note) {
+      cache->Clear();
+    }];
   });
+  return *cache;
+}
 
-  layoutCacheLock->lock();
+/**
+ * A fingerprint of the characters and attributes of `text`. Equal strings have equal fingerprints; the cache
+ * compares the strings themselves before it trusts a match.
+ */
+static uint64_t ASTextNodeFingerprintAttributedString(NSAttributedString *text)
+{
+  __block AS::Fingerprint fingerprint;
+  NSString *string = text.string;
+  const NSUInteger length = string.length;
+  const UniChar *characters = CFStringGetCharactersPtr((__bridge CFStringRef)string);
+  if (characters != NULL) {
+    fingerprint.Add(characters, length * sizeof(UniChar));
+  } else {
+    UniChar buffer[256];
+    for (NSUInteger location = 0; location < length; location += 256) {
+      const NSRange range = NSMakeRange(location, MIN((NSUInteger)256, length - location));
+      [string getCharacters:buffer range:range];
+      fingerprint.Add(buffer, range.length * sizeof(UniChar));
+    }
+  }
+
+  // Attribute dictionaries have no order, so each run adds up the hashes of its pairs.
+  [text enumerateAttributesInRange:NSMakeRange(0, length) options:kNilOptions usingBlock:^(NSDictionary<NSAttributedStringKey, id> *attributes, NSRange range, BOOL *stop) {
+    __block uint64_t sum = 0;
+    [attributes enumerateKeysAndObjectsUsingBlock:^(NSAttributedStringKey key, id value, BOOL *stop) {
+      sum += AS::Fingerprint::Hash(AS::Fingerprint::Hash(key.hash) ^ [value hash]);
+    }];
+    fingerprint.Add(range.location);
+    fingerprint.Add(range.length);
+    fingerprint.Add(sum);
+  }];
+  return fingerprint.Value();
+}
 
-  ASTextCacheValue *cacheValue = [textLayoutCache objectForKey:text];
-  if (cacheValue == nil) {
-    cacheValue = [[ASTextCacheValue alloc] init];
-    [textLayoutCache setObject:cacheValue forKey:[text copy]];
+static void ASTextNodeFingerprintColor(AS::Fingerprint &fingerprint, CGColorRef color)
+{
+  if (color == NULL) {
+    fingerprint.Add(0);
+    return;
+  }
+  fingerprint.Add(CFHash(CGColorGetColorSpace(color)));
+  fingerprint.Add(CGColorGetComponents(color), CGColorGetNumberOfComponents(color) * sizeof(CGFloat));
+  if (CGPatternRef pattern = CGColorGetPattern(color)) {
+    fingerprint.Add(CFHash(pattern));
   }
+}
 
-  // Lock the cache item for the rest of the method. Only after acquiring can we release the NSCache.
-  AS::MutexLocker lock(cacheValue->_m);
-  layoutCacheLock->unlock();
+/**
+ * The container parameters that a cached layout must share, other than size.
+ */
+static uint64_t ASTextNodeFingerprintContainer(ASTextContainer *container)
+{
+  AS::Fingerprint fingerprint;
+  const UIEdgeInsets insets = container.insets;
+  fingerprint.Add(&insets, sizeof(insets));
+  fingerprint.Add(container.maximumNumberOfRows);
+  fingerprint.Add(container.truncationType);
+  fingerprint.Add(container.exclusionPaths.hash);
+  fingerprint.Add(container.truncationToken.hash);
+  return fingerprint.Value();
+}
 
+static BOOL ASTextNodeLayoutIsCompatibleWithContainer(ASTextLayout *layout, ASTextContainer *container)
+{
+  ASTextContainer *otherContainer = layout.container;
   CGRect containerBounds = (CGRect){ .size = container.size };
-  {
-    for (const auto &t : cacheValue->_layouts) {
-      CGSize constrainedSize = std::get<0>(t);
-      ASTextLayout *layout = std::get<1>(t);
-
-      CGSize layoutSize = layout.textBoundingSize;
-      // 1. CoreText can return frames that are narrower than the constrained width, for obvious reasons.
-      // 2. CoreText can return frames that are slightly wider than the constrained width, for some reason.
-      //    We have to trust that somehow it's OK to try and draw within our size constraint, despite the return value.
-      // 3. Thus, those two values (constrained width & returned width) form a range, where
-      //    intermediate values in that range will be snapped. Thus, we can use a given layout as long as our
-      //    width is in that range, between the min and max of those two values.
-      CGRect minRect = CGRectMake(0, 0, MIN(layoutSize.width, constrainedSize.width), MIN(layoutSize.height, constrainedSize.height));
-      if (!CGRectContainsRect(containerBounds, minRect)) {
-        continue;
-      }
-      CGRect maxRect = CGRectMake(0, 0, MAX(layoutSize.width, constrainedSize.width), MAX(layoutSize.height, constrainedSize.height));
-      if (!CGRectContainsRect(maxRect, containerBounds)) {
-        continue;
-      }
-      if (!CGSizeEqualToSize(container.size, constrainedSize)) {
-        continue;
-      }
+  CGSize constrainedSize = otherContainer.size;
+  CGSize layoutSize = layout.textBoundingSize;
+  // 1. CoreText can return frames that are narrower than the constrained width, for obvious reasons.
+  // 2. CoreText can return frames that are slightly wider than the constrained width, for some reason.
+  //    We have to trust that somehow it's OK to try and draw within our size constraint, despite the return value.
+  // 3. Thus, those two values (constrained width & returned width) form a range, where
+  //    intermediate values in that range will be snapped. Thus, we can use a given layout as long as our
+  //    width is in that range, between the min and max of those two values.
+  // The cache key only gets the sizes into the same size class; this is what makes the layout reusable.
+  CGRect minRect = CGRectMake(0, 0, MIN(layoutSize.width, constrainedSize.width), MIN(layoutSize.height, constrainedSize.height));
+  if (!CGRectContainsRect(containerBounds, minRect)) {
+    return NO;
+  }
+  CGRect maxRect = CGRectMake(0, 0, MAX(layoutSize.width, constrainedSize.width), MAX(layoutSize.height, constrainedSize.height));
+  if (!CGRectContainsRect(maxRect, containerBounds)) {
+    return NO;
+  }
 
-      // Now check container params.
-      ASTextContainer *otherContainer = layout.container;
-      if (!UIEdgeInsetsEqualToEdgeInsets(container.insets, otherContainer.insets)) {
-        continue;
-      }
-      if (!ASObjectIsEqual(container.exclusionPaths, otherContainer.exclusionPaths)) {
-        continue;
-      }
-      if (container.maximumNumberOfRows != otherContainer.maximumNumberOfRows) {
-        continue;
-      }
-      if (container.truncationType != otherContainer.truncationType) {
-        continue;
+  // Now check container params.
+  return UIEdgeInsetsEqualToEdgeInsets(container.insets, otherContainer.insets)
+      && ASObjectIsEqual(container.exclusionPaths, otherContainer.exclusionPaths)
+      && container.maximumNumberOfRows == otherContainer.maximumNumberOfRows
+      && container.truncationType == otherContainer.truncationType
+      && ASObjectIsEqual(container.truncationToken, otherContainer.truncationToken);
+}
+
+/**
+ * A rough guess at what a layout keeps in memory: its CoreText frame, lines and runs grow with the text.
+ */
+static size_t ASTextNodeEstimatedLayoutBytes(ASTextLayout *layout)
+{
+  return 1024 + layout.text.length * 24 + layout.lines.count * 256;
+}
+
+/**
+ * Returns a layout of the text made from `source` in `container`. A cached layout is reused if it is compatible;
+ * otherwise `makeText` is called for the text to lay out, and its layout is cached.
+ *
+ * `textFingerprint` is ASTextNodeFingerprintAttributedString(source), and `variant` identifies whatever `makeText`
+ * applies on top of `source`. Callers keep both, so a string is fingerprinted once rather than on every lookup.
+ */
+static NS_RETURNS_RETAINED ASTextLayout *ASTextNodeCompatibleLayout(ASTextContainer *container, NSAttributedString *source, uint64_t textFingerprint, uint64_t variant, NS_NOESCAPE NSAttributedString *(^makeText)(void))
+{
+  ASTextNodeLayoutCache &cache = ASTextNodeSharedLayoutCache();
+  const CGSize size = container.size;
+  const AS::TextLayoutKey key = {
+    textFingerprint,
+    variant,
+    ASTextNodeFingerprintContainer(container),
+    AS::TextLayoutKey::SizeClass(size.width),
+    AS::TextLayoutKey::SizeClass(size.height)
+  };
+
+  ASTextNodeLayoutCacheValue cached;
+  const bool found = cache.Find(key, [&](const ASTextNodeLayoutCacheValue &value) {
+    return ASTextNodeLayoutIsCompatibleWithContainer(value.layout, container)
+        && (value.source == source || [value.source isEqualToAttributedString:source]);
+  }, cached);
+  if (found) {
+    return cached.layout;
+  }
+
+  // Cache Miss. Compute the text layout. Two threads missing on the same key both compute it; the last one is kept.
+  ASTextLayout *layout = [ASTextLayout layoutWithContainer:container text:makeText()];
+  if (layout != nil) {
+    cache.Insert(key, {[source copy], layout}, ASTextNodeEstimatedLayoutBytes(layout));
+  }
+  return layout;
+}
+
+/**
+ * The variant of text that is laid out exactly as given.
+ */
+static const uint64_t ASTextNodeUnpreparedTextVariant = 0;
+
+/**
+ * Applies the truncation mode, and the shadow if any, to `attributedString`, as -prepareAttributedString:isForIntrinsicSize:
+ * does with the node's current values. Takes them as arguments so that text can be prepared off the lock.
+ */
+static void ASTextNodePrepareAttributedString(NSMutableAttributedString *attributedString, BOOL isForIntrinsicSize, NSLineBreakMode truncationMode, NSShadow *shadow)
+{
+  NSLineBreakMode innerMode;
+  switch (truncationMode) {
+    case NSLineBreakByWordWrapping:
+    case NSLineBreakByCharWrapping:
+    case NSLineBreakByClipping:
+      innerMode = truncationMode;
+      break;
+    default:
+      innerMode = NSLineBreakByWordWrapping;
+  }
+
+  // Apply/Fix paragraph style if needed
+  [attributedString enumerateAttribute:NSParagraphStyleAttributeName inRange:NSMakeRange(0, attributedString.length) options:kNilOptions usingBlock:^(NSParagraphStyle *style, NSRange range, BOOL * _Nonnull stop) {
+
+    BOOL applyTruncationMode = YES;
+    NSMutableParagraphStyle *paragraphStyle = nil;
+    // Only "left" and "justified" alignments are supported while calculating intrinsic size.
+    // Other alignments like "right", "center" and "natural" cause the size to be bigger than needed and thus should be ignored/overridden.
+    const BOOL forceLeftAlignment = (style != nil
+                                     && isForIntrinsicSize
+                                     && style.alignment != NSTextAlignmentLeft
+                                     && style.alignment != NSTextAlignmentJustified);
+    if (style != nil) {
+      if (innerMode == style.lineBreakMode) {
+        applyTruncationMode = NO;
       }
-      if (!ASObjectIsEqual(container.truncationToken, otherContainer.truncationToken)) {
-        continue;
+      paragraphStyle = [style mutableCopy];
+    } else {
+      if (innerMode == NSLineBreakByWordWrapping) {
+        applyTruncationMode = NO;
       }
-      // TODO: When we get a cache hit, move this entry to the front (LRU).
-      return layout;
+      paragraphStyle = [NSMutableParagraphStyle new];
     }
-  }
-
-  // Cache Miss. Compute the text layout.
-  ASTextLayout *layout = [ASTextLayout layoutWithContainer:container text:text];
+    if (!applyTruncationMode && !forceLeftAlignment) {
+      return;
+    }
+    paragraphStyle.lineBreakMode = innerMode;
 
-  // Store the result in the cache.
-  {
-    // This is a critical section. However we also must hold the lock until this point, in case
-    // another thread requests this cache item while a layout is being calculated, so they don't race.
-    cacheValue->_layouts.push_front(std::make_tuple(container.size, layout));
-    if (cacheValue->_layouts.size() > 3) {
-      cacheValue->_layouts.pop_back();
+    if (applyTruncationMode) {
+      paragraphStyle.lineBreakMode = truncationMode;
     }
-  }
+    if (forceLeftAlignment) {
+      paragraphStyle.alignment = NSTextAlignmentLeft;
+    }
+    [attributedString addAttribute:NSParagraphStyleAttributeName value:paragraphStyle range:range];
+  }];
 
-  return layout;
+  // Apply shadow if needed
+  if (shadow != nil) {
+    [attributedString addAttribute:NSShadowAttributeName value:shadow range:NSMakeRange(0, attributedString.length)];
+  }
 }
 
 static const NSTimeInterval ASTextNodeHighlightFadeOutDuration = 0.15;
@@ -156,6 +284,7 @@ static NSString *ASTextNodeTruncationTokenAttributeName = @"ASTextNodeTruncation
   CGFloat _shadowRadius;
   
   NSAttributedString *_attributedText;
+  uint64_t _attributedTextFingerprint;
   NSAttributedString *_truncationAttributedText;
   NSAttributedString *_additionalTruncationMessage;
   NSArray<NSNumber *> *_pointSizeScaleFactors;
@@ -188,6 +317,7 @@ static NSArray *DefaultLinkAttributeNames() {
 {
   if (self = [super init]) {
     _textContainer = [[ASTextContainer alloc] init];
+    _attributedTextFingerprint = ASTextNodeFingerprintAttributedString(nil);
     // Load default values from superclass.
     _shadowOffset = [super shadowOffset];
     _shadowColor = CGColorRetain([super shadowColor]);
@@ -352,9 +482,12 @@ static NSArray *DefaultLinkAttributeNames() {
   // it may provide a text that is longer than the width and require a wordWrapping line break mode and looking for the height to be calculated.
   BOOL isCalculatingIntrinsicSize = (_textContainer.size.width >= ASTextContainerMaxSize.width) || (_textContainer.size.height >= ASTextContainerMaxSize.height);
 
-  NSMutableAttributedString *mutableText = [_attributedText mutableCopy];
-  [self prepareAttributedString:mutableText isForIntrinsicSize:isCalculatingIntrinsicSize];
-  ASTextLayout *layout = ASTextNodeCompatibleLayoutWithContainerAndText(_textContainer, mutableText);
+  uint64_t variant = [self _locked_preparedTextVariantForIntrinsicSize:isCalculatingIntrinsicSize];
+  ASTextLayout *layout = ASTextNodeCompatibleLayout(_textContainer, _attributedText, _attributedTextFingerprint, variant, ^NSAttributedString *{
+    NSMutableAttributedString *mutableText = [_attributedText mutableCopy];
+    [self prepareAttributedString:mutableText isForIntrinsicSize:isCalculatingIntrinsicSize];
+    return mutableText;
+  });
   if (layout.truncatedLine != nil && layout.truncatedLine.size.width > layout.textBoundingSize.width) {
     return (CGSize) {MIN(constrainedSize.width, layout.truncatedLine.size.width), layout.textBoundingSize.height};
   }
@@ -399,6 +532,7 @@ static NSArray *DefaultLinkAttributeNames() {
   if (!ASCompareAssignCopy(_attributedText, attributedText)) {
     return;
   }
+  _attributedTextFingerprint = ASTextNodeFingerprintAttributedString(_attributedText);
 
   // Since truncation text matches style of attributedText, invalidate it now.
   [self _locked_invalidateTruncationText];
@@ -450,67 +584,48 @@ static NSArray *DefaultLinkAttributeNames() {
 - (void)prepareAttributedString:(NSMutableAttributedString *)attributedString isForIntrinsicSize:(BOOL)isForIntrinsicSize
 {
   ASLockScopeSelf();
-  NSLineBreakMode innerMode;
-  switch (_truncationMode) {
-    case NSLineBreakByWordWrapping:
-    case NSLineBreakByCharWrapping:
-    case NSLineBreakByClipping:
-      innerMode = _truncationMode;
-      break;
-    default:
-      innerMode = NSLineBreakByWordWrapping;
-  }
-
-  // Apply/Fix paragraph style if needed
-  [attributedString enumerateAttribute:NSParagraphStyleAttributeName inRange:NSMakeRange(0, attributedString.length) options:kNilOptions usingBlock:^(NSParagraphStyle *style, NSRange range, BOOL * _Nonnull stop) {
-
-    BOOL applyTruncationMode = YES;
-    NSMutableParagraphStyle *paragraphStyle = nil;
-    // Only "left" and "justified" alignments are supported while calculating intrinsic size.
-    // Other alignments like "right", "center" and "natural" cause the size to be bigger than needed and thus should be ignored/overridden.
-    const BOOL forceLeftAlignment = (style != nil
-                                     && isForIntrinsicSize
-                                     && style.alignment != NSTextAlignmentLeft
-                                     && style.alignment != NSTextAlignmentJustified);
-    if (style != nil) {
-      if (innerMode == style.lineBreakMode) {
-        applyTruncationMode = NO;
-      }
-      paragraphStyle = [style mutableCopy];
-    } else {
-      if (innerMode == NSLineBreakByWordWrapping) {
-        applyTruncationMode = NO;
-      }
-      paragraphStyle = [NSMutableParagraphStyle new];
-    }
-    if (!applyTruncationMode && !forceLeftAlignment) {
-      return;
-    }
-    paragraphStyle.lineBreakMode = innerMode;
+  ASTextNodePrepareAttributedString(attributedString, isForIntrinsicSize, _truncationMode, [self _locked_shadow]);
+}
 
-    if (applyTruncationMode) {
-      paragraphStyle.lineBreakMode = _truncationMode;
-    }
-    if (forceLeftAlignment) {
-      paragraphStyle.alignment = NSTextAlignmentLeft;
-    }
-    [attributedString addAttribute:NSParagraphStyleAttributeName value:paragraphStyle range:range];
-  }];
+/**
+ * The shadow -prepareAttributedString:isForIntrinsicSize: applies, or nil.
+ */
+- (NSShadow *)_locked_shadow
+{
+  DISABLED_ASAssertLocked(__instanceLock__);
+  if (!(_shadowOpacity > 0 && (_shadowRadius != 0 || !CGSizeEqualToSize(_shadowOffset, CGSizeZero)) && CGColorGetAlpha(_shadowColor) > 0)) {
+    return nil;
+  }
+  NSShadow *shadow = [[NSShadow alloc] init];
+  if (_shadowOpacity != 1) {
+    CGColorRef shadowColorRef = CGColorCreateCopyWithAlpha(_shadowColor, _shadowOpacity * CGColorGetAlpha(_shadowColor));
+    shadow.shadowColor = [UIColor colorWithCGColor:shadowColorRef];
+    CGColorRelease(shadowColorRef);
+  } else {
+    shadow.shadowColor = [UIColor colorWithCGColor:_shadowColor];
+  }
+  shadow.shadowOffset = _shadowOffset;
+  shadow.shadowBlurRadius = _shadowRadius;
+  return shadow;
+}
 
-  // Apply shadow if needed
+/**
+ * Identifies what -prepareAttributedString:isForIntrinsicSize: does to the text, for the layout cache. Anything that
+ * method starts to depend on must be added here too.
+ */
+- (uint64_t)_locked_preparedTextVariantForIntrinsicSize:(BOOL)isForIntrinsicSize
+{
+  DISABLED_ASAssertLocked(__instanceLock__);
+  AS::Fingerprint fingerprint;
+  fingerprint.Add(_truncationMode);
+  fingerprint.Add(isForIntrinsicSize);
   if (_shadowOpacity > 0 && (_shadowRadius != 0 || !CGSizeEqualToSize(_shadowOffset, CGSizeZero)) && CGColorGetAlpha(_shadowColor) > 0) {
-    NSShadow *shadow = [[NSShadow alloc] init];
-    if (_shadowOpacity != 1) {
-      CGColorRef shadowColorRef = CGColorCreateCopyWithAlpha(_shadowColor, _shadowOpacity * CGColorGetAlpha(_shadowColor));
-      shadow.shadowColor = [UIColor colorWithCGColor:shadowColorRef];
-      CGColorRelease(shadowColorRef);
-    } else {
-      shadow.shadowColor = [UIColor colorWithCGColor:_shadowColor];
-    }
-    shadow.shadowOffset = _shadowOffset;
-    shadow.shadowBlurRadius = _shadowRadius;
-    [attributedString addAttribute:NSShadowAttributeName value:shadow range:NSMakeRange(0, attributedString.length)];
+    fingerprint.Add(&_shadowOffset, sizeof(_shadowOffset));
+    fingerprint.Add(&_shadowOpacity, sizeof(_shadowOpacity));
+    fingerprint.Add(&_shadowRadius, sizeof(_shadowRadius));
+    ASTextNodeFingerprintColor(fingerprint, _shadowColor);
   }
+  return fingerprint.Value();
 }
 
 #pragma mark - Drawing
@@ -518,7 +633,11 @@ static NSArray *DefaultLinkAttributeNames() {
 - (NSObject *)drawParametersForAsyncLayer:(_ASDisplayLayer *)layer
 {
   ASTextContainer *copiedContainer;
-  NSMutableAttributedString *mutableText;
+  NSAttributedString *source;
+  uint64_t textFingerprint;
+  uint64_t variant;
+  NSLineBreakMode truncationMode;
+  NSShadow *shadow;
   BOOL needsTintColor;
   id bgColor;
   {
@@ -530,31 +649,52 @@ static NSArray *DefaultLinkAttributeNames() {
     copiedContainer = [_textContainer copy];
     copiedContainer.size = self.bounds.size;
     [copiedContainer makeImmutable];
-    mutableText = [_attributedText mutableCopy] ?: [[NSMutableAttributedString alloc] init];
-
-    [self prepareAttributedString:mutableText isForIntrinsicSize:NO];
-    needsTintColor = self.textColorFollowsTintColor && mutableText.length > 0;
+    // Fingerprints of nil and of an empty string are the same.
+    source = _attributedText ?: [[NSAttributedString alloc] init];
+    textFingerprint = _attributedTextFingerprint;
+    variant = [self _locked_preparedTextVariantForIntrinsicSize:NO];
+
+    // The prepared text is only built if the layout cache misses, from what it is prepared with now.
+    truncationMode = _truncationMode;
+    shadow = [self _locked_shadow];
+    needsTintColor = self.textColorFollowsTintColor && source.length > 0;
     bgColor = self.backgroundColor ?: [NSNull null];
   }
   
   // After all other attributes are set, apply tint color if needed and foreground color is not already specified
+  UIColor *tintColor = nil;
   if (needsTintColor) {
-    // Apply tint color if specified and if foreground color is undefined for attributedString
-    NSRange limit = NSMakeRange(0, mutableText.length);
-    // Look for previous attributes that define foreground color
-    UIColor *attributeValue = (UIColor *)[mutableText attribute:NSForegroundColorAttributeName atIndex:limit.location effectiveRange:NULL];
+    // Look for previous attributes that define foreground color. Preparing the text doesn't set any.
+    UIColor *attributeValue = (UIColor *)[source attribute:NSForegroundColorAttributeName atIndex:0 effectiveRange:NULL];
     
     // we need to unlock before accessing tintColor
-    UIColor *tintColor = self.tintColor;
-    if (attributeValue == nil && tintColor) {
-      // None are found, apply tint color if available. Fallback to "black" text color
-      [mutableText addAttributes:@{ NSForegroundColorAttributeName : tintColor } range:limit];
+    if (attributeValue == nil) {
+      tintColor = self.tintColor;
+    }
+    if (tintColor) {
+      AS::Fingerprint tinted;
+      tinted.Add(variant);
+      ASTextNodeFingerprintColor(tinted, tintColor.CGColor);
+      variant = tinted.Value();
     }
   }
 
+  NSAttributedString *(^makeText)(void) = ^NSAttributedString *{
+    NSMutableAttributedString *mutableText = [source mutableCopy];
+    ASTextNodePrepareAttributedString(mutableText, NO, truncationMode, shadow);
+    if (tintColor) {
+      // None are found, apply tint color if available. Fallback to "black" text color
+      [mutableText addAttributes:@{ NSForegroundColorAttributeName : tintColor } range:NSMakeRange(0, mutableText.length)];
+    }
+    return mutableText;
+  };
+
   return @{
     @"container": copiedContainer,
-    @"text": mutableText,
+    @"makeText": makeText,
+    @"source": source,
+    @"textFingerprint": @(textFingerprint),
+    @"variant": @(variant),
     @"bgColor": bgColor
   };
 }
@@ -562,9 +702,12 @@ static NSArray *DefaultLinkAttributeNames() {
 + (void)drawRect:(CGRect)bounds withParameters:(NSDictionary *)layoutDict isCancelled:(NS_NOESCAPE asdisplaynode_iscancelled_block_t)isCancelledBlock isRasterizing:(BOOL)isRasterizing
 {
   ASTextContainer *container = layoutDict[@"container"];
-  NSAttributedString *text = layoutDict[@"text"];
+  NSAttributedString *(^makeText)(void) = layoutDict[@"makeText"];
+  NSAttributedString *source = layoutDict[@"source"];
+  uint64_t textFingerprint = [layoutDict[@"textFingerprint"] unsignedLongLongValue];
+  uint64_t variant = [layoutDict[@"variant"] unsignedLongLongValue];
   UIColor *bgColor = layoutDict[@"bgColor"];
-  ASTextLayout *layout = ASTextNodeCompatibleLayoutWithContainerAndText(container, text);
+  ASTextLayout *layout = ASTextNodeCompatibleLayout(container, source, textFingerprint, variant, makeText);
   
   if (isCancelledBlock()) {
     return;
@@ -645,7 +788,7 @@ static NSArray *DefaultLinkAttributeNames() {
   // See discussion in https://github.com/TextureGroup/Texture/pull/396
   ASTextContainer *containerCopy = [_textContainer copy];
   containerCopy.size = self.calculatedSize;
-  ASTextLayout *layout = ASTextNodeCompatibleLayoutWithContainerAndText(containerCopy, _attributedText);
+  ASTextLayout *layout = [self _locked_layoutOfAttributedTextInContainer:containerCopy];
 
   if ([self _locked_pointInsideAdditionalTruncationMessage:point withLayout:layout]) {
     if (inAdditionalTruncationMessageOut != NULL) {
@@ -903,7 +1046,7 @@ static NSArray *DefaultLinkAttributeNames() {
         // See discussion in https://github.com/TextureGroup/Texture/pull/396
         ASTextContainer *textContainerCopy = [_textContainer copy];
         textContainerCopy.size = self.calculatedSize;
-        ASTextLayout *layout = ASTextNodeCompatibleLayoutWithContainerAndText(textContainerCopy, _attributedText);
+        ASTextLayout *layout = [self _locked_layoutOfAttributedTextInContainer:textContainerCopy];
 
         NSArray<ASTextSelectionRect *> *highlightRects = [layout selectionRectsWithoutStartAndEndForRange:[ASTextRange rangeWithRange:highlightRange]];
         NSMutableArray *converted = [NSMutableArray arrayWithCapacity:highlightRects.count];
@@ -1083,7 +1226,7 @@ static CGRect ASTextNodeAdjustRenderRectForShadowPadding(CGRect rendererRect, UI
       // See discussion in https://github.com/TextureGroup/Texture/pull/396
       ASTextContainer *containerCopy = [_textContainer copy];
       containerCopy.size = self.calculatedSize;
-      ASTextLayout *layout = ASTextNodeCompatibleLayoutWithContainerAndText(containerCopy, _attributedText);
+      ASTextLayout *layout = [self _locked_layoutOfAttributedTextInContainer:containerCopy];
       visibleRange = layout.visibleRange;
     }
     NSRange truncationMessageRange = [self _additionalTruncationMessageRangeWithVisibleRange:visibleRange];
@@ -1363,7 +1506,18 @@ static NSAttributedString *DefaultTruncationAttributedString()
 {
   ASTextContainer *container = [_textContainer copy];
   container.size = size;
-  return ASTextNodeCompatibleLayoutWithContainerAndText(container, _attributedText);
+  return [self _locked_layoutOfAttributedTextInContainer:container];
+}
+
+/**
+ * The layout of the attributed text exactly as set, without -prepareAttributedString:isForIntrinsicSize:.
+ */
+- (ASTextLayout *)_locked_layoutOfAttributedTextInContainer:(ASTextContainer *)container
+{
+  NSAttributedString *attributedText = _attributedText;
+  return ASTextNodeCompatibleLayout(container, attributedText, _attributedTextFingerprint, ASTextNodeUnpreparedTextVariant, ^{
+    return attributedText;
+  });
 }
 
 - (NSUInteger)maximumNumberOfLines
@@ -1504,6 +1658,19 @@ static NSAttributedString *DefaultTruncationAttributedString()
   [ASTextDebugOption setSharedDebugOption:debugOption];
 }
 
++ (ASTextNodeLayoutCacheStatistics)layoutCacheStatistics
+{
+  const ASTextNodeLayoutCache::Statistics statistics = ASTextNodeSharedLayoutCache().GetStatistics();
+  return (ASTextNodeLayoutCacheStatistics){
+    .hits = statistics.hits,
+    .misses = statistics.misses,
+    .evictions = statistics.evictions,
+    .entryCount = (NSUInteger)statistics.entries,
+    .bytes = (NSUInteger)statistics.bytes,
+    .capacityBytes = (NSUInteger)statistics.capacityBytes
+  };
+}
+
 - (BOOL)usingExperiment
 {
   return YES;
@@ -21,6 +21,11 @@
   #define AS_ENABLE_TEXTNODE 1 // Enable old TextNode by default
 #endif
 
+// Count acquisitions, contention, and wait and hold times of every AS::Mutex. See ASLockProfiler.h.
+#ifndef AS_LOCK_PROFILING
+  #define AS_LOCK_PROFILING 0
+#endif
+
 // This needs to stay in sync with Weaver
 #ifndef AS_USE_VIDEO
   #define AS_USE_VIDEO 0
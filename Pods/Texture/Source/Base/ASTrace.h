@@ -0,0 +1,71 @@
+//
+//  ASTrace.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#import <Foundation/Foundation.h>
+#import <AsyncDisplayKit/ASBaseDefines.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A lightweight timeline of what the app and Texture are doing, exported as
+ * Chrome trace-event JSON for chrome://tracing or ui.perfetto.dev.
+ *
+ * Tracing is off until ASTraceStart(). While it is off, each trace point costs
+ * one call and a load. While it is on, events go into a ring owned by the
+ * recording thread, without locking, and a background flusher collects them.
+ *
+ * ASTraceBegin("Layout", 0);
+ * ...
+ * ASTraceEnd("Layout", 0);
+ * NSData *json = ASTraceCopyChromeTrace();
+ */
+typedef NS_ENUM(uint8_t, ASTracePhase) {
+  /** Opens a slice on the current thread. Slices nest. */
+  ASTracePhaseBegin,
+  /** Closes the innermost open slice on the current thread. */
+  ASTracePhaseEnd,
+  /** A point in time. */
+  ASTracePhaseInstant,
+  /** A sample of a counter named by the event; the argument is the value. */
+  ASTracePhaseCounter,
+};
+
+/** Starts recording and the background flusher. Events recorded before are discarded. */
+ASDK_EXTERN void ASTraceStart(void);
+
+/** Stops recording and flushes. What was recorded stays available for export. */
+ASDK_EXTERN void ASTraceStop(void);
+
+ASDK_EXTERN BOOL ASTraceIsEnabled(void);
+
+/** Returns a stable id for `name`. The name is copied. Prefer the macros below, which intern once per call site. */
+ASDK_EXTERN uint32_t ASTraceInternName(const char *name);
+
+/** Records an event on the current thread if tracing is on. */
+ASDK_EXTERN void ASTraceRecord(ASTracePhase phase, uint32_t nameID, uint64_t arg);
+
+/** Everything recorded since ASTraceStart(), as Chrome trace-event JSON. */
+ASDK_EXTERN NSData *ASTraceCopyChromeTrace(void);
+
+/** Events lost because a thread's ring or the store was full. */
+ASDK_EXTERN uint64_t ASTraceDroppedEventCount(void);
+
+#define ASTraceBegin(name, arg) _ASTraceRecordAtCallSite(ASTracePhaseBegin, name, arg)
+#define ASTraceEnd(name, arg) _ASTraceRecordAtCallSite(ASTracePhaseEnd, name, arg)
+#define ASTraceInstant(name, arg) _ASTraceRecordAtCallSite(ASTracePhaseInstant, name, arg)
+#define ASTraceCounter(name, value) _ASTraceRecordAtCallSite(ASTracePhaseCounter, name, value)
+
+#define _ASTraceRecordAtCallSite(phase, name, arg) ({ \
+  if (ASTraceIsEnabled()) { \
+    static uint32_t __traceNameID; \
+    static dispatch_once_t __traceNameOnce; \
+    dispatch_once(&__traceNameOnce, ^{ __traceNameID = ASTraceInternName(name); }); \
+    ASTraceRecord(phase, __traceNameID, (uint64_t)(arg)); \
+  } \
+})
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,60 @@
+//
+//  ASTrace.mm
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#import <AsyncDisplayKit/ASTrace.h>
+#import <AsyncDisplayKit/ASTraceRecorder.h>
+
+// Often enough that a thread's ring, at 4096 events, does not fill up between flushes.
+static const unsigned kASTraceFlushIntervalMilliseconds = 100;
+
+void ASTraceStart()
+{
+  AS::TraceRecorder::SetEnabled(false);
+  AS::TraceRecorder::Reset();
+  if ([NSThread isMainThread]) {
+    AS::TraceRecorder::SetCurrentThreadName("main");
+  } else {
+    dispatch_async(dispatch_get_main_queue(), ^{
+      AS::TraceRecorder::SetCurrentThreadName("main");
+    });
+  }
+  AS::TraceRecorder::StartFlusher(kASTraceFlushIntervalMilliseconds);
+  AS::TraceRecorder::SetEnabled(true);
+}
+
+void ASTraceStop()
+{
+  AS::TraceRecorder::SetEnabled(false);
+  AS::TraceRecorder::StopFlusher();
+  AS::TraceRecorder::Flush();
+}
+
+BOOL ASTraceIsEnabled()
+{
+  return AS::TraceRecorder::IsEnabled();
+}
+
+uint32_t ASTraceInternName(const char *name)
+{
+  return AS::TraceRecorder::Intern(name);
+}
+
+void ASTraceRecord(ASTracePhase phase, uint32_t nameID, uint64_t arg)
+{
+  AS::TraceRecorder::Record((AS::TracePhase)phase, nameID, arg);
+}
+
+NSData *ASTraceCopyChromeTrace()
+{
+  const std::string json = AS::TraceRecorder::ExportChromeTrace();
+  return [NSData dataWithBytes:json.data() length:json.size()];
+}
+
+uint64_t ASTraceDroppedEventCount()
+{
+  return AS::TraceRecorder::DroppedCount();
+}
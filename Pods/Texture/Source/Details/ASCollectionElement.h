@@ -24,6 +24,18 @@ AS_SUBCLASSING_RESTRICTED
 @property (nonatomic) ASPrimitiveTraitCollection traitCollection;
 @property (nullable, nonatomic, readonly) id nodeModel;
 
+/**
+ * How expensive the node is to allocate and lay out relative to the other elements, as hinted by the data source when
+ * the element was inserted. 0 means unknown.
+ */
+@property (nonatomic) CGFloat layoutCostHint;
+
+/**
+ * Whether the data source expected the node to be on screen when the element was inserted. Prioritized nodes are
+ * prepared first.
+ */
+@property (nonatomic, getter=isPrioritized) BOOL prioritized;
+
 - (instancetype)initWithNodeModel:(nullable id)nodeModel
                         nodeBlock:(ASCellNodeBlock)nodeBlock
          supplementaryElementKind:(nullable NSString *)supplementaryElementKind
@@ -97,6 +97,23 @@ ASDK_EXTERN NSString * const ASCollectionInvalidUpdateException;
 
 - (nullable id<ASSectionContext>)dataController:(ASDataController *)dataController contextForSection:(NSInteger)section;
 
+/**
+ * How expensive the node at the index path is to allocate and lay out, relative to the others, such as the length of
+ * its text. Nodes are prepared most expensive first, so a long one doesn't start last and hold up the batch. 0 means
+ * unknown; such nodes go after those with a hint, in order.
+ */
+- (CGFloat)dataController:(ASDataController *)dataController layoutCostHintForNodeOfKind:(NSString *)kind atIndexPath:(NSIndexPath *)indexPath;
+
+/**
+ * Whether the node at the index path is expected to be on screen once its change set is applied.
+ *
+ * Implementing this turns on streaming: prioritized nodes are prepared first, and the change set goes on to the main
+ * thread as soon as they are ready while the rest are finished in the background. Those are measured in the background
+ * but get their frames on the main thread, after the change set. A node that is needed before then, for example to
+ * size its row, is finished by the thread that asks for it. Not used when node creation is serialized.
+ */
+- (BOOL)dataController:(ASDataController *)dataController shouldPrioritizeNodeOfKind:(NSString *)kind atIndexPath:(NSIndexPath *)indexPath;
+
 @end
 
 /**
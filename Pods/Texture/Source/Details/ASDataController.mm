@@ -9,12 +9,14 @@
 
 #import <AsyncDisplayKit/ASDataController.h>
 
+#import <memory>
+
 #import <AsyncDisplayKit/_ASHierarchyChangeSet.h>
 #import <AsyncDisplayKit/_ASScopeTimer.h>
 #import <AsyncDisplayKit/ASCellNode.h>
 #import <AsyncDisplayKit/ASCollectionElement.h>
 #import <AsyncDisplayKit/ASCollectionLayoutContext.h>
-#import <AsyncDisplayKit/ASDispatch.h>
+#import <AsyncDisplayKit/ASCostScheduler.h>
 #import <AsyncDisplayKit/ASDisplayNodeExtras.h>
 #import <AsyncDisplayKit/ASElementMap.h>
 #import <AsyncDisplayKit/ASLayout.h>
@@ -69,6 +71,8 @@ typedef void (^ASDataControllerSynchronizationBlock)();
     unsigned int constrainedSizeForNodeAtIndexPath:1;
     unsigned int constrainedSizeForSupplementaryNodeOfKindAtIndexPath:1;
     unsigned int contextForSection:1;
+    unsigned int layoutCostHintForNodeOfKindAtIndexPath:1;
+    unsigned int shouldPrioritizeNodeOfKindAtIndexPath:1;
   } _dataSourceFlags;
 }
 
@@ -95,6 +99,8 @@ typedef void (^ASDataControllerSynchronizationBlock)();
   _dataSourceFlags.constrainedSizeForNodeAtIndexPath = [_dataSource respondsToSelector:@selector(dataController:constrainedSizeForNodeAtIndexPath:)];
   _dataSourceFlags.constrainedSizeForSupplementaryNodeOfKindAtIndexPath = [_dataSource respondsToSelector:@selector(dataController:constrainedSizeForSupplementaryNodeOfKind:atIndexPath:)];
   _dataSourceFlags.contextForSection = [_dataSource respondsToSelector:@selector(dataController:contextForSection:)];
+  _dataSourceFlags.layoutCostHintForNodeOfKindAtIndexPath = [_dataSource respondsToSelector:@selector(dataController:layoutCostHintForNodeOfKind:atIndexPath:)];
+  _dataSourceFlags.shouldPrioritizeNodeOfKindAtIndexPath = [_dataSource respondsToSelector:@selector(dataController:shouldPrioritizeNodeOfKind:atIndexPath:)];
 
   self.visibleMap = self.pendingMap = [[ASElementMap alloc] init];
   
@@ -132,6 +138,11 @@ typedef void (^ASDataControllerSynchronizationBlock)();
 /**
  * Allocates and layouts nodes from the given collection elements, and blocks the current thread while doing so.
  *
+ * Nodes are prepared most expensive first, as hinted by the data source, with the calling thread working alongside the
+ * background ones unless node creation is serialized. If the data source prioritizes nodes, this returns as soon as
+ * those are ready and the rest are finished in the background, tracked by the editing transaction group. Their frames
+ * are applied on the main thread, as the change set may already be showing them.
+ *
  * @param elements The elements from which nodes can be allocated and laid out.
  * @param strictlyOnCurrentThread Whether or not all the work must be done strictly on the current thread.
  * YES means all nodes will be allocated and laid out serially on the current thread.
@@ -151,7 +162,7 @@ typedef void (^ASDataControllerSynchronizationBlock)();
   {
     as_activity_create_for_scope("Data controller batch");
 
-    void(^work)(size_t) = ^(size_t i) {
+    void(^work)(size_t, BOOL) = ^(size_t i, BOOL applyFrameOnMain) {
       __strong id<ASDataControllerSource> strongDataSource = weakDataSource;
       if (strongDataSource == nil) {
         return;
@@ -167,22 +178,72 @@ typedef void (^ASDataControllerSynchronizationBlock)();
 
       // Layout the node if the size range is valid.
       ASSizeRange sizeRange = element.constrainedSize;
-      if (ASSizeRangeHasSignificantArea(sizeRange)) {
+      if (!ASSizeRangeHasSignificantArea(sizeRange)) {
+        return;
+      }
+      if (applyFrameOnMain) {
+        [self _layoutNodeApplyingFrameOnMain:node withConstrainedSize:sizeRange];
+      } else {
         [self _layoutNode:node withConstrainedSize:sizeRange];
       }
     };
     
     if (strictlyOnCurrentThread) {
       for (NSUInteger i = 0; i < nodeCount; i++) {
-        work(i);
+        work(i, NO);
       }
     } else {
+      const BOOL serialize = [_dataSource dataControllerShouldSerializeNodeCreation:self];
+      // Serialized node creation gets a single background thread. Otherwise the calling thread, which would just wait,
+      // works alongside the background ones.
+      const NSUInteger helperCount = serialize ? 1 : MIN(NSProcessInfo.processInfo.activeProcessorCount, nodeCount) - 1;
+      const BOOL streaming = !serialize && helperCount > 0 && _dataSourceFlags.shouldPrioritizeNodeOfKindAtIndexPath;
+      // Most expensive first, as hinted by the data source. Shared with helpers that may outlive this call when streaming.
+      const auto scheduler = std::make_shared<AS::CostScheduler>();
+      scheduler->Reset(nodeCount, [&](size_t i) {
+        return (double)elements[i].layoutCostHint;
+      }, [&](size_t i) {
+        return streaming && elements[i].prioritized;
+      });
+      dispatch_semaphore_t prioritizedFinished = dispatch_semaphore_create(0);
+      void(^drain)(BOOL) = ^(BOOL prioritizedOnly) {
+        size_t i;
+        while (prioritizedOnly ? scheduler->ClaimPrioritized(i) : scheduler->Claim(i)) {
+          // Nodes the change set doesn't wait for may already be on screen by the time they're laid out.
+          work(i, streaming && !scheduler->IsPrioritized(i));
+          if (scheduler->Finish(i)) {
+            dispatch_semaphore_signal(prioritizedFinished);
+          }
+        }
+      };
+
       dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
-      NSUInteger threadCount = 0;
-      if ([_dataSource dataControllerShouldSerializeNodeCreation:self]) {
-        threadCount = 1;
+      dispatch_group_t group = streaming ? _editingTransactionGroup : dispatch_group_create();
+      for (NSUInteger t = 0; t < helperCount; t++) {
+        if (streaming) {
+          ++_editingTransactionGroupCount;
+        }
+        dispatch_group_async(group, queue, ^{
+          drain(NO);
+          if (streaming) {
+            --self->_editingTransactionGroupCount;
+          }
+        });
+      }
+
+      if (serialize) {
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+      } else if (streaming) {
+        // The change set goes on to the main thread once the prioritized nodes are ready. Nodes the helpers haven't
+        // finished by the time they're needed are finished by whichever thread asks first.
+        drain(YES);
+        if (scheduler->PrioritizedCount() > 0) {
+          dispatch_semaphore_wait(prioritizedFinished, DISPATCH_TIME_FOREVER);
+        }
+      } else {
+        drain(NO);
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
       }
-      ASDispatchApply(nodeCount, queue, threadCount, work);
     }
   }
 
@@ -205,6 +266,29 @@ typedef void (^ASDataControllerSynchronizationBlock)();
   node.frame = frame;
 }
 
+/**
+ * Like -_layoutNode:withConstrainedSize:, but measures on the current thread and applies the frame on the main thread,
+ * in order after any change set that is already showing the node.
+ */
+- (void)_layoutNodeApplyingFrameOnMain:(ASCellNode *)node withConstrainedSize:(ASSizeRange)constrainedSize
+{
+  if (![_dataSource dataController:self shouldEagerlyLayoutNode:node]) {
+    return;
+  }
+
+  ASDisplayNodeAssert(ASSizeRangeHasSignificantArea(constrainedSize), @"Attempt to layout cell node with invalid size range %@", NSStringFromASSizeRange(constrainedSize));
+
+  ASLayout *layout = [node layoutThatFits:constrainedSize];
+  [_mainSerialQueue performBlockOnMainThread:^{
+    // If the node was measured again since, whoever did so applied their own layout.
+    if (node.calculatedLayout == layout) {
+      CGRect frame = CGRectZero;
+      frame.size = layout.size;
+      node.frame = frame;
+    }
+  }];
+}
+
 #pragma mark - Data Source Access (Calling _dataSource)
 
 - (NSArray<NSIndexPath *> *)_allIndexPathsForItemsOfKind:(NSString *)kind inSections:(NSIndexSet *)sections
@@ -424,6 +508,12 @@ typedef void (^ASDataControllerSynchronizationBlock)();
                                                                   constrainedSize:constrainedSize
                                                                        owningNode:node
                                                                   traitCollection:traitCollection];
+    if (_dataSourceFlags.layoutCostHintForNodeOfKindAtIndexPath) {
+      element.layoutCostHint = [dataSource dataController:self layoutCostHintForNodeOfKind:kind atIndexPath:indexPath];
+    }
+    if (_dataSourceFlags.shouldPrioritizeNodeOfKindAtIndexPath) {
+      element.prioritized = [dataSource dataController:self shouldPrioritizeNodeOfKind:kind atIndexPath:indexPath];
+    }
     [map insertElement:element atIndexPath:indexPath];
     changeSet.countForAsyncLayout += (shouldAsyncLayout ? 1 : 0);
   }
@@ -63,6 +63,26 @@ typedef void(^ASImageCacherCompletion)(id <ASImageContainerProtocol> _Nullable i
  */
 - (void)clearFetchedImageFromCacheWithURL:(NSURL *)URL;
 
+/**
+ @abstract Called when a node that has loaded the image with the given URL enters the display range.
+ @param URL The URL of the image.
+ @param targetPixelSize The size in pixels the node draws the image at.
+ @param callbackQueue The queue to call `completion` on.
+ @param completion The block to be called with the image decoded at targetPixelSize, or nil.
+ @discussion Lets a cache keep decoded bitmaps only for images near the screen, and compressed bytes for the rest.
+ Each call is balanced by imageDidExitDisplayWithURL:.
+ */
+- (void)imageWillEnterDisplayWithURL:(NSURL *)URL
+                     targetPixelSize:(CGSize)targetPixelSize
+                       callbackQueue:(dispatch_queue_t)callbackQueue
+                          completion:(void (^)(UIImage * _Nullable image))completion;
+
+/**
+ @abstract Called when a node that was passed to imageWillEnterDisplayWithURL:targetPixelSize:callbackQueue:completion:
+ leaves the display range, or stops showing the image.
+ */
+- (void)imageDidExitDisplayWithURL:(NSURL *)URL;
+
 @end
 
 /**
@@ -12,7 +12,8 @@
 NS_ASSUME_NONNULL_BEGIN
 
 /**
- * An objective-C wrapper for unordered_map.
+ * An objective-C wrapper for AS::FlatIntegerMap, which keeps update mappings as
+ * runs of consecutive indexes.
  */
 AS_SUBCLASSING_RESTRICTED
 @interface ASIntegerMap : NSObject <NSCopying>
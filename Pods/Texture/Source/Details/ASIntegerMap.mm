@@ -8,17 +8,25 @@
 
 #import "ASIntegerMap.h"
 #import <AsyncDisplayKit/ASAssert.h>
-#import <unordered_map>
+#import <AsyncDisplayKit/ASFlatIntegerMap.h>
 #import <AsyncDisplayKit/ASObjectDescriptionHelpers.h>
+#import <vector>
 
 /**
- * This is just a friendly Objective-C interface to unordered_map<NSInteger, NSInteger>
+ * This is just a friendly Objective-C interface to AS::FlatIntegerMap
  */
 @interface ASIntegerMap () <ASDescriptionProvider>
 @end
 
+static void ASIntegerMapAppendRanges(NSIndexSet *indexes, std::vector<AS::FlatIntegerMap::Range> *ranges)
+{
+  [indexes enumerateRangesUsingBlock:^(NSRange range, BOOL * _Nonnull stop) {
+    ranges->push_back({(NSInteger)range.location, (NSInteger)range.length});
+  }];
+}
+
 @implementation ASIntegerMap {
-  std::unordered_map<NSInteger, NSInteger> _map;
+  AS::FlatIntegerMap _map;
   BOOL _isIdentity;
   BOOL _isEmpty;
   BOOL _immutable; // identity map and empty mape are immutable.
@@ -60,32 +68,16 @@
     return ASIntegerMap.identityMap;
   }
 
-  ASIntegerMap *result = [[ASIntegerMap alloc] init];
-  // Start with the old indexes
-  NSMutableIndexSet *indexes = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(0, oldCount)];
-
-  // Descending order, shift deleted ranges left
-  [deletions enumerateRangesWithOptions:NSEnumerationReverse usingBlock:^(NSRange range, BOOL * _Nonnull stop) {
-    [indexes shiftIndexesStartingAtIndex:NSMaxRange(range) by:-range.length];
-  }];
-
-  // Ascending order, shift inserted ranges right
-  [insertions enumerateRangesUsingBlock:^(NSRange range, BOOL * _Nonnull stop) {
-    [indexes shiftIndexesStartingAtIndex:range.location by:range.length];
-  }];
+  // The n-th surviving old index maps to the n-th new index that isn't an
+  // insertion. That comes out as one run per stretch between changes, so this
+  // is linear in the number of changed ranges rather than in oldCount.
+  std::vector<AS::FlatIntegerMap::Range> deleted;
+  std::vector<AS::FlatIntegerMap::Range> inserted;
+  ASIntegerMapAppendRanges(deletions, &deleted);
+  ASIntegerMapAppendRanges(insertions, &inserted);
 
-  __block NSInteger oldIndex = 0;
-  [indexes enumerateRangesUsingBlock:^(NSRange range, BOOL * _Nonnull stop) {
-    // Note we advance oldIndex unconditionally, not newIndex
-    for (NSInteger newIndex = range.location; newIndex < NSMaxRange(range); oldIndex++) {
-      if ([deletions containsIndex:oldIndex]) {
-        // index was deleted, do nothing, just let oldIndex advance.
-      } else {
-        // assign the next index for this item.
-        result->_map[oldIndex] = newIndex++;
-      }
-    }
-  }];
+  ASIntegerMap *result = [[ASIntegerMap alloc] init];
+  result->_map.BuildForUpdate(oldCount, deleted.data(), deleted.size(), inserted.data(), inserted.size());
   return result;
 }
 
@@ -97,8 +89,8 @@
     return NSNotFound;
   }
 
-  const auto result = _map.find(key);
-  return result != _map.end() ? result->second : NSNotFound;
+  NSInteger value;
+  return _map.Find(key, value) ? value : NSNotFound;
 }
 
 - (void)setInteger:(NSInteger)value forKey:(NSInteger)key
@@ -108,7 +100,7 @@
     return;
   }
 
-  _map[key] = value;
+  _map.Set(key, value);
 }
 
 - (ASIntegerMap *)inverseMap
@@ -118,10 +110,7 @@
   }
 
   const auto result = [[ASIntegerMap alloc] init];
-  
-  for (const auto &e : _map) {
-    result->_map[e.second] = e.first;
-  }
+  result->_map = _map.Inverse();
   return result;
 }
 
@@ -151,9 +140,9 @@
   } else {
     // { 1->2 3->4 5->6 }
     NSMutableString *str = [NSMutableString string];
-    for (const auto &e : _map) {
-      [str appendFormat:@" %ld->%ld", (long)e.first, (long)e.second];
-    }
+    _map.ForEach([&](NSInteger key, NSInteger value) {
+      [str appendFormat:@" %ld->%ld", (long)key, (long)value];
+    });
     // Remove leading space
     if (str.length > 0) {
       [str deleteCharactersInRange:NSMakeRange(0, 1)];
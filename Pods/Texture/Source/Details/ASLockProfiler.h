@@ -0,0 +1,361 @@
+//
+//  ASLockProfiler.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the profiler can be built,
+// tested and benchmarked on its own. AS::Mutex uses it when AS_LOCK_PROFILING
+// is set; otherwise nothing here is compiled in.
+
+#ifdef __cplusplus
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace AS {
+
+/**
+ * What one named lock did: how often it was taken, how often a thread had to
+ * wait for it, and how long threads waited and held it. Histograms bucket
+ * durations by powers of two nanoseconds: bucket i counts durations below 2^i,
+ * and the last bucket everything longer.
+ */
+struct LockStatistics
+{
+  static const size_t kBuckets = 32;
+
+  const char *name;
+  uint64_t acquisitions;
+  uint64_t contentions;
+  uint64_t waitNanoseconds;
+  uint64_t holdNanoseconds;
+  uint64_t waitHistogram[kBuckets];
+  uint64_t holdHistogram[kBuckets];
+
+  static size_t Bucket(uint64_t nanoseconds) {
+    size_t bucket = 0;
+    while (nanoseconds != 0 && bucket < kBuckets - 1) {
+      nanoseconds >>= 1;
+      bucket++;
+    }
+    return bucket;
+  }
+
+  void Merge(const LockStatistics &other) {
+    acquisitions += other.acquisitions;
+    contentions += other.contentions;
+    waitNanoseconds += other.waitNanoseconds;
+    holdNanoseconds += other.holdNanoseconds;
+    for (size_t i = 0; i < kBuckets; i++) {
+      waitHistogram[i] += other.waitHistogram[i];
+      holdHistogram[i] += other.holdHistogram[i];
+    }
+  }
+};
+
+/**
+ * Collects LockStatistics for every lock name.
+ *
+ * Each thread records into its own table, found through a pthread key and
+ * guarded by a mutex that only the reports ever contend for, so recording
+ * shares nothing with other threads. Reports add the tables up. A thread's
+ * table is folded into the totals when the thread exits.
+ *
+ * Names are compared by address and must live forever, like string literals
+ * and Objective-C class names do.
+ */
+class LockProfiler
+{
+public:
+  /** Profiling starts off; locks taken while it is off are not counted. */
+  static void SetEnabled(bool enabled) {
+    EnabledFlag().store(enabled, std::memory_order_relaxed);
+  }
+
+  static bool IsEnabled() {
+    return EnabledFlag().load(std::memory_order_relaxed);
+  }
+
+  static uint64_t Now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /** Records an acquisition that is not held on its own, such as a recursive lock taken again. */
+  static void RecordAcquisition(const char *name, uint64_t waitNanoseconds, bool contended) {
+    ThreadTable &table = CurrentThreadTable();
+    std::lock_guard<std::mutex> l(table.mutex);
+    AddAcquisition(table.StatisticsForName(name), waitNanoseconds, contended);
+  }
+
+  /** Records an acquisition and how long it was held, once it is released. */
+  static void RecordAcquisitionAndHold(const char *name, uint64_t waitNanoseconds, bool contended, uint64_t holdNanoseconds) {
+    ThreadTable &table = CurrentThreadTable();
+    std::lock_guard<std::mutex> l(table.mutex);
+    LockStatistics &statistics = table.StatisticsForName(name);
+    AddAcquisition(statistics, waitNanoseconds, contended);
+    statistics.holdNanoseconds += holdNanoseconds;
+    statistics.holdHistogram[LockStatistics::Bucket(holdNanoseconds)]++;
+  }
+
+  /**
+   * Totals for the `limit` most contended locks: most contentions first, then
+   * the longest total wait, then the most acquisitions.
+   */
+  static std::vector<LockStatistics> Report(size_t limit) {
+    Registry &registry = SharedRegistry();
+    std::vector<LockStatistics> totals;
+    {
+      std::lock_guard<std::mutex> l(registry.mutex);
+      totals = registry.retired;
+      for (ThreadTable *table : registry.tables) {
+        std::lock_guard<std::mutex> tl(table->mutex);
+        for (const LockStatistics &statistics : table->slots) {
+          if (statistics.name != nullptr) {
+            MergeInto(totals, statistics);
+          }
+        }
+      }
+    }
+    std::sort(totals.begin(), totals.end(), [](const LockStatistics &a, const LockStatistics &b) {
+      if (a.contentions != b.contentions) {
+        return a.contentions > b.contentions;
+      }
+      if (a.waitNanoseconds != b.waitNanoseconds) {
+        return a.waitNanoseconds > b.waitNanoseconds;
+      }
+      return a.acquisitions > b.acquisitions;
+    });
+    if (totals.size() > limit) {
+      totals.resize(limit);
+    }
+    return totals;
+  }
+
+  /** Report(limit) as a table, one lock per line. */
+  static std::string Describe(size_t limit) {
+    std::string description = "lock                                     acquired  contended   wait ms   hold ms\n";
+    for (const LockStatistics &s : Report(limit)) {
+      char line[160];
+      snprintf(line, sizeof(line), "%-40.40s %9llu %10llu %9.3f %9.3f\n", s.name,
+               (unsigned long long)s.acquisitions, (unsigned long long)s.contentions,
+               s.waitNanoseconds / 1e6, s.holdNanoseconds / 1e6);
+      description += line;
+    }
+    return description;
+  }
+
+  /** Forgets everything recorded so far. */
+  static void Reset() {
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.mutex);
+    registry.retired.clear();
+    for (ThreadTable *table : registry.tables) {
+      std::lock_guard<std::mutex> tl(table->mutex);
+      table->Clear();
+    }
+  }
+
+private:
+  // Open addressing on the name's address. Threads see few distinct names, so
+  // the table stays small and a lookup is a probe or two.
+  struct ThreadTable
+  {
+    ThreadTable() : slots(16), count(0) { Clear(); }
+
+    std::mutex mutex;
+    std::vector<LockStatistics> slots;
+    size_t count;
+
+    void Clear() {
+      std::memset(slots.data(), 0, slots.size() * sizeof(LockStatistics));
+      count = 0;
+    }
+
+    LockStatistics &StatisticsForName(const char *name) {
+      const size_t mask = slots.size() - 1;
+      for (size_t i = Hash(name) & mask;; i = (i + 1) & mask) {
+        if (slots[i].name == name) {
+          return slots[i];
+        }
+        if (slots[i].name == nullptr) {
+          if ((count + 1) * 2 > slots.size()) {
+            Grow();
+            return StatisticsForName(name);
+          }
+          count++;
+          slots[i].name = name;
+          return slots[i];
+        }
+      }
+    }
+
+    void Grow() {
+      std::vector<LockStatistics> old(slots.size() * 2);
+      old.swap(slots);
+      Clear();
+      for (const LockStatistics &statistics : old) {
+        if (statistics.name != nullptr) {
+          StatisticsForName(statistics.name) = statistics;
+        }
+      }
+    }
+
+    static size_t Hash(const char *name) {
+      uint64_t h = (uint64_t)(uintptr_t)name * 0x9E3779B97F4A7C15ull;
+      return (size_t)(h >> 32);
+    }
+  };
+
+  struct Registry
+  {
+    std::mutex mutex;
+    std::vector<ThreadTable *> tables;
+    // Totals from threads that have exited.
+    std::vector<LockStatistics> retired;
+  };
+
+  static void AddAcquisition(LockStatistics &statistics, uint64_t waitNanoseconds, bool contended) {
+    statistics.acquisitions++;
+    if (contended) {
+      statistics.contentions++;
+      statistics.waitNanoseconds += waitNanoseconds;
+    }
+    statistics.waitHistogram[LockStatistics::Bucket(waitNanoseconds)]++;
+  }
+
+  static std::atomic<bool> &EnabledFlag() {
+    static std::atomic<bool> enabled(false);
+    return enabled;
+  }
+
+  static Registry &SharedRegistry() {
+    // Never destroyed, so threads exiting during process teardown can still retire.
+    static Registry *registry = new Registry();
+    return *registry;
+  }
+
+  static void MergeInto(std::vector<LockStatistics> &totals, const LockStatistics &statistics) {
+    for (LockStatistics &total : totals) {
+      if (total.name == statistics.name) {
+        total.Merge(statistics);
+        return;
+      }
+    }
+    totals.push_back(statistics);
+  }
+
+  static void RetireThreadTable(void *value) {
+    ThreadTable *table = static_cast<ThreadTable *>(value);
+    Registry &registry = SharedRegistry();
+    {
+      std::lock_guard<std::mutex> l(registry.mutex);
+      for (const LockStatistics &statistics : table->slots) {
+        if (statistics.name != nullptr) {
+          MergeInto(registry.retired, statistics);
+        }
+      }
+      registry.tables.erase(std::find(registry.tables.begin(), registry.tables.end(), table));
+    }
+    delete table;
+  }
+
+  static pthread_key_t ThreadTableKey() {
+    static pthread_key_t key = [] {
+      pthread_key_t k;
+      pthread_key_create(&k, RetireThreadTable);
+      return k;
+    }();
+    return key;
+  }
+
+  static ThreadTable &CurrentThreadTable() {
+    const pthread_key_t key = ThreadTableKey();
+    ThreadTable *table = static_cast<ThreadTable *>(pthread_getspecific(key));
+    if (table == nullptr) {
+      table = new ThreadTable();
+      pthread_setspecific(key, table);
+      Registry &registry = SharedRegistry();
+      std::lock_guard<std::mutex> l(registry.mutex);
+      registry.tables.push_back(table);
+    }
+    return *table;
+  }
+};
+
+/**
+ * The per-lock half of the profiler, embedded in a lock. The lock calls Lock()
+ * instead of locking directly while profiling is on, and WillUnlock() before
+ * it unlocks. Only the thread holding the lock touches the probe.
+ *
+ * Acquisitions that succeed on the first try count as uncontended; the rest
+ * are timed from the failed try until the lock is taken. The outermost
+ * acquisition is recorded together with its hold when the lock is released,
+ * in a single visit to the thread's table. Recursive locks count every
+ * acquisition but time holds from the outermost one.
+ */
+class LockProbe
+{
+public:
+  LockProbe() : _name("AS::Mutex"), _acquiredAt(0), _waitNanoseconds(0), _contended(false), _depth(0) {}
+
+  void SetName(const char *name) {
+    _name = name;
+  }
+
+  template <typename TryLock, typename BlockingLock>
+  void Lock(TryLock &&tryLock, BlockingLock &&lock) {
+    if (tryLock()) {
+      DidLock(0, false);
+      return;
+    }
+    const uint64_t start = LockProfiler::Now();
+    lock();
+    DidLock(LockProfiler::Now() - start, true);
+  }
+
+  /** For a successful try_lock while profiling is on. */
+  void DidTryLock() {
+    DidLock(0, false);
+  }
+
+  void WillUnlock() {
+    if (_depth > 0 && --_depth == 0) {
+      LockProfiler::RecordAcquisitionAndHold(_name, _waitNanoseconds, _contended, LockProfiler::Now() - _acquiredAt);
+    }
+  }
+
+private:
+  void DidLock(uint64_t waitNanoseconds, bool contended) {
+    if (_depth++ == 0) {
+      _waitNanoseconds = waitNanoseconds;
+      _contended = contended;
+      _acquiredAt = LockProfiler::Now();
+    } else {
+      LockProfiler::RecordAcquisition(_name, waitNanoseconds, contended);
+    }
+  }
+
+  const char *_name;
+  uint64_t _acquiredAt;
+  uint64_t _waitNanoseconds;
+  bool _contended;
+  unsigned _depth;
+};
+
+} // namespace AS
+
+#endif /* __cplusplus */
@@ -254,6 +254,23 @@ static dispatch_once_t shared_init_predicate;
   }
 }
 
+- (void)imageWillEnterDisplayWithURL:(NSURL *)URL
+                     targetPixelSize:(CGSize)targetPixelSize
+                       callbackQueue:(dispatch_queue_t)callbackQueue
+                          completion:(void (^)(UIImage * _Nullable image))completion
+{
+  [[self sharedPINRemoteImageManager] imageWillEnterDisplayWithURL:URL processorKey:nil targetPixelSize:targetPixelSize completion:^(PINImage * _Nullable image) {
+    [ASPINRemoteImageDownloader _performWithCallbackQueue:callbackQueue work:^{
+      completion(image);
+    }];
+  }];
+}
+
+- (void)imageDidExitDisplayWithURL:(NSURL *)URL
+{
+  [[self sharedPINRemoteImageManager] imageDidExitDisplayWithURL:URL processorKey:nil];
+}
+
 - (nullable id)downloadImageWithURL:(NSURL *)URL
                         shouldRetry:(BOOL)shouldRetry
                       callbackQueue:(dispatch_queue_t)callbackQueue
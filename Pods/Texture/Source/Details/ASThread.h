@@ -99,6 +99,11 @@ ASDISPLAYNODE_INLINE void _ASUnlockScopeCleanup(id<NSLocking> __strong *lockPtr)
 #include <new>
 #include <thread>
 
+#if AS_LOCK_PROFILING
+#import <objc/runtime.h>
+#import <AsyncDisplayKit/ASLockProfiler.h>
+#endif
+
 // These macros are here for legacy reasons. We may get rid of them later.
 #define DISABLED_ASAssertLocked(m)
 #define DISABLED_ASAssertUnlocked(m)
@@ -122,6 +127,10 @@ namespace AS {
     void SetDebugNameWithObject(id object) {
 #if ASEnableVerboseLogging && ASDISPLAYNODE_ASSERTIONS_ENABLED
       _debug_name = std::string(ASObjectDescriptionMakeTiny(object).UTF8String);
+#endif
+#if AS_LOCK_PROFILING
+      // Profiles add up by class, so every node of a class shares a row.
+      _probe.SetName(class_getName(object_getClass(object)));
 #endif
     }
 
@@ -147,47 +156,35 @@ namespace AS {
     Mutex &operator=(const Mutex&) = delete;
 
     bool try_lock() {
-      bool success = false;
-      switch (_type) {
-        case Plain:
-          success = _plain.try_lock();
-          break;
-        case Recursive:
-          success = _recursive.try_lock();
-          break;
-        case Unfair:
-          success = os_unfair_lock_trylock(&_unfair);
-          break;
-        case RecursiveUnfair:
-          success = ASRecursiveUnfairLockTryLock(&_runfair);
-          break;
-      }
+      bool success = TryLockUnderlying();
       if (success) {
+#if AS_LOCK_PROFILING
+        if (LockProfiler::IsEnabled()) {
+          _probe.DidTryLock();
+        }
+#endif
         DidLock();
       }
       return success;
     }
     
     void lock() {
-      switch (_type) {
-        case Plain:
-          _plain.lock();
-          break;
-        case Recursive:
-          _recursive.lock();
-          break;
-        case Unfair:
-          os_unfair_lock_lock(&_unfair);
-          break;
-        case RecursiveUnfair:
-          ASRecursiveUnfairLockLock(&_runfair);
-          break;
+#if AS_LOCK_PROFILING
+      if (LockProfiler::IsEnabled()) {
+        _probe.Lock([this] { return TryLockUnderlying(); }, [this] { LockUnderlying(); });
+        DidLock();
+        return;
       }
+#endif
+      LockUnderlying();
       DidLock();
     }
 
     void unlock() {
       WillUnlock();
+#if AS_LOCK_PROFILING
+      _probe.WillUnlock();
+#endif
       switch (_type) {
         case Plain:
           _plain.unlock();
@@ -247,6 +244,42 @@ namespace AS {
       RecursiveUnfair
     };
 
+    bool TryLockUnderlying() {
+      bool success = false;
+      switch (_type) {
+        case Plain:
+          success = _plain.try_lock();
+          break;
+        case Recursive:
+          success = _recursive.try_lock();
+          break;
+        case Unfair:
+          success = os_unfair_lock_trylock(&_unfair);
+          break;
+        case RecursiveUnfair:
+          success = ASRecursiveUnfairLockTryLock(&_runfair);
+          break;
+      }
+      return success;
+    }
+
+    void LockUnderlying() {
+      switch (_type) {
+        case Plain:
+          _plain.lock();
+          break;
+        case Recursive:
+          _recursive.lock();
+          break;
+        case Unfair:
+          os_unfair_lock_lock(&_unfair);
+          break;
+        case RecursiveUnfair:
+          ASRecursiveUnfairLockLock(&_runfair);
+          break;
+      }
+    }
+
     void WillUnlock() {
 #if ASDISPLAYNODE_ASSERTIONS_ENABLED
 #if ASEnableVerboseLogging
@@ -285,6 +318,10 @@ namespace AS {
     std::string _debug_name;
 #endif
 
+#if AS_LOCK_PROFILING
+    LockProbe _probe;
+#endif
+
 #if ASDISPLAYNODE_ASSERTIONS_ENABLED
     std::thread::id _owner = std::thread::id();
     int _count = 0;
@@ -61,6 +61,8 @@
  * Each index 0...[self count] will be either moved from or deleted. If it is moved to the same location, we omit it.
  * Each index 0...[array count] will be the destination of ONE move or ONE insert.
  * Knowing these things means any two of the three (delete, move, insert) implies the third.
+ *
+ * When several minimal diffs exist, which one is returned is unspecified.
  */
 
 @interface NSArray (Diffing)
@@ -68,24 +70,24 @@
 /**
  * @abstract Compares two arrays, providing the insertion and deletion indexes needed to transform into the target array.
  * @discussion This compares the equality of each object with `isEqual:`.
- * This diffing algorithm uses a bottom-up memoized longest common subsequence solution to identify differences.
- * It runs in O(mn) complexity.
+ * This diffing algorithm finds a longest common subsequence with Myers' linear space algorithm (see ASArrayDiff.h).
+ * It runs in O((m+n)d) time for d differences, and in linear time when the arrays only differ at one end.
  */
 - (void)asdk_diffWithArray:(NSArray *)array insertions:(NSIndexSet **)insertions deletions:(NSIndexSet **)deletions;
 
 /**
  * @abstract Compares two arrays, providing the insertion and deletion indexes needed to transform into the target array.
  * @discussion The `compareBlock` is used to identify the equality of the objects within the arrays.
- * This diffing algorithm uses a bottom-up memoized longest common subsequence solution to identify differences.
- * It runs in O(mn) complexity.
+ * This diffing algorithm finds a longest common subsequence with Myers' linear space algorithm (see ASArrayDiff.h).
+ * It runs in O((m+n)d) time for d differences, and in linear time when the arrays only differ at one end.
  */
 - (void)asdk_diffWithArray:(NSArray *)array insertions:(NSIndexSet **)insertions deletions:(NSIndexSet **)deletions compareBlock:(BOOL (^)(id lhs, id rhs))comparison;
 
 /**
  * @abstract Compares two arrays, providing the insertion, deletion, and move indexes needed to transform into the target array.
  * @discussion This compares the equality of each object with `isEqual:`.
- * This diffing algorithm uses a bottom-up memoized longest common subsequence solution to identify differences.
- * It runs in O(mn) complexity.
+ * This diffing algorithm finds a longest common subsequence with Myers' linear space algorithm (see ASArrayDiff.h).
+ * It runs in O((m+n)d) time for d differences, and in linear time when the arrays only differ at one end.
  * The moves are returned in ascending order of their destination index.
  */
 - (void)asdk_diffWithArray:(NSArray *)array insertions:(NSIndexSet **)insertions deletions:(NSIndexSet **)deletions moves:(NSArray<NSIndexPath *> **)moves;
@@ -10,7 +10,17 @@
 #import <AsyncDisplayKit/NSArray+Diffing.h>
 #import <UIKit/NSIndexPath+UIKitAdditions.h>
 #import <AsyncDisplayKit/ASAssert.h>
-#import <unordered_map>
+#import <AsyncDisplayKit/ASArrayDiff.h>
+#import <vector>
+
+static NSMutableIndexSet *ASIndexSetWithIndexes(const std::vector<size_t> &indexes)
+{
+  NSMutableIndexSet *set = [NSMutableIndexSet indexSet];
+  for (size_t index : indexes) {
+    [set addIndex:index];
+  }
+  return set;
+}
 
 @implementation NSArray (Diffing)
 
@@ -37,126 +47,48 @@ typedef BOOL (^compareBlock)(id _Nonnull lhs, id _Nonnull rhs);
 - (void)asdk_diffWithArray:(NSArray *)array insertions:(NSIndexSet **)insertions deletions:(NSIndexSet **)deletions
                      moves:(NSArray<NSIndexPath *> **)moves compareBlock:(compareBlock)comparison
 {
-  struct NSObjectHash
-  {
-    std::size_t operator()(id <NSObject> k) const { return (std::size_t) [k hash]; };
-  };
-  struct NSObjectCompare
-  {
-    bool operator()(id <NSObject> lhs, id <NSObject> rhs) const { return (bool) [lhs isEqual:rhs]; };
-  };
-  std::unordered_multimap<unowned id, NSUInteger, NSObjectHash, NSObjectCompare> potentialMoves;
-
   NSAssert(comparison != nil, @"Comparison block is required");
   NSAssert(moves == nil || comparison == [NSArray defaultCompareBlock], @"move detection requires isEqual: and hash (no custom compare)");
-  NSMutableArray<NSIndexPath *> *moveIndexPaths = nil;
-  NSMutableIndexSet *insertionIndexes = nil, *deletionIndexes = nil;
-  if (moves) {
-    moveIndexPaths = [NSMutableArray new];
-  }
-  NSMutableIndexSet *commonIndexes = [self _asdk_commonIndexesWithArray:array compareBlock:comparison];
-
-  if (deletions || moves) {
-    deletionIndexes = [NSMutableIndexSet indexSet];
-    NSUInteger i = 0;
-    for (id element in self) {
-      if (![commonIndexes containsIndex:i]) {
-        [deletionIndexes addIndex:i];
-      }
-      if (moves) {
-        potentialMoves.insert(std::pair<id, NSUInteger>(element, i));
-      }
-      ++i;
-    }
-  }
 
-  if (insertions || moves) {
-    insertionIndexes = [NSMutableIndexSet indexSet];
-    NSArray *commonObjects = [self objectsAtIndexes:commonIndexes];
-    for (NSUInteger i = 0, j = 0; j < array.count; j++) {
-      auto moveFound = potentialMoves.find(array[j]);
-      NSUInteger movedFrom = NSNotFound;
-      if (moveFound != potentialMoves.end() && moveFound->second != j) {
-        movedFrom = moveFound->second;
-        potentialMoves.erase(moveFound);
-        [moveIndexPaths addObject:[NSIndexPath indexPathForItem:j inSection:movedFrom]];
-      }
-      if (i < commonObjects.count && j < array.count && comparison(commonObjects[i], array[j])) {
-        i++;
-      } else {
-        if (movedFrom != NSNotFound) {
-          // moves will coalesce a delete / insert - the insert is just not done, and here we remove the delete:
-          [deletionIndexes removeIndex:movedFrom];
-          // OR a move will have come from the LCS:
-          if ([commonIndexes containsIndex:movedFrom]) {
-            [commonIndexes removeIndex:movedFrom];
-            commonObjects = [self objectsAtIndexes:commonIndexes];
-          }
-        } else {
-          [insertionIndexes addIndex:j];
-        }
-      }
+  // Copy the elements out once, so the diff runs over plain C arrays.
+  const NSUInteger selfCount = self.count;
+  const NSUInteger arrayCount = array.count;
+  std::vector<unowned id> selfObjects(selfCount), arrayObjects(arrayCount);
+  [self getObjects:selfObjects.data() range:NSMakeRange(0, selfCount)];
+  [array getObjects:arrayObjects.data() range:NSMakeRange(0, arrayCount)];
+
+  // With isEqual:, precomputed hashes rule out most pairs without a message send.
+  AS::ArrayDiff diff;
+  if (comparison == [NSArray defaultCompareBlock]) {
+    std::vector<uint64_t> selfHashes(selfCount), arrayHashes(arrayCount);
+    for (NSUInteger i = 0; i < selfCount; i++) {
+      selfHashes[i] = [selfObjects[i] hash];
     }
+    for (NSUInteger j = 0; j < arrayCount; j++) {
+      arrayHashes[j] = [arrayObjects[j] hash];
+    }
+    AS::DiffArrays(selfCount, arrayCount, selfHashes.data(), arrayHashes.data(), [&](size_t i, size_t j) {
+      return (bool)[selfObjects[i] isEqual:arrayObjects[j]];
+    }, moves != nil, diff);
+  } else {
+    AS::DiffArrays(selfCount, arrayCount, nullptr, nullptr, [&](size_t i, size_t j) {
+      return (bool)comparison(selfObjects[i], arrayObjects[j]);
+    }, false, diff);
   }
 
-  if (moves) {*moves = moveIndexPaths;}
-  if (deletions) {*deletions = deletionIndexes;}
-  if (insertions) {*insertions = insertionIndexes;}
-}
-
-// https://github.com/raywenderlich/swift-algorithm-club/tree/master/Longest%20Common%20Subsequence is not exactly this code (obviously), but
-// is a good commentary on the algorithm.
-- (NSMutableIndexSet *)_asdk_commonIndexesWithArray:(NSArray *)array compareBlock:(BOOL (^)(id lhs, id rhs))comparison
-{
-  NSAssert(comparison != nil, @"Comparison block is required");
-
-  NSInteger selfCount = self.count;
-  NSInteger arrayCount = array.count;
-
-  // Allocate the diff map in the heap so we don't blow the stack for large arrays.
-  NSInteger **lengths = NULL;
-  lengths = (NSInteger **)malloc(sizeof(NSInteger*) * (selfCount+1));
-  if (lengths == NULL) {
-    ASDisplayNodeFailAssert(@"Failed to allocate memory for diffing");
-    return nil;
-  }
-  // Fill in a LCS length matrix:
-  for (NSInteger i = 0; i <= selfCount; i++) {
-    lengths[i] = (NSInteger *)malloc(sizeof(NSInteger) * (arrayCount+1));
-    if (lengths[i] == NULL) {
-      ASDisplayNodeFailAssert(@"Failed to allocate memory for diffing");
-      return nil;
-    }
-    id selfObj = i > 0 ? self[i-1] : nil;
-    for (NSInteger j = 0; j <= arrayCount; j++) {
-      if (i == 0 || j == 0) {
-        lengths[i][j] = 0;
-      } else if (comparison(selfObj, array[j-1])) {
-        lengths[i][j] = 1 + lengths[i-1][j-1];
-      } else {
-        lengths[i][j] = MAX(lengths[i-1][j], lengths[i][j-1]);
-      }
+  if (moves) {
+    NSMutableArray<NSIndexPath *> *moveIndexPaths = [[NSMutableArray alloc] initWithCapacity:diff.moves.size()];
+    for (const auto &move : diff.moves) {
+      [moveIndexPaths addObject:[NSIndexPath indexPathForItem:move.second inSection:move.first]];
     }
+    *moves = moveIndexPaths;
   }
-  // Backtrack to fill in indices based on length matrix:
-  NSMutableIndexSet *common = [NSMutableIndexSet indexSet];
-  NSInteger i = selfCount, j = arrayCount;
-  while(i > 0 && j > 0) {
-    if (comparison(self[i-1], array[j-1])) {
-      [common addIndex:(i-1)];
-      i--; j--;
-    } else if (lengths[i-1][j] > lengths[i][j-1]) {
-      i--;
-    } else {
-      j--;
-    }
+  if (deletions) {
+    *deletions = ASIndexSetWithIndexes(diff.deletions);
   }
-
-  for (NSInteger i = 0; i <= selfCount; i++) {
-    free(lengths[i]);
+  if (insertions) {
+    *insertions = ASIndexSetWithIndexes(diff.insertions);
   }
-  free(lengths);
-  return common;
 }
 
 static compareBlock defaultCompare = nil;
@@ -12,7 +12,7 @@
 #import <AsyncDisplayKit/_ASAsyncTransactionGroup.h>
 #import <AsyncDisplayKit/ASAssert.h>
 #import <AsyncDisplayKit/ASThread.h>
-#import <list>
+#import <AsyncDisplayKit/ASWorkStealingExecutor.h>
 #import <map>
 
 #ifndef __STRICT_ANSI__
@@ -61,7 +61,8 @@ NSInteger const ASDefaultTransactionPriority = 0;
 
 @end
 
-// Lightweight operation queue for _ASAsyncTransaction that limits number of spawned threads
+// Lightweight operation queue for _ASAsyncTransaction that limits number of spawned threads.
+// Each dispatch queue gets a work-stealing executor whose workers are blocks dispatched onto it.
 class ASAsyncTransactionQueue
 {
 public:
@@ -86,6 +87,9 @@ public:
     // wait until all scheduled blocks finished executing
     virtual void wait() = 0;
     
+    // scheduled blocks that have not started yet will not be executed
+    virtual void cancel() = 0;
+    
   protected:
     virtual ~Group() { }; // call release() instead
   };
@@ -97,19 +101,11 @@ public:
   
 private:
   
-  struct GroupNotify
-  {
-    dispatch_block_t _block;
-    dispatch_queue_t _queue;
-  };
-  
-  class GroupImpl : public Group
+  class GroupImpl : public Group, public AS::WorkGroup
   {
   public:
     GroupImpl(ASAsyncTransactionQueue &queue)
-      : _pendingOperations(0)
-      , _releaseCalled(false)
-      , _queue(queue)
+      : _queue(queue)
     {
     }
     
@@ -119,36 +115,30 @@ private:
     virtual void enter();
     virtual void leave();
     virtual void wait();
+    virtual void cancel();
     
-    int _pendingOperations;
-    std::list<GroupNotify> _notifyList;
-    std::condition_variable _condition;
-    BOOL _releaseCalled;
     ASAsyncTransactionQueue &_queue;
   };
   
-  struct Operation
+  class Operation : public AS::WorkItem
   {
-    dispatch_block_t _block;
-    GroupImpl *_group;
-    NSInteger _priority;
-  };
+  public:
+    Operation(dispatch_block_t block) : _block(block) { }
     
-  struct DispatchEntry // entry for each dispatch queue
-  {
-    typedef std::list<Operation> OperationQueue;
-    typedef std::list<OperationQueue::iterator> OperationIteratorList; // each item points to operation queue
-    typedef std::map<NSInteger, OperationIteratorList> OperationPriorityMap; // sorted by priority
-
-    OperationQueue _operationQueue;
-    OperationPriorityMap _operationPriorityMap;
-    int _threadCount;
-      
-    Operation popNextOperation(bool respectPriority);  // assumes locked mutex
-    void pushOperation(Operation operation);           // assumes locked mutex
+    virtual void Perform(bool canceled)
+    {
+      if (!canceled) {
+        _block();
+      }
+    }
+    
+    dispatch_block_t _block;
   };
   
-  std::map<dispatch_queue_t, DispatchEntry> _entries;
+  AS::WorkStealingExecutor &executorForQueue(dispatch_queue_t queue);
+  
+  // Executors live as long as the process; there is one per target queue, usually only a few.
+  std::map<dispatch_queue_t, AS::WorkStealingExecutor *> _executors;
   std::mutex _mutex;
 };
 
@@ -158,155 +148,73 @@ ASAsyncTransactionQueue::Group* ASAsyncTransactionQueue::createGroup()
   return res;
 }
 
-void ASAsyncTransactionQueue::GroupImpl::release()
+AS::WorkStealingExecutor &ASAsyncTransactionQueue::executorForQueue(dispatch_queue_t queue)
 {
-  std::lock_guard<std::mutex> l(_queue._mutex);
+  std::lock_guard<std::mutex> l(_mutex);
   
-  if (_pendingOperations == 0)  {
-    delete this;
-  } else {
-    _releaseCalled = YES;
+  AS::WorkStealingExecutor *&executor = _executors[queue];
+  if (executor == nullptr) {
+#if ASDISPLAYNODE_DELAY_DISPLAY
+    unsigned maxWorkers = 1;
+#else
+    unsigned maxWorkers = (unsigned)[NSProcessInfo processInfo].activeProcessorCount * 2;
+#endif
+    executor = new AS::WorkStealingExecutor(maxWorkers, [queue](AS::WorkStealingExecutor &e) {
+      AS::WorkStealingExecutor *target = &e;
+      dispatch_async(queue, ^{
+        target->RunWorker();
+      });
+    });
   }
+  return *executor;
 }
 
-ASAsyncTransactionQueue::Operation ASAsyncTransactionQueue::DispatchEntry::popNextOperation(bool respectPriority)
-{
-  NSCAssert(!_operationQueue.empty() && !_operationPriorityMap.empty(), @"No scheduled operations available");
-
-  OperationQueue::iterator queueIterator;
-  OperationPriorityMap::iterator mapIterator;
-  
-  if (respectPriority) {
-    mapIterator = --_operationPriorityMap.end();  // highest priority "bucket"
-    queueIterator = *mapIterator->second.begin();
-  } else {
-    queueIterator = _operationQueue.begin();
-    mapIterator = _operationPriorityMap.find(queueIterator->_priority);
-  }
-  
-  // no matter what, first item in "bucket" must match item in queue
-  NSCAssert(mapIterator->second.front() == queueIterator, @"Queue inconsistency");
-  
-  Operation res = *queueIterator;
-  _operationQueue.erase(queueIterator);
-  
-  mapIterator->second.pop_front();
-  if (mapIterator->second.empty()) {
-    _operationPriorityMap.erase(mapIterator);
-  }
-
-  return res;
-}
-
-void ASAsyncTransactionQueue::DispatchEntry::pushOperation(ASAsyncTransactionQueue::Operation operation)
+void ASAsyncTransactionQueue::GroupImpl::release()
 {
-  _operationQueue.push_back(operation);
-
-  OperationIteratorList &list = _operationPriorityMap[operation._priority];
-  list.push_back(--_operationQueue.end());
+  Release();
 }
 
 void ASAsyncTransactionQueue::GroupImpl::schedule(NSInteger priority, dispatch_queue_t queue, dispatch_block_t block)
 {
-  ASAsyncTransactionQueue &q = _queue;
-  std::lock_guard<std::mutex> l(q._mutex);
-  
-  DispatchEntry &entry = q._entries[queue];
-  
-  Operation operation;
-  operation._block = block;
-  operation._group = this;
-  operation._priority = priority;
-  entry.pushOperation(operation);
+  AS::WorkStealingExecutor &executor = _queue.executorForQueue(queue);
   
-  ++_pendingOperations; // enter group
-  
-#if ASDISPLAYNODE_DELAY_DISPLAY
-  NSUInteger maxThreads = 1;
-#else 
-  NSUInteger maxThreads = [NSProcessInfo processInfo].activeProcessorCount * 2;
-
+  unsigned maxThreads = executor.MaxWorkers();
+#if !ASDISPLAYNODE_DELAY_DISPLAY
   // Bit questionable maybe - we can give main thread more CPU time during tracking.
-  if ([[NSRunLoop mainRunLoop].currentMode isEqualToString:UITrackingRunLoopMode])
+  if ([[NSRunLoop mainRunLoop].currentMode isEqualToString:UITrackingRunLoopMode] && maxThreads > 1)
     --maxThreads;
 #endif
   
-  if (entry._threadCount < maxThreads) { // we need to spawn another thread
-
-    // first thread will take operations in queue order (regardless of priority), other threads will respect priority
-    bool respectPriority = entry._threadCount > 0;
-    ++entry._threadCount;
-    
-    dispatch_async(queue, ^{
-      std::unique_lock<std::mutex> lock(q._mutex);
-      
-      // go until there are no more pending operations
-      while (!entry._operationQueue.empty()) {
-        Operation operation = entry.popNextOperation(respectPriority);
-        lock.unlock();
-        if (operation._block) {
-          operation._block();
-        }
-        operation._group->leave();
-        operation._block = nil; // the block must be freed while mutex is unlocked
-        lock.lock();
-      }
-      --entry._threadCount;
-      
-      if (entry._threadCount == 0) {
-        NSCAssert(entry._operationQueue.empty() || entry._operationPriorityMap.empty(), @"No working threads but operations are still scheduled"); // this shouldn't happen
-        q._entries.erase(queue);
-      }
-    });
-  }
+  // Above, at and below the default priority. Within a lane operations run in queue order.
+  int lane = priority > ASDefaultTransactionPriority ? 0 : (priority == ASDefaultTransactionPriority ? 1 : 2);
+  Schedule(executor, new Operation(block), lane, maxThreads);
 }
 
 void ASAsyncTransactionQueue::GroupImpl::notify(dispatch_queue_t queue, dispatch_block_t block)
 {
-  std::lock_guard<std::mutex> l(_queue._mutex);
-
-  if (_pendingOperations == 0) {
+  Notify([queue, block] {
     dispatch_async(queue, block);
-  } else {
-    _notifyList.push_back({block, queue});
-  }
+  });
 }
 
 void ASAsyncTransactionQueue::GroupImpl::enter()
 {
-  std::lock_guard<std::mutex> l(_queue._mutex);
-  ++_pendingOperations;
+  Enter();
 }
 
 void ASAsyncTransactionQueue::GroupImpl::leave()
 {
-  std::lock_guard<std::mutex> l(_queue._mutex);
-  --_pendingOperations;
-  
-  if (_pendingOperations == 0) {
-    std::list<GroupNotify> notifyList;
-    _notifyList.swap(notifyList);
-    
-    for (GroupNotify & notify : notifyList) {
-      dispatch_async(notify._queue, notify._block);
-    }
-    
-    _condition.notify_one();
-    
-    // there was attempt to release the group before, but we still
-    // had operations scheduled so now is good time
-    if (_releaseCalled) {
-      delete this;
-    }
-  }
+  Leave();
 }
 
 void ASAsyncTransactionQueue::GroupImpl::wait()
 {
-  std::unique_lock<std::mutex> lock(_queue._mutex);
-  while (_pendingOperations > 0) {
-    _condition.wait(lock);
-  }
+  Wait();
+}
+
+void ASAsyncTransactionQueue::GroupImpl::cancel()
+{
+  Cancel();
 }
 
 ASAsyncTransactionQueue & ASAsyncTransactionQueue::instance()
@@ -374,6 +282,9 @@ ASAsyncTransactionQueue & ASAsyncTransactionQueue::instance()
   ASDisplayNodeAssertMainThread();
   NSAssert(self.state != ASAsyncTransactionStateOpen, @"You can only cancel a committed or already-canceled transaction");
   self.state = ASAsyncTransactionStateCanceled;
+  if (_group) {
+    _group->cancel();
+  }
 }
 
 - (void)commit
@@ -127,6 +127,9 @@ ASDK_EXTERN ASLayout *ASCalculateLayout(id<ASLayoutElement>layoutElement, const
 
 /**
  * Traverses the existing layout tree and generates a new tree that represents only ASDisplayNode layouts
+ *
+ * @discussion The sublayouts of the result are kept as plain frames, and their ASLayout objects are only made on first
+ * access to -sublayouts. -frameForElement: and -isEqual: don't need them.
  */
 - (ASLayout *)filteredNodeLayoutTree NS_RETURNS_RETAINED AS_WARN_UNUSED_RESULT;
 
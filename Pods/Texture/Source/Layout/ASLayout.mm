@@ -10,9 +10,11 @@
 #import <AsyncDisplayKit/ASLayout.h>
 
 #import <atomic>
-#import <queue>
+#import <pthread.h>
+#import <vector>
 
 #import <AsyncDisplayKit/ASCollections.h>
+#import <AsyncDisplayKit/ASFlatLayoutTree.h>
 #import <AsyncDisplayKit/ASLayoutSpecUtilities.h>
 #import <AsyncDisplayKit/ASLayoutSpec+Subclasses.h>
 
@@ -48,16 +50,79 @@ ASDISPLAYNODE_INLINE AS_WARN_UNUSED_RESULT BOOL ASLayoutIsDisplayNodeType(ASLayo
   return layout.type == ASLayoutElementTypeDisplayNode;
 }
 
+/**
+ * A sublayout of a flattened layout, kept as plain values until its ASLayout is asked for. The flattened layout retains
+ * the element.
+ */
+struct ASFlatSublayout {
+  unowned id<ASLayoutElement> element;
+  CGSize size;
+  CGPoint position;
+};
+
+typedef AS::FlatLayoutTree<unowned ASLayout *, CGPoint> ASFlatLayoutTree;
+
+/**
+ * Flattening walks into this, one tree per thread, so its storage is reused from one layout pass to the next.
+ */
+static ASFlatLayoutTree &flatLayoutTree()
+{
+  static pthread_key_t k;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    pthread_key_create(&k, [](void *tree) { delete static_cast<ASFlatLayoutTree *>(tree); });
+  });
+  auto tree = static_cast<ASFlatLayoutTree *>(pthread_getspecific(k));
+  if (tree == nullptr) {
+    tree = new ASFlatLayoutTree();
+    pthread_setspecific(k, tree);
+  }
+  return *tree;
+}
+
+ASDISPLAYNODE_INLINE CGRect ASLayoutFrame(CGPoint position, CGSize size)
+{
+  CGRect subnodeFrame = CGRectZero;
+  CGPoint adjustedOrigin = position;
+  if (isfinite(adjustedOrigin.x) == NO) {
+    ASDisplayNodeCAssert(0, @"Layout has an invalid position");
+    adjustedOrigin.x = 0;
+  }
+  if (isfinite(adjustedOrigin.y) == NO) {
+    ASDisplayNodeCAssert(0, @"Layout has an invalid position");
+    adjustedOrigin.y = 0;
+  }
+  subnodeFrame.origin = adjustedOrigin;
+  
+  CGSize adjustedSize = size;
+  if (isfinite(adjustedSize.width) == NO) {
+    ASDisplayNodeCAssert(0, @"Layout has an invalid size");
+    adjustedSize.width = 0;
+  }
+  if (isfinite(adjustedSize.height) == NO) {
+    ASDisplayNodeCAssert(0, @"Layout has an invalid position");
+    adjustedSize.height = 0;
+  }
+  subnodeFrame.size = adjustedSize;
+  
+  return subnodeFrame;
+}
+
 @interface ASLayout () <ASDescriptionProvider>
 {
   ASLayoutElementType _layoutElementType;
   std::atomic_bool _retainSublayoutElements;
+  // A flattened layout keeps its sublayouts here rather than in _sublayouts. The ASLayouts are made on first access to
+  // -sublayouts and published here, +1. Until then, frames and equality are answered from _flatSublayouts.
+  std::vector<ASFlatSublayout> _flatSublayouts;
+  std::atomic<CFTypeRef> _materializedSublayouts;
 }
 @end
 
 @implementation ASLayout
 
 @dynamic frame, type;
+@synthesize sublayouts = _sublayouts;
 
 static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(NO);
 
@@ -115,6 +180,26 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
   return self;
 }
 
+/**
+ * A flattened layout with null position, whose sublayouts are made from `flatSublayouts` when first asked for. Takes
+ * the contents of the vector, and retains the elements until the layout is deallocated.
+ */
+- (instancetype)initWithLayoutElement:(id<ASLayoutElement>)layoutElement
+                                 size:(CGSize)size
+                       flatSublayouts:(std::vector<ASFlatSublayout> &)flatSublayouts
+{
+  self = [self initWithLayoutElement:layoutElement size:size position:ASPointNull sublayouts:nil];
+  if (self) {
+    _flatSublayouts.swap(flatSublayouts);
+    // The designated initializer may have marked the elements retained already, while there were none.
+    _retainSublayoutElements.store(true);
+    for (const ASFlatSublayout &sublayout : _flatSublayouts) {
+      CFBridgingRetain(sublayout.element);
+    }
+  }
+  return self;
+}
+
 #pragma mark - Class Constructors
 
 + (instancetype)layoutWithLayoutElement:(id<ASLayoutElement>)layoutElement
@@ -155,6 +240,14 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
         CFRelease(cfElement);
       }
     }
+    for (const ASFlatSublayout &sublayout : _flatSublayouts) {
+      if (CFTypeRef cfElement = (__bridge CFTypeRef)sublayout.element) {
+        CFRelease(cfElement);
+      }
+    }
+  }
+  if (CFTypeRef sublayouts = _materializedSublayouts.load()) {
+    CFRelease(sublayouts);
   }
 }
 
@@ -170,6 +263,49 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
     // CFBridgingRetain atomically casts and retains. We need the atomicity.
     CFBridgingRetain(sublayout->_layoutElement);
   }
+  for (const ASFlatSublayout &sublayout : _flatSublayouts) {
+    CFBridgingRetain(sublayout.element);
+  }
+}
+
+#pragma mark - Sublayouts
+
+/**
+ * The number of sublayouts, without making the ASLayouts of a flattened layout.
+ */
+ASDISPLAYNODE_INLINE NSUInteger ASLayoutSublayoutCount(ASLayout *layout)
+{
+  return layout->_flatSublayouts.empty() ? layout->_sublayouts.count : layout->_flatSublayouts.size();
+}
+
+- (NSArray<ASLayout *> *)sublayouts
+{
+  if (_flatSublayouts.empty()) {
+    return _sublayouts;
+  }
+  if (CFTypeRef sublayouts = _materializedSublayouts.load(std::memory_order_acquire)) {
+    return (__bridge NSArray *)sublayouts;
+  }
+  
+  std::vector<ASLayout *> layouts;
+  layouts.reserve(_flatSublayouts.size());
+  for (const ASFlatSublayout &sublayout : _flatSublayouts) {
+    layouts.push_back([ASLayout layoutWithLayoutElement:sublayout.element
+                                                   size:sublayout.size
+                                               position:sublayout.position
+                                             sublayouts:nil]);
+  }
+  NSArray *array = [NSArray arrayByTransferring:layouts.data() count:layouts.size()];
+  
+  // Another thread may have got here first. Everyone must see the same objects, since callers such as the
+  // right-to-left flip move them.
+  CFTypeRef expected = nullptr;
+  CFTypeRef desired = CFBridgingRetain(array);
+  if (_materializedSublayouts.compare_exchange_strong(expected, desired, std::memory_order_acq_rel)) {
+    return array;
+  }
+  CFRelease(desired);
+  return (__bridge NSArray *)expected;
 }
 
 #pragma mark - Layout Flattening
@@ -182,7 +318,7 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
   }
   
   for (ASLayout *sublayout in _sublayouts) {
-    if (ASLayoutIsDisplayNodeType(sublayout) == NO || sublayout->_sublayouts.count > 0) {
+    if (ASLayoutIsDisplayNodeType(sublayout) == NO || ASLayoutSublayoutCount(sublayout) > 0) {
       return NO;
     }
   }
@@ -198,56 +334,41 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
     return self;
   }
   
-  struct Context {
-    unowned ASLayout *layout;
-    CGPoint absolutePosition;
-  };
-  
-  // Queue used to keep track of sublayouts while traversing this layout in a DFS fashion.
-  std::deque<Context> queue;
-  for (ASLayout *sublayout in _sublayouts) {
-    queue.push_back({sublayout, sublayout.position});
-  }
-  
-  std::vector<ASLayout *> flattenedSublayouts;
+  // One walk lays the tree out as records in the thread's flat tree; only the nodes are kept.
+  ASFlatLayoutTree &tree = flatLayoutTree();
+  tree.Build(self, [](unowned ASLayout *layout) {
+    return ASLayoutIsDisplayNodeType(layout);
+  }, [](unowned ASLayout *layout) {
+    return layout->_position;
+  }, [](unowned ASLayout *layout, std::vector<unowned ASLayout *> &children) {
+    // Nodes are never walked into, so this only makes the sublayouts of a flattened layout that isn't a node's.
+    NSArray<ASLayout *> *sublayouts = layout->_flatSublayouts.empty() ? layout->_sublayouts : layout.sublayouts;
+    const NSUInteger count = sublayouts.count;
+    if (count > 0) {
+      children.resize(count);
+      [sublayouts getObjects:children.data() range:NSMakeRange(0, count)];
+    }
+  });
   
-  while (!queue.empty()) {
-    const Context context = std::move(queue.front());
-    queue.pop_front();
-    
-    unowned ASLayout *layout = context.layout;
-    // Direct ivar access to avoid retain/release, use existing +1.
-    const NSUInteger sublayoutsCount = layout->_sublayouts.count;
-    const CGPoint absolutePosition = context.absolutePosition;
-    
-    if (ASLayoutIsDisplayNodeType(layout)) {
-      if (sublayoutsCount > 0 || CGPointEqualToPoint(ASCeilPointValues(absolutePosition), layout.position) == NO) {
-        // Only create a new layout if the existing one can't be reused, which means it has either some sublayouts or an invalid absolute position.
-        const auto newLayout = [ASLayout layoutWithLayoutElement:layout->_layoutElement
-                                                     size:layout.size
-                                                 position:absolutePosition
-                                               sublayouts:@[]];
-        flattenedSublayouts.push_back(newLayout);
-      } else {
-        flattenedSublayouts.push_back(layout);
-      }
-    } else if (sublayoutsCount > 0) {
-      // Fast-reverse-enumerate the sublayouts array by copying it into a C-array and push_front'ing each into the queue.
-      unowned ASLayout *rawSublayouts[sublayoutsCount];
-      [layout->_sublayouts getObjects:rawSublayouts range:NSMakeRange(0, sublayoutsCount)];
-      for (NSInteger i = sublayoutsCount - 1; i >= 0; i--) {
-        queue.push_front({rawSublayouts[i], absolutePosition + rawSublayouts[i].position});
-      }
+  // No ASLayouts are made for the nodes until someone asks for -sublayouts. Display only needs their frames.
+  std::vector<ASFlatSublayout> flatSublayouts;
+  flatSublayouts.reserve(tree.NodeCount());
+  for (const ASFlatLayoutTree::Record &record : tree) {
+    if (record.isNode) {
+      unowned ASLayout *layout = record.layout;
+      flatSublayouts.push_back({layout->_layoutElement, layout->_size, ASCeilPointValues(record.position)});
     }
   }
+  tree.Reset();
   
-  NSArray *array = [NSArray arrayByTransferring:flattenedSublayouts.data() count:flattenedSublayouts.size()];
-  // flattenedSublayouts is now all nils.
-  
-  ASLayout *layout = [ASLayout layoutWithLayoutElement:_layoutElement size:_size sublayouts:array];
-  // All flattened layouts must retain sublayout elements until they are applied.
-  [layout retainSublayoutElements];
-  return layout;
+  if (flatSublayouts.empty()) {
+    ASLayout *layout = [ASLayout layoutWithLayoutElement:_layoutElement size:_size sublayouts:@[]];
+    // All flattened layouts must retain sublayout elements until they are applied.
+    [layout retainSublayoutElements];
+    return layout;
+  }
+  // All flattened layouts must retain sublayout elements until they are applied, which this does.
+  return [[ASLayout alloc] initWithLayoutElement:_layoutElement size:_size flatSublayouts:flatSublayouts];
 }
 
 #pragma mark - Equality Checking
@@ -267,7 +388,22 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
         || CGPointEqualToPoint(self.position, layout.position))) return NO;
   if (_layoutElement != layout.layoutElement) return NO;
 
-  if (!ASObjectIsEqual(_sublayouts, layout.sublayouts)) {
+  // Two flattened layouts compare their sublayouts' values, unless some of those have been made and maybe moved.
+  if (!_flatSublayouts.empty() && !layout->_flatSublayouts.empty()
+      && _materializedSublayouts.load(std::memory_order_acquire) == nullptr
+      && layout->_materializedSublayouts.load(std::memory_order_acquire) == nullptr) {
+    if (_flatSublayouts.size() != layout->_flatSublayouts.size()) return NO;
+    for (size_t i = 0; i < _flatSublayouts.size(); i++) {
+      const ASFlatSublayout &a = _flatSublayouts[i];
+      const ASFlatSublayout &b = layout->_flatSublayouts[i];
+      if (a.element != b.element || !CGSizeEqualToSize(a.size, b.size) || !CGPointEqualToPoint(a.position, b.position)) {
+        return NO;
+      }
+    }
+    return YES;
+  }
+
+  if (!ASObjectIsEqual(self.sublayouts, layout.sublayouts)) {
     return NO;
   }
 
@@ -283,7 +419,15 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
 
 - (CGRect)frameForElement:(id<ASLayoutElement>)layoutElement
 {
-  for (ASLayout *l in _sublayouts) {
+  if (!_flatSublayouts.empty() && _materializedSublayouts.load(std::memory_order_acquire) == nullptr) {
+    for (const ASFlatSublayout &sublayout : _flatSublayouts) {
+      if (sublayout.element == layoutElement) {
+        return ASLayoutFrame(sublayout.position, sublayout.size);
+      }
+    }
+    return CGRectNull;
+  }
+  for (ASLayout *l in self.sublayouts) {
     if (l->_layoutElement == layoutElement) {
       return l.frame;
     }
@@ -293,30 +437,7 @@ static std::atomic_bool static_retainsSublayoutLayoutElements = ATOMIC_VAR_INIT(
 
 - (CGRect)frame
 {
-  CGRect subnodeFrame = CGRectZero;
-  CGPoint adjustedOrigin = _position;
-  if (isfinite(adjustedOrigin.x) == NO) {
-    ASDisplayNodeAssert(0, @"Layout has an invalid position");
-    adjustedOrigin.x = 0;
-  }
-  if (isfinite(adjustedOrigin.y) == NO) {
-    ASDisplayNodeAssert(0, @"Layout has an invalid position");
-    adjustedOrigin.y = 0;
-  }
-  subnodeFrame.origin = adjustedOrigin;
-  
-  CGSize adjustedSize = _size;
-  if (isfinite(adjustedSize.width) == NO) {
-    ASDisplayNodeAssert(0, @"Layout has an invalid size");
-    adjustedSize.width = 0;
-  }
-  if (isfinite(adjustedSize.height) == NO) {
-    ASDisplayNodeAssert(0, @"Layout has an invalid position");
-    adjustedSize.height = 0;
-  }
-  subnodeFrame.size = adjustedSize;
-  
-  return subnodeFrame;
+  return ASLayoutFrame(_position, _size);
 }
 
 #pragma mark - Description
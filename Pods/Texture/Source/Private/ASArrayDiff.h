@@ -0,0 +1,244 @@
+//
+//  ASArrayDiff.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the diff can be built and
+// benchmarked on its own. NSArray+Diffing is the Objective-C front end.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace AS {
+
+/**
+ * Changes that turn an old sequence into a new one, in the format documented
+ * in NSArray+Diffing.h. All indexes are ascending; moves are (from, to) pairs
+ * in ascending order of `to`.
+ */
+struct ArrayDiff
+{
+  std::vector<size_t> insertions;
+  std::vector<size_t> deletions;
+  std::vector<std::pair<size_t, size_t>> moves;
+};
+
+namespace diff_detail {
+
+// Myers, "An O(ND) Difference Algorithm and Its Variations", section 4b: the
+// linear space refinement. `equal(i, j)` compares old[i] with new[j].
+template <typename Equal>
+class CommonSubsequence
+{
+public:
+  CommonSubsequence (const Equal &equal, size_t n, size_t m, std::vector<size_t> &common)
+    : _equal(equal), _common(common), _offset(2 * (ptrdiff_t)(n + m) + 2),
+      _forward(4 * (n + m) + 5), _backward(4 * (n + m) + 5) {}
+
+  void Compare(size_t aLo, size_t aHi, size_t bLo, size_t bHi) {
+    // Common prefix and suffix first: they are the whole story for the usual
+    // append-or-edit-near-the-end updates, which then cost O(n + m).
+    while (aLo < aHi && bLo < bHi && _equal(aLo, bLo)) {
+      _common.push_back(aLo);
+      aLo++;
+      bLo++;
+    }
+    size_t suffix = 0;
+    while (aLo < aHi - suffix && bLo < bHi - suffix && _equal(aHi - suffix - 1, bHi - suffix - 1)) {
+      suffix++;
+    }
+    aHi -= suffix;
+    bHi -= suffix;
+
+    // With the ends trimmed, a single insertion or deletion leaves one side
+    // empty, so from here on the edit distance is at least 2 and both halves
+    // around the middle snake are strictly smaller problems.
+    if (aLo < aHi && bLo < bHi) {
+      size_t x, y, u, v;
+      MiddleSnake(aLo, aHi, bLo, bHi, x, y, u, v);
+      Compare(aLo, x, bLo, y);
+      for (size_t i = x; i < u; i++) {
+        _common.push_back(i);
+      }
+      Compare(u, aHi, v, bHi);
+    }
+
+    for (size_t i = aHi; i < aHi + suffix; i++) {
+      _common.push_back(i);
+    }
+  }
+
+private:
+  // Finds the snake (x, y) -> (u, v) in the middle of a shortest edit path,
+  // running the search from both corners until the paths overlap.
+  void MiddleSnake(size_t aLo, size_t aHi, size_t bLo, size_t bHi,
+                   size_t &x0, size_t &y0, size_t &u0, size_t &v0) {
+    const ptrdiff_t n = (ptrdiff_t)(aHi - aLo);
+    const ptrdiff_t m = (ptrdiff_t)(bHi - bLo);
+    const ptrdiff_t delta = n - m;
+    const bool odd = (delta & 1) != 0;
+    // Diagonals run from -(d + 1) to d + 1 forward and around delta backward,
+    // within +-2(n + m) + 2 either way.
+    ptrdiff_t *vf = _forward.data() + _offset;  // furthest x on diagonal k, from (0, 0)
+    ptrdiff_t *vb = _backward.data() + _offset; // nearest x on diagonal k, from (n, m)
+
+    vf[1] = 0;
+    vb[delta - 1] = n;
+    for (ptrdiff_t d = 0; d <= (n + m + 1) / 2; d++) {
+      for (ptrdiff_t k = -d; k <= d; k += 2) {
+        ptrdiff_t x = (k == -d || (k != d && vf[k - 1] < vf[k + 1])) ? vf[k + 1] : vf[k - 1] + 1;
+        ptrdiff_t y = x - k;
+        const ptrdiff_t xStart = x, yStart = y;
+        while (x < n && y < m && _equal(aLo + x, bLo + y)) {
+          x++;
+          y++;
+        }
+        vf[k] = x;
+        if (odd && k >= delta - (d - 1) && k <= delta + (d - 1) && x >= vb[k]) {
+          x0 = aLo + xStart; y0 = bLo + yStart;
+          u0 = aLo + x; v0 = bLo + y;
+          return;
+        }
+      }
+      for (ptrdiff_t k = -d; k <= d; k += 2) {
+        const ptrdiff_t c = k + delta; // the backward search's diagonals are centered on delta
+        ptrdiff_t x = (k == d || (k != -d && vb[c - 1] < vb[c + 1])) ? vb[c - 1] : vb[c + 1] - 1;
+        ptrdiff_t y = x - c;
+        const ptrdiff_t xEnd = x, yEnd = y;
+        while (x > 0 && y > 0 && _equal(aLo + x - 1, bLo + y - 1)) {
+          x--;
+          y--;
+        }
+        vb[c] = x;
+        if (!odd && c >= -d && c <= d && x <= vf[c]) {
+          x0 = aLo + x; y0 = bLo + y;
+          u0 = aLo + xEnd; v0 = bLo + yEnd;
+          return;
+        }
+      }
+    }
+    // Unreachable: the searches meet by d = ceil((n + m) / 2).
+    x0 = u0 = aLo;
+    y0 = v0 = bLo;
+  }
+
+  const Equal &_equal;
+  std::vector<size_t> &_common;
+  const ptrdiff_t _offset;
+  std::vector<ptrdiff_t> _forward;
+  std::vector<ptrdiff_t> _backward;
+};
+
+} // namespace diff_detail
+
+/**
+ * Appends the indexes into the old sequence of a longest common subsequence
+ * of old[0, n) and new[0, m), in ascending order.
+ *
+ * Takes O((n + m) * d) time for an edit distance d, with a single O(n + m)
+ * allocation; a shared prefix and suffix cost only one comparison per element.
+ * Where several longest subsequences exist, which one is found is unspecified.
+ */
+template <typename Equal>
+void LongestCommonSubsequence(size_t n, size_t m, const Equal &equal, std::vector<size_t> &common)
+{
+  diff_detail::CommonSubsequence<Equal> lcs(equal, n, m, common);
+  lcs.Compare(0, n, 0, m);
+}
+
+/**
+ * Diffs old[0, n) against new[0, m).
+ *
+ * `equal(i, j)` compares old[i] with new[j]. To detect moves, pass the
+ * elements' hashes, which must agree with `equal`; otherwise pass null. Any
+ * hashes passed also serve to skip `equal` for elements that cannot match.
+ *
+ * Moves are found as before: walking the new sequence, an element equal to an
+ * old one at another index is reported as moved from it, replacing a delete
+ * and insert pair or taking it out of the common subsequence. Among equal old
+ * elements the first one not yet taken is used.
+ */
+template <typename Equal>
+void DiffArrays(size_t n, size_t m, const uint64_t *oldHashes, const uint64_t *newHashes,
+                const Equal &equal, bool detectMoves, ArrayDiff &diff)
+{
+  auto same = [&](size_t i, size_t j) {
+    return (oldHashes == nullptr || oldHashes[i] == newHashes[j]) && equal(i, j);
+  };
+
+  std::vector<size_t> common;
+  LongestCommonSubsequence(n, m, same, common);
+
+  // Old indexes marked common, deleted or (with moves) already taken.
+  enum : uint8_t { Deleted = 1, Common = 2, Taken = 4 };
+  std::vector<uint8_t> state(n, Deleted);
+  for (size_t i : common) {
+    state[i] = Common;
+  }
+
+  // Old indexes sorted by hash, so equal candidates for a move sit together.
+  std::vector<size_t> byHash;
+  if (detectMoves && oldHashes != nullptr) {
+    byHash.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      byHash[i] = i;
+    }
+    std::stable_sort(byHash.begin(), byHash.end(), [&](size_t a, size_t b) {
+      return oldHashes[a] < oldHashes[b];
+    });
+  }
+  auto findCandidate = [&](size_t j) -> size_t {
+    uint64_t hash = newHashes[j];
+    auto it = std::lower_bound(byHash.begin(), byHash.end(), hash, [&](size_t i, uint64_t h) {
+      return oldHashes[i] < h;
+    });
+    for (; it != byHash.end() && oldHashes[*it] == hash; ++it) {
+      if (!(state[*it] & Taken) && equal(*it, j)) {
+        return *it;
+      }
+    }
+    return SIZE_MAX;
+  };
+
+  size_t c = 0; // next unmatched entry of `common`
+  for (size_t j = 0; j < m; j++) {
+    while (c < common.size() && !(state[common[c]] & Common)) {
+      c++; // taken out of the subsequence by an earlier move
+    }
+    if (c < common.size() && same(common[c], j)) {
+      size_t i = common[c++];
+      state[i] |= Taken;
+      if (detectMoves && i != j) {
+        diff.moves.emplace_back(i, j);
+      }
+      continue;
+    }
+    size_t movedFrom = detectMoves && !byHash.empty() ? findCandidate(j) : SIZE_MAX;
+    if (movedFrom != SIZE_MAX && movedFrom != j) {
+      // A move replaces the delete and the insert, or leaves the subsequence.
+      diff.moves.emplace_back(movedFrom, j);
+      state[movedFrom] = Taken;
+    } else {
+      // An equal element at the same index is still deleted and inserted again.
+      if (movedFrom != SIZE_MAX && !(state[movedFrom] & Common)) {
+        state[movedFrom] |= Taken;
+      }
+      diff.insertions.push_back(j);
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (state[i] & Deleted) {
+      diff.deletions.push_back(i);
+    }
+  }
+}
+
+} // namespace AS
@@ -0,0 +1,134 @@
+//
+//  ASCostScheduler.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the scheduling can be built,
+// tested and simulated on its own. ASDataController allocates cell nodes by it.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace AS {
+
+/**
+ * Hands out a batch of independent work items to any number of threads.
+ *
+ * Items are claimed in order of priority, then of estimated cost: prioritized
+ * items first, and within each group the most expensive first, so that a long
+ * item starts early instead of being picked up last and holding up the whole
+ * batch. Items with equal cost keep their order; with no estimates at all the
+ * order is unchanged.
+ *
+ * Finishing the last prioritized item is reported to exactly one caller, so a
+ * thread can hand those on while the rest are still being worked on.
+ *
+ * Reset is not thread safe; the claim and finish calls are.
+ */
+class CostScheduler
+{
+public:
+  CostScheduler() : _prioritizedCount(0), _next(0), _prioritizedLeft(0) {}
+
+  /**
+   * Starts a batch of `count` items. `cost(i)` estimates the cost of item i,
+   * with 0 for unknown, and `prioritized(i)` tells whether it goes first.
+   */
+  template <typename Cost, typename Prioritized>
+  void Reset(size_t count, Cost cost, Prioritized prioritized) {
+    struct Key
+    {
+      double cost;
+      uint32_t index;
+      bool prioritized;
+    };
+    std::vector<Key> keys;
+    keys.reserve(count);
+    _prioritized.assign(count, false);
+    _prioritizedCount = 0;
+    for (size_t i = 0; i < count; i++) {
+      const bool first = prioritized(i);
+      keys.push_back({cost(i), (uint32_t)i, first});
+      _prioritized[i] = first;
+      _prioritizedCount += first ? 1 : 0;
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) {
+      return a.prioritized != b.prioritized ? a.prioritized : a.cost > b.cost;
+    });
+    _order.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      _order[i] = keys[i].index;
+    }
+    _next.store(0, std::memory_order_relaxed);
+    _prioritizedLeft.store(_prioritizedCount, std::memory_order_release);
+  }
+
+  size_t Count() const {
+    return _order.size();
+  }
+
+  size_t PrioritizedCount() const {
+    return _prioritizedCount;
+  }
+
+  bool IsPrioritized(size_t index) const {
+    return _prioritized[index];
+  }
+
+  /** Claims the next item into `index`, or returns false once all are claimed. */
+  bool Claim(size_t &index) {
+    const size_t position = _next.fetch_add(1, std::memory_order_relaxed);
+    if (position >= _order.size()) {
+      return false;
+    }
+    index = _order[position];
+    return true;
+  }
+
+  /** Like Claim, but returns false once the prioritized items are all claimed. */
+  bool ClaimPrioritized(size_t &index) {
+    size_t position = _next.load(std::memory_order_relaxed);
+    do {
+      if (position >= _prioritizedCount) {
+        return false;
+      }
+    } while (!_next.compare_exchange_weak(position, position + 1, std::memory_order_relaxed));
+    index = _order[position];
+    return true;
+  }
+
+  /**
+   * Reports a claimed item as done. Returns true to the one call that
+   * finishes the last prioritized item.
+   */
+  bool Finish(size_t index) {
+    if (!_prioritized[index]) {
+      return false;
+    }
+    return _prioritizedLeft.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  /** Whether every prioritized item has finished. True when there are none. */
+  bool PrioritizedFinished() const {
+    return _prioritizedLeft.load(std::memory_order_acquire) == 0;
+  }
+
+private:
+  CostScheduler(const CostScheduler &) = delete;
+  CostScheduler &operator=(const CostScheduler &) = delete;
+
+  std::vector<uint32_t> _order;
+  std::vector<bool> _prioritized;
+  size_t _prioritizedCount;
+  std::atomic<size_t> _next;
+  std::atomic<size_t> _prioritizedLeft;
+};
+
+} // namespace AS
@@ -14,6 +14,7 @@
 #import <AsyncDisplayKit/ASGraphicsContext.h>
 #import <AsyncDisplayKit/ASInternalHelpers.h>
 #import <AsyncDisplayKit/ASSignpost.h>
+#import <AsyncDisplayKit/ASTrace.h>
 
 using AS::MutexLocker;
 
@@ -269,6 +270,17 @@ using AS::MutexLocker;
   };
 #endif
 
+  // Likewise wrap it in a trace slice, tagged with the node, while tracing.
+  if (displayBlock != nil && ASTraceIsEnabled()) {
+    const uintptr_t nodeID = (uintptr_t)self;
+    displayBlock = ^{
+      ASTraceBegin("Display", nodeID);
+      id result = displayBlock();
+      ASTraceEnd("Display", nodeID);
+      return result;
+    };
+  }
+
   return displayBlock;
 }
 
@@ -423,6 +435,7 @@ using AS::MutexLocker;
         layer.contents = (id)image.CGImage;
       }
       [self didDisplayAsyncLayer:self.asyncLayer];
+      ASTraceInstant("Display completed", (uintptr_t)self);
       
       if (rasterizesSubtree) {
         ASDisplayNodePerformBlockOnEverySubnode(self, NO, ^(ASDisplayNode * _Nonnull node) {
@@ -0,0 +1,423 @@
+//
+//  ASFlatIntegerMap.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the map can be built, tested
+// and benchmarked on its own. ASIntegerMap wraps it.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace AS {
+
+/**
+ * A map from integers to integers, kept in one of two forms.
+ *
+ * Runs: sorted, non-overlapping runs of consecutive keys that map to
+ * consecutive values. This is what the mapping for an update to an array
+ * looks like, and it takes one run per stretch between deletions and
+ * insertions. A mapping that is a plain shift is a single run, which is held
+ * without allocating and looked up with a range check. More runs are binary
+ * searched.
+ *
+ * Hash: open addressing with linear probing, in a small inline buffer that
+ * moves to the heap when it fills up. A map starts as runs and stays runs as
+ * long as keys are set in ascending order, and turns into a hash the first
+ * time they aren't.
+ *
+ * There is no removal. Not thread safe.
+ */
+class FlatIntegerMap
+{
+public:
+  typedef intptr_t Integer;
+
+  struct Range
+  {
+    Integer location;
+    Integer length;
+  };
+
+  struct Run
+  {
+    Integer key;
+    Integer value;
+    Integer length;
+  };
+
+  FlatIntegerMap() : _isHash(false), _size(0), _run(), _runCount(0), _slots(_inline), _capacity(kInlineSlots), _hasMinKey(false), _minKeyValue(0) {
+    ClearSlots();
+  }
+
+  FlatIntegerMap(const FlatIntegerMap &other) : FlatIntegerMap() {
+    *this = other;
+  }
+
+  FlatIntegerMap &operator=(const FlatIntegerMap &other) {
+    if (this == &other) {
+      return *this;
+    }
+    _isHash = other._isHash;
+    _size = other._size;
+    _run = other._run;
+    _runs = other._runs;
+    _runCount = other._runCount;
+    _hasMinKey = other._hasMinKey;
+    _minKeyValue = other._minKeyValue;
+    if (other._slots == other._inline) {
+      _heap.reset();
+      _slots = _inline;
+    } else {
+      _heap.reset(new Slot[other._capacity]);
+      _slots = _heap.get();
+    }
+    _capacity = other._capacity;
+    std::copy(other._slots, other._slots + other._capacity, _slots);
+    return *this;
+  }
+
+  /**
+   * Replaces the contents with the mapping for an update to an array of
+   * `oldCount` items: the n-th item that isn't deleted maps to the n-th new
+   * index that isn't inserted. Both range lists are ascending and don't
+   * overlap, as an index set's ranges are.
+   */
+  void BuildForUpdate(Integer oldCount, const Range *deleted, size_t deletedCount, const Range *inserted, size_t insertedCount) {
+    Clear();
+    Integer oldIndex = 0;
+    Integer newIndex = 0;
+    size_t d = 0;
+    size_t i = 0;
+    while (oldIndex < oldCount) {
+      while (d < deletedCount && deleted[d].location + deleted[d].length <= oldIndex) {
+        d++;
+      }
+      if (d < deletedCount && deleted[d].location <= oldIndex) {
+        oldIndex = deleted[d].location + deleted[d].length;
+        continue;
+      }
+      while (i < insertedCount && inserted[i].location + inserted[i].length <= newIndex) {
+        i++;
+      }
+      if (i < insertedCount && inserted[i].location <= newIndex) {
+        newIndex = inserted[i].location + inserted[i].length;
+        continue;
+      }
+      Integer length = oldCount - oldIndex;
+      if (d < deletedCount) {
+        length = std::min(length, deleted[d].location - oldIndex);
+      }
+      if (i < insertedCount) {
+        length = std::min(length, inserted[i].location - newIndex);
+      }
+      AppendRun({oldIndex, newIndex, length});
+      oldIndex += length;
+      newIndex += length;
+    }
+  }
+
+  /** Looks up `key` into `value`, or returns false if it isn't in the map. */
+  bool Find(Integer key, Integer &value) const {
+    if (!_isHash) {
+      const Run *run = FindRun(key);
+      if (run == nullptr) {
+        return false;
+      }
+      value = run->value + (key - run->key);
+      return true;
+    }
+    if (key == kEmptyKey) {
+      value = _minKeyValue;
+      return _hasMinKey;
+    }
+    const size_t mask = _capacity - 1;
+    for (size_t index = Hash(key) & mask;; index = (index + 1) & mask) {
+      if (_slots[index].key == key) {
+        value = _slots[index].value;
+        return true;
+      }
+      if (_slots[index].key == kEmptyKey) {
+        return false;
+      }
+    }
+  }
+
+  void Set(Integer key, Integer value) {
+    if (!_isHash) {
+      Integer existing;
+      if (Find(key, existing) && existing == value) {
+        return;
+      }
+      if (_runCount == 0 || key > LastKey(LastRun())) {
+        AppendRun({key, value, 1});
+        return;
+      }
+      ConvertToHash();
+    }
+    Insert(key, value);
+  }
+
+  size_t Size() const {
+    return _size;
+  }
+
+  /** Whether the map is held as runs rather than hashed. */
+  bool IsRuns() const {
+    return !_isHash;
+  }
+
+  size_t RunCount() const {
+    return _isHash ? 0 : _runCount;
+  }
+
+  /** Calls `f(key, value)` for each entry, in key order when held as runs. */
+  template <typename F>
+  void ForEach(F f) const {
+    if (!_isHash) {
+      const Run *runs = Runs();
+      for (size_t r = 0; r < _runCount; r++) {
+        for (Integer offset = 0; offset < runs[r].length; offset++) {
+          f(runs[r].key + offset, runs[r].value + offset);
+        }
+      }
+      return;
+    }
+    if (_hasMinKey) {
+      const Integer minKey = kEmptyKey;
+      f(minKey, _minKeyValue);
+    }
+    for (size_t index = 0; index < _capacity; index++) {
+      if (_slots[index].key != kEmptyKey) {
+        f(_slots[index].key, _slots[index].value);
+      }
+    }
+  }
+
+  /**
+   * Returns the map from values back to keys. If two keys share a value, one
+   * of them wins.
+   */
+  FlatIntegerMap Inverse() const {
+    FlatIntegerMap result;
+    if (!_isHash && _runCount <= 1) {
+      if (_runCount == 1) {
+        result.AppendRun({_run.value, _run.key, _run.length});
+      }
+      return result;
+    }
+    if (!_isHash) {
+      const Run *runs = Runs();
+      std::vector<Run> swapped;
+      swapped.reserve(_runCount);
+      for (size_t r = 0; r < _runCount; r++) {
+        swapped.push_back({runs[r].value, runs[r].key, runs[r].length});
+      }
+      std::sort(swapped.begin(), swapped.end(), [](const Run &a, const Run &b) {
+        return a.key < b.key;
+      });
+      bool overlaps = false;
+      for (size_t r = 1; r < swapped.size(); r++) {
+        overlaps = overlaps || LastKey(swapped[r - 1]) >= swapped[r].key;
+      }
+      if (!overlaps) {
+        for (const Run &run : swapped) {
+          result.AppendRun(run);
+        }
+        return result;
+      }
+    }
+    ForEach([&](Integer key, Integer value) {
+      result.Set(value, key);
+    });
+    return result;
+  }
+
+  bool operator==(const FlatIntegerMap &other) const {
+    if (_size != other._size) {
+      return false;
+    }
+    bool equal = true;
+    ForEach([&](Integer key, Integer value) {
+      Integer otherValue;
+      equal = equal && other.Find(key, otherValue) && otherValue == value;
+    });
+    return equal;
+  }
+
+  bool operator!=(const FlatIntegerMap &other) const {
+    return !(*this == other);
+  }
+
+  void Clear() {
+    _isHash = false;
+    _size = 0;
+    _runs.clear();
+    _runCount = 0;
+    _heap.reset();
+    _slots = _inline;
+    _capacity = kInlineSlots;
+    _hasMinKey = false;
+    ClearSlots();
+  }
+
+private:
+  // Marks an empty slot. The one entry that has it as its key is kept aside.
+  static const Integer kEmptyKey = INTPTR_MIN;
+  static const size_t kInlineSlots = 8;
+
+  struct Slot
+  {
+    Integer key;
+    Integer value;
+  };
+
+  static size_t Hash(Integer key) {
+    uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h ^ (h >> 32));
+  }
+
+  // Keys and values can be anywhere in the range, so ends are worked out
+  // without going past it.
+  static Integer LastKey(const Run &run) {
+    return run.key + (run.length - 1);
+  }
+
+  static uintptr_t Distance(Integer from, Integer to) {
+    return (uintptr_t)to - (uintptr_t)from;
+  }
+
+  // A single run is kept in _run; from two on they are all in _runs.
+  const Run *Runs() const {
+    return _runCount == 1 ? &_run : _runs.data();
+  }
+
+  Run &LastRun() {
+    return _runCount == 1 ? _run : _runs.back();
+  }
+
+  const Run *FindRun(Integer key) const {
+    if (_runCount == 1) {
+      return key >= _run.key && Distance(_run.key, key) < (uintptr_t)_run.length ? &_run : nullptr;
+    }
+    const Run *end = _runs.data() + _runCount;
+    const Run *after = std::upper_bound(_runs.data(), end, key, [](Integer k, const Run &run) {
+      return k < run.key;
+    });
+    if (after == _runs.data()) {
+      return nullptr;
+    }
+    const Run *run = after - 1;
+    return Distance(run->key, key) < (uintptr_t)run->length ? run : nullptr;
+  }
+
+  // Runs are appended in key order; one that carries on from the last is merged into it.
+  void AppendRun(const Run &run) {
+    _size += run.length;
+    if (_runCount == 0) {
+      _run = run;
+      _runCount = 1;
+      return;
+    }
+    Run &last = LastRun();
+    if (run.key > last.key && run.value > last.value && Distance(last.key, run.key) == (uintptr_t)last.length
+        && Distance(last.value, run.value) == (uintptr_t)last.length) {
+      last.length += run.length;
+      return;
+    }
+    if (_runCount == 1) {
+      _runs.push_back(_run);
+    }
+    _runs.push_back(run);
+    _runCount++;
+  }
+
+  void ConvertToHash() {
+    const Run single = _run;
+    std::vector<Run> runs;
+    runs.swap(_runs);
+    const size_t runCount = _runCount;
+    const Run *source = runCount == 1 ? &single : runs.data();
+    _runCount = 0;
+    _size = 0;
+    _isHash = true;
+    for (size_t r = 0; r < runCount; r++) {
+      for (Integer offset = 0; offset < source[r].length; offset++) {
+        Insert(source[r].key + offset, source[r].value + offset);
+      }
+    }
+  }
+
+  void Insert(Integer key, Integer value) {
+    if (key == kEmptyKey) {
+      _size += _hasMinKey ? 0 : 1;
+      _hasMinKey = true;
+      _minKeyValue = value;
+      return;
+    }
+    // Kept at most three quarters full.
+    if ((_size + 1) * 4 > _capacity * 3) {
+      Grow();
+    }
+    const size_t mask = _capacity - 1;
+    for (size_t index = Hash(key) & mask;; index = (index + 1) & mask) {
+      if (_slots[index].key == key) {
+        _slots[index].value = value;
+        return;
+      }
+      if (_slots[index].key == kEmptyKey) {
+        _slots[index] = {key, value};
+        _size++;
+        return;
+      }
+    }
+  }
+
+  void Grow() {
+    std::unique_ptr<Slot[]> old(std::move(_heap));
+    Slot *oldSlots = _slots;
+    const size_t oldCapacity = _capacity;
+    Slot inlineCopy[kInlineSlots];
+    if (oldSlots == _inline) {
+      std::copy(_inline, _inline + kInlineSlots, inlineCopy);
+      oldSlots = inlineCopy;
+    }
+    _capacity = oldCapacity * 2;
+    _heap.reset(new Slot[_capacity]);
+    _slots = _heap.get();
+    ClearSlots();
+    _size = _hasMinKey ? 1 : 0;
+    for (size_t index = 0; index < oldCapacity; index++) {
+      if (oldSlots[index].key != kEmptyKey) {
+        Insert(oldSlots[index].key, oldSlots[index].value);
+      }
+    }
+  }
+
+  void ClearSlots() {
+    for (size_t index = 0; index < _capacity; index++) {
+      _slots[index].key = kEmptyKey;
+    }
+  }
+
+  bool _isHash;
+  size_t _size;
+  Run _run;
+  std::vector<Run> _runs;
+  size_t _runCount;
+  Slot _inline[kInlineSlots];
+  std::unique_ptr<Slot[]> _heap;
+  Slot *_slots;
+  size_t _capacity;
+  bool _hasMinKey;
+  Integer _minKeyValue;
+};
+
+} // namespace AS
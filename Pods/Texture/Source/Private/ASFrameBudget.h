@@ -0,0 +1,174 @@
+//
+//  ASFrameBudget.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the scheduling can be built and
+// tested against a simulated clock on its own. ASRunLoopQueue drains by it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace AS {
+
+/**
+ * Decides how much of a work queue to drain in each run loop pass so that the
+ * passes of one frame together stay within a time budget.
+ *
+ * Frames are a fixed interval apart, counted from the first pass. A run loop
+ * may pass many times in one frame, so every pass in a frame spends from the
+ * same budget, and BeginPass refuses a pass once it is spent; the drainer then
+ * waits for NextFrameStart rather than running again at once.
+ *
+ * The cost of an item is tracked as an exponentially weighted moving average
+ * of measured batches. Each pass hands out batches sized to fit the remaining
+ * budget at that cost, until the budget is spent. The drainer checks
+ * HasTimeLeft after every item and hands back the rest of a batch once it is
+ * out of time, so a misestimate costs at most one item's overrun. The first
+ * item of a frame is always processed, so the queue drains however slow its
+ * items are. Until a cost has been measured, batches have one item.
+ *
+ * Times are in seconds, from any monotonic clock.
+ */
+class FrameBudget
+{
+public:
+  /** Off, with a smoothing of 0.1. */
+  FrameBudget() : FrameBudget(0, 0, 0.1) {}
+
+  /**
+   * `smoothing` is the weight of one new item's cost in the average. A batch
+   * of n items weighs as much as n single items.
+   */
+  FrameBudget(double budget, double scrollingBudget, double smoothing)
+    : _budget(budget), _scrollingBudget(scrollingBudget), _smoothing(smoothing),
+      _frameInterval(1.0 / 60), _itemCost(-1), _frameStart(0), _frameSpent(0), _hasFrame(false),
+      _frameHasBatch(false), _passStart(0), _passBudget(0) {}
+
+  void SetBudgets(double budget, double scrollingBudget) {
+    _budget = budget;
+    _scrollingBudget = scrollingBudget;
+  }
+
+  /** The time between frames, a 60Hz frame by default. */
+  void SetFrameInterval(double interval) {
+    _frameInterval = interval;
+  }
+
+  /** Draining by budget is on when the budget is positive. */
+  bool IsEnabled() const {
+    return _budget > 0;
+  }
+
+  /**
+   * Starts a pass at `now`, on what is left of the frame's budget, the smaller
+   * one while the user scrolls. Returns false if the frame has spent it, in
+   * which case nothing may be processed until NextFrameStart.
+   */
+  bool BeginPass(double now, bool scrolling) {
+    // A pass a hair before the next frame, e.g. woken for it by a timer on another clock, starts it.
+    const double early = _frameInterval / 100;
+    if (!_hasFrame) {
+      _hasFrame = true;
+      StartFrame(now);
+    } else if (now + early >= _frameStart + _frameInterval) {
+      const double frames = std::max(std::floor((now + early - _frameStart) / _frameInterval), 1.0);
+      StartFrame(_frameStart + frames * _frameInterval);
+    }
+    _passStart = now;
+    _passBudget = (scrolling ? std::min(_budget, _scrollingBudget) : _budget) - _frameSpent;
+    return _passBudget > 0 || !_frameHasBatch;
+  }
+
+  /** Ends the pass begun last, at `now`, charging its time to the frame. */
+  void EndPass(double now) {
+    _frameSpent += std::max(now - _passStart, 0.0);
+  }
+
+  /** When the frame after the current one starts. */
+  double NextFrameStart() const {
+    return _frameStart + _frameInterval;
+  }
+
+  /** How many of the `available` items to take next; 0 once the pass has spent its budget. */
+  size_t NextBatchSize(double now, size_t available) {
+    if (available == 0) {
+      return 0;
+    }
+    size_t count = 0;
+    const double remaining = _passStart + _passBudget - now;
+    if (remaining <= 0) {
+      count = 0;
+    } else if (_itemCost < 0) {
+      count = 1;
+    } else {
+      const double fit = _itemCost > 0 ? std::floor(remaining / _itemCost) : (double)available;
+      count = fit < (double)available ? (size_t)fit : available;
+    }
+    if (count == 0 && !_frameHasBatch) {
+      count = 1;
+    }
+    _frameHasBatch = _frameHasBatch || count > 0;
+    return count;
+  }
+
+  /** Whether the pass may go on to another item. The first item of a frame always may. */
+  bool HasTimeLeft(double now) const {
+    return now < _passStart + _passBudget;
+  }
+
+  /** Feeds back how long `count` items took. */
+  void DidProcess(size_t count, double seconds) {
+    if (count == 0) {
+      return;
+    }
+    const double perItem = std::max(seconds, 0.0) / count;
+    if (_itemCost < 0) {
+      _itemCost = perItem;
+      return;
+    }
+    const double weight = 1 - std::pow(1 - _smoothing, (double)count);
+    _itemCost += weight * (perItem - _itemCost);
+  }
+
+  /** Negative until the first batch has been measured. */
+  double EstimatedItemCost() const {
+    return _itemCost;
+  }
+
+  /** What was left of the frame's budget when the current pass began. */
+  double PassBudget() const {
+    return _passBudget;
+  }
+
+  /** The time the passes of the current frame have taken, up to the last EndPass. */
+  double FrameSpent() const {
+    return _frameSpent;
+  }
+
+private:
+  void StartFrame(double start) {
+    _frameStart = start;
+    _frameSpent = 0;
+    _frameHasBatch = false;
+  }
+
+  double _budget;
+  double _scrollingBudget;
+  double _smoothing;
+  double _frameInterval;
+  double _itemCost;
+  double _frameStart;
+  double _frameSpent;
+  bool _hasFrame;
+  bool _frameHasBatch;
+  double _passStart;
+  double _passBudget;
+};
+
+} // namespace AS
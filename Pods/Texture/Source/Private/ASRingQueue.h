@@ -0,0 +1,128 @@
+//
+//  ASRingQueue.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the queue can be built, tested
+// and benchmarked on its own. Under ARC, T may be an ownership-qualified object
+// pointer such as `__weak id`.
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace AS {
+
+/**
+ * A first-in, first-out queue in a circular buffer. Pushing and popping never
+ * move the other elements; the buffer doubles when full and halves when a
+ * quarter full, so a burst does not pin its peak memory.
+ *
+ * Not thread safe.
+ */
+template <typename T>
+class RingQueue
+{
+public:
+  RingQueue() : _storage(nullptr), _capacity(0), _head(0), _size(0) {}
+
+  ~RingQueue() {
+    Clear();
+    ::operator delete(_storage);
+  }
+
+  size_t Size() const {
+    return _size;
+  }
+
+  bool IsEmpty() const {
+    return _size == 0;
+  }
+
+  size_t Capacity() const {
+    return _capacity;
+  }
+
+  /** The element `index` places from the front. */
+  T &operator[](size_t index) {
+    return _storage[(_head + index) & (_capacity - 1)];
+  }
+
+  T &Front() {
+    return (*this)[0];
+  }
+
+  void PushBack(const T &value) {
+    ReserveForPush();
+    new (&(*this)[_size]) T(value);
+    _size++;
+  }
+
+  void PushBack(T &&value) {
+    ReserveForPush();
+    new (&(*this)[_size]) T(std::move(value));
+    _size++;
+  }
+
+  /** For handing back what was popped but not used, ahead of everything else. */
+  void PushFront(T &&value) {
+    ReserveForPush();
+    _head = (_head + _capacity - 1) & (_capacity - 1);
+    new (&Front()) T(std::move(value));
+    _size++;
+  }
+
+  void PopFront() {
+    Front().~T();
+    _head = (_head + 1) & (_capacity - 1);
+    _size--;
+    if (_capacity > kMinimumCapacity && _size <= _capacity / 4) {
+      Reallocate(_capacity / 2);
+    }
+  }
+
+  void Clear() {
+    while (_size > 0) {
+      Front().~T();
+      _head = (_head + 1) & (_capacity - 1);
+      _size--;
+    }
+    _head = 0;
+  }
+
+private:
+  static const size_t kMinimumCapacity = 16;
+
+  void ReserveForPush() {
+    if (_size == _capacity) {
+      Reallocate(_capacity == 0 ? kMinimumCapacity : _capacity * 2);
+    }
+  }
+
+  void Reallocate(size_t capacity) {
+    T *storage = static_cast<T *>(::operator new(capacity * sizeof(T)));
+    for (size_t i = 0; i < _size; i++) {
+      T &element = (*this)[i];
+      new (&storage[i]) T(std::move(element));
+      element.~T();
+    }
+    ::operator delete(_storage);
+    _storage = storage;
+    _capacity = capacity;
+    _head = 0;
+  }
+
+  RingQueue(const RingQueue &) = delete;
+  RingQueue &operator=(const RingQueue &) = delete;
+
+  T *_storage;
+  size_t _capacity; // zero or a power of two
+  size_t _head;
+  size_t _size;
+};
+
+} // namespace AS
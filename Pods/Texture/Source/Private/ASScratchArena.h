@@ -0,0 +1,154 @@
+//
+//  ASScratchArena.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so code using it can be built and
+// benchmarked on its own.
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace AS {
+
+/**
+ * A bump allocator for short-lived, trivially destructible scratch data.
+ *
+ * Memory is handed out by a Scope and reclaimed all at once when that scope
+ * closes. Scopes nest like stack frames, which fits recursive passes such as
+ * layout: a nested computation opens its own scope on the same arena and gives
+ * its memory back before the outer one continues. Blocks are never moved, so
+ * pointers stay valid until their scope closes, and they are kept for reuse.
+ *
+ * Not thread safe; keep one arena per thread.
+ */
+class ScratchArena
+{
+  struct Block;
+
+public:
+  class Scope
+  {
+  public:
+    explicit Scope(ScratchArena &arena)
+      : _arena(arena), _block(arena._current), _used(arena._used) {
+      arena._depth++;
+    }
+
+    ~Scope() {
+      _arena._current = _block;
+      _arena._used = _used;
+      if (--_arena._depth == 0) {
+        _arena.Trim();
+      }
+    }
+
+    /** Uninitialized storage for `count` objects of type T. */
+    template <typename T>
+    T *Allocate(size_t count) {
+      static_assert(std::is_trivially_destructible<T>::value, "Scratch memory is never destroyed");
+      static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned types are not supported");
+      return static_cast<T *>(_arena.Allocate(count * sizeof(T), alignof(T)));
+    }
+
+  private:
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    ScratchArena &_arena;
+    Block *_block;
+    size_t _used;
+  };
+
+  ScratchArena() : _first(nullptr), _current(nullptr), _used(0), _depth(0) {}
+
+  ~ScratchArena() {
+    for (Block *block = _first; block != nullptr;) {
+      Block *next = block->next;
+      ::operator delete(block);
+      block = next;
+    }
+  }
+
+private:
+  ScratchArena(const ScratchArena &) = delete;
+  ScratchArena &operator=(const ScratchArena &) = delete;
+
+  // Aligned like operator new's memory, so data() is too.
+  struct alignas(std::max_align_t) Block
+  {
+    Block *next;
+    size_t capacity;
+
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+  };
+
+  static constexpr size_t kFirstBlockSize = 4096;
+  // Blocks past the first are freed once the outermost scope closes if they
+  // add up to more than this, so one huge pass does not pin its memory.
+  static constexpr size_t kRetainedBytes = 64 * 1024;
+
+  void *Allocate(size_t size, size_t alignment) {
+    if (_current != nullptr) {
+      size_t offset = (_used + alignment - 1) & ~(alignment - 1);
+      if (offset + size <= _current->capacity) {
+        _used = offset + size;
+        return _current->data() + offset;
+      }
+    }
+
+    // Move on to the next block, inserting a fresh one if it is too small.
+    Block *next = _current ? _current->next : _first;
+    if (next == nullptr || next->capacity < size) {
+      size_t capacity = kFirstBlockSize;
+      if (_current) {
+        capacity = _current->capacity * 2;
+      }
+      while (capacity < size) {
+        capacity *= 2;
+      }
+      Block *block = static_cast<Block *>(::operator new(sizeof(Block) + capacity));
+      block->capacity = capacity;
+      block->next = next;
+      if (_current) {
+        _current->next = block;
+      } else {
+        _first = block;
+      }
+      next = block;
+    }
+    _current = next;
+    _used = size;
+    return next->data();
+  }
+
+  void Trim() {
+    if (_first == nullptr) {
+      return;
+    }
+    size_t retained = 0;
+    for (Block *block = _first->next; block != nullptr; block = block->next) {
+      retained += block->capacity;
+    }
+    if (retained > kRetainedBytes) {
+      for (Block *block = _first->next; block != nullptr;) {
+        Block *next = block->next;
+        ::operator delete(block);
+        block = next;
+      }
+      _first->next = nullptr;
+    }
+  }
+
+  Block *_first;
+  Block *_current;
+  size_t _used;
+  unsigned _depth;
+};
+
+} // namespace AS
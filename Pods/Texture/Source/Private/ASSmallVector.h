@@ -0,0 +1,137 @@
+//
+//  ASSmallVector.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so code using it can be built and
+// benchmarked on its own.
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+namespace AS {
+
+/**
+ * A vector of trivially copyable values that keeps its first N elements
+ * inline and only allocates once it grows past them.
+ */
+template <typename T, size_t N>
+class SmallVector
+{
+  static_assert(std::is_trivially_copyable<T>::value, "SmallVector copies its elements with memcpy");
+  static_assert(N > 0, "Use std::vector without inline storage");
+
+public:
+  typedef T value_type;
+  typedef T *iterator;
+  typedef const T *const_iterator;
+
+  SmallVector() : _data(Inline()), _size(0), _capacity(N) {}
+
+  SmallVector(const SmallVector &other) : SmallVector() {
+    Append(other.begin(), other.size());
+  }
+
+  SmallVector(SmallVector &&other) : SmallVector() {
+    if (other.IsInline()) {
+      Append(other.begin(), other.size());
+    } else {
+      _data = other._data;
+      _capacity = other._capacity;
+      _size = other._size;
+      other._data = other.Inline();
+      other._capacity = N;
+    }
+    other._size = 0;
+  }
+
+  SmallVector &operator=(const SmallVector &other) {
+    if (this != &other) {
+      _size = 0;
+      Append(other.begin(), other.size());
+    }
+    return *this;
+  }
+
+  SmallVector &operator=(SmallVector &&other) {
+    if (this != &other) {
+      this->~SmallVector();
+      new (this) SmallVector(static_cast<SmallVector &&>(other));
+    }
+    return *this;
+  }
+
+  ~SmallVector() {
+    if (!IsInline()) {
+      ::operator delete(_data);
+    }
+  }
+
+  void push_back(const T &value) {
+    if (_size == _capacity) {
+      // `value` may live in the storage being replaced.
+      T copy = value;
+      Reserve(_capacity * 2);
+      _data[_size++] = copy;
+    } else {
+      _data[_size++] = value;
+    }
+  }
+
+  void clear() { _size = 0; }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  T &operator[](size_t i) { return _data[i]; }
+  const T &operator[](size_t i) const { return _data[i]; }
+  T &front() { return _data[0]; }
+  const T &front() const { return _data[0]; }
+  T &back() { return _data[_size - 1]; }
+  const T &back() const { return _data[_size - 1]; }
+
+  iterator begin() { return _data; }
+  iterator end() { return _data + _size; }
+  const_iterator begin() const { return _data; }
+  const_iterator end() const { return _data + _size; }
+
+private:
+  T *Inline() { return reinterpret_cast<T *>(&_inline); }
+  bool IsInline() const { return _capacity == N; }
+
+  void Reserve(size_t capacity) {
+    if (capacity <= _capacity) {
+      return;
+    }
+    T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+    if (_size > 0) {
+      std::memcpy(data, _data, _size * sizeof(T));
+    }
+    if (!IsInline()) {
+      ::operator delete(_data);
+    }
+    _data = data;
+    _capacity = capacity;
+  }
+
+  void Append(const T *values, size_t count) {
+    Reserve(_size + count);
+    if (count > 0) {
+      std::memcpy(_data + _size, values, count * sizeof(T));
+    }
+    _size += count;
+  }
+
+  T *_data;
+  size_t _size;
+  size_t _capacity;
+  typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type _inline;
+};
+
+} // namespace AS
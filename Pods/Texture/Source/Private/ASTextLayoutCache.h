@@ -0,0 +1,293 @@
+//
+//  ASTextLayoutCache.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the cache can be built, tested
+// and benchmarked on its own. ASTextNode2 keeps its text layouts in one.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace AS {
+
+/**
+ * A streaming 64-bit hash for fingerprinting content, such as the characters
+ * and attributes of a string. Not cryptographic: callers that cannot afford a
+ * collision compare the content on a match.
+ */
+class Fingerprint
+{
+public:
+  Fingerprint() : _state(0x243F6A8885A308D3ull), _length(0) {}
+
+  void Add(uint64_t value) {
+    _state = Mix(_state ^ value);
+    _length += 8;
+  }
+
+  void Add(const void *bytes, size_t length) {
+    const unsigned char *p = static_cast<const unsigned char *>(bytes);
+    _length += length;
+    for (; length >= 8; p += 8, length -= 8) {
+      uint64_t word;
+      std::memcpy(&word, p, 8);
+      _state = Mix(_state ^ word);
+    }
+    if (length > 0) {
+      uint64_t word = 0;
+      std::memcpy(&word, p, length);
+      _state = Mix(_state ^ word ^ ((uint64_t)length << 56));
+    }
+  }
+
+  uint64_t Value() const {
+    return Finalize(_state ^ _length);
+  }
+
+  /** A well mixed hash of a single value, for combining unordered sets of values by addition. */
+  static uint64_t Hash(uint64_t value) {
+    return Finalize(value + 0x9E3779B97F4A7C15ull);
+  }
+
+private:
+  static uint64_t Mix(uint64_t h) {
+    h *= 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 29);
+  }
+
+  // The MurmurHash3 finalizer.
+  static uint64_t Finalize(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  uint64_t _state;
+  uint64_t _length;
+};
+
+/**
+ * Identifies a text layout: what is laid out, how, and into roughly what size.
+ *
+ * Sizes go in as size classes, so a layout is found again for sizes that differ
+ * only by rounding noise. Whether the layout actually fits the new size is for
+ * the caller to check.
+ */
+struct TextLayoutKey
+{
+  /** Fingerprint of the source string. */
+  uint64_t text;
+  /** Fingerprint of whatever turned the source string into the laid out one. */
+  uint64_t variant;
+  /** Fingerprint of the container's parameters other than its size. */
+  uint64_t container;
+  int32_t widthClass;
+  int32_t heightClass;
+
+  bool operator==(const TextLayoutKey &other) const {
+    return text == other.text && variant == other.variant && container == other.container
+        && widthClass == other.widthClass && heightClass == other.heightClass;
+  }
+
+  /** Sizes within 1/8 point share a class. Unbounded sizes get their own. */
+  static int32_t SizeClass(double points) {
+    const double kClassesPerPoint = 8;
+    if (!(points < (double)INT32_MAX / kClassesPerPoint)) {
+      return INT32_MAX;
+    }
+    return (int32_t)std::floor(points * kClassesPerPoint + 0.5);
+  }
+};
+
+struct TextLayoutKeyHash
+{
+  size_t operator()(const TextLayoutKey &key) const {
+    Fingerprint f;
+    f.Add(key.text);
+    f.Add(key.variant);
+    f.Add(key.container);
+    f.Add(((uint64_t)(uint32_t)key.widthClass << 32) | (uint32_t)key.heightClass);
+    return (size_t)f.Value();
+  }
+};
+
+/**
+ * A thread safe least recently used cache, bounded by the estimated bytes of
+ * its values rather than their number.
+ *
+ * Keys are spread over a fixed number of shards, each with its own lock, list
+ * and byte budget, so lookups on different shards never contend. Every lookup
+ * and insertion moves the entry to the front of its shard; insertions evict
+ * from the back until the shard is within budget. Values are destroyed after
+ * the shard lock is released.
+ */
+template <typename Key, typename Value, typename Hash>
+class ShardedLRUCache
+{
+public:
+  struct Statistics
+  {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t capacityBytes;
+  };
+
+  /** `shardCount` is rounded up to a power of two; each shard gets an equal part of `capacityBytes`. */
+  ShardedLRUCache(size_t capacityBytes, size_t shardCount)
+    : _shardMask(RoundUpToPowerOfTwo(shardCount) - 1), _shards(_shardMask + 1) {
+    for (Shard &shard : _shards) {
+      shard.capacity = capacityBytes / _shards.size();
+    }
+  }
+
+  /**
+   * Looks up `key` and, if `accept(value)` agrees that the value can be used,
+   * copies it to `out` and marks it most recently used. `accept` runs under the
+   * shard's lock. A rejected value stays cached and counts as a miss.
+   */
+  template <typename Accept>
+  bool Find(const Key &key, Accept &&accept, Value &out) {
+    Shard &shard = ShardFor(key);
+    std::lock_guard<std::mutex> l(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end() || !accept(static_cast<const Value &>(found->second->value))) {
+      shard.misses++;
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    shard.hits++;
+    out = found->second->value;
+    return true;
+  }
+
+  bool Find(const Key &key, Value &out) {
+    return Find(key, [](const Value &) { return true; }, out);
+  }
+
+  /**
+   * Caches `value` under `key`, replacing any value already there, then evicts
+   * least recently used entries until the shard is within budget. A value too
+   * large for a shard on its own is not cached.
+   */
+  void Insert(const Key &key, Value value, size_t bytes) {
+    Shard &shard = ShardFor(key);
+    std::vector<Value> released;
+    {
+      std::lock_guard<std::mutex> l(shard.mutex);
+      auto found = shard.index.find(key);
+      if (found != shard.index.end()) {
+        shard.bytes -= found->second->bytes;
+        released.push_back(std::move(found->second->value));
+        shard.lru.erase(found->second);
+        shard.index.erase(found);
+      }
+      if (bytes > shard.capacity) {
+        return;
+      }
+      shard.lru.push_front(Entry{key, std::move(value), bytes});
+      shard.index.emplace(key, shard.lru.begin());
+      shard.bytes += bytes;
+      shard.insertions++;
+      while (shard.bytes > shard.capacity) {
+        Entry &victim = shard.lru.back();
+        shard.bytes -= victim.bytes;
+        shard.index.erase(victim.key);
+        released.push_back(std::move(victim.value));
+        shard.lru.pop_back();
+        shard.evictions++;
+      }
+    }
+  }
+
+  /** Drops every entry, for example on a memory warning. Counters are kept. */
+  void Clear() {
+    for (Shard &shard : _shards) {
+      std::list<Entry> lru;
+      {
+        std::lock_guard<std::mutex> l(shard.mutex);
+        shard.index.clear();
+        lru.swap(shard.lru);
+        shard.bytes = 0;
+      }
+    }
+  }
+
+  Statistics GetStatistics() {
+    Statistics statistics = {};
+    for (Shard &shard : _shards) {
+      std::lock_guard<std::mutex> l(shard.mutex);
+      statistics.hits += shard.hits;
+      statistics.misses += shard.misses;
+      statistics.insertions += shard.insertions;
+      statistics.evictions += shard.evictions;
+      statistics.entries += shard.index.size();
+      statistics.bytes += shard.bytes;
+      statistics.capacityBytes += shard.capacity;
+    }
+    return statistics;
+  }
+
+private:
+  struct Entry
+  {
+    Key key;
+    Value value;
+    size_t bytes;
+  };
+
+  struct Shard
+  {
+    Shard() : capacity(0), bytes(0), hits(0), misses(0), insertions(0), evictions(0) {}
+
+    std::mutex mutex;
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+    size_t capacity;
+    size_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+  };
+
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+      p <<= 1;
+    }
+    return p;
+  }
+
+  Shard &ShardFor(const Key &key) {
+    // The top bits, which the index's own bucketing leaves alone.
+    const uint64_t h = Fingerprint::Hash(Hash()(key));
+    return _shards[(size_t)(h >> 40) & _shardMask];
+  }
+
+  ShardedLRUCache(const ShardedLRUCache &) = delete;
+  ShardedLRUCache &operator=(const ShardedLRUCache &) = delete;
+
+  const size_t _shardMask;
+  std::vector<Shard> _shards;
+};
+
+} // namespace AS
@@ -0,0 +1,451 @@
+//
+//  ASTraceRecorder.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the recorder can be built,
+// tested and benchmarked on its own. ASTrace.h is the Objective-C face of it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#endif
+
+namespace AS {
+
+enum class TracePhase : uint8_t {
+  Begin,
+  End,
+  Instant,
+  Counter,
+};
+
+/** One fixed-size trace event. `name` is an id from TraceRecorder::Intern. */
+struct TraceEvent
+{
+  uint64_t timestamp;
+  uint64_t arg;
+  uint32_t name;
+  TracePhase phase;
+};
+
+/**
+ * A single-producer, single-consumer ring of trace events. The owning thread
+ * pushes without locking; one drainer at a time pops. A push onto a full ring
+ * drops the event and counts it, so recording never waits for the drainer.
+ */
+class TraceRing
+{
+public:
+  static const size_t kCapacity = 4096;
+
+  TraceRing() : _head(0), _cachedTail(0), _dropped(0), _tail(0) {}
+
+  bool Push(const TraceEvent &event) {
+    const uint64_t head = _head.load(std::memory_order_relaxed);
+    if (head - _cachedTail >= kCapacity) {
+      _cachedTail = _tail.load(std::memory_order_acquire);
+      if (head - _cachedTail >= kCapacity) {
+        _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+    _events[head & (kCapacity - 1)] = event;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Pops every event pushed so far, oldest first. */
+  template <typename Consume>
+  size_t Drain(Consume &&consume) {
+    const uint64_t tail = _tail.load(std::memory_order_relaxed);
+    const uint64_t head = _head.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i != head; i++) {
+      consume(_events[i & (kCapacity - 1)]);
+    }
+    _tail.store(head, std::memory_order_release);
+    return (size_t)(head - tail);
+  }
+
+  uint64_t Dropped() const {
+    return _dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  // The producer's and the drainer's positions live on separate cache lines.
+  std::atomic<uint64_t> _head;
+  uint64_t _cachedTail;
+  std::atomic<uint64_t> _dropped;
+  char _producerPadding[64];
+  std::atomic<uint64_t> _tail;
+  char _consumerPadding[64];
+  TraceEvent _events[kCapacity];
+};
+
+/**
+ * Records begin, end, instant and counter events from any thread and exports
+ * them as Chrome trace-event JSON, for chrome://tracing or Perfetto.
+ *
+ * Each thread records into its own TraceRing, found through a pthread key, so
+ * recording takes no lock and shares nothing with other threads. A flusher
+ * thread, or Flush(), moves events from the rings into one bounded store;
+ * once the store is full, further events are counted as dropped. A thread's
+ * ring is flushed and freed when the thread exits.
+ *
+ * Event names are interned once, typically per call site, and recorded by id.
+ */
+class TraceRecorder
+{
+public:
+  /** Recording starts off; Record does nothing while it is off. */
+  static void SetEnabled(bool enabled) {
+    EnabledFlag().store(enabled, std::memory_order_relaxed);
+  }
+
+  static bool IsEnabled() {
+    return EnabledFlag().load(std::memory_order_relaxed);
+  }
+
+  /** Monotonic nanoseconds. Reading the clock is most of the cost of recording an event. */
+  static uint64_t Now() {
+#if defined(__APPLE__)
+    // Reads the timebase register, without the system call steady_clock may make.
+    static const mach_timebase_info_data_t timebase = [] {
+      mach_timebase_info_data_t info;
+      mach_timebase_info(&info);
+      return info;
+    }();
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  /** Returns the id for `name`, the same one every time. The name is copied. */
+  static uint32_t Intern(const char *name) {
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.namesMutex);
+    auto found = registry.nameIds.find(name);
+    if (found != registry.nameIds.end()) {
+      return found->second;
+    }
+    const uint32_t id = (uint32_t)registry.names.size();
+    registry.names.push_back(name);
+    registry.nameIds.emplace(registry.names.back(), id);
+    return id;
+  }
+
+  static void Record(TracePhase phase, uint32_t name, uint64_t arg) {
+    if (!IsEnabled()) {
+      return;
+    }
+    TraceEvent event;
+    event.timestamp = Now();
+    event.arg = arg;
+    event.name = name;
+    event.phase = phase;
+    CurrentThreadRing().ring.Push(event);
+  }
+
+  /** Names the calling thread in exports. Threads are otherwise named by pthread_getname_np. */
+  static void SetCurrentThreadName(const char *name) {
+    ThreadRing &ring = CurrentThreadRing();
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.mutex);
+    registry.threadNames[ring.threadId] = name;
+  }
+
+  /** Caps the events kept between exports. Further events are counted as dropped. */
+  static void SetStoreCapacity(size_t capacity) {
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.mutex);
+    registry.storeCapacity = capacity;
+  }
+
+  /** Moves every recorded event from the thread rings to the store. */
+  static void Flush() {
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.mutex);
+    for (ThreadRing *ring : registry.rings) {
+      DrainLocked(registry, *ring);
+    }
+  }
+
+  /** Starts a thread that flushes every `intervalMilliseconds`. Does nothing if one is running. */
+  static void StartFlusher(unsigned intervalMilliseconds) {
+    Flusher &flusher = SharedFlusher();
+    std::lock_guard<std::mutex> l(flusher.mutex);
+    if (flusher.thread.joinable()) {
+      return;
+    }
+    flusher.stopping = false;
+    flusher.thread = std::thread([&flusher, intervalMilliseconds] {
+      std::unique_lock<std::mutex> fl(flusher.mutex);
+      while (!flusher.stopping) {
+        flusher.condition.wait_for(fl, std::chrono::milliseconds(intervalMilliseconds));
+        fl.unlock();
+        Flush();
+        fl.lock();
+      }
+    });
+  }
+
+  static void StopFlusher() {
+    Flusher &flusher = SharedFlusher();
+    std::thread thread;
+    {
+      std::lock_guard<std::mutex> l(flusher.mutex);
+      flusher.stopping = true;
+      thread.swap(flusher.thread);
+    }
+    flusher.condition.notify_all();
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  /** Events lost to full rings or a full store since the last Reset. */
+  static uint64_t DroppedCount() {
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.mutex);
+    uint64_t dropped = registry.droppedFromStore + registry.droppedFromRetiredRings;
+    for (ThreadRing *ring : registry.rings) {
+      dropped += ring->ring.Dropped() - ring->droppedAtReset;
+    }
+    return dropped;
+  }
+
+  /** Events in the store, waiting to be exported. */
+  static size_t StoredCount() {
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.mutex);
+    return registry.store.size();
+  }
+
+  /**
+   * Flushes, then returns everything stored as a Chrome trace-event JSON
+   * object. Timestamps are in microseconds since the first stored event.
+   * Events stay stored; call Reset to start over.
+   */
+  static std::string ExportChromeTrace() {
+    Flush();
+    Registry &registry = SharedRegistry();
+    std::vector<std::string> names;
+    {
+      std::lock_guard<std::mutex> l(registry.namesMutex);
+      names = registry.names;
+    }
+    std::lock_guard<std::mutex> l(registry.mutex);
+    const long pid = (long)getpid();
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    char buffer[160];
+    for (const auto &thread : registry.threadNames) {
+      snprintf(buffer, sizeof(buffer), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,\"args\":{\"name\":",
+               first ? "" : ",", pid, thread.first);
+      json += buffer;
+      AppendQuoted(json, thread.second);
+      json += "}}";
+      first = false;
+    }
+    uint64_t epoch = UINT64_MAX;
+    for (const StoredEvent &stored : registry.store) {
+      epoch = std::min(epoch, stored.event.timestamp);
+    }
+    for (const StoredEvent &stored : registry.store) {
+      const TraceEvent &event = stored.event;
+      const uint64_t ns = event.timestamp - epoch;
+      snprintf(buffer, sizeof(buffer), "%s\n{\"ph\":\"%s\",\"ts\":%llu.%03u,\"pid\":%ld,\"tid\":%u,\"name\":",
+               first ? "" : ",", PhaseCode(event.phase), (unsigned long long)(ns / 1000), (unsigned)(ns % 1000), pid, stored.threadId);
+      json += buffer;
+      AppendQuoted(json, event.name < names.size() ? names[event.name] : std::string("?"));
+      const char *argName = event.phase == TracePhase::Counter ? "value" : "arg";
+      snprintf(buffer, sizeof(buffer), "%s,\"args\":{\"%s\":%llu}}",
+               event.phase == TracePhase::Instant ? ",\"s\":\"t\"" : "", argName, (unsigned long long)event.arg);
+      json += buffer;
+      first = false;
+    }
+    json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return json;
+  }
+
+  /** Forgets every stored and unflushed event. Interned names and thread names are kept. */
+  static void Reset() {
+    Registry &registry = SharedRegistry();
+    std::lock_guard<std::mutex> l(registry.mutex);
+    for (ThreadRing *ring : registry.rings) {
+      ring->ring.Drain([](const TraceEvent &) {});
+      ring->droppedAtReset = ring->ring.Dropped();
+    }
+    registry.store.clear();
+    registry.store.shrink_to_fit();
+    registry.droppedFromStore = 0;
+    registry.droppedFromRetiredRings = 0;
+  }
+
+private:
+  struct ThreadRing
+  {
+    TraceRing ring;
+    uint32_t threadId;
+    uint64_t droppedAtReset;
+  };
+
+  struct StoredEvent
+  {
+    TraceEvent event;
+    uint32_t threadId;
+  };
+
+  struct Registry
+  {
+    Registry() : nextThreadId(1), storeCapacity(1 << 20), droppedFromStore(0), droppedFromRetiredRings(0) {}
+
+    // Guards everything but the names.
+    std::mutex mutex;
+    std::vector<ThreadRing *> rings;
+    std::unordered_map<uint32_t, std::string> threadNames;
+    uint32_t nextThreadId;
+    std::vector<StoredEvent> store;
+    size_t storeCapacity;
+    uint64_t droppedFromStore;
+    uint64_t droppedFromRetiredRings;
+
+    // Interning never waits for a flush.
+    std::mutex namesMutex;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> nameIds;
+  };
+
+  struct Flusher
+  {
+    Flusher() : stopping(false) {}
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::thread thread;
+    bool stopping;
+  };
+
+  static const char *PhaseCode(TracePhase phase) {
+    switch (phase) {
+      case TracePhase::Begin:
+        return "B";
+      case TracePhase::End:
+        return "E";
+      case TracePhase::Instant:
+        return "i";
+      case TracePhase::Counter:
+        return "C";
+    }
+    return "i";
+  }
+
+  static void AppendQuoted(std::string &json, const std::string &string) {
+    json += '"';
+    for (char c : string) {
+      if (c == '"' || c == '\\') {
+        json += '\\';
+        json += c;
+      } else if ((unsigned char)c < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+        json += escaped;
+      } else {
+        json += c;
+      }
+    }
+    json += '"';
+  }
+
+  static void DrainLocked(Registry &registry, ThreadRing &ring) {
+    ring.ring.Drain([&registry, &ring](const TraceEvent &event) {
+      if (registry.store.size() >= registry.storeCapacity) {
+        registry.droppedFromStore++;
+        return;
+      }
+      registry.store.push_back(StoredEvent{event, ring.threadId});
+    });
+  }
+
+  static std::atomic<bool> &EnabledFlag() {
+    static std::atomic<bool> enabled(false);
+    return enabled;
+  }
+
+  static Registry &SharedRegistry() {
+    // Never destroyed, so threads exiting during process teardown can still retire.
+    static Registry *registry = new Registry();
+    return *registry;
+  }
+
+  static Flusher &SharedFlusher() {
+    static Flusher *flusher = new Flusher();
+    return *flusher;
+  }
+
+  static void RetireThreadRing(void *value) {
+    ThreadRing *ring = static_cast<ThreadRing *>(value);
+    Registry &registry = SharedRegistry();
+    {
+      std::lock_guard<std::mutex> l(registry.mutex);
+      DrainLocked(registry, *ring);
+      registry.droppedFromRetiredRings += ring->ring.Dropped() - ring->droppedAtReset;
+      for (auto it = registry.rings.begin(); it != registry.rings.end(); ++it) {
+        if (*it == ring) {
+          registry.rings.erase(it);
+          break;
+        }
+      }
+    }
+    delete ring;
+  }
+
+  static pthread_key_t ThreadRingKey() {
+    static pthread_key_t key = [] {
+      pthread_key_t k;
+      pthread_key_create(&k, RetireThreadRing);
+      return k;
+    }();
+    return key;
+  }
+
+  static ThreadRing &CurrentThreadRing() {
+    const pthread_key_t key = ThreadRingKey();
+    ThreadRing *ring = static_cast<ThreadRing *>(pthread_getspecific(key));
+    if (ring == nullptr) {
+      ring = new ThreadRing();
+      ring->droppedAtReset = 0;
+      pthread_setspecific(key, ring);
+      char name[64] = {0};
+      pthread_getname_np(pthread_self(), name, sizeof(name));
+      Registry &registry = SharedRegistry();
+      std::lock_guard<std::mutex> l(registry.mutex);
+      ring->threadId = registry.nextThreadId++;
+      registry.threadNames[ring->threadId] = name[0] != '\0' ? std::string(name) : "thread " + std::to_string(ring->threadId);
+      registry.rings.push_back(ring);
+    }
+    return *ring;
+  }
+};
+
+} // namespace AS
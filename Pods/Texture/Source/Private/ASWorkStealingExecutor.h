@@ -0,0 +1,488 @@
+//
+//  ASWorkStealingExecutor.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so the executor can be built and
+// benchmarked on its own.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AS {
+
+class WorkGroup;
+
+/**
+ * A unit of work for WorkStealingExecutor. The executor deletes the item after
+ * calling Perform().
+ */
+class WorkItem
+{
+public:
+  WorkItem () : _next(nullptr), _group(nullptr) {}
+  virtual ~WorkItem () {}
+
+  /// Runs the work. `canceled` is true if the item's group was canceled before it started.
+  virtual void Perform(bool canceled) = 0;
+
+  WorkItem (const WorkItem&) = delete;
+  WorkItem &operator=(const WorkItem&) = delete;
+
+private:
+  friend class WorkStealingExecutor;
+  friend class WorkGroup;
+  WorkItem *_next; // injection queue link
+  WorkGroup *_group;
+};
+
+/**
+ * Chase-Lev work-stealing deque (Lê et al., "Correct and Efficient
+ * Work-Stealing for Weak Memory Models"). Only the owning worker pushes and
+ * pops at the bottom; any thread may steal from the top. Buffers that are
+ * outgrown stay alive until the deque is destroyed, since a thief may still be
+ * reading from them.
+ */
+class WorkStealingDeque
+{
+public:
+  WorkStealingDeque () : _top(0), _bottom(0), _buffer(new Buffer(32, nullptr)) {}
+
+  ~WorkStealingDeque () {
+    Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+    while (buffer) {
+      Buffer *previous = buffer->previous;
+      delete buffer;
+      buffer = previous;
+    }
+  }
+
+  WorkStealingDeque (const WorkStealingDeque&) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque&) = delete;
+
+  /// Owner only.
+  void Push(WorkItem *item) {
+    int64_t b = _bottom.load(std::memory_order_relaxed);
+    int64_t t = _top.load(std::memory_order_acquire);
+    Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+    if (b - t > buffer->mask) {
+      buffer = buffer->Grow(b, t);
+      _buffer.store(buffer, std::memory_order_release);
+    }
+    buffer->Put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  /// Owner only. Returns the most recently pushed item.
+  WorkItem *Pop() {
+    int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+    Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+    _bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = _top.load(std::memory_order_relaxed);
+    if (t > b) {
+      _bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    WorkItem *item = buffer->Get(b);
+    if (t == b) {
+      // Last item: race the thieves for it.
+      if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  /// Any thread. Returns the oldest item, or null if empty or another thread won the race.
+  WorkItem *Steal() {
+    int64_t t = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = _bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    Buffer *buffer = _buffer.load(std::memory_order_acquire);
+    WorkItem *item = buffer->Get(t);
+    if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  bool Empty() const {
+    return _top.load(std::memory_order_acquire) >= _bottom.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Buffer
+  {
+    Buffer (int64_t capacity, Buffer *previous)
+      : mask(capacity - 1), items(new std::atomic<WorkItem *>[capacity]), previous(previous) {}
+
+    WorkItem *Get(int64_t i) { return items[i & mask].load(std::memory_order_relaxed); }
+    void Put(int64_t i, WorkItem *item) { items[i & mask].store(item, std::memory_order_relaxed); }
+
+    Buffer *Grow(int64_t bottom, int64_t top) {
+      Buffer *grown = new Buffer((mask + 1) * 2, this);
+      for (int64_t i = top; i < bottom; i++) {
+        grown->Put(i, Get(i));
+      }
+      return grown;
+    }
+
+    const int64_t mask;
+    std::unique_ptr<std::atomic<WorkItem *>[]> items;
+    Buffer *const previous;
+  };
+
+  // Top and bottom are written by different threads; keep them on separate
+  // cache lines. Padding rather than alignas, which C++11 `new` doesn't honor.
+  std::atomic<int64_t> _top;
+  char _topPadding[64 - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> _bottom;
+  std::atomic<Buffer *> _buffer;
+  char _bottomPadding[64 - sizeof(std::atomic<int64_t>) - sizeof(std::atomic<Buffer *>)];
+};
+
+/**
+ * Executes work items on a bounded, elastic set of workers.
+ *
+ * Items are submitted into one of kLaneCount priority lanes, lane 0 first.
+ * Submissions land in a per-lane injection queue; a worker moves a batch of
+ * them into its own deque per lane, so only submitters and refilling workers
+ * touch the injection lock, and idle workers steal from busy ones instead.
+ *
+ * Workers are not threads of their own: `spawn` is called whenever another
+ * worker is wanted and must arrange for RunWorker() to be called on some
+ * thread (e.g. with dispatch_async). RunWorker() returns as soon as there is
+ * no work left, so no thread is held while idle.
+ *
+ * The worker in slot 0 takes lanes in rotation rather than strictly by
+ * priority, so a steady stream of high priority work cannot starve the rest.
+ */
+class WorkStealingExecutor
+{
+public:
+  static constexpr int kLaneCount = 3;
+
+  WorkStealingExecutor (unsigned maxWorkers, std::function<void(WorkStealingExecutor &)> spawn)
+    : _slots(new Slot[maxWorkers]), _slotCount(maxWorkers), _spawn(std::move(spawn)),
+      _workerLimit(maxWorkers), _activeWorkers(0), _searchingWorkers(0), _pending(0) {}
+
+  ~WorkStealingExecutor () {
+    for (int lane = 0; lane < kLaneCount; lane++) {
+      while (WorkItem *item = _lanes[lane].head) {
+        _lanes[lane].head = item->_next;
+        delete item;
+      }
+    }
+  }
+
+  WorkStealingExecutor (const WorkStealingExecutor&) = delete;
+  WorkStealingExecutor &operator=(const WorkStealingExecutor&) = delete;
+
+  unsigned MaxWorkers() const { return _slotCount; }
+
+  /**
+   * Queues `item`, taking ownership of it. Starts another worker if none is
+   * looking for work and fewer than `workerLimit` (at most MaxWorkers()) are
+   * running.
+   */
+  void Submit(WorkItem *item, int lane, unsigned workerLimit) {
+    if (lane < 0) lane = 0;
+    if (lane >= kLaneCount) lane = kLaneCount - 1;
+    if (workerLimit > _slotCount) workerLimit = _slotCount;
+    _workerLimit.store(workerLimit, std::memory_order_relaxed);
+
+    _pending.fetch_add(1, std::memory_order_seq_cst);
+    {
+      std::lock_guard<std::mutex> l(_lanes[lane].mutex);
+      item->_next = nullptr;
+      if (_lanes[lane].tail) {
+        _lanes[lane].tail->_next = item;
+      } else {
+        _lanes[lane].head = item;
+      }
+      _lanes[lane].tail = item;
+      _lanes[lane].count++;
+    }
+
+    if (_searchingWorkers.load(std::memory_order_seq_cst) == 0) {
+      StartWorker();
+    }
+  }
+
+  /// Runs items until none are left. Called once per spawn, on any thread.
+  void RunWorker() {
+    unsigned slot = ClaimSlot();
+    WorkStealingDeque *deques = _slots[slot].deques;
+    int firstLane = 0;
+
+    // A worker is searching from the moment it is started until it finds an
+    // item, and again after running it. Only the last searcher to find work
+    // starts another one, so cheap items don't wake every worker at once and
+    // expensive ones still fan out up to the limit.
+    for (;;) {
+      WorkItem *item = nullptr;
+      for (int i = 0; i < kLaneCount && item == nullptr; i++) {
+        int lane = (firstLane + i) % kLaneCount;
+        item = deques[lane].Pop();
+        if (item == nullptr) {
+          item = Refill(deques[lane], lane);
+        }
+        if (item == nullptr) {
+          item = Steal(slot, lane);
+        }
+      }
+
+      if (item) {
+        _pending.fetch_sub(1, std::memory_order_seq_cst);
+        if (_searchingWorkers.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+            _pending.load(std::memory_order_seq_cst) > 0) {
+          StartWorker();
+        }
+        Run(item);
+        _searchingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        if (slot == 0) {
+          firstLane = (firstLane + 1) % kLaneCount;
+        }
+        continue;
+      }
+
+      if (_pending.load(std::memory_order_seq_cst) > 0) {
+        // Items are in flight between an injection queue and a deque.
+        std::this_thread::yield();
+        continue;
+      }
+
+      // Retire, then look again: a submitter that saw us still searching did
+      // not start a worker, so any item it queued meanwhile is ours to run.
+      ReleaseSlot(slot);
+      _searchingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+      _activeWorkers.fetch_sub(1, std::memory_order_seq_cst);
+      if (_pending.load(std::memory_order_seq_cst) == 0 ||
+          !TryActivateWorker(_workerLimit.load(std::memory_order_relaxed))) {
+        return;
+      }
+      _searchingWorkers.fetch_add(1, std::memory_order_seq_cst);
+      slot = ClaimSlot();
+      deques = _slots[slot].deques;
+    }
+  }
+
+private:
+  struct Lane
+  {
+    Lane () : head(nullptr), tail(nullptr), count(0) {}
+    std::mutex mutex;
+    WorkItem *head;
+    WorkItem *tail;
+    size_t count;
+    char padding[64];
+  };
+
+  struct Slot
+  {
+    Slot () : claimed(false) {}
+    WorkStealingDeque deques[kLaneCount];
+    std::atomic<bool> claimed;
+  };
+
+  void StartWorker() {
+    if (TryActivateWorker(_workerLimit.load(std::memory_order_relaxed))) {
+      _searchingWorkers.fetch_add(1, std::memory_order_seq_cst);
+      _spawn(*this);
+    }
+  }
+
+  bool TryActivateWorker(unsigned workerLimit) {
+    unsigned active = _activeWorkers.load(std::memory_order_seq_cst);
+    while (active < workerLimit) {
+      if (_activeWorkers.compare_exchange_weak(active, active + 1, std::memory_order_seq_cst)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Claimed slots never outnumber active workers, so a free one is always
+  // coming, if not already there.
+  unsigned ClaimSlot() {
+    for (;;) {
+      for (unsigned i = 0; i < _slotCount; i++) {
+        if (!_slots[i].claimed.load(std::memory_order_relaxed) &&
+            !_slots[i].claimed.exchange(true, std::memory_order_acquire)) {
+          return i;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void ReleaseSlot(unsigned slot) {
+    _slots[slot].claimed.store(false, std::memory_order_release);
+  }
+
+  // Moves a share of the lane's injected items into `deque` and returns the
+  // first one. The deque pops newest first, so the batch goes in reversed.
+  WorkItem *Refill(WorkStealingDeque &deque, int lane) {
+    Lane &l = _lanes[lane];
+    WorkItem *batch[kMaxBatch];
+    size_t count = 0;
+    {
+      std::lock_guard<std::mutex> lock(l.mutex);
+      if (l.count == 0) {
+        return nullptr;
+      }
+      size_t share = std::min(l.count / _slotCount + 1, l.count);
+      while (count < share && count < kMaxBatch) {
+        WorkItem *item = l.head;
+        l.head = item->_next;
+        batch[count++] = item;
+      }
+      l.count -= count;
+      if (l.head == nullptr) {
+        l.tail = nullptr;
+      }
+    }
+    for (size_t i = count; i > 1; i--) {
+      deque.Push(batch[i - 1]);
+    }
+    return batch[0];
+  }
+
+  WorkItem *Steal(unsigned thief, int lane) {
+    for (unsigned i = 1; i < _slotCount; i++) {
+      WorkStealingDeque &victim = _slots[(thief + i) % _slotCount].deques[lane];
+      if (!victim.Empty()) {
+        if (WorkItem *item = victim.Steal()) {
+          return item;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  static void Run(WorkItem *item);
+
+  static constexpr size_t kMaxBatch = 32;
+
+  Lane _lanes[kLaneCount];
+  std::unique_ptr<Slot[]> _slots;
+  const unsigned _slotCount;
+  const std::function<void(WorkStealingExecutor &)> _spawn;
+  std::atomic<unsigned> _workerLimit; // as of the latest Submit()
+  std::atomic<unsigned> _activeWorkers;
+  std::atomic<unsigned> _searchingWorkers;
+  char _activeWorkersPadding[64];
+  std::atomic<int64_t> _pending;
+};
+
+/**
+ * Tracks completion of a set of items, like dispatch_group_t, and can cancel
+ * the ones that have not started yet.
+ *
+ * Reference counted: Create() returns a group with one reference, and every
+ * Enter() takes another until the matching Leave(), so a released group lives
+ * until its last item has run.
+ */
+class WorkGroup
+{
+public:
+  static WorkGroup *Create() { return new WorkGroup(); }
+
+  void Retain() { _refs.fetch_add(1, std::memory_order_relaxed); }
+
+  void Release() {
+    if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  /// Submits `item` to `executor` as part of this group.
+  void Schedule(WorkStealingExecutor &executor, WorkItem *item, int lane, unsigned workerLimit) {
+    Enter();
+    item->_group = this;
+    executor.Submit(item, lane, workerLimit);
+  }
+
+  /// Calls `block` once every entered item has left, right away if none is pending.
+  void Notify(std::function<void()> block) {
+    {
+      std::lock_guard<std::mutex> l(_mutex);
+      if (_pendingItems.load(std::memory_order_acquire) > 0) {
+        _notifyBlocks.push_back(std::move(block));
+        return;
+      }
+    }
+    block();
+  }
+
+  void Enter() {
+    Retain();
+    _pendingItems.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Leave() {
+    if (_pendingItems.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::vector<std::function<void()>> blocks;
+      {
+        std::lock_guard<std::mutex> l(_mutex);
+        blocks.swap(_notifyBlocks);
+        _condition.notify_all();
+      }
+      for (auto &block : blocks) {
+        block();
+      }
+    }
+    Release();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> l(_mutex);
+    while (_pendingItems.load(std::memory_order_acquire) > 0) {
+      _condition.wait(l);
+    }
+  }
+
+  /// Items of this group that have not started yet run with `canceled` set.
+  void Cancel() { _canceled.store(true, std::memory_order_release); }
+  bool IsCanceled() const { return _canceled.load(std::memory_order_acquire); }
+
+protected:
+  WorkGroup () : _refs(1), _pendingItems(0), _canceled(false) {}
+  virtual ~WorkGroup () {} // call Release() instead
+
+private:
+  std::atomic<int> _refs;
+  std::atomic<int> _pendingItems;
+  std::atomic<bool> _canceled;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  std::vector<std::function<void()>> _notifyBlocks;
+};
+
+inline void WorkStealingExecutor::Run(WorkItem *item) {
+  WorkGroup *group = item->_group;
+  item->Perform(group && group->IsCanceled());
+  delete item;
+  if (group) {
+    group->Leave();
+  }
+}
+
+} // namespace AS
@@ -0,0 +1,140 @@
+//
+//  ASFlatLayoutTree.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// Plain C++11 with no Foundation dependency, so flattening can be built, tested
+// and benchmarked on its own. -[ASLayout filteredNodeLayoutTree] uses it.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace AS {
+
+/**
+ * A layout tree laid out as one contiguous array of records in depth-first
+ * preorder, each with its absolute position and the index of its parent.
+ *
+ * Build walks the tree with an explicit stack. It descends into every layout
+ * that is not a node and stops at nodes, which are what a flattened layout
+ * keeps. The record and stack storage is kept between builds, so a tree kept
+ * per thread flattens without allocating once it has seen a tree that size.
+ *
+ * Layout is a non-owning handle, and Point needs `+` and a zero default.
+ * Not thread safe; keep one tree per thread.
+ */
+template <typename Layout, typename Point>
+class FlatLayoutTree
+{
+public:
+  static const uint32_t kNoParent = UINT32_MAX;
+
+  struct Record
+  {
+    Layout layout;
+    /** Relative to the root. */
+    Point position;
+    uint32_t parent;
+    /** Whether this is a node the walk stopped at. The root never is. */
+    bool isNode;
+  };
+
+  FlatLayoutTree() : _nodeCount(0) {}
+
+  /**
+   * Replaces the records with the tree under `root`. `isNode(layout)` tells
+   * whether to stop at a layout, `position(layout)` gives its position in its
+   * parent and `children(layout, out)` appends its sublayouts to `out`. The
+   * root is always descended into and sits at position zero.
+   */
+  template <typename IsNode, typename Position, typename Children>
+  void Build(Layout root, IsNode isNode, Position position, Children children) {
+    _records.clear();
+    _stack.clear();
+    _nodeCount = 0;
+    _records.push_back({root, Point(), kNoParent, false});
+    PushChildren(0, children);
+    while (!_stack.empty()) {
+      const Pending pending = _stack.back();
+      _stack.pop_back();
+      const uint32_t index = (uint32_t)_records.size();
+      const Point absolute = _records[pending.parent].position + position(pending.layout);
+      const bool node = isNode(pending.layout);
+      _records.push_back({pending.layout, absolute, pending.parent, node});
+      if (node) {
+        _nodeCount++;
+      } else {
+        PushChildren(index, children);
+      }
+    }
+  }
+
+  size_t Size() const {
+    return _records.size();
+  }
+
+  /** How many records are nodes. */
+  size_t NodeCount() const {
+    return _nodeCount;
+  }
+
+  const Record &operator[](size_t index) const {
+    return _records[index];
+  }
+
+  const Record *begin() const {
+    return _records.data();
+  }
+
+  const Record *end() const {
+    return _records.data() + _records.size();
+  }
+
+  /** Drops the records, and their storage too if an unusually big tree grew it. */
+  void Reset() {
+    if (_records.capacity() > kRetainedRecords) {
+      std::vector<Record>().swap(_records);
+      std::vector<Pending>().swap(_stack);
+      std::vector<Layout>().swap(_children);
+    }
+    _records.clear();
+    _stack.clear();
+    _children.clear();
+    _nodeCount = 0;
+  }
+
+private:
+  // Storage for this many records is kept between builds.
+  static const size_t kRetainedRecords = 4096;
+
+  struct Pending
+  {
+    Layout layout;
+    uint32_t parent;
+  };
+
+  // Pushed in reverse, so they pop in order.
+  template <typename Children>
+  void PushChildren(uint32_t parent, Children &children) {
+    _children.clear();
+    children(_records[parent].layout, _children);
+    for (size_t i = _children.size(); i > 0; i--) {
+      _stack.push_back({_children[i - 1], parent});
+    }
+  }
+
+  FlatLayoutTree(const FlatLayoutTree &) = delete;
+  FlatLayoutTree &operator=(const FlatLayoutTree &) = delete;
+
+  std::vector<Record> _records;
+  std::vector<Pending> _stack;
+  std::vector<Layout> _children;
+  size_t _nodeCount;
+};
+
+} // namespace AS
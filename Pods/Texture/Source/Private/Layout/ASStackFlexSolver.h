@@ -0,0 +1,187 @@
+//
+//  ASStackFlexSolver.h
+//  Texture
+//
+//  Licensed under Apache 2.0: http://www.apache.org/licenses/LICENSE-2.0
+//
+
+#pragma once
+
+// The arithmetic core of ASStackUnpositionedLayout: line breaking and flexible
+// length resolution along the stack axis. Plain C++11 over plain structs, so
+// it can be built and benchmarked on its own; the layout spec snapshots each
+// child's style into a StackFlexItem once and lays children out itself.
+
+#include <cmath>
+#include <cstddef>
+
+namespace AS {
+
+template <typename Float>
+struct StackFlexItem
+{
+  /** Size along the stack axis, from the child's current layout. */
+  Float stackSize;
+  Float flexGrow;
+  Float flexShrink;
+  Float spacingBefore;
+  Float spacingAfter;
+  /** Set by FlexStackLine: whether the child must be laid out again, at flexedStackSize. */
+  bool flexed;
+  Float flexedStackSize;
+
+  bool IsFlexibleInBothDirections() const
+  {
+    return flexGrow > 0 && flexShrink > 0;
+  }
+};
+
+/**
+ * The distance to add to `sum` to bring it within [minimum, maximum]: positive
+ * when the items must grow, negative when they must shrink.
+ */
+template <typename Float>
+Float StackViolation(Float sum, Float minimum, Float maximum)
+{
+  if (sum < minimum) {
+    return minimum - sum;
+  } else if (sum > maximum) {
+    return maximum - sum;
+  }
+  return 0;
+}
+
+/** The length the items take up along the stack axis, including all spacing. */
+template <typename Float>
+Float StackDimensionSum(const StackFlexItem<Float> *items, size_t count, Float spacing)
+{
+  // Spacing first, then sizes: the order the sums have always been taken in,
+  // which keeps layouts bit for bit the same.
+  Float sum = count == 0 ? 0 : spacing * (count - 1);
+  for (size_t i = 0; i < count; i++) {
+    sum = sum + items[i].spacingBefore + items[i].spacingAfter;
+  }
+  for (size_t i = 0; i < count; i++) {
+    sum = sum + items[i].stackSize;
+  }
+  return sum;
+}
+
+/**
+ * Breaks the items into lines (https://www.w3.org/TR/css-flexbox-1/#algo-line-break),
+ * calling `onLine(begin, end)` for each run of items in order. Without `wrap`
+ * all items share one line.
+ */
+template <typename Float, typename OnLine>
+void CollectStackLines(const StackFlexItem<Float> *items, size_t count, Float spacing,
+                       Float minimum, Float maximum, bool wrap, OnLine &&onLine)
+{
+  if (!wrap) {
+    onLine((size_t)0, count);
+    return;
+  }
+
+  size_t begin = 0;
+  Float lineStackDimensionSum = 0;
+  Float interitemSpacing = 0;
+  for (size_t i = 0; i < count; i++) {
+    const StackFlexItem<Float> &item = items[i];
+    const Float itemAndSpacingStackDimension = item.spacingBefore + item.stackSize + item.spacingAfter;
+    const bool negativeViolationIfAddItem = StackViolation(lineStackDimensionSum + interitemSpacing + itemAndSpacingStackDimension, minimum, maximum) < 0;
+    if (negativeViolationIfAddItem && i > begin) {
+      onLine(begin, i);
+      begin = i;
+      lineStackDimensionSum = 0;
+      interitemSpacing = 0;
+    }
+    lineStackDimensionSum += interitemSpacing + itemAndSpacingStackDimension;
+    interitemSpacing = spacing;
+  }
+  onLine(begin, count);
+}
+
+/**
+ * Resolves one line's violation of [minimum, maximum] by growing or shrinking
+ * its flexible items (https://www.w3.org/TR/css-flexbox-1/#resolve-flexible-lengths),
+ * setting `flexed` and `flexedStackSize` on each.
+ *
+ * Growth is shared out by flex grow factor and rounded down, with what the
+ * rounding leaves over going to the first growing item. Shrinking is shared
+ * out by flex shrink factor scaled by each item's size.
+ *
+ * Returns false if no item has a flex factor in the violation's direction, so
+ * nothing was flexed. Violations smaller than `epsilon` are ignored.
+ */
+template <typename Float>
+bool FlexStackLine(StackFlexItem<Float> *items, size_t count, Float spacing,
+                   Float minimum, Float maximum, Float epsilon)
+{
+  // Everything that does not depend on the violation, in two passes. Each sum
+  // accumulates in its original order so rounding is unchanged.
+  Float spacingSum = count == 0 ? 0 : spacing * (count - 1);
+  Float flexGrowSum = 0;
+  Float flexShrinkSum = 0;
+  for (size_t i = 0; i < count; i++) {
+    const StackFlexItem<Float> &item = items[i];
+    spacingSum = spacingSum + item.spacingBefore + item.spacingAfter;
+    flexGrowSum = flexGrowSum + item.flexGrow;
+    flexShrinkSum = flexShrinkSum + item.flexShrink;
+    items[i].flexed = false;
+  }
+  Float stackDimensionSum = spacingSum;
+  Float scaledFlexShrinkSum = 0;
+  for (size_t i = 0; i < count; i++) {
+    const StackFlexItem<Float> &item = items[i];
+    stackDimensionSum = stackDimensionSum + item.stackSize;
+    if (flexShrinkSum != 0) {
+      scaledFlexShrinkSum = scaledFlexShrinkSum + item.stackSize * (item.flexShrink / flexShrinkSum);
+    }
+  }
+
+  const Float violation = StackViolation(stackDimensionSum, minimum, maximum);
+  const bool grow = violation > 0;
+  const Float flexFactorSum = std::fabs(violation) < epsilon ? 0 : (grow ? flexGrowSum : flexShrinkSum);
+  if (flexFactorSum == 0) {
+    return false;
+  }
+
+  // One pass to size every item; the rounding remainder is known only at the
+  // end, so the first growing item is topped up afterwards.
+  Float remainingViolation = violation;
+  size_t firstFlexItem = count;
+  for (size_t i = 0; i < count; i++) {
+    StackFlexItem<Float> &item = items[i];
+    Float adjustment;
+    if (grow) {
+      adjustment = std::floor(violation * (item.flexGrow / flexFactorSum));
+    } else if (scaledFlexShrinkSum == 0) {
+      adjustment = 0;
+    } else {
+      const Float scaledFlexShrinkRatio = item.stackSize * (item.flexShrink / flexFactorSum) / scaledFlexShrinkSum;
+      adjustment = -std::fabs(scaledFlexShrinkRatio * violation);
+    }
+    remainingViolation = remainingViolation - adjustment;
+    // Items are considered inflexible if they do not need to make a flex adjustment.
+    if (adjustment != 0) {
+      if (firstFlexItem == count) {
+        firstFlexItem = i;
+      }
+      item.flexed = true;
+      item.flexedStackSize = item.stackSize + adjustment;
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    StackFlexItem<Float> &item = items[i];
+    if (item.flexed) {
+      // Only the first flexible item with a flex grow factor takes the remaining violation.
+      if (i == firstFlexItem && item.flexGrow > 0) {
+        item.flexedStackSize = item.flexedStackSize + remainingViolation;
+      }
+      item.flexedStackSize = item.flexedStackSize > 0 ? item.flexedStackSize : 0;
+    }
+  }
+  return true;
+}
+
+} // namespace AS
@@ -17,8 +17,8 @@ struct ASStackPositionedLayout {
   /** Final size of the stack */
   const CGSize size;
   
-  /** Given an unpositioned layout, computes the positions each child should be placed at. */
-  static ASStackPositionedLayout compute(const ASStackUnpositionedLayout &unpositionedLayout,
+  /** Given an unpositioned layout, computes the positions each child should be placed at. Takes over its items. */
+  static ASStackPositionedLayout compute(ASStackUnpositionedLayout &&unpositionedLayout,
                                          const ASStackLayoutSpecStyle &style,
                                          const ASSizeRange &constrainedSize);
 };
@@ -120,6 +120,7 @@ static void stackOffsetAndSpacingForEachItem(const std::size_t numOfItems,
 }
 
 static void positionItemsInLine(const ASStackUnpositionedLine &line,
+                                const std::vector<ASStackLayoutSpecItem> &items,
                                 const ASStackLayoutSpecStyle &style,
                                 const CGPoint &startingPoint,
                                 const CGFloat stackSpacing)
@@ -127,7 +128,8 @@ static void positionItemsInLine(const ASStackUnpositionedLine &line,
   CGPoint p = startingPoint;
   BOOL first = YES;
   
-  for (const auto &item : line.items) {
+  for (size_t i = line.begin; i < line.end; i++) {
+    const auto &item = items[i];
     p = p + directionPoint(style.direction, item.child.style.spacingBefore, 0);
     if (!first) {
       p = p + directionPoint(style.direction, style.spacing + stackSpacing, 0);
@@ -139,7 +141,7 @@ static void positionItemsInLine(const ASStackUnpositionedLine &line,
   }
 }
 
-ASStackPositionedLayout ASStackPositionedLayout::compute(const ASStackUnpositionedLayout &layout,
+ASStackPositionedLayout ASStackPositionedLayout::compute(ASStackUnpositionedLayout &&layout,
                                                          const ASStackLayoutSpecStyle &style,
                                                          const ASSizeRange &sizeRange)
 {
@@ -158,7 +160,6 @@ ASStackPositionedLayout ASStackPositionedLayout::compute(const ASStackUnposition
   CGFloat crossSpacing;
   crossOffsetAndSpacingForEachLine(numOfLines, crossViolation, alignContent, crossOffset, crossSpacing);
   
-  std::vector<ASStackLayoutSpecItem> positionedItems;
   CGPoint p = directionPoint(direction, 0, crossOffset);
   BOOL first = YES;
   for (const auto &line : lines) {
@@ -167,19 +168,18 @@ ASStackPositionedLayout ASStackPositionedLayout::compute(const ASStackUnposition
     }
     first = NO;
     
-    const auto &items = line.items;
     const auto stackViolation = ASStackUnpositionedLayout::computeStackViolation(line.stackDimensionSum, style, sizeRange);
     CGFloat stackOffset;
     CGFloat stackSpacing;
-    stackOffsetAndSpacingForEachItem(items.size(), stackViolation, justifyContent, stackOffset, stackSpacing);
+    stackOffsetAndSpacingForEachItem(line.end - line.begin, stackViolation, justifyContent, stackOffset, stackSpacing);
     
     setStackValueToPoint(direction, stackOffset, p);
-    positionItemsInLine(line, style, p, stackSpacing);
-    std::move(items.begin(), items.end(), std::back_inserter(positionedItems));
+    positionItemsInLine(line, layout.items, style, p, stackSpacing);
     
     p = p + directionPoint(direction, -stackOffset, line.crossSize);
   }
 
   const CGSize finalSize = directionSize(direction, layout.stackDimensionSum, layout.crossDimensionSum);
-  return {std::move(positionedItems), ASSizeRangeClamp(sizeRange, finalSize)};
+  // Lines are consecutive runs of items, so the items are already in order.
+  return {std::move(layout.items), ASSizeRangeClamp(sizeRange, finalSize)};
 }
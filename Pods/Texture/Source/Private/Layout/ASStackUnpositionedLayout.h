@@ -10,6 +10,7 @@
 #import <vector>
 
 #import <AsyncDisplayKit/ASLayout.h>
+#import <AsyncDisplayKit/ASSmallVector.h>
 #import <AsyncDisplayKit/ASStackLayoutSpecUtilities.h>
 #import <AsyncDisplayKit/ASStackLayoutSpec.h>
 
@@ -33,8 +34,10 @@ struct ASStackLayoutSpecItem {
 };
 
 struct ASStackUnpositionedLine {
-  /** The set of proposed children in this line, each contains child layout, not yet positioned. */
-  std::vector<ASStackLayoutSpecItem> items;
+  /** The index of the first item of this line in the layout's items. */
+  size_t begin;
+  /** One past the index of the last item of this line. */
+  size_t end;
   /** The total size of the children in the stack dimension, including all spacing. */
   CGFloat stackDimensionSum;
   /** The size in the cross dimension */
@@ -45,8 +48,10 @@ struct ASStackUnpositionedLine {
 
 /** Represents a set of stack layout children that have their final layout computed, but are not yet positioned. */
 struct ASStackUnpositionedLayout {
-  /** The set of proposed lines, each contains child layouts, not yet positioned. */
-  const std::vector<ASStackUnpositionedLine> lines;
+  /** The proposed children, line after line, each contains child layout, not yet positioned. Not const, so that positioning can take them over. */
+  std::vector<ASStackLayoutSpecItem> items;
+  /** The set of proposed lines, each a range of items. Stacks rarely wrap, so one line is kept inline. */
+  const AS::SmallVector<ASStackUnpositionedLine, 1> lines;
   /** 
    * In a single line stack (e.g no wrao), this is the total size of the children in the stack dimension, including all spacing.
    * In a multi-line stack, this is the largest stack dimension among lines.
@@ -9,15 +9,39 @@
 
 #import <AsyncDisplayKit/ASStackUnpositionedLayout.h>
 
+#import <pthread.h>
 #import <tgmath.h>
 #import <numeric>
 
 #import <AsyncDisplayKit/ASDispatch.h>
 #import <AsyncDisplayKit/ASLayoutSpecUtilities.h>
 #import <AsyncDisplayKit/ASLayoutElementStylePrivate.h>
+#import <AsyncDisplayKit/ASScratchArena.h>
+#import <AsyncDisplayKit/ASStackFlexSolver.h>
 
 CGFloat const kViolationEpsilon = 0.01;
 
+typedef AS::StackFlexItem<CGFloat> ASStackFlexItem;
+
+/**
+ Scratch memory for the flex solver, one arena per thread. Nested stacks are laid out recursively on the same thread and
+ open their scopes on top of their parent's.
+ */
+static AS::ScratchArena &scratchArena()
+{
+  static pthread_key_t k;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    pthread_key_create(&k, [](void *arena) { delete static_cast<AS::ScratchArena *>(arena); });
+  });
+  auto arena = static_cast<AS::ScratchArena *>(pthread_getspecific(k));
+  if (arena == nullptr) {
+    arena = new AS::ScratchArena();
+    pthread_setspecific(k, arena);
+  }
+  return *arena;
+}
+
 static CGFloat resolveCrossDimensionMaxForStretchChild(const ASStackLayoutSpecStyle &style,
                                                        const ASStackLayoutSpecChild &child,
                                                        const CGFloat stackMax,
@@ -105,7 +129,7 @@ static void dispatchApplyIfNeeded(size_t iterationCount, BOOL forced, void(^work
 
  @param lines unpositioned lines
  */
-static CGFloat computeLinesCrossDimensionSum(const std::vector<ASStackUnpositionedLine> &lines,
+static CGFloat computeLinesCrossDimensionSum(const AS::SmallVector<ASStackUnpositionedLine, 1> &lines,
                                              const ASStackLayoutSpecStyle &style)
 {
   return std::accumulate(lines.begin(), lines.end(),
@@ -193,16 +217,18 @@ CGFloat ASStackUnpositionedLayout::computeCrossViolation(const CGFloat crossDime
                                                                        |
                  +--------------------------------------------------+  + crossMax
 
- @param items pre-computed items; modified in-place as needed
+ @param items pre-computed items of one line; modified in-place as needed
+ @param count the number of items in the line
  @param style the layout style of the overall stack layout
  */
-static void stretchItemsAlongCrossDimension(std::vector<ASStackLayoutSpecItem> &items,
+static void stretchItemsAlongCrossDimension(ASStackLayoutSpecItem *items,
+                                            const size_t count,
                                             const ASStackLayoutSpecStyle &style,
                                             const BOOL concurrent,
                                             const CGSize parentSize,
                                             const CGFloat crossSize)
 {
-  dispatchApplyIfNeeded(items.size(), concurrent, ^(size_t i) {
+  dispatchApplyIfNeeded(count, concurrent, ^(size_t i) {
     auto &item = items[i];
     const ASStackLayoutAlignItems alignItems = alignment(item.child.style.alignSelf, style.alignItems);
     if (alignItems == ASStackLayoutAlignItemsStretch) {
@@ -223,7 +249,8 @@ static void stretchItemsAlongCrossDimension(std::vector<ASStackLayoutSpecItem> &
  * https://www.w3.org/TR/css-flexbox-1/#algo-line-stretch
  * https://www.w3.org/TR/css-flexbox-1/#algo-stretch
  */
-static void stretchLinesAlongCrossDimension(std::vector<ASStackUnpositionedLine> &lines,
+static void stretchLinesAlongCrossDimension(AS::SmallVector<ASStackUnpositionedLine, 1> &lines,
+                                            std::vector<ASStackLayoutSpecItem> &items,
                                             const ASStackLayoutSpecStyle &style,
                                             const BOOL concurrent,
                                             const ASSizeRange &sizeRange,
@@ -243,7 +270,7 @@ static void stretchLinesAlongCrossDimension(std::vector<ASStackUnpositionedLine>
       line.crossSize += extraCrossSizePerLine;
     }
     
-    stretchItemsAlongCrossDimension(line.items, style, concurrent, parentSize, line.crossSize);
+    stretchItemsAlongCrossDimension(&items[line.begin], line.end - line.begin, style, concurrent, parentSize, line.crossSize);
   }
 }
 
@@ -271,11 +298,13 @@ CGFloat ASStackUnpositionedLayout::baselineForItem(const ASStackLayoutSpecStyle
  * Computes cross size and baseline of each line.
  * https://www.w3.org/TR/css-flexbox-1/#algo-cross-line
  *
- * @param lines All items to lay out
+ * @param lines All lines to lay out
+ * @param items All items, line after line
  * @param style the layout style of the overall stack layout
  * @param sizeRange the range of allowable sizes for the stack layout component
  */
-static void computeLinesCrossSizeAndBaseline(std::vector<ASStackUnpositionedLine> &lines,
+static void computeLinesCrossSizeAndBaseline(AS::SmallVector<ASStackUnpositionedLine, 1> &lines,
+                                             const std::vector<ASStackLayoutSpecItem> &items,
                                              const ASStackLayoutSpecStyle &style,
                                              const ASSizeRange &sizeRange)
 {
@@ -293,7 +322,8 @@ static void computeLinesCrossSizeAndBaseline(std::vector<ASStackUnpositionedLine
     
     // We still need to determine the line's baseline
     //TODO unit test
-    for (const auto &item : line.items) {
+    for (size_t i = line.begin; i < line.end; i++) {
+      const auto &item = items[i];
       if (itemIsBaselineAligned(style, item)) {
         CGFloat baseline = ASStackUnpositionedLayout::baselineForItem(style, item);
         line.baseline = MAX(line.baseline, baseline);
@@ -304,12 +334,12 @@ static void computeLinesCrossSizeAndBaseline(std::vector<ASStackUnpositionedLine
   }
   
   for (auto &line : lines) {
-    const auto &items = line.items;
     CGFloat maxStartToBaselineDistance = 0;
     CGFloat maxBaselineToEndDistance = 0;
     CGFloat maxItemCrossSize = 0;
     
-    for (const auto &item : items) {
+    for (size_t i = line.begin; i < line.end; i++) {
+      const auto &item = items[i];
       if (itemIsBaselineAligned(style, item)) {
         // Step 1. Collect all the items whose align-self is baseline. Find the largest of the distances
         // between each item’s baseline and its hypothetical outer cross-start edge (aka. its baseline value),
@@ -336,110 +366,49 @@ static void computeLinesCrossSizeAndBaseline(std::vector<ASStackUnpositionedLine
 }
 
 /**
- Returns a lambda that computes the relevant flex factor based on the given violation.
- @param violation The amount that the stack layout violates its size range.  See header for sign interpretation.
+ Snapshots the flex properties of each child into the solver's items, so the flex passes never go back to the style.
  */
-static std::function<CGFloat(const ASStackLayoutSpecItem &)> flexFactorInViolationDirection(const CGFloat violation)
+static void snapshotFlexItems(const std::vector<ASStackLayoutSpecChild> &children, ASStackFlexItem *flexItems)
 {
-  if (std::fabs(violation) < kViolationEpsilon) {
-    return [](const ASStackLayoutSpecItem &item) { return 0.0; };
-  } else if (violation > 0) {
-    return [](const ASStackLayoutSpecItem &item) { return item.child.style.flexGrow; };
-  } else {
-    return [](const ASStackLayoutSpecItem &item) { return item.child.style.flexShrink; };
+  for (size_t i = 0; i < children.size(); i++) {
+    ASLayoutElementStyle *style = children[i].style;
+    flexItems[i] = {.stackSize = 0,
+                    .flexGrow = style.flexGrow,
+                    .flexShrink = style.flexShrink,
+                    .spacingBefore = style.spacingBefore,
+                    .spacingAfter = style.spacingAfter,
+                    .flexed = false,
+                    .flexedStackSize = 0};
   }
 }
 
-static inline CGFloat scaledFlexShrinkFactor(const ASStackLayoutSpecItem &item,
-                                             const ASStackLayoutSpecStyle &style,
-                                             const CGFloat flexFactorSum)
-{
-  return stackDimension(style.direction, item.layout.size) * (item.child.style.flexShrink / flexFactorSum);
-}
-
-/**
- Returns a lambda that computes a flex shrink adjustment for a given item based on the provided violation.
- @param items The unpositioned items from the original unconstrained layout pass.
- @param style The layout style to be applied to all children.
- @param violation The amount that the stack layout violates its size range.
- @param flexFactorSum The sum of each item's flex factor as determined by the provided violation.
- @return A lambda capable of computing the flex shrink adjustment, if any, for a particular item.
- */
-static std::function<CGFloat(const ASStackLayoutSpecItem &)> flexShrinkAdjustment(const std::vector<ASStackLayoutSpecItem> &items,
-                                                                                  const ASStackLayoutSpecStyle &style,
-                                                                                  const CGFloat violation,
-                                                                                  const CGFloat flexFactorSum)
-{
-  const CGFloat scaledFlexShrinkFactorSum = std::accumulate(items.begin(), items.end(), 0.0, [&](CGFloat x, const ASStackLayoutSpecItem &item) {
-    return x + scaledFlexShrinkFactor(item, style, flexFactorSum);
-  });
-  return [style, scaledFlexShrinkFactorSum, violation, flexFactorSum](const ASStackLayoutSpecItem &item) {
-    if (scaledFlexShrinkFactorSum == 0.0) {
-      return (CGFloat)0.0;
-    }
-    
-    const CGFloat scaledFlexShrinkFactorRatio = scaledFlexShrinkFactor(item, style, flexFactorSum) / scaledFlexShrinkFactorSum;
-    // The item should shrink proportionally to the scaled flex shrink factor ratio computed above.
-    // Unlike the flex grow adjustment the flex shrink adjustment needs to take the size of each item into account.
-    return -std::fabs(scaledFlexShrinkFactorRatio * violation);
-  };
-}
-
-/**
- Returns a lambda that computes a flex grow adjustment for a given item based on the provided violation.
- @param items The unpositioned items from the original unconstrained layout pass.
- @param violation The amount that the stack layout violates its size range.
- @param flexFactorSum The sum of each item's flex factor as determined by the provided violation.
- @return A lambda capable of computing the flex grow adjustment, if any, for a particular item.
- */
-static std::function<CGFloat(const ASStackLayoutSpecItem &)> flexGrowAdjustment(const std::vector<ASStackLayoutSpecItem> &items,
-                                                                                const CGFloat violation,
-                                                                                const CGFloat flexFactorSum)
-{
-  // To compute the flex grow adjustment distribute the violation proportionally based on each item's flex grow factor.
-  return [violation, flexFactorSum](const ASStackLayoutSpecItem &item) {
-    return std::floor(violation * (item.child.style.flexGrow / flexFactorSum));
-  };
-}
-
 /**
- Returns a lambda that computes a flex adjustment for a given item based on the provided violation.
- @param items The unpositioned items from the original unconstrained layout pass.
- @param style The layout style to be applied to all children.
- @param violation The amount that the stack layout violates its size range.
- @param flexFactorSum The sum of each item's flex factor as determined by the provided violation.
- @return A lambda capable of computing the flex adjustment for a particular item.
+ Copies the stack dimension of each item's current layout into the solver's items.
  */
-static std::function<CGFloat(const ASStackLayoutSpecItem &)> flexAdjustmentInViolationDirection(const std::vector<ASStackLayoutSpecItem> &items,
-                                                                                                const ASStackLayoutSpecStyle &style,
-                                                                                                const CGFloat violation,
-                                                                                                const CGFloat flexFactorSum)
+static void updateFlexItemStackSizes(const std::vector<ASStackLayoutSpecItem> &items,
+                                     const ASStackLayoutSpecStyle &style,
+                                     ASStackFlexItem *flexItems)
 {
-  if (violation > 0) {
-    return flexGrowAdjustment(items, violation, flexFactorSum);
-  } else {
-    return flexShrinkAdjustment(items, style, violation, flexFactorSum);
+  for (size_t i = 0; i < items.size(); i++) {
+    flexItems[i].stackSize = stackDimension(style.direction, items[i].layout.size);
   }
 }
 
-ASDISPLAYNODE_INLINE BOOL isFlexibleInBothDirections(const ASStackLayoutSpecChild &child)
-{
-    return child.style.flexGrow > 0 && child.style.flexShrink > 0;
-}
-
 /**
  The flexible children may have been left not laid out in the initial layout pass, so we may have to go through and size
  these children at zero size so that the children layouts are at least present.
  */
-static void layoutFlexibleChildrenAtZeroSize(std::vector<ASStackLayoutSpecItem> &items,
+static void layoutFlexibleChildrenAtZeroSize(ASStackLayoutSpecItem *items,
+                                             const ASStackFlexItem *flexItems,
+                                             const size_t count,
                                              const ASStackLayoutSpecStyle &style,
                                              const BOOL concurrent,
                                              const ASSizeRange &sizeRange,
                                              const CGSize parentSize)
 {
-  dispatchApplyIfNeeded(items.size(), concurrent, ^(size_t i) {
+  dispatchApplyIfNeeded(count, concurrent, ^(size_t i) {
     auto &item = items[i];
-    if (isFlexibleInBothDirections(item.child)) {
+    if (flexItems[i].IsFlexibleInBothDirections()) {
       item.layout = crossChildLayout(item.child,
                                      style,
                                      0,
@@ -452,7 +421,7 @@ static void layoutFlexibleChildrenAtZeroSize(std::vector<ASStackLayoutSpecItem>
 }
 
 /**
- Computes the consumed stack dimension length for the given vector of items and stacking style.
+ Computes the consumed stack dimension length for the given items and stacking style.
 
               stackDimensionSum
           <----------------------->
@@ -462,27 +431,15 @@ static void layoutFlexibleChildrenAtZeroSize(std::vector<ASStackLayoutSpecItem>
           +-----+  |       |  +---+
                    +-------+
 
- @param items unpositioned layouts for items
+ @param flexItems the items of one line, with up to date stack sizes
+ @param count the number of items in the line
  @param style the layout style of the overall stack layout
  */
-static CGFloat computeItemsStackDimensionSum(const std::vector<ASStackLayoutSpecItem> &items,
+static CGFloat computeItemsStackDimensionSum(const ASStackFlexItem *flexItems,
+                                             const size_t count,
                                              const ASStackLayoutSpecStyle &style)
 {
-  // Sum up the children's spacing
-  const CGFloat childSpacingSum = std::accumulate(items.begin(), items.end(),
-                                                  // Start from default spacing between each child:
-                                                  items.empty() ? 0 : style.spacing * (items.size() - 1),
-                                                  [&](CGFloat x, const ASStackLayoutSpecItem &l) {
-                                                    return x + l.child.style.spacingBefore + l.child.style.spacingAfter;
-                                                  });
-
-  // Sum up the children's dimensions (including spacing) in the stack direction.
-  const CGFloat childStackDimensionSum = std::accumulate(items.begin(), items.end(),
-                                                         childSpacingSum,
-                                                         [&](CGFloat x, const ASStackLayoutSpecItem &l) {
-                                                           return x + stackDimension(style.direction, l.layout.size);
-                                                         });
-  return childStackDimensionSum;
+  return AS::StackDimensionSum(flexItems, count, style.spacing);
 }
 
 //TODO move this up near computeCrossViolation and make both methods share the same code path, to make sure they share the same concept of "negative" and "positive" violations.
@@ -521,25 +478,24 @@ CGFloat ASStackUnpositionedLayout::computeStackViolation(const CGFloat stackDime
                                                          const ASStackLayoutSpecStyle &style,
                                                          const ASSizeRange &sizeRange)
 {
-  const CGFloat minStackDimension = stackDimension(style.direction, sizeRange.min);
-  const CGFloat maxStackDimension = stackDimension(style.direction, sizeRange.max);
-  if (stackDimensionSum < minStackDimension) {
-    return minStackDimension - stackDimensionSum;
-  } else if (stackDimensionSum > maxStackDimension) {
-    return maxStackDimension - stackDimensionSum;
-  }
-  return 0;
+  return AS::StackViolation(stackDimensionSum,
+                            stackDimension(style.direction, sizeRange.min),
+                            stackDimension(style.direction, sizeRange.max));
 }
 
 /**
  If we have a single flexible (both shrinkable and growable) child, and our allowed size range is set to a specific
  number then we may avoid the first "intrinsic" size calculation.
  */
-ASDISPLAYNODE_INLINE BOOL useOptimizedFlexing(const std::vector<ASStackLayoutSpecChild> &children,
+ASDISPLAYNODE_INLINE BOOL useOptimizedFlexing(const ASStackFlexItem *flexItems,
+                                              const size_t count,
                                               const ASStackLayoutSpecStyle &style,
                                               const ASSizeRange &sizeRange)
 {
-  const NSUInteger flexibleChildren = std::count_if(children.begin(), children.end(), isFlexibleInBothDirections);
+  NSUInteger flexibleChildren = 0;
+  for (size_t i = 0; i < count; i++) {
+    flexibleChildren += flexItems[i].IsFlexibleInBothDirections() ? 1 : 0;
+  }
   return ((flexibleChildren == 1)
           && (stackDimension(style.direction, sizeRange.min) ==
               stackDimension(style.direction, sizeRange.max)));
@@ -547,76 +503,57 @@ ASDISPLAYNODE_INLINE BOOL useOptimizedFlexing(const std::vector<ASStackLayoutSpe
 
 /**
  Flexes children in the stack axis to resolve a min or max stack size violation. First, determines which children are
- flexible (see computeStackViolation and isFlexibleInViolationDirection). Then computes how much to flex each flexible child
+ flexible (see computeStackViolation and AS::FlexStackLine). Then computes how much to flex each flexible child
  and performs re-layout. Note that there may still be a non-zero violation even after flexing.
 
  The actual CSS flexbox spec describes an iterative looping algorithm here, which may be adopted in t5837937:
  http://www.w3.org/TR/css3-flexbox/#resolve-flexible-lengths
 
- @param lines reference to unpositioned lines and items from the original, unconstrained layout pass; modified in-place
+ @param lines unpositioned lines from the original, unconstrained layout pass
+ @param items unpositioned items, line after line; modified in-place
+ @param flexItems the solver's view of items, with the stack sizes of the unconstrained layout pass
  @param style layout style to be applied to all children
  @param sizeRange the range of allowable sizes for the stack layout component
  @param parentSize Size of the stack layout component. May be undefined in either or both directions.
  */
-static void flexLinesAlongStackDimension(std::vector<ASStackUnpositionedLine> &lines,
+static void flexLinesAlongStackDimension(const AS::SmallVector<ASStackUnpositionedLine, 1> &lines,
+                                         std::vector<ASStackLayoutSpecItem> &items,
+                                         ASStackFlexItem *flexItems,
                                          const ASStackLayoutSpecStyle &style,
                                          const BOOL concurrent,
                                          const ASSizeRange &sizeRange,
                                          const CGSize parentSize,
                                          const BOOL useOptimizedFlexing)
 {
-  for (auto &line : lines) {
-    auto &items = line.items;
-    const CGFloat violation = ASStackUnpositionedLayout::computeStackViolation(computeItemsStackDimensionSum(items, style), style, sizeRange);
-    std::function<CGFloat(const ASStackLayoutSpecItem &)> flexFactor = flexFactorInViolationDirection(violation);
-    // The flex factor sum is needed to determine if flexing is necessary.
-    // This value is also needed if the violation is positive and flexible items need to grow, so keep it around.
-    const CGFloat flexFactorSum = std::accumulate(items.begin(), items.end(), 0.0, [&](CGFloat x, const ASStackLayoutSpecItem &item) {
-      return x + flexFactor(item);
-    });
+  for (const auto &line : lines) {
+    const size_t count = line.end - line.begin;
+    ASStackLayoutSpecItem *lineItems = &items[line.begin];
+    ASStackFlexItem *lineFlexItems = flexItems + line.begin;
+    const BOOL flexible = AS::FlexStackLine(lineFlexItems,
+                                            count,
+                                            style.spacing,
+                                            stackDimension(style.direction, sizeRange.min),
+                                            stackDimension(style.direction, sizeRange.max),
+                                            kViolationEpsilon);
     
     // If no items are able to flex then there is nothing left to do with this line. Bail.
-    if (flexFactorSum == 0) {
+    if (!flexible) {
       // If optimized flexing was used then we have to clean up the unsized items and lay them out at zero size.
       if (useOptimizedFlexing) {
-        layoutFlexibleChildrenAtZeroSize(items, style, concurrent, sizeRange, parentSize);
+        layoutFlexibleChildrenAtZeroSize(lineItems, lineFlexItems, count, style, concurrent, sizeRange, parentSize);
       }
       continue;
     }
     
-    std::function<CGFloat(const ASStackLayoutSpecItem &)> flexAdjustment = flexAdjustmentInViolationDirection(items,
-                                                                                                              style,
-                                                                                                              violation,
-                                                                                                              flexFactorSum);
-    // Compute any remaining violation to the first flexible item.
-    const CGFloat remainingViolation = std::accumulate(items.begin(), items.end(), violation, [&](CGFloat x, const ASStackLayoutSpecItem &item) {
-      return x - flexAdjustment(item);
-    });
-    
-    size_t firstFlexItem = -1;
-    for(size_t i = 0; i < items.size(); i++) {
+    dispatchApplyIfNeeded(count, concurrent, ^(size_t i) {
+      const auto &flexItem = lineFlexItems[i];
       // Items are consider inflexible if they do not need to make a flex adjustment.
-      if (flexAdjustment(items[i]) != 0) {
-        firstFlexItem = i;
-        break;
-      }
-    }
-    if (firstFlexItem == -1) {
-      continue;
-    }
-    
-    dispatchApplyIfNeeded(items.size(), concurrent, ^(size_t i) {
-      auto &item = items[i];
-      const CGFloat currentFlexAdjustment = flexAdjustment(item);
-      // Items are consider inflexible if they do not need to make a flex adjustment.
-      if (currentFlexAdjustment != 0) {
-        const CGFloat originalStackSize = stackDimension(style.direction, item.layout.size);
-        // Only apply the remaining violation for the first flexible item that has a flex grow factor.
-        const CGFloat flexedStackSize = originalStackSize + currentFlexAdjustment + (i == firstFlexItem && item.child.style.flexGrow > 0 ? remainingViolation : 0);
+      if (flexItem.flexed) {
+        auto &item = lineItems[i];
         item.layout = crossChildLayout(item.child,
                                        style,
-                                       MAX(flexedStackSize, 0),
-                                       MAX(flexedStackSize, 0),
+                                       flexItem.flexedStackSize,
+                                       flexItem.flexedStackSize,
                                        crossDimension(style.direction, sizeRange.min),
                                        crossDimension(style.direction, sizeRange.max),
                                        parentSize);
@@ -628,42 +565,22 @@ static void flexLinesAlongStackDimension(std::vector<ASStackUnpositionedLine> &l
 /**
  https://www.w3.org/TR/css-flexbox-1/#algo-line-break
  */
-static std::vector<ASStackUnpositionedLine> collectChildrenIntoLines(const std::vector<ASStackLayoutSpecItem> &items,
-                                                                     const ASStackLayoutSpecStyle &style,
-                                                                     const ASSizeRange &sizeRange)
+static AS::SmallVector<ASStackUnpositionedLine, 1> collectChildrenIntoLines(const ASStackFlexItem *flexItems,
+                                                                           const size_t count,
+                                                                           const ASStackLayoutSpecStyle &style,
+                                                                           const ASSizeRange &sizeRange)
 {
   //TODO if infinite max stack size, fast path
-  if (style.flexWrap == ASStackLayoutFlexWrapNoWrap) {
-    return std::vector<ASStackUnpositionedLine> (1, {.items = std::move(items)});
-  }
-  
-  std::vector<ASStackUnpositionedLine> lines;
-  std::vector<ASStackLayoutSpecItem> lineItems;
-  CGFloat lineStackDimensionSum = 0;
-  CGFloat interitemSpacing = 0;
-
-  for(auto it = items.begin(); it != items.end(); ++it) {
-    const auto &item = *it;
-    const CGFloat itemStackDimension = stackDimension(style.direction, item.layout.size);
-    const CGFloat itemAndSpacingStackDimension = item.child.style.spacingBefore + itemStackDimension + item.child.style.spacingAfter;
-    const BOOL negativeViolationIfAddItem = (ASStackUnpositionedLayout::computeStackViolation(lineStackDimensionSum + interitemSpacing + itemAndSpacingStackDimension, style, sizeRange) < 0);
-    const BOOL breakCurrentLine = negativeViolationIfAddItem && !lineItems.empty();
-    
-    if (breakCurrentLine) {
-      lines.push_back({.items = std::vector<ASStackLayoutSpecItem> (lineItems)});
-      lineItems.clear();
-      lineStackDimensionSum = 0;
-      interitemSpacing = 0;
-    }
-    
-    lineItems.push_back(std::move(item));
-    lineStackDimensionSum += interitemSpacing + itemAndSpacingStackDimension;
-    interitemSpacing = style.spacing;
-  }
-  
-  // Handle last line
-  lines.push_back({.items = std::vector<ASStackLayoutSpecItem> (lineItems)});
-  
+  AS::SmallVector<ASStackUnpositionedLine, 1> lines;
+  AS::CollectStackLines(flexItems,
+                        count,
+                        style.spacing,
+                        stackDimension(style.direction, sizeRange.min),
+                        stackDimension(style.direction, sizeRange.max),
+                        style.flexWrap != ASStackLayoutFlexWrapNoWrap,
+                        [&](size_t begin, size_t end) {
+                          lines.push_back({.begin = begin, .end = end});
+                        });
   return lines;
 }
 
@@ -672,6 +589,7 @@ static std::vector<ASStackUnpositionedLine> collectChildrenIntoLines(const std::
  stretched.
  */
 static void layoutItemsAlongUnconstrainedStackDimension(std::vector<ASStackLayoutSpecItem> &items,
+                                                        const ASStackFlexItem *flexItems,
                                                         const ASStackLayoutSpecStyle &style,
                                                         const BOOL concurrent,
                                                         const ASSizeRange &sizeRange,
@@ -683,7 +601,7 @@ static void layoutItemsAlongUnconstrainedStackDimension(std::vector<ASStackLayou
   
   dispatchApplyIfNeeded(items.size(), concurrent, ^(size_t i) {
     auto &item = items[i];
-    if (useOptimizedFlexing && isFlexibleInBothDirections(item.child)) {
+    if (useOptimizedFlexing && flexItems[i].IsFlexibleInBothDirections()) {
       item.layout = [ASLayout layoutWithLayoutElement:item.child.element size:{0, 0}];
     } else {
       item.layout = crossChildLayout(item.child,
@@ -713,8 +631,14 @@ ASStackUnpositionedLayout ASStackUnpositionedLayout::compute(const std::vector<A
     (sizeRange.min.height == sizeRange.max.height) ? sizeRange.min.height : ASLayoutElementParentDimensionUndefined,
   };
 
+  // The flex solver works on plain structs in this thread's scratch arena. Children laid out below open their own
+  // scopes on top of this one, and everything is released when this layout returns.
+  AS::ScratchArena::Scope scratch(scratchArena());
+  ASStackFlexItem *flexItems = scratch.Allocate<ASStackFlexItem>(children.size());
+  snapshotFlexItems(children, flexItems);
+
   // We may be able to avoid some redundant layout passes
-  const BOOL optimizedFlexing = useOptimizedFlexing(children, style, sizeRange);
+  const BOOL optimizedFlexing = useOptimizedFlexing(flexItems, children.size(), style, sizeRange);
 
   std::vector<ASStackLayoutSpecItem> items = AS::map(children, [&](const ASStackLayoutSpecChild &child) -> ASStackLayoutSpecItem {
     return {child, nil};
@@ -724,29 +648,32 @@ ASStackUnpositionedLayout ASStackUnpositionedLayout::compute(const std::vector<A
   // the stack dimension.  This allows us to compute the "intrinsic" size of each child and find the available violation
   // which determines whether we must grow or shrink the flexible children.
   layoutItemsAlongUnconstrainedStackDimension(items,
+                                              flexItems,
                                               style,
                                               concurrent,
                                               sizeRange,
                                               parentSize,
                                               optimizedFlexing);
+  updateFlexItemStackSizes(items, style, flexItems);
   
   // Collect items into lines (https://www.w3.org/TR/css-flexbox-1/#algo-line-break)
-  std::vector<ASStackUnpositionedLine> lines = collectChildrenIntoLines(items, style, sizeRange);
+  AS::SmallVector<ASStackUnpositionedLine, 1> lines = collectChildrenIntoLines(flexItems, items.size(), style, sizeRange);
   
   // Resolve the flexible lengths (https://www.w3.org/TR/css-flexbox-1/#resolve-flexible-lengths)
-  flexLinesAlongStackDimension(lines, style, concurrent, sizeRange, parentSize, optimizedFlexing);
+  flexLinesAlongStackDimension(lines, items, flexItems, style, concurrent, sizeRange, parentSize, optimizedFlexing);
   
   // Calculate the cross size of each flex line (https://www.w3.org/TR/css-flexbox-1/#algo-cross-line)
-  computeLinesCrossSizeAndBaseline(lines, style, sizeRange);
+  computeLinesCrossSizeAndBaseline(lines, items, style, sizeRange);
   
   // Handle 'align-content: stretch' (https://www.w3.org/TR/css-flexbox-1/#algo-line-stretch)
   // Determine the used cross size of each item (https://www.w3.org/TR/css-flexbox-1/#algo-stretch)
-  stretchLinesAlongCrossDimension(lines, style, concurrent, sizeRange, parentSize);
+  stretchLinesAlongCrossDimension(lines, items, style, concurrent, sizeRange, parentSize);
   
   // Compute stack dimension sum of each line and the whole stack
+  updateFlexItemStackSizes(items, style, flexItems);
   CGFloat layoutStackDimensionSum = 0;
   for (auto &line : lines) {
-    line.stackDimensionSum = computeItemsStackDimensionSum(line.items, style);
+    line.stackDimensionSum = computeItemsStackDimensionSum(flexItems + line.begin, line.end - line.begin, style);
     // layoutStackDimensionSum is the max stackDimensionSum among all lines
     layoutStackDimensionSum = MAX(line.stackDimensionSum, layoutStackDimensionSum);
   }
@@ -754,5 +681,5 @@ ASStackUnpositionedLayout ASStackUnpositionedLayout::compute(const std::vector<A
   // This should be done before `lines` are moved to a new ASStackUnpositionedLayout struct (i.e `std::move(lines)`)
   CGFloat layoutCrossDimensionSum = computeLinesCrossDimensionSum(lines, style);
   
-  return {.lines = std::move(lines), .stackDimensionSum = layoutStackDimensionSum, .crossDimensionSum = layoutCrossDimensionSum};
+  return {.items = std::move(items), .lines = std::move(lines), .stackDimensionSum = layoutStackDimensionSum, .crossDimensionSum = layoutCrossDimensionSum};
 }